@@ -175,6 +175,17 @@ public class Collectd
   native public static int registerWrite (String name,
       CollectdWriteInterface object);
 
+  /**
+   * Registers a write callback which receives value lists in batches. The
+   * batch size is configured with the "BatchSize" and "BatchTimeout" options
+   * of the java plugin.
+   *
+   * @return Zero when successful, non-zero otherwise.
+   * @see CollectdBatchWriteInterface
+   */
+  native public static int registerBatchWrite (String name,
+      CollectdBatchWriteInterface object);
+
   /**
    * Java representation of collectd/src/plugin.h:plugin_register_flush
    *
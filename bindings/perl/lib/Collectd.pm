@@ -263,6 +263,45 @@ sub plugin_call_all {
 	return 1;
 }
 
+# Collectd::_plugin_write_batch ([type, ds, vl], ...).
+#
+# Used by the perl plugin to pass a batch of value lists to all write
+# callbacks at once. Each argument is a reference to the arguments of a single
+# write callback call.
+sub _plugin_write_batch {
+	my %plugins;
+
+	our $cb_name = undef;
+
+	{
+		lock %{$plugins[TYPE_WRITE]};
+		%plugins = %{$plugins[TYPE_WRITE]};
+	}
+
+	foreach my $plugin (keys %plugins) {
+		my $name = $plugins{$plugin}->{'cb_name'};
+		my $failed = 0;
+
+		foreach my $args (@_) {
+			# logging calls plugin_call_all() which resets $cb_name
+			$cb_name = $name;
+			next if (call_by_name (@$args));
+
+			my $err = $@ ? $@ : "callback returned false";
+
+			if (0 == $failed++) {
+				ERROR ("Execution of callback \"$name\" failed: $err");
+			}
+		}
+
+		if ($failed) {
+			WARNING ("${plugin}->write() failed for $failed of "
+				. scalar (@_) . " value lists.");
+		}
+	}
+	return 1;
+}
+
 # Collectd::plugin_register (type, name, data).
 #
 # type:
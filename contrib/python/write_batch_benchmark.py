@@ -0,0 +1,110 @@
+#!/usr/bin/python
+
+###############################################################################
+# Compares the cost of per-value and batched write callbacks.                #
+#                                                                             #
+# The read callback dispatches "Values" value lists per interval and a write  #
+# callback counts what it receives. Every "ReportInterval" seconds the number #
+# of value lists received and the CPU time used by the whole daemon are       #
+# logged. Since dispatching costs the same in both modes, the difference in   #
+# CPU time per value list is the overhead of the write path.                  #
+#                                                                             #
+# Run it once with "BatchSize 0" (one call per value list) and once with a    #
+# batch size, e.g.:                                                           #
+#                                                                             #
+#   <Plugin python>                                                           #
+#     ModulePath "/path/to/contrib/python"                                    #
+#     Import "write_batch_benchmark"                                          #
+#     <Module write_batch_benchmark>                                          #
+#       Values 10000                                                          #
+#       BatchSize 512                                                         #
+#     </Module>                                                               #
+#   </Plugin>                                                                 #
+#                                                                             #
+# Set "Values 0" to only measure values dispatched by other plugins, for      #
+# example received from collectd-tg by the network plugin.                    #
+###############################################################################
+
+import os
+import time
+import collectd
+
+config = {
+	'values': 10000,
+	'batch_size': 0,
+	'batch_timeout': 10.0,
+	'report_interval': 10.0,
+}
+
+state = {
+	'received': 0,
+	'begin': None,
+	'cpu': None,
+}
+
+def cpu_time():
+	t = os.times()
+	return t[0] + t[1]
+
+def configure(conf):
+	for node in conf.children:
+		key = node.key.lower()
+		if key == 'values':
+			config['values'] = int(node.values[0])
+		elif key == 'batchsize':
+			config['batch_size'] = int(node.values[0])
+		elif key == 'batchtimeout':
+			config['batch_timeout'] = float(node.values[0])
+		elif key == 'reportinterval':
+			config['report_interval'] = float(node.values[0])
+		else:
+			collectd.warning('write_batch_benchmark: Unknown config key: %s' % node.key)
+
+def read():
+	v = collectd.Values(plugin='write_batch_benchmark', type='gauge')
+	for i in range(config['values']):
+		v.dispatch(type_instance=str(i % 1000), values=[i])
+
+def report():
+	now = time.time()
+	if state['begin'] is None:
+		state['begin'] = now
+		state['cpu'] = cpu_time()
+		state['received'] = 0
+		return
+	elapsed = now - state['begin']
+	if elapsed < config['report_interval']:
+		return
+	cpu = cpu_time() - state['cpu']
+	received = state['received']
+	if received > 0:
+		collectd.info('write_batch_benchmark: batch_size %d: %d value lists in %.1f s, '
+			'%.1f value lists/s, %.2f us CPU per value list'
+			% (config['batch_size'], received, elapsed, received / elapsed,
+			1e6 * cpu / received))
+	state['begin'] = now
+	state['cpu'] = cpu_time()
+	state['received'] = 0
+
+def write(vl):
+	vl.values[0]
+	state['received'] += 1
+	report()
+
+def write_batch(records):
+	for r in records:
+		r.values[0]
+	state['received'] += len(records)
+	report()
+
+def init():
+	if config['values'] > 0:
+		collectd.register_read(read)
+	if config['batch_size'] > 0:
+		collectd.register_write(write_batch, batch_size=config['batch_size'],
+			batch_timeout=config['batch_timeout'])
+	else:
+		collectd.register_write(write)
+
+collectd.register_config(configure)
+collectd.register_init(init)
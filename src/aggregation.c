@@ -32,13 +32,25 @@
 #include "common.h"
 #include "configfile.h"
 #include "meta_data.h"
-#include "utils_cache.h" /* for uc_get_rate() */
+#include "utils_cache.h" /* for uc_get_rate_buffer() */
+#include "utils_sketch.h"
 #include "utils_subst.h"
 #include "utils_vl_lookup.h"
 
 #define AGG_MATCHES_ALL(str) (strcmp ("/.*/", str) == 0)
 #define AGG_FUNC_PLACEHOLDER "%{aggregation}"
 
+/* Number of accumulators per aggregation instance. Each write thread is
+ * assigned one of them, so that threads don't contend for the same lock. */
+#ifndef AGG_SHARDS_NUM
+# define AGG_SHARDS_NUM 8
+#endif
+
+/* Relative error of the calculated percentiles. */
+#ifndef AGG_PERCENTILE_ACCURACY
+# define AGG_PERCENTILE_ACCURACY 0.01
+#endif
+
 struct aggregation_s /* {{{ */
 {
   identifier_t ident;
@@ -57,17 +69,15 @@ struct aggregation_s /* {{{ */
   _Bool calc_min;
   _Bool calc_max;
   _Bool calc_stddev;
+
+  double *percentiles;
+  size_t percentiles_num;
 }; /* }}} */
 typedef struct aggregation_s aggregation_t;
 
-struct agg_instance_s;
-typedef struct agg_instance_s agg_instance_t;
-struct agg_instance_s /* {{{ */
+struct agg_shard_s /* {{{ */
 {
   pthread_mutex_t lock;
-  identifier_t ident;
-
-  int ds_type;
 
   derive_t num;
   gauge_t sum;
@@ -76,12 +86,32 @@ struct agg_instance_s /* {{{ */
   gauge_t min;
   gauge_t max;
 
+  sketch_t *sketch;
+}; /* }}} */
+typedef struct agg_shard_s agg_shard_t;
+
+struct agg_instance_s;
+typedef struct agg_instance_s agg_instance_t;
+struct agg_instance_s /* {{{ */
+{
+  identifier_t ident;
+
+  int ds_type;
+
+  agg_shard_t shards[AGG_SHARDS_NUM];
+
+  /* Only accessed by the read callback. */
+  sketch_t *sketch;
+  double const *percentiles;
+  size_t percentiles_num;
+
   rate_to_value_state_t *state_num;
   rate_to_value_state_t *state_sum;
   rate_to_value_state_t *state_average;
   rate_to_value_state_t *state_min;
   rate_to_value_state_t *state_max;
   rate_to_value_state_t *state_stddev;
+  rate_to_value_state_t *state_percentiles;
 
   agg_instance_t *next;
 }; /* }}} */
@@ -91,6 +121,10 @@ static lookup_t *lookup = NULL;
 static pthread_mutex_t agg_instance_list_lock = PTHREAD_MUTEX_INITIALIZER;
 static agg_instance_t *agg_instance_list_head = NULL;
 
+static pthread_key_t agg_shard_key;
+static pthread_mutex_t agg_shard_lock = PTHREAD_MUTEX_INITIALIZER;
+static size_t agg_shard_counter = 0;
+
 static _Bool agg_is_regex (char const *str) /* {{{ */
 {
   size_t len;
@@ -110,12 +144,50 @@ static _Bool agg_is_regex (char const *str) /* {{{ */
 
 static void agg_destroy (aggregation_t *agg) /* {{{ */
 {
+  if (agg == NULL)
+    return;
+
+  sfree (agg->percentiles);
   sfree (agg);
 } /* }}} void agg_destroy */
 
+/* Returns the index of the shard the calling thread updates. Threads are
+ * assigned a shard in a round-robin fashion the first time they call this
+ * function. */
+static size_t agg_shard_index (void) /* {{{ */
+{
+  void *ptr;
+
+  ptr = pthread_getspecific (agg_shard_key);
+  if (ptr == NULL)
+  {
+    pthread_mutex_lock (&agg_shard_lock);
+    /* Store "index + 1", because NULL means "unset". */
+    ptr = (void *) ((agg_shard_counter % AGG_SHARDS_NUM) + 1);
+    agg_shard_counter++;
+    pthread_mutex_unlock (&agg_shard_lock);
+
+    pthread_setspecific (agg_shard_key, ptr);
+  }
+
+  return (((size_t) ptr) - 1);
+} /* }}} size_t agg_shard_index */
+
+static void agg_shard_reset (agg_shard_t *shard) /* {{{ */
+{
+  shard->num = 0;
+  shard->sum = 0.0;
+  shard->squares_sum = 0.0;
+  shard->min = NAN;
+  shard->max = NAN;
+  sketch_reset (shard->sketch);
+} /* }}} void agg_shard_reset */
+
 /* Frees all dynamically allocated memory within the instance. */
 static void agg_instance_destroy (agg_instance_t *inst) /* {{{ */
 {
+  size_t i;
+
   if (inst == NULL)
     return;
 
@@ -133,17 +205,23 @@ static void agg_instance_destroy (agg_instance_t *inst) /* {{{ */
   }
   pthread_mutex_unlock (&agg_instance_list_lock);
 
+  for (i = 0; i < AGG_SHARDS_NUM; i++)
+  {
+    pthread_mutex_destroy (&inst->shards[i].lock);
+    sketch_destroy (inst->shards[i].sketch);
+  }
+  sketch_destroy (inst->sketch);
+
   sfree (inst->state_num);
   sfree (inst->state_sum);
   sfree (inst->state_average);
   sfree (inst->state_min);
   sfree (inst->state_max);
   sfree (inst->state_stddev);
+  sfree (inst->state_percentiles);
 
   memset (inst, 0, sizeof (*inst));
   inst->ds_type = -1;
-  inst->min = NAN;
-  inst->max = NAN;
 } /* }}} void agg_instance_destroy */
 
 static int agg_instance_create_name (agg_instance_t *inst, /* {{{ */
@@ -237,6 +315,7 @@ static agg_instance_t *agg_instance_create (data_set_t const *ds, /* {{{ */
     value_list_t const *vl, aggregation_t *agg)
 {
   agg_instance_t *inst;
+  size_t i;
 
   DEBUG ("aggregation plugin: Creating new instance.");
 
@@ -247,14 +326,16 @@ static agg_instance_t *agg_instance_create (data_set_t const *ds, /* {{{ */
     return (NULL);
   }
   memset (inst, 0, sizeof (*inst));
-  pthread_mutex_init (&inst->lock, /* attr = */ NULL);
 
   inst->ds_type = ds->ds[0].type;
 
   agg_instance_create_name (inst, vl, agg);
 
-  inst->min = NAN;
-  inst->max = NAN;
+  for (i = 0; i < AGG_SHARDS_NUM; i++)
+  {
+    pthread_mutex_init (&inst->shards[i].lock, /* attr = */ NULL);
+    agg_shard_reset (&inst->shards[i]);
+  }
 
 #define INIT_STATE(field) do { \
   inst->state_ ## field = NULL; \
@@ -279,6 +360,31 @@ static agg_instance_t *agg_instance_create (data_set_t const *ds, /* {{{ */
 
 #undef INIT_STATE
 
+  if (agg->percentiles_num > 0)
+  {
+    inst->percentiles = agg->percentiles;
+    inst->percentiles_num = agg->percentiles_num;
+
+    inst->state_percentiles = calloc (agg->percentiles_num,
+        sizeof (*inst->state_percentiles));
+    inst->sketch = sketch_create (AGG_PERCENTILE_ACCURACY);
+    for (i = 0; i < AGG_SHARDS_NUM; i++)
+      inst->shards[i].sketch = sketch_create (AGG_PERCENTILE_ACCURACY);
+
+    for (i = 0; i < AGG_SHARDS_NUM; i++)
+      if (inst->shards[i].sketch == NULL)
+        break;
+
+    if ((inst->state_percentiles == NULL) || (inst->sketch == NULL)
+        || (i < AGG_SHARDS_NUM))
+    {
+      agg_instance_destroy (inst);
+      free (inst);
+      ERROR ("aggregation plugin: Allocating percentile state failed.");
+      return (NULL);
+    }
+  }
+
   pthread_mutex_lock (&agg_instance_list_lock);
   inst->next = agg_instance_list_head;
   agg_instance_list_head = inst;
@@ -294,7 +400,9 @@ static agg_instance_t *agg_instance_create (data_set_t const *ds, /* {{{ */
 static int agg_instance_update (agg_instance_t *inst, /* {{{ */
     data_set_t const *ds, value_list_t const *vl)
 {
-  gauge_t *rate;
+  agg_shard_t *shard;
+  gauge_t rate;
+  int status;
 
   if (ds->ds_num != 1)
   {
@@ -304,8 +412,8 @@ static int agg_instance_update (agg_instance_t *inst, /* {{{ */
     return (EINVAL);
   }
 
-  rate = uc_get_rate (ds, vl);
-  if (rate == NULL)
+  status = uc_get_rate_buffer (ds, vl, &rate, /* ret_values_num = */ 1);
+  if (status != 0)
   {
     char ident[6 * DATA_MAX_NAME_LEN];
     FORMAT_VL (ident, sizeof (ident), vl);
@@ -314,26 +422,27 @@ static int agg_instance_update (agg_instance_t *inst, /* {{{ */
     return (ENOENT);
   }
 
-  if (isnan (rate[0]))
-  {
-    sfree (rate);
+  if (isnan (rate))
     return (0);
-  }
 
-  pthread_mutex_lock (&inst->lock);
+  shard = inst->shards + agg_shard_index ();
+
+  pthread_mutex_lock (&shard->lock);
 
-  inst->num++;
-  inst->sum += rate[0];
-  inst->squares_sum += (rate[0] * rate[0]);
+  shard->num++;
+  shard->sum += rate;
+  shard->squares_sum += (rate * rate);
 
-  if (isnan (inst->min) || (inst->min > rate[0]))
-    inst->min = rate[0];
-  if (isnan (inst->max) || (inst->max < rate[0]))
-    inst->max = rate[0];
+  if (isnan (shard->min) || (shard->min > rate))
+    shard->min = rate;
+  if (isnan (shard->max) || (shard->max < rate))
+    shard->max = rate;
 
-  pthread_mutex_unlock (&inst->lock);
+  if (shard->sketch != NULL)
+    sketch_add (shard->sketch, rate);
+
+  pthread_mutex_unlock (&shard->lock);
 
-  sfree (rate);
   return (0);
 } /* }}} int agg_instance_update */
 
@@ -379,6 +488,8 @@ static int agg_instance_read_func (agg_instance_t *inst, /* {{{ */
 static int agg_instance_read (agg_instance_t *inst, cdtime_t t) /* {{{ */
 {
   value_list_t vl = VALUE_LIST_INIT;
+  agg_shard_t total;
+  size_t i;
 
   /* Pre-set all the fields in the value list that will not change per
    * aggregation type (sum, average, ...). The struct will be re-used and must
@@ -408,30 +519,62 @@ static int agg_instance_read (agg_instance_t *inst, cdtime_t t) /* {{{ */
   } \
 } while (0)
 
-  pthread_mutex_lock (&inst->lock);
+  /* Merge and reset the per-thread accumulators. The shard locks are only
+   * held for copying, not while dispatching. */
+  memset (&total, 0, sizeof (total));
+  total.min = NAN;
+  total.max = NAN;
+  for (i = 0; i < AGG_SHARDS_NUM; i++)
+  {
+    agg_shard_t *shard = inst->shards + i;
 
-  READ_FUNC (num, (gauge_t) inst->num);
+    pthread_mutex_lock (&shard->lock);
+
+    if (shard->num > 0)
+    {
+      total.num += shard->num;
+      total.sum += shard->sum;
+      total.squares_sum += shard->squares_sum;
+
+      if (isnan (total.min) || (total.min > shard->min))
+        total.min = shard->min;
+      if (isnan (total.max) || (total.max < shard->max))
+        total.max = shard->max;
+
+      if (inst->sketch != NULL)
+        sketch_merge (inst->sketch, shard->sketch);
+
+      agg_shard_reset (shard);
+    }
+
+    pthread_mutex_unlock (&shard->lock);
+  }
+
+  READ_FUNC (num, (gauge_t) total.num);
 
   /* All other aggregations are only defined when there have been any values
    * at all. */
-  if (inst->num > 0)
+  if (total.num > 0)
   {
-    READ_FUNC (sum, inst->sum);
-    READ_FUNC (average, (inst->sum / ((gauge_t) inst->num)));
-    READ_FUNC (min, inst->min);
-    READ_FUNC (max, inst->max);
-    READ_FUNC (stddev, sqrt((((gauge_t) inst->num) * inst->squares_sum)
-          - (inst->sum * inst->sum)) / ((gauge_t) inst->num));
-  }
+    READ_FUNC (sum, total.sum);
+    READ_FUNC (average, (total.sum / ((gauge_t) total.num)));
+    READ_FUNC (min, total.min);
+    READ_FUNC (max, total.max);
+    READ_FUNC (stddev, sqrt((((gauge_t) total.num) * total.squares_sum)
+          - (total.sum * total.sum)) / ((gauge_t) total.num));
+
+    for (i = 0; i < inst->percentiles_num; i++)
+    {
+      char func[DATA_MAX_NAME_LEN];
 
-  /* Reset internal state. */
-  inst->num = 0;
-  inst->sum = 0.0;
-  inst->squares_sum = 0.0;
-  inst->min = NAN;
-  inst->max = NAN;
+      ssnprintf (func, sizeof (func), "percentile-%g", inst->percentiles[i]);
+      agg_instance_read_func (inst, func,
+          sketch_get_percentile (inst->sketch, inst->percentiles[i]),
+          inst->state_percentiles + i, &vl, inst->ident.plugin_instance, t);
+    }
+  }
 
-  pthread_mutex_unlock (&inst->lock);
+  sketch_reset (inst->sketch);
 
   meta_data_destroy (vl.meta);
   vl.meta = NULL;
@@ -482,6 +625,7 @@ static void agg_lookup_free_obj_callback (void *user_obj) /* {{{ */
  *     CalculateMinimum true
  *     CalculateMaximum true
  *     CalculateStddev true
+ *     CalculatePercentile 50 95 99
  *   </Aggregation>
  * </Plugin>
  */
@@ -521,6 +665,46 @@ static int agg_config_handle_group_by (oconfig_item_t const *ci, /* {{{ */
   return (0);
 } /* }}} int agg_config_handle_group_by */
 
+static int agg_config_handle_percentile (oconfig_item_t const *ci, /* {{{ */
+    aggregation_t *agg)
+{
+  int i;
+
+  for (i = 0; i < ci->values_num; i++)
+  {
+    double percent;
+    double *tmp;
+
+    if (ci->values[i].type != OCONFIG_TYPE_NUMBER)
+    {
+      ERROR ("aggregation plugin: Argument %i of the \"%s\" option "
+          "is not a number.", i + 1, ci->key);
+      continue;
+    }
+
+    percent = ci->values[i].value.number;
+    if ((percent <= 0.0) || (percent >= 100.0))
+    {
+      ERROR ("aggregation plugin: The value for \"%s\" must be between "
+          "0 and 100, exclusively.", ci->key);
+      continue;
+    }
+
+    tmp = realloc (agg->percentiles,
+        sizeof (*agg->percentiles) * (agg->percentiles_num + 1));
+    if (tmp == NULL)
+    {
+      ERROR ("aggregation plugin: realloc failed.");
+      return (ENOMEM);
+    }
+    agg->percentiles = tmp;
+    agg->percentiles[agg->percentiles_num] = percent;
+    agg->percentiles_num++;
+  } /* for (ci->values) */
+
+  return (0);
+} /* }}} int agg_config_handle_percentile */
+
 static int agg_config_aggregation (oconfig_item_t *ci) /* {{{ */
 {
   aggregation_t *agg;
@@ -585,6 +769,8 @@ static int agg_config_aggregation (oconfig_item_t *ci) /* {{{ */
       cf_util_get_boolean (child, &agg->calc_max);
     else if (strcasecmp ("CalculateStddev", child->key) == 0)
       cf_util_get_boolean (child, &agg->calc_stddev);
+    else if (strcasecmp ("CalculatePercentile", child->key) == 0)
+      agg_config_handle_percentile (child, agg);
     else
       WARNING ("aggregation plugin: The \"%s\" key is not allowed inside "
           "<Aggregation /> blocks and will be ignored.", child->key);
@@ -647,7 +833,8 @@ static int agg_config_aggregation (oconfig_item_t *ci) /* {{{ */
   } /* }}} */
 
   if (!agg->calc_num && !agg->calc_sum && !agg->calc_average /* {{{ */
-      && !agg->calc_min && !agg->calc_max && !agg->calc_stddev)
+      && !agg->calc_min && !agg->calc_max && !agg->calc_stddev
+      && (agg->percentiles_num == 0))
   {
     ERROR ("aggregation plugin: No aggregation function has been specified. "
         "Without this, I don't know what I should be calculating. "
@@ -660,7 +847,7 @@ static int agg_config_aggregation (oconfig_item_t *ci) /* {{{ */
 
   if (!is_valid) /* {{{ */
   {
-    sfree (agg);
+    agg_destroy (agg);
     return (-1);
   } /* }}} */
 
@@ -668,7 +855,7 @@ static int agg_config_aggregation (oconfig_item_t *ci) /* {{{ */
   if (status != 0)
   {
     ERROR ("aggregation plugin: lookup_add failed with status %i.", status);
-    sfree (agg);
+    agg_destroy (agg);
     return (-1);
   }
 
@@ -680,6 +867,32 @@ static int agg_config_aggregation (oconfig_item_t *ci) /* {{{ */
   return (0);
 } /* }}} int agg_config_aggregation */
 
+static int agg_config_cache_size (oconfig_item_t *ci) /* {{{ */
+{
+  int cache_size = -1;
+  int status;
+
+  status = cf_util_get_int (ci, &cache_size);
+  if (status != 0)
+    return (status);
+
+  if (cache_size < 0)
+  {
+    ERROR ("aggregation plugin: CacheSize must not be negative.");
+    return (-1);
+  }
+
+  status = lookup_set_cache_size (lookup, (size_t) cache_size);
+  if (status != 0)
+  {
+    ERROR ("aggregation plugin: lookup_set_cache_size failed with status %i.",
+        status);
+    return (-1);
+  }
+
+  return (0);
+} /* }}} int agg_config_cache_size */
+
 static int agg_config (oconfig_item_t *ci) /* {{{ */
 {
   int i;
@@ -688,6 +901,17 @@ static int agg_config (oconfig_item_t *ci) /* {{{ */
 
   if (lookup == NULL)
   {
+    int status;
+
+    status = pthread_key_create (&agg_shard_key, /* destructor = */ NULL);
+    if (status != 0)
+    {
+      pthread_mutex_unlock (&agg_instance_list_lock);
+      ERROR ("aggregation plugin: pthread_key_create failed with status %i.",
+          status);
+      return (-1);
+    }
+
     lookup = lookup_create (agg_lookup_class_callback,
         agg_lookup_obj_callback,
         agg_lookup_free_class_callback,
@@ -700,24 +924,29 @@ static int agg_config (oconfig_item_t *ci) /* {{{ */
     }
   }
 
+  /* lookup_search() creates instances, taking agg_instance_list_lock, while
+   * holding the lookup's locks. Don't call lookup_add() with it held. */
+  pthread_mutex_unlock (&agg_instance_list_lock);
+
   for (i = 0; i < ci->children_num; i++)
   {
     oconfig_item_t *child = ci->children + i;
 
     if (strcasecmp ("Aggregation", child->key) == 0)
       agg_config_aggregation (child);
+    else if (strcasecmp ("CacheSize", child->key) == 0)
+      agg_config_cache_size (child);
     else
       WARNING ("aggregation plugin: The \"%s\" key is not allowed inside "
           "<Plugin aggregation /> blocks and will be ignored.", child->key);
   }
 
-  pthread_mutex_unlock (&agg_instance_list_lock);
-
   return (0);
 } /* }}} int agg_config */
 
 static int agg_read (void) /* {{{ */
 {
+  agg_instance_t *head;
   agg_instance_t *this;
   cdtime_t t;
   int success;
@@ -725,7 +954,13 @@ static int agg_read (void) /* {{{ */
   t = cdtime ();
   success = 0;
 
+  /* New instances are only ever prepended to the list and instances are not
+   * removed while the daemon is running, so it's sufficient to hold the lock
+   * while reading the head. This keeps the write callback from blocking on
+   * the list lock while all instances are being read. */
   pthread_mutex_lock (&agg_instance_list_lock);
+  head = agg_instance_list_head;
+  pthread_mutex_unlock (&agg_instance_list_lock);
 
   /* agg_instance_list_head only holds data, after the "write" callback has
    * been called with a matching value list at least once. So on startup,
@@ -733,13 +968,10 @@ static int agg_read (void) /* {{{ */
    * the read() callback is called first, agg_instance_list_head is NULL and
    * "success" may be zero. This is expected and should not result in an error.
    * Therefore we need to handle this case separately. */
-  if (agg_instance_list_head == NULL)
-  {
-    pthread_mutex_unlock (&agg_instance_list_lock);
+  if (head == NULL)
     return (0);
-  }
 
-  for (this = agg_instance_list_head; this != NULL; this = this->next)
+  for (this = head; this != NULL; this = this->next)
   {
     int status;
 
@@ -751,8 +983,6 @@ static int agg_read (void) /* {{{ */
       success++;
   }
 
-  pthread_mutex_unlock (&agg_instance_list_lock);
-
   return ((success > 0) ? 0 : -1);
 } /* }}} int agg_read */
 
@@ -29,6 +29,7 @@
 #include "collectd.h"
 #include "common.h"
 #include "plugin.h"
+#include "utils_avltree.h"
 
 #include <arpa/inet.h>
 #include <errno.h>
@@ -71,6 +72,9 @@
 /** Timeout interval in seconds */
 #define CEPH_TIMEOUT_INTERVAL 1
 
+/** Number of value lists collected before they are dispatched at once */
+#define CEPH_BATCH_SIZE 64
+
 /** Maximum path length for a UNIX domain socket on this system */
 #define UNIX_DOMAIN_SOCK_PATH_MAX (sizeof(((struct sockaddr_un*)0)->sun_path))
 
@@ -112,18 +116,29 @@ struct ceph_daemon
 
     /** Number of counters */
     int ds_num;
-    /** Track ds types */
-    uint32_t *ds_types;
-    /** Track ds names to match with types */
-    char **ds_names;
-
     /**
-     * Keep track of last data for latency values so we can calculate rate
-     * since last poll.
+     * Counters of the cached perf schema, keyed by their path in the perf
+     * dump (e.g. "osd.op_latency"). Maps to struct ceph_ds.
      */
-    struct last_data **last_poll_data;
-    /** index of last poll data */
-    int last_idx;
+    c_avl_tree_t *ds_tree;
+    /** The perf dump contained counters missing from the cached schema */
+    _Bool schema_stale;
+};
+
+/**
+ * A counter announced by the perf schema. Latency counters keep the sum/count
+ * pair of the last poll so we can calculate the average since then.
+ */
+struct ceph_ds
+{
+    /** Compacted counter name, used as type instance */
+    char name[DATA_MAX_NAME_LEN];
+    /** One of ceph_dset_type_d */
+    uint32_t type;
+
+    double last_sum;
+    uint64_t last_count;
+    _Bool have_last;
 };
 
 /******* JSON parsing *******/
@@ -165,6 +180,12 @@ static struct ceph_daemon **g_daemons = NULL;
 /** Number of elements in g_daemons */
 static int g_num_daemons = 0;
 
+/**
+ * Connection state for each element of g_daemons. Kept across intervals so
+ * the JSON buffers don't have to be allocated for every request.
+ */
+static struct cconn *g_conns = NULL;
+
 /**
  * A set of data that we build up in memory while parsing the JSON.
  */
@@ -174,31 +195,18 @@ struct values_tmp
     struct ceph_daemon *d;
     /** track avgcount across counters for avgcount/sum latency pairs */
     uint64_t avgcount;
-    /** current index of counters - used to get type of counter */
-    int index;
     /** do we already have an avgcount for latency pair */
     int avgcount_exists;
-    /**
-     * similar to index, but current index of latency type counters -
-     * used to get last poll data of counter
-     */
-    int latency_index;
     /**
      * values list - maintain across counters since
      * host/plugin/plugin instance are always the same
      */
     value_list_t vlist;
-};
 
-/**
- * A set of count/sum pairs to keep track of latency types and get difference
- * between this poll data and last poll data.
- */
-struct last_data
-{
-    char ds_name[DATA_MAX_NAME_LEN];
-    double last_sum;
-    uint64_t last_count;
+    /** value lists waiting to be dispatched by ceph_batch_flush */
+    value_list_t batch[CEPH_BATCH_SIZE];
+    value_t batch_values[CEPH_BATCH_SIZE];
+    size_t batch_num;
 };
 
 /******* network I/O *******/
@@ -242,6 +250,9 @@ struct cconn
     /** Buffer containing JSON data */
     unsigned char *json;
 
+    /** Allocated size of the JSON buffer, which is kept across requests */
+    size_t json_size;
+
     /** Keep data important to yajl processing */
     struct yajl_struct yajl;
 };
@@ -429,22 +440,33 @@ static void ceph_daemons_print(void)
     }
 }
 
-static void ceph_daemon_free(struct ceph_daemon *d)
+/** Forget the cached schema of a daemon */
+static void ceph_daemon_clear_ds(struct ceph_daemon *d)
 {
-    int i = 0;
-    for(; i < d->last_idx; i++)
-    {
-        sfree(d->last_poll_data[i]);
-    }
-    sfree(d->last_poll_data);
-    d->last_poll_data = NULL;
-    d->last_idx = 0;
-    for(i = 0; i < d->ds_num; i++)
+    char *key;
+    struct ceph_ds *ds;
+
+    if(d->ds_tree != NULL)
     {
-        sfree(d->ds_names[i]);
+        while(c_avl_pick(d->ds_tree, (void *) &key, (void *) &ds) == 0)
+        {
+            sfree(key);
+            sfree(ds);
+        }
+        c_avl_destroy(d->ds_tree);
+        d->ds_tree = NULL;
     }
-    sfree(d->ds_types);
-    sfree(d->ds_names);
+    d->ds_num = 0;
+}
+
+static _Bool ceph_daemon_needs_schema(const struct ceph_daemon *d)
+{
+    return (d->ds_num == 0) || d->schema_stale;
+}
+
+static void ceph_daemon_free(struct ceph_daemon *d)
+{
+    ceph_daemon_clear_ds(d);
     sfree(d);
 }
 
@@ -591,9 +613,17 @@ static int parse_keys (char *buffer, size_t buffer_size, const char *key_str)
 static int ceph_daemon_add_ds_entry(struct ceph_daemon *d, const char *name,
         int pc_type)
 {
-    uint32_t type;
-    char ds_name[DATA_MAX_NAME_LEN];
-    memset(ds_name, 0, sizeof(ds_name));
+    struct ceph_ds *ds;
+    char *key;
+    size_t key_len;
+    int status;
+
+    /* Only the "type" of each counter is of interest. Newer daemons also
+     * report numeric metadata, such as "priority", which is skipped here. */
+    if((count_parts(name) <= 2) || !has_suffix(name, ".type"))
+    {
+        return 0;
+    }
 
     if(convert_special_metrics)
     {
@@ -611,34 +641,48 @@ static int ceph_daemon_add_ds_entry(struct ceph_daemon *d, const char *name,
         }
     }
 
-    d->ds_names = realloc(d->ds_names, sizeof(char *) * (d->ds_num + 1));
-    if(!d->ds_names)
-    {
-        return -ENOMEM;
-    }
-
-    d->ds_types = realloc(d->ds_types, sizeof(uint32_t) * (d->ds_num + 1));
-    if(!d->ds_types)
+    if(d->ds_tree == NULL)
     {
-        return -ENOMEM;
+        d->ds_tree = c_avl_create((void *) strcmp);
+        if(d->ds_tree == NULL)
+        {
+            return -ENOMEM;
+        }
     }
 
-    d->ds_names[d->ds_num] = malloc(sizeof(char) * DATA_MAX_NAME_LEN);
-    if(!d->ds_names[d->ds_num])
+    ds = calloc(1, sizeof(*ds));
+    if(!ds)
     {
         return -ENOMEM;
     }
 
-    type = (pc_type & PERFCOUNTER_DERIVE) ? DSET_RATE :
+    ds->type = (pc_type & PERFCOUNTER_DERIVE) ? DSET_RATE :
             ((pc_type & PERFCOUNTER_LATENCY) ? DSET_LATENCY : DSET_BYTES);
-    d->ds_types[d->ds_num] = type;
 
-    if (parse_keys(ds_name, sizeof (ds_name), name))
+    if(parse_keys(ds->name, sizeof(ds->name), name))
     {
+        sfree(ds);
         return 1;
     }
 
-    sstrncpy(d->ds_names[d->ds_num], ds_name, DATA_MAX_NAME_LEN -1);
+    /* The perf dump reports the counter without the ".type" suffix. */
+    key_len = strlen(name) - strlen(".type");
+    key = malloc(key_len + 1);
+    if(!key)
+    {
+        sfree(ds);
+        return -ENOMEM;
+    }
+    sstrncpy(key, name, key_len + 1);
+
+    status = c_avl_insert(d->ds_tree, key, ds);
+    if(status != 0)
+    {
+        /* status > 0: duplicate counter, keep the first definition */
+        sfree(key);
+        sfree(ds);
+        return (status < 0) ? -ENOMEM : 0;
+    }
     d->ds_num = (d->ds_num + 1);
 
     return 0;
@@ -840,134 +884,59 @@ node_handler_define_schema(void *arg, const char *val, const char *key)
 }
 
 /**
- * Latency counter does not yet have an entry in last poll data - add it.
+ * Calculate average b/t current data and last poll data
+ * if last poll data exists
  */
-static int add_last(struct ceph_daemon *d, const char *ds_n, double cur_sum,
+static double get_last_avg(struct ceph_ds *ds, double cur_sum,
         uint64_t cur_count)
 {
-    d->last_poll_data[d->last_idx] = malloc(1 * sizeof(struct last_data));
-    if(!d->last_poll_data[d->last_idx])
-    {
-        return -ENOMEM;
-    }
-    sstrncpy(d->last_poll_data[d->last_idx]->ds_name,ds_n,
-            sizeof(d->last_poll_data[d->last_idx]->ds_name));
-    d->last_poll_data[d->last_idx]->last_sum = cur_sum;
-    d->last_poll_data[d->last_idx]->last_count = cur_count;
-    d->last_idx = (d->last_idx + 1);
-    return 0;
-}
+    double result = NAN;
 
-/**
- * Update latency counter or add new entry if it doesn't exist
- */
-static int update_last(struct ceph_daemon *d, const char *ds_n, int index,
-        double cur_sum, uint64_t cur_count)
-{
-    if((d->last_idx > index) && (strcmp(d->last_poll_data[index]->ds_name, ds_n) == 0))
+    if(ds->have_last && (cur_count > ds->last_count))
     {
-        d->last_poll_data[index]->last_sum = cur_sum;
-        d->last_poll_data[index]->last_count = cur_count;
-        return 0;
+        result = (cur_sum - ds->last_sum) / (cur_count - ds->last_count);
     }
 
-    if(!d->last_poll_data)
-    {
-        d->last_poll_data = malloc(1 * sizeof(struct last_data *));
-        if(!d->last_poll_data)
-        {
-            return -ENOMEM;
-        }
-    }
-    else
-    {
-        struct last_data **tmp_last = realloc(d->last_poll_data,
-                ((d->last_idx+1) * sizeof(struct last_data *)));
-        if(!tmp_last)
-        {
-            return -ENOMEM;
-        }
-        d->last_poll_data = tmp_last;
-    }
-    return add_last(d, ds_n, cur_sum, cur_count);
+    ds->last_sum = cur_sum;
+    ds->last_count = cur_count;
+    ds->have_last = 1;
+    return result;
 }
 
-/**
- * If using index guess failed (shouldn't happen, but possible if counters
- * get rearranged), resort to searching for counter name
- */
-static int backup_search_for_last_avg(struct ceph_daemon *d, const char *ds_n)
+/** Dispatch the collected value lists */
+static void ceph_batch_flush(struct values_tmp *vtmp)
 {
-    int i = 0;
-    for(; i < d->last_idx; i++)
+    if(vtmp->batch_num == 0)
     {
-        if(strcmp(d->last_poll_data[i]->ds_name, ds_n) == 0)
-        {
-            return i;
-        }
+        return;
     }
-    return -1;
+    plugin_dispatch_values_list(vtmp->batch, vtmp->batch_num);
+    vtmp->batch_num = 0;
 }
 
 /**
- * Calculate average b/t current data and last poll data
- * if last poll data exists
+ * Queue a value for dispatch. Values are dispatched in batches, so the write
+ * queue is locked once per batch instead of once per counter.
  */
-static double get_last_avg(struct ceph_daemon *d, const char *ds_n, int index,
-        double cur_sum, uint64_t cur_count)
+static void ceph_batch_add(struct values_tmp *vtmp, struct ceph_ds *ds,
+        value_t value)
 {
-    double result = -1.1, sum_delt = 0.0;
-    uint64_t count_delt = 0;
-    int tmp_index = 0;
-    if(d->last_idx > index)
-    {
-        if(strcmp(d->last_poll_data[index]->ds_name, ds_n) == 0)
-        {
-            tmp_index = index;
-        }
-        //test previous index
-        else if((index > 0) && (strcmp(d->last_poll_data[index-1]->ds_name, ds_n) == 0))
-        {
-            tmp_index = (index - 1);
-        }
-        else
-        {
-            tmp_index = backup_search_for_last_avg(d, ds_n);
-        }
-
-        if((tmp_index > -1) && (cur_count > d->last_poll_data[tmp_index]->last_count))
-        {
-            sum_delt = (cur_sum - d->last_poll_data[tmp_index]->last_sum);
-            count_delt = (cur_count - d->last_poll_data[tmp_index]->last_count);
-            result = (sum_delt / count_delt);
-        }
-    }
+    value_list_t *vl;
 
-    if(result == -1.1)
+    if(vtmp->batch_num >= CEPH_BATCH_SIZE)
     {
-        result = NAN;
-    }
-    if(update_last(d, ds_n, tmp_index, cur_sum, cur_count) == -ENOMEM)
-    {
-        return -ENOMEM;
+        ceph_batch_flush(vtmp);
     }
-    return result;
-}
 
-/**
- * If using index guess failed, resort to searching for counter name
- */
-static uint32_t backup_search_for_type(struct ceph_daemon *d, char *ds_name)
-{
-    int idx = 0;
-    for(; idx < d->ds_num; idx++)
-    {
-        if(strcmp(d->ds_names[idx], ds_name) == 0)
-        {
-            return d->ds_types[idx];
-        }
-    }
-    return DSET_TYPE_UNFOUND;
+    vl = vtmp->batch + vtmp->batch_num;
+    memcpy(vl, &vtmp->vlist, sizeof(*vl));
+    sstrncpy(vl->type, ceph_dset_types[ds->type], sizeof(vl->type));
+    sstrncpy(vl->type_instance, ds->name, sizeof(vl->type_instance));
+
+    vtmp->batch_values[vtmp->batch_num] = value;
+    vl->values = vtmp->batch_values + vtmp->batch_num;
+    vl->values_len = 1;
+    vtmp->batch_num++;
 }
 
 /**
@@ -979,47 +948,21 @@ static int node_handler_fetch_data(void *arg, const char *val, const char *key)
     double tmp_d;
     uint64_t tmp_u;
     struct values_tmp *vtmp = (struct values_tmp*) arg;
-    uint32_t type = DSET_TYPE_UNFOUND;
-    int index = vtmp->index;
-
-    char ds_name[DATA_MAX_NAME_LEN];
-    memset(ds_name, 0, sizeof(ds_name));
+    struct ceph_ds *ds = NULL;
 
-    if (parse_keys (ds_name, sizeof (ds_name), key))
+    if((vtmp->d->ds_tree == NULL)
+            || (c_avl_get(vtmp->d->ds_tree, key, (void *) &ds) != 0))
     {
-        return 1;
-    }
-
-    if(index >= vtmp->d->ds_num)
-    {
-        //don't overflow bounds of array
-        index = (vtmp->d->ds_num - 1);
-    }
-
-    /**
-     * counters should remain in same order we parsed schema... we maintain the
-     * index variable to keep track of current point in list of counters. first
-     * use index to guess point in array for retrieving type. if that doesn't
-     * work, use the old way to get the counter type
-     */
-    if(strcmp(ds_name, vtmp->d->ds_names[index]) == 0)
-    {
-        //found match
-        type = vtmp->d->ds_types[index];
-    }
-    else if((index > 0) && (strcmp(ds_name, vtmp->d->ds_names[index-1]) == 0))
-    {
-        //try previous key
-        type = vtmp->d->ds_types[index-1];
-    }
-
-    if(type == DSET_TYPE_UNFOUND)
-    {
-        //couldn't find right type by guessing, check the old way
-        type = backup_search_for_type(vtmp->d, ds_name);
+        /* The daemon was probably restarted with a different set of
+         * counters. Skip the counter and fetch the schema again during the
+         * next read. */
+        DEBUG("ceph plugin: %s: counter %s is not in the schema.",
+                vtmp->d->name, key);
+        vtmp->d->schema_stale = 1;
+        return 0;
     }
 
-    switch(type)
+    switch(ds->type)
     {
         case DSET_LATENCY:
             if(vtmp->avgcount_exists == -1)
@@ -1047,16 +990,11 @@ static int node_handler_fetch_data(void *arg, const char *val, const char *key)
                 }
                 else
                 {
-                    result = get_last_avg(vtmp->d, ds_name, vtmp->latency_index, sum, vtmp->avgcount);
-                    if(result == -ENOMEM)
-                    {
-                        return -ENOMEM;
-                    }
+                    result = get_last_avg(ds, sum, vtmp->avgcount);
                 }
 
                 uv.gauge = result;
                 vtmp->avgcount_exists = -1;
-                vtmp->latency_index = (vtmp->latency_index + 1);
             }
             break;
         case DSET_BYTES:
@@ -1069,18 +1007,11 @@ static int node_handler_fetch_data(void *arg, const char *val, const char *key)
             break;
         case DSET_TYPE_UNFOUND:
         default:
-            ERROR("ceph plugin: ds %s was not properly initialized.", ds_name);
+            ERROR("ceph plugin: ds %s was not properly initialized.", ds->name);
             return -1;
     }
 
-    sstrncpy(vtmp->vlist.type, ceph_dset_types[type], sizeof(vtmp->vlist.type));
-    sstrncpy(vtmp->vlist.type_instance, ds_name, sizeof(vtmp->vlist.type_instance));
-    vtmp->vlist.values = &uv;
-    vtmp->vlist.values_len = 1;
-
-    vtmp->index = (vtmp->index + 1);
-    plugin_dispatch_values(&vtmp->vlist);
-
+    ceph_batch_add(vtmp, ds, uv);
     return 0;
 }
 
@@ -1128,7 +1059,6 @@ static int cconn_connect(struct cconn *io)
     io->state = CSTATE_WRITE_REQUEST;
     io->amt = 0;
     io->json_len = 0;
-    io->json = NULL;
     return 0;
 }
 
@@ -1143,19 +1073,15 @@ static void cconn_close(struct cconn *io)
     io->asok = -1;
     io->amt = 0;
     io->json_len = 0;
-    sfree(io->json);
-    io->json = NULL;
 }
 
-/* Process incoming JSON counter data */
-static int
-cconn_process_data(struct cconn *io, yajl_struct *yajl, yajl_handle hand)
+/* Set up the state used while processing JSON counter data */
+static struct values_tmp *cconn_values_tmp_create(struct cconn *io)
 {
-    int ret;
     struct values_tmp *vtmp = calloc(1, sizeof(struct values_tmp) * 1);
     if(!vtmp)
     {
-        return -ENOMEM;
+        return NULL;
     }
 
     vtmp->vlist = (value_list_t)VALUE_LIST_INIT;
@@ -1165,12 +1091,7 @@ cconn_process_data(struct cconn *io, yajl_struct *yajl, yajl_handle hand)
 
     vtmp->d = io->d;
     vtmp->avgcount_exists = -1;
-    vtmp->latency_index = 0;
-    vtmp->index = 0;
-    yajl->handler_arg = vtmp;
-    ret = traverse_json(io->json, io->json_len, hand);
-    sfree(vtmp);
-    return ret;
+    return vtmp;
 }
 
 /**
@@ -1187,6 +1108,7 @@ static int cconn_process_json(struct cconn *io)
     int result = 1;
     yajl_handle hand;
     yajl_status status;
+    struct values_tmp *vtmp = NULL;
 
     hand = yajl_alloc(&callbacks,
 #if HAVE_YAJL_V2
@@ -1207,14 +1129,20 @@ static int cconn_process_json(struct cconn *io)
     switch(io->request_type)
     {
         case ASOK_REQ_DATA:
+            vtmp = cconn_values_tmp_create(io);
+            if(!vtmp)
+            {
+                result = -ENOMEM;
+                goto done;
+            }
             io->yajl.handler = node_handler_fetch_data;
-            result = cconn_process_data(io, &io->yajl, hand);
+            io->yajl.handler_arg = vtmp;
+            result = traverse_json(io->json, io->json_len, hand);
             break;
         case ASOK_REQ_SCHEMA:
-            //init daemon specific variables
-            io->d->ds_num = 0;
-            io->d->last_idx = 0;
-            io->d->last_poll_data = NULL;
+            //drop the previously cached schema
+            ceph_daemon_clear_ds(io->d);
+            io->d->schema_stale = 0;
             io->yajl.handler = node_handler_define_schema;
             io->yajl.handler_arg = io->d;
             result = traverse_json(io->json, io->json_len, hand);
@@ -1239,11 +1167,15 @@ static int cconn_process_json(struct cconn *io)
       ERROR ("ceph plugin: yajl_parse_complete failed: %s",
           (char *) errmsg);
       yajl_free_error (hand, errmsg);
-      yajl_free (hand);
-      return 1;
+      result = 1;
     }
 
     done:
+    if(vtmp != NULL)
+    {
+        ceph_batch_flush(vtmp);
+        sfree(vtmp);
+    }
     yajl_free (hand);
     return result;
 }
@@ -1358,12 +1290,19 @@ static int cconn_handle_event(struct cconn *io)
                 io->json_len = ntohl(io->json_len);
                 io->amt = 0;
                 io->state = CSTATE_READ_JSON;
-                io->json = calloc(1, io->json_len + 1);
-                if(!io->json)
+                if(io->json_size < ((size_t) io->json_len) + 1)
                 {
-                    ERROR("ceph plugin: error callocing io->json");
-                    return -ENOMEM;
+                    unsigned char *tmp = realloc(io->json,
+                            ((size_t) io->json_len) + 1);
+                    if(!tmp)
+                    {
+                        ERROR("ceph plugin: error reallocing io->json");
+                        return -ENOMEM;
+                    }
+                    io->json = tmp;
+                    io->json_size = ((size_t) io->json_len) + 1;
                 }
+                io->json[io->json_len] = 0;
             }
             return 0;
         }
@@ -1463,17 +1402,22 @@ static int cconn_main_loop(uint32_t request_type)
 {
     int i, ret, some_unreachable = 0;
     struct timeval end_tv;
-    struct cconn io_array[g_num_daemons];
+    struct cconn *io_array = g_conns;
 
     DEBUG("ceph plugin: entering cconn_main_loop(request_type = %d)", request_type);
 
-    /* create cconn array */
-    memset(io_array, 0, sizeof(io_array));
     for(i = 0; i < g_num_daemons; ++i)
     {
-        io_array[i].d = g_daemons[i];
         io_array[i].request_type = request_type;
         io_array[i].state = CSTATE_UNCONNECTED;
+
+        /* The schema is cached; only ask daemons which lack an up-to-date
+         * one. */
+        if((request_type == ASOK_REQ_VERSION)
+                && !ceph_daemon_needs_schema(io_array[i].d))
+        {
+            io_array[i].request_type = ASOK_REQ_NONE;
+        }
     }
 
     /** Calculate the time at which we should give up */
@@ -1574,15 +1518,45 @@ static int cconn_main_loop(uint32_t request_type)
 
 static int ceph_read(void)
 {
+    int i;
+
+    /* Fetch the schema of daemons that were unreachable so far or that
+     * reported unknown counters, e.g. after having been upgraded. */
+    for(i = 0; i < g_num_daemons; ++i)
+    {
+        if(ceph_daemon_needs_schema(g_daemons[i]))
+        {
+            cconn_main_loop(ASOK_REQ_VERSION);
+            break;
+        }
+    }
+
     return cconn_main_loop(ASOK_REQ_DATA);
 }
 
 /******* lifecycle *******/
 static int ceph_init(void)
 {
-    int ret;
+    int i, ret;
     ceph_daemons_print();
 
+    if(g_num_daemons == 0)
+    {
+        return 0;
+    }
+
+    g_conns = calloc(g_num_daemons, sizeof(*g_conns));
+    if(!g_conns)
+    {
+        ERROR("ceph plugin: calloc failed.");
+        return ENOMEM;
+    }
+    for(i = 0; i < g_num_daemons; ++i)
+    {
+        g_conns[i].d = g_daemons[i];
+        g_conns[i].asok = -1;
+    }
+
     ret = cconn_main_loop(ASOK_REQ_VERSION);
 
     return (ret) ? ret : 0;
@@ -1593,8 +1567,14 @@ static int ceph_shutdown(void)
     int i;
     for(i = 0; i < g_num_daemons; ++i)
     {
+        if(g_conns != NULL)
+        {
+            cconn_close(g_conns + i);
+            sfree(g_conns[i].json);
+        }
         ceph_daemon_free(g_daemons[i]);
     }
+    sfree(g_conns);
     sfree(g_daemons);
     g_daemons = NULL;
     g_num_daemons = 0;
@@ -177,10 +177,172 @@ DEF_TEST(parse_keys)
   return 0;
 }
 
+/* A fake admin socket which, like the real one, serves a single request per
+ * connection. */
+static char const *fake_schema;
+static char const *fake_data;
+static int fake_requests[3];
+static int fake_listen_fd = -1;
+static _Bool fake_shutdown = 0;
+static pthread_mutex_t fake_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void fake_asok_handle (int fd)
+{
+  char req[64];
+  size_t req_len = 0;
+  char const *ptr;
+  char const *json = NULL;
+  uint32_t n;
+  int request;
+
+  /* read the request, e.g. { "prefix": "2" } */
+  memset (req, 0, sizeof (req));
+  while (req_len < sizeof (req) - 1)
+  {
+    if ((read (fd, req + req_len, 1) != 1) || (req[req_len] == '\n'))
+      break;
+    req_len++;
+  }
+
+  ptr = strstr (req, "\"prefix\": \"");
+  if (ptr == NULL)
+    return;
+  request = atoi (ptr + strlen ("\"prefix\": \""));
+  if ((request < 0) || (request > 2))
+    return;
+
+  pthread_mutex_lock (&fake_lock);
+  fake_requests[request]++;
+  if (request == ASOK_REQ_DATA)
+    json = fake_data;
+  else if (request == ASOK_REQ_SCHEMA)
+    json = fake_schema;
+  pthread_mutex_unlock (&fake_lock);
+
+  n = htonl ((json != NULL) ? (uint32_t) strlen (json) : 1);
+  if (write (fd, &n, sizeof (n)) != sizeof (n))
+    return;
+  if ((json != NULL) && (write (fd, json, strlen (json)) < 0))
+    return;
+}
+
+static void *fake_asok_thread (void *arg)
+{
+  while (!fake_shutdown)
+  {
+    struct pollfd pfd = { fake_listen_fd, POLLIN, 0 };
+    int fd;
+
+    if (poll (&pfd, 1, /* timeout = */ 10) <= 0)
+      continue;
+
+    fd = accept (fake_listen_fd, NULL, NULL);
+    if (fd < 0)
+      continue;
+
+    fake_asok_handle (fd);
+    close (fd);
+  }
+
+  return (NULL);
+}
+
+DEF_TEST(cached_schema)
+{
+  char dir[] = "/tmp/ceph_test.XXXXXX";
+  struct sockaddr_un sa;
+  struct ceph_daemon *d;
+  struct ceph_ds *ds = NULL;
+  pthread_t thread;
+
+  fake_schema = "{\"osd\": {"
+      "\"op_w\": {\"type\": 10, \"description\": \"\", \"priority\": 5}, "
+      "\"op_latency\": {\"type\": 5}, "
+      "\"numpg\": {\"type\": 2}}}";
+  fake_data = "{\"osd\": {"
+      "\"op_w\": 42, "
+      "\"op_latency\": {\"avgcount\": 2, \"sum\": 0.5}, "
+      "\"numpg\": 7}}";
+
+  CHECK_NOT_NULL (mkdtemp (dir));
+
+  memset (&sa, 0, sizeof (sa));
+  sa.sun_family = AF_UNIX;
+  snprintf (sa.sun_path, sizeof (sa.sun_path), "%s/asok", dir);
+
+  fake_listen_fd = socket (PF_UNIX, SOCK_STREAM, 0);
+  OK (fake_listen_fd >= 0);
+  CHECK_ZERO (bind (fake_listen_fd, (struct sockaddr *) &sa, sizeof (sa)));
+  CHECK_ZERO (listen (fake_listen_fd, 8));
+  CHECK_ZERO (pthread_create (&thread, NULL, fake_asok_thread, NULL));
+
+  d = calloc (1, sizeof (*d));
+  CHECK_NOT_NULL (d);
+  sstrncpy (d->name, "osd.0", sizeof (d->name));
+  sstrncpy (d->asok_path, sa.sun_path, sizeof (d->asok_path));
+  g_daemons = calloc (1, sizeof (*g_daemons));
+  CHECK_NOT_NULL (g_daemons);
+  g_daemons[0] = d;
+  g_num_daemons = 1;
+
+  /* The schema is fetched once during init and cached afterwards. */
+  CHECK_ZERO (ceph_init ());
+  CHECK_ZERO (ceph_read ());
+  CHECK_ZERO (ceph_read ());
+
+  EXPECT_EQ_INT (3, d->ds_num);
+  CHECK_ZERO (c_avl_get (d->ds_tree, "osd.op_latency", (void *) &ds));
+  EXPECT_EQ_STR ("Osd.opLatency", ds->name);
+  EXPECT_EQ_INT (DSET_LATENCY, (int) ds->type);
+  EXPECT_EQ_UINT64 (2, ds->last_count);
+  CHECK_ZERO (c_avl_get (d->ds_tree, "osd.op_w", (void *) &ds));
+  EXPECT_EQ_INT (DSET_RATE, (int) ds->type);
+
+  pthread_mutex_lock (&fake_lock);
+  EXPECT_EQ_INT (1, fake_requests[ASOK_REQ_SCHEMA]);
+  EXPECT_EQ_INT (2, fake_requests[ASOK_REQ_DATA]);
+
+  /* An unknown counter in the perf dump causes the schema to be fetched
+   * again during the next read. */
+  fake_schema = "{\"osd\": {"
+      "\"op_w\": {\"type\": 10}, "
+      "\"op_r\": {\"type\": 10}, "
+      "\"op_latency\": {\"type\": 5}, "
+      "\"numpg\": {\"type\": 2}}}";
+  fake_data = "{\"osd\": {"
+      "\"op_w\": 43, "
+      "\"op_r\": 3, "
+      "\"op_latency\": {\"avgcount\": 4, \"sum\": 1.5}, "
+      "\"numpg\": 7}}";
+  pthread_mutex_unlock (&fake_lock);
+
+  CHECK_ZERO (ceph_read ());
+  OK (d->schema_stale);
+  CHECK_ZERO (ceph_read ());
+  OK (!d->schema_stale);
+  EXPECT_EQ_INT (4, d->ds_num);
+
+  pthread_mutex_lock (&fake_lock);
+  EXPECT_EQ_INT (2, fake_requests[ASOK_REQ_VERSION]);
+  EXPECT_EQ_INT (2, fake_requests[ASOK_REQ_SCHEMA]);
+  EXPECT_EQ_INT (4, fake_requests[ASOK_REQ_DATA]);
+  pthread_mutex_unlock (&fake_lock);
+
+  fake_shutdown = 1;
+  pthread_join (thread, NULL);
+  close (fake_listen_fd);
+  unlink (sa.sun_path);
+  rmdir (dir);
+
+  CHECK_ZERO (ceph_shutdown ());
+  return 0;
+}
+
 int main (void)
 {
   RUN_TEST(traverse_json);
   RUN_TEST(parse_keys);
+  RUN_TEST(cached_schema);
 
   END_TEST;
 }
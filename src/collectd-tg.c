@@ -40,34 +40,103 @@
 #include <signal.h>
 #include <errno.h>
 #include <math.h>
+#include <poll.h>
+#include <netdb.h>
+#include <pthread.h>
 #include <sys/time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
 
+#include "utils_avltree.h"
 #include "utils_heap.h"
+#include "utils_sketch.h"
 
 #include "libcollectdclient/collectd/client.h"
 #include "libcollectdclient/collectd/network.h"
 #include "libcollectdclient/collectd/network_buffer.h"
+#include "libcollectdclient/collectd/async.h"
 
 #define DEF_NUM_HOSTS    1000
 #define DEF_NUM_PLUGINS    20
 #define DEF_NUM_VALUES 100000
 #define DEF_INTERVAL       10.0
 
+/* In latency mode, plugin names start with this prefix so that the receiver
+ * can tell the generated value lists apart from other traffic. */
+#define LATENCY_PLUGIN_PREFIX "latency"
+
+/* Part types of the network protocol, see network.h. */
+#define TYPE_HOST            0x0000
+#define TYPE_TIME            0x0001
+#define TYPE_TIME_HR         0x0008
+#define TYPE_PLUGIN          0x0002
+#define TYPE_PLUGIN_INSTANCE 0x0003
+#define TYPE_TYPE            0x0004
+#define TYPE_TYPE_INSTANCE   0x0005
+#define TYPE_VALUES          0x0006
+#define TYPE_INTERVAL        0x0007
+#define TYPE_INTERVAL_HR     0x0009
+
 static int conf_num_hosts = DEF_NUM_HOSTS;
 static int conf_num_plugins = DEF_NUM_PLUGINS;
 static int conf_num_values = DEF_NUM_VALUES;
 static double conf_interval = DEF_INTERVAL;
 static const char *conf_destination = NET_DEFAULT_V6_ADDR;
+static _Bool conf_destination_set = 0;
 static const char *conf_service = NET_DEFAULT_PORT;
+static const char *conf_socket = NULL;
+static int conf_connections = 1;
+static int conf_batch_size = 1024;
+static int conf_protocol = LCC_PROTOCOL_TEXT;
+static double conf_duration = 0.0;
+static _Bool conf_flood = 0;
+static int conf_threads = 1;
+static double conf_zipf = 0.0;
+static int conf_seed = 1;
+static _Bool conf_latency = 0;
+static _Bool conf_receive = 0;
+static _Bool conf_json = 0;
+
+static lcc_async_t *async;
+
+/* Cumulative distribution of hosts, used with a Zipf distribution. */
+static double *host_cdf = NULL;
+
+struct sender_s
+{
+  pthread_t thread;
+  c_heap_t *values_heap;
+  lcc_network_t *net;
+  unsigned int seed;
+  uint64_t values_sent;
+};
+typedef struct sender_s sender_t;
+
+/* Last time received per identifier, used to detect lost values. */
+struct series_s
+{
+  double time;
+};
+typedef struct series_s series_t;
 
-static lcc_network_t *net;
-
-static c_heap_t *values_heap = NULL;
+struct receiver_s
+{
+  c_avl_tree_t *series;
+  sketch_t *latency;
+  uint64_t received;
+  uint64_t lost;
+  uint64_t reordered;
+  double first;
+  double last;
+};
+typedef struct receiver_s receiver_t;
 
 static struct sigaction sigint_action;
 static struct sigaction sigterm_action;
 
-static _Bool loop = 1;
+static volatile _Bool loop = 1;
 
 __attribute__((noreturn))
 static void exit_usage (int exit_status) /* {{{ */
@@ -81,11 +150,29 @@ static void exit_usage (int exit_status) /* {{{ */
       "    -n <number>    Number of value lists. (Default: %i)\n"
       "    -H <number>    Number of hosts to emulate. (Default: %i)\n"
       "    -p <number>    Number of plugins to emulate. (Default: %i)\n"
+      "    -z <exponent>  Distribute value lists over hosts following a\n"
+      "                   Zipf distribution. (Default: uniform)\n"
+      "    -r <seed>      Seed of the random number generator. (Default: 1)\n"
       "    -i <seconds>   Interval of each value in seconds. (Default: %.3f)\n"
       "    -d <dest>      Destination address of the network packets.\n"
       "                   (Default: %s)\n"
       "    -D <port>      Destination port of the network packets.\n"
       "                   (Default: %s)\n"
+      "    -s <address>   Send to the unixsock plugin listening at <address>\n"
+      "                   instead of sending network packets.\n"
+      "    -c <number>    Number of connections used with -s. (Default: 1)\n"
+      "    -b <number>    Number of value lists sent at once with -s.\n"
+      "                   (Default: 1024)\n"
+      "    -B             Send binary PUTVAL frames with -s.\n"
+      "    -T <number>    Number of sending threads. (Default: 1)\n"
+      "    -f             Send as fast as possible, ignoring the interval.\n"
+      "    -t <seconds>   Stop after this many seconds.\n"
+      "    -L             Send the current time as value, for measuring the\n"
+      "                   latency with -l.\n"
+      "    -l             Receive network packets on the address given with\n"
+      "                   -d and -D and report the latency of values sent\n"
+      "                   with -L.\n"
+      "    -j             Print a summary in JSON format when stopping.\n"
       "    -h             Print usage information (this output).\n"
       "\n"
       "Copyright (C) 2010-2012  Florian Forster\n"
@@ -101,18 +188,8 @@ static void signal_handler (int signal) /* {{{ */
   loop = 0;
 } /* }}} void signal_handler */
 
-#if HAVE_CLOCK_GETTIME
-static double dtime (void) /* {{{ */
-{
-  struct timespec ts = { 0 };
-
-  if (clock_gettime (CLOCK_MONOTONIC, &ts) != 0)
-    perror ("clock_gettime");
-
-  return ((double) ts.tv_sec) + (((double) ts.tv_nsec) / 1e9);
-} /* }}} double dtime */
-#else
-/* Work around for Mac OS X which doesn't have clock_gettime(2). *sigh* */
+/* Wall clock time, so that times sent by one instance can be compared with
+ * the time another instance received them. */
 static double dtime (void) /* {{{ */
 {
   struct timeval tv = { 0 };
@@ -122,7 +199,6 @@ static double dtime (void) /* {{{ */
 
   return ((double) tv.tv_sec) + (((double) tv.tv_usec) / 1e6);
 } /* }}} double dtime */
-#endif
 
 static int compare_time (const void *v0, const void *v1) /* {{{ */
 {
@@ -151,7 +227,55 @@ static int get_boundet_random (int min, int max) /* {{{ */
   return (min + ((int) (((double) range) * ((double) random ()) / (((double) RAND_MAX) + 1.0))));
 } /* }}} int get_boundet_random */
 
-static lcc_value_list_t *create_value_list (void) /* {{{ */
+static int host_cdf_create (void) /* {{{ */
+{
+  double sum = 0.0;
+  int i;
+
+  host_cdf = calloc ((size_t) conf_num_hosts, sizeof (*host_cdf));
+  if (host_cdf == NULL)
+    return (-1);
+
+  for (i = 0; i < conf_num_hosts; i++)
+  {
+    sum += 1.0 / pow ((double) (i + 1), conf_zipf);
+    host_cdf[i] = sum;
+  }
+  for (i = 0; i < conf_num_hosts; i++)
+    host_cdf[i] /= sum;
+
+  return (0);
+} /* }}} int host_cdf_create */
+
+static int get_host_num (void) /* {{{ */
+{
+  double r;
+  int lo;
+  int hi;
+
+  if (host_cdf == NULL)
+    return (get_boundet_random (0, conf_num_hosts));
+
+  r = ((double) random ()) / (((double) RAND_MAX) + 1.0);
+
+  /* Binary search for the first host whose cumulative probability is
+   * greater than "r". */
+  lo = 0;
+  hi = conf_num_hosts - 1;
+  while (lo < hi)
+  {
+    int mid = lo + (hi - lo) / 2;
+
+    if (host_cdf[mid] > r)
+      hi = mid;
+    else
+      lo = mid + 1;
+  }
+
+  return (lo);
+} /* }}} int get_host_num */
+
+static lcc_value_list_t *create_value_list (int index) /* {{{ */
 {
   lcc_value_list_t *vl;
   int host_num;
@@ -183,13 +307,13 @@ static lcc_value_list_t *create_value_list (void) /* {{{ */
 
   vl->values_len = 1;
 
-  host_num = get_boundet_random (0, conf_num_hosts);
+  host_num = get_host_num ();
 
   vl->interval = conf_interval;
   vl->time = 1.0 + dtime ()
     + (host_num % (1 + (int) vl->interval));
 
-  if (get_boundet_random (0, 2) == 0)
+  if (conf_latency || (get_boundet_random (0, 2) == 0))
     vl->values_types[0] = LCC_TYPE_GAUGE;
   else
     vl->values_types[0] = LCC_TYPE_DERIVE;
@@ -197,13 +321,14 @@ static lcc_value_list_t *create_value_list (void) /* {{{ */
   snprintf (vl->identifier.host, sizeof (vl->identifier.host),
       "host%04i", host_num);
   snprintf (vl->identifier.plugin, sizeof (vl->identifier.plugin),
-      "plugin%03i", get_boundet_random (0, conf_num_plugins));
+      "%s%03i", conf_latency ? LATENCY_PLUGIN_PREFIX : "plugin",
+      get_boundet_random (0, conf_num_plugins));
   strncpy (vl->identifier.type,
       (vl->values_types[0] == LCC_TYPE_GAUGE) ? "gauge" : "derive",
       sizeof (vl->identifier.type));
   vl->identifier.type[sizeof (vl->identifier.type) - 1] = 0;
   snprintf (vl->identifier.type_instance, sizeof (vl->identifier.type_instance),
-      "ti%li", random ());
+      "ti%i", index);
 
   return (vl);
 } /* }}} int create_value_list */
@@ -218,24 +343,95 @@ static void destroy_value_list (lcc_value_list_t *vl) /* {{{ */
   free (vl);
 } /* }}} void destroy_value_list */
 
-static int send_value (lcc_value_list_t *vl) /* {{{ */
+static int send_value (sender_t *s, lcc_value_list_t *vl) /* {{{ */
 {
   int status;
 
-  if (vl->values_types[0] == LCC_TYPE_GAUGE)
-    vl->values[0].gauge = 100.0 * ((gauge_t) random ()) / (((gauge_t) RAND_MAX) + 1.0);
+  if (conf_latency)
+    vl->values[0].gauge = dtime ();
+  else if (vl->values_types[0] == LCC_TYPE_GAUGE)
+    vl->values[0].gauge = 100.0 * ((gauge_t) rand_r (&s->seed)) / (((gauge_t) RAND_MAX) + 1.0);
   else
-    vl->values[0].derive += (derive_t) get_boundet_random (0, 100);
+    vl->values[0].derive += (derive_t) (rand_r (&s->seed) % 100);
 
-  status = lcc_network_values_send (net, vl);
-  if (status != 0)
-    fprintf (stderr, "lcc_network_values_send failed with status %i.\n", status);
+  if (async != NULL)
+  {
+    status = lcc_async_putval (async, vl);
+    if (status != 0)
+      fprintf (stderr, "lcc_async_putval failed with status %i.\n", status);
+  }
+  else
+  {
+    status = lcc_network_values_send (s->net, vl);
+    if (status != 0)
+      fprintf (stderr, "lcc_network_values_send failed with status %i.\n", status);
+  }
 
   vl->time += vl->interval;
 
   return (0);
 } /* }}} int send_value */
 
+static void *sender_thread (void *arg) /* {{{ */
+{
+  sender_t *s = arg;
+  double start_time = dtime ();
+  double last_time = 0;
+
+  while (loop)
+  {
+    lcc_value_list_t *vl = c_heap_get_root (s->values_heap);
+
+    if (vl == NULL)
+      break;
+
+    if ((conf_duration > 0.0) && ((s->values_sent % 1024) == 0)
+        && ((dtime () - start_time) >= conf_duration))
+    {
+      c_heap_insert (s->values_heap, vl);
+      break;
+    }
+
+    if (conf_flood)
+    {
+      /* Keep the order of the heap, but don't wait. */
+    }
+    else if (vl->time != last_time)
+    {
+      if (conf_threads == 1)
+        printf ("%"PRIu64" values have been sent.\n", s->values_sent);
+
+      /* Check if we need to sleep */
+      double now = dtime ();
+
+      while (loop && (now < vl->time))
+      {
+        double wait = vl->time - now;
+        struct timespec ts = { 0, 0 };
+
+        /* Sleep at most 1 / 100 second, so that signals are noticed. */
+        if (wait > 0.01)
+          wait = 0.01;
+        ts.tv_nsec = (long) (wait * 1e9);
+
+        nanosleep (&ts, /* remaining = */ NULL);
+        now = dtime ();
+      }
+      last_time = vl->time;
+    }
+
+    send_value (s, vl);
+    s->values_sent++;
+
+    c_heap_insert (s->values_heap, vl);
+  }
+
+  if (s->net != NULL)
+    lcc_network_flush (s->net);
+
+  return (NULL);
+} /* }}} void *sender_thread */
+
 static int get_integer_opt (const char *str, int *ret_value) /* {{{ */
 {
   char *endptr;
@@ -298,7 +494,7 @@ static int read_options (int argc, char **argv) /* {{{ */
 {
   int opt;
 
-  while ((opt = getopt (argc, argv, "n:H:p:i:d:D:h")) != -1)
+  while ((opt = getopt (argc, argv, "n:H:p:z:r:i:d:D:s:c:b:BT:ft:Lljh")) != -1)
   {
     switch (opt)
     {
@@ -314,18 +510,67 @@ static int read_options (int argc, char **argv) /* {{{ */
         get_integer_opt (optarg, &conf_num_plugins);
         break;
 
+      case 'z':
+        get_double_opt (optarg, &conf_zipf);
+        break;
+
+      case 'r':
+        get_integer_opt (optarg, &conf_seed);
+        break;
+
       case 'i':
         get_double_opt (optarg, &conf_interval);
         break;
 
       case 'd':
         conf_destination = optarg;
+        conf_destination_set = 1;
         break;
 
       case 'D':
         conf_service = optarg;
         break;
 
+      case 's':
+        conf_socket = optarg;
+        break;
+
+      case 'c':
+        get_integer_opt (optarg, &conf_connections);
+        break;
+
+      case 'b':
+        get_integer_opt (optarg, &conf_batch_size);
+        break;
+
+      case 'B':
+        conf_protocol = LCC_PROTOCOL_BINARY;
+        break;
+
+      case 'T':
+        get_integer_opt (optarg, &conf_threads);
+        break;
+
+      case 'f':
+        conf_flood = 1;
+        break;
+
+      case 't':
+        get_double_opt (optarg, &conf_duration);
+        break;
+
+      case 'L':
+        conf_latency = 1;
+        break;
+
+      case 'l':
+        conf_receive = 1;
+        break;
+
+      case 'j':
+        conf_json = 1;
+        break;
+
       case 'h':
         exit_usage (EXIT_SUCCESS);
 
@@ -334,53 +579,386 @@ static int read_options (int argc, char **argv) /* {{{ */
     } /* switch (opt) */
   } /* while (getopt) */
 
+  if ((conf_num_values < 1) || (conf_num_hosts < 1) || (conf_num_plugins < 1)
+      || (conf_threads < 1) || (conf_connections < 1) || (conf_batch_size < 1))
+  {
+    fprintf (stderr, "Numeric options must be greater than zero.\n");
+    exit (EXIT_FAILURE);
+  }
+
   return (0);
 } /* }}} int read_options */
 
-int main (int argc, char **argv) /* {{{ */
+/*
+ * Receiving
+ */
+static uint64_t ntohll (uint64_t n) /* {{{ */
+{
+#if BYTE_ORDER == BIG_ENDIAN
+  return (n);
+#else
+  return (((uint64_t) ntohl ((uint32_t) n)) << 32)
+    | ((uint64_t) ntohl ((uint32_t) (n >> 32)));
+#endif
+} /* }}} uint64_t ntohll */
+
+/* Gauges are sent in x86 byte order, i.e. little endian. */
+static double gauge_decode (const unsigned char *p) /* {{{ */
 {
+  uint64_t n = 0;
+  double d;
   int i;
-  double last_time;
-  int values_sent = 0;
 
-  read_options (argc, argv);
+  for (i = 7; i >= 0; i--)
+    n = (n << 8) | (uint64_t) p[i];
 
-  sigint_action.sa_handler = signal_handler;
-  sigaction (SIGINT, &sigint_action, /* old = */ NULL);
+  memcpy (&d, &n, sizeof (d));
+  return (d);
+} /* }}} double gauge_decode */
 
-  sigterm_action.sa_handler = signal_handler;
-  sigaction (SIGTERM, &sigterm_action, /* old = */ NULL);
+static void receive_value (receiver_t *r, /* {{{ */
+    const lcc_value_list_t *vl, double value, double now)
+{
+  char ident[6 * LCC_NAME_LEN];
+  series_t *series = NULL;
+
+  r->received++;
+  if (r->first == 0.0)
+    r->first = now;
+  r->last = now;
 
+  sketch_add (r->latency, now - value);
 
-  values_heap = c_heap_create (compare_time);
-  if (values_heap == NULL)
+  /* Every value list is sent with times one interval apart, so gaps
+   * indicate lost values. */
+  lcc_identifier_to_string (NULL, ident, sizeof (ident), &vl->identifier);
+  if (c_avl_get (r->series, ident, (void *) &series) == 0)
   {
-    fprintf (stderr, "c_heap_create failed.\n");
-    exit (EXIT_FAILURE);
+    if (vl->time <= series->time)
+    {
+      r->reordered++;
+      return;
+    }
+    if (vl->interval > 0.0)
+    {
+      double missing = round ((vl->time - series->time) / vl->interval) - 1.0;
+      if (missing > 0.0)
+        r->lost += (uint64_t) missing;
+    }
+    series->time = vl->time;
+    return;
+  }
+
+  series = malloc (sizeof (*series));
+  if (series == NULL)
+    return;
+  series->time = vl->time;
+
+  if (c_avl_insert (r->series, strdup (ident), series) != 0)
+    free (series);
+} /* }}} void receive_value */
+
+static void receive_packet (receiver_t *r, /* {{{ */
+    const unsigned char *buffer, size_t buffer_size, double now)
+{
+  lcc_value_list_t vl = LCC_VALUE_LIST_INIT;
+
+  while (buffer_size >= 4)
+  {
+    uint16_t type = (uint16_t) ((buffer[0] << 8) | buffer[1]);
+    size_t length = (size_t) ((buffer[2] << 8) | buffer[3]);
+    const unsigned char *payload = buffer + 4;
+    size_t payload_size;
+    char *string = NULL;
+    uint64_t number = 0;
+
+    if ((length < 4) || (length > buffer_size))
+      return;
+    payload_size = length - 4;
+
+    if (type == TYPE_HOST)
+      string = vl.identifier.host;
+    else if (type == TYPE_PLUGIN)
+      string = vl.identifier.plugin;
+    else if (type == TYPE_PLUGIN_INSTANCE)
+      string = vl.identifier.plugin_instance;
+    else if (type == TYPE_TYPE)
+      string = vl.identifier.type;
+    else if (type == TYPE_TYPE_INSTANCE)
+      string = vl.identifier.type_instance;
+
+    if ((type == TYPE_TIME) || (type == TYPE_TIME_HR)
+        || (type == TYPE_INTERVAL) || (type == TYPE_INTERVAL_HR))
+    {
+      if (payload_size != sizeof (number))
+        return;
+      memcpy (&number, payload, sizeof (number));
+      number = ntohll (number);
+    }
+
+    if (string != NULL)
+    {
+      if ((payload_size < 1) || (payload_size > LCC_NAME_LEN)
+          || (payload[payload_size - 1] != 0))
+        return;
+      memcpy (string, payload, payload_size);
+    }
+    else if (type == TYPE_TIME)
+      vl.time = (double) number;
+    else if (type == TYPE_TIME_HR)
+      vl.time = ((double) number) / 1073741824.0;
+    else if (type == TYPE_INTERVAL)
+      vl.interval = (double) number;
+    else if (type == TYPE_INTERVAL_HR)
+      vl.interval = ((double) number) / 1073741824.0;
+    else if (type == TYPE_VALUES)
+    {
+      uint16_t num;
+
+      if (payload_size < 2)
+        return;
+      num = (uint16_t) ((payload[0] << 8) | payload[1]);
+      if (payload_size != 2 + 9 * ((size_t) num))
+        return;
+
+      if ((num == 1) && (payload[2] == LCC_TYPE_GAUGE)
+          && (strncmp (vl.identifier.plugin, LATENCY_PLUGIN_PREFIX,
+              strlen (LATENCY_PLUGIN_PREFIX)) == 0))
+        receive_value (r, &vl, gauge_decode (payload + 3), now);
+    }
+
+    buffer += length;
+    buffer_size -= length;
   }
+} /* }}} void receive_packet */
+
+static int receive_open_socket (void) /* {{{ */
+{
+  struct addrinfo ai_hints = { 0 };
+  struct addrinfo *ai_list = NULL;
+  struct addrinfo *ai_ptr;
+  int fd = -1;
+  int status;
+
+  ai_hints.ai_flags = AI_PASSIVE;
+  ai_hints.ai_family = AF_UNSPEC;
+  ai_hints.ai_socktype = SOCK_DGRAM;
+
+  status = getaddrinfo (conf_destination_set ? conf_destination : NULL,
+      conf_service, &ai_hints, &ai_list);
+  if (status != 0)
+  {
+    fprintf (stderr, "getaddrinfo failed: %s\n", gai_strerror (status));
+    return (-1);
+  }
+
+  for (ai_ptr = ai_list; ai_ptr != NULL; ai_ptr = ai_ptr->ai_next)
+  {
+    int buffer_size = 16 * 1024 * 1024;
+
+    fd = socket (ai_ptr->ai_family, ai_ptr->ai_socktype, ai_ptr->ai_protocol);
+    if (fd < 0)
+      continue;
+
+    /* Avoid losing packets at high rates. Failure is not fatal. */
+    setsockopt (fd, SOL_SOCKET, SO_RCVBUF, &buffer_size, sizeof (buffer_size));
+
+    if (bind (fd, ai_ptr->ai_addr, ai_ptr->ai_addrlen) == 0)
+      break;
+
+    close (fd);
+    fd = -1;
+  }
+
+  freeaddrinfo (ai_list);
+
+  if (fd < 0)
+    fprintf (stderr, "Binding to port %s failed.\n", conf_service);
+  return (fd);
+} /* }}} int receive_open_socket */
+
+static int receive_main (void) /* {{{ */
+{
+  receiver_t r = { 0 };
+  double start_time;
+  double elapsed;
+  double p50, p99, p999;
+  int fd;
+
+  fd = receive_open_socket ();
+  if (fd < 0)
+    return (-1);
+
+  r.series = c_avl_create ((void *) strcmp);
+  r.latency = sketch_create (0.01);
+  if ((r.series == NULL) || (r.latency == NULL))
+  {
+    fprintf (stderr, "Allocating memory failed.\n");
+    close (fd);
+    return (-1);
+  }
+
+  fprintf (stdout, "Receiving on port %s ...\n", conf_service);
+  fflush (stdout);
+
+  start_time = dtime ();
+  while (loop)
+  {
+    struct pollfd pfd = { fd, POLLIN, 0 };
+    unsigned char buffer[65536];
+    ssize_t status;
+
+    if ((conf_duration > 0.0) && ((dtime () - start_time) >= conf_duration))
+      break;
+
+    if (poll (&pfd, 1, /* timeout = */ 100) <= 0)
+      continue;
+
+    /* Read everything that is available before checking the time again. */
+    while ((status = recv (fd, buffer, sizeof (buffer), MSG_DONTWAIT)) > 0)
+      receive_packet (&r, buffer, (size_t) status, dtime ());
+  }
+  close (fd);
+
+  elapsed = r.last - r.first;
+  p50 = sketch_get_percentile (r.latency, 50.0);
+  p99 = sketch_get_percentile (r.latency, 99.0);
+  p999 = sketch_get_percentile (r.latency, 99.9);
+
+  if (conf_json)
+    printf ("{\"mode\":\"receive\",\"received\":%"PRIu64","
+        "\"seconds\":%.3f,\"rate\":%.1f,"
+        "\"latency_p50\":%.6f,\"latency_p99\":%.6f,\"latency_p999\":%.6f,"
+        "\"lost\":%"PRIu64",\"reordered\":%"PRIu64",\"series\":%i}\n",
+        r.received, elapsed, (elapsed > 0.0) ? r.received / elapsed : 0.0,
+        isnan (p50) ? 0.0 : p50, isnan (p99) ? 0.0 : p99,
+        isnan (p999) ? 0.0 : p999,
+        r.lost, r.reordered, c_avl_size (r.series));
+  else
+    printf ("%"PRIu64" values received in %.3f seconds (%.1f values/s) "
+        "from %i series, %"PRIu64" lost, %"PRIu64" reordered.\n"
+        "Latency: p50 %.6f s, p99 %.6f s, p99.9 %.6f s.\n",
+        r.received, elapsed, (elapsed > 0.0) ? r.received / elapsed : 0.0,
+        c_avl_size (r.series), r.lost, r.reordered, p50, p99, p999);
+
+  while (42)
+  {
+    char *key = NULL;
+    series_t *series = NULL;
+
+    if (c_avl_pick (r.series, (void *) &key, (void *) &series) != 0)
+      break;
+    free (key);
+    free (series);
+  }
+  c_avl_destroy (r.series);
+  sketch_destroy (r.latency);
+
+  return (0);
+} /* }}} int receive_main */
+
+/*
+ * Sending
+ */
+static int async_start (void) /* {{{ */
+{
+  int status;
+
+  status = lcc_async_create (conf_socket, &async);
+  if (status != 0)
+  {
+    fprintf (stderr, "lcc_async_create failed with status %i.\n", status);
+    return (-1);
+  }
+
+  lcc_async_set_protocol (async, conf_protocol);
+  lcc_async_set_connections (async, (size_t) conf_connections);
+  lcc_async_set_batch_size (async, (size_t) conf_batch_size);
+
+  status = lcc_async_start (async);
+  if (status != 0)
+  {
+    fprintf (stderr, "Connecting to %s failed: %s\n",
+        conf_socket, strerror (status));
+    return (-1);
+  }
+
+  return (0);
+} /* }}} int async_start */
+
+static lcc_network_t *network_create (void) /* {{{ */
+{
+  lcc_network_t *net;
+  lcc_server_t *srv;
 
   net = lcc_network_create ();
   if (net == NULL)
   {
     fprintf (stderr, "lcc_network_create failed.\n");
-    exit (EXIT_FAILURE);
+    return (NULL);
   }
-  else
+
+  srv = lcc_server_create (net, conf_destination, conf_service);
+  if (srv == NULL)
   {
-    lcc_server_t *srv;
-    
-    srv = lcc_server_create (net, conf_destination, conf_service);
-    if (srv == NULL)
-    {
-      fprintf (stderr, "lcc_server_create failed.\n");
-      exit (EXIT_FAILURE);
-    }
+    fprintf (stderr, "lcc_server_create failed.\n");
+    lcc_network_destroy (net);
+    return (NULL);
+  }
 
-    lcc_server_set_ttl (srv, 42);
+  lcc_server_set_ttl (srv, 42);
 #if 0
-    lcc_server_set_security_level (srv, ENCRYPT,
-        "admin", "password1");
+  lcc_server_set_security_level (srv, ENCRYPT,
+      "admin", "password1");
 #endif
+
+  return (net);
+} /* }}} lcc_network_t *network_create */
+
+static int send_main (void) /* {{{ */
+{
+  sender_t *senders;
+  double start_time;
+  double elapsed;
+  uint64_t values_sent = 0;
+  uint64_t failed = 0;
+  uint64_t dropped = 0;
+  int i;
+
+  senders = calloc ((size_t) conf_threads, sizeof (*senders));
+  if (senders == NULL)
+  {
+    fprintf (stderr, "calloc failed.\n");
+    return (-1);
+  }
+
+  if ((conf_socket != NULL) && (async_start () != 0))
+    return (-1);
+
+  for (i = 0; i < conf_threads; i++)
+  {
+    senders[i].seed = (unsigned int) (conf_seed + i);
+
+    senders[i].values_heap = c_heap_create (compare_time);
+    if (senders[i].values_heap == NULL)
+    {
+      fprintf (stderr, "c_heap_create failed.\n");
+      return (-1);
+    }
+
+    /* lcc_network_t is not thread-safe, so every thread has its own. */
+    if (conf_socket == NULL)
+    {
+      senders[i].net = network_create ();
+      if (senders[i].net == NULL)
+        return (-1);
+    }
+  }
+
+  if ((conf_zipf > 0.0) && (host_cdf_create () != 0))
+  {
+    fprintf (stderr, "calloc failed.\n");
+    return (-1);
   }
 
   fprintf (stdout, "Creating %i values ... ", conf_num_values);
@@ -389,69 +967,102 @@ int main (int argc, char **argv) /* {{{ */
   {
     lcc_value_list_t *vl;
 
-    vl = create_value_list ();
+    vl = create_value_list (i);
     if (vl == NULL)
     {
       fprintf (stderr, "create_value_list failed.\n");
-      exit (EXIT_FAILURE);
+      return (-1);
     }
 
-    c_heap_insert (values_heap, vl);
+    c_heap_insert (senders[i % conf_threads].values_heap, vl);
   }
   fprintf (stdout, "done\n");
+  fflush (stdout);
 
-  last_time = 0;
-  while (loop)
+  start_time = dtime ();
+  for (i = 0; i < conf_threads; i++)
   {
-    lcc_value_list_t *vl = c_heap_get_root (values_heap);
+    if (pthread_create (&senders[i].thread, NULL, sender_thread,
+          senders + i) != 0)
+    {
+      fprintf (stderr, "pthread_create failed.\n");
+      return (-1);
+    }
+  }
 
-    if (vl == NULL)
-      break;
+  for (i = 0; i < conf_threads; i++)
+  {
+    pthread_join (senders[i].thread, NULL);
+    values_sent += senders[i].values_sent;
+  }
 
-    if (vl->time != last_time)
-    {
-      printf ("%i values have been sent.\n", values_sent);
+  fprintf (stdout, "Shutting down.\n");
+  fflush (stdout);
 
-      /* Check if we need to sleep */
-      double now = dtime ();
+  if (async != NULL)
+  {
+    lcc_async_stats_t stats;
+
+    lcc_async_flush (async);
+    lcc_async_stats (async, &stats);
+    values_sent = stats.sent;
+    failed = stats.failed;
+    dropped = stats.dropped;
+    lcc_async_destroy (async);
+  }
+  elapsed = dtime () - start_time;
+
+  if (conf_json)
+    printf ("{\"mode\":\"send\",\"threads\":%i,\"value_lists\":%i,"
+        "\"sent\":%"PRIu64",\"failed\":%"PRIu64",\"dropped\":%"PRIu64","
+        "\"seconds\":%.3f,\"rate\":%.1f}\n",
+        conf_threads, conf_num_values, values_sent, failed, dropped,
+        elapsed, ((double) values_sent) / elapsed);
+  else
+    printf ("%"PRIu64" values sent in %.3f seconds (%.1f values/s), "
+        "%"PRIu64" failed, %"PRIu64" dropped.\n",
+        values_sent, elapsed, ((double) values_sent) / elapsed,
+        failed, dropped);
 
-      while (now < vl->time)
-      {
-        /* 1 / 100 second */
-        struct timespec ts = { 0, 10000000 };
+  for (i = 0; i < conf_threads; i++)
+  {
+    while (42)
+    {
+      lcc_value_list_t *vl = c_heap_get_root (senders[i].values_heap);
+      if (vl == NULL)
+        break;
+      destroy_value_list (vl);
+    }
+    c_heap_destroy (senders[i].values_heap);
 
-        ts.tv_sec = (time_t) now;
-        ts.tv_nsec = (long) ((now - ((double) ts.tv_sec)) * 1e9);
+    if (senders[i].net != NULL)
+      lcc_network_destroy (senders[i].net);
+  }
+  free (senders);
+  free (host_cdf);
 
-        nanosleep (&ts, /* remaining = */ NULL);
-        now = dtime ();
+  return (0);
+} /* }}} int send_main */
 
-        if (!loop)
-          break;
-      }
-      last_time = vl->time;
-    }
+int main (int argc, char **argv) /* {{{ */
+{
+  int status;
 
-    send_value (vl);
-    values_sent++;
+  read_options (argc, argv);
+  srandom ((unsigned int) conf_seed);
 
-    c_heap_insert (values_heap, vl);
-  }
+  sigint_action.sa_handler = signal_handler;
+  sigaction (SIGINT, &sigint_action, /* old = */ NULL);
 
-  fprintf (stdout, "Shutting down.\n");
-  fflush (stdout);
+  sigterm_action.sa_handler = signal_handler;
+  sigaction (SIGTERM, &sigterm_action, /* old = */ NULL);
 
-  while (42)
-  {
-    lcc_value_list_t *vl = c_heap_get_root (values_heap);
-    if (vl == NULL)
-      break;
-    destroy_value_list (vl);
-  }
-  c_heap_destroy (values_heap);
+  if (conf_receive)
+    status = receive_main ();
+  else
+    status = send_main ();
 
-  lcc_network_destroy (net);
-  exit (EXIT_SUCCESS);
+  exit ((status == 0) ? EXIT_SUCCESS : EXIT_FAILURE);
   return (0);
 } /* }}} int main */
 
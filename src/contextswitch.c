@@ -34,6 +34,7 @@
 /* #endif HAVE_SYSCTLBYNAME */
 
 #elif KERNEL_LINUX
+# include "utils_procfs.h"
 /* no global variables */
 /* #endif KERNEL_LINUX */
 
@@ -46,7 +47,8 @@
 # error "No applicable input method."
 #endif
 
-static void cs_submit (derive_t context_switches)
+/* `t' is the time the counter was read or zero for "now". */
+static void cs_submit (derive_t context_switches, cdtime_t t)
 {
 	value_t values[1];
 	value_list_t vl = VALUE_LIST_INIT;
@@ -55,6 +57,7 @@ static void cs_submit (derive_t context_switches)
 
 	vl.values = values;
 	vl.values_len = 1;
+	vl.time = t;
 	sstrncpy (vl.host, hostname_g, sizeof (vl.host));
 	sstrncpy (vl.plugin, "contextswitch", sizeof (vl.plugin));
 	sstrncpy (vl.type, "contextswitch", sizeof (vl.type));
@@ -79,53 +82,29 @@ static int cs_read (void)
 		return (-1);
 	}
 
-	cs_submit (value);
+	cs_submit (value, 0);
 /* #endif HAVE_SYSCTLBYNAME */
 
 #elif KERNEL_LINUX
-	FILE *fh;
-	char buffer[64];
-	int numfields;
-	char *fields[3];
-	derive_t result = 0;
-	int status = -2;
-
-	fh = fopen ("/proc/stat", "r");
-	if (fh == NULL) {
-		ERROR ("contextswitch plugin: unable to open /proc/stat: %s",
-				sstrerror (errno, buffer, sizeof (buffer)));
+	procfs_stat_t const *ps;
+	int status = 0;
+
+	ps = procfs_stat_acquire ();
+	if (ps == NULL) {
+		char errbuf[1024];
+		ERROR ("contextswitch plugin: unable to read /proc/stat: %s",
+				sstrerror (errno, errbuf, sizeof (errbuf)));
 		return (-1);
 	}
 
-	while (fgets(buffer, sizeof(buffer), fh) != NULL)
-	{
-		char *endptr;
-
-		numfields = strsplit(buffer, fields, STATIC_ARRAY_SIZE (fields));
-		if (numfields != 2)
-			continue;
-
-		if (strcmp("ctxt", fields[0]) != 0)
-			continue;
-
-		errno = 0;
-		endptr = NULL;
-		result = (derive_t) strtoll (fields[1], &endptr, /* base = */ 10);
-		if ((endptr == fields[1]) || (errno != 0)) {
-			ERROR ("contextswitch plugin: Cannot parse ctxt value: %s",
-					fields[1]);
-			status = -1;
-			break;
-		}
-
-		cs_submit(result);
-		status = 0;
-		break;
+	if (ps->have_ctxt)
+		cs_submit (ps->ctxt, ps->time);
+	else {
+		ERROR ("contextswitch plugin: Unable to find context switch value.");
+		status = -1;
 	}
-	fclose(fh);
 
-	if (status == -2)
-		ERROR ("contextswitch plugin: Unable to find context switch value.");
+	procfs_release (ps);
 /* #endif  KERNEL_LINUX */
 
 #elif HAVE_PERFSTAT
@@ -141,7 +120,7 @@ static int cs_read (void)
 		return (-1);
 	}
 
-	cs_submit(perfcputotal.pswitch);
+	cs_submit(perfcputotal.pswitch, 0);
 	status = 0;
 #endif /* defined(HAVE_PERFSTAT) */
 
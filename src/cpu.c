@@ -31,6 +31,10 @@
 #include "common.h"
 #include "plugin.h"
 
+#if KERNEL_LINUX
+# include "utils_procfs.h"
+#endif
+
 #ifdef HAVE_MACH_KERN_RETURN_H
 # include <mach/kern_return.h>
 #endif
@@ -318,7 +322,8 @@ static int init (void)
 	return (0);
 } /* int init */
 
-static void submit_value (int cpu_num, int cpu_state, const char *type, value_t value)
+static void submit_value (int cpu_num, int cpu_state, const char *type,
+		value_t value, cdtime_t t)
 {
 	value_t values[1];
 	value_list_t vl = VALUE_LIST_INIT;
@@ -327,6 +332,7 @@ static void submit_value (int cpu_num, int cpu_state, const char *type, value_t
 
 	vl.values = values;
 	vl.values_len = 1;
+	vl.time = t;
 
 	sstrncpy (vl.host, hostname_g, sizeof (vl.host));
 	sstrncpy (vl.plugin, "cpu", sizeof (vl.plugin));
@@ -341,7 +347,8 @@ static void submit_value (int cpu_num, int cpu_state, const char *type, value_t
 	plugin_dispatch_values (&vl);
 }
 
-static void submit_percent(int cpu_num, int cpu_state, gauge_t percent)
+static void submit_percent(int cpu_num, int cpu_state, gauge_t percent,
+		cdtime_t t)
 {
 	value_t value;
 
@@ -352,15 +359,16 @@ static void submit_percent(int cpu_num, int cpu_state, gauge_t percent)
 		return;
 
 	value.gauge = percent;
-	submit_value (cpu_num, cpu_state, "percent", value);
+	submit_value (cpu_num, cpu_state, "percent", value, t);
 }
 
-static void submit_derive(int cpu_num, int cpu_state, derive_t derive)
+static void submit_derive(int cpu_num, int cpu_state, derive_t derive,
+		cdtime_t t)
 {
 	value_t value;
 
 	value.derive = derive;
-	submit_value (cpu_num, cpu_state, "cpu", value);
+	submit_value (cpu_num, cpu_state, "cpu", value, t);
 }
 
 /* Takes the zero-index number of a CPU and makes sure that the module-global
@@ -440,7 +448,7 @@ static void aggregate (gauge_t *sum_by_state) /* {{{ */
  * current rate; each rate may be NAN. Calculates the percentage of each state
  * and dispatches the metric. */
 static void cpu_commit_one (int cpu_num, /* {{{ */
-		gauge_t rates[static COLLECTD_CPU_STATE_MAX])
+		gauge_t rates[static COLLECTD_CPU_STATE_MAX], cdtime_t t)
 {
 	size_t state;
 	gauge_t sum;
@@ -451,14 +459,14 @@ static void cpu_commit_one (int cpu_num, /* {{{ */
 	if (!report_by_state)
 	{
 		gauge_t percent = 100.0 * rates[COLLECTD_CPU_STATE_ACTIVE] / sum;
-		submit_percent (cpu_num, COLLECTD_CPU_STATE_ACTIVE, percent);
+		submit_percent (cpu_num, COLLECTD_CPU_STATE_ACTIVE, percent, t);
 		return;
 	}
 
 	for (state = 0; state < COLLECTD_CPU_STATE_ACTIVE; state++)
 	{
 		gauge_t percent = 100.0 * rates[state] / sum;
-		submit_percent (cpu_num, state, percent);
+		submit_percent (cpu_num, state, percent, t);
 	}
 } /* }}} void cpu_commit_one */
 
@@ -475,7 +483,7 @@ static void cpu_reset (void) /* {{{ */
 } /* }}} void cpu_reset */
 
 /* Legacy behavior: Dispatches the raw derive values without any aggregation. */
-static void cpu_commit_without_aggregation (void) /* {{{ */
+static void cpu_commit_without_aggregation (cdtime_t t) /* {{{ */
 {
 	int state;
 
@@ -490,13 +498,15 @@ static void cpu_commit_without_aggregation (void) /* {{{ */
 			if (!s->has_value)
 				continue;
 
-			submit_derive ((int) cpu_num, (int) state, s->conv.last_value.derive);
+			submit_derive ((int) cpu_num, (int) state,
+					s->conv.last_value.derive, t);
 		}
 	}
 } /* }}} void cpu_commit_without_aggregation */
 
-/* Aggregates the internal state and dispatches the metrics. */
-static void cpu_commit (void) /* {{{ */
+/* Aggregates the internal state and dispatches the metrics. `t' is the time
+ * the values were sampled. */
+static void cpu_commit (cdtime_t t) /* {{{ */
 {
 	gauge_t global_rates[COLLECTD_CPU_STATE_MAX] = {
 		NAN, NAN, NAN, NAN, NAN, NAN, NAN, NAN, NAN, NAN /* Batman! */
@@ -505,7 +515,7 @@ static void cpu_commit (void) /* {{{ */
 
 	if (report_by_state && report_by_cpu && !report_percent)
 	{
-		cpu_commit_without_aggregation ();
+		cpu_commit_without_aggregation (t);
 		return;
 	}
 
@@ -513,7 +523,7 @@ static void cpu_commit (void) /* {{{ */
 
 	if (!report_by_cpu)
 	{
-		cpu_commit_one (-1, global_rates);
+		cpu_commit_one (-1, global_rates, t);
 		return;
 	}
 
@@ -529,7 +539,7 @@ static void cpu_commit (void) /* {{{ */
 			if (this_cpu_states[state].has_value)
 				local_rates[state] = this_cpu_states[state].rate;
 
-		cpu_commit_one ((int) cpu_num, local_rates);
+		cpu_commit_one ((int) cpu_num, local_rates, t);
 	}
 } /* }}} void cpu_commit */
 
@@ -606,50 +616,43 @@ static int cpu_read (void)
 /* }}} #endif PROCESSOR_CPU_LOAD_INFO */
 
 #elif defined(KERNEL_LINUX) /* {{{ */
-	int cpu;
-	FILE *fh;
-	char buf[1024];
-
-	char *fields[9];
-	int numfields;
+	procfs_stat_t const *ps;
+	size_t i;
 
-	if ((fh = fopen ("/proc/stat", "r")) == NULL)
+	if ((ps = procfs_stat_acquire ()) == NULL)
 	{
 		char errbuf[1024];
-		ERROR ("cpu plugin: fopen (/proc/stat) failed: %s",
+		ERROR ("cpu plugin: reading /proc/stat failed: %s",
 				sstrerror (errno, errbuf, sizeof (errbuf)));
 		return (-1);
 	}
 
-	while (fgets (buf, 1024, fh) != NULL)
+	/* The snapshot may have been taken by another plugin a moment ago. */
+	now = ps->time;
+
+	for (i = 0; i < ps->cpu_num; i++)
 	{
-		if (strncmp (buf, "cpu", 3))
-			continue;
-		if ((buf[3] < '0') || (buf[3] > '9'))
-			continue;
+		procfs_cpu_t const *c = ps->cpu + i;
 
-		numfields = strsplit (buf, fields, 9);
-		if (numfields < 5)
+		if (c->fields_num < 4)
 			continue;
 
-		cpu = atoi (fields[0] + 3);
-
-		cpu_stage (cpu, COLLECTD_CPU_STATE_USER,   (derive_t) atoll(fields[1]), now);
-		cpu_stage (cpu, COLLECTD_CPU_STATE_NICE,   (derive_t) atoll(fields[2]), now);
-		cpu_stage (cpu, COLLECTD_CPU_STATE_SYSTEM, (derive_t) atoll(fields[3]), now);
-		cpu_stage (cpu, COLLECTD_CPU_STATE_IDLE,   (derive_t) atoll(fields[4]), now);
+		cpu_stage (c->cpu, COLLECTD_CPU_STATE_USER,   c->fields[0], now);
+		cpu_stage (c->cpu, COLLECTD_CPU_STATE_NICE,   c->fields[1], now);
+		cpu_stage (c->cpu, COLLECTD_CPU_STATE_SYSTEM, c->fields[2], now);
+		cpu_stage (c->cpu, COLLECTD_CPU_STATE_IDLE,   c->fields[3], now);
 
-		if (numfields >= 8)
+		if (c->fields_num >= 7)
 		{
-			cpu_stage (cpu, COLLECTD_CPU_STATE_WAIT,      (derive_t) atoll(fields[5]), now);
-			cpu_stage (cpu, COLLECTD_CPU_STATE_INTERRUPT, (derive_t) atoll(fields[6]), now);
-			cpu_stage (cpu, COLLECTD_CPU_STATE_SOFTIRQ,   (derive_t) atoll(fields[7]), now);
+			cpu_stage (c->cpu, COLLECTD_CPU_STATE_WAIT,      c->fields[4], now);
+			cpu_stage (c->cpu, COLLECTD_CPU_STATE_INTERRUPT, c->fields[5], now);
+			cpu_stage (c->cpu, COLLECTD_CPU_STATE_SOFTIRQ,   c->fields[6], now);
 
-			if (numfields >= 9)
-				cpu_stage (cpu, COLLECTD_CPU_STATE_STEAL, (derive_t) atoll(fields[8]), now);
+			if (c->fields_num >= 8)
+				cpu_stage (c->cpu, COLLECTD_CPU_STATE_STEAL, c->fields[7], now);
 		}
 	}
-	fclose (fh);
+	procfs_release (ps);
 /* }}} #endif defined(KERNEL_LINUX) */
 
 #elif defined(HAVE_LIBKSTAT) /* {{{ */
@@ -838,7 +841,7 @@ static int cpu_read (void)
 	}
 #endif /* }}} HAVE_PERFSTAT */
 
-	cpu_commit ();
+	cpu_commit (now);
 	cpu_reset ();
 	return (0);
 }
@@ -25,6 +25,7 @@
 #include "common.h"
 #include "plugin.h"
 #include "configfile.h"
+#include "utils_curl_multi.h"
 #include "utils_match.h"
 #include "utils_time.h"
 
@@ -572,6 +573,14 @@ static int cc_config (oconfig_item_t *ci) /* {{{ */
       else
         errors++;
     }
+    else if (strcasecmp ("MaxConnectionsPerHost", child->key) == 0)
+    {
+      int tmp = 0;
+      if (cf_util_get_int (child, &tmp) == 0)
+        ucm_set_max_host_connections ((long) tmp);
+      else
+        errors++;
+    }
     else
     {
       WARNING ("curl plugin: Option `%s' not allowed here.", child->key);
@@ -654,31 +663,35 @@ static void cc_submit_response_time (const web_page_t *wp, /* {{{ */
   plugin_dispatch_values (&vl);
 } /* }}} void cc_submit_response_time */
 
-static int cc_read_page (web_page_t *wp) /* {{{ */
+/* Called by the HTTP engine's thread once the page has been received. */
+static void cc_read_page_done (CURL *curl, CURLcode status, /* {{{ */
+    void *user_data)
 {
+  web_page_t *wp = user_data;
   web_match_t *wm;
-  int status;
-  cdtime_t start = 0;
 
-  if (wp->response_time)
-    start = cdtime ();
+  if (status == CURLE_ABORTED_BY_CALLBACK) /* shutting down */
+    return;
 
-  wp->buffer_fill = 0;
-  status = curl_easy_perform (wp->curl);
   if (status != CURLE_OK)
   {
     ERROR ("curl plugin: curl_easy_perform failed with status %i: %s",
         status, wp->curl_errbuf);
-    return (-1);
+    wp->buffer_fill = 0;
+    return;
   }
 
   if (wp->response_time)
-    cc_submit_response_time (wp, cdtime() - start);
+  {
+    double total_time = 0.0;
+    curl_easy_getinfo (curl, CURLINFO_TOTAL_TIME, &total_time);
+    cc_submit_response_time (wp, DOUBLE_TO_CDTIME_T (total_time));
+  }
 
   if(wp->response_code)
   {
     long response_code = 0;
-    status = curl_easy_getinfo(wp->curl, CURLINFO_RESPONSE_CODE, &response_code);
+    status = curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response_code);
     if(status != CURLE_OK) {
       ERROR ("curl plugin: Fetching response code failed with status %i: %s",
         status, wp->curl_errbuf);
@@ -690,9 +703,10 @@ static int cc_read_page (web_page_t *wp) /* {{{ */
   for (wm = wp->matches; wm != NULL; wm = wm->next)
   {
     cu_match_value_t *mv;
+    int match_status;
 
-    status = match_apply (wm->match, wp->buffer);
-    if (status != 0)
+    match_status = match_apply (wm->match, wp->buffer);
+    if (match_status != 0)
     {
       WARNING ("curl plugin: match_apply failed.");
       continue;
@@ -709,9 +723,34 @@ static int cc_read_page (web_page_t *wp) /* {{{ */
     match_value_reset (mv);
   } /* for (wm = wp->matches; wm != NULL; wm = wm->next) */
 
+  /* Empty the buffer for the next request. It must not be touched while a
+   * transfer is in progress, which ucm_submit() only reports by failing. */
+  wp->buffer_fill = 0;
+} /* }}} void cc_read_page_done */
+
+static int cc_read_page (web_page_t *wp) /* {{{ */
+{
+  int status;
+
+  status = ucm_submit (wp->curl, cc_read_page_done, wp);
+  if (status == EBUSY)
+  {
+    WARNING ("curl plugin: The previous request for page \"%s\" is still "
+        "in progress. Skipping this interval.", wp->instance);
+    return (-1);
+  }
+  else if (status != 0)
+  {
+    ERROR ("curl plugin: Submitting the request for page \"%s\" failed.",
+        wp->instance);
+    return (-1);
+  }
+
   return (0);
 } /* }}} int cc_read_page */
 
+/* All pages are requested at the same time. The responses are handled by the
+ * HTTP engine's thread as they arrive. */
 static int cc_read (void) /* {{{ */
 {
   web_page_t *wp;
@@ -724,6 +763,8 @@ static int cc_read (void) /* {{{ */
 
 static int cc_shutdown (void) /* {{{ */
 {
+  ucm_shutdown ();
+
   cc_web_page_free (pages_g);
   pages_g = NULL;
 
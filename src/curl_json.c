@@ -25,7 +25,7 @@
 #include "common.h"
 #include "plugin.h"
 #include "configfile.h"
-#include "utils_avltree.h"
+#include "utils_curl_multi.h"
 #include "utils_complain.h"
 
 #include <sys/types.h>
@@ -43,8 +43,6 @@
 #endif
 
 #define CJ_DEFAULT_HOST "localhost"
-#define CJ_KEY_MAGIC 0x43484b59UL /* CHKY */
-#define CJ_IS_KEY(key) ((key)->magic == CJ_KEY_MAGIC)
 #define CJ_ANY "*"
 #define COUCH_MIN(x,y) ((x) < (y) ? (x) : (y))
 
@@ -52,10 +50,33 @@ struct cj_key_s;
 typedef struct cj_key_s cj_key_t;
 struct cj_key_s /* {{{ */
 {
-  unsigned long magic;
   char *path;
   char *type;
   char *instance;
+  /* Data source type of "type", looked up when the first value is found. */
+  int ds_type;
+};
+/* }}} */
+
+/* The configured key paths are compiled into a trie, so that looking up a
+ * map key or array index is a binary search in the children of the parent's
+ * node. Anything below a key without node is skipped by the parser callbacks
+ * without any lookups. */
+struct cj_node_s;
+typedef struct cj_node_s cj_node_t;
+struct cj_node_s /* {{{ */
+{
+  char *name;
+  size_t name_len;
+
+  /* The key to dispatch values found at this path, if any. */
+  cj_key_t *key;
+
+  /* Sorted by cj_node_compare(). */
+  cj_node_t **children;
+  size_t children_num;
+  /* Matches any map key or array index. Used if no child matches. */
+  cj_node_t *any;
 };
 /* }}} */
 
@@ -83,14 +104,12 @@ struct cj_s /* {{{ */
   char curl_errbuf[CURL_ERROR_SIZE];
 
   yajl_handle yajl;
-  c_avl_tree_t *tree;
-  cj_key_t *key;
+  cj_node_t *tree;
   int depth;
   struct {
-    union {
-      c_avl_tree_t *tree;
-      cj_key_t *key;
-    };
+    /* The node of the current map key or array index. NULL if nothing is
+     * configured for this key, i.e. the subtree is skipped. */
+    cj_node_t *node;
     _Bool in_array;
     int index;
     char name[DATA_MAX_NAME_LEN];
@@ -106,6 +125,7 @@ typedef unsigned int yajl_len_t;
 
 static int cj_read (user_data_t *ud);
 static void cj_submit (cj_t *db, cj_key_t *key, value_t *value);
+static int cj_parser_start (cj_t *db);
 
 static size_t cj_curl_callback (void *buf, /* {{{ */
     size_t size, size_t nmemb, void *user_data)
@@ -123,6 +143,12 @@ static size_t cj_curl_callback (void *buf, /* {{{ */
   if (db == NULL)
     return (0);
 
+  /* The parser is created when the first chunk arrives, so that the read
+   * callback doesn't touch the parser state while a transfer is still in
+   * progress. */
+  if ((db->yajl == NULL) && (cj_parser_start (db) != 0))
+    return (0);
+
   status = yajl_parse(db->yajl, (unsigned char *)buf, len);
   if (status == yajl_status_ok)
     return (len);
@@ -142,6 +168,9 @@ static int cj_get_type (cj_key_t *key)
 {
   const data_set_t *ds;
 
+  if (key->ds_type >= 0)
+    return (key->ds_type);
+
   ds = plugin_get_ds (key->type);
   if (ds == NULL)
   {
@@ -168,22 +197,94 @@ static int cj_get_type (cj_key_t *key)
         key->type);
   }
 
-  return ds->ds[0].type;
+  key->ds_type = ds->ds[0].type;
+  return (key->ds_type);
 }
 
+static int cj_node_compare (char const *name, size_t name_len, /* {{{ */
+    cj_node_t const *node)
+{
+  int status;
+
+  status = memcmp (name, node->name, COUCH_MIN (name_len, node->name_len));
+  if (status != 0)
+    return (status);
+
+  if (name_len < node->name_len)
+    return (-1);
+  else if (name_len > node->name_len)
+    return (1);
+  return (0);
+} /* }}} int cj_node_compare */
+
+/* Returns the index of the child called "name" or, if there is no such child,
+ * the index at which it would have to be inserted. */
+static size_t cj_node_search (cj_node_t const *node, /* {{{ */
+    char const *name, size_t name_len, _Bool *found)
+{
+  size_t lo = 0;
+  size_t hi = node->children_num;
+
+  *found = 0;
+  while (lo < hi)
+  {
+    size_t mid = lo + (hi - lo) / 2;
+    int status = cj_node_compare (name, name_len, node->children[mid]);
+
+    if (status == 0)
+    {
+      *found = 1;
+      return (mid);
+    }
+    else if (status < 0)
+      hi = mid;
+    else
+      lo = mid + 1;
+  }
+
+  return (lo);
+} /* }}} size_t cj_node_search */
+
+static cj_node_t *cj_node_lookup (cj_node_t const *node, /* {{{ */
+    char const *name, size_t name_len)
+{
+  _Bool found;
+  size_t i;
+
+  if (node->children_num > 0)
+  {
+    i = cj_node_search (node, name, name_len, &found);
+    if (found)
+      return (node->children[i]);
+  }
+
+  return (node->any);
+} /* }}} cj_node_t *cj_node_lookup */
+
 static int cj_cb_map_key (void *ctx, const unsigned char *val,
     yajl_len_t len);
 
 static void cj_cb_inc_array_index (void *ctx, _Bool update_key)
 {
   cj_t *db = (cj_t *)ctx;
+  cj_node_t *parent;
 
   if (!db->state[db->depth].in_array)
     return;
 
   db->state[db->depth].index++;
 
-  if (update_key)
+  if (!update_key)
+    return;
+
+  /* Avoid formatting the index if the array is being skipped. */
+  parent = db->state[db->depth - 1].node;
+  if (parent == NULL)
+  {
+    db->state[db->depth].node = NULL;
+    return;
+  }
+
   {
     char name[DATA_MAX_NAME_LEN];
 
@@ -212,33 +313,41 @@ static int cj_cb_null (void * ctx)
 static int cj_cb_number (void *ctx,
     const char *number, yajl_len_t number_len)
 {
-  char buffer[number_len + 1];
-
   cj_t *db = (cj_t *)ctx;
-  cj_key_t *key = db->state[db->depth].key;
+  cj_node_t *node;
+  cj_key_t *key;
+  char buffer[64];
   value_t vt;
   int type;
   int status;
 
-  /* Create a null-terminated version of the string. */
-  memcpy (buffer, number, number_len);
-  buffer[sizeof (buffer) - 1] = 0;
-
-  if ((key == NULL) || !CJ_IS_KEY (key)) {
-    if (key != NULL && !db->state[db->depth].in_array/*can be inhomogeneous*/)
-      NOTICE ("curl_json plugin: Found \"%s\", but the configuration expects"
-              " a map.", buffer);
-    cj_cb_inc_array_index (ctx, /* update_key = */ 1);
-    key = db->state[db->depth].key;
-    if (key == NULL) {
-      return (CJ_CB_CONTINUE);
-    }
+  cj_cb_inc_array_index (ctx, /* update_key = */ 1);
+
+  node = db->state[db->depth].node;
+  if (node == NULL)
+    return (CJ_CB_CONTINUE);
+
+  key = node->key;
+  if (key == NULL)
+  {
+    /* Arrays can be inhomogeneous. */
+    if (!db->state[db->depth].in_array)
+      NOTICE ("curl_json plugin: Found \"%.*s\", but the configuration "
+          "expects a map.", (int) number_len, number);
+    return (CJ_CB_CONTINUE);
   }
-  else
+
+  if (number_len >= sizeof (buffer))
   {
-    cj_cb_inc_array_index (ctx, /* update_key = */ 1);
+    NOTICE ("curl_json plugin: Ignoring the %zu byte long value of \"%s\".",
+        (size_t) number_len, key->path);
+    return (CJ_CB_CONTINUE);
   }
 
+  /* Create a null-terminated version of the string. */
+  memcpy (buffer, number, number_len);
+  buffer[number_len] = 0;
+
   type = cj_get_type (key);
   status = parse_value (buffer, &vt, type);
   if (status != 0)
@@ -251,49 +360,37 @@ static int cj_cb_number (void *ctx,
   return (CJ_CB_CONTINUE);
 } /* int cj_cb_number */
 
-/* Queries the key-tree of the parent context for "in_name" and, if found,
- * updates the "key" field of the current context. Otherwise, "key" is set to
- * NULL. */
+/* Looks up "in_name" in the node of the parent context and updates the "node"
+ * field of the current context. The name is only copied if it matched, since
+ * it is needed for the type instance only. */
 static int cj_cb_map_key (void *ctx,
     unsigned char const *in_name, yajl_len_t in_name_len)
 {
   cj_t *db = (cj_t *)ctx;
-  c_avl_tree_t *tree;
-
-  tree = db->state[db->depth-1].tree;
-
-  if (tree != NULL)
-  {
-    cj_key_t *value = NULL;
-    char *name;
-    size_t name_len;
-
-    /* Create a null-terminated version of the name. */
-    name = db->state[db->depth].name;
-    name_len = COUCH_MIN ((size_t) in_name_len,
-        sizeof (db->state[db->depth].name) - 1);
-    memcpy (name, in_name, name_len);
-    name[name_len] = 0;
-
-    if (c_avl_get (tree, name, (void *) &value) == 0) {
-      if (CJ_IS_KEY((cj_key_t*)value)) {
-        db->state[db->depth].key = value;
-      }
-      else {
-        db->state[db->depth].tree = (c_avl_tree_t*) value;
-      }
-    }
-    else if (c_avl_get (tree, CJ_ANY, (void *) &value) == 0)
-      if (CJ_IS_KEY((cj_key_t*)value)) {
-        db->state[db->depth].key = value;
-      }
-      else {
-        db->state[db->depth].tree = (c_avl_tree_t*) value;
-      }
-    else
-      db->state[db->depth].key = NULL;
+  cj_node_t *parent;
+  cj_node_t *node;
+  char *name;
+  size_t name_len;
+
+  parent = db->state[db->depth-1].node;
+  if (parent == NULL)
+  {
+    db->state[db->depth].node = NULL;
+    return (CJ_CB_CONTINUE);
   }
 
+  node = cj_node_lookup (parent, (char const *) in_name, (size_t) in_name_len);
+  db->state[db->depth].node = node;
+  if (node == NULL)
+    return (CJ_CB_CONTINUE);
+
+  /* Create a null-terminated version of the name. */
+  name = db->state[db->depth].name;
+  name_len = COUCH_MIN ((size_t) in_name_len,
+      sizeof (db->state[db->depth].name) - 1);
+  memcpy (name, in_name, name_len);
+  name[name_len] = 0;
+
   return (CJ_CB_CONTINUE);
 }
 
@@ -319,7 +416,7 @@ static int cj_cb_start (void *ctx)
 static int cj_cb_end (void *ctx)
 {
   cj_t *db = (cj_t *)ctx;
-  db->state[db->depth].tree = NULL;
+  db->state[db->depth].node = NULL;
   --db->depth;
   return (CJ_CB_CONTINUE);
 }
@@ -381,25 +478,85 @@ static void cj_key_free (cj_key_t *key) /* {{{ */
   sfree (key);
 } /* }}} void cj_key_free */
 
-static void cj_tree_free (c_avl_tree_t *tree) /* {{{ */
+static void cj_node_free (cj_node_t *node) /* {{{ */
 {
-  char *name;
-  void *value;
+  size_t i;
+
+  if (node == NULL)
+    return;
+
+  for (i = 0; i < node->children_num; i++)
+    cj_node_free (node->children[i]);
+  sfree (node->children);
+  cj_node_free (node->any);
+
+  cj_key_free (node->key);
+  sfree (node->name);
+  sfree (node);
+} /* }}} void cj_node_free */
+
+static cj_node_t *cj_node_create (char const *name, size_t name_len) /* {{{ */
+{
+  cj_node_t *node;
+
+  node = calloc (1, sizeof (*node));
+  if (node == NULL)
+    return (NULL);
 
-  while (c_avl_pick (tree, (void *) &name, (void *) &value) == 0)
+  node->name = malloc (name_len + 1);
+  if (node->name == NULL)
   {
-    cj_key_t *key = (cj_key_t *)value;
+    sfree (node);
+    return (NULL);
+  }
+  memcpy (node->name, name, name_len);
+  node->name[name_len] = 0;
+  node->name_len = name_len;
 
-    if (CJ_IS_KEY(key))
-      cj_key_free (key);
-    else
-      cj_tree_free ((c_avl_tree_t *)value);
+  return (node);
+} /* }}} cj_node_t *cj_node_create */
 
-    sfree (name);
+/* Returns the child called "name", creating it if necessary. */
+static cj_node_t *cj_node_get_child (cj_node_t *node, /* {{{ */
+    char const *name, size_t name_len)
+{
+  cj_node_t **tmp;
+  cj_node_t *child;
+  _Bool found;
+  size_t i;
+
+  if ((name_len == strlen (CJ_ANY))
+      && (memcmp (name, CJ_ANY, name_len) == 0))
+  {
+    if (node->any == NULL)
+      node->any = cj_node_create (name, name_len);
+    return (node->any);
   }
 
-  c_avl_destroy (tree);
-} /* }}} void cj_tree_free */
+  i = cj_node_search (node, name, name_len, &found);
+  if (found)
+    return (node->children[i]);
+
+  child = cj_node_create (name, name_len);
+  if (child == NULL)
+    return (NULL);
+
+  tmp = realloc (node->children,
+      (node->children_num + 1) * sizeof (*node->children));
+  if (tmp == NULL)
+  {
+    cj_node_free (child);
+    return (NULL);
+  }
+  node->children = tmp;
+
+  memmove (node->children + i + 1, node->children + i,
+      (node->children_num - i) * sizeof (*node->children));
+  node->children[i] = child;
+  node->children_num++;
+
+  return (child);
+} /* }}} cj_node_t *cj_node_get_child */
 
 static void cj_free (void *arg) /* {{{ */
 {
@@ -413,11 +570,17 @@ static void cj_free (void *arg) /* {{{ */
     return;
 
   if (db->curl != NULL)
+  {
+    ucm_remove (db->curl);
     curl_easy_cleanup (db->curl);
+  }
   db->curl = NULL;
 
-  if (db->tree != NULL)
-    cj_tree_free (db->tree);
+  if (db->yajl != NULL)
+    yajl_free (db->yajl);
+  db->yajl = NULL;
+
+  cj_node_free (db->tree);
   db->tree = NULL;
 
   sfree (db->instance);
@@ -438,11 +601,6 @@ static void cj_free (void *arg) /* {{{ */
 
 /* Configuration handling functions {{{ */
 
-static c_avl_tree_t *cj_avl_create(void)
-{
-  return c_avl_create ((int (*) (const void *, const void *)) strcmp);
-}
-
 static int cj_config_append_string (const char *name, struct curl_slist **dest, /* {{{ */
     oconfig_item_t *ci)
 {
@@ -481,7 +639,7 @@ static int cj_config_add_key (cj_t *db, /* {{{ */
     return (-1);
   }
   memset (key, 0, sizeof (*key));
-  key->magic = CJ_KEY_MAGIC;
+  key->ds_type = -1;
 
   if (strcasecmp ("Key", ci->key) == 0)
   {
@@ -539,12 +697,18 @@ static int cj_config_add_key (cj_t *db, /* {{{ */
    */
   char *ptr;
   char *name;
-  c_avl_tree_t *tree;
+  cj_node_t *node;
 
   if (db->tree == NULL)
-    db->tree = cj_avl_create();
+    db->tree = cj_node_create ("", 0);
+  if (db->tree == NULL)
+  {
+    ERROR ("curl_json plugin: malloc failed.");
+    cj_key_free (key);
+    return (-1);
+  }
 
-  tree = db->tree;
+  node = db->tree;
   ptr = key->path;
   if (*ptr == '/')
     ++ptr;
@@ -552,24 +716,19 @@ static int cj_config_add_key (cj_t *db, /* {{{ */
   name = ptr;
   while ((ptr = strchr (name, '/')) != NULL)
   {
-    char ent[PATH_MAX];
-    c_avl_tree_t *value;
-    size_t len;
+    size_t len = ptr - name;
 
-    len = ptr - name;
     if (len == 0)
       break;
 
-    len = COUCH_MIN(len, sizeof (ent)-1);
-    sstrncpy (ent, name, len+1);
-
-    if (c_avl_get (tree, ent, (void *) &value) != 0)
+    node = cj_node_get_child (node, name, len);
+    if (node == NULL)
     {
-      value = cj_avl_create ();
-      c_avl_insert (tree, strdup (ent), value);
+      ERROR ("curl_json plugin: malloc failed.");
+      cj_key_free (key);
+      return (-1);
     }
 
-    tree = value;
     name = ptr + 1;
   }
 
@@ -580,7 +739,22 @@ static int cj_config_add_key (cj_t *db, /* {{{ */
     return (-1);
   }
 
-  c_avl_insert (tree, strdup (name), key);
+  node = cj_node_get_child (node, name, strlen (name));
+  if (node == NULL)
+  {
+    ERROR ("curl_json plugin: malloc failed.");
+    cj_key_free (key);
+    return (-1);
+  }
+  if (node->key != NULL)
+  {
+    WARNING ("curl_json plugin: The key \"%s\" has been configured more "
+        "than once.", key->path);
+    cj_key_free (key);
+    return (-1);
+  }
+
+  node->key = key;
   return (status);
 } /* }}} int cj_config_add_key */
 
@@ -804,6 +978,14 @@ static int cj_config (oconfig_item_t *ci) /* {{{ */
       else
         errors++;
     }
+    else if (strcasecmp ("MaxConnectionsPerHost", child->key) == 0)
+    {
+      int tmp = 0;
+      if (cf_util_get_int (child, &tmp) == 0)
+        ucm_set_max_host_connections ((long) tmp);
+      else
+        errors++;
+    }
     else
     {
       WARNING ("curl_json plugin: Option `%s' not allowed here.", child->key);
@@ -896,38 +1078,11 @@ static int cj_sock_perform (cj_t *db) /* {{{ */
 } /* }}} int cj_sock_perform */
 
 
-static int cj_curl_perform(cj_t *db) /* {{{ */
-{
-  int status;
-  long rc;
-  char *url;
-  url = db->url;
-
-  status = curl_easy_perform (db->curl);
-  if (status != CURLE_OK)
-  {
-    ERROR ("curl_json plugin: curl_easy_perform failed with status %i: %s (%s)",
-           status, db->curl_errbuf, url);
-    return (-1);
-  }
-
-  curl_easy_getinfo(db->curl, CURLINFO_EFFECTIVE_URL, &url);
-  curl_easy_getinfo(db->curl, CURLINFO_RESPONSE_CODE, &rc);
-
-  /* The response code is zero if a non-HTTP transport was used. */
-  if ((rc != 0) && (rc != 200))
-  {
-    ERROR ("curl_json plugin: curl_easy_perform failed with "
-        "response code %ld (%s)", rc, url);
-    return (-1);
-  }
-  return (0);
-} /* }}} int cj_curl_perform */
-
-static int cj_perform (cj_t *db) /* {{{ */
+static int cj_parser_start (cj_t *db) /* {{{ */
 {
-  int status;
-  yajl_handle yprev = db->yajl;
+  db->depth = 0;
+  memset (&db->state, 0, sizeof(db->state));
+  db->state[db->depth].node = db->tree;
 
   db->yajl = yajl_alloc (&ycallbacks,
 #if HAVE_YAJL_V2
@@ -939,20 +1094,26 @@ static int cj_perform (cj_t *db) /* {{{ */
   if (db->yajl == NULL)
   {
     ERROR ("curl_json plugin: yajl_alloc failed.");
-    db->yajl = yprev;
     return (-1);
   }
 
-  if (db->url)
-    status = cj_curl_perform (db);
-  else
-    status = cj_sock_perform (db);
-  if (status < 0)
-  {
+  return (0);
+} /* }}} int cj_parser_start */
+
+static void cj_parser_abort (cj_t *db) /* {{{ */
+{
+  if (db->yajl != NULL)
     yajl_free (db->yajl);
-    db->yajl = yprev;
-    return (-1);
-  }
+  db->yajl = NULL;
+} /* }}} void cj_parser_abort */
+
+static int cj_parser_finish (cj_t *db) /* {{{ */
+{
+  int status;
+
+  /* Nothing has been received. */
+  if (db->yajl == NULL)
+    return (0);
 
 #if HAVE_YAJL_V2
     status = yajl_complete_parse(db->yajl);
@@ -968,19 +1129,57 @@ static int cj_perform (cj_t *db) /* {{{ */
     ERROR ("curl_json plugin: yajl_parse_complete failed: %s",
         (char *) errmsg);
     yajl_free_error (db->yajl, errmsg);
-    yajl_free (db->yajl);
-    db->yajl = yprev;
+    cj_parser_abort (db);
     return (-1);
   }
 
-  yajl_free (db->yajl);
-  db->yajl = yprev;
+  cj_parser_abort (db);
   return (0);
-} /* }}} int cj_perform */
+} /* }}} int cj_parser_finish */
+
+/* Called by the HTTP engine's thread once the response has been received. The
+ * body has been parsed by cj_curl_callback() already. */
+static void cj_curl_done (CURL *curl, CURLcode status, /* {{{ */
+    void *user_data)
+{
+  cj_t *db = user_data;
+  long rc;
+  char *url;
+  url = db->url;
+
+  if (status == CURLE_ABORTED_BY_CALLBACK) /* shutting down */
+  {
+    cj_parser_abort (db);
+    return;
+  }
+
+  if (status != CURLE_OK)
+  {
+    ERROR ("curl_json plugin: curl_easy_perform failed with status %i: %s (%s)",
+           status, db->curl_errbuf, url);
+    cj_parser_abort (db);
+    return;
+  }
+
+  curl_easy_getinfo(curl, CURLINFO_EFFECTIVE_URL, &url);
+  curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &rc);
+
+  /* The response code is zero if a non-HTTP transport was used. */
+  if ((rc != 0) && (rc != 200))
+  {
+    ERROR ("curl_json plugin: curl_easy_perform failed with "
+        "response code %ld (%s)", rc, url);
+    cj_parser_abort (db);
+    return;
+  }
+
+  cj_parser_finish (db);
+} /* }}} void cj_curl_done */
 
 static int cj_read (user_data_t *ud) /* {{{ */
 {
   cj_t *db;
+  int status;
 
   if ((ud == NULL) || (ud->data == NULL))
   {
@@ -990,12 +1189,34 @@ static int cj_read (user_data_t *ud) /* {{{ */
 
   db = (cj_t *) ud->data;
 
-  db->depth = 0;
-  memset (&db->state, 0, sizeof(db->state));
-  db->state[db->depth].tree = db->tree;
-  db->key = NULL;
+  if (db->url == NULL)
+  {
+    status = cj_sock_perform (db);
+    if (status < 0)
+    {
+      cj_parser_abort (db);
+      return (-1);
+    }
+    return (cj_parser_finish (db));
+  }
 
-  return cj_perform (db);
+  /* Requests are performed by the HTTP engine, which feeds the response into
+   * the parser as it arrives. */
+  status = ucm_submit (db->curl, cj_curl_done, db);
+  if (status == EBUSY)
+  {
+    WARNING ("curl_json plugin: The previous request for \"%s\" is still "
+        "in progress. Skipping this interval.", db->url);
+    return (-1);
+  }
+  else if (status != 0)
+  {
+    ERROR ("curl_json plugin: Submitting the request for \"%s\" failed.",
+        db->url);
+    return (-1);
+  }
+
+  return (0);
 } /* }}} int cj_read */
 
 static int cj_init (void) /* {{{ */
@@ -1006,10 +1227,17 @@ static int cj_init (void) /* {{{ */
   return (0);
 } /* }}} int cj_init */
 
+static int cj_shutdown (void) /* {{{ */
+{
+  ucm_shutdown ();
+  return (0);
+} /* }}} int cj_shutdown */
+
 void module_register (void)
 {
   plugin_register_complex_config ("curl_json", cj_config);
   plugin_register_init ("curl_json", cj_init);
+  plugin_register_shutdown ("curl_json", cj_shutdown);
 } /* void module_register */
 
 /* vim: set sw=2 sts=2 et fdm=marker : */
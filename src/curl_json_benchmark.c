@@ -0,0 +1,439 @@
+/**
+ * collectd - src/curl_json_benchmark.c
+ * Copyright (C) 2026       agent
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   agent <agent at local>
+ */
+
+/*
+ * Measures how fast the curl_json plugin parses a large response of which
+ * only a few values are configured, e.g. the node statistics of a big
+ * Elasticsearch cluster.
+ * Usage: benchmark_curl_json [<iterations> [<file> <key> [<key> ...]]]
+ * Without a file, a response with statistics of 2000 nodes (about 10 MByte) is
+ * generated and four keys per node are collected.
+ */
+
+#include "curl_json.c" /* sic */
+
+#include "utils_cache.h"
+
+#include <sys/stat.h>
+
+char hostname_g[] = "example.com";
+
+static data_source_t dsrc[] = {
+  { "value", DS_TYPE_GAUGE, 0.0, NAN }
+};
+static data_set_t ds = { "gauge", STATIC_ARRAY_SIZE (dsrc), dsrc };
+
+static unsigned long values_num = 0;
+
+/* mock functions */
+void plugin_log (int level, char const *format, ...)
+{
+  char buffer[1024];
+  va_list ap;
+
+  if (level > LOG_WARNING)
+    return;
+
+  va_start (ap, format);
+  vsnprintf (buffer, sizeof (buffer), format, ap);
+  va_end (ap);
+
+  fprintf (stderr, "plugin_log (%i, \"%s\");\n", level, buffer);
+}
+
+const data_set_t *plugin_get_ds (const char *name)
+{
+  /* Every type is a single gauge. */
+  return (&ds);
+}
+
+int plugin_dispatch_values (value_list_t const *vl)
+{
+  values_num++;
+  return (0);
+}
+
+cdtime_t plugin_get_interval (void)
+{
+  return TIME_T_TO_CDTIME_T (10);
+}
+
+plugin_ctx_t plugin_get_ctx (void)
+{
+  plugin_ctx_t ctx = { 0 };
+  return (ctx);
+}
+
+plugin_ctx_t plugin_set_ctx (plugin_ctx_t ctx)
+{
+  return (ctx);
+}
+
+int plugin_thread_create (pthread_t *thread, const pthread_attr_t *attr,
+    void *(*start_routine) (void *), void *arg)
+{
+  return (pthread_create (thread, attr, start_routine, arg));
+}
+
+int plugin_register_complex_config (const char *type,
+    int (*callback) (oconfig_item_t *))
+{
+  return (0);
+}
+
+int plugin_register_init (const char *name, plugin_init_cb callback)
+{
+  return (0);
+}
+
+int plugin_register_shutdown (const char *name, int (*callback) (void))
+{
+  return (0);
+}
+
+int plugin_register_complex_read (const char *group, const char *name,
+    plugin_read_cb callback, cdtime_t interval, user_data_t *user_data)
+{
+  return (0);
+}
+
+int cf_util_get_string (const oconfig_item_t *ci, char **ret_string)
+{
+  if ((ci->values_num != 1) || (ci->values[0].type != OCONFIG_TYPE_STRING))
+    return (-1);
+
+  sfree (*ret_string);
+  *ret_string = strdup (ci->values[0].value.string);
+  return ((*ret_string == NULL) ? -1 : 0);
+}
+
+int cf_util_get_int (const oconfig_item_t *ci, int *ret_value)
+{
+  return (-1);
+}
+
+int cf_util_get_boolean (const oconfig_item_t *ci, _Bool *ret_bool)
+{
+  return (-1);
+}
+
+int cf_util_get_cdtime (const oconfig_item_t *ci, cdtime_t *ret_value)
+{
+  return (-1);
+}
+
+void c_complain_once (int level, c_complain_t *c, const char *format, ...)
+{
+}
+
+gauge_t *uc_get_rate (const data_set_t *ds, const value_list_t *vl)
+{
+  return (NULL);
+}
+/* end mock functions */
+
+struct buffer_s
+{
+  char *data;
+  size_t len;
+  size_t size;
+};
+typedef struct buffer_s buffer_t;
+
+__attribute__ ((format (printf, 2, 3)))
+static void buffer_printf (buffer_t *b, char const *format, ...)
+{
+  va_list ap;
+  int status;
+
+  while (42)
+  {
+    va_start (ap, format);
+    status = vsnprintf (b->data + b->len, b->size - b->len, format, ap);
+    va_end (ap);
+
+    if ((status >= 0) && ((size_t) status < b->size - b->len))
+    {
+      b->len += (size_t) status;
+      return;
+    }
+
+    b->size = 2 * b->size + 1024;
+    b->data = realloc (b->data, b->size);
+    if (b->data == NULL)
+    {
+      fprintf (stderr, "realloc failed\n");
+      exit (EXIT_FAILURE);
+    }
+  }
+}
+
+static char const *thread_pools[] = { "bulk", "fetch_shard_started",
+  "fetch_shard_store", "flush", "force_merge", "generic", "get", "index",
+  "listener", "management", "percolate", "refresh", "search", "snapshot",
+  "suggest", "warmer" };
+
+static char const *default_keys[] = {
+  "nodes/*/indices/docs/count",
+  "nodes/*/jvm/mem/heap_used_in_bytes",
+  "nodes/*/thread_pool/search/queue",
+  "nodes/*/fs/data/*/available_in_bytes"
+};
+
+/* Generates something resembling the response of Elasticsearch's
+ * "/_nodes/stats" for "nodes_num" nodes. Per node, one value matches every
+ * one of the default keys, except for "fs/data", which has two entries. */
+static void generate_response (buffer_t *b, int nodes_num)
+{
+  int i;
+  size_t j;
+
+  buffer_printf (b, "{\"cluster_name\":\"benchmark\",\"nodes\":{");
+  for (i = 0; i < nodes_num; i++)
+  {
+    buffer_printf (b, "%s\"node%04d\":{\"timestamp\":1458000000000,"
+        "\"name\":\"node%04d\",\"transport_address\":\"10.0.%d.%d:9300\","
+        "\"host\":\"10.0.%d.%d\",\"roles\":[\"master\",\"data\",\"ingest\"],",
+        (i == 0) ? "" : ",", i, i, i / 256, i % 256, i / 256, i % 256);
+
+    buffer_printf (b, "\"indices\":{"
+        "\"docs\":{\"count\":%d,\"deleted\":%d},"
+        "\"store\":{\"size_in_bytes\":%d,\"throttle_time_in_millis\":0},"
+        "\"indexing\":{\"index_total\":%d,\"index_time_in_millis\":%d,"
+          "\"index_current\":0,\"index_failed\":0,\"delete_total\":%d,"
+          "\"delete_time_in_millis\":%d,\"delete_current\":0,"
+          "\"noop_update_total\":0,\"is_throttled\":false,"
+          "\"throttle_time_in_millis\":0},"
+        "\"get\":{\"total\":%d,\"time_in_millis\":%d,\"exists_total\":%d,"
+          "\"exists_time_in_millis\":%d,\"missing_total\":0,"
+          "\"missing_time_in_millis\":0,\"current\":0},"
+        "\"search\":{\"open_contexts\":0,\"query_total\":%d,"
+          "\"query_time_in_millis\":%d,\"query_current\":0,\"fetch_total\":%d,"
+          "\"fetch_time_in_millis\":%d,\"fetch_current\":0,"
+          "\"scroll_total\":0,\"scroll_time_in_millis\":0,"
+          "\"scroll_current\":0},"
+        "\"segments\":{\"count\":%d,\"memory_in_bytes\":%d,"
+          "\"terms_memory_in_bytes\":%d,\"stored_fields_memory_in_bytes\":%d,"
+          "\"term_vectors_memory_in_bytes\":0,\"norms_memory_in_bytes\":%d,"
+          "\"doc_values_memory_in_bytes\":%d,"
+          "\"index_writer_memory_in_bytes\":0,"
+          "\"version_map_memory_in_bytes\":0,"
+          "\"fixed_bit_set_memory_in_bytes\":0,\"file_sizes\":{}}},",
+        1000 * i, i, 123456 * i, 17 * i, 3 * i, i, i, 42 * i, 5 * i, 40 * i,
+        4 * i, 99 * i, 12 * i, 98 * i, 11 * i, i, 7654 * i, 5432 * i,
+        321 * i, 12 * i, 34 * i);
+
+    buffer_printf (b, "\"os\":{\"timestamp\":1458000000000,"
+        "\"cpu_percent\":%d,\"load_average\":[%d.25,%d.5,%d.75],"
+        "\"mem\":{\"total_in_bytes\":34359738368,\"free_in_bytes\":%d,"
+          "\"used_in_bytes\":%d,\"free_percent\":%d,\"used_percent\":%d},"
+        "\"swap\":{\"total_in_bytes\":0,\"free_in_bytes\":0,"
+          "\"used_in_bytes\":0}},",
+        i % 100, i % 8, i % 4, i % 2, 1000 * i, 2000 * i, i % 100,
+        100 - (i % 100));
+
+    buffer_printf (b, "\"jvm\":{\"timestamp\":1458000000000,"
+        "\"uptime_in_millis\":%d,"
+        "\"mem\":{\"heap_used_in_bytes\":%d,\"heap_used_percent\":%d,"
+          "\"heap_committed_in_bytes\":%d,\"heap_max_in_bytes\":%d,"
+          "\"non_heap_used_in_bytes\":%d,"
+          "\"non_heap_committed_in_bytes\":%d,\"pools\":{"
+          "\"young\":{\"used_in_bytes\":%d,\"max_in_bytes\":%d,"
+            "\"peak_used_in_bytes\":%d,\"peak_max_in_bytes\":%d},"
+          "\"survivor\":{\"used_in_bytes\":%d,\"max_in_bytes\":%d,"
+            "\"peak_used_in_bytes\":%d,\"peak_max_in_bytes\":%d},"
+          "\"old\":{\"used_in_bytes\":%d,\"max_in_bytes\":%d,"
+            "\"peak_used_in_bytes\":%d,\"peak_max_in_bytes\":%d}}},"
+        "\"threads\":{\"count\":%d,\"peak_count\":%d},"
+        "\"gc\":{\"collectors\":{"
+          "\"young\":{\"collection_count\":%d,"
+            "\"collection_time_in_millis\":%d},"
+          "\"old\":{\"collection_count\":%d,"
+            "\"collection_time_in_millis\":%d}}}},",
+        1000 * i, 1024 * i, i % 100, 2048 * i, 4096 * i, 64 * i, 128 * i,
+        i, 2 * i, 3 * i, 4 * i, 5 * i, 6 * i, 7 * i, 8 * i, 9 * i, 10 * i,
+        11 * i, 12 * i, 100 + i, 200 + i, 10 * i, 20 * i, i, 2 * i);
+
+    buffer_printf (b, "\"thread_pool\":{");
+    for (j = 0; j < STATIC_ARRAY_SIZE (thread_pools); j++)
+      buffer_printf (b, "%s\"%s\":{\"threads\":%d,\"queue\":%zu,"
+          "\"active\":%d,\"rejected\":0,\"largest\":%d,\"completed\":%d}",
+          (j == 0) ? "" : ",", thread_pools[j], i % 32, j, i % 8, i % 32,
+          1000 * i);
+    buffer_printf (b, "},");
+
+    buffer_printf (b, "\"fs\":{\"timestamp\":1458000000000,"
+        "\"total\":{\"total_in_bytes\":%d,\"free_in_bytes\":%d,"
+          "\"available_in_bytes\":%d},\"data\":[",
+        1000000 * (i % 1000), 500000 * (i % 1000), 400000 * (i % 1000));
+    for (j = 0; j < 2; j++)
+      buffer_printf (b, "%s{\"path\":\"/var/lib/elasticsearch/nodes/%zu\","
+          "\"mount\":\"/var/lib/elasticsearch (/dev/sd%c1)\","
+          "\"type\":\"ext4\",\"total_in_bytes\":%d,\"free_in_bytes\":%d,"
+          "\"available_in_bytes\":%d,\"spins\":\"true\"}",
+          (j == 0) ? "" : ",", j, (char) ('b' + j), 500000 * (i % 1000),
+          250000 * (i % 1000), 200000 * (i % 1000));
+    buffer_printf (b, "]},");
+
+    buffer_printf (b, "\"transport\":{\"server_open\":%d,\"rx_count\":%d,"
+        "\"rx_size_in_bytes\":%d,\"tx_count\":%d,\"tx_size_in_bytes\":%d},"
+        "\"http\":{\"current_open\":%d,\"total_opened\":%d},"
+        "\"breakers\":{"
+          "\"request\":{\"limit_size_in_bytes\":%d,"
+            "\"limit_size\":\"1gb\",\"estimated_size_in_bytes\":0,"
+            "\"estimated_size\":\"0b\",\"overhead\":1.0,\"tripped\":0},"
+          "\"fielddata\":{\"limit_size_in_bytes\":%d,"
+            "\"limit_size\":\"1.5gb\",\"estimated_size_in_bytes\":%d,"
+            "\"estimated_size\":\"%dkb\",\"overhead\":1.03,\"tripped\":0},"
+          "\"parent\":{\"limit_size_in_bytes\":%d,"
+            "\"limit_size\":\"2gb\",\"estimated_size_in_bytes\":%d,"
+            "\"estimated_size\":\"%dkb\",\"overhead\":1.0,\"tripped\":0}}}",
+        i % 64, 1000 * i, 100000 * i, 1001 * i, 100100 * i, i % 16, 10 * i,
+        1073741824, 1610612736, 1024 * i, i, 2147483647, 1024 * i, i);
+  }
+  buffer_printf (b, "}}");
+}
+
+static int read_file (buffer_t *b, char const *file)
+{
+  struct stat statbuf;
+  FILE *fh;
+
+  if (stat (file, &statbuf) != 0)
+  {
+    perror (file);
+    return (-1);
+  }
+
+  b->size = (size_t) statbuf.st_size + 1;
+  b->data = malloc (b->size);
+  if (b->data == NULL)
+    return (-1);
+
+  fh = fopen (file, "r");
+  if (fh == NULL)
+  {
+    perror (file);
+    return (-1);
+  }
+  b->len = fread (b->data, 1, (size_t) statbuf.st_size, fh);
+  fclose (fh);
+
+  return (0);
+}
+
+static int add_key (cj_t *db, char const *path)
+{
+  oconfig_value_t path_value = { .type = OCONFIG_TYPE_STRING };
+  oconfig_value_t type_value = { .type = OCONFIG_TYPE_STRING };
+  oconfig_item_t type_item = { .key = "Type", .values = &type_value,
+    .values_num = 1 };
+  oconfig_item_t key_item = { .key = "Key", .values = &path_value,
+    .values_num = 1, .children = &type_item, .children_num = 1 };
+
+  path_value.value.string = (char *) path;
+  type_value.value.string = "gauge";
+
+  return (cj_config_add_key (db, &key_item));
+}
+
+int main (int argc, char **argv)
+{
+  buffer_t response = { NULL, 0, 0 };
+  unsigned long iterations = 10;
+  unsigned long expected = 0;
+  unsigned long i;
+  size_t offset;
+  cdtime_t begin;
+  double elapsed;
+  cj_t *db;
+  int nodes_num = 2000;
+  int status;
+
+  if (argc > 1)
+    iterations = strtoul (argv[1], NULL, 0);
+  if (argc == 3)
+  {
+    fprintf (stderr, "Usage: %s [<iterations> [<file> <key> [<key> ...]]]\n",
+        argv[0]);
+    return (EXIT_FAILURE);
+  }
+
+  db = calloc (1, sizeof (*db));
+  if (db == NULL)
+    return (EXIT_FAILURE);
+  db->instance = strdup ("benchmark");
+
+  if (argc > 3)
+  {
+    if (read_file (&response, argv[2]) != 0)
+      return (EXIT_FAILURE);
+    for (i = 3; i < (unsigned long) argc; i++)
+      if (add_key (db, argv[i]) != 0)
+        return (EXIT_FAILURE);
+  }
+  else
+  {
+    generate_response (&response, nodes_num);
+    for (i = 0; i < STATIC_ARRAY_SIZE (default_keys); i++)
+      if (add_key (db, default_keys[i]) != 0)
+        return (EXIT_FAILURE);
+    expected = iterations * (unsigned long) (nodes_num * 5);
+  }
+
+  begin = cdtime ();
+  for (i = 0; i < iterations; i++)
+  {
+    /* Feed the parser the way libcurl does, in chunks of 16 kByte. */
+    for (offset = 0; offset < response.len; offset += CURL_MAX_WRITE_SIZE)
+    {
+      size_t len = COUCH_MIN (response.len - offset,
+          (size_t) CURL_MAX_WRITE_SIZE);
+
+      if (cj_curl_callback (response.data + offset, 1, len, db) != len)
+        return (EXIT_FAILURE);
+    }
+
+    if (cj_parser_finish (db) != 0)
+      return (EXIT_FAILURE);
+  }
+  elapsed = CDTIME_T_TO_DOUBLE (cdtime () - begin);
+
+  printf ("response: %.1f MByte\n",
+      ((double) response.len) / (1024.0 * 1024.0));
+  printf ("parse:    %lu iterations in %.3f s (%.1f MByte/s)\n", iterations,
+      elapsed, ((double) (iterations * response.len))
+      / (1024.0 * 1024.0 * elapsed));
+  printf ("values:   %lu\n", values_num);
+
+  status = ((expected == 0) || (values_num == expected)) ? 0 : 1;
+
+  cj_free (db);
+  sfree (response.data);
+  return (status);
+}
+
+/* vim: set sw=2 sts=2 et : */
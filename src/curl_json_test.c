@@ -0,0 +1,253 @@
+/**
+ * collectd - src/curl_json_test.c
+ * Copyright (C) 2026       agent
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   agent <agent at local>
+ */
+
+/* Values are handed to this function instead of the daemon. */
+#define plugin_dispatch_values test_dispatch_values
+
+#include "curl_json.c" /* sic */
+#include "testing.h"
+
+static data_source_t dsrc_gauge[] = {
+  { "value", DS_TYPE_GAUGE, 0.0, NAN }
+};
+static data_set_t ds_gauge = { "gauge", STATIC_ARRAY_SIZE (dsrc_gauge),
+  dsrc_gauge };
+
+static gauge_t dispatched[16];
+static char dispatched_instance[16][DATA_MAX_NAME_LEN];
+static size_t dispatched_num = 0;
+
+int test_dispatch_values (value_list_t const *vl)
+{
+  if (dispatched_num >= STATIC_ARRAY_SIZE (dispatched))
+    return (-1);
+
+  dispatched[dispatched_num] = vl->values[0].gauge;
+  sstrncpy (dispatched_instance[dispatched_num], vl->type_instance,
+      sizeof (dispatched_instance[dispatched_num]));
+  dispatched_num++;
+  return (0);
+}
+
+const data_set_t *plugin_get_ds (const char *name)
+{
+  if (strcmp (name, ds_gauge.type) == 0)
+    return (&ds_gauge);
+  return (NULL);
+}
+
+int plugin_register_complex_read (const char *group, const char *name,
+    plugin_read_cb callback, cdtime_t interval, user_data_t *user_data)
+{
+  return (ENOTSUP);
+}
+
+int cf_util_get_string (const oconfig_item_t *ci, char **ret_string)
+{
+  if ((ci->values_num != 1) || (ci->values[0].type != OCONFIG_TYPE_STRING))
+    return (-1);
+
+  sfree (*ret_string);
+  *ret_string = strdup (ci->values[0].value.string);
+  return ((*ret_string == NULL) ? -1 : 0);
+}
+
+int cf_util_get_int (const oconfig_item_t *ci, int *ret_value)
+{
+  return (ENOTSUP);
+}
+
+int cf_util_get_boolean (const oconfig_item_t *ci, _Bool *ret_bool)
+{
+  return (ENOTSUP);
+}
+
+int cf_util_get_cdtime (const oconfig_item_t *ci, cdtime_t *ret_value)
+{
+  return (ENOTSUP);
+}
+
+void c_complain_once (int level, c_complain_t *c, const char *format, ...)
+{
+}
+
+static int add_key (cj_t *db, char const *path)
+{
+  oconfig_value_t path_value = { .type = OCONFIG_TYPE_STRING };
+  oconfig_value_t type_value = { .type = OCONFIG_TYPE_STRING };
+  oconfig_item_t type_item = { .key = "Type", .values = &type_value,
+    .values_num = 1 };
+  oconfig_item_t key_item = { .key = "Key", .values = &path_value,
+    .values_num = 1, .children = &type_item, .children_num = 1 };
+
+  path_value.value.string = (char *) path;
+  type_value.value.string = "gauge";
+
+  return (cj_config_add_key (db, &key_item));
+}
+
+static cj_t *create_db (void)
+{
+  char const *keys[] = { "x", "/a/b", "a/*", "a/c/d", "arr/0", "arr/*/y",
+    "long" };
+  cj_t *db;
+  size_t i;
+
+  db = calloc (1, sizeof (*db));
+  if (db == NULL)
+    return (NULL);
+  db->instance = strdup ("test");
+
+  for (i = 0; i < STATIC_ARRAY_SIZE (keys); i++)
+  {
+    if (add_key (db, keys[i]) != 0)
+    {
+      cj_free (db);
+      return (NULL);
+    }
+  }
+
+  return (db);
+}
+
+#define LOOKUP(node, name) cj_node_lookup ((node), (name), strlen (name))
+
+DEF_TEST(trie)
+{
+  char const *root_names[] = { "a", "arr", "long", "x" };
+  cj_node_t *root;
+  cj_node_t *a;
+  cj_node_t *node;
+  cj_t *db;
+  size_t i;
+
+  CHECK_NOT_NULL (db = create_db ());
+  root = db->tree;
+  CHECK_NOT_NULL (root);
+
+  /* children are sorted, "a" sorts before "arr" */
+  EXPECT_EQ_INT ((int) STATIC_ARRAY_SIZE (root_names),
+      (int) root->children_num);
+  for (i = 0; i < root->children_num; i++)
+    EXPECT_EQ_STR (root_names[i], root->children[i]->name);
+  OK (root->any == NULL);
+
+  CHECK_NOT_NULL (a = LOOKUP (root, "a"));
+  OK (a->key == NULL);
+  OK (LOOKUP (root, "ar") == NULL);
+  OK (LOOKUP (root, "arrr") == NULL);
+  OK (LOOKUP (root, "") == NULL);
+  /* names are compared by length, not as C strings */
+  OK (cj_node_lookup (root, "arr/0", 3) == LOOKUP (root, "arr"));
+
+  /* exact matches take precedence over "*" */
+  CHECK_NOT_NULL (node = LOOKUP (a, "b"));
+  CHECK_NOT_NULL (node->key);
+  EXPECT_EQ_STR ("/a/b", node->key->path);
+  CHECK_NOT_NULL (node = LOOKUP (a, "e"));
+  OK (node == a->any);
+  CHECK_NOT_NULL (node->key);
+  EXPECT_EQ_STR ("a/*", node->key->path);
+  CHECK_NOT_NULL (node = LOOKUP (a, "c"));
+  OK (node->key == NULL);
+  CHECK_NOT_NULL (node = LOOKUP (node, "d"));
+  CHECK_NOT_NULL (node->key);
+  EXPECT_EQ_STR ("a/c/d", node->key->path);
+  OK (LOOKUP (node, "d") == NULL);
+
+  /* "*" also matches array indexes */
+  CHECK_NOT_NULL (node = LOOKUP (root, "arr"));
+  CHECK_NOT_NULL (node = LOOKUP (node, "7"));
+  CHECK_NOT_NULL (node = LOOKUP (node, "y"));
+  CHECK_NOT_NULL (node->key);
+  EXPECT_EQ_STR ("arr/*/y", node->key->path);
+
+  OK (add_key (db, "a/b") != 0);
+  OK (add_key (db, "a/") != 0);
+
+  cj_free (db);
+  return (0);
+}
+
+DEF_TEST(parse)
+{
+  char const *json = "{"
+    "\"a\": {\"b\": 1, \"c\": {\"d\": 2, \"e\": 10}, \"e\": 3, \"f\": [11]},"
+    "\"x\": 4,"
+    "\"y\": {\"a\": {\"b\": 12}},"
+    "\"arr\": [5, {\"y\": 6, \"z\": 13}, {\"y\": \"9\"}],"
+    "\"long\": \"1234567890123456789012345678901234567890"
+      "12345678901234567890123456789012345678901234567890\""
+    "}";
+  struct {
+    char const *instance;
+    gauge_t value;
+  } want[] = {
+    { "a-b", 1.0 },
+    { "a-c-d", 2.0 },
+    { "a-e", 3.0 },
+    { "x", 4.0 },
+    { "arr-0", 5.0 },
+    { "arr-1-y", 6.0 },
+    { "arr-2-y", 9.0 },
+  };
+  size_t len = strlen (json);
+  size_t offset;
+  cj_t *db;
+  size_t i;
+
+  CHECK_NOT_NULL (db = create_db ());
+
+  /* feed the parser in small chunks, like libcurl does */
+  for (offset = 0; offset < len; offset += 7)
+  {
+    size_t chunk = COUCH_MIN (len - offset, 7);
+    if (cj_curl_callback ((char *) json + offset, 1, chunk, db) != chunk)
+      break;
+  }
+  OK (offset >= len);
+  CHECK_ZERO (cj_parser_finish (db));
+
+  EXPECT_EQ_INT ((int) STATIC_ARRAY_SIZE (want), (int) dispatched_num);
+  for (i = 0; (i < dispatched_num) && (i < STATIC_ARRAY_SIZE (want)); i++)
+  {
+    EXPECT_EQ_STR (want[i].instance, dispatched_instance[i]);
+    EXPECT_EQ_DOUBLE (want[i].value, dispatched[i]);
+  }
+
+  cj_free (db);
+  return (0);
+}
+
+int main (void)
+{
+  RUN_TEST(trie);
+  RUN_TEST(parse);
+
+  END_TEST;
+}
+
+/* vim: set sw=2 sts=2 et : */
@@ -23,6 +23,7 @@
 #include "common.h"
 #include "plugin.h"
 #include "configfile.h"
+#include "utils_curl_multi.h"
 #include "utils_llist.h"
 
 #include <libxml/parser.h>
@@ -89,9 +90,8 @@ struct cx_s /* {{{ */
 
   CURL *curl;
   char curl_errbuf[CURL_ERROR_SIZE];
-  char *buffer;
-  size_t buffer_size;
-  size_t buffer_fill;
+  /* The document is parsed while it is being received. */
+  xmlParserCtxtPtr xml_ctxt;
 
   llist_t *list; /* list of xpath blocks */
 };
@@ -117,28 +117,35 @@ static size_t cx_curl_callback (void *buf, /* {{{ */
    if (len <= 0)
     return (len);
 
-  if ((db->buffer_fill + len) >= db->buffer_size)
+  /* The first chunk is used to detect the encoding. */
+  if (db->xml_ctxt == NULL)
   {
-    char *temp;
-
-    temp = (char *) realloc (db->buffer,
-                    db->buffer_fill + len + 1);
-    if (temp == NULL)
+    db->xml_ctxt = xmlCreatePushParserCtxt (/* sax = */ NULL,
+        /* user_data = */ NULL, (char *) buf, (int) len, db->url);
+    if (db->xml_ctxt == NULL)
     {
-      ERROR ("curl_xml plugin: realloc failed.");
+      ERROR ("curl_xml plugin: xmlCreatePushParserCtxt failed.");
       return (0);
     }
-    db->buffer = temp;
-    db->buffer_size = db->buffer_fill + len + 1;
+    return (len);
   }
 
-  memcpy (db->buffer + db->buffer_fill, (char *) buf, len);
-  db->buffer_fill += len;
-  db->buffer[db->buffer_fill] = 0;
+  xmlParseChunk (db->xml_ctxt, (char *) buf, (int) len, /* terminate = */ 0);
 
   return (len);
 } /* }}} size_t cx_curl_callback */
 
+static void cx_xml_reset (cx_t *db) /* {{{ */
+{
+  if (db->xml_ctxt == NULL)
+    return;
+
+  if (db->xml_ctxt->myDoc != NULL)
+    xmlFreeDoc (db->xml_ctxt->myDoc);
+  xmlFreeParserCtxt (db->xml_ctxt);
+  db->xml_ctxt = NULL;
+} /* }}} void cx_xml_reset */
+
 static void cx_xpath_free (cx_xpath_t *xpath) /* {{{ */
 {
   if (xpath == NULL)
@@ -186,13 +193,16 @@ static void cx_free (void *arg) /* {{{ */
     return;
 
   if (db->curl != NULL)
+  {
+    ucm_remove (db->curl);
     curl_easy_cleanup (db->curl);
+  }
   db->curl = NULL;
 
   if (db->list != NULL)
     cx_list_free (db->list);
 
-  sfree (db->buffer);
+  cx_xml_reset (db);
   sfree (db->instance);
   sfree (db->host);
 
@@ -566,21 +576,13 @@ static int cx_handle_parsed_xml(xmlDocPtr doc, /* {{{ */
   return status;
 } /* }}} cx_handle_parsed_xml */
 
-static int cx_parse_stats_xml(xmlChar* xml, cx_t *db) /* {{{ */
+/* Evaluates the configured XPath expressions and frees "doc". */
+static int cx_parse_stats_xml(xmlDocPtr doc, cx_t *db) /* {{{ */
 {
   int status;
-  xmlDocPtr doc;
   xmlXPathContextPtr xpath_ctx;
   size_t i;
 
-  /* Load the XML */
-  doc = xmlParseDoc(xml);
-  if (doc == NULL)
-  {
-    ERROR ("curl_xml plugin: Failed to parse the xml document  - %s", xml);
-    return (-1);
-  }
-
   xpath_ctx = xmlXPathNewContext(doc);
   if(xpath_ctx == NULL)
   {
@@ -612,21 +614,30 @@ static int cx_parse_stats_xml(xmlChar* xml, cx_t *db) /* {{{ */
   return status;
 } /* }}} cx_parse_stats_xml */
 
-static int cx_curl_perform (cx_t *db, CURL *curl) /* {{{ */
+/* Called by the HTTP engine's thread once the document has been received. */
+static void cx_curl_done (CURL *curl, CURLcode status, /* {{{ */
+    void *user_data)
 {
-  int status;
+  cx_t *db = user_data;
+  xmlParserCtxtPtr xml_ctxt;
+  xmlDocPtr doc;
+  _Bool well_formed;
   long rc;
-  char *ptr;
   char *url;
   url = db->url;
 
-  db->buffer_fill = 0; 
-  status = curl_easy_perform (curl);
+  if (status == CURLE_ABORTED_BY_CALLBACK) /* shutting down */
+  {
+    cx_xml_reset (db);
+    return;
+  }
+
   if (status != CURLE_OK)
   {
     ERROR ("curl_xml plugin: curl_easy_perform failed with status %i: %s (%s)",
            status, db->curl_errbuf, url);
-    return (-1);
+    cx_xml_reset (db);
+    return;
   }
 
   curl_easy_getinfo(curl, CURLINFO_EFFECTIVE_URL, &url);
@@ -637,20 +648,41 @@ static int cx_curl_perform (cx_t *db, CURL *curl) /* {{{ */
   {
     ERROR ("curl_xml plugin: curl_easy_perform failed with response code %ld (%s)",
            rc, url);
-    return (-1);
+    cx_xml_reset (db);
+    return;
   }
 
-  ptr = db->buffer;
+  if (db->xml_ctxt == NULL)
+  {
+    ERROR ("curl_xml plugin: Received an empty document (%s)", url);
+    return;
+  }
 
-  status = cx_parse_stats_xml(BAD_CAST ptr, db);
-  db->buffer_fill = 0;
+  xml_ctxt = db->xml_ctxt;
+  db->xml_ctxt = NULL;
 
-  return status;
-} /* }}} int cx_curl_perform */
+  xmlParseChunk (xml_ctxt, NULL, 0, /* terminate = */ 1);
+  doc = xml_ctxt->myDoc;
+  well_formed = xml_ctxt->wellFormed ? 1 : 0;
+  xmlFreeParserCtxt (xml_ctxt);
+
+  if ((doc == NULL) || !well_formed)
+  {
+    ERROR ("curl_xml plugin: Failed to parse the xml document (%s)", url);
+    if (doc != NULL)
+      xmlFreeDoc (doc);
+    return;
+  }
+
+  cx_parse_stats_xml (doc, db);
+} /* }}} void cx_curl_done */
 
+/* Requests the document and returns immediately. The response is parsed by
+ * the HTTP engine's thread while it is being received. */
 static int cx_read (user_data_t *ud) /* {{{ */
 {
   cx_t *db;
+  int status;
 
   if ((ud == NULL) || (ud->data == NULL))
   {
@@ -660,7 +692,21 @@ static int cx_read (user_data_t *ud) /* {{{ */
 
   db = (cx_t *) ud->data;
 
-  return cx_curl_perform (db, db->curl);
+  status = ucm_submit (db->curl, cx_curl_done, db);
+  if (status == EBUSY)
+  {
+    WARNING ("curl_xml plugin: The previous request for \"%s\" is still "
+        "in progress. Skipping this interval.", db->url);
+    return (-1);
+  }
+  else if (status != 0)
+  {
+    ERROR ("curl_xml plugin: Submitting the request for \"%s\" failed.",
+        db->url);
+    return (-1);
+  }
+
+  return (0);
 } /* }}} int cx_read */
 
 /* Configuration handling functions {{{ */
@@ -1057,6 +1103,14 @@ static int cx_config (oconfig_item_t *ci) /* {{{ */
       else
         errors++;
     }
+    else if (strcasecmp ("MaxConnectionsPerHost", child->key) == 0)
+    {
+      int tmp = 0;
+      if (cf_util_get_int (child, &tmp) == 0)
+        ucm_set_max_host_connections ((long) tmp);
+      else
+        errors++;
+    }
     else
     {
       WARNING ("curl_xml plugin: Option `%s' not allowed here.", child->key);
@@ -1081,10 +1135,17 @@ static int cx_init (void) /* {{{ */
   return (0);
 } /* }}} int cx_init */
 
+static int cx_shutdown (void) /* {{{ */
+{
+  ucm_shutdown ();
+  return (0);
+} /* }}} int cx_shutdown */
+
 void module_register (void)
 {
   plugin_register_complex_config ("curl_xml", cx_config);
   plugin_register_init ("curl_xml", cx_init);
+  plugin_register_shutdown ("curl_xml", cx_shutdown);
 } /* void module_register */
 
 /* vim: set sw=2 sts=2 et fdm=marker : */
@@ -122,7 +122,10 @@ static cf_global_option_t cf_global_options[] =
 	{"CollectInternalStats", NULL, "false"},
 	{"PreCacheChain",  NULL, "PreCache"},
 	{"PostCacheChain", NULL, "PostCache"},
-	{"MaxReadInterval", NULL, "86400"}
+	{"MaxReadInterval", NULL, "86400"},
+	{"CacheHistoryLength", NULL, NULL},
+	{"CacheSnapshotFile", NULL, NULL},
+	{"CacheSnapshotInterval", NULL, NULL}
 };
 static int cf_global_options_num = STATIC_ARRAY_SIZE (cf_global_options);
 
@@ -134,8 +134,13 @@ static long            write_limit_high = 0;
 static long            write_limit_low = 0;
 
 static derive_t        stats_values_dropped = 0;
+static pthread_mutex_t statistics_lock = PTHREAD_MUTEX_INITIALIZER;
 static _Bool           record_statistics = 0;
 
+static char const     *cache_snapshot_file = NULL;
+static cdtime_t        cache_snapshot_interval = 0;
+static cdtime_t        cache_snapshot_next = 0;
+
 /*
  * Static functions
  */
@@ -818,6 +823,77 @@ static int plugin_write_enqueue (value_list_t const *vl) /* {{{ */
 	return (0);
 } /* }}} int plugin_write_enqueue */
 
+/* Like plugin_write_enqueue, but appends all value lists at once. Value lists
+ * for which "drop" is true are skipped. Returns the number of value lists
+ * which could not be enqueued. */
+static size_t plugin_write_enqueue_list (value_list_t const *vl, /* {{{ */
+		size_t vl_num, _Bool const *drop)
+{
+	write_queue_t *head = NULL;
+	write_queue_t *tail = NULL;
+	plugin_ctx_t ctx = plugin_get_ctx ();
+	long length = 0;
+	size_t failed = 0;
+	size_t i;
+
+	for (i = 0; i < vl_num; i++)
+	{
+		write_queue_t *q;
+
+		if (drop[i])
+			continue;
+
+		q = malloc (sizeof (*q));
+		if (q == NULL)
+		{
+			failed++;
+			continue;
+		}
+		q->next = NULL;
+		q->ctx = ctx;
+
+		q->vl = plugin_value_list_clone (vl + i);
+		if (q->vl == NULL)
+		{
+			sfree (q);
+			failed++;
+			continue;
+		}
+
+		if (tail == NULL)
+			head = q;
+		else
+			tail->next = q;
+		tail = q;
+		length++;
+	}
+
+	if (head == NULL)
+		return (failed);
+
+	pthread_mutex_lock (&write_lock);
+
+	if (write_queue_tail == NULL)
+	{
+		write_queue_head = head;
+		write_queue_length = length;
+	}
+	else
+	{
+		write_queue_tail->next = head;
+		write_queue_length += length;
+	}
+	write_queue_tail = tail;
+
+	if (length > 1)
+		pthread_cond_broadcast (&write_cond);
+	else
+		pthread_cond_signal (&write_cond);
+	pthread_mutex_unlock (&write_lock);
+
+	return (failed);
+} /* }}} size_t plugin_write_enqueue_list */
+
 static value_list_t *plugin_write_dequeue (void) /* {{{ */
 {
 	write_queue_t *q;
@@ -1696,12 +1772,38 @@ int plugin_unregister_notification (const char *name)
 void plugin_init_all (void)
 {
 	char const *chain_name;
+	long history_length;
 	llentry_t *le;
 	int status;
 
 	/* Init the value cache */
 	uc_init ();
 
+	history_length = global_option_get_long ("CacheHistoryLength",
+			/* default = */ 0);
+	if (history_length < 0)
+	{
+		ERROR ("CacheHistoryLength must be positive or zero.");
+		history_length = 0;
+	}
+	uc_set_history_length ((size_t) history_length);
+
+	/* Restore the value cache from the last snapshot. The data sets have been
+	 * read from types.db at this point. This function may be called more
+	 * than once, but the snapshot is only loaded the first time. */
+	if (cache_snapshot_file == NULL)
+	{
+		cache_snapshot_file = global_option_get ("CacheSnapshotFile");
+		if (cache_snapshot_file != NULL)
+		{
+			uc_snapshot_read (cache_snapshot_file);
+
+			cache_snapshot_interval = global_option_get_time (
+					"CacheSnapshotInterval", /* default = */ 0);
+			cache_snapshot_next = cdtime () + cache_snapshot_interval;
+		}
+	}
+
 	if (IS_TRUE (global_option_get ("CollectInternalStats")))
 		record_statistics = 1;
 
@@ -1802,6 +1904,13 @@ void plugin_read_all (void)
 	}
 	uc_check_timeout ();
 
+	if ((cache_snapshot_file != NULL) && (cache_snapshot_interval > 0)
+			&& (cdtime () >= cache_snapshot_next))
+	{
+		uc_snapshot_write (cache_snapshot_file);
+		cache_snapshot_next = cdtime () + cache_snapshot_interval;
+	}
+
 	return;
 } /* void plugin_read_all */
 
@@ -2021,6 +2130,10 @@ void plugin_shutdown_all (void)
 
 	stop_write_threads ();
 
+	/* All values have been dispatched, so the cache won't change anymore. */
+	if (cache_snapshot_file != NULL)
+		uc_snapshot_write (cache_snapshot_file);
+
 	/* Write plugins which use the `user_data' pointer usually need the
 	 * same data available to the flush callback. If this is the case, set
 	 * the free_function to NULL when registering the flush callback and to
@@ -2322,7 +2435,6 @@ static _Bool check_drop_value (void) /* {{{ */
 int plugin_dispatch_values (value_list_t const *vl)
 {
 	int status;
-	static pthread_mutex_t statistics_lock = PTHREAD_MUTEX_INITIALIZER;
 
 	if (check_drop_value ()) {
 		if(record_statistics) {
@@ -2346,6 +2458,46 @@ int plugin_dispatch_values (value_list_t const *vl)
 	return (0);
 }
 
+int plugin_dispatch_values_list (value_list_t const *vl, size_t vl_num) /* {{{ */
+{
+	_Bool *drop;
+	uint64_t dropped = 0;
+	size_t failed;
+	size_t i;
+
+	if (vl_num == 0)
+		return (0);
+
+	drop = calloc (vl_num, sizeof (*drop));
+	if (drop == NULL)
+	{
+		ERROR ("plugin_dispatch_values_list: calloc failed.");
+		return ((int) vl_num);
+	}
+
+	for (i = 0; i < vl_num; i++)
+	{
+		drop[i] = check_drop_value ();
+		if (drop[i])
+			dropped++;
+	}
+
+	if ((dropped > 0) && record_statistics)
+	{
+		pthread_mutex_lock (&statistics_lock);
+		stats_values_dropped += dropped;
+		pthread_mutex_unlock (&statistics_lock);
+	}
+
+	failed = plugin_write_enqueue_list (vl, vl_num, drop);
+	sfree (drop);
+	if (failed > 0)
+		ERROR ("plugin_dispatch_values_list: Enqueuing %zu of %zu value "
+				"lists failed.", failed, vl_num);
+
+	return ((int) failed);
+} /* }}} int plugin_dispatch_values_list */
+
 __attribute__((sentinel))
 int plugin_dispatch_multivalue (value_list_t const *template, /* {{{ */
 		_Bool store_percentage, int store_type, ...)
@@ -352,6 +352,20 @@ void plugin_log_available_writers (void);
  */
 int plugin_dispatch_values (value_list_t const *vl);
 
+/*
+ * NAME
+ *  plugin_dispatch_values_list
+ *
+ * DESCRIPTION
+ *  Dispatches "vl_num" value lists at once. This is cheaper than calling
+ *  `plugin_dispatch_values' for each of them, because the write queue is
+ *  locked only once.
+ *
+ * RETURNS
+ *  The number of value lists it failed to dispatch (zero on success).
+ */
+int plugin_dispatch_values_list (value_list_t const *vl, size_t vl_num);
+
 /*
  * NAME
  *  plugin_dispatch_multivalue
@@ -32,6 +32,13 @@ kstat_ctl_t *kc = NULL;
 
 char hostname_g[] = "example.com";
 
+int plugin_register_config (const char *name,
+    int (*callback) (const char *key, const char *val),
+    const char **keys, int keys_num)
+{
+  return ENOTSUP;
+}
+
 int plugin_register_complex_config (const char *type, int (*callback) (oconfig_item_t *))
 {
   return ENOTSUP;
@@ -57,6 +64,11 @@ int plugin_dispatch_values (value_list_t const *vl)
   return ENOTSUP;
 }
 
+int plugin_dispatch_values_list (value_list_t const *vl, size_t vl_num)
+{
+  return ENOTSUP;
+}
+
 void plugin_log (int level, char const *format, ...)
 {
   char buffer[1024];
@@ -74,4 +86,21 @@ cdtime_t plugin_get_interval (void)
   return TIME_T_TO_CDTIME_T (10);
 }
 
+plugin_ctx_t plugin_get_ctx (void)
+{
+  plugin_ctx_t ctx = { 0 };
+  return (ctx);
+}
+
+plugin_ctx_t plugin_set_ctx (plugin_ctx_t ctx)
+{
+  return (plugin_get_ctx ());
+}
+
+int plugin_thread_create (pthread_t *thread, const pthread_attr_t *attr,
+    void *(*start_routine) (void *), void *arg)
+{
+  return (pthread_create (thread, attr, start_routine, arg));
+}
+
 /* vim: set sw=2 sts=2 et : */
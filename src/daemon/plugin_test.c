@@ -0,0 +1,209 @@
+/**
+ * collectd - src/daemon/plugin_test.c
+ * Copyright (C) 2026       agent
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   agent <agent at local>
+ */
+
+#include "collectd.h"
+#include "common.h" /* for STATIC_ARRAY_SIZE */
+#include "configfile.h"
+#include "plugin.h"
+#include "testing.h"
+
+/* defined in collectd.c */
+char hostname_g[DATA_MAX_NAME_LEN] = "example.com";
+cdtime_t interval_g;
+int pidfile_from_cli = 0;
+int timeout_g = 2;
+#if HAVE_LIBKSTAT
+kstat_ctl_t *kc;
+#endif /* HAVE_LIBKSTAT */
+
+#define WRITTEN_MAX 64
+
+static data_source_t dsrc_test[] = {
+  { "value", DS_TYPE_GAUGE, 0.0, NAN }
+};
+static data_set_t ds_test = { "test", STATIC_ARRAY_SIZE (dsrc_test), dsrc_test };
+
+static pthread_mutex_t written_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t written_cond = PTHREAD_COND_INITIALIZER;
+static gauge_t written[WRITTEN_MAX];
+static size_t written_num = 0;
+/* While set, the write callback blocks, so that the write queue fills up. */
+static _Bool writer_blocked = 0;
+
+static int test_init (void)
+{
+  return (0);
+}
+
+static int test_write (const data_set_t *ds, const value_list_t *vl,
+    user_data_t __attribute__((unused)) *ud)
+{
+  pthread_mutex_lock (&written_lock);
+  while (writer_blocked)
+    pthread_cond_wait (&written_cond, &written_lock);
+  if (written_num < WRITTEN_MAX)
+    written[written_num] = vl->values[0].gauge;
+  written_num++;
+  pthread_cond_broadcast (&written_cond);
+  pthread_mutex_unlock (&written_lock);
+  return (0);
+}
+
+/* Waits up to one second until "num" value lists have been written. Returns
+ * the number of value lists written. */
+static size_t wait_written (size_t num)
+{
+  struct timespec ts;
+  size_t ret;
+
+  CDTIME_T_TO_TIMESPEC (cdtime () + TIME_T_TO_CDTIME_T (1), &ts);
+
+  pthread_mutex_lock (&written_lock);
+  while (written_num < num)
+    if (pthread_cond_timedwait (&written_cond, &written_lock, &ts) != 0)
+      break;
+  ret = written_num;
+  pthread_mutex_unlock (&written_lock);
+
+  return (ret);
+}
+
+/* Fills "vl" with "num" value lists of the "test" type, using "values" as
+ * storage. */
+static void fill_list (value_list_t *vl, value_t *values, size_t num,
+    gauge_t first)
+{
+  size_t i;
+
+  for (i = 0; i < num; i++)
+  {
+    value_list_t tmp = VALUE_LIST_INIT;
+
+    values[i].gauge = first + (gauge_t) i;
+    tmp.values = values + i;
+    tmp.values_len = 1;
+    tmp.time = cdtime ();
+    tmp.interval = TIME_T_TO_CDTIME_T (10);
+    sstrncpy (tmp.host, "example.com", sizeof (tmp.host));
+    sstrncpy (tmp.plugin, "test", sizeof (tmp.plugin));
+    sstrncpy (tmp.type, "test", sizeof (tmp.type));
+    ssnprintf (tmp.type_instance, sizeof (tmp.type_instance), "%zu", i);
+
+    vl[i] = tmp;
+  }
+}
+
+DEF_TEST(dispatch_values_list)
+{
+  value_list_t vl[16];
+  value_t values[STATIC_ARRAY_SIZE (vl)];
+  size_t i;
+
+  EXPECT_EQ_INT (0, plugin_dispatch_values_list (vl, 0));
+
+  fill_list (vl, values, STATIC_ARRAY_SIZE (vl), 0.0);
+  EXPECT_EQ_INT (0, plugin_dispatch_values_list (vl,
+        STATIC_ARRAY_SIZE (vl)));
+
+  /* The value lists are copied: callers may reuse their buffers right
+   * away, like utils_db_query does with its batches. */
+  for (i = 0; i < STATIC_ARRAY_SIZE (values); i++)
+    values[i].gauge = NAN;
+
+  EXPECT_EQ_INT ((int) STATIC_ARRAY_SIZE (vl),
+      (int) wait_written (STATIC_ARRAY_SIZE (vl)));
+
+  /* With a single write thread, value lists are written in order. */
+  pthread_mutex_lock (&written_lock);
+  for (i = 0; i < STATIC_ARRAY_SIZE (vl); i++)
+    EXPECT_EQ_DOUBLE ((gauge_t) i, written[i]);
+  written_num = 0;
+  pthread_mutex_unlock (&written_lock);
+
+  return (0);
+}
+
+DEF_TEST(dispatch_values_list_drop)
+{
+  value_list_t vl[16];
+  value_t values[STATIC_ARRAY_SIZE (vl)];
+  size_t i;
+
+  pthread_mutex_lock (&written_lock);
+  writer_blocked = 1;
+  pthread_mutex_unlock (&written_lock);
+
+  /* The queue is below WriteQueueLimitLow, so nothing is dropped. */
+  fill_list (vl, values, STATIC_ARRAY_SIZE (vl), 0.0);
+  EXPECT_EQ_INT (0, plugin_dispatch_values_list (vl,
+        STATIC_ARRAY_SIZE (vl)));
+
+  /* Now at least 15 value lists are queued, which is above
+   * WriteQueueLimitHigh: the entire list is dropped. Dropping is not an
+   * error. */
+  fill_list (vl, values, STATIC_ARRAY_SIZE (vl), 100.0);
+  EXPECT_EQ_INT (0, plugin_dispatch_values_list (vl,
+        STATIC_ARRAY_SIZE (vl)));
+
+  pthread_mutex_lock (&written_lock);
+  writer_blocked = 0;
+  pthread_cond_broadcast (&written_cond);
+  pthread_mutex_unlock (&written_lock);
+
+  EXPECT_EQ_INT ((int) STATIC_ARRAY_SIZE (vl),
+      (int) wait_written (2 * STATIC_ARRAY_SIZE (vl)));
+
+  pthread_mutex_lock (&written_lock);
+  for (i = 0; i < STATIC_ARRAY_SIZE (vl); i++)
+    EXPECT_EQ_DOUBLE ((gauge_t) i, written[i]);
+  written_num = 0;
+  pthread_mutex_unlock (&written_lock);
+
+  return (0);
+}
+
+int main (void)
+{
+  plugin_init_ctx ();
+
+  global_option_set ("WriteThreads", "1");
+  global_option_set ("WriteQueueLimitHigh", "8");
+  global_option_set ("WriteQueueLimitLow", "8");
+
+  plugin_register_data_set (&ds_test);
+  plugin_register_init ("test", test_init);
+  plugin_register_write ("test", test_write, /* user_data = */ NULL);
+  plugin_init_all ();
+
+  RUN_TEST(dispatch_values_list);
+  RUN_TEST(dispatch_values_list_drop);
+
+  plugin_shutdown_all ();
+
+  END_TEST;
+}
+
+/* vim: set sw=2 sts=2 et : */
@@ -674,6 +674,39 @@ c_avl_iterator_t *c_avl_get_iterator (c_avl_tree_t *t)
 	return (iter);
 } /* c_avl_iterator_t *c_avl_get_iterator */
 
+c_avl_iterator_t *c_avl_get_iterator_after (c_avl_tree_t *t, const void *key)
+{
+	c_avl_iterator_t *iter;
+	c_avl_node_t *n;
+	int cmp;
+
+	iter = c_avl_get_iterator (t);
+	if ((iter == NULL) || (key == NULL))
+		return (iter);
+
+	/* The iterator points to the node returned last, so position it on the
+	 * largest key less than or equal to "key". If there is none, the
+	 * iterator stays at the beginning. */
+	n = t->root;
+	while (n != NULL)
+	{
+		cmp = t->compare (key, n->key);
+		if (cmp < 0)
+		{
+			n = n->left;
+		}
+		else
+		{
+			iter->node = n;
+			if (cmp == 0)
+				break;
+			n = n->right;
+		}
+	}
+
+	return (iter);
+} /* c_avl_iterator_t *c_avl_get_iterator_after */
+
 int c_avl_iterator_next (c_avl_iterator_t *iter, void **key, void **value)
 {
 	c_avl_node_t *n;
@@ -142,9 +142,70 @@ DEF_TEST(success)
   return (0);
 }
 
+DEF_TEST(iterator_after)
+{
+  char *keys[] = { "b", "d", "f", "h", "j", "l", "n" };
+  struct {
+    char *after;
+    char *first;
+  } cases[] = {
+    {"a", "b"},
+    {"b", "d"},
+    {"c", "d"},
+    {"h", "j"},
+    {"i", "j"},
+    {"m", "n"},
+    {"n", NULL},
+    {"z", NULL},
+  };
+
+  c_avl_tree_t *t;
+  c_avl_iterator_t *iter;
+  char *key;
+  char *value;
+  size_t i;
+  int num;
+
+  CHECK_NOT_NULL (t = c_avl_create (compare_callback));
+  for (i = 0; i < STATIC_ARRAY_SIZE (keys); i++)
+    CHECK_ZERO (c_avl_insert (t, keys[i], keys[i]));
+
+  for (i = 0; i < STATIC_ARRAY_SIZE (cases); i++)
+  {
+    CHECK_NOT_NULL (iter = c_avl_get_iterator_after (t, cases[i].after));
+    if (cases[i].first == NULL)
+    {
+      EXPECT_EQ_INT (-1, c_avl_iterator_next (iter, (void *) &key,
+            (void *) &value));
+    }
+    else
+    {
+      CHECK_ZERO (c_avl_iterator_next (iter, (void *) &key, (void *) &value));
+      EXPECT_EQ_STR (cases[i].first, key);
+    }
+    c_avl_iterator_destroy (iter);
+  }
+
+  /* Iterating from the middle visits all remaining keys in order. */
+  CHECK_NOT_NULL (iter = c_avl_get_iterator_after (t, "e"));
+  num = 0;
+  while (c_avl_iterator_next (iter, (void *) &key, (void *) &value) == 0)
+  {
+    EXPECT_EQ_STR (keys[2 + num], key);
+    num++;
+  }
+  EXPECT_EQ_INT (5, num);
+  c_avl_iterator_destroy (iter);
+
+  c_avl_destroy (t);
+
+  return (0);
+}
+
 int main (void)
 {
   RUN_TEST(success);
+  RUN_TEST(iterator_after);
 
   END_TEST;
 }
@@ -33,8 +33,62 @@
 
 #include <assert.h>
 #include <pthread.h>
+#include <sys/mman.h>
 
-typedef struct cache_entry_s
+/* Maximum number of timed out entries handled while holding the lock. */
+#ifndef UC_TIMEOUT_CHUNK_SIZE
+# define UC_TIMEOUT_CHUNK_SIZE 1024
+#endif
+
+/* Number of history buffers allocated at once. */
+#ifndef UC_HISTORY_SLAB_SIZE
+# define UC_HISTORY_SLAB_SIZE 256
+#endif
+
+/* Bump the version whenever the layout of the snapshot file changes. Files
+ * with a different version are ignored. */
+#define UC_SNAPSHOT_MAGIC "CDUCSNAP"
+#define UC_SNAPSHOT_VERSION 2
+#define UC_SNAPSHOT_BYTE_ORDER 0x01020304
+
+/* Snapshots are only ever read by the host that wrote them, so everything is
+ * stored in host byte order. The byte order field is used to detect files
+ * copied from elsewhere. */
+struct uc_snapshot_header_s
+{
+	char     magic[8];
+	uint32_t version;
+	uint32_t byte_order;
+	uint64_t entries_num;
+	/* Size of the entire file, including this header. */
+	uint64_t size;
+};
+typedef struct uc_snapshot_header_s uc_snapshot_header_t;
+
+/* Each entry is followed by the raw values, the gauge values, the history
+ * (times first, then values, see below), the name (including the terminating
+ * null byte) and the serialized meta data. Entries are padded to a multiple
+ * of eight bytes. */
+struct uc_snapshot_entry_s
+{
+	uint32_t size;
+	uint32_t name_len;
+	uint32_t values_num;
+	int32_t  state;
+	int32_t  hits;
+	uint32_t history_length;
+	uint32_t history_index;
+	uint32_t meta_size;
+	uint64_t last_time;
+	uint64_t interval;
+};
+typedef struct uc_snapshot_entry_s uc_snapshot_entry_t;
+
+struct uc_expiry_list_s;
+typedef struct uc_expiry_list_s uc_expiry_list_t;
+
+typedef struct cache_entry_s cache_entry_t;
+struct cache_entry_s
 {
 	char name[6 * DATA_MAX_NAME_LEN];
 	size_t     values_num;
@@ -60,16 +114,58 @@ typedef struct cache_entry_s
 	 * +-----+-----+-----+-----+-----+-----+-----+-----+-----+----
 	 * !      t = 0      !      t = 1      !      t = 2      ! ...
 	 * +-----------------+-----------------+-----------------+----
+	 *
+	 * The time of each step is kept in "history_time", which is allocated
+	 * together with "history": "history" points right behind the last time
+	 * stamp. Steps which haven't been written yet have a time of zero.
 	 */
-	gauge_t *history;
-	size_t   history_index; /* points to the next position to write to. */
-	size_t   history_length;
+	cdtime_t *history_time;
+	gauge_t  *history;
+	size_t    history_index; /* points to the next position to write to. */
+	size_t    history_length;
 
 	meta_data_t *meta;
-} cache_entry_t;
+
+	/* Linked list of all entries with the same interval, see below. */
+	uc_expiry_list_t *expiry_list;
+	cache_entry_t *expiry_prev;
+	cache_entry_t *expiry_next;
+};
+
+/* All entries with the same interval are kept in a doubly linked list which
+ * is ordered by "last_update", oldest first. Updated entries are moved to
+ * the tail, so the entries which have timed out are always at the head of
+ * the list and uc_check_timeout() doesn't need to look at any other entry.
+ * There are usually only very few distinct intervals. */
+struct uc_expiry_list_s
+{
+	cdtime_t interval;
+	cache_entry_t *head;
+	cache_entry_t *tail;
+	uc_expiry_list_t *next;
+};
+
+/* History buffers are small and all of them have one of very few sizes, so
+ * they are carved out of larger slabs instead of being allocated one by one.
+ * Freed buffers are kept on a free list per size and reused. */
+struct uc_history_class_s;
+typedef struct uc_history_class_s uc_history_class_t;
+struct uc_history_class_s
+{
+	size_t size;
+	void *free_list;
+	uc_history_class_t *next;
+};
+
+/* Number of entries uc_iterate_names() looks at before releasing the cache
+ * lock for a moment. */
+#define UC_ITERATE_CHUNK 1024
 
 static c_avl_tree_t   *cache_tree = NULL;
 static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static uc_expiry_list_t *expiry_lists = NULL;
+static uc_history_class_t *history_classes = NULL;
+static size_t          history_length_default = 0;
 
 static int cache_compare (const cache_entry_t *a, const cache_entry_t *b)
 {
@@ -103,6 +199,7 @@ static cache_entry_t *cache_alloc (size_t values_num)
     return (NULL);
   }
 
+  ce->history_time = NULL;
   ce->history = NULL;
   ce->history_length = 0;
   ce->meta = NULL;
@@ -110,6 +207,153 @@ static cache_entry_t *cache_alloc (size_t values_num)
   return (ce);
 } /* cache_entry_t *cache_alloc */
 
+/* Returns the size of a history buffer holding "length" steps of
+ * "values_num" values each, including the time stamps. */
+static size_t uc_history_size (size_t values_num, size_t length)
+{
+  return (length * (sizeof (cdtime_t) + values_num * sizeof (gauge_t)));
+} /* size_t uc_history_size */
+
+/* `cache_lock' must be held. */
+static void *uc_history_alloc (size_t size)
+{
+  uc_history_class_t *hc;
+  void *ptr;
+
+  /* Free buffers are linked through their first bytes. */
+  if (size < sizeof (void *))
+    size = sizeof (void *);
+
+  for (hc = history_classes; hc != NULL; hc = hc->next)
+    if (hc->size == size)
+      break;
+
+  if (hc == NULL)
+  {
+    hc = malloc (sizeof (*hc));
+    if (hc == NULL)
+      return (NULL);
+    memset (hc, 0, sizeof (*hc));
+    hc->size = size;
+    hc->next = history_classes;
+    history_classes = hc;
+  }
+
+  if (hc->free_list == NULL)
+  {
+    char *slab;
+    size_t i;
+
+    /* Slabs are never returned to the system. */
+    slab = calloc (UC_HISTORY_SLAB_SIZE, size);
+    if (slab == NULL)
+      return (NULL);
+
+    for (i = UC_HISTORY_SLAB_SIZE; i > 0; i--)
+    {
+      void *obj = slab + ((i - 1) * size);
+      *((void **) obj) = hc->free_list;
+      hc->free_list = obj;
+    }
+  }
+
+  ptr = hc->free_list;
+  hc->free_list = *((void **) ptr);
+  return (ptr);
+} /* void *uc_history_alloc */
+
+/* `cache_lock' must be held. */
+static void uc_history_free (cache_entry_t *ce)
+{
+  uc_history_class_t *hc;
+  size_t size;
+
+  if (ce->history_time == NULL)
+    return;
+
+  size = uc_history_size (ce->values_num, ce->history_length);
+  if (size < sizeof (void *))
+    size = sizeof (void *);
+
+  for (hc = history_classes; hc != NULL; hc = hc->next)
+    if (hc->size == size)
+      break;
+  assert (hc != NULL);
+
+  *((void **) ce->history_time) = hc->free_list;
+  hc->free_list = ce->history_time;
+
+  ce->history_time = NULL;
+  ce->history = NULL;
+  ce->history_index = 0;
+  ce->history_length = 0;
+} /* void uc_history_free */
+
+/* Replaces the history of "ce" with an empty buffer for "length" steps. The
+ * samples already recorded are retained, as far as they fit. `cache_lock'
+ * must be held. */
+static int uc_history_resize (cache_entry_t *ce, size_t length)
+{
+  cdtime_t *times;
+  gauge_t *history;
+  size_t copy_num;
+  size_t i;
+
+  times = uc_history_alloc (uc_history_size (ce->values_num, length));
+  if (times == NULL)
+    return (-ENOMEM);
+  history = (gauge_t *) (times + length);
+
+  for (i = 0; i < length; i++)
+    times[i] = 0;
+  for (i = 0; i < (length * ce->values_num); i++)
+    history[i] = NAN;
+
+  /* Copy the most recent steps, oldest first, so that the next step is
+   * written right behind them. */
+  copy_num = (ce->history_length < length) ? ce->history_length : length;
+  for (i = 0; i < copy_num; i++)
+  {
+    size_t src = (ce->history_index + ce->history_length - copy_num + i)
+      % ce->history_length;
+
+    times[i] = ce->history_time[src];
+    memcpy (history + (i * ce->values_num),
+        ce->history + (src * ce->values_num),
+        ce->values_num * sizeof (*history));
+  }
+
+  uc_history_free (ce);
+
+  ce->history_time = times;
+  ce->history = history;
+  ce->history_length = length;
+  ce->history_index = copy_num % length;
+
+  return (0);
+} /* int uc_history_resize */
+
+/* Appends the current rates to the history, if one exists. `cache_lock' must
+ * be held. */
+static void uc_history_record (cache_entry_t *ce, cdtime_t t)
+{
+  size_t i;
+
+  if (ce->history == NULL)
+    return;
+
+  assert (ce->history_index < ce->history_length);
+  for (i = 0; i < ce->values_num; i++)
+  {
+    size_t hist_idx = (ce->values_num * ce->history_index) + i;
+    ce->history[hist_idx] = ce->values_gauge[i];
+  }
+  ce->history_time[ce->history_index] = t;
+
+  assert (ce->history_length > 0);
+  ce->history_index = (ce->history_index + 1) % ce->history_length;
+} /* void uc_history_record */
+
 static void cache_free (cache_entry_t *ce)
 {
   if (ce == NULL)
@@ -117,7 +361,7 @@ static void cache_free (cache_entry_t *ce)
 
   sfree (ce->values_gauge);
   sfree (ce->values_raw);
-  sfree (ce->history);
+  uc_history_free (ce);
   if (ce->meta != NULL)
   {
     meta_data_destroy (ce->meta);
@@ -126,6 +370,66 @@ static void cache_free (cache_entry_t *ce)
   sfree (ce);
 } /* void cache_free */
 
+/* `cache_lock' must be held. */
+static void uc_expiry_unlink (cache_entry_t *ce)
+{
+  uc_expiry_list_t *el = ce->expiry_list;
+
+  if (el == NULL)
+    return;
+
+  if (ce->expiry_prev != NULL)
+    ce->expiry_prev->expiry_next = ce->expiry_next;
+  else
+    el->head = ce->expiry_next;
+
+  if (ce->expiry_next != NULL)
+    ce->expiry_next->expiry_prev = ce->expiry_prev;
+  else
+    el->tail = ce->expiry_prev;
+
+  ce->expiry_list = NULL;
+  ce->expiry_prev = NULL;
+  ce->expiry_next = NULL;
+} /* void uc_expiry_unlink */
+
+/* Appends the entry to the expiry list matching its interval. `cache_lock'
+ * must be held and the entry must not be linked. */
+static void uc_expiry_link (cache_entry_t *ce)
+{
+  uc_expiry_list_t *el;
+
+  assert (ce->expiry_list == NULL);
+
+  for (el = expiry_lists; el != NULL; el = el->next)
+    if (el->interval == ce->interval)
+      break;
+
+  if (el == NULL)
+  {
+    el = malloc (sizeof (*el));
+    if (el == NULL)
+    {
+      ERROR ("uc_expiry_link: malloc failed. "
+	  "The value \"%s\" will not time out.", ce->name);
+      return;
+    }
+    memset (el, 0, sizeof (*el));
+    el->interval = ce->interval;
+    el->next = expiry_lists;
+    expiry_lists = el;
+  }
+
+  ce->expiry_list = el;
+  ce->expiry_prev = el->tail;
+  ce->expiry_next = NULL;
+  if (el->tail != NULL)
+    el->tail->expiry_next = ce;
+  else
+    el->head = ce;
+  el->tail = ce;
+} /* void uc_expiry_link */
+
 static void uc_check_range (const data_set_t *ds, cache_entry_t *ce)
 {
   size_t i;
@@ -212,13 +516,24 @@ static int uc_insert (const data_set_t *ds, const value_list_t *vl,
   ce->interval = vl->interval;
   ce->state = STATE_OKAY;
 
+  if (history_length_default > 0)
+  {
+    if (uc_history_resize (ce, history_length_default) == 0)
+      uc_history_record (ce, vl->time);
+    else
+      ERROR ("uc_insert: Allocating the history of %s failed.", key);
+  }
+
   if (c_avl_insert (cache_tree, key_copy, ce) != 0)
   {
     sfree (key_copy);
+    cache_free (ce);
     ERROR ("uc_insert: c_avl_insert failed.");
     return (-1);
   }
 
+  uc_expiry_link (ce);
+
   DEBUG ("uc_insert: Added %s to the cache.", key);
   return (0);
 } /* int uc_insert */
@@ -232,140 +547,124 @@ int uc_init (void)
   return (0);
 } /* int uc_init */
 
-int uc_check_timeout (void)
+int uc_set_history_length (size_t history_length)
 {
-  cdtime_t now;
-  cache_entry_t *ce;
-
-  char **keys = NULL;
-  cdtime_t *keys_time = NULL;
-  cdtime_t *keys_interval = NULL;
-  int keys_len = 0;
+  pthread_mutex_lock (&cache_lock);
+  history_length_default = history_length;
+  pthread_mutex_unlock (&cache_lock);
 
-  char *key;
-  c_avl_iterator_t *iter;
+  return (0);
+} /* int uc_set_history_length */
 
-  int status;
-  int i;
-  
-  pthread_mutex_lock (&cache_lock);
+int uc_check_timeout (void)
+{
+  struct
+  {
+    cache_entry_t *ce;
+    cdtime_t time;
+    cdtime_t interval;
+  } expired[UC_TIMEOUT_CHUNK_SIZE];
+  size_t expired_num;
+  cdtime_t now;
+  size_t i;
 
   now = cdtime ();
 
-  /* Build a list of entries to be flushed */
-  iter = c_avl_get_iterator (cache_tree);
-  while (c_avl_iterator_next (iter, (void *) &key, (void *) &ce) == 0)
+  /* Entries are only ever removed from the cache by this function, which is
+   * only called from one thread. Pointers to the entries therefore stay
+   * valid while the lock is released. */
+  do
   {
-    char **tmp;
-    cdtime_t *tmp_time;
+    uc_expiry_list_t *el;
 
-    /* If the entry is fresh enough, continue. */
-    if ((now - ce->last_update) < (ce->interval * timeout_g))
-      continue;
+    expired_num = 0;
 
-    /* If entry has not been updated, add to `keys' array */
-    tmp = (char **) realloc ((void *) keys,
-	(keys_len + 1) * sizeof (char *));
-    if (tmp == NULL)
+    /* Take timed out entries from the head of each expiry list. They are
+     * unlinked, but stay in the cache for now. */
+    pthread_mutex_lock (&cache_lock);
+    for (el = expiry_lists;
+	(el != NULL) && (expired_num < UC_TIMEOUT_CHUNK_SIZE);
+	el = el->next)
     {
-      ERROR ("uc_check_timeout: realloc failed.");
-      continue;
-    }
-    keys = tmp;
+      while ((el->head != NULL) && (expired_num < UC_TIMEOUT_CHUNK_SIZE))
+      {
+	cache_entry_t *ce = el->head;
 
-    tmp_time = realloc (keys_time, (keys_len + 1) * sizeof (*keys_time));
-    if (tmp_time == NULL)
-    {
-      ERROR ("uc_check_timeout: realloc failed.");
-      continue;
-    }
-    keys_time = tmp_time;
+	/* If the oldest entry is fresh enough, so are all others. Entries
+	 * updated after "now" was read may have been linked in while the lock
+	 * was released, so don't subtract: cdtime_t is unsigned. */
+	if ((ce->last_update + (ce->interval * timeout_g)) > now)
+	  break;
 
-    tmp_time = realloc (keys_interval, (keys_len + 1) * sizeof (*keys_interval));
-    if (tmp_time == NULL)
-    {
-      ERROR ("uc_check_timeout: realloc failed.");
-      continue;
-    }
-    keys_interval = tmp_time;
+	uc_expiry_unlink (ce);
 
-    keys[keys_len] = strdup (key);
-    if (keys[keys_len] == NULL)
-    {
-      ERROR ("uc_check_timeout: strdup failed.");
-      continue;
+	expired[expired_num].ce = ce;
+	expired[expired_num].time = ce->last_time;
+	expired[expired_num].interval = ce->interval;
+	expired_num++;
+      }
     }
-    keys_time[keys_len] = ce->last_time;
-    keys_interval[keys_len] = ce->interval;
-
-    keys_len++;
-  } /* while (c_avl_iterator_next) */
-
-  c_avl_iterator_destroy (iter);
-  pthread_mutex_unlock (&cache_lock);
-
-  if (keys_len == 0)
-  {
-    /* realloc() may have been called for these. */
-    sfree (keys);
-    sfree (keys_time);
-    sfree (keys_interval);
-    return (0);
-  }
-
-  /* Call the "missing" callback for each value. Do this before removing the
-   * value from the cache, so that callbacks can still access the data stored,
-   * including plugin specific meta data, rates, history, …. This must be done
-   * without holding the lock, otherwise we will run into a deadlock if a
-   * plugin calls the cache interface. */
-  for (i = 0; i < keys_len; i++)
-  {
-    value_list_t vl = VALUE_LIST_INIT;
+    pthread_mutex_unlock (&cache_lock);
 
-    vl.values = NULL;
-    vl.values_len = 0;
-    vl.meta = NULL;
+    if (expired_num == 0)
+      break;
 
-    status = parse_identifier_vl (keys[i], &vl);
-    if (status != 0)
+    /* Call the "missing" callback for each value. Do this before removing
+     * the value from the cache, so that callbacks can still access the data
+     * stored, including plugin specific meta data, rates, history, ….
+     * This must be done without holding the lock, otherwise we will run
+     * into a deadlock if a plugin calls the cache interface. */
+    for (i = 0; i < expired_num; i++)
     {
-      ERROR ("uc_check_timeout: parse_identifier_vl (\"%s\") failed.", keys[i]);
-      continue;
-    }
+      value_list_t vl = VALUE_LIST_INIT;
+      int status;
 
-    vl.time = keys_time[i];
-    vl.interval = keys_interval[i];
+      vl.values = NULL;
+      vl.values_len = 0;
+      vl.meta = NULL;
 
-    plugin_dispatch_missing (&vl);
-  } /* for (i = 0; i < keys_len; i++) */
+      status = parse_identifier_vl (expired[i].ce->name, &vl);
+      if (status != 0)
+      {
+	ERROR ("uc_check_timeout: parse_identifier_vl (\"%s\") failed.",
+	    expired[i].ce->name);
+	continue;
+      }
 
-  /* Now actually remove all the values from the cache. We don't re-evaluate
-   * the timestamp again, so in theory it is possible we remove a value after
-   * it is updated here. */
-  pthread_mutex_lock (&cache_lock);
-  for (i = 0; i < keys_len; i++)
-  {
-    key = NULL;
-    ce = NULL;
+      vl.time = expired[i].time;
+      vl.interval = expired[i].interval;
 
-    status = c_avl_remove (cache_tree, keys[i],
-	(void *) &key, (void *) &ce);
-    if (status != 0)
+      plugin_dispatch_missing (&vl);
+    } /* for (i = 0; i < expired_num; i++) */
+
+    /* Now actually remove the values from the cache. Entries which have
+     * been updated in the meantime have been linked into an expiry list
+     * again and are kept. */
+    pthread_mutex_lock (&cache_lock);
+    for (i = 0; i < expired_num; i++)
     {
-      ERROR ("uc_check_timeout: c_avl_remove (\"%s\") failed.", keys[i]);
-      sfree (keys[i]);
-      continue;
-    }
+      cache_entry_t *ce = expired[i].ce;
+      char *key = NULL;
+      cache_entry_t *removed = NULL;
+      int status;
 
-    sfree (keys[i]);
-    sfree (key);
-    cache_free (ce);
-  } /* for (i = 0; i < keys_len; i++) */
-  pthread_mutex_unlock (&cache_lock);
+      if (ce->expiry_list != NULL)
+	continue;
 
-  sfree (keys);
-  sfree (keys_time);
-  sfree (keys_interval);
+      status = c_avl_remove (cache_tree, ce->name,
+	  (void *) &key, (void *) &removed);
+      if (status != 0)
+      {
+	ERROR ("uc_check_timeout: c_avl_remove (\"%s\") failed.", ce->name);
+	continue;
+      }
+      assert (removed == ce);
+
+      sfree (key);
+      cache_free (removed);
+    } /* for (i = 0; i < expired_num; i++) */
+    pthread_mutex_unlock (&cache_lock);
+  } while (expired_num == UC_TIMEOUT_CHUNK_SIZE);
 
   return (0);
 } /* int uc_check_timeout */
@@ -453,18 +752,7 @@ int uc_update (const data_set_t *ds, const value_list_t *vl)
   } /* for (i) */
 
   /* Update the history if it exists. */
-  if (ce->history != NULL)
-  {
-    assert (ce->history_index < ce->history_length);
-    for (i = 0; i < ce->values_num; i++)
-    {
-      size_t hist_idx = (ce->values_num * ce->history_index) + i;
-      ce->history[hist_idx] = ce->values_gauge[i];
-    }
-
-    assert (ce->history_length > 0);
-    ce->history_index = (ce->history_index + 1) % ce->history_length;
-  }
+  uc_history_record (ce, vl->time);
 
   /* Prune invalid gauge data */
   uc_check_range (ds, ce);
@@ -473,6 +761,10 @@ int uc_update (const data_set_t *ds, const value_list_t *vl)
   ce->last_update = cdtime ();
   ce->interval = vl->interval;
 
+  /* Move the entry to the end of its expiry list. */
+  uc_expiry_unlink (ce);
+  uc_expiry_link (ce);
+
   pthread_mutex_unlock (&cache_lock);
 
   return (0);
@@ -559,6 +851,44 @@ gauge_t *uc_get_rate (const data_set_t *ds, const value_list_t *vl)
   return (ret);
 } /* gauge_t *uc_get_rate */
 
+int uc_get_rate_buffer (const data_set_t *ds, const value_list_t *vl,
+    gauge_t *ret_values, size_t ret_values_num)
+{
+  char name[6 * DATA_MAX_NAME_LEN];
+  cache_entry_t *ce = NULL;
+  int status = 0;
+
+  if (ret_values_num != ds->ds_num)
+  {
+    ERROR ("utils_cache: uc_get_rate_buffer: ds[%s] has %zu values, "
+	"but the buffer has room for %zu.",
+	ds->type, ds->ds_num, ret_values_num);
+    return (-EINVAL);
+  }
+
+  if (FORMAT_VL (name, sizeof (name), vl) != 0)
+  {
+    ERROR ("utils_cache: uc_get_rate_buffer: FORMAT_VL failed.");
+    return (-1);
+  }
+
+  pthread_mutex_lock (&cache_lock);
+
+  if (c_avl_get (cache_tree, name, (void *) &ce) != 0)
+    status = -ENOENT;
+  else if (ce->state == STATE_MISSING)
+    status = -1;
+  else if (ce->values_num != ret_values_num)
+    status = -EINVAL;
+  else
+    memcpy (ret_values, ce->values_gauge,
+	ret_values_num * sizeof (*ret_values));
+
+  pthread_mutex_unlock (&cache_lock);
+
+  return (status);
+} /* int uc_get_rate_buffer */
+
 size_t uc_get_size (void) {
   size_t size_arrays = 0;
 
@@ -658,6 +988,71 @@ int uc_get_names (char ***ret_names, cdtime_t **ret_times, size_t *ret_number)
   return (0);
 } /* int uc_get_names */
 
+int uc_iterate_names (const char *after,
+    int (*callback) (const char *name, cdtime_t time, void *user_data),
+    void *user_data)
+{
+  char last[6 * DATA_MAX_NAME_LEN] = "";
+  _Bool have_last = 0;
+
+  if (callback == NULL)
+    return (-1);
+
+  if (after != NULL)
+  {
+    sstrncpy (last, after, sizeof (last));
+    have_last = 1;
+  }
+
+  while (42)
+  {
+    c_avl_iterator_t *iter;
+    char *key;
+    cache_entry_t *ce;
+    size_t visited = 0;
+    int status = 0;
+
+    pthread_mutex_lock (&cache_lock);
+
+    iter = c_avl_get_iterator_after (cache_tree, have_last ? last : NULL);
+    if (iter == NULL)
+    {
+      pthread_mutex_unlock (&cache_lock);
+      ERROR ("uc_iterate_names: c_avl_get_iterator_after failed.");
+      return (-1);
+    }
+
+    while (c_avl_iterator_next (iter, (void *) &key, (void *) &ce) == 0)
+    {
+      visited++;
+
+      /* remove missing values when list values */
+      if (ce->state != STATE_MISSING)
+      {
+        status = callback (key, ce->last_time, user_data);
+        if (status != 0)
+          break;
+      }
+
+      /* Continue after this entry once the lock has been reacquired. */
+      if (visited >= UC_ITERATE_CHUNK)
+      {
+        sstrncpy (last, key, sizeof (last));
+        have_last = 1;
+        break;
+      }
+    } /* while (c_avl_iterator_next) */
+
+    c_avl_iterator_destroy (iter);
+    pthread_mutex_unlock (&cache_lock);
+
+    if (status != 0)
+      return (status);
+    if (visited < UC_ITERATE_CHUNK)
+      return (0);
+  }
+} /* int uc_iterate_names */
+
 int uc_get_state (const data_set_t *ds, const value_list_t *vl)
 {
   char name[6 * DATA_MAX_NAME_LEN];
@@ -735,23 +1130,12 @@ int uc_get_history_by_name (const char *name,
    * size. */
   if (ce->history_length < num_steps)
   {
-    gauge_t *tmp;
-
-    tmp = realloc (ce->history, sizeof (*ce->history)
-	* num_steps * ce->values_num);
-    if (tmp == NULL)
+    status = uc_history_resize (ce, num_steps);
+    if (status != 0)
     {
       pthread_mutex_unlock (&cache_lock);
-      return (-ENOMEM);
+      return (status);
     }
-
-    for (i = ce->history_length * ce->values_num;
-	i < (num_steps * ce->values_num);
-	i++)
-      tmp[i] = NAN;
-
-    ce->history = tmp;
-    ce->history_length = num_steps;
   } /* if (ce->history_length < num_steps) */
 
   /* Copy the values to the output buffer. */
@@ -777,6 +1161,82 @@ int uc_get_history_by_name (const char *name,
   return (0);
 } /* int uc_get_history_by_name */
 
+int uc_get_history_range_by_name (const char *name, size_t num_steps,
+    cdtime_t **ret_times, gauge_t **ret_history,
+    size_t *ret_steps_num, size_t *ret_values_num)
+{
+  cache_entry_t *ce = NULL;
+  cdtime_t *times = NULL;
+  gauge_t *history = NULL;
+  size_t steps_num = 0;
+  size_t values_num;
+  size_t i;
+  int status;
+
+  pthread_mutex_lock (&cache_lock);
+
+  status = c_avl_get (cache_tree, name, (void *) &ce);
+  if (status != 0)
+  {
+    pthread_mutex_unlock (&cache_lock);
+    return (-ENOENT);
+  }
+
+  /* Unlike uc_get_history_by_name(), don't resize the history: it would be
+   * empty after resizing anyway. */
+  if ((num_steps == 0) || (num_steps > ce->history_length))
+    num_steps = ce->history_length;
+  values_num = ce->values_num;
+
+  if ((num_steps > 0) && (ret_times != NULL))
+  {
+    times = calloc (num_steps, sizeof (*times));
+    history = calloc (num_steps * values_num, sizeof (*history));
+    if ((times == NULL) || (history == NULL))
+    {
+      pthread_mutex_unlock (&cache_lock);
+      sfree (times);
+      sfree (history);
+      return (-ENOMEM);
+    }
+  }
+
+  for (i = 0; i < num_steps; i++)
+  {
+    size_t src_index;
+
+    if (i < ce->history_index)
+      src_index = ce->history_index - (i + 1);
+    else
+      src_index = ce->history_length + ce->history_index - (i + 1);
+
+    /* Steps which have never been written are the oldest ones. */
+    if (ce->history_time[src_index] == 0)
+      break;
+
+    if (times != NULL)
+    {
+      times[i] = ce->history_time[src_index];
+      memcpy (history + (i * values_num),
+	  ce->history + (src_index * values_num),
+	  sizeof (*history) * values_num);
+    }
+    steps_num++;
+  }
+
+  pthread_mutex_unlock (&cache_lock);
+
+  if (ret_times != NULL)
+  {
+    *ret_times = times;
+    *ret_history = history;
+  }
+  *ret_steps_num = steps_num;
+  *ret_values_num = values_num;
+
+  return (0);
+} /* int uc_get_history_range_by_name */
+
 int uc_get_history (const data_set_t *ds, const value_list_t *vl,
     gauge_t *ret_history, size_t num_steps, size_t num_ds)
 {
@@ -868,6 +1328,656 @@ int uc_inc_hits (const data_set_t *ds, const value_list_t *vl, int step)
   return (ret);
 } /* int uc_inc_hits */
 
+/*
+ * Snapshot interface
+ */
+#define UC_SNAPSHOT_ALIGN(s) (((s) + 7) & ~((size_t) 7))
+
+/* Serializes the meta data as a sequence of type byte, key and value. Returns
+ * the number of bytes required. Nothing is written if "buffer" is NULL or too
+ * small. */
+static size_t uc_snapshot_meta_write (meta_data_t *md, /* {{{ */
+    char *buffer, size_t buffer_size)
+{
+  char **toc = NULL;
+  int toc_num;
+  size_t size = 0;
+  int i;
+
+  if (md == NULL)
+    return (0);
+
+  toc_num = meta_data_toc (md, &toc);
+  if (toc_num <= 0)
+    return (0);
+
+  for (i = 0; i < toc_num; i++)
+  {
+    char tmp[sizeof (uint64_t)];
+    char *str = NULL;
+    void const *value = tmp;
+    size_t value_size = 0;
+    size_t key_size = strlen (toc[i]) + 1;
+    int type;
+
+    type = meta_data_type (md, toc[i]);
+    switch (type)
+    {
+      case MD_TYPE_STRING:
+        if (meta_data_get_string (md, toc[i], &str) == 0)
+        {
+          value = str;
+          value_size = strlen (str) + 1;
+        }
+        break;
+
+      case MD_TYPE_SIGNED_INT:
+        {
+          int64_t v = 0;
+          meta_data_get_signed_int (md, toc[i], &v);
+          memcpy (tmp, &v, sizeof (v));
+          value_size = sizeof (v);
+        }
+        break;
+
+      case MD_TYPE_UNSIGNED_INT:
+        {
+          uint64_t v = 0;
+          meta_data_get_unsigned_int (md, toc[i], &v);
+          memcpy (tmp, &v, sizeof (v));
+          value_size = sizeof (v);
+        }
+        break;
+
+      case MD_TYPE_DOUBLE:
+        {
+          double v = NAN;
+          meta_data_get_double (md, toc[i], &v);
+          memcpy (tmp, &v, sizeof (v));
+          value_size = sizeof (v);
+        }
+        break;
+
+      case MD_TYPE_BOOLEAN:
+        {
+          _Bool v = 0;
+          meta_data_get_boolean (md, toc[i], &v);
+          tmp[0] = v ? 1 : 0;
+          value_size = 1;
+        }
+        break;
+    }
+
+    if (value_size > 0)
+    {
+      if ((buffer != NULL) && ((size + 1 + key_size + value_size) <= buffer_size))
+      {
+        buffer[size] = (char) type;
+        memcpy (buffer + size + 1, toc[i], key_size);
+        memcpy (buffer + size + 1 + key_size, value, value_size);
+      }
+      size += 1 + key_size + value_size;
+    }
+
+    sfree (str);
+    sfree (toc[i]);
+  }
+  sfree (toc);
+
+  return (size);
+} /* }}} size_t uc_snapshot_meta_write */
+
+static meta_data_t *uc_snapshot_meta_read (char const *buffer, /* {{{ */
+    size_t buffer_size)
+{
+  meta_data_t *md;
+  size_t pos = 0;
+
+  md = meta_data_create ();
+  if (md == NULL)
+    return (NULL);
+
+  while (pos < buffer_size)
+  {
+    int type = (int) buffer[pos];
+    char const *key = buffer + pos + 1;
+    char const *key_end;
+    char const *value;
+    size_t avail;
+    int status = 0;
+
+    pos++;
+    key_end = memchr (key, 0, buffer_size - pos);
+    if (key_end == NULL)
+      break;
+    pos += (size_t) (key_end - key) + 1;
+    value = buffer + pos;
+    avail = buffer_size - pos;
+
+    if (type == MD_TYPE_STRING)
+    {
+      char const *value_end = memchr (value, 0, avail);
+      if (value_end == NULL)
+        break;
+      status = meta_data_add_string (md, key, value);
+      pos += (size_t) (value_end - value) + 1;
+    }
+    else if (type == MD_TYPE_BOOLEAN)
+    {
+      if (avail < 1)
+        break;
+      status = meta_data_add_boolean (md, key, value[0] ? 1 : 0);
+      pos += 1;
+    }
+    else
+    {
+      uint64_t v;
+
+      if (avail < sizeof (v))
+        break;
+      memcpy (&v, value, sizeof (v));
+
+      if (type == MD_TYPE_SIGNED_INT)
+        status = meta_data_add_signed_int (md, key, (int64_t) v);
+      else if (type == MD_TYPE_UNSIGNED_INT)
+        status = meta_data_add_unsigned_int (md, key, v);
+      else if (type == MD_TYPE_DOUBLE)
+      {
+        double d;
+        memcpy (&d, &v, sizeof (d));
+        status = meta_data_add_double (md, key, d);
+      }
+      else
+        break;
+      pos += sizeof (v);
+    }
+
+    if (status != 0)
+      break;
+  }
+
+  if (pos != buffer_size)
+  {
+    meta_data_destroy (md);
+    return (NULL);
+  }
+
+  return (md);
+} /* }}} meta_data_t *uc_snapshot_meta_read */
+
+static size_t uc_snapshot_entry_size (cache_entry_t *ce, /* {{{ */
+    size_t meta_size)
+{
+  return (UC_SNAPSHOT_ALIGN (sizeof (uc_snapshot_entry_t)
+        + ce->values_num * (sizeof (value_t) + sizeof (gauge_t))
+        + uc_history_size (ce->values_num, ce->history_length)
+        + strlen (ce->name) + 1
+        + meta_size));
+} /* }}} size_t uc_snapshot_entry_size */
+
+/* Serializes "ce" into "buffer", which must hold at least "entry_size"
+ * bytes. */
+static void uc_snapshot_entry_write (cache_entry_t *ce, /* {{{ */
+    char *buffer, size_t entry_size, size_t meta_size)
+{
+  uc_snapshot_entry_t *se = (uc_snapshot_entry_t *) buffer;
+  size_t history_size = uc_history_size (ce->values_num, ce->history_length);
+  char *ptr;
+
+  memset (buffer, 0, entry_size);
+
+  se->size = (uint32_t) entry_size;
+  se->name_len = (uint32_t) (strlen (ce->name) + 1);
+  se->values_num = (uint32_t) ce->values_num;
+  se->state = (int32_t) ce->state;
+  se->hits = (int32_t) ce->hits;
+  se->history_length = (uint32_t) ce->history_length;
+  se->history_index = (uint32_t) ce->history_index;
+  se->meta_size = (uint32_t) meta_size;
+  se->last_time = (uint64_t) ce->last_time;
+  se->interval = (uint64_t) ce->interval;
+
+  ptr = (char *) (se + 1);
+  memcpy (ptr, ce->values_raw, ce->values_num * sizeof (value_t));
+  ptr += ce->values_num * sizeof (value_t);
+  memcpy (ptr, ce->values_gauge, ce->values_num * sizeof (gauge_t));
+  ptr += ce->values_num * sizeof (gauge_t);
+  if (history_size > 0)
+    memcpy (ptr, ce->history_time, history_size);
+  ptr += history_size;
+  memcpy (ptr, ce->name, se->name_len);
+  ptr += se->name_len;
+  uc_snapshot_meta_write (ce->meta, ptr, meta_size);
+} /* }}} void uc_snapshot_entry_write */
+
+/* Copies up to UC_ITERATE_CHUNK entries following "last" into "buffer",
+ * growing it as required. "last" is updated to the name of the last entry
+ * copied. Returns the number of entries copied or less than zero on error.
+ * The cache lock is only held while copying, so that updates aren't blocked
+ * while the snapshot is written to disk. */
+static int uc_snapshot_copy_chunk (char *last, size_t last_size, /* {{{ */
+    _Bool have_last, char **buffer, size_t *buffer_size, size_t *fill)
+{
+  c_avl_iterator_t *iter;
+  char *key;
+  cache_entry_t *ce;
+  int entries_num = 0;
+
+  *fill = 0;
+
+  pthread_mutex_lock (&cache_lock);
+
+  iter = c_avl_get_iterator_after (cache_tree, have_last ? last : NULL);
+  if (iter == NULL)
+  {
+    pthread_mutex_unlock (&cache_lock);
+    ERROR ("uc_snapshot_write: c_avl_get_iterator_after failed.");
+    return (-1);
+  }
+
+  while ((entries_num < UC_ITERATE_CHUNK)
+      && (c_avl_iterator_next (iter, (void *) &key, (void *) &ce) == 0))
+  {
+    size_t meta_size = uc_snapshot_meta_write (ce->meta, NULL, 0);
+    size_t entry_size = uc_snapshot_entry_size (ce, meta_size);
+
+    if ((*fill + entry_size) > *buffer_size)
+    {
+      size_t new_size = 2 * (*fill + entry_size);
+      char *tmp = realloc (*buffer, new_size);
+
+      if (tmp == NULL)
+      {
+        c_avl_iterator_destroy (iter);
+        pthread_mutex_unlock (&cache_lock);
+        ERROR ("uc_snapshot_write: realloc failed.");
+        return (-1);
+      }
+      *buffer = tmp;
+      *buffer_size = new_size;
+    }
+
+    uc_snapshot_entry_write (ce, *buffer + *fill, entry_size, meta_size);
+    *fill += entry_size;
+    entries_num++;
+
+    sstrncpy (last, key, last_size);
+  }
+
+  c_avl_iterator_destroy (iter);
+  pthread_mutex_unlock (&cache_lock);
+
+  return (entries_num);
+} /* }}} int uc_snapshot_copy_chunk */
+
+/* Makes the rename of a snapshot durable by syncing the directory it has been
+ * written to. */
+static int uc_snapshot_sync_dir (const char *file) /* {{{ */
+{
+  char dir[PATH_MAX];
+  char errbuf[1024];
+  char *slash;
+  int fd;
+  int status = 0;
+
+  sstrncpy (dir, file, sizeof (dir));
+  slash = strrchr (dir, '/');
+  if (slash == NULL)
+    sstrncpy (dir, ".", sizeof (dir));
+  else if (slash == dir)
+    dir[1] = 0;
+  else
+    *slash = 0;
+
+  fd = open (dir, O_RDONLY | O_DIRECTORY);
+  if (fd < 0)
+  {
+    ERROR ("uc_snapshot_write: open (%s) failed: %s", dir,
+        sstrerror (errno, errbuf, sizeof (errbuf)));
+    return (-1);
+  }
+
+  if (fsync (fd) != 0)
+  {
+    ERROR ("uc_snapshot_write: fsync (%s) failed: %s", dir,
+        sstrerror (errno, errbuf, sizeof (errbuf)));
+    status = -1;
+  }
+
+  close (fd);
+  return (status);
+} /* }}} int uc_snapshot_sync_dir */
+
+/* Writes all cache entries to "file". The snapshot is written to a temporary
+ * file first, which is then renamed, so that readers never see a partially
+ * written snapshot. Entries are copied in chunks; entries added or removed
+ * while the snapshot is being written may or may not be included. */
+int uc_snapshot_write (const char *file) /* {{{ */
+{
+  char tmp_file[PATH_MAX];
+  char errbuf[1024];
+  char last[6 * DATA_MAX_NAME_LEN] = "";
+  _Bool have_last = 0;
+  uc_snapshot_header_t hdr;
+  char *buffer = NULL;
+  size_t buffer_size = 0;
+  size_t fill;
+  uint64_t size;
+  uint64_t entries_num = 0;
+  int fd;
+  int status = 0;
+
+  if (file == NULL)
+    return (EINVAL);
+
+  ssnprintf (tmp_file, sizeof (tmp_file), "%s.XXXXXX", file);
+
+  fd = mkstemp (tmp_file);
+  if (fd < 0)
+  {
+    ERROR ("uc_snapshot_write: mkstemp (%s) failed: %s", tmp_file,
+        sstrerror (errno, errbuf, sizeof (errbuf)));
+    return (-1);
+  }
+
+  /* The header is written last, once the number of entries is known. */
+  memset (&hdr, 0, sizeof (hdr));
+  size = sizeof (hdr);
+  if (lseek (fd, (off_t) size, SEEK_SET) == (off_t) -1)
+  {
+    ERROR ("uc_snapshot_write: lseek (%s) failed: %s", tmp_file,
+        sstrerror (errno, errbuf, sizeof (errbuf)));
+    status = -1;
+  }
+
+  while (status == 0)
+  {
+    int num = uc_snapshot_copy_chunk (last, sizeof (last), have_last,
+        &buffer, &buffer_size, &fill);
+
+    if (num < 0)
+    {
+      status = -1;
+      break;
+    }
+    if (num == 0)
+      break;
+    have_last = 1;
+
+    if (swrite (fd, buffer, fill) != 0)
+    {
+      ERROR ("uc_snapshot_write: Writing %s failed: %s", tmp_file,
+          sstrerror (errno, errbuf, sizeof (errbuf)));
+      status = -1;
+      break;
+    }
+
+    size += fill;
+    entries_num += (uint64_t) num;
+
+    if (num < UC_ITERATE_CHUNK)
+      break;
+  }
+  sfree (buffer);
+
+  if (status == 0)
+  {
+    memcpy (hdr.magic, UC_SNAPSHOT_MAGIC, sizeof (hdr.magic));
+    hdr.version = UC_SNAPSHOT_VERSION;
+    hdr.byte_order = UC_SNAPSHOT_BYTE_ORDER;
+    hdr.entries_num = entries_num;
+    hdr.size = size;
+
+    if ((pwrite (fd, &hdr, sizeof (hdr), 0) != (ssize_t) sizeof (hdr))
+        || (fsync (fd) != 0))
+    {
+      ERROR ("uc_snapshot_write: Writing %s failed: %s", tmp_file,
+          sstrerror (errno, errbuf, sizeof (errbuf)));
+      status = -1;
+    }
+  }
+  close (fd);
+
+  if ((status == 0) && (rename (tmp_file, file) != 0))
+  {
+    ERROR ("uc_snapshot_write: rename (%s, %s) failed: %s", tmp_file, file,
+        sstrerror (errno, errbuf, sizeof (errbuf)));
+    status = -1;
+  }
+
+  if (status != 0)
+  {
+    unlink (tmp_file);
+    return (status);
+  }
+
+  /* A failure here only means the snapshot may not survive a crash. */
+  uc_snapshot_sync_dir (file);
+
+  DEBUG ("uc_snapshot_write: Wrote %"PRIu64" entries to %s.",
+      entries_num, file);
+  return (0);
+} /* }}} int uc_snapshot_write */
+
+/* Restores a single entry. `cache_lock' must be held. Returns zero if the
+ * entry has been added, greater than zero if it has been skipped and less
+ * than zero on error. */
+static int uc_snapshot_restore (uc_snapshot_entry_t const *se, /* {{{ */
+    char const *data, cdtime_t now)
+{
+  value_list_t vl = VALUE_LIST_INIT;
+  const data_set_t *ds;
+  cache_entry_t *ce;
+  char const *name;
+  char *key;
+  size_t history_size;
+
+  history_size = uc_history_size (se->values_num, se->history_length);
+  name = data + se->values_num * (sizeof (value_t) + sizeof (gauge_t))
+    + history_size;
+
+  if ((se->name_len == 0) || (se->name_len > sizeof (ce->name))
+      || (name[se->name_len - 1] != 0))
+    return (-1);
+
+  if (c_avl_get (cache_tree, name, NULL) == 0)
+    return (1);
+
+  /* Values which would time out right away are not restored. */
+  if ((se->interval > 0) && (now > se->last_time)
+      && ((now - se->last_time) >= (timeout_g * se->interval)))
+    return (1);
+
+  vl.values = NULL;
+  vl.values_len = 0;
+  vl.meta = NULL;
+  if (parse_identifier_vl (name, &vl) != 0)
+    return (-1);
+
+  /* The definition of the type may have changed since the snapshot has been
+   * written. */
+  ds = plugin_get_ds (vl.type);
+  if ((ds == NULL) || (ds->ds_num != se->values_num)
+      || ((se->history_length > 0) && (se->history_index >= se->history_length)))
+    return (1);
+
+  key = strdup (name);
+  if (key == NULL)
+    return (-1);
+
+  ce = cache_alloc (se->values_num);
+  if (ce == NULL)
+  {
+    sfree (key);
+    return (-1);
+  }
+
+  sstrncpy (ce->name, name, sizeof (ce->name));
+  memcpy (ce->values_raw, data, se->values_num * sizeof (value_t));
+  data += se->values_num * sizeof (value_t);
+  memcpy (ce->values_gauge, data, se->values_num * sizeof (gauge_t));
+  data += se->values_num * sizeof (gauge_t);
+
+  if (history_size > 0)
+  {
+    if (uc_history_resize (ce, se->history_length) != 0)
+    {
+      sfree (key);
+      cache_free (ce);
+      return (-1);
+    }
+    memcpy (ce->history_time, data, history_size);
+    ce->history_index = se->history_index;
+  }
+
+  if (se->meta_size > 0)
+  {
+    ce->meta = uc_snapshot_meta_read (name + se->name_len, se->meta_size);
+    if (ce->meta == NULL)
+      WARNING ("uc_snapshot_restore: Unable to parse the meta data of %s.",
+          name);
+  }
+
+  ce->last_time = (cdtime_t) se->last_time;
+  /* The entry has not been updated since the snapshot has been written, but
+   * give it a full timeout period before considering it missing. */
+  ce->last_update = now;
+  ce->interval = (cdtime_t) se->interval;
+  ce->state = (int) se->state;
+  ce->hits = (int) se->hits;
+
+  if (c_avl_insert (cache_tree, key, ce) != 0)
+  {
+    sfree (key);
+    cache_free (ce);
+    return (-1);
+  }
+
+  uc_expiry_link (ce);
+  return (0);
+} /* }}} int uc_snapshot_restore */
+
+/* Loads a snapshot written by uc_snapshot_write(). Entries which are already
+ * in the cache, whose type doesn't match the current data set definition or
+ * which would have timed out already are skipped. */
+int uc_snapshot_read (const char *file) /* {{{ */
+{
+  char errbuf[1024];
+  uc_snapshot_header_t const *hdr;
+  struct stat statbuf;
+  char const *map;
+  size_t size;
+  size_t pos;
+  uint64_t i;
+  size_t restored = 0;
+  cdtime_t now;
+  int fd;
+  int status = 0;
+
+  if (file == NULL)
+    return (EINVAL);
+
+  fd = open (file, O_RDONLY);
+  if (fd < 0)
+  {
+    status = errno;
+    if (status != ENOENT)
+      ERROR ("uc_snapshot_read: open (%s) failed: %s", file,
+          sstrerror (status, errbuf, sizeof (errbuf)));
+    return (status);
+  }
+
+  if (fstat (fd, &statbuf) != 0)
+  {
+    ERROR ("uc_snapshot_read: fstat (%s) failed: %s", file,
+        sstrerror (errno, errbuf, sizeof (errbuf)));
+    close (fd);
+    return (-1);
+  }
+  size = (size_t) statbuf.st_size;
+
+  if (size < sizeof (*hdr))
+  {
+    ERROR ("uc_snapshot_read: %s is too small.", file);
+    close (fd);
+    return (-1);
+  }
+
+  map = mmap (NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close (fd);
+  if (map == MAP_FAILED)
+  {
+    ERROR ("uc_snapshot_read: mmap (%s) failed: %s", file,
+        sstrerror (errno, errbuf, sizeof (errbuf)));
+    return (-1);
+  }
+#ifdef MADV_SEQUENTIAL
+  madvise ((void *) map, size, MADV_SEQUENTIAL);
+#endif
+
+  hdr = (uc_snapshot_header_t const *) map;
+  if ((memcmp (hdr->magic, UC_SNAPSHOT_MAGIC, sizeof (hdr->magic)) != 0)
+      || (hdr->byte_order != UC_SNAPSHOT_BYTE_ORDER)
+      || (hdr->size != (uint64_t) size))
+  {
+    ERROR ("uc_snapshot_read: %s is not a valid snapshot file.", file);
+    munmap ((void *) map, size);
+    return (-1);
+  }
+  else if (hdr->version != UC_SNAPSHOT_VERSION)
+  {
+    WARNING ("uc_snapshot_read: %s has version %"PRIu32", expected "
+        "version %i. Ignoring it.", file, hdr->version, UC_SNAPSHOT_VERSION);
+    munmap ((void *) map, size);
+    return (-1);
+  }
+
+  now = cdtime ();
+  pos = sizeof (*hdr);
+
+  pthread_mutex_lock (&cache_lock);
+  for (i = 0; i < hdr->entries_num; i++)
+  {
+    uc_snapshot_entry_t const *se;
+    size_t min_size;
+
+    if ((size - pos) < sizeof (*se))
+    {
+      status = -1;
+      break;
+    }
+    se = (uc_snapshot_entry_t const *) (map + pos);
+
+    min_size = sizeof (*se)
+      + (size_t) se->values_num * (sizeof (value_t) + sizeof (gauge_t))
+      + uc_history_size (se->values_num, se->history_length)
+      + (size_t) se->name_len + (size_t) se->meta_size;
+    if ((se->size < min_size) || (se->size > (size - pos))
+        || ((se->size % 8) != 0))
+    {
+      status = -1;
+      break;
+    }
+
+    if (uc_snapshot_restore (se, (char const *) (se + 1), now) == 0)
+      restored++;
+
+    pos += se->size;
+  }
+  pthread_mutex_unlock (&cache_lock);
+
+  munmap ((void *) map, size);
+
+  if (status != 0)
+    ERROR ("uc_snapshot_read: %s is corrupt after %"PRIu64" entries.",
+        file, i);
+
+  INFO ("uc_snapshot_read: Restored %zu of %"PRIu64" entries from %s "
+      "in %.3f seconds.", restored, i, file,
+      CDTIME_T_TO_DOUBLE (cdtime () - now));
+  return (status);
+} /* }}} int uc_snapshot_read */
+
 /*
  * Meta data interface
  */
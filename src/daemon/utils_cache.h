@@ -35,13 +35,28 @@
 #define STATE_MISSING 15
 
 int uc_init (void);
+/* Number of steps of history allocated for new entries. Zero, the default,
+ * means that history is only allocated by uc_get_history(). */
+int uc_set_history_length (size_t history_length);
 int uc_check_timeout (void);
 int uc_update (const data_set_t *ds, const value_list_t *vl);
 int uc_get_rate_by_name (const char *name, gauge_t **ret_values, size_t *ret_values_num);
 gauge_t *uc_get_rate (const data_set_t *ds, const value_list_t *vl);
+int uc_get_rate_buffer (const data_set_t *ds, const value_list_t *vl,
+    gauge_t *ret_values, size_t ret_values_num);
 
 size_t uc_get_size (void);
 int uc_get_names (char ***ret_names, cdtime_t **ret_times, size_t *ret_number);
+/* Calls "callback" for every entry, except missing ones, in the order of
+ * their names, starting after "after" or at the first entry if "after" is
+ * NULL. The callback is called with the cache lock held and must not call any
+ * other uc_* function. The lock is released every thousand or so entries, so
+ * long iterations don't block updates; entries added or removed in the meantime
+ * may or may not be visited. Iteration stops when the callback returns non-zero
+ * and that value is returned. */
+int uc_iterate_names (const char *after,
+    int (*callback) (const char *name, cdtime_t time, void *user_data),
+    void *user_data);
 
 int uc_get_state (const data_set_t *ds, const value_list_t *vl);
 int uc_set_state (const data_set_t *ds, const value_list_t *vl, int state);
@@ -53,6 +68,19 @@ int uc_get_history (const data_set_t *ds, const value_list_t *vl,
     gauge_t *ret_history, size_t num_steps, size_t num_ds);
 int uc_get_history_by_name (const char *name,
     gauge_t *ret_history, size_t num_steps, size_t num_ds);
+/* Returns up to "num_steps" recorded steps of history, newest first, along
+ * with their times. All available steps are returned if "num_steps" is zero.
+ * The caller must free "ret_times" and "ret_history". If both are NULL, only
+ * the number of steps and values is returned. */
+int uc_get_history_range_by_name (const char *name, size_t num_steps,
+    cdtime_t **ret_times, gauge_t **ret_history,
+    size_t *ret_steps_num, size_t *ret_values_num);
+
+/*
+ * Snapshot interface
+ */
+int uc_snapshot_write (const char *file);
+int uc_snapshot_read (const char *file);
 
 /*
  * Meta data interface
@@ -0,0 +1,146 @@
+/**
+ * collectd - src/daemon/utils_cache_benchmark.c
+ * Copyright (C) 2026       agent
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   agent <agent at local>
+ */
+
+/*
+ * Measures how long it takes to write and restore a snapshot of the value
+ * cache. Usage: benchmark_utils_cache [<entries> [<file>]]
+ * The default is one million entries, which requires about 1 GByte of memory.
+ */
+
+#include "collectd.h"
+#include "common.h"
+#include "utils_cache.h"
+
+int timeout_g = 2;
+
+static data_source_t dsrc[] = {
+  { "rx", DS_TYPE_DERIVE, 0.0, NAN },
+  { "tx", DS_TYPE_DERIVE, 0.0, NAN }
+};
+static data_set_t ds = { "if_octets", STATIC_ARRAY_SIZE (dsrc), dsrc };
+
+/* mock functions */
+void plugin_log (int level, char const *format, ...)
+{
+  char buffer[1024];
+  va_list ap;
+
+  if (level > LOG_WARNING)
+    return;
+
+  va_start (ap, format);
+  vsnprintf (buffer, sizeof (buffer), format, ap);
+  va_end (ap);
+
+  fprintf (stderr, "plugin_log (%i, \"%s\");\n", level, buffer);
+}
+
+const data_set_t *plugin_get_ds (const char *name)
+{
+  if (strcmp (ds.type, name) == 0)
+    return (&ds);
+  return (NULL);
+}
+
+cdtime_t plugin_get_interval (void)
+{
+  return TIME_T_TO_CDTIME_T (10);
+}
+
+int plugin_dispatch_missing (const value_list_t *vl)
+{
+  return (0);
+}
+/* end mock functions */
+
+int main (int argc, char **argv)
+{
+  value_list_t vl = VALUE_LIST_INIT;
+  value_t values[2];
+  char const *file = "/tmp/benchmark_utils_cache.snapshot";
+  unsigned long entries_num = 1000000;
+  unsigned long i;
+  cdtime_t now;
+  cdtime_t begin;
+  struct stat statbuf;
+
+  if (argc > 1)
+    entries_num = strtoul (argv[1], NULL, 0);
+  if (argc > 2)
+    file = argv[2];
+
+  uc_init ();
+
+  now = cdtime ();
+  vl.values = values;
+  vl.values_len = STATIC_ARRAY_SIZE (values);
+  vl.time = now;
+  vl.interval = TIME_T_TO_CDTIME_T (10);
+  sstrncpy (vl.plugin, "interface", sizeof (vl.plugin));
+  sstrncpy (vl.type, ds.type, sizeof (vl.type));
+
+  begin = cdtime ();
+  for (i = 0; i < entries_num; i++)
+  {
+    ssnprintf (vl.host, sizeof (vl.host), "host%lu.example.com", i / 100);
+    ssnprintf (vl.plugin_instance, sizeof (vl.plugin_instance), "eth%lu",
+        i % 100);
+    values[0].derive = (derive_t) i;
+    values[1].derive = (derive_t) (2 * i);
+
+    if (uc_update (&ds, &vl) != 0)
+      return (1);
+  }
+  printf ("populate: %lu entries in %.3f s\n", entries_num,
+      CDTIME_T_TO_DOUBLE (cdtime () - begin));
+
+  begin = cdtime ();
+  if (uc_snapshot_write (file) != 0)
+    return (1);
+  printf ("write:    %.3f s\n", CDTIME_T_TO_DOUBLE (cdtime () - begin));
+
+  if (stat (file, &statbuf) == 0)
+    printf ("size:     %.1f MByte\n",
+        ((double) statbuf.st_size) / (1024.0 * 1024.0));
+
+  /* Let all entries time out to get an empty cache. */
+  begin = cdtime ();
+  timeout_g = 0;
+  uc_check_timeout ();
+  timeout_g = 2;
+  printf ("clear:    %.3f s\n", CDTIME_T_TO_DOUBLE (cdtime () - begin));
+
+  begin = cdtime ();
+  if (uc_snapshot_read (file) != 0)
+    return (1);
+  printf ("read:     %.3f s (%zu entries restored)\n",
+      CDTIME_T_TO_DOUBLE (cdtime () - begin), uc_get_size ());
+
+  unlink (file);
+  return ((uc_get_size () == (size_t) entries_num) ? 0 : 1);
+}
+
+/* vim: set sw=2 sts=2 et : */
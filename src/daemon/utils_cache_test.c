@@ -0,0 +1,496 @@
+/**
+ * collectd - src/daemon/utils_cache_test.c
+ * Copyright (C) 2026       agent
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   agent <agent at local>
+ */
+
+#include "common.h" /* for STATIC_ARRAY_SIZE */
+#include "collectd.h"
+#include "testing.h"
+#include "utils_cache.h"
+
+int timeout_g = 2;
+
+static data_source_t dsrc_test[] = {
+  { "rx", DS_TYPE_DERIVE, 0.0, NAN },
+  { "tx", DS_TYPE_GAUGE,  0.0, NAN }
+};
+static data_set_t ds_test = { "test", STATIC_ARRAY_SIZE (dsrc_test), dsrc_test };
+/* Same type name, but a different number of data sources. Used to simulate
+ * a changed types.db. */
+static data_set_t ds_changed = { "test", 1, dsrc_test };
+static data_set_t const *ds_current = &ds_test;
+
+static int missing_num = 0;
+/* called by plugin_dispatch_missing(), i.e. while uc_check_timeout() runs */
+static void (*missing_hook) (void) = NULL;
+
+/* mock functions */
+void plugin_log (int level, char const *format, ...)
+{
+  char buffer[1024];
+  va_list ap;
+
+  va_start (ap, format);
+  vsnprintf (buffer, sizeof (buffer), format, ap);
+  va_end (ap);
+
+  printf ("plugin_log (%i, \"%s\");\n", level, buffer);
+}
+
+const data_set_t *plugin_get_ds (const char *name)
+{
+  if (strcmp ("test", name) == 0)
+    return (ds_current);
+  return (NULL);
+}
+
+cdtime_t plugin_get_interval (void)
+{
+  return TIME_T_TO_CDTIME_T (10);
+}
+
+int plugin_dispatch_missing (const value_list_t *vl)
+{
+  missing_num++;
+  if (missing_hook != NULL)
+    missing_hook ();
+  return (0);
+}
+/* end mock functions */
+
+static char snapshot_file[] = "/tmp/test_utils_cache.XXXXXX";
+
+static void init_vl (value_list_t *vl, value_t *values, char const *host)
+{
+  vl->values = values;
+  vl->values_len = STATIC_ARRAY_SIZE (dsrc_test);
+  vl->interval = TIME_T_TO_CDTIME_T (10);
+  sstrncpy (vl->host, host, sizeof (vl->host));
+  sstrncpy (vl->plugin, "plugin", sizeof (vl->plugin));
+  sstrncpy (vl->type, "test", sizeof (vl->type));
+}
+
+/* Removes all entries from the cache by letting them time out. */
+static void clear_cache (void)
+{
+  timeout_g = 0;
+  uc_check_timeout ();
+  timeout_g = 2;
+}
+
+DEF_TEST(snapshot)
+{
+  value_list_t vl = VALUE_LIST_INIT;
+  value_t values[2];
+  gauge_t rates[2];
+  gauge_t history[3 * 2];
+  char *s = NULL;
+  int64_t si = 0;
+  uint64_t ui = 0;
+  double d = 0.0;
+  _Bool b = 0;
+  cdtime_t now = cdtime ();
+
+  init_vl (&vl, values, "example.com");
+
+  values[0].derive = 100;
+  values[1].gauge = 1.5;
+  vl.time = now - TIME_T_TO_CDTIME_T (20);
+  CHECK_ZERO (uc_update (&ds_test, &vl));
+  /* Allocate the history, so it's part of the snapshot. */
+  CHECK_ZERO (uc_get_history (&ds_test, &vl, history, 3, 2));
+
+  values[0].derive = 200;
+  values[1].gauge = 2.5;
+  vl.time = now - TIME_T_TO_CDTIME_T (10);
+  CHECK_ZERO (uc_update (&ds_test, &vl));
+
+  uc_set_state (&ds_test, &vl, STATE_WARNING);
+  uc_set_hits (&ds_test, &vl, 42);
+  CHECK_ZERO (uc_meta_data_add_string (&vl, "string", "foobar"));
+  CHECK_ZERO (uc_meta_data_add_signed_int (&vl, "signed_int", -23));
+  CHECK_ZERO (uc_meta_data_add_unsigned_int (&vl, "unsigned_int", 23));
+  CHECK_ZERO (uc_meta_data_add_double (&vl, "double", 0.5));
+  CHECK_ZERO (uc_meta_data_add_boolean (&vl, "boolean", 1));
+
+  CHECK_ZERO (uc_snapshot_write (snapshot_file));
+
+  clear_cache ();
+  EXPECT_EQ_INT (1, missing_num);
+  EXPECT_EQ_UINT64 (0, uc_get_size ());
+
+  CHECK_ZERO (uc_snapshot_read (snapshot_file));
+  EXPECT_EQ_UINT64 (1, uc_get_size ());
+
+  CHECK_ZERO (uc_get_rate_buffer (&ds_test, &vl, rates, 2));
+  EXPECT_EQ_DOUBLE (10.0, rates[0]);
+  EXPECT_EQ_DOUBLE (2.5, rates[1]);
+  EXPECT_EQ_INT (STATE_WARNING, uc_get_state (&ds_test, &vl));
+  EXPECT_EQ_INT (42, uc_get_hits (&ds_test, &vl));
+
+  CHECK_ZERO (uc_get_history (&ds_test, &vl, history, 3, 2));
+  EXPECT_EQ_DOUBLE (10.0, history[0]);
+  EXPECT_EQ_DOUBLE (2.5, history[1]);
+  EXPECT_EQ_DOUBLE (NAN, history[2]);
+
+  CHECK_ZERO (uc_meta_data_get_string (&vl, "string", &s));
+  EXPECT_EQ_STR ("foobar", s);
+  sfree (s);
+  CHECK_ZERO (uc_meta_data_get_signed_int (&vl, "signed_int", &si));
+  EXPECT_EQ_INT (-23, si);
+  CHECK_ZERO (uc_meta_data_get_unsigned_int (&vl, "unsigned_int", &ui));
+  EXPECT_EQ_UINT64 (23, ui);
+  CHECK_ZERO (uc_meta_data_get_double (&vl, "double", &d));
+  EXPECT_EQ_DOUBLE (0.5, d);
+  CHECK_ZERO (uc_meta_data_get_boolean (&vl, "boolean", &b));
+  OK (b);
+
+  /* The raw value has been restored, so the very next update yields a
+   * rate. */
+  values[0].derive = 400;
+  values[1].gauge = 3.5;
+  vl.time = now;
+  CHECK_ZERO (uc_update (&ds_test, &vl));
+  CHECK_ZERO (uc_get_rate_buffer (&ds_test, &vl, rates, 2));
+  EXPECT_EQ_DOUBLE (20.0, rates[0]);
+
+  /* Entries already in the cache are not overwritten. */
+  CHECK_ZERO (uc_snapshot_read (snapshot_file));
+  CHECK_ZERO (uc_get_rate_buffer (&ds_test, &vl, rates, 2));
+  EXPECT_EQ_DOUBLE (20.0, rates[0]);
+
+  clear_cache ();
+  missing_num = 0;
+  return (0);
+}
+
+DEF_TEST(skipped_entries)
+{
+  value_list_t vl = VALUE_LIST_INIT;
+  value_t values[2];
+  cdtime_t now = cdtime ();
+
+  init_vl (&vl, values, "fresh.example.com");
+  values[0].derive = 1;
+  values[1].gauge = 1.0;
+  vl.time = now;
+  CHECK_ZERO (uc_update (&ds_test, &vl));
+
+  /* Would time out immediately after restoring. */
+  init_vl (&vl, values, "stale.example.com");
+  vl.time = now - TIME_T_TO_CDTIME_T (3600);
+  CHECK_ZERO (uc_update (&ds_test, &vl));
+
+  CHECK_ZERO (uc_snapshot_write (snapshot_file));
+  clear_cache ();
+
+  CHECK_ZERO (uc_snapshot_read (snapshot_file));
+  EXPECT_EQ_UINT64 (1, uc_get_size ());
+  clear_cache ();
+
+  /* The definition of the type has changed since writing the snapshot. */
+  ds_current = &ds_changed;
+  CHECK_ZERO (uc_snapshot_read (snapshot_file));
+  EXPECT_EQ_UINT64 (0, uc_get_size ());
+  ds_current = &ds_test;
+
+  missing_num = 0;
+  return (0);
+}
+
+static void update_late (void)
+{
+  value_list_t vl = VALUE_LIST_INIT;
+  value_t values[2];
+
+  /* only once */
+  missing_hook = NULL;
+
+  /* Make sure the entry's last update is later than the time
+   * uc_check_timeout() has started at. */
+  usleep (1000);
+
+  init_vl (&vl, values, "late.example.com");
+  /* a new interval, i.e. a new expiry list */
+  vl.interval = TIME_T_TO_CDTIME_T (7);
+  vl.time = cdtime ();
+  values[0].derive = 1;
+  values[1].gauge = 1.0;
+  uc_update (&ds_test, &vl);
+}
+
+DEF_TEST(update_during_timeout)
+{
+  value_list_t vl = VALUE_LIST_INIT;
+  value_t values[2];
+  cdtime_t now = cdtime ();
+  /* more than one chunk, so the lock is released in between */
+  int entries_num = 1100;
+  int i;
+
+  for (i = 0; i < entries_num; i++)
+  {
+    char host[DATA_MAX_NAME_LEN];
+
+    snprintf (host, sizeof (host), "host%04d.example.com", i);
+    init_vl (&vl, values, host);
+    vl.time = now - TIME_T_TO_CDTIME_T (3600);
+    values[0].derive = i;
+    values[1].gauge = (gauge_t) i;
+    CHECK_ZERO (uc_update (&ds_test, &vl));
+  }
+
+  /* Expires everything that has been updated before the pass started. */
+  missing_num = 0;
+  missing_hook = update_late;
+  timeout_g = 0;
+  uc_check_timeout ();
+  timeout_g = 2;
+  missing_hook = NULL;
+
+  EXPECT_EQ_INT (entries_num, missing_num);
+  EXPECT_EQ_UINT64 (1, uc_get_size ());
+  init_vl (&vl, values, "late.example.com");
+  vl.interval = TIME_T_TO_CDTIME_T (7);
+  EXPECT_EQ_INT (0, uc_get_hits (&ds_test, &vl));
+
+  clear_cache ();
+  EXPECT_EQ_UINT64 (0, uc_get_size ());
+  missing_num = 0;
+  return (0);
+}
+
+DEF_TEST(history)
+{
+  value_list_t vl = VALUE_LIST_INIT;
+  value_t values[2];
+  cdtime_t now = cdtime ();
+  cdtime_t *times = NULL;
+  gauge_t *history = NULL;
+  gauge_t buffer[5 * 2];
+  size_t steps_num = 0;
+  size_t values_num = 0;
+  int i;
+
+  CHECK_ZERO (uc_set_history_length (3));
+  init_vl (&vl, values, "history.example.com");
+
+  for (i = 0; i < 4; i++)
+  {
+    values[0].derive = 100 * i;
+    values[1].gauge = (gauge_t) i;
+    vl.time = now - TIME_T_TO_CDTIME_T (10 * (3 - i));
+    CHECK_ZERO (uc_update (&ds_test, &vl));
+  }
+
+  /* Only the three most recent steps are kept, newest first. */
+  CHECK_ZERO (uc_get_history_range_by_name ("history.example.com/plugin/test",
+        /* num_steps = */ 0, &times, &history, &steps_num, &values_num));
+  EXPECT_EQ_UINT64 (3, steps_num);
+  EXPECT_EQ_UINT64 (2, values_num);
+  EXPECT_EQ_UINT64 (now, times[0]);
+  EXPECT_EQ_UINT64 (now - TIME_T_TO_CDTIME_T (20), times[2]);
+  EXPECT_EQ_DOUBLE (10.0, history[0]);
+  EXPECT_EQ_DOUBLE (3.0, history[1]);
+  EXPECT_EQ_DOUBLE (1.0, history[5]);
+  sfree (times);
+  sfree (history);
+
+  CHECK_ZERO (uc_get_history_range_by_name ("history.example.com/plugin/test",
+        /* num_steps = */ 1, &times, &history, &steps_num, &values_num));
+  EXPECT_EQ_UINT64 (1, steps_num);
+  EXPECT_EQ_DOUBLE (3.0, history[1]);
+  sfree (times);
+  sfree (history);
+
+  /* Only count the steps. */
+  steps_num = values_num = 0;
+  CHECK_ZERO (uc_get_history_range_by_name ("history.example.com/plugin/test",
+        /* num_steps = */ 0, NULL, NULL, &steps_num, &values_num));
+  EXPECT_EQ_UINT64 (3, steps_num);
+  EXPECT_EQ_UINT64 (2, values_num);
+  CHECK_ZERO (uc_get_history_range_by_name ("history.example.com/plugin/test",
+        /* num_steps = */ 2, NULL, NULL, &steps_num, &values_num));
+  EXPECT_EQ_UINT64 (2, steps_num);
+
+  /* Growing the history keeps the recorded steps. */
+  CHECK_ZERO (uc_get_history (&ds_test, &vl, buffer, 5, 2));
+  EXPECT_EQ_DOUBLE (3.0, buffer[1]);
+  EXPECT_EQ_DOUBLE (1.0, buffer[5]);
+  EXPECT_EQ_DOUBLE (NAN, buffer[7]);
+
+  CHECK_ZERO (uc_get_history_range_by_name ("history.example.com/plugin/test",
+        /* num_steps = */ 0, &times, &history, &steps_num, &values_num));
+  EXPECT_EQ_UINT64 (3, steps_num);
+  sfree (times);
+  sfree (history);
+
+  OK (uc_get_history_range_by_name ("does/not/exist", 0,
+        &times, &history, &steps_num, &values_num) != 0);
+
+  CHECK_ZERO (uc_set_history_length (0));
+  clear_cache ();
+  missing_num = 0;
+  return (0);
+}
+
+struct iterate_state_s
+{
+  char last[6 * DATA_MAX_NAME_LEN];
+  int num;
+  int limit;
+  _Bool ordered;
+};
+typedef struct iterate_state_s iterate_state_t;
+
+static int iterate_callback (const char *name, cdtime_t time, void *user_data)
+{
+  iterate_state_t *state = user_data;
+
+  if ((state->num > 0) && (strcmp (state->last, name) >= 0))
+    state->ordered = 0;
+  sstrncpy (state->last, name, sizeof (state->last));
+  state->num++;
+
+  if ((state->limit > 0) && (state->num >= state->limit))
+    return (42);
+  return (0);
+}
+
+DEF_TEST(iterate_names)
+{
+  value_list_t vl = VALUE_LIST_INIT;
+  value_t values[2];
+  iterate_state_t state;
+  char host[64];
+  int i;
+
+  /* More entries than are visited while holding the lock once. */
+  for (i = 0; i < 2500; i++)
+  {
+    ssnprintf (host, sizeof (host), "host%04i", i);
+    init_vl (&vl, values, host);
+    values[0].derive = i;
+    values[1].gauge = (gauge_t) i;
+    vl.time = cdtime ();
+    CHECK_ZERO (uc_update (&ds_test, &vl));
+  }
+
+  memset (&state, 0, sizeof (state));
+  state.ordered = 1;
+  CHECK_ZERO (uc_iterate_names (NULL, iterate_callback, &state));
+  EXPECT_EQ_INT (2500, state.num);
+  OK1 (state.ordered, "names are visited in order");
+  EXPECT_EQ_STR ("host2499/plugin/test", state.last);
+
+  /* Continue after a name, which doesn't need to exist. */
+  memset (&state, 0, sizeof (state));
+  state.ordered = 1;
+  CHECK_ZERO (uc_iterate_names ("host1000/plugin/test", iterate_callback,
+        &state));
+  EXPECT_EQ_INT (1499, state.num);
+  OK1 (state.ordered, "names are visited in order");
+
+  memset (&state, 0, sizeof (state));
+  CHECK_ZERO (uc_iterate_names ("host1000", iterate_callback, &state));
+  EXPECT_EQ_INT (1500, state.num);
+
+  /* The callback's return value stops the iteration. */
+  memset (&state, 0, sizeof (state));
+  state.limit = 1100;
+  EXPECT_EQ_INT (42, uc_iterate_names ("host0999/plugin/test",
+        iterate_callback, &state));
+  EXPECT_EQ_INT (1100, state.num);
+  EXPECT_EQ_STR ("host2099/plugin/test", state.last);
+
+  clear_cache ();
+  missing_num = 0;
+  return (0);
+}
+
+DEF_TEST(invalid_files)
+{
+  char buffer[4096];
+  FILE *fh;
+  size_t len;
+  int fd;
+
+  /* A missing file is not an error worth logging about. */
+  EXPECT_EQ_INT (ENOENT, uc_snapshot_read ("/nonexistent/snapshot"));
+
+  CHECK_ZERO (uc_snapshot_write (snapshot_file));
+  CHECK_NOT_NULL (fh = fopen (snapshot_file, "r"));
+  len = fread (buffer, 1, sizeof (buffer), fh);
+  fclose (fh);
+  OK (len > 16);
+
+  /* Unknown version. */
+  buffer[8]++;
+  CHECK_NOT_NULL (fh = fopen (snapshot_file, "w"));
+  OK (fwrite (buffer, 1, len, fh) == len);
+  fclose (fh);
+  OK (uc_snapshot_read (snapshot_file) != 0);
+  buffer[8]--;
+
+  /* Truncated file. */
+  CHECK_NOT_NULL (fh = fopen (snapshot_file, "w"));
+  OK (fwrite (buffer, 1, len - 1, fh) == (len - 1));
+  fclose (fh);
+  OK (uc_snapshot_read (snapshot_file) != 0);
+
+  /* Not a snapshot at all. */
+  fd = open (snapshot_file, O_WRONLY | O_TRUNC);
+  OK (fd >= 0);
+  OK (write (fd, "garbage garbage garbage garbage", 31) == 31);
+  close (fd);
+  OK (uc_snapshot_read (snapshot_file) != 0);
+
+  EXPECT_EQ_UINT64 (0, uc_get_size ());
+  return (0);
+}
+
+int main (void)
+{
+  int fd;
+
+  fd = mkstemp (snapshot_file);
+  if (fd < 0)
+    return (1);
+  close (fd);
+
+  uc_init ();
+
+  RUN_TEST(snapshot);
+  RUN_TEST(skipped_entries);
+  RUN_TEST(update_during_timeout);
+  RUN_TEST(history);
+  RUN_TEST(iterate_names);
+  RUN_TEST(invalid_files);
+
+  unlink (snapshot_file);
+
+  END_TEST;
+}
+
+/* vim: set sw=2 sts=2 et : */
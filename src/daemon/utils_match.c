@@ -35,44 +35,212 @@
 #define UTILS_MATCH_FLAGS_FREE_USER_DATA 0x01
 #define UTILS_MATCH_FLAGS_EXCLUDE_REGEX 0x02
 
+/* Shorter literals occur in too many lines to be useful as a prefilter. */
+#define UTILS_MATCH_LITERAL_MIN 3
+
+/* Maximum number of (sub-)matches passed to callbacks. */
+#define UTILS_MATCH_SUBMATCH_MAX 32
+
 struct cu_match_s
 {
   regex_t regex;
   regex_t excluderegex;
   int flags;
 
+  /* Number of (sub-)matches the callback needs. Asking regexec for fewer
+   * submatches makes it considerably faster. */
+  size_t nmatch;
+  char *literal;
+
   int (*callback) (const char *str, char * const *matches, size_t matches_num,
       void *user_data);
   void *user_data;
 };
 
+/*
+ * The match set scans strings with an Aho-Corasick automaton built from the
+ * literals of all matches. Bytes are mapped to classes first, so that the
+ * transition table only has one column per byte that occurs in a literal,
+ * plus one for all other bytes.
+ */
+struct cu_match_set_s
+{
+  cu_match_t **matches;
+  size_t matches_num;
+
+  /* Generation in which a match's literal was last seen. */
+  unsigned int *seen;
+  unsigned int generation;
+
+  _Bool dirty;
+  unsigned char classes[256];
+  size_t classes_num;
+  size_t states_num;
+  /* states_num * classes_num transitions */
+  int *transitions;
+  /* First match whose literal ends in a state, or -1. */
+  int *state_match;
+  /* Closest state on the failure path which has matches, or -1. */
+  int *state_output;
+  /* Next match with the same literal, or -1. */
+  int *match_next;
+};
+
 /*
  * Private functions
  */
-static char *match_substr (const char *str, int begin, int end)
+/* Returns a pointer to the character following the bracket expression
+ * starting at `ptr', e.g. "[]a[:digit:]]". */
+static const char *match_skip_bracket (const char *ptr) /* {{{ */
 {
-  char *ret;
-  size_t ret_len;
+  assert (*ptr == '[');
+  ptr++;
 
-  if ((begin < 0) || (end < 0) || (begin >= end))
-    return (NULL);
-  if ((size_t) end > (strlen (str) + 1))
+  if (*ptr == '^')
+    ptr++;
+  if (*ptr == ']')
+    ptr++;
+
+  while ((*ptr != 0) && (*ptr != ']'))
   {
-    ERROR ("utils_match: match_substr: `end' points after end of string.");
-    return (NULL);
+    /* Character classes, collating symbols and equivalence classes. */
+    if ((ptr[0] == '[') && ((ptr[1] == ':') || (ptr[1] == '.')
+          || (ptr[1] == '=')))
+    {
+      char end = ptr[1];
+
+      ptr += 2;
+      while ((*ptr != 0) && !((ptr[0] == end) && (ptr[1] == ']')))
+        ptr++;
+      if (*ptr == 0)
+        break;
+      ptr += 2;
+      continue;
+    }
+    ptr++;
   }
 
-  ret_len = end - begin;
-  ret = (char *) malloc (sizeof (char) * (ret_len + 1));
-  if (ret == NULL)
+  if (*ptr != 0)
+    ptr++;
+  return (ptr);
+} /* }}} const char *match_skip_bracket */
+
+/* Returns a pointer to the character following the parenthesized
+ * subexpression starting at `ptr'. */
+static const char *match_skip_group (const char *ptr) /* {{{ */
+{
+  int depth = 0;
+
+  while (*ptr != 0)
   {
-    ERROR ("utils_match: match_substr: malloc failed.");
-    return (NULL);
+    if (*ptr == '[')
+    {
+      ptr = match_skip_bracket (ptr);
+      continue;
+    }
+
+    if ((*ptr == '\\') && (ptr[1] != 0))
+      ptr++;
+    else if (*ptr == '(')
+      depth++;
+    else if (*ptr == ')')
+    {
+      depth--;
+      if (depth == 0)
+        return (ptr + 1);
+    }
+    ptr++;
+  }
+
+  return (ptr);
+} /* }}} const char *match_skip_group */
+
+/* Returns the longest literal string which every string matched by the
+ * extended regular expression `regex' contains, or NULL. Subexpressions and
+ * characters followed by a quantifier allowing zero repetitions are skipped,
+ * and an alternation at the top level disables the prefilter. */
+static char *match_extract_literal (const char *regex) /* {{{ */
+{
+  char best[256] = "";
+  char cur[256] = "";
+  size_t best_len = 0;
+  size_t cur_len = 0;
+  const char *ptr = regex;
+
+#define FLUSH_LITERAL() do { \
+  if (cur_len > best_len) { \
+    memcpy (best, cur, cur_len); \
+    best[cur_len] = 0; \
+    best_len = cur_len; \
+  } \
+  cur_len = 0; \
+} while (0)
+
+  while (*ptr != 0)
+  {
+    char c = *ptr;
+
+    if (c == '|')
+      return (NULL);
+    else if (c == '(')
+    {
+      FLUSH_LITERAL ();
+      ptr = match_skip_group (ptr);
+      continue;
+    }
+    else if (c == '[')
+    {
+      FLUSH_LITERAL ();
+      ptr = match_skip_bracket (ptr);
+      continue;
+    }
+    else if ((c == '*') || (c == '?') || (c == '{'))
+    {
+      /* The preceding character is optional. */
+      if (cur_len > 0)
+        cur_len--;
+      FLUSH_LITERAL ();
+      if (c == '{')
+        while ((ptr[1] != 0) && (*ptr != '}'))
+          ptr++;
+      ptr++;
+      continue;
+    }
+    else if ((c == '+') || (c == '.') || (c == '^') || (c == '$')
+        || (c == ')'))
+    {
+      FLUSH_LITERAL ();
+      ptr++;
+      continue;
+    }
+    else if (c == '\\')
+    {
+      ptr++;
+      if (*ptr == 0)
+        break;
+
+      /* GNU extensions such as "\w" or "\<" and back-references. */
+      if (isalnum ((unsigned char) *ptr) || (strchr ("<>`'", *ptr) != NULL))
+      {
+        FLUSH_LITERAL ();
+        ptr++;
+        continue;
+      }
+      c = *ptr;
+    }
+
+    if (cur_len < sizeof (cur) - 1)
+      cur[cur_len++] = c;
+    ptr++;
   }
+  FLUSH_LITERAL ();
+
+#undef FLUSH_LITERAL
 
-  sstrncpy (ret, str + begin, ret_len + 1);
-  return (ret);
-} /* char *match_substr */
+  if (best_len < UTILS_MATCH_LITERAL_MIN)
+    return (NULL);
+  return (strdup (best));
+} /* }}} char *match_extract_literal */
 
 static int default_callback (const char __attribute__((unused)) *str,
     char * const *matches, size_t matches_num, void *user_data)
@@ -252,17 +420,21 @@ cu_match_t *match_create_callback (const char *regex, const char *excluderegex,
   }
 
   if (excluderegex && strcmp(excluderegex, "") != 0) {
-    status = regcomp (&obj->excluderegex, excluderegex, REG_EXTENDED);
+    status = regcomp (&obj->excluderegex, excluderegex,
+	REG_EXTENDED | REG_NOSUB);
     if (status != 0)
     {
 	ERROR ("Compiling the excluding regular expression \"%s\" failed.",
 	       excluderegex);
+	regfree (&obj->regex);
 	sfree (obj);
 	return (NULL);
     }
     obj->flags |= UTILS_MATCH_FLAGS_EXCLUDE_REGEX;
   }
 
+  obj->nmatch = UTILS_MATCH_SUBMATCH_MAX;
+  obj->literal = match_extract_literal (regex);
   obj->callback = callback;
   obj->user_data = user_data;
 
@@ -291,6 +463,18 @@ cu_match_t *match_create_simple (const char *regex,
 
   obj->flags |= UTILS_MATCH_FLAGS_FREE_USER_DATA;
 
+  /* The default callback only looks at the first submatch, and not at all
+   * when counting lines. */
+  if (((match_ds_type & UTILS_MATCH_DS_TYPE_GAUGE)
+	&& (match_ds_type & UTILS_MATCH_CF_GAUGE_INC))
+      || ((match_ds_type & UTILS_MATCH_DS_TYPE_COUNTER)
+	&& (match_ds_type & UTILS_MATCH_CF_COUNTER_INC))
+      || ((match_ds_type & UTILS_MATCH_DS_TYPE_DERIVE)
+	&& (match_ds_type & UTILS_MATCH_CF_DERIVE_INC)))
+    obj->nmatch = 1;
+  else
+    obj->nmatch = 2;
+
   return (obj);
 } /* cu_match_t *match_create_simple */
 
@@ -316,15 +500,25 @@ void match_destroy (cu_match_t *obj)
     sfree (obj->user_data);
   }
 
+  regfree (&obj->regex);
+  if (obj->flags & UTILS_MATCH_FLAGS_EXCLUDE_REGEX)
+    regfree (&obj->excluderegex);
+
+  sfree (obj->literal);
   sfree (obj);
 } /* void match_destroy */
 
 int match_apply (cu_match_t *obj, const char *str)
 {
   int status;
-  regmatch_t re_match[32];
-  char *matches[32];
+  regmatch_t re_match[UTILS_MATCH_SUBMATCH_MAX];
+  char *matches[UTILS_MATCH_SUBMATCH_MAX];
   size_t matches_num;
+  /* All (sub-)matches are copied into one buffer, which is only allocated
+   * on the heap if the stack buffer is too small. */
+  char buffer[4096];
+  char *copy = buffer;
+  size_t copy_size = 0;
   size_t i;
 
   if ((obj == NULL) || (str == NULL))
@@ -332,7 +526,7 @@ int match_apply (cu_match_t *obj, const char *str)
 
   if (obj->flags & UTILS_MATCH_FLAGS_EXCLUDE_REGEX) {
     status = regexec (&obj->excluderegex, str,
-		      STATIC_ARRAY_SIZE (re_match), re_match,
+		      /* nmatch = */ 0, /* pmatch = */ NULL,
 		      /* eflags = */ 0);
     /* Regex did match, so exclude this line */
     if (status == 0) {
@@ -342,47 +536,53 @@ int match_apply (cu_match_t *obj, const char *str)
   }
 
   status = regexec (&obj->regex, str,
-      STATIC_ARRAY_SIZE (re_match), re_match,
+      obj->nmatch, re_match,
       /* eflags = */ 0);
 
   /* Regex did not match */
   if (status != 0)
     return (0);
 
-  memset (matches, '\0', sizeof (matches));
-  for (matches_num = 0; matches_num < STATIC_ARRAY_SIZE (matches); matches_num++)
+  for (matches_num = 0; matches_num < obj->nmatch; matches_num++)
   {
     if ((re_match[matches_num].rm_so < 0)
-	|| (re_match[matches_num].rm_eo < 0))
+	|| (re_match[matches_num].rm_eo < re_match[matches_num].rm_so))
       break;
 
-    matches[matches_num] = match_substr (str,
-	re_match[matches_num].rm_so, re_match[matches_num].rm_eo);
-    if (matches[matches_num] == NULL)
-    {
-      status = -1;
-      break;
-    }
+    copy_size += (size_t) (re_match[matches_num].rm_eo
+	- re_match[matches_num].rm_so) + 1;
   }
 
-  if (status != 0)
+  if (copy_size > sizeof (buffer))
   {
-    ERROR ("utils_match: match_apply: match_substr failed.");
-  }
-  else
-  {
-    status = obj->callback (str, matches, matches_num, obj->user_data);
-    if (status != 0)
+    copy = malloc (copy_size);
+    if (copy == NULL)
     {
-      ERROR ("utils_match: match_apply: callback failed.");
+      ERROR ("utils_match: match_apply: malloc failed.");
+      return (-1);
     }
   }
 
+  copy_size = 0;
   for (i = 0; i < matches_num; i++)
   {
-    sfree (matches[i]);
+    size_t len = (size_t) (re_match[i].rm_eo - re_match[i].rm_so);
+
+    matches[i] = copy + copy_size;
+    memcpy (matches[i], str + re_match[i].rm_so, len);
+    matches[i][len] = 0;
+    copy_size += len + 1;
+  }
+
+  status = obj->callback (str, matches, matches_num, obj->user_data);
+  if (status != 0)
+  {
+    ERROR ("utils_match: match_apply: callback failed.");
   }
 
+  if (copy != buffer)
+    sfree (copy);
+
   return (status);
 } /* int match_apply */
 
@@ -393,4 +593,266 @@ void *match_get_user_data (cu_match_t *obj)
   return (obj->user_data);
 } /* void *match_get_user_data */
 
+const char *match_get_literal (cu_match_t *obj)
+{
+  if (obj == NULL)
+    return (NULL);
+  return (obj->literal);
+} /* const char *match_get_literal */
+
+/*
+ * Match sets
+ */
+static void match_set_free_automaton (cu_match_set_t *set) /* {{{ */
+{
+  sfree (set->transitions);
+  sfree (set->state_match);
+  sfree (set->state_output);
+  sfree (set->match_next);
+  set->states_num = 0;
+  set->classes_num = 0;
+} /* }}} void match_set_free_automaton */
+
+static int match_set_build (cu_match_set_t *set) /* {{{ */
+{
+  size_t states_max = 1;
+  size_t i;
+  int *queue;
+  size_t queue_head;
+  size_t queue_tail;
+
+  match_set_free_automaton (set);
+
+  /* Class zero is used for all bytes that don't occur in any literal. */
+  memset (set->classes, 0, sizeof (set->classes));
+  set->classes_num = 1;
+  for (i = 0; i < set->matches_num; i++)
+  {
+    const unsigned char *ptr
+      = (const unsigned char *) set->matches[i]->literal;
+
+    if (ptr == NULL)
+      continue;
+
+    states_max += strlen ((const char *) ptr);
+    for (; *ptr != 0; ptr++)
+      if (set->classes[*ptr] == 0)
+	set->classes[*ptr] = (unsigned char) set->classes_num++;
+  }
+
+  set->transitions = malloc (states_max * set->classes_num
+      * sizeof (*set->transitions));
+  set->state_match = malloc (states_max * sizeof (*set->state_match));
+  set->state_output = malloc (states_max * sizeof (*set->state_output));
+  set->match_next = malloc (set->matches_num * sizeof (*set->match_next));
+  queue = malloc (states_max * sizeof (*queue));
+  if ((set->transitions == NULL) || (set->state_match == NULL)
+      || (set->state_output == NULL) || (set->match_next == NULL)
+      || (queue == NULL))
+  {
+    ERROR ("utils_match: match_set_build: malloc failed.");
+    match_set_free_automaton (set);
+    sfree (queue);
+    return (-1);
+  }
+
+  for (i = 0; i < states_max * set->classes_num; i++)
+    set->transitions[i] = -1;
+  for (i = 0; i < states_max; i++)
+  {
+    set->state_match[i] = -1;
+    set->state_output[i] = -1;
+  }
+
+  /* Build the trie of all literals. */
+  set->states_num = 1;
+  for (i = 0; i < set->matches_num; i++)
+  {
+    const unsigned char *ptr
+      = (const unsigned char *) set->matches[i]->literal;
+    int state = 0;
+
+    set->match_next[i] = -1;
+    if (ptr == NULL)
+      continue;
+
+    for (; *ptr != 0; ptr++)
+    {
+      int *next = set->transitions
+	+ ((size_t) state) * set->classes_num + set->classes[*ptr];
+
+      if (*next < 0)
+	*next = (int) set->states_num++;
+      state = *next;
+    }
+
+    set->match_next[i] = set->state_match[state];
+    set->state_match[state] = (int) i;
+  }
+
+  /* Compute the failure function in breadth-first order and turn the trie
+   * into a deterministic automaton. The failure states are only needed
+   * temporarily and are stored in `state_output' until the outputs are
+   * computed. */
+  queue_head = 0;
+  queue_tail = 0;
+  for (i = 0; i < set->classes_num; i++)
+  {
+    int next = set->transitions[i];
+
+    if (next < 0)
+      set->transitions[i] = 0;
+    else
+    {
+      set->state_output[next] = 0;
+      queue[queue_tail++] = next;
+    }
+  }
+
+  while (queue_head < queue_tail)
+  {
+    int state = queue[queue_head++];
+    int fail = set->state_output[state];
+    int *row = set->transitions + ((size_t) state) * set->classes_num;
+    int *fail_row = set->transitions + ((size_t) fail) * set->classes_num;
+
+    for (i = 0; i < set->classes_num; i++)
+    {
+      if (row[i] < 0)
+	row[i] = fail_row[i];
+      else
+      {
+	set->state_output[row[i]] = fail_row[i];
+	queue[queue_tail++] = row[i];
+      }
+    }
+  }
+
+  /* The queue holds all states but the root in breadth-first order, so the
+   * failure state of each state has been finalized before the state
+   * itself. */
+  for (i = 0; i < queue_tail; i++)
+  {
+    int state = queue[i];
+    int fail = set->state_output[state];
+
+    if (set->state_match[fail] >= 0)
+      set->state_output[state] = fail;
+    else
+      set->state_output[state] = set->state_output[fail];
+  }
+  set->state_output[0] = -1;
+
+  sfree (queue);
+  set->dirty = 0;
+  return (0);
+} /* }}} int match_set_build */
+
+cu_match_set_t *match_set_create (void)
+{
+  cu_match_set_t *set;
+
+  set = calloc (1, sizeof (*set));
+  if (set == NULL)
+    return (NULL);
+
+  return (set);
+} /* cu_match_set_t *match_set_create */
+
+void match_set_destroy (cu_match_set_t *set)
+{
+  if (set == NULL)
+    return;
+
+  match_set_free_automaton (set);
+  sfree (set->matches);
+  sfree (set->seen);
+  sfree (set);
+} /* void match_set_destroy */
+
+int match_set_add (cu_match_set_t *set, cu_match_t *match)
+{
+  cu_match_t **tmp_matches;
+  unsigned int *tmp_seen;
+
+  if ((set == NULL) || (match == NULL))
+    return (-1);
+
+  tmp_matches = realloc (set->matches,
+      (set->matches_num + 1) * sizeof (*set->matches));
+  if (tmp_matches == NULL)
+    return (-1);
+  set->matches = tmp_matches;
+
+  tmp_seen = realloc (set->seen, (set->matches_num + 1) * sizeof (*set->seen));
+  if (tmp_seen == NULL)
+    return (-1);
+  set->seen = tmp_seen;
+
+  set->matches[set->matches_num] = match;
+  set->seen[set->matches_num] = 0;
+  set->matches_num++;
+  set->dirty = 1;
+
+  return (0);
+} /* int match_set_add */
+
+int match_set_apply (cu_match_set_t *set, const char *str)
+{
+  const unsigned char *ptr;
+  int state = 0;
+  int status = 0;
+  size_t i;
+
+  if ((set == NULL) || (str == NULL))
+    return (-1);
+
+  if (set->dirty && (match_set_build (set) != 0))
+  {
+    /* Fall back to trying every match. */
+    for (i = 0; i < set->matches_num; i++)
+      if (match_apply (set->matches[i], str) != 0)
+	status = -1;
+    return (status);
+  }
+
+  set->generation++;
+  if (set->generation == 0)
+  {
+    memset (set->seen, 0, set->matches_num * sizeof (*set->seen));
+    set->generation = 1;
+  }
+
+  for (ptr = (const unsigned char *) str; *ptr != 0; ptr++)
+  {
+    int output;
+
+    state = set->transitions[((size_t) state) * set->classes_num
+      + set->classes[*ptr]];
+
+    output = (set->state_match[state] >= 0)
+      ? state : set->state_output[state];
+    while (output >= 0)
+    {
+      int m;
+
+      for (m = set->state_match[output]; m >= 0; m = set->match_next[m])
+	set->seen[m] = set->generation;
+      output = set->state_output[output];
+    }
+  }
+
+  for (i = 0; i < set->matches_num; i++)
+  {
+    if ((set->matches[i]->literal != NULL)
+	&& (set->seen[i] != set->generation))
+      continue;
+
+    if (match_apply (set->matches[i], str) != 0)
+      status = -1;
+  }
+
+  return (status);
+} /* int match_set_apply */
+
 /* vim: set sw=2 sts=2 ts=8 : */
@@ -65,6 +65,9 @@
 struct cu_match_s;
 typedef struct cu_match_s cu_match_t;
 
+struct cu_match_set_s;
+typedef struct cu_match_set_s cu_match_set_t;
+
 struct cu_match_value_s
 {
   int ds_type;
@@ -170,6 +173,59 @@ int match_apply (cu_match_t *obj, const char *str);
  */
 void *match_get_user_data (cu_match_t *obj);
 
+/*
+ * NAME
+ *  match_get_literal
+ *
+ * DESCRIPTION
+ *  Returns a string which is contained in every string matched by the regular
+ *  expression of `obj', or NULL if no such string of a useful length could be
+ *  determined. The returned string is owned by `obj'.
+ */
+const char *match_get_literal (cu_match_t *obj);
+
+/*
+ * NAME
+ *  match_set_create
+ *
+ * DESCRIPTION
+ *  Creates an empty set of matches. Applying the set to a string is
+ *  equivalent to calling `match_apply' for each match in the order they were
+ *  added, but the string is first scanned once for the literals of all
+ *  matches (see `match_get_literal') and only those regular expressions whose
+ *  literal occurs in the string are executed.
+ *  A set must not be used by more than one thread at a time.
+ */
+cu_match_set_t *match_set_create (void);
+
+/*
+ * NAME
+ *  match_set_destroy
+ *
+ * DESCRIPTION
+ *  Destroys the set. The matches added to it are not destroyed.
+ */
+void match_set_destroy (cu_match_set_t *set);
+
+/*
+ * NAME
+ *  match_set_add
+ *
+ * DESCRIPTION
+ *  Adds `match' to the set.
+ */
+int match_set_add (cu_match_set_t *set, cu_match_t *match);
+
+/*
+ * NAME
+ *  match_set_apply
+ *
+ * DESCRIPTION
+ *  Applies all matches in the set to `str', see `match_apply'. Returns zero
+ *  if all matches succeeded or the status of the last failed match.
+ */
+int match_set_apply (cu_match_set_t *set, const char *str);
+
 #endif /* UTILS_MATCH_H */
 
 /* vim: set sw=2 sts=2 ts=8 : */
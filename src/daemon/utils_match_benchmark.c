@@ -0,0 +1,261 @@
+/**
+ * collectd - src/daemon/utils_match_benchmark.c
+ * Copyright (C) 2026       agent
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   agent <agent at local>
+ */
+
+/*
+ * Compares applying every match to every line, as utils_tail_match used to
+ * do, with the literal prefilter of cu_match_set_t.
+ * Usage: benchmark_utils_match [<lines> | <file>]
+ * Without a file, the given number of synthetic access log lines (default
+ * one million) is generated in memory.
+ */
+
+#include "collectd.h"
+#include "common.h"
+#include "utils_match.h"
+
+static const char *regexes[] = {
+  "\"GET [^\"]* HTTP/1\\.[01]\" 200 ([0-9]+)",
+  "\"POST [^\"]* HTTP/1\\.[01]\" 200 ([0-9]+)",
+  "\"PUT [^\"]* HTTP/1\\.[01]\" ([0-9]+)",
+  "\"DELETE [^\"]* HTTP",
+  "\" 301 ([0-9]+)",
+  "\" 302 ([0-9]+)",
+  "\" 304 ",
+  "\" 400 ",
+  "\" 401 ",
+  "\" 403 ",
+  "\" 404 ([0-9]+)",
+  "\" 500 ",
+  "\" 502 ",
+  "\" 503 ",
+  "\" 504 ",
+  "/api/v1/users/[0-9]+",
+  "/api/v1/orders/[0-9]+",
+  "/api/v2/search\\?q=",
+  "/static/.*\\.css",
+  "/static/.*\\.js",
+  "\\.php(\\?| )",
+  "/wp-login\\.php",
+  "/admin/",
+  "Googlebot",
+  "bingbot",
+  "Baiduspider",
+  "YandexBot",
+  "curl/[0-9.]+",
+  "python-requests/",
+  "Wget/",
+  "Mozilla/5\\.0 \\(Windows NT 10",
+  "Mozilla/5\\.0 \\(Macintosh",
+  "Mozilla/5\\.0 \\(X11; Linux",
+  "Mozilla/5\\.0 \\(iPhone",
+  "Android [0-9]+",
+  "upstream timed out",
+  "connection refused",
+  "SSL_do_handshake\\(\\) failed",
+  "client intended to send too large body",
+  "request_time=([0-9.]+)",
+};
+
+static const char *methods[] = { "GET", "GET", "GET", "POST", "HEAD" };
+static const char *paths[] = {
+  "/", "/index.html", "/static/app.js", "/static/main.css",
+  "/api/v1/users/1234", "/images/logo.png", "/about", "/feed.xml",
+};
+static const int codes[] = { 200, 200, 200, 200, 200, 304, 404, 302 };
+static const char *agents[] = {
+  "Mozilla/5.0 (Windows NT 10.0; Win64; x64)",
+  "Mozilla/5.0 (Macintosh; Intel Mac OS X 10_11_6)",
+  "Mozilla/5.0 (compatible; Googlebot/2.1)",
+  "curl/7.47.0",
+};
+
+static unsigned long match_count;
+
+static int count_callback (const char *str,
+    char * const *matches, size_t matches_num, void *user_data)
+{
+  match_count++;
+  return (0);
+}
+
+static double now (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ((double) ts.tv_sec) + ((double) ts.tv_nsec) / 1e9;
+}
+
+static char **lines_generate (size_t num)
+{
+  char **lines;
+  char buffer[512];
+  size_t i;
+
+  lines = calloc (num + 1, sizeof (*lines));
+  if (lines == NULL)
+    return (NULL);
+
+  srand (42);
+  for (i = 0; i < num; i++)
+  {
+    ssnprintf (buffer, sizeof (buffer),
+        "10.%i.%i.%i - - [19/Oct/2016:13:55:36 +0200] \"%s %s HTTP/1.1\" "
+        "%i %i \"-\" \"%s\"",
+        rand () % 256, rand () % 256, rand () % 256,
+        methods[rand () % STATIC_ARRAY_SIZE (methods)],
+        paths[rand () % STATIC_ARRAY_SIZE (paths)],
+        codes[rand () % STATIC_ARRAY_SIZE (codes)],
+        rand () % 100000,
+        agents[rand () % STATIC_ARRAY_SIZE (agents)]);
+    lines[i] = strdup (buffer);
+    if (lines[i] == NULL)
+      return (NULL);
+  }
+
+  return (lines);
+}
+
+static char **lines_read (const char *file, size_t *ret_num)
+{
+  FILE *fh;
+  char **lines = NULL;
+  size_t num = 0;
+  size_t size = 0;
+  char buffer[4096];
+
+  fh = fopen (file, "r");
+  if (fh == NULL)
+    return (NULL);
+
+  while (fgets (buffer, sizeof (buffer), fh) != NULL)
+  {
+    if (num + 1 >= size)
+    {
+      char **tmp;
+
+      size = (size == 0) ? 1024 : 2 * size;
+      tmp = realloc (lines, size * sizeof (*lines));
+      if (tmp == NULL)
+        break;
+      lines = tmp;
+    }
+    lines[num] = strdup (buffer);
+    if (lines[num] == NULL)
+      break;
+    num++;
+  }
+  fclose (fh);
+
+  if (lines != NULL)
+    lines[num] = NULL;
+  *ret_num = num;
+  return (lines);
+}
+
+int main (int argc, char **argv)
+{
+  cu_match_t *matches[STATIC_ARRAY_SIZE (regexes)];
+  cu_match_set_t *set;
+  char **lines;
+  size_t lines_num = 1000000;
+  size_t literals_num = 0;
+  size_t i;
+  size_t j;
+  double begin;
+  double naive;
+  double prefiltered;
+  unsigned long naive_count;
+
+  if ((argc > 1) && (access (argv[1], R_OK) == 0))
+    lines = lines_read (argv[1], &lines_num);
+  else
+  {
+    if (argc > 1)
+      lines_num = strtoul (argv[1], NULL, 0);
+    lines = lines_generate (lines_num);
+  }
+  if (lines == NULL)
+  {
+    fprintf (stderr, "Reading / generating lines failed.\n");
+    return (1);
+  }
+
+  set = match_set_create ();
+  if (set == NULL)
+    return (1);
+
+  for (i = 0; i < STATIC_ARRAY_SIZE (regexes); i++)
+  {
+    matches[i] = match_create_callback (regexes[i], NULL,
+        count_callback, NULL);
+    if (matches[i] == NULL)
+    {
+      fprintf (stderr, "Compiling \"%s\" failed.\n", regexes[i]);
+      return (1);
+    }
+    if (match_get_literal (matches[i]) != NULL)
+      literals_num++;
+    match_set_add (set, matches[i]);
+  }
+  printf ("%zu lines, %zu matches, %zu with a literal\n",
+      lines_num, STATIC_ARRAY_SIZE (regexes), literals_num);
+
+  match_count = 0;
+  begin = now ();
+  for (j = 0; j < lines_num; j++)
+    for (i = 0; i < STATIC_ARRAY_SIZE (regexes); i++)
+      match_apply (matches[i], lines[j]);
+  naive = now () - begin;
+  naive_count = match_count;
+  printf ("match_apply:     %.3f s, %.0f lines/s, %lu matched\n",
+      naive, ((double) lines_num) / naive, naive_count);
+
+  match_count = 0;
+  begin = now ();
+  for (j = 0; j < lines_num; j++)
+    match_set_apply (set, lines[j]);
+  prefiltered = now () - begin;
+  printf ("match_set_apply: %.3f s, %.0f lines/s, %lu matched\n",
+      prefiltered, ((double) lines_num) / prefiltered, match_count);
+
+  if (match_count != naive_count)
+  {
+    fprintf (stderr, "Number of matches differs!\n");
+    return (1);
+  }
+
+  match_set_destroy (set);
+  for (i = 0; i < STATIC_ARRAY_SIZE (regexes); i++)
+    match_destroy (matches[i]);
+  for (j = 0; j < lines_num; j++)
+    free (lines[j]);
+  free (lines);
+
+  return (0);
+}
+
+/* vim: set sw=2 sts=2 et : */
@@ -0,0 +1,168 @@
+/**
+ * collectd - src/daemon/utils_match_test.c
+ * Copyright (C) 2026       agent
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   agent <agent at local>
+ */
+
+#include "common.h" /* for STATIC_ARRAY_SIZE */
+#include "collectd.h"
+#include "testing.h"
+#include "utils_match.h"
+
+DEF_TEST(literal)
+{
+  struct {
+    const char *regex;
+    const char *want;
+  } cases[] = {
+    {"GET /index.html",               "GET /index"},
+    {"^([0-9]+) bytes sent$",         " bytes sent"},
+    {"status=([0-9]+) user=[a-z]+",   "status="},
+    {"abc*def",                       "def"},
+    {"abcd?ef",                       "abc"},
+    {"abcd+ef",                       "abcd"},
+    {"abcd{2}efgh",                   "efgh"},
+    {"foo\\.bar\\wbaz",               "foo.bar"},
+    {"[]abc[:digit:]]xyzzy",          "xyzzy"},
+    {"(a|b)connection refused",       "connection refused"},
+    {"timeout|connection refused",    NULL},
+    {"a.b.c",                         NULL},
+    {"",                              NULL},
+  };
+  size_t i;
+
+  for (i = 0; i < STATIC_ARRAY_SIZE (cases); i++) {
+    cu_match_t *m;
+
+    CHECK_NOT_NULL (m = match_create_callback (cases[i].regex, NULL,
+          NULL, NULL));
+    if (cases[i].want == NULL)
+      OK1 (match_get_literal (m) == NULL, cases[i].regex);
+    else
+      EXPECT_EQ_STR (cases[i].want, match_get_literal (m));
+    match_destroy (m);
+  }
+
+  return 0;
+}
+
+static int count_callback (const char *str,
+    char * const *matches, size_t matches_num, void *user_data)
+{
+  int *count = user_data;
+
+  (*count)++;
+  return 0;
+}
+
+DEF_TEST(set)
+{
+  const char *regexes[] = {
+    "GET [^ ]* HTTP",
+    "POST",
+    " 404 ",
+    " 5[0-9][0-9] ",
+    "(bot|crawler)",
+    "Mozilla/5\\.0",
+    "\"-\" \"curl/",
+  };
+  const char *lines[] = {
+    "1.2.3.4 - - \"GET /index.html HTTP/1.1\" 200 1024 \"-\" \"Mozilla/5.0\"",
+    "1.2.3.4 - - \"POST /login HTTP/1.1\" 302 0 \"-\" \"curl/7.50\"",
+    "1.2.3.4 - - \"GET /missing HTTP/1.1\" 404 512 \"-\" \"Googlebot\"",
+    "1.2.3.4 - - \"HEAD / HTTP/1.0\" 503 0 \"-\" \"crawler\"",
+    "Mozilla/5x0 GETPOSTGET",
+    "",
+  };
+  cu_match_t *matches[STATIC_ARRAY_SIZE (regexes)];
+  int counts_set[STATIC_ARRAY_SIZE (regexes)] = { 0 };
+  int counts_want[STATIC_ARRAY_SIZE (regexes)] = { 0 };
+  cu_match_set_t *set;
+  size_t i;
+  size_t j;
+
+  CHECK_NOT_NULL (set = match_set_create ());
+  for (i = 0; i < STATIC_ARRAY_SIZE (regexes); i++) {
+    CHECK_NOT_NULL (matches[i] = match_create_callback (regexes[i], NULL,
+          count_callback, counts_set + i));
+    CHECK_ZERO (match_set_add (set, matches[i]));
+  }
+
+  for (j = 0; j < STATIC_ARRAY_SIZE (lines); j++)
+    CHECK_ZERO (match_set_apply (set, lines[j]));
+
+  /* Applying the matches one by one must give the same result. */
+  for (i = 0; i < STATIC_ARRAY_SIZE (regexes); i++) {
+    cu_match_t *m;
+
+    CHECK_NOT_NULL (m = match_create_callback (regexes[i], NULL,
+          count_callback, counts_want + i));
+    for (j = 0; j < STATIC_ARRAY_SIZE (lines); j++)
+      CHECK_ZERO (match_apply (m, lines[j]));
+    match_destroy (m);
+
+    EXPECT_EQ_INT (counts_want[i], counts_set[i]);
+  }
+
+  EXPECT_EQ_INT (2, counts_set[0]);
+  EXPECT_EQ_INT (2, counts_set[1]);
+  EXPECT_EQ_INT (1, counts_set[2]);
+
+  match_set_destroy (set);
+  for (i = 0; i < STATIC_ARRAY_SIZE (regexes); i++)
+    match_destroy (matches[i]);
+
+  return 0;
+}
+
+DEF_TEST(simple)
+{
+  cu_match_t *m;
+  cu_match_value_t *mv;
+
+  CHECK_NOT_NULL (m = match_create_simple ("sent ([0-9]+) bytes",
+        "^DEBUG", UTILS_MATCH_DS_TYPE_DERIVE | UTILS_MATCH_CF_DERIVE_ADD));
+  CHECK_NOT_NULL (mv = match_get_user_data (m));
+
+  CHECK_ZERO (match_apply (m, "INFO sent 100 bytes"));
+  CHECK_ZERO (match_apply (m, "DEBUG sent 1000 bytes"));
+  CHECK_ZERO (match_apply (m, "INFO received 10 bytes"));
+  CHECK_ZERO (match_apply (m, "INFO sent 23 bytes"));
+
+  EXPECT_EQ_INT (2, (int) mv->values_num);
+  EXPECT_EQ_INT (123, (int) mv->value.derive);
+
+  match_destroy (m);
+  return 0;
+}
+
+int main (void)
+{
+  RUN_TEST(literal);
+  RUN_TEST(set);
+  RUN_TEST(simple);
+
+  END_TEST;
+}
+
+/* vim: set sw=2 sts=2 et : */
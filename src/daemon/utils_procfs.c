@@ -0,0 +1,487 @@
+/**
+ * collectd - src/daemon/utils_procfs.c
+ * Copyright (C) 2026       agent
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   agent <agent at local>
+ **/
+
+#include "collectd.h"
+#include "common.h"
+#include "plugin.h"
+#include "utils_procfs.h"
+
+#include <pthread.h>
+
+/* A snapshot and its reference count. The cache holds one reference to its
+ * current snapshot, every user another one. */
+struct procfs_snapshot_s
+{
+  int refcount;
+  struct procfs_cache_s *cache;
+
+  union
+  {
+    procfs_stat_t stat;
+    procfs_netdev_t netdev;
+    procfs_diskstats_t diskstats;
+  } data;
+};
+typedef struct procfs_snapshot_s procfs_snapshot_t;
+
+struct procfs_cache_s
+{
+  char const *path;
+  /* Read if `path' doesn't exist; passed to `parse' as `fallback'. */
+  char const *fallback_path;
+
+  int (*parse) (procfs_snapshot_t *snap, char *buffer, _Bool fallback);
+  void (*free_data) (procfs_snapshot_t *snap);
+
+  pthread_mutex_t lock;
+  procfs_snapshot_t *current;
+  cdtime_t current_time;
+
+  /* Contents of the file; reused for every read. */
+  char *buffer;
+  size_t buffer_size;
+};
+typedef struct procfs_cache_s procfs_cache_t;
+
+/* Makes room for one more element in `*array'. */
+static int procfs_grow (void **array, size_t *array_size, /* {{{ */
+    size_t array_num, size_t elem_size)
+{
+  size_t new_size;
+  void *tmp;
+
+  if (array_num < *array_size)
+    return (0);
+
+  new_size = (*array_size == 0) ? 16 : 2 * (*array_size);
+  tmp = realloc (*array, new_size * elem_size);
+  if (tmp == NULL)
+    return (ENOMEM);
+
+  *array = tmp;
+  *array_size = new_size;
+  return (0);
+} /* }}} int procfs_grow */
+
+static derive_t procfs_atoderive (char const *str) /* {{{ */
+{
+  return ((derive_t) strtoll (str, /* endptr = */ NULL, /* base = */ 10));
+} /* }}} derive_t procfs_atoderive */
+
+int procfs_stat_parse (procfs_stat_t *s, char *buffer) /* {{{ */
+{
+  size_t cpu_size = 0;
+  char *line;
+  char *saveptr = NULL;
+
+  s->cpu = NULL;
+  s->cpu_num = 0;
+  s->have_ctxt = 0;
+  s->have_processes = 0;
+  s->have_swap = 0;
+
+  for (line = strtok_r (buffer, "\n", &saveptr);
+      line != NULL;
+      line = strtok_r (NULL, "\n", &saveptr))
+  {
+    char *fields[PROCFS_CPU_FIELDS_MAX + 1];
+    int fields_num;
+
+    /* The "intr" line is split into the first few fields only. */
+    fields_num = strsplit (line, fields, STATIC_ARRAY_SIZE (fields));
+    if (fields_num < 2)
+      continue;
+
+    if ((strncmp ("cpu", fields[0], 3) == 0)
+        && (fields[0][3] >= '0') && (fields[0][3] <= '9'))
+    {
+      procfs_cpu_t *cpu;
+      int i;
+
+      if (procfs_grow ((void *) &s->cpu, &cpu_size, s->cpu_num,
+            sizeof (*s->cpu)) != 0)
+      {
+        sfree (s->cpu);
+        s->cpu_num = 0;
+        return (ENOMEM);
+      }
+
+      cpu = s->cpu + s->cpu_num;
+      cpu->cpu = atoi (fields[0] + 3);
+      cpu->fields_num = (size_t) (fields_num - 1);
+      for (i = 1; i < fields_num; i++)
+        cpu->fields[i - 1] = procfs_atoderive (fields[i]);
+      s->cpu_num++;
+    }
+    else if ((fields_num == 2) && (strcmp ("ctxt", fields[0]) == 0))
+    {
+      s->have_ctxt = (strtoderive (fields[1], &s->ctxt) == 0);
+    }
+    else if ((fields_num == 2) && (strcmp ("processes", fields[0]) == 0))
+    {
+      s->have_processes = (strtoderive (fields[1], &s->processes) == 0);
+    }
+    else if ((fields_num == 3) && (strcmp ("swap", fields[0]) == 0))
+    {
+      s->have_swap = (strtoderive (fields[1], &s->swap_in) == 0)
+        && (strtoderive (fields[2], &s->swap_out) == 0);
+    }
+  }
+
+  return (0);
+} /* }}} int procfs_stat_parse */
+
+int procfs_netdev_parse (procfs_netdev_t *s, char *buffer) /* {{{ */
+{
+  size_t interface_size = 0;
+  char *line;
+  char *saveptr = NULL;
+
+  s->interface = NULL;
+  s->interface_num = 0;
+
+  for (line = strtok_r (buffer, "\n", &saveptr);
+      line != NULL;
+      line = strtok_r (NULL, "\n", &saveptr))
+  {
+    procfs_interface_t *interface;
+    char *device;
+    char *colon;
+    char *fields[16];
+    int fields_num;
+
+    /* The header lines don't contain a colon. */
+    colon = strchr (line, ':');
+    if (colon == NULL)
+      continue;
+    *colon = 0;
+
+    device = line;
+    while (device[0] == ' ')
+      device++;
+    if (device[0] == 0)
+      continue;
+
+    fields_num = strsplit (colon + 1, fields, STATIC_ARRAY_SIZE (fields));
+    if (fields_num < 12)
+      continue;
+
+    if (procfs_grow ((void *) &s->interface, &interface_size,
+          s->interface_num, sizeof (*s->interface)) != 0)
+    {
+      sfree (s->interface);
+      s->interface_num = 0;
+      return (ENOMEM);
+    }
+
+    interface = s->interface + s->interface_num;
+    sstrncpy (interface->name, device, sizeof (interface->name));
+    interface->rx_bytes   = procfs_atoderive (fields[0]);
+    interface->rx_packets = procfs_atoderive (fields[1]);
+    interface->rx_errors  = procfs_atoderive (fields[2]);
+    interface->rx_dropped = procfs_atoderive (fields[3]);
+    interface->tx_bytes   = procfs_atoderive (fields[8]);
+    interface->tx_packets = procfs_atoderive (fields[9]);
+    interface->tx_errors  = procfs_atoderive (fields[10]);
+    interface->tx_dropped = procfs_atoderive (fields[11]);
+    s->interface_num++;
+  }
+
+  return (0);
+} /* }}} int procfs_netdev_parse */
+
+int procfs_diskstats_parse (procfs_diskstats_t *s, char *buffer) /* {{{ */
+{
+  size_t disk_size = 0;
+  /* /proc/partitions has a "#blocks" column before the name */
+  int name_index = s->partitions ? 3 : 2;
+  char *line;
+  char *saveptr = NULL;
+
+  s->disk = NULL;
+  s->disk_num = 0;
+
+  for (line = strtok_r (buffer, "\n", &saveptr);
+      line != NULL;
+      line = strtok_r (NULL, "\n", &saveptr))
+  {
+    procfs_disk_t *disk;
+    char *fields[PROCFS_DISK_STATS_MAX + 4];
+    int fields_num;
+    int i;
+
+    fields_num = strsplit (line, fields, STATIC_ARRAY_SIZE (fields));
+    if (fields_num <= name_index + 1)
+      continue;
+
+    /* skips the header of /proc/partitions */
+    if ((fields[0][0] < '0') || (fields[0][0] > '9'))
+      continue;
+
+    if (procfs_grow ((void *) &s->disk, &disk_size, s->disk_num,
+          sizeof (*s->disk)) != 0)
+    {
+      sfree (s->disk);
+      s->disk_num = 0;
+      return (ENOMEM);
+    }
+
+    disk = s->disk + s->disk_num;
+    disk->major = (unsigned int) atoi (fields[0]);
+    disk->minor = (unsigned int) atoi (fields[1]);
+    sstrncpy (disk->name, fields[name_index], sizeof (disk->name));
+
+    disk->stats_num = 0;
+    for (i = name_index + 1;
+        (i < fields_num) && (disk->stats_num < PROCFS_DISK_STATS_MAX); i++)
+    {
+      disk->stats[disk->stats_num] = procfs_atoderive (fields[i]);
+      disk->stats_num++;
+    }
+    s->disk_num++;
+  }
+
+  return (0);
+} /* }}} int procfs_diskstats_parse */
+
+static int procfs_stat_parse_cb (procfs_snapshot_t *snap, char *buffer, /* {{{ */
+    _Bool __attribute__((unused)) fallback)
+{
+  return (procfs_stat_parse (&snap->data.stat, buffer));
+} /* }}} int procfs_stat_parse_cb */
+
+static void procfs_stat_free (procfs_snapshot_t *snap) /* {{{ */
+{
+  sfree (snap->data.stat.cpu);
+} /* }}} void procfs_stat_free */
+
+static int procfs_netdev_parse_cb (procfs_snapshot_t *snap, /* {{{ */
+    char *buffer, _Bool __attribute__((unused)) fallback)
+{
+  return (procfs_netdev_parse (&snap->data.netdev, buffer));
+} /* }}} int procfs_netdev_parse_cb */
+
+static void procfs_netdev_free (procfs_snapshot_t *snap) /* {{{ */
+{
+  sfree (snap->data.netdev.interface);
+} /* }}} void procfs_netdev_free */
+
+static int procfs_diskstats_parse_cb (procfs_snapshot_t *snap, /* {{{ */
+    char *buffer, _Bool fallback)
+{
+  snap->data.diskstats.partitions = fallback;
+  return (procfs_diskstats_parse (&snap->data.diskstats, buffer));
+} /* }}} int procfs_diskstats_parse_cb */
+
+static void procfs_diskstats_free (procfs_snapshot_t *snap) /* {{{ */
+{
+  sfree (snap->data.diskstats.disk);
+} /* }}} void procfs_diskstats_free */
+
+static procfs_cache_t stat_cache = {
+  "/proc/stat", NULL,
+  procfs_stat_parse_cb, procfs_stat_free,
+  PTHREAD_MUTEX_INITIALIZER, NULL, 0, NULL, 0
+};
+
+static procfs_cache_t netdev_cache = {
+  "/proc/net/dev", NULL,
+  procfs_netdev_parse_cb, procfs_netdev_free,
+  PTHREAD_MUTEX_INITIALIZER, NULL, 0, NULL, 0
+};
+
+static procfs_cache_t diskstats_cache = {
+  "/proc/diskstats", "/proc/partitions",
+  procfs_diskstats_parse_cb, procfs_diskstats_free,
+  PTHREAD_MUTEX_INITIALIZER, NULL, 0, NULL, 0
+};
+
+/* Reads the whole file into the cache's buffer. Must be called with the
+ * cache locked. Returns an errno value on failure. */
+static int procfs_read_file (procfs_cache_t *c, char const *path) /* {{{ */
+{
+  size_t len = 0;
+  int fd;
+
+  fd = open (path, O_RDONLY);
+  if (fd < 0)
+    return (errno);
+
+  while (42)
+  {
+    ssize_t status;
+
+    if (c->buffer_size - len < 2)
+    {
+      size_t new_size = (c->buffer_size == 0) ? 4096 : 2 * c->buffer_size;
+      char *tmp = realloc (c->buffer, new_size);
+      if (tmp == NULL)
+      {
+        close (fd);
+        return (ENOMEM);
+      }
+      c->buffer = tmp;
+      c->buffer_size = new_size;
+    }
+
+    status = read (fd, c->buffer + len, c->buffer_size - len - 1);
+    if (status < 0)
+    {
+      int status_errno = errno;
+      if (status_errno == EINTR)
+        continue;
+      close (fd);
+      return (status_errno);
+    }
+    else if (status == 0)
+      break;
+
+    len += (size_t) status;
+  }
+
+  close (fd);
+  c->buffer[len] = 0;
+  return (0);
+} /* }}} int procfs_read_file */
+
+static void procfs_unref (procfs_snapshot_t *snap) /* {{{ */
+{
+  snap->refcount--;
+  if (snap->refcount > 0)
+    return;
+
+  snap->cache->free_data (snap);
+  sfree (snap);
+} /* }}} void procfs_unref */
+
+/* Returns a new snapshot of the file. Must be called with the cache locked. */
+static procfs_snapshot_t *procfs_snapshot_read (procfs_cache_t *c, /* {{{ */
+    cdtime_t now)
+{
+  procfs_snapshot_t *snap;
+  _Bool fallback = 0;
+  int status;
+
+  status = procfs_read_file (c, c->path);
+  if ((status == ENOENT) && (c->fallback_path != NULL))
+  {
+    fallback = 1;
+    status = procfs_read_file (c, c->fallback_path);
+  }
+  if (status != 0)
+  {
+    errno = status;
+    return (NULL);
+  }
+
+  snap = calloc (1, sizeof (*snap));
+  if (snap == NULL)
+  {
+    errno = ENOMEM;
+    return (NULL);
+  }
+  snap->refcount = 1;
+  snap->cache = c;
+
+  status = c->parse (snap, c->buffer, fallback);
+  if (status != 0)
+  {
+    sfree (snap);
+    errno = status;
+    return (NULL);
+  }
+
+  /* All snapshot types start with the time. */
+  snap->data.stat.time = now;
+  return (snap);
+} /* }}} procfs_snapshot_t *procfs_snapshot_read */
+
+static void const *procfs_acquire (procfs_cache_t *c) /* {{{ */
+{
+  procfs_snapshot_t *snap;
+  cdtime_t now;
+
+  pthread_mutex_lock (&c->lock);
+
+  /* Plugins reading the file during the same interval share a snapshot.
+   * Concurrent callers wait here and then use the snapshot just read. */
+  now = cdtime ();
+  if ((c->current == NULL)
+      || ((now - c->current_time) >= (plugin_get_interval () / 2)))
+  {
+    snap = procfs_snapshot_read (c, now);
+    if (snap == NULL)
+    {
+      int status = errno;
+      pthread_mutex_unlock (&c->lock);
+      errno = status;
+      return (NULL);
+    }
+
+    if (c->current != NULL)
+      procfs_unref (c->current);
+    c->current = snap;
+    c->current_time = now;
+  }
+
+  snap = c->current;
+  snap->refcount++;
+
+  pthread_mutex_unlock (&c->lock);
+  return (&snap->data);
+} /* }}} void *procfs_acquire */
+
+procfs_stat_t const *procfs_stat_acquire (void) /* {{{ */
+{
+  return (procfs_acquire (&stat_cache));
+} /* }}} procfs_stat_t *procfs_stat_acquire */
+
+procfs_netdev_t const *procfs_netdev_acquire (void) /* {{{ */
+{
+  return (procfs_acquire (&netdev_cache));
+} /* }}} procfs_netdev_t *procfs_netdev_acquire */
+
+procfs_diskstats_t const *procfs_diskstats_acquire (void) /* {{{ */
+{
+  return (procfs_acquire (&diskstats_cache));
+} /* }}} procfs_diskstats_t *procfs_diskstats_acquire */
+
+void procfs_release (void const *snapshot) /* {{{ */
+{
+  procfs_snapshot_t *snap;
+  procfs_cache_t *c;
+
+  if (snapshot == NULL)
+    return;
+
+  snap = (procfs_snapshot_t *) (((char *) snapshot)
+      - offsetof (procfs_snapshot_t, data));
+  c = snap->cache;
+
+  pthread_mutex_lock (&c->lock);
+  procfs_unref (snap);
+  pthread_mutex_unlock (&c->lock);
+} /* }}} void procfs_release */
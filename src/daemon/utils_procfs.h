@@ -0,0 +1,178 @@
+/**
+ * collectd - src/daemon/utils_procfs.h
+ * Copyright (C) 2026       agent
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   agent <agent at local>
+ *
+ * DESCRIPTION
+ *   Parsed snapshots of the Linux statistics files /proc/stat, /proc/net/dev
+ *   and /proc/diskstats, shared by all plugins. Each file is read and parsed
+ *   at most once per interval: plugins asking for the same file during the
+ *   same interval get the same, read-only snapshot. A snapshot records the
+ *   time the file was read, so rates can be calculated against the actual
+ *   sampling time.
+ **/
+
+#ifndef UTILS_PROCFS_H
+#define UTILS_PROCFS_H 1
+
+#include "plugin.h"
+
+/* user, nice, system, idle, iowait, irq, softirq, steal, guest, guest_nice */
+#define PROCFS_CPU_FIELDS_MAX 10
+
+/* One "cpuN" line of /proc/stat. */
+struct procfs_cpu_s
+{
+  int cpu;
+  derive_t fields[PROCFS_CPU_FIELDS_MAX];
+  size_t fields_num;
+};
+typedef struct procfs_cpu_s procfs_cpu_t;
+
+struct procfs_stat_s
+{
+  cdtime_t time;
+
+  /* Per-CPU lines, in the order of the file. The "cpu" sum line is not
+   * included. */
+  procfs_cpu_t *cpu;
+  size_t cpu_num;
+
+  /* "ctxt": context switches since boot */
+  derive_t ctxt;
+  _Bool have_ctxt;
+
+  /* "processes": forks since boot */
+  derive_t processes;
+  _Bool have_processes;
+
+  /* "swap": pages swapped in and out (Linux < 2.6) */
+  derive_t swap_in;
+  derive_t swap_out;
+  _Bool have_swap;
+};
+typedef struct procfs_stat_s procfs_stat_t;
+
+/* One interface of /proc/net/dev. */
+struct procfs_interface_s
+{
+  char name[DATA_MAX_NAME_LEN];
+
+  derive_t rx_bytes;
+  derive_t rx_packets;
+  derive_t rx_errors;
+  derive_t rx_dropped;
+
+  derive_t tx_bytes;
+  derive_t tx_packets;
+  derive_t tx_errors;
+  derive_t tx_dropped;
+};
+typedef struct procfs_interface_s procfs_interface_t;
+
+struct procfs_netdev_s
+{
+  cdtime_t time;
+
+  procfs_interface_t *interface;
+  size_t interface_num;
+};
+typedef struct procfs_netdev_s procfs_netdev_t;
+
+/* The numbers following the device name */
+#define PROCFS_DISK_STATS_MAX 17
+
+/* One device of /proc/diskstats. */
+struct procfs_disk_s
+{
+  unsigned int major;
+  unsigned int minor;
+  char name[DATA_MAX_NAME_LEN];
+
+  /* Four numbers for partitions of Linux 2.6, eleven or more otherwise. */
+  derive_t stats[PROCFS_DISK_STATS_MAX];
+  size_t stats_num;
+};
+typedef struct procfs_disk_s procfs_disk_t;
+
+struct procfs_diskstats_s
+{
+  cdtime_t time;
+
+  /* Set if the data was read from /proc/partitions (Linux 2.4) because
+   * /proc/diskstats doesn't exist. The "#blocks" column is skipped. */
+  _Bool partitions;
+
+  procfs_disk_t *disk;
+  size_t disk_num;
+};
+typedef struct procfs_diskstats_s procfs_diskstats_t;
+
+/*
+ * NAME
+ *   procfs_stat_acquire
+ *   procfs_netdev_acquire
+ *   procfs_diskstats_acquire
+ *
+ * DESCRIPTION
+ *   Returns a snapshot of the file. The file is only read if the most recent
+ *   snapshot is older than half the calling plugin's interval. The snapshot
+ *   must not be modified and must be handed back using `procfs_release'.
+ *
+ * RETURN VALUE
+ *   The snapshot or NULL if reading the file failed. In the latter case
+ *   `errno' is set appropriately.
+ */
+procfs_stat_t const *procfs_stat_acquire (void);
+procfs_netdev_t const *procfs_netdev_acquire (void);
+procfs_diskstats_t const *procfs_diskstats_acquire (void);
+
+/*
+ * NAME
+ *   procfs_release
+ *
+ * DESCRIPTION
+ *   Releases a snapshot returned by one of the `procfs_*_acquire' functions.
+ */
+void procfs_release (void const *snapshot);
+
+/*
+ * NAME
+ *   procfs_stat_parse
+ *   procfs_netdev_parse
+ *   procfs_diskstats_parse
+ *
+ * DESCRIPTION
+ *   Parses the contents of the file, passed in `buffer', into `s'. `buffer'
+ *   is modified. The arrays in `s' are allocated and must be freed by the
+ *   caller; `s->time' is not touched. `procfs_diskstats_parse' expects the
+ *   format of /proc/partitions if `s->partitions' is set.
+ *
+ * RETURN VALUE
+ *   Zero on success, an errno value otherwise.
+ */
+int procfs_stat_parse (procfs_stat_t *s, char *buffer);
+int procfs_netdev_parse (procfs_netdev_t *s, char *buffer);
+int procfs_diskstats_parse (procfs_diskstats_t *s, char *buffer);
+
+#endif /* UTILS_PROCFS_H */
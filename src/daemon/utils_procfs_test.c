@@ -0,0 +1,188 @@
+/**
+ * collectd - src/daemon/utils_procfs_test.c
+ * Copyright (C) 2026       agent
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   agent <agent at local>
+ */
+
+#include "collectd.h"
+#include "common.h"
+#include "testing.h"
+#include "utils_procfs.h"
+
+#if HAVE_LIBKSTAT
+kstat_ctl_t *kc;
+#endif /* HAVE_LIBKSTAT */
+
+/* defined in utils_time.c, built with MOCK_TIME */
+extern cdtime_t cdtime_mock;
+
+DEF_TEST(stat_parse)
+{
+  char buffer[] =
+    "cpu  600 10 300 9000 50 0 20 0 0 0\n"
+    "cpu0 300 5 150 4500 25 0 10 0 0 0\n"
+    "cpu1 300 5 150 4500 25 0 10 0 0 0\n"
+    "intr 123456 42 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0\n"
+    "ctxt 987654321\n"
+    "btime 1450000000\n"
+    "processes 31337\n"
+    "procs_running 2\n"
+    "swap 10 20\n";
+  procfs_stat_t s;
+
+  memset (&s, 0, sizeof (s));
+  CHECK_ZERO (procfs_stat_parse (&s, buffer));
+
+  EXPECT_EQ_INT (2, (int) s.cpu_num);
+  EXPECT_EQ_INT (0, s.cpu[0].cpu);
+  EXPECT_EQ_INT (1, s.cpu[1].cpu);
+  EXPECT_EQ_INT (10, (int) s.cpu[1].fields_num);
+  EXPECT_EQ_UINT64 (300, (uint64_t) s.cpu[1].fields[0]);
+  EXPECT_EQ_UINT64 (4500, (uint64_t) s.cpu[1].fields[3]);
+  EXPECT_EQ_UINT64 (10, (uint64_t) s.cpu[1].fields[6]);
+
+  OK (s.have_ctxt);
+  EXPECT_EQ_UINT64 (987654321, (uint64_t) s.ctxt);
+  OK (s.have_processes);
+  EXPECT_EQ_UINT64 (31337, (uint64_t) s.processes);
+  OK (s.have_swap);
+  EXPECT_EQ_UINT64 (10, (uint64_t) s.swap_in);
+  EXPECT_EQ_UINT64 (20, (uint64_t) s.swap_out);
+
+  sfree (s.cpu);
+  return 0;
+}
+
+DEF_TEST(netdev_parse)
+{
+  char buffer[] =
+    "Inter-|   Receive                                                |  Transmit\n"
+    " face |bytes    packets errs drop fifo frame compressed multicast|bytes    packets errs drop fifo colls carrier compressed\n"
+    "    lo:  123456     100    0    0    0     0          0         0   123456     100    0    0    0     0       0          0\n"
+    "  eth0:98765432   65000    1    2    0     0          0        10 12345678   43000    3    4    0     0       0          0\n";
+  procfs_netdev_t s;
+
+  memset (&s, 0, sizeof (s));
+  CHECK_ZERO (procfs_netdev_parse (&s, buffer));
+
+  EXPECT_EQ_INT (2, (int) s.interface_num);
+  EXPECT_EQ_STR ("lo", s.interface[0].name);
+  EXPECT_EQ_STR ("eth0", s.interface[1].name);
+  EXPECT_EQ_UINT64 (98765432, (uint64_t) s.interface[1].rx_bytes);
+  EXPECT_EQ_UINT64 (65000, (uint64_t) s.interface[1].rx_packets);
+  EXPECT_EQ_UINT64 (1, (uint64_t) s.interface[1].rx_errors);
+  EXPECT_EQ_UINT64 (2, (uint64_t) s.interface[1].rx_dropped);
+  EXPECT_EQ_UINT64 (12345678, (uint64_t) s.interface[1].tx_bytes);
+  EXPECT_EQ_UINT64 (43000, (uint64_t) s.interface[1].tx_packets);
+  EXPECT_EQ_UINT64 (3, (uint64_t) s.interface[1].tx_errors);
+  EXPECT_EQ_UINT64 (4, (uint64_t) s.interface[1].tx_dropped);
+
+  sfree (s.interface);
+  return 0;
+}
+
+DEF_TEST(diskstats_parse)
+{
+  char diskstats[] =
+    "   8       0 sda 1000 20 30000 400 2000 50 60000 700 0 800 1100\n"
+    "   8       1 sda1 900 15000 1900 30000\n";
+  char partitions[] =
+    "major minor  #blocks  name     rio rmerge rsect ruse wio wmerge wsect wuse running use aveq\n"
+    "\n"
+    "   3     0   39082680 hda 1 2 3 4 5 6 7 8 9 10 11\n";
+  procfs_diskstats_t s;
+
+  memset (&s, 0, sizeof (s));
+  CHECK_ZERO (procfs_diskstats_parse (&s, diskstats));
+
+  EXPECT_EQ_INT (2, (int) s.disk_num);
+  EXPECT_EQ_STR ("sda", s.disk[0].name);
+  EXPECT_EQ_INT (8, (int) s.disk[0].major);
+  EXPECT_EQ_INT (0, (int) s.disk[0].minor);
+  EXPECT_EQ_INT (11, (int) s.disk[0].stats_num);
+  EXPECT_EQ_UINT64 (1000, (uint64_t) s.disk[0].stats[0]);
+  EXPECT_EQ_UINT64 (1100, (uint64_t) s.disk[0].stats[10]);
+  EXPECT_EQ_STR ("sda1", s.disk[1].name);
+  EXPECT_EQ_INT (4, (int) s.disk[1].stats_num);
+  EXPECT_EQ_UINT64 (30000, (uint64_t) s.disk[1].stats[3]);
+  sfree (s.disk);
+
+  memset (&s, 0, sizeof (s));
+  s.partitions = 1;
+  CHECK_ZERO (procfs_diskstats_parse (&s, partitions));
+
+  EXPECT_EQ_INT (1, (int) s.disk_num);
+  EXPECT_EQ_STR ("hda", s.disk[0].name);
+  EXPECT_EQ_INT (11, (int) s.disk[0].stats_num);
+  EXPECT_EQ_UINT64 (1, (uint64_t) s.disk[0].stats[0]);
+  EXPECT_EQ_UINT64 (11, (uint64_t) s.disk[0].stats[10]);
+  sfree (s.disk);
+
+  return 0;
+}
+
+#if KERNEL_LINUX
+DEF_TEST(acquire)
+{
+  procfs_stat_t const *s0;
+  procfs_stat_t const *s1;
+  procfs_stat_t const *s2;
+
+  s0 = procfs_stat_acquire ();
+  CHECK_NOT_NULL (s0);
+  OK (s0->cpu_num > 0);
+
+  /* Same interval: the snapshot is shared. */
+  s1 = procfs_stat_acquire ();
+  CHECK_NOT_NULL (s1);
+  OK (s0 == s1);
+  procfs_release (s1);
+
+  /* One interval later the file is read again. The old snapshot stays
+   * valid until it is released. */
+  cdtime_mock += plugin_get_interval ();
+  s2 = procfs_stat_acquire ();
+  CHECK_NOT_NULL (s2);
+  OK (s0 != s2);
+  OK (s2->time > s0->time);
+  OK (s0->cpu_num > 0);
+
+  procfs_release (s0);
+  procfs_release (s2);
+  return 0;
+}
+#endif
+
+int main (void)
+{
+  RUN_TEST(stat_parse);
+  RUN_TEST(netdev_parse);
+  RUN_TEST(diskstats_parse);
+#if KERNEL_LINUX
+  RUN_TEST(acquire);
+#endif
+
+  END_TEST;
+}
+
+/* vim: set sw=2 sts=2 et : */
@@ -32,25 +32,155 @@
 
 #include "collectd.h"
 #include "common.h"
+#include "plugin.h"
 #include "utils_tail.h"
 
+#include <pthread.h>
+#include <poll.h>
+
+#if HAVE_SYS_INOTIFY_H
+# include <sys/inotify.h>
+# define CU_TAIL_NOTIFY_EVENTS (IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF \
+    | IN_DELETE_SELF)
+#endif
+
+/* Lines longer than this are split. */
+#define CU_TAIL_BUFFER_SIZE 65536
+
+/* Without inotify, and while waiting for a rotated file to be replaced, the
+ * background thread checks the file this often (in milliseconds). After an
+ * error it waits ten times as long. */
+#define CU_TAIL_POLL_TIMEOUT 1000
+
 struct cu_tail_s
 {
 	char  *file;
-	FILE  *fh;
+	int    fd;
 	struct stat stat;
+
+	/* Data read from the file but not yet returned. It starts at
+	 * "buffer + buffer_begin" and is "buffer_fill" bytes long. One extra byte
+	 * is allocated so that a line filling the entire buffer can be
+	 * terminated. */
+	char  *buffer;
+	size_t buffer_begin;
+	size_t buffer_fill;
+
+	/* With inotify, the file is only stat'ed after it has been moved or
+	 * deleted instead of every time the end of the file is reached. */
+	int    notify_fd;
+	int    notify_wd;
+	_Bool  moved;
+
+	pthread_t thread;
+	_Bool  thread_running;
+	_Bool  thread_stop;
+	int    thread_wakeup[2];
+	tailfunc_t *thread_callback;
+	void  *thread_data;
 };
 
+static void cu_tail_notify_add (cu_tail_t *obj)
+{
+#if HAVE_SYS_INOTIFY_H
+  if (obj->notify_fd < 0)
+    return;
+
+  if (obj->notify_wd >= 0)
+    inotify_rm_watch (obj->notify_fd, obj->notify_wd);
+
+  obj->notify_wd = inotify_add_watch (obj->notify_fd, obj->file,
+      CU_TAIL_NOTIFY_EVENTS);
+  if (obj->notify_wd < 0)
+  {
+    char errbuf[1024];
+    WARNING ("utils_tail: inotify_add_watch (%s) failed: %s", obj->file,
+	sstrerror (errno, errbuf, sizeof (errbuf)));
+  }
+#endif
+} /* void cu_tail_notify_add */
+
+/* Reads all pending inotify events. Returns the events of the watched file or
+ * -1 if the file is not being watched. */
+static int cu_tail_notify_read (cu_tail_t *obj)
+{
+#if HAVE_SYS_INOTIFY_H
+  char buffer[4096]
+    __attribute__ ((aligned (__alignof__ (struct inotify_event))));
+  int events = 0;
+
+  if (obj->notify_wd < 0)
+    return (-1);
+
+  while (42)
+  {
+    ssize_t len;
+    char *ptr;
+
+    len = read (obj->notify_fd, buffer, sizeof (buffer));
+    if ((len < 0) && (errno == EINTR))
+      continue;
+    if (len <= 0)
+      break;
+
+    for (ptr = buffer; ptr < buffer + len; )
+    {
+      struct inotify_event *ev = (struct inotify_event *) ptr;
+
+      if (ev->wd == obj->notify_wd)
+	events |= (int) ev->mask;
+      ptr += sizeof (*ev) + ev->len;
+    }
+  }
+
+  return (events);
+#else
+  return (-1);
+#endif
+} /* int cu_tail_notify_read */
+
+/* Appends a newline if the buffer ends with an incomplete line, so that the
+ * remainder of a rotated or truncated file is not glued to the next line. */
+static void cu_tail_terminate (cu_tail_t *obj)
+{
+  if (obj->buffer_fill == 0)
+    return;
+  if (obj->buffer[obj->buffer_begin + obj->buffer_fill - 1] == '\n')
+    return;
+
+  if (obj->buffer_begin > 0)
+  {
+    memmove (obj->buffer, obj->buffer + obj->buffer_begin, obj->buffer_fill);
+    obj->buffer_begin = 0;
+  }
+  if (obj->buffer_fill < CU_TAIL_BUFFER_SIZE)
+    obj->buffer[obj->buffer_fill++] = '\n';
+} /* void cu_tail_terminate */
+
+static void cu_tail_close (cu_tail_t *obj)
+{
+  if (obj->fd >= 0)
+    close (obj->fd);
+  obj->fd = -1;
+  cu_tail_terminate (obj);
+} /* void cu_tail_close */
+
+/* Returns 0 if the file was (re)opened or truncated, i.e. there may be more
+ * to read, 1 if nothing changed and -1 on error. */
 static int cu_tail_reopen (cu_tail_t *obj)
 {
   int seek_end = 0;
-  FILE *fh;
+  int fd;
   struct stat stat_buf;
   int status;
 
   memset (&stat_buf, 0, sizeof (stat_buf));
   status = stat (obj->file, &stat_buf);
-  if (status != 0)
+  /* The file has been moved away and not been replaced yet. Keep reading the
+   * old one. */
+  if ((status != 0) && (errno == ENOENT) && (obj->fd >= 0))
+    return (1);
+  else if (status != 0)
   {
     char errbuf[1024];
     ERROR ("utils_tail: stat (%s) failed: %s", obj->file,
@@ -59,24 +189,26 @@ static int cu_tail_reopen (cu_tail_t *obj)
   }
 
   /* The file is already open.. */
-  if ((obj->fh != NULL) && (stat_buf.st_ino == obj->stat.st_ino))
+  if ((obj->fd >= 0) && (stat_buf.st_ino == obj->stat.st_ino))
   {
+    memcpy (&obj->stat, &stat_buf, sizeof (struct stat));
+    obj->moved = 0;
+
     /* Seek to the beginning if file was truncated */
-    if (stat_buf.st_size < obj->stat.st_size)
+    if (stat_buf.st_size < lseek (obj->fd, 0, SEEK_CUR))
     {
       INFO ("utils_tail: File `%s' was truncated.", obj->file);
-      status = fseek (obj->fh, 0, SEEK_SET);
-      if (status != 0)
+      if (lseek (obj->fd, 0, SEEK_SET) != 0)
       {
 	char errbuf[1024];
-	ERROR ("utils_tail: fseek (%s) failed: %s", obj->file,
+	ERROR ("utils_tail: lseek (%s) failed: %s", obj->file,
 	    sstrerror (errno, errbuf, sizeof (errbuf)));
-	fclose (obj->fh);
-	obj->fh = NULL;
+	cu_tail_close (obj);
 	return (-1);
       }
+      cu_tail_terminate (obj);
+      return (0);
     }
-    memcpy (&obj->stat, &stat_buf, sizeof (struct stat));
     return (1);
   }
 
@@ -85,35 +217,199 @@ static int cu_tail_reopen (cu_tail_t *obj)
   if ((obj->stat.st_ino == 0) || (obj->stat.st_ino == stat_buf.st_ino))
     seek_end = 1;
 
-  fh = fopen (obj->file, "r");
-  if (fh == NULL)
+  fd = open (obj->file, O_RDONLY);
+  if (fd < 0)
   {
     char errbuf[1024];
-    ERROR ("utils_tail: fopen (%s) failed: %s", obj->file,
+    ERROR ("utils_tail: open (%s) failed: %s", obj->file,
 	sstrerror (errno, errbuf, sizeof (errbuf)));
     return (-1);
   }
 
-  if (seek_end != 0)
+  if ((seek_end != 0) && (lseek (fd, 0, SEEK_END) < 0))
   {
-    status = fseek (fh, 0, SEEK_END);
-    if (status != 0)
+    char errbuf[1024];
+    ERROR ("utils_tail: lseek (%s) failed: %s", obj->file,
+	sstrerror (errno, errbuf, sizeof (errbuf)));
+    close (fd);
+    return (-1);
+  }
+
+  cu_tail_close (obj);
+  obj->fd = fd;
+  memcpy (&obj->stat, &stat_buf, sizeof (struct stat));
+  obj->moved = 0;
+  cu_tail_notify_add (obj);
+
+  return (0);
+} /* int cu_tail_reopen */
+
+/* Called when the end of the file has been reached. Returns 0 if there may be
+ * more to read, 1 if not and -1 on error. */
+static int cu_tail_check (cu_tail_t *obj)
+{
+#if HAVE_SYS_INOTIFY_H
+  int events;
+
+  events = cu_tail_notify_read (obj);
+  if (events > 0)
+  {
+    if ((events & (IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF)) != 0)
+      obj->moved = 1;
+  }
+
+  if ((events >= 0) && !obj->moved)
+  {
+    struct stat stat_buf;
+
+    if (events == 0)
+      return (1);
+
+    /* The file has been modified. Data appended after the last read(2) will
+     * be picked up by the caller's next attempt; only truncation needs to be
+     * handled here. */
+    if ((fstat (obj->fd, &stat_buf) == 0)
+	&& (stat_buf.st_size < lseek (obj->fd, 0, SEEK_CUR)))
+      return (cu_tail_reopen (obj));
+    return (0);
+  }
+#endif
+
+  return (cu_tail_reopen (obj));
+} /* int cu_tail_check */
+
+/* Reads as much data as fits into the buffer. Returns the number of bytes
+ * read, zero at the end of the file and -1 on error. */
+static ssize_t cu_tail_fill (cu_tail_t *obj)
+{
+  ssize_t status;
+
+  if (obj->buffer_begin > 0)
+  {
+    memmove (obj->buffer, obj->buffer + obj->buffer_begin, obj->buffer_fill);
+    obj->buffer_begin = 0;
+  }
+
+  do
+  {
+    status = read (obj->fd, obj->buffer + obj->buffer_fill,
+	CU_TAIL_BUFFER_SIZE - obj->buffer_fill);
+  } while ((status < 0) && (errno == EINTR));
+
+  if (status > 0)
+    obj->buffer_fill += (size_t) status;
+  return (status);
+} /* ssize_t cu_tail_fill */
+
+/* Takes the next line, including its newline character, from the buffer.
+ * Lines longer than "max_len" are split. Returns NULL if the buffer doesn't
+ * hold a complete line. */
+static char *cu_tail_line (cu_tail_t *obj, size_t max_len, size_t *ret_len)
+{
+  char *begin = obj->buffer + obj->buffer_begin;
+  char *end;
+  size_t len;
+
+  if (obj->buffer_fill == 0)
+    return (NULL);
+
+  end = memchr (begin, '\n', obj->buffer_fill);
+  if (end != NULL)
+    len = (size_t) (end - begin) + 1;
+  else if (obj->buffer_fill >= max_len)
+    len = max_len;
+  else
+    return (NULL);
+
+  if (len > max_len)
+    len = max_len;
+
+  obj->buffer_begin += len;
+  obj->buffer_fill -= len;
+  if (obj->buffer_fill == 0)
+    obj->buffer_begin = 0;
+
+  *ret_len = len;
+  return (begin);
+} /* char *cu_tail_line */
+
+/* Makes sure the next line is in the buffer. Returns 0 on success, 1 at the
+ * end of the file and -1 on error. */
+static int cu_tail_next (cu_tail_t *obj, size_t max_len,
+    char **ret_line, size_t *ret_len)
+{
+  int status;
+
+  if (obj->fd < 0)
+  {
+    status = cu_tail_reopen (obj);
+    if (status < 0)
+      return (status);
+  }
+
+  while (42)
+  {
+    ssize_t len;
+
+    *ret_line = cu_tail_line (obj, max_len, ret_len);
+    if (*ret_line != NULL)
+      return (0);
+
+    if (obj->fd < 0)
+      return (1);
+
+    len = cu_tail_fill (obj);
+    if (len > 0)
+      continue;
+    else if (len < 0)
     {
       char errbuf[1024];
-      ERROR ("utils_tail: fseek (%s) failed: %s", obj->file,
+      WARNING ("utils_tail: read (%s) failed: %s", obj->file,
 	  sstrerror (errno, errbuf, sizeof (errbuf)));
-      fclose (fh);
-      return (-1);
+      /* Force `cu_tail_reopen' to reopen the file.. */
+      cu_tail_close (obj);
+      status = cu_tail_reopen (obj);
     }
+    else
+      status = cu_tail_check (obj);
+
+    if (status != 0)
+      return (status);
   }
+} /* int cu_tail_next */
 
-  if (obj->fh != NULL)
-    fclose (obj->fh);
-  obj->fh = fh;
-  memcpy (&obj->stat, &stat_buf, sizeof (struct stat));
+static void *cu_tail_thread (void *arg)
+{
+  cu_tail_t *obj = arg;
 
-  return (0);
-} /* int cu_tail_reopen */
+  while (!obj->thread_stop)
+  {
+    struct pollfd fds[2];
+    nfds_t fds_num = 0;
+    int timeout = CU_TAIL_POLL_TIMEOUT;
+    int status;
+
+    status = cu_tail_read (obj, obj->thread_callback, obj->thread_data);
+
+    fds[fds_num].fd = obj->thread_wakeup[0];
+    fds[fds_num].events = POLLIN;
+    fds_num++;
+
+    if (status != 0)
+      timeout = 10 * CU_TAIL_POLL_TIMEOUT;
+    else if ((obj->notify_wd >= 0) && !obj->moved)
+    {
+      fds[fds_num].fd = obj->notify_fd;
+      fds[fds_num].events = POLLIN;
+      fds_num++;
+      timeout = -1;
+    }
+
+    poll (fds, fds_num, timeout);
+  }
+
+  return ((void *) 0);
+} /* void *cu_tail_thread */
 
 cu_tail_t *cu_tail_create (const char *file)
 {
@@ -125,21 +421,57 @@ cu_tail_t *cu_tail_create (const char *file)
 	memset (obj, '\0', sizeof (cu_tail_t));
 
 	obj->file = strdup (file);
-	if (obj->file == NULL)
+	obj->buffer = malloc (CU_TAIL_BUFFER_SIZE + 1);
+	if ((obj->file == NULL) || (obj->buffer == NULL))
 	{
+		sfree (obj->file);
+		sfree (obj->buffer);
 		free (obj);
 		return (NULL);
 	}
 
-	obj->fh = NULL;
+	obj->fd = -1;
+	obj->notify_wd = -1;
+	obj->thread_wakeup[0] = -1;
+	obj->thread_wakeup[1] = -1;
+
+#if HAVE_SYS_INOTIFY_H
+	obj->notify_fd = inotify_init1 (IN_NONBLOCK | IN_CLOEXEC);
+	if (obj->notify_fd < 0)
+	{
+		char errbuf[1024];
+		INFO ("utils_tail: inotify_init1 failed, falling back to "
+				"polling `%s': %s", obj->file,
+				sstrerror (errno, errbuf, sizeof (errbuf)));
+	}
+#else
+	obj->notify_fd = -1;
+#endif
 
 	return (obj);
 } /* cu_tail_t *cu_tail_create */
 
 int cu_tail_destroy (cu_tail_t *obj)
 {
-	if (obj->fh != NULL)
-		fclose (obj->fh);
+	if (obj->thread_running)
+	{
+		obj->thread_stop = 1;
+		if (write (obj->thread_wakeup[1], "", 1) < 0)
+		{
+			/* The thread will notice within CU_TAIL_POLL_TIMEOUT. */
+		}
+		pthread_join (obj->thread, NULL);
+	}
+	if (obj->thread_wakeup[0] >= 0)
+		close (obj->thread_wakeup[0]);
+	if (obj->thread_wakeup[1] >= 0)
+		close (obj->thread_wakeup[1]);
+
+	if (obj->fd >= 0)
+		close (obj->fd);
+	if (obj->notify_fd >= 0)
+		close (obj->notify_fd);
+	free (obj->buffer);
 	free (obj->file);
 	free (obj);
 
@@ -148,6 +480,8 @@ int cu_tail_destroy (cu_tail_t *obj)
 
 int cu_tail_readline (cu_tail_t *obj, char *buf, int buflen)
 {
+  char *line;
+  size_t len;
   int status;
 
   if (buflen < 1)
@@ -157,104 +491,94 @@ int cu_tail_readline (cu_tail_t *obj, char *buf, int buflen)
     return (-1);
   }
 
-  if (obj->fh == NULL)
-  {
-    status = cu_tail_reopen (obj);
-    if (status < 0)
-      return (status);
-  }
-  assert (obj->fh != NULL);
-
-  /* Try to read from the filehandle. If that succeeds, everything appears to
-   * be fine and we can return. */
-  clearerr (obj->fh);
-  if (fgets (buf, buflen, obj->fh) != NULL)
-  {
-    buf[buflen - 1] = 0;
-    return (0);
-  }
-
-  /* Check if we encountered an error */
-  if (ferror (obj->fh) != 0)
-  {
-    /* Jupp, error. Force `cu_tail_reopen' to reopen the file.. */
-    fclose (obj->fh);
-    obj->fh = NULL;
-  }
-  /* else: eof -> check if the file was moved away and reopen the new file if
-   * so.. */
-
-  status = cu_tail_reopen (obj);
-  /* error -> return with error */
+  status = cu_tail_next (obj, (size_t) buflen - 1, &line, &len);
   if (status < 0)
     return (status);
-  /* file end reached and file not reopened -> nothing more to read */
   else if (status > 0)
   {
+    /* EOF */
     buf[0] = 0;
     return (0);
   }
 
-  /* If we get here: file was re-opened and there may be more to read.. Let's
-   * try again. */
-  if (fgets (buf, buflen, obj->fh) != NULL)
-  {
-    buf[buflen - 1] = 0;
-    return (0);
-  }
-
-  if (ferror (obj->fh) != 0)
-  {
-    char errbuf[1024];
-    WARNING ("utils_tail: fgets (%s) returned an error: %s", obj->file,
-	sstrerror (errno, errbuf, sizeof (errbuf)));
-    fclose (obj->fh);
-    obj->fh = NULL;
-    return (-1);
-  }
-
-  /* EOf, well, apparently the new file is empty.. */
-  buf[0] = 0;
+  memcpy (buf, line, len);
+  buf[len] = 0;
   return (0);
 } /* int cu_tail_readline */
 
-int cu_tail_read (cu_tail_t *obj, char *buf, int buflen, tailfunc_t *callback,
-		void *data)
+int cu_tail_read (cu_tail_t *obj, tailfunc_t *callback, void *data)
 {
 	int status;
 
-	while (42)
+	while (!obj->thread_stop)
 	{
+		char *line;
 		size_t len;
 
-		status = cu_tail_readline (obj, buf, buflen);
-		if (status != 0)
+		status = cu_tail_next (obj, CU_TAIL_BUFFER_SIZE, &line, &len);
+		if (status < 0)
 		{
-			ERROR ("utils_tail: cu_tail_read: cu_tail_readline "
-					"failed.");
-			break;
+			ERROR ("utils_tail: cu_tail_read: reading `%s' failed.",
+					obj->file);
+			return (status);
 		}
-
-		/* check for EOF */
-		if (buf[0] == 0)
+		else if (status > 0) /* EOF */
 			break;
 
-		len = strlen (buf);
-		while (len > 0) {
-			if (buf[len - 1] != '\n')
-				break;
-			buf[len - 1] = '\0';
+		/* Terminate the line in place, replacing the newline. There is
+		 * always room for one more byte, see cu_tail_s. */
+		if (line[len - 1] == '\n')
 			len--;
-		}
+		line[len] = 0;
 
-		status = callback (data, buf, buflen);
+		status = callback (data, line, (int) len + 1);
 		if (status != 0)
 		{
 			ERROR ("utils_tail: cu_tail_read: callback returned "
 					"status %i.", status);
-			break;
+			return (status);
 		}
 	}
 
-	return status;
+	return (0);
 } /* int cu_tail_read */
+
+int cu_tail_start (cu_tail_t *obj, tailfunc_t *callback, void *data)
+{
+	int status;
+
+	if (obj->thread_running)
+		return (EBUSY);
+
+	if (pipe (obj->thread_wakeup) != 0)
+	{
+		char errbuf[1024];
+		ERROR ("utils_tail: pipe failed: %s",
+				sstrerror (errno, errbuf, sizeof (errbuf)));
+		return (-1);
+	}
+
+	obj->thread_callback = callback;
+	obj->thread_data = data;
+	obj->thread_stop = 0;
+
+	/* Open the file now, so that lines written after this function returns
+	 * are not skipped. Errors are reported by the thread. */
+	if (obj->fd < 0)
+		cu_tail_reopen (obj);
+
+	status = plugin_thread_create (&obj->thread, NULL, cu_tail_thread, obj);
+	if (status != 0)
+	{
+		ERROR ("utils_tail: Starting a thread for `%s' failed.",
+				obj->file);
+		close (obj->thread_wakeup[0]);
+		close (obj->thread_wakeup[1]);
+		obj->thread_wakeup[0] = -1;
+		obj->thread_wakeup[1] = -1;
+		return (status);
+	}
+	obj->thread_running = 1;
+
+	return (0);
+} /* int cu_tail_start */
@@ -76,13 +76,30 @@ int cu_tail_destroy (cu_tail_t *obj);
 int cu_tail_readline (cu_tail_t *obj, char *buf, int buflen);
 
 /*
- * cu_tail_readline
+ * cu_tail_read
+ *
+ * Reads from the file until eof condition or an error is encountered and
+ * calls `callback' for each line. The file is read in large blocks; `buf'
+ * points into the internal buffer, the newline has been removed and
+ * `buflen' is the size of the string including the terminating null byte.
+ * Lines longer than 64 KiB are split.
+ *
+ * Returns 0 when successful and non-zero otherwise.
+ */
+int cu_tail_read (cu_tail_t *obj, tailfunc_t *callback, void *data);
+
+/*
+ * cu_tail_start
  *
- * Reads from the file until eof condition or an error is encountered.
+ * Starts a thread which reads the file continuously, calling `callback' for
+ * each line as soon as it has been written. Where inotify is available, the
+ * thread sleeps until the file is modified, moved or deleted; otherwise it
+ * checks the file once a second. The thread is stopped by
+ * `cu_tail_destroy'. Do not call `cu_tail_read' or `cu_tail_readline' on the
+ * object once the thread is running.
  *
  * Returns 0 when successful and non-zero otherwise.
  */
-int cu_tail_read (cu_tail_t *obj, char *buf, int buflen, tailfunc_t *callback,
-		void *data);
+int cu_tail_start (cu_tail_t *obj, tailfunc_t *callback, void *data);
 
 #endif /* UTILS_TAIL_H */
@@ -36,6 +36,8 @@
 #include "utils_tail.h"
 #include "utils_tail_match.h"
 
+#include <pthread.h>
+
 struct cu_tail_match_simple_s
 {
   char plugin[DATA_MAX_NAME_LEN];
@@ -63,6 +65,11 @@ struct cu_tail_match_s
   cdtime_t interval;
   cu_tail_match_match_t *matches;
   size_t matches_num;
+  cu_match_set_t *match_set;
+
+  /* Serializes matching in the background thread with submitting. */
+  pthread_mutex_t lock;
+  _Bool background;
 };
 
 /*
@@ -111,10 +118,10 @@ static int tail_callback (void *data, char *buf,
     int __attribute__((unused)) buflen)
 {
   cu_tail_match_t *obj = (cu_tail_match_t *) data;
-  size_t i;
 
-  for (i = 0; i < obj->matches_num; i++)
-    match_apply (obj->matches[i].match, buf);
+  pthread_mutex_lock (&obj->lock);
+  match_set_apply (obj->match_set, buf);
+  pthread_mutex_unlock (&obj->lock);
 
   return (0);
 } /* int tail_callback */
@@ -138,6 +145,16 @@ cu_tail_match_t *tail_match_create (const char *filename)
     return (NULL);
   }
 
+  obj->match_set = match_set_create ();
+  if (obj->match_set == NULL)
+  {
+    cu_tail_destroy (obj->tail);
+    sfree (obj);
+    return (NULL);
+  }
+
+  pthread_mutex_init (&obj->lock, /* attr = */ NULL);
+
   return (obj);
 } /* cu_tail_match_t *tail_match_create */
 
@@ -169,6 +186,8 @@ void tail_match_destroy (cu_tail_match_t *obj)
     match->user_data = NULL;
   }
 
+  match_set_destroy (obj->match_set);
+  pthread_mutex_destroy (&obj->lock);
   sfree (obj->matches);
   sfree (obj);
 } /* void tail_match_destroy */
@@ -185,6 +204,12 @@ int tail_match_add_match (cu_tail_match_t *obj, cu_match_t *match,
   if (temp == NULL)
     return (-1);
 
+  if (match_set_add (obj->match_set, match) != 0)
+  {
+    obj->matches = temp;
+    return (-1);
+  }
+
   obj->matches = temp;
   obj->matches_num++;
 
@@ -244,20 +269,38 @@ int tail_match_add_match_simple (cu_tail_match_t *obj,
   return (status);
 } /* int tail_match_add_match_simple */
 
-int tail_match_read (cu_tail_match_t *obj)
+int tail_match_start (cu_tail_match_t *obj)
 {
-  char buffer[4096];
   int status;
-  size_t i;
 
-  status = cu_tail_read (obj->tail, buffer, sizeof (buffer), tail_callback,
-      (void *) obj);
+  status = cu_tail_start (obj->tail, tail_callback, (void *) obj);
   if (status != 0)
   {
-    ERROR ("tail_match: cu_tail_read failed.");
+    ERROR ("tail_match: cu_tail_start failed.");
     return (status);
   }
 
+  obj->background = 1;
+  return (0);
+} /* int tail_match_start */
+
+int tail_match_read (cu_tail_match_t *obj)
+{
+  int status;
+  size_t i;
+
+  /* In the background the file is read as it is written. */
+  if (!obj->background)
+  {
+    status = cu_tail_read (obj->tail, tail_callback, (void *) obj);
+    if (status != 0)
+    {
+      ERROR ("tail_match: cu_tail_read failed.");
+      return (status);
+    }
+  }
+
+  pthread_mutex_lock (&obj->lock);
   for (i = 0; i < obj->matches_num; i++)
   {
     cu_tail_match_match_t *lt_match = obj->matches + i;
@@ -267,6 +310,7 @@ int tail_match_read (cu_tail_match_t *obj)
 
     (*lt_match->submit) (lt_match->match, lt_match->user_data);
   }
+  pthread_mutex_unlock (&obj->lock);
 
   return (0);
 } /* int tail_match_read */
@@ -112,6 +112,22 @@ int tail_match_add_match_simple (cu_tail_match_t *obj,
     const char *plugin, const char *plugin_instance,
     const char *type, const char *type_instance, const cdtime_t interval);
 
+/*
+ * NAME
+ *   tail_match_start
+ *
+ * DESCRIPTION
+ *   Starts a thread which reads and matches new lines as soon as they are
+ *   written to the logfile, see `cu_tail_start'. `tail_match_read' then only
+ *   calls the submit_match callbacks, so values are still aggregated over the
+ *   read interval. All matches must have been added before calling this
+ *   function.
+ *
+ * RETURN VALUE
+ *   Zero on success, nonzero on failure.
+ */
+int tail_match_start (cu_tail_match_t *obj);
+
 /*
  * NAME
  *   tail_match_read
@@ -0,0 +1,207 @@
+/**
+ * collectd - src/daemon/utils_tail_test.c
+ * Copyright (C) 2026       agent
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   agent <agent at local>
+ */
+
+#include "collectd.h"
+#include "common.h"
+#include "testing.h"
+#include "utils_tail.h"
+
+#include <pthread.h>
+
+static char dir[] = "/tmp/test_utils_tail.XXXXXX";
+static char file[sizeof (dir) + 16];
+
+static void append (const char *path, const char *str)
+{
+  FILE *fh = fopen (path, "a");
+  if (fh == NULL)
+    return;
+  fputs (str, fh);
+  fclose (fh);
+}
+
+static char lines[16][128];
+static int lines_num;
+static pthread_mutex_t lines_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int lines_callback (void *data, char *buf, int buflen)
+{
+  pthread_mutex_lock (&lines_lock);
+  if (lines_num < (int) STATIC_ARRAY_SIZE (lines))
+    sstrncpy (lines[lines_num], buf, sizeof (lines[lines_num]));
+  lines_num++;
+  pthread_mutex_unlock (&lines_lock);
+
+  return ((buflen == (int) strlen (buf) + 1) ? 0 : -1);
+}
+
+static int lines_wait (int num)
+{
+  int i;
+
+  for (i = 0; i < 500; i++)
+  {
+    int n;
+
+    pthread_mutex_lock (&lines_lock);
+    n = lines_num;
+    pthread_mutex_unlock (&lines_lock);
+
+    if (n >= num)
+      return (n);
+    usleep (10000);
+  }
+
+  return (-1);
+}
+
+DEF_TEST(readline)
+{
+  cu_tail_t *t;
+  char buf[8];
+
+  append (file, "old content is skipped\n");
+  CHECK_NOT_NULL (t = cu_tail_create (file));
+
+  CHECK_ZERO (cu_tail_readline (t, buf, sizeof (buf)));
+  EXPECT_EQ_STR ("", buf);
+
+  append (file, "one\ntwo\nlong line\nab");
+  CHECK_ZERO (cu_tail_readline (t, buf, sizeof (buf)));
+  EXPECT_EQ_STR ("one\n", buf);
+  CHECK_ZERO (cu_tail_readline (t, buf, sizeof (buf)));
+  EXPECT_EQ_STR ("two\n", buf);
+  /* Lines longer than the buffer are split. */
+  CHECK_ZERO (cu_tail_readline (t, buf, sizeof (buf)));
+  EXPECT_EQ_STR ("long li", buf);
+  CHECK_ZERO (cu_tail_readline (t, buf, sizeof (buf)));
+  EXPECT_EQ_STR ("ne\n", buf);
+  /* Incomplete lines are held back until the newline has been written. */
+  CHECK_ZERO (cu_tail_readline (t, buf, sizeof (buf)));
+  EXPECT_EQ_STR ("", buf);
+
+  append (file, "c\n");
+  CHECK_ZERO (cu_tail_readline (t, buf, sizeof (buf)));
+  EXPECT_EQ_STR ("abc\n", buf);
+  CHECK_ZERO (cu_tail_readline (t, buf, sizeof (buf)));
+  EXPECT_EQ_STR ("", buf);
+
+  cu_tail_destroy (t);
+  unlink (file);
+  return (0);
+}
+
+DEF_TEST(rotate)
+{
+  char rotated[sizeof (file) + 2];
+  cu_tail_t *t;
+
+  ssnprintf (rotated, sizeof (rotated), "%s.1", file);
+  append (file, "");
+  CHECK_NOT_NULL (t = cu_tail_create (file));
+  CHECK_ZERO (cu_tail_read (t, lines_callback, NULL));
+
+  lines_num = 0;
+  append (file, "first\n");
+  CHECK_ZERO (cu_tail_read (t, lines_callback, NULL));
+  EXPECT_EQ_INT (1, lines_num);
+  EXPECT_EQ_STR ("first", lines[0]);
+
+  /* The rest of the old file is read before switching to the new one. An
+   * incomplete last line is returned as it is. */
+  append (file, "second\nlast");
+  CHECK_ZERO (rename (file, rotated));
+  append (file, "new\n");
+  CHECK_ZERO (cu_tail_read (t, lines_callback, NULL));
+  EXPECT_EQ_INT (4, lines_num);
+  EXPECT_EQ_STR ("second", lines[1]);
+  EXPECT_EQ_STR ("last", lines[2]);
+  EXPECT_EQ_STR ("new", lines[3]);
+
+  /* Truncation is noticed once the file is smaller than the read position. */
+  CHECK_ZERO (truncate (file, 0));
+  CHECK_ZERO (cu_tail_read (t, lines_callback, NULL));
+  append (file, "truncated\n");
+  CHECK_ZERO (cu_tail_read (t, lines_callback, NULL));
+  EXPECT_EQ_INT (5, lines_num);
+  EXPECT_EQ_STR ("truncated", lines[4]);
+
+  cu_tail_destroy (t);
+  unlink (file);
+  unlink (rotated);
+  return (0);
+}
+
+DEF_TEST(thread)
+{
+  cu_tail_t *t;
+
+  append (file, "");
+  CHECK_NOT_NULL (t = cu_tail_create (file));
+
+  lines_num = 0;
+  CHECK_ZERO (cu_tail_start (t, lines_callback, NULL));
+  EXPECT_EQ_INT (EBUSY, cu_tail_start (t, lines_callback, NULL));
+
+  append (file, "hello\n");
+  EXPECT_EQ_INT (1, lines_wait (1));
+  append (file, "world\n");
+  EXPECT_EQ_INT (2, lines_wait (2));
+
+  pthread_mutex_lock (&lines_lock);
+  EXPECT_EQ_STR ("hello", lines[0]);
+  EXPECT_EQ_STR ("world", lines[1]);
+  pthread_mutex_unlock (&lines_lock);
+
+  /* Also after the file has been replaced. */
+  CHECK_ZERO (unlink (file));
+  append (file, "again\n");
+  EXPECT_EQ_INT (3, lines_wait (3));
+  EXPECT_EQ_STR ("again", lines[2]);
+
+  cu_tail_destroy (t);
+  unlink (file);
+  return (0);
+}
+
+int main (void)
+{
+  if (mkdtemp (dir) == NULL)
+  {
+    printf ("Bail out! mkdtemp failed.\n");
+    return (1);
+  }
+  ssnprintf (file, sizeof (file), "%s/log", dir);
+
+  RUN_TEST(readline);
+  RUN_TEST(rotate);
+  RUN_TEST(thread);
+
+  rmdir (dir);
+  END_TEST;
+}
+
+/* vim: set sw=2 sts=2 et : */
@@ -118,44 +118,34 @@ static const char *cdbi_strerror (dbi_conn conn, /* {{{ */
   return (buffer);
 } /* }}} const char *cdbi_conn_error */
 
+/* Numbers are passed to the db query interface as such, without formatting
+ * them as strings. Strings point into "res" and are valid until the next row
+ * is fetched. */
 static int cdbi_result_get_field (dbi_result res, /* {{{ */
-    unsigned int index, char *buffer, size_t buffer_size)
+    unsigned int index, unsigned short src_type, udb_column_t *column)
 {
-  unsigned short src_type;
-
-  src_type = dbi_result_get_field_type_idx (res, index);
-  if (src_type == DBI_TYPE_ERROR)
-  {
-    ERROR ("dbi plugin: cdbi_result_get: "
-        "dbi_result_get_field_type_idx failed.");
-    return (-1);
-  }
-
   if (src_type == DBI_TYPE_INTEGER)
   {
-    long long value;
-
-    value = dbi_result_get_longlong_idx (res, index);
-    ssnprintf (buffer, buffer_size, "%lli", value);
+    column->type = UDB_COLUMN_INTEGER;
+    column->value.integer = (int64_t) dbi_result_get_longlong_idx (res, index);
   }
   else if (src_type == DBI_TYPE_DECIMAL)
   {
-    double value;
-
-    value = dbi_result_get_double_idx (res, index);
-    ssnprintf (buffer, buffer_size, "%63.15g", value);
+    column->type = UDB_COLUMN_DOUBLE;
+    column->value.number = dbi_result_get_double_idx (res, index);
   }
   else if (src_type == DBI_TYPE_STRING)
   {
     const char *value;
-    
+
     value = dbi_result_get_string_idx (res, index);
     if (value == NULL)
-      sstrncpy (buffer, "", buffer_size);
+      value = "";
     else if (strcmp ("ERROR", value) == 0)
       return (-1);
-    else
-      sstrncpy (buffer, value, buffer_size);
+
+    column->type = UDB_COLUMN_STRING;
+    column->value.string = value;
   }
   /* DBI_TYPE_BINARY */
   /* DBI_TYPE_DATETIME */
@@ -498,7 +488,9 @@ static int cdbi_read_database_query (cdbi_database_t *db, /* {{{ */
   dbi_result res;
   size_t column_num;
   char **column_names;
-  char **column_values;
+  unsigned short *column_types;
+  udb_column_t *columns;
+  cdtime_t begin;
   int status;
   size_t i;
 
@@ -506,17 +498,20 @@ static int cdbi_read_database_query (cdbi_database_t *db, /* {{{ */
    * specified status. */
 #define BAIL_OUT(status) \
   if (column_names != NULL) { sfree (column_names[0]); sfree (column_names); } \
-  if (column_values != NULL) { sfree (column_values[0]); sfree (column_values); } \
+  sfree (column_types); \
+  sfree (columns); \
   if (res != NULL) { dbi_result_free (res); res = NULL; } \
   return (status)
 
   column_names = NULL;
-  column_values = NULL;
+  column_types = NULL;
+  columns = NULL;
   res = NULL;
 
   statement = udb_query_get_statement (q);
   assert (statement != NULL);
 
+  begin = cdtime ();
   res = dbi_conn_query (db->connection, statement);
   if (res == NULL)
   {
@@ -547,7 +542,7 @@ static int cdbi_read_database_query (cdbi_database_t *db, /* {{{ */
         db->name, udb_query_get_name (q), column_num);
   }
 
-  /* Allocate `column_names' and `column_values'. {{{ */
+  /* Allocate `column_names', `column_types' and `columns'. {{{ */
   column_names = (char **) calloc (column_num, sizeof (char *));
   if (column_names == NULL)
   {
@@ -565,25 +560,16 @@ static int cdbi_read_database_query (cdbi_database_t *db, /* {{{ */
   for (i = 1; i < column_num; i++)
     column_names[i] = column_names[i - 1] + DATA_MAX_NAME_LEN;
 
-  column_values = (char **) calloc (column_num, sizeof (char *));
-  if (column_values == NULL)
+  column_types = calloc (column_num, sizeof (*column_types));
+  columns = calloc (column_num, sizeof (*columns));
+  if ((column_types == NULL) || (columns == NULL))
   {
     ERROR ("dbi plugin: malloc failed.");
     BAIL_OUT (-1);
   }
-
-  column_values[0] = (char *) calloc (column_num,
-      DATA_MAX_NAME_LEN * sizeof (char));
-  if (column_values[0] == NULL)
-  {
-    ERROR ("dbi plugin: malloc failed.");
-    BAIL_OUT (-1);
-  }
-  for (i = 1; i < column_num; i++)
-    column_values[i] = column_values[i - 1] + DATA_MAX_NAME_LEN;
   /* }}} */
 
-  /* Copy the field names to `column_names' */
+  /* Copy the field names to `column_names' and look up the field types. */
   for (i = 0; i < column_num; i++) /* {{{ */
   {
     const char *column_name;
@@ -598,6 +584,16 @@ static int cdbi_read_database_query (cdbi_database_t *db, /* {{{ */
     }
 
     sstrncpy (column_names[i], column_name, DATA_MAX_NAME_LEN);
+
+    column_types[i] = dbi_result_get_field_type_idx (res,
+        (unsigned int) (i + 1));
+    if (column_types[i] == DBI_TYPE_ERROR)
+    {
+      ERROR ("dbi plugin: cdbi_read_database_query (%s, %s): "
+          "dbi_result_get_field_type_idx (%zu) failed.",
+          db->name, udb_query_get_name (q), i + 1);
+      BAIL_OUT (-1);
+    }
   } /* }}} for (i = 0; i < column_num; i++) */
 
   udb_query_prepare_result (q, prep_area, (db->host ? db->host : hostname_g),
@@ -623,11 +619,11 @@ static int cdbi_read_database_query (cdbi_database_t *db, /* {{{ */
   while (42) /* {{{ */
   {
     status = 0;
-    /* Copy the value of the columns to `column_values' */
+    /* Fetch the value of the columns into `columns' */
     for (i = 0; i < column_num; i++) /* {{{ */
     {
       status = cdbi_result_get_field (res, (unsigned int) (i + 1),
-          column_values[i], DATA_MAX_NAME_LEN);
+          column_types[i], columns + i);
 
       if (status != 0)
       {
@@ -643,7 +639,7 @@ static int cdbi_read_database_query (cdbi_database_t *db, /* {{{ */
      * to dispatch the row to the daemon. */
     if (status == 0) /* {{{ */
     {
-      status = udb_query_handle_result (q, prep_area, column_values);
+      status = udb_query_handle_result_columns (q, prep_area, columns);
       if (status != 0)
       {
         ERROR ("dbi plugin: cdbi_read_database_query (%s, %s): "
@@ -669,6 +665,7 @@ static int cdbi_read_database_query (cdbi_database_t *db, /* {{{ */
   } /* }}} while (42) */
 
   /* Tell the db query interface that we're done with this query. */
+  udb_query_submit_stats (q, prep_area, cdtime () - begin);
   udb_query_finish_result (q, prep_area);
 
   /* Clean up and return `status = 0' (success) */
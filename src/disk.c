@@ -85,6 +85,8 @@ static _Bool use_bsd_name = 0;
 /* #endif HAVE_IOKIT_IOKITLIB_H */
 
 #elif KERNEL_LINUX
+# include "utils_procfs.h"
+
 typedef struct diskstats
 {
 	char *name;
@@ -110,6 +112,25 @@ typedef struct diskstats
 } diskstats_t;
 
 static diskstats_t *disklist;
+
+/* If possible, the statistics are read from sysfs: /sys/block/<disk>/stat and
+ * /sys/block/<disk>/<partition>/stat are opened once and re-read using
+ * pread(2) every interval. /proc/diskstats is used otherwise. */
+#define DISK_SYSFS_DIR "/sys/block"
+/* Look for added and removed devices every this many reads. */
+#define DISK_SYSFS_RESCAN 60
+
+struct disk_sysfs_s
+{
+	int fd;
+	procfs_disk_t disk;
+};
+typedef struct disk_sysfs_s disk_sysfs_t;
+
+static disk_sysfs_t *sysfs_devs = NULL;
+static size_t sysfs_devs_num = 0;
+static unsigned int sysfs_reads = 0;
+static _Bool sysfs_unavailable = 0;
 /* #endif KERNEL_LINUX */
 #elif KERNEL_FREEBSD
 static struct gmesh geom_tree;
@@ -268,9 +289,11 @@ static int disk_init (void)
 	return (0);
 } /* int disk_init */
 
+/* `t' is the time the counters were read or zero for "now". */
 static void disk_submit (const char *plugin_instance,
 		const char *type,
-		derive_t read, derive_t write)
+		derive_t read, derive_t write,
+		cdtime_t t)
 {
 	value_t values[2];
 	value_list_t vl = VALUE_LIST_INIT;
@@ -284,6 +307,7 @@ static void disk_submit (const char *plugin_instance,
 
 	vl.values = values;
 	vl.values_len = 2;
+	vl.time = t;
 	sstrncpy (vl.host, hostname_g, sizeof (vl.host));
 	sstrncpy (vl.plugin, "disk", sizeof (vl.plugin));
 	sstrncpy (vl.plugin_instance, plugin_instance,
@@ -294,7 +318,8 @@ static void disk_submit (const char *plugin_instance,
 } /* void disk_submit */
 
 #if KERNEL_LINUX
-static void submit_in_progress (char const *disk_name, gauge_t in_progress)
+static void submit_in_progress (char const *disk_name, gauge_t in_progress,
+		cdtime_t t)
 {
 	value_t v;
 	value_list_t vl = VALUE_LIST_INIT;
@@ -306,6 +331,7 @@ static void submit_in_progress (char const *disk_name, gauge_t in_progress)
 
 	vl.values = &v;
 	vl.values_len = 1;
+	vl.time = t;
 	sstrncpy (vl.host, hostname_g, sizeof (vl.host));
 	sstrncpy (vl.plugin, "disk", sizeof (vl.plugin));
 	sstrncpy (vl.plugin_instance, disk_name, sizeof (vl.plugin_instance));
@@ -314,7 +340,8 @@ static void submit_in_progress (char const *disk_name, gauge_t in_progress)
 	plugin_dispatch_values (&vl);
 }
 
-static void submit_io_time (char const *plugin_instance, derive_t io_time, derive_t weighted_time)
+static void submit_io_time (char const *plugin_instance, derive_t io_time, derive_t weighted_time,
+		cdtime_t t)
 {
 	value_t values[2];
 	value_list_t vl = VALUE_LIST_INIT;
@@ -327,6 +354,7 @@ static void submit_io_time (char const *plugin_instance, derive_t io_time, deriv
 
 	vl.values = values;
 	vl.values_len = 2;
+	vl.time = t;
 	sstrncpy (vl.host, hostname_g, sizeof (vl.host));
 	sstrncpy (vl.plugin, "disk", sizeof (vl.plugin));
 	sstrncpy (vl.plugin_instance, plugin_instance, sizeof (vl.plugin_instance));
@@ -335,6 +363,163 @@ static void submit_io_time (char const *plugin_instance, derive_t io_time, deriv
 	plugin_dispatch_values (&vl);
 }
 
+static void disk_sysfs_close (void)
+{
+	size_t i;
+
+	for (i = 0; i < sysfs_devs_num; i++)
+		close (sysfs_devs[i].fd);
+	sfree (sysfs_devs);
+	sysfs_devs_num = 0;
+} /* void disk_sysfs_close */
+
+static int disk_sysfs_add (char const *path, char const *name)
+{
+	disk_sysfs_t *tmp;
+	char *c;
+	int fd;
+
+	fd = open (path, O_RDONLY);
+	if (fd < 0)
+		return (-1);
+
+	tmp = realloc (sysfs_devs, (sysfs_devs_num + 1) * sizeof (*sysfs_devs));
+	if (tmp == NULL)
+	{
+		close (fd);
+		return (-1);
+	}
+	sysfs_devs = tmp;
+
+	tmp = sysfs_devs + sysfs_devs_num;
+	memset (tmp, 0, sizeof (*tmp));
+	tmp->fd = fd;
+	sstrncpy (tmp->disk.name, name, sizeof (tmp->disk.name));
+
+	/* sysfs replaces the slash of names like "cciss/c0d0" with a bang. */
+	for (c = tmp->disk.name; *c != 0; c++)
+		if (*c == '!')
+			*c = '/';
+
+	sysfs_devs_num++;
+	return (0);
+} /* int disk_sysfs_add */
+
+static int disk_sysfs_scan (void)
+{
+	DIR *dh;
+	struct dirent *de;
+
+	disk_sysfs_close ();
+	sysfs_reads = 0;
+
+	dh = opendir (DISK_SYSFS_DIR);
+	if (dh == NULL)
+	{
+		sysfs_unavailable = 1;
+		return (-1);
+	}
+
+	while ((de = readdir (dh)) != NULL)
+	{
+		char path[PATH_MAX];
+		DIR *part_dh;
+		struct dirent *part_de;
+		size_t name_len;
+
+		if (de->d_name[0] == '.')
+			continue;
+
+		ssnprintf (path, sizeof (path), DISK_SYSFS_DIR "/%s/stat",
+				de->d_name);
+		if (disk_sysfs_add (path, de->d_name) != 0)
+			continue;
+
+		/* Partitions are sub-directories named after the disk, e.g.
+		 * "sda1" or "nvme0n1p1". */
+		ssnprintf (path, sizeof (path), DISK_SYSFS_DIR "/%s", de->d_name);
+		part_dh = opendir (path);
+		if (part_dh == NULL)
+			continue;
+
+		name_len = strlen (de->d_name);
+		while ((part_de = readdir (part_dh)) != NULL)
+		{
+			if ((strncmp (de->d_name, part_de->d_name, name_len) != 0)
+					|| (part_de->d_name[name_len] == 0))
+				continue;
+
+			ssnprintf (path, sizeof (path), DISK_SYSFS_DIR "/%s/%s/stat",
+					de->d_name, part_de->d_name);
+			disk_sysfs_add (path, part_de->d_name);
+		}
+		closedir (part_dh);
+	}
+	closedir (dh);
+
+	return ((sysfs_devs_num > 0) ? 0 : -1);
+} /* int disk_sysfs_scan */
+
+/* Reads the statistics of all devices found in sysfs. Returns non-zero if
+ * sysfs can't be used. */
+static int disk_sysfs_read (cdtime_t *ret_time)
+{
+	_Bool rescan = 0;
+	size_t i;
+
+	if (sysfs_unavailable)
+		return (-1);
+
+	if ((sysfs_devs_num == 0) || (sysfs_reads >= DISK_SYSFS_RESCAN))
+		if (disk_sysfs_scan () != 0)
+			return (-1);
+	sysfs_reads++;
+
+	*ret_time = cdtime ();
+	for (i = 0; i < sysfs_devs_num; i++)
+	{
+		procfs_disk_t *d = &sysfs_devs[i].disk;
+		char buffer[512];
+		char *ptr;
+		ssize_t status;
+
+		d->stats_num = 0;
+
+		status = pread (sysfs_devs[i].fd, buffer, sizeof (buffer) - 1, 0);
+		if (status <= 0)
+		{
+			/* The device has most likely been removed. */
+			rescan = 1;
+			continue;
+		}
+		buffer[status] = 0;
+
+		ptr = buffer;
+		while (d->stats_num < PROCFS_DISK_STATS_MAX)
+		{
+			char *endptr = NULL;
+			unsigned long long value;
+
+			value = strtoull (ptr, &endptr, 10);
+			if (endptr == ptr)
+				break;
+
+			d->stats[d->stats_num] = (derive_t) value;
+			d->stats_num++;
+			ptr = endptr;
+		}
+
+		/* Linux 4.18 and later append discard and flush statistics. Only
+		 * the eleven fields found in all versions are used. */
+		if (d->stats_num > 11)
+			d->stats_num = 11;
+	}
+
+	if (rescan)
+		sysfs_reads = DISK_SYSFS_RESCAN;
+
+	return (0);
+} /* int disk_sysfs_read */
 
 static counter_t disk_calc_time_incr (counter_t delta_time, counter_t delta_ops)
 {
@@ -517,11 +702,11 @@ static int disk_read (void)
 		/* and submit */
 		DEBUG ("disk plugin: disk_name = \"%s\"", disk_name);
 		if ((read_byt != -1LL) || (write_byt != -1LL))
-			disk_submit (disk_name, "disk_octets", read_byt, write_byt);
+			disk_submit (disk_name, "disk_octets", read_byt, write_byt, 0);
 		if ((read_ops != -1LL) || (write_ops != -1LL))
-			disk_submit (disk_name, "disk_ops", read_ops, write_ops);
+			disk_submit (disk_name, "disk_ops", read_ops, write_ops, 0);
 		if ((read_tme != -1LL) || (write_tme != -1LL))
-			disk_submit (disk_name, "disk_time", read_tme / 1000, write_tme / 1000);
+			disk_submit (disk_name, "disk_time", read_tme / 1000, write_tme / 1000, 0);
 
 	}
 	IOObjectRelease (disk_list);
@@ -616,33 +801,30 @@ static int disk_read (void)
 		if ((snap_iter->bytes[DEVSTAT_READ] != 0) || (snap_iter->bytes[DEVSTAT_WRITE] != 0)) {
 			disk_submit(disk_name, "disk_octets",
 					(derive_t)snap_iter->bytes[DEVSTAT_READ],
-					(derive_t)snap_iter->bytes[DEVSTAT_WRITE]);
+					(derive_t)snap_iter->bytes[DEVSTAT_WRITE], 0);
 		}
 
 		if ((snap_iter->operations[DEVSTAT_READ] != 0) || (snap_iter->operations[DEVSTAT_WRITE] != 0)) {
 			disk_submit(disk_name, "disk_ops",
 					(derive_t)snap_iter->operations[DEVSTAT_READ],
-					(derive_t)snap_iter->operations[DEVSTAT_WRITE]);
+					(derive_t)snap_iter->operations[DEVSTAT_WRITE], 0);
 		}
 
 		read_time = devstat_compute_etime(&snap_iter->duration[DEVSTAT_READ], NULL);
 		write_time = devstat_compute_etime(&snap_iter->duration[DEVSTAT_WRITE], NULL);
 		if ((read_time != 0) || (write_time != 0)) {
 			disk_submit (disk_name, "disk_time",
-					(derive_t)(read_time*1000), (derive_t)(write_time*1000));
+					(derive_t)(read_time*1000), (derive_t)(write_time*1000), 0);
 		}
 	}
 	geom_stats_snapshot_free(snap);
 
 #elif KERNEL_LINUX
-	FILE *fh;
-	char buffer[1024];
-	
-	char *fields[32];
-	int numfields;
-	int fieldshift = 0;
-
-	int minor = 0;
+	procfs_diskstats_t const *snap = NULL;
+	size_t disks_num;
+	_Bool partitions = 0;
+	cdtime_t t;
+	size_t i;
 
 	derive_t read_sectors  = 0;
 	derive_t write_sectors = 0;
@@ -660,36 +842,41 @@ static int disk_read (void)
 
 	diskstats_t *ds, *pre_ds;
 
-	if ((fh = fopen ("/proc/diskstats", "r")) == NULL)
+	if (disk_sysfs_read (&t) == 0)
+	{
+		disks_num = sysfs_devs_num;
+	}
+	else
 	{
-		fh = fopen ("/proc/partitions", "r");
-		if (fh == NULL)
+		snap = procfs_diskstats_acquire ();
+		if (snap == NULL)
 		{
-			ERROR ("disk plugin: fopen (/proc/{diskstats,partitions}) failed.");
+			ERROR ("disk plugin: Reading /proc/{diskstats,partitions} failed.");
 			return (-1);
 		}
-
-		/* Kernel is 2.4.* */
-		fieldshift = 1;
+		disks_num = snap->disk_num;
+		partitions = snap->partitions;
+		t = snap->time;
 	}
 
 #if HAVE_LIBUDEV
 	handle_udev = udev_new();
 #endif
 
-	while (fgets (buffer, sizeof (buffer), fh) != NULL)
+	for (i = 0; i < disks_num; i++)
 	{
-		char *disk_name;
-		char *output_name;
-
-		numfields = strsplit (buffer, fields, 32);
-
-		if ((numfields != (14 + fieldshift)) && (numfields != 7))
+		procfs_disk_t const *d = (snap != NULL)
+			? snap->disk + i : &sysfs_devs[i].disk;
+		char const *disk_name;
+		char const *output_name;
+
+		/* Only the Linux 2.6 partition format and the classic eleven
+		 * statistics are understood. */
+		if ((d->stats_num != 11)
+				&& ((d->stats_num != 4) || partitions))
 			continue;
 
-		minor = atoll (fields[1]);
-
-		disk_name = fields[2 + fieldshift];
+		disk_name = d->name;
 
 		for (ds = disklist, pre_ds = disklist; ds != NULL; pre_ds = ds, ds = ds->next)
 			if (strcmp (disk_name, ds->name) == 0)
@@ -713,41 +900,36 @@ static int disk_read (void)
 		}
 
 		is_disk = 0;
-		if (numfields == 7)
+		if (d->stats_num == 4)
 		{
 			/* Kernel 2.6, Partition */
-			read_ops      = atoll (fields[3]);
-			read_sectors  = atoll (fields[4]);
-			write_ops     = atoll (fields[5]);
-			write_sectors = atoll (fields[6]);
+			read_ops      = d->stats[0];
+			read_sectors  = d->stats[1];
+			write_ops     = d->stats[2];
+			write_sectors = d->stats[3];
 		}
-		else if (numfields == (14 + fieldshift))
+		else
 		{
-			read_ops  =  atoll (fields[3 + fieldshift]);
-			write_ops =  atoll (fields[7 + fieldshift]);
+			read_ops  = d->stats[0];
+			write_ops = d->stats[4];
 
-			read_sectors  = atoll (fields[5 + fieldshift]);
-			write_sectors = atoll (fields[9 + fieldshift]);
+			read_sectors  = d->stats[2];
+			write_sectors = d->stats[6];
 
-			if ((fieldshift == 0) || (minor == 0))
+			if (!partitions || (d->minor == 0))
 			{
 				is_disk = 1;
-				read_merged  = atoll (fields[4 + fieldshift]);
-				read_time    = atoll (fields[6 + fieldshift]);
-				write_merged = atoll (fields[8 + fieldshift]);
-				write_time   = atoll (fields[10+ fieldshift]);
+				read_merged  = d->stats[1];
+				read_time    = d->stats[3];
+				write_merged = d->stats[5];
+				write_time   = d->stats[7];
 
-				in_progress = atof (fields[11 + fieldshift]);
+				in_progress = (gauge_t) d->stats[8];
 
-				io_time       = atof (fields[12 + fieldshift]);
-				weighted_time = atof (fields[13 + fieldshift]);
+				io_time       = d->stats[9];
+				weighted_time = d->stats[10];
 			}
 		}
-		else
-		{
-			DEBUG ("numfields = %i; => unknown file format.", numfields);
-			continue;
-		}
 
 		{
 			derive_t diff_read_sectors;
@@ -847,35 +1029,35 @@ static int disk_read (void)
 
 		if ((ds->read_bytes != 0) || (ds->write_bytes != 0))
 			disk_submit (output_name, "disk_octets",
-					ds->read_bytes, ds->write_bytes);
+					ds->read_bytes, ds->write_bytes, t);
 
 		if ((ds->read_ops != 0) || (ds->write_ops != 0))
 			disk_submit (output_name, "disk_ops",
-					read_ops, write_ops);
+					read_ops, write_ops, t);
 
 		if ((ds->avg_read_time != 0) || (ds->avg_write_time != 0))
 			disk_submit (output_name, "disk_time",
-					ds->avg_read_time, ds->avg_write_time);
+					ds->avg_read_time, ds->avg_write_time, t);
 
 		if (is_disk)
 		{
 			disk_submit (output_name, "disk_merged",
-					read_merged, write_merged);
-			submit_in_progress (output_name, in_progress);
-			submit_io_time (output_name, io_time, weighted_time);
+					read_merged, write_merged, t);
+			submit_in_progress (output_name, in_progress, t);
+			submit_io_time (output_name, io_time, weighted_time, t);
 		} /* if (is_disk) */
 
 #if HAVE_LIBUDEV
 		/* release udev-based alternate name, if allocated */
 		sfree (alt_name);
 #endif
-	} /* while (fgets (buffer, sizeof (buffer), fh) != NULL) */
+	} /* for (i = 0; i < disks_num; i++) */
 
 #if HAVE_LIBUDEV
 	udev_unref(handle_udev);
 #endif
 
-	fclose (fh);
+	procfs_release (snap);
 /* #endif defined(KERNEL_LINUX) */
 
 #elif HAVE_LIBKSTAT
@@ -910,19 +1092,19 @@ static int disk_read (void)
 		if (strncmp (ksp[i]->ks_class, "disk", 4) == 0)
 		{
 			disk_submit (ksp[i]->ks_name, "disk_octets",
-					kio.KIO_ROCTETS, kio.KIO_WOCTETS);
+					kio.KIO_ROCTETS, kio.KIO_WOCTETS, 0);
 			disk_submit (ksp[i]->ks_name, "disk_ops",
-					kio.KIO_ROPS, kio.KIO_WOPS);
+					kio.KIO_ROPS, kio.KIO_WOPS, 0);
 			/* FIXME: Convert this to microseconds if necessary */
 			disk_submit (ksp[i]->ks_name, "disk_time",
-					kio.KIO_RTIME, kio.KIO_WTIME);
+					kio.KIO_RTIME, kio.KIO_WTIME, 0);
 		}
 		else if (strncmp (ksp[i]->ks_class, "partition", 9) == 0)
 		{
 			disk_submit (ksp[i]->ks_name, "disk_octets",
-					kio.KIO_ROCTETS, kio.KIO_WOCTETS);
+					kio.KIO_ROCTETS, kio.KIO_WOCTETS, 0);
 			disk_submit (ksp[i]->ks_name, "disk_ops",
-					kio.KIO_ROPS, kio.KIO_WOPS);
+					kio.KIO_ROPS, kio.KIO_WOPS, 0);
 		}
 	}
 /* #endif defined(HAVE_LIBKSTAT) */
@@ -943,7 +1125,7 @@ static int disk_read (void)
 	for (counter=0; counter < disks; counter++) {
 		strncpy(name, ds->disk_name, sizeof(name));
 		name[sizeof(name)-1] = '\0'; /* strncpy doesn't terminate longer strings */
-		disk_submit (name, "disk_octets", ds->read_bytes, ds->write_bytes);
+		disk_submit (name, "disk_octets", ds->read_bytes, ds->write_bytes, 0);
 		ds++;
 	}
 /* #endif defined(HAVE_LIBSTATGRAB) */
@@ -987,27 +1169,38 @@ static int disk_read (void)
 	{
 		read_sectors = stat_disk[i].rblks*stat_disk[i].bsize;
 		write_sectors = stat_disk[i].wblks*stat_disk[i].bsize;
-		disk_submit (stat_disk[i].name, "disk_octets", read_sectors, write_sectors);
+		disk_submit (stat_disk[i].name, "disk_octets", read_sectors, write_sectors, 0);
 
 		read_ops = stat_disk[i].xrate;
 		write_ops = stat_disk[i].xfers - stat_disk[i].xrate;
-		disk_submit (stat_disk[i].name, "disk_ops", read_ops, write_ops);
+		disk_submit (stat_disk[i].name, "disk_ops", read_ops, write_ops, 0);
 
 		read_time = stat_disk[i].rserv;
 		read_time *= ((double)(_system_configuration.Xint)/(double)(_system_configuration.Xfrac)) / 1000000.0;
 		write_time = stat_disk[i].wserv;
 		write_time *= ((double)(_system_configuration.Xint)/(double)(_system_configuration.Xfrac)) / 1000000.0;
-		disk_submit (stat_disk[i].name, "disk_time", read_time, write_time);
+		disk_submit (stat_disk[i].name, "disk_time", read_time, write_time, 0);
 	}
 #endif /* defined(HAVE_PERFSTAT) */
 
 	return (0);
 } /* int disk_read */
 
+#if KERNEL_LINUX
+static int disk_shutdown (void)
+{
+	disk_sysfs_close ();
+	return (0);
+} /* int disk_shutdown */
+#endif /* KERNEL_LINUX */
+
 void module_register (void)
 {
   plugin_register_config ("disk", disk_config,
       config_keys, config_keys_num);
   plugin_register_init ("disk", disk_init);
+#if KERNEL_LINUX
+  plugin_register_shutdown ("disk", disk_shutdown);
+#endif
   plugin_register_read ("disk", disk_read);
 } /* void module_register */
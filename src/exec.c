@@ -37,14 +37,27 @@
 #include <pwd.h>
 #include <grp.h>
 #include <signal.h>
+#include <fcntl.h>
 
 #include <pthread.h>
 
+#if KERNEL_LINUX
+# include <sys/epoll.h>
+#endif
+
 #define PL_NORMAL        0x01
 #define PL_NOTIF_ACTION  0x02
 
 #define PL_RUNNING       0x10
 
+/* Initial size of the input buffer of a pipe. This is the maximum length of a
+ * text line; the buffer grows when a larger binary frame is read. */
+#define EXEC_BUFFER_SIZE     4096
+#define EXEC_FRAME_MAX       (PUTVAL_BINARY_HEADER_SIZE + 65535)
+
+/* Maximum number of notifications waiting for the notification worker. */
+#define EXEC_NOTIF_QUEUE_MAX 1024
+
 /*
  * Private data types
  */
@@ -54,10 +67,26 @@
  * all functions used to handle notifications MUST NOT write to this structure.
  * The `pid' and `status' fields are thus unused if the `PL_NOTIF_ACTION' flag
  * is set.
- * The `PL_RUNNING' flag is set in `exec_read' and unset in `exec_read_one'.
+ * The `PL_RUNNING' flag is set in `exec_read' and unset once the child has
+ * closed its STDOUT and has been reaped, i.e. in `exec_child_finished',
+ * `sigchld_handler' or `exec_read_one'. `sigchld_handler' can't take
+ * `pl_lock'; it only clears the flag after `exec_child_finished' has closed
+ * the streams, so the two never clear it for different children.
  */
 struct program_list_s;
 typedef struct program_list_s program_list_t;
+
+/* Input read from one of the pipes connected to a child. */
+typedef struct exec_stream_s
+{
+  program_list_t *pl;
+  int             fd;
+  _Bool           is_stderr;
+  char           *buffer;
+  size_t          buffer_size;
+  size_t          buffer_fill;
+} exec_stream_t;
+
 struct program_list_s
 {
   char           *user;
@@ -67,6 +96,8 @@ struct program_list_s
   int             pid;
   int             status;
   int             flags;
+  exec_stream_t   out;
+  exec_stream_t   err;
   program_list_t *next;
 };
 
@@ -74,6 +105,7 @@ typedef struct program_list_and_notification_s
 {
   program_list_t *pl;
   notification_t n;
+  struct program_list_and_notification_s *next;
 } program_list_and_notification_t;
 
 /*
@@ -82,6 +114,26 @@ typedef struct program_list_and_notification_s
 static program_list_t *pl_head = NULL;
 static pthread_mutex_t pl_lock = PTHREAD_MUTEX_INITIALIZER;
 
+#if KERNEL_LINUX
+/* The pipes of all children are read by a single thread using epoll. A byte
+ * written to `exec_wakeup_fd' stops this thread. */
+static int exec_epoll_fd = -1;
+static int exec_wakeup_fd[2] = {-1, -1};
+static pthread_t exec_reader_thread;
+static _Bool exec_reader_running = 0;
+#endif
+
+/* Notifications are queued and handed to the `NotificationExec' programs by a
+ * single worker thread. */
+static program_list_and_notification_t *notif_queue_head = NULL;
+static program_list_and_notification_t *notif_queue_tail = NULL;
+static size_t notif_queue_num = 0;
+static pthread_mutex_t notif_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t notif_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t notif_thread;
+static _Bool notif_thread_running = 0;
+static _Bool notif_shutdown = 0;
+
 /*
  * Functions
  */
@@ -95,8 +147,19 @@ static void sigchld_handler (int __attribute__((unused)) signal) /* {{{ */
     for (pl = pl_head; pl != NULL; pl = pl->next)
       if (pl->pid == pid)
         break;
-    if (pl != NULL)
-      pl->status = status;
+    if (pl == NULL)
+      continue;
+
+    pl->status = status;
+#if KERNEL_LINUX
+    /* If STDOUT is still open, `exec_child_finished' clears the flag. */
+    if (pl->pid == pid)
+    {
+      if (pl->out.fd < 0)
+        pl->flags &= ~PL_RUNNING;
+      pl->pid = 0;
+    }
+#endif
   } /* while (waitpid) */
 } /* void sigchld_handler }}} */
 
@@ -133,6 +196,8 @@ static int exec_config_exec (oconfig_item_t *ci) /* {{{ */
     return (-1);
   }
   memset (pl, '\0', sizeof (program_list_t));
+  pl->out.fd = -1;
+  pl->err.fd = -1;
 
   if (strcasecmp ("NotificationExec", ci->key) == 0)
     pl->flags |= PL_NOTIF_ACTION;
@@ -561,145 +626,446 @@ static int parse_line (char *buffer) /* {{{ */
   }
 } /* int parse_line }}} */
 
-static void *exec_read_one (void *arg) /* {{{ */
+static int exec_stream_init (exec_stream_t *s, program_list_t *pl, /* {{{ */
+    int fd, _Bool is_stderr)
 {
-  program_list_t *pl = (program_list_t *) arg;
-  int fd, fd_err, highest_fd;
-  fd_set fdset, copy;
-  int status;
-  char buffer[1200];  /* if not completely read */
-  char buffer_err[1024];
-  char *pbuffer = buffer;
-  char *pbuffer_err = buffer_err;
+  s->pl = pl;
+  s->fd = fd;
+  s->is_stderr = is_stderr;
+  s->buffer_fill = 0;
 
-  status = fork_child (pl, NULL, &fd, &fd_err);
-  if (status < 0)
+  if (s->buffer == NULL)
   {
-    /* Reset the "running" flag */
-    pthread_mutex_lock (&pl_lock);
-    pl->flags &= ~PL_RUNNING;
-    pthread_mutex_unlock (&pl_lock);
-    pthread_exit ((void *) 1);
+    s->buffer = malloc (EXEC_BUFFER_SIZE);
+    if (s->buffer == NULL)
+    {
+      ERROR ("exec plugin: malloc failed.");
+      return (-1);
+    }
+    s->buffer_size = EXEC_BUFFER_SIZE;
   }
-  pl->pid = status;
 
-  assert (pl->pid != 0);
+  return (0);
+} /* }}} int exec_stream_init */
 
-  FD_ZERO( &fdset );
-  FD_SET(fd, &fdset);
-  FD_SET(fd_err, &fdset);
+static void exec_stream_close (exec_stream_t *s) /* {{{ */
+{
+  if (s->fd < 0)
+    return;
 
-  /* Determine the highest file descriptor */
-  highest_fd = (fd > fd_err) ? fd : fd_err;
+#if KERNEL_LINUX
+  if (exec_epoll_fd >= 0)
+    epoll_ctl (exec_epoll_fd, EPOLL_CTL_DEL, s->fd, NULL);
+#endif
+  close (s->fd);
+  s->fd = -1;
+  s->buffer_fill = 0;
+} /* }}} void exec_stream_close */
 
-  /* We use a copy of fdset, as select modifies it */
-  copy = fdset;
+/*
+ * Handles all complete lines and binary PUTVAL frames in the buffer and moves
+ * the remainder to the beginning of the buffer. Lines read from STDERR are
+ * logged.
+ */
+static void exec_stream_parse (exec_stream_t *s) /* {{{ */
+{
+  size_t offset = 0;
 
-  while (1)
+  while (offset < s->buffer_fill)
   {
-    int len;
-
-    status = select (highest_fd + 1, &copy, NULL, NULL, NULL);
-    if (status < 0)
-    {
-      if (errno == EINTR)
-        continue;
-      break;
-    }
+    char *begin = s->buffer + offset;
+    size_t avail = s->buffer_fill - offset;
+    char *end;
 
-    if (FD_ISSET(fd, &copy))
+    if (!s->is_stderr && (begin[0] == PUTVAL_BINARY_MAGIC))
     {
-      char *pnl;
+      unsigned char *header = (unsigned char *) begin;
+      size_t frame_size;
 
-      len = read(fd, pbuffer, sizeof(buffer) - 1 - (pbuffer - buffer));
+      if (avail < PUTVAL_BINARY_HEADER_SIZE)
+        break;
 
-      if (len < 0)
+      if (header[1] != PUTVAL_BINARY_VERSION)
       {
-        if (errno == EAGAIN || errno == EINTR)  continue;
+        /* There is no way to find the next frame or line. */
+        ERROR ("exec plugin: Program `%s' sent a binary frame of unsupported "
+            "version %u. Discarding %zu bytes of input.", s->pl->exec,
+            (unsigned int) header[1], avail);
+        offset = s->buffer_fill;
         break;
       }
-      else if (len == 0) break;  /* We've reached EOF */
 
-      pbuffer[len] = '\0';
+      frame_size = PUTVAL_BINARY_HEADER_SIZE
+        + ((((size_t) header[2]) << 8) | ((size_t) header[3]));
+      if (avail < frame_size)
+        break;
+
+      handle_putval_binary (stdout, begin + PUTVAL_BINARY_HEADER_SIZE,
+          frame_size - PUTVAL_BINARY_HEADER_SIZE);
+      offset += frame_size;
+      continue;
+    }
 
-      len += pbuffer - buffer;
-      pbuffer = buffer;
+    end = memchr (begin, '\n', avail);
+    if (end == NULL)
+      break;
+    offset += (size_t) (end - begin) + 1;
 
-      while ((pnl = strchr(pbuffer, '\n')))
-      {
-        *pnl = '\0';
-        if (*(pnl-1) == '\r' ) *(pnl-1) = '\0';
+    *end = '\0';
+    if ((end > begin) && (end[-1] == '\r'))
+      end[-1] = '\0';
 
-        parse_line (pbuffer);
+    if (s->is_stderr)
+      ERROR ("exec plugin: exec_read_one: error = %s", begin);
+    else
+      parse_line (begin);
+  } /* while (offset < s->buffer_fill) */
 
-        pbuffer = ++pnl;
-      }
-      /* not completely read ? */
-      if (pbuffer - buffer < len)
-      {
-        len -= pbuffer - buffer;
-        memmove(buffer, pbuffer, len);
-        pbuffer = buffer + len;
-      }
-      else
-        pbuffer = buffer;
+  if (offset > 0)
+  {
+    memmove (s->buffer, s->buffer + offset, s->buffer_fill - offset);
+    s->buffer_fill -= offset;
+  }
+
+  if (s->buffer_fill < s->buffer_size)
+    return;
+
+  /* The buffer is full, so the first line or frame does not fit. */
+  if (!s->is_stderr && (s->buffer[0] == PUTVAL_BINARY_MAGIC)
+      && (s->buffer_size < EXEC_FRAME_MAX))
+  {
+    char *tmp = realloc (s->buffer, EXEC_FRAME_MAX);
+    if (tmp != NULL)
+    {
+      s->buffer = tmp;
+      s->buffer_size = EXEC_FRAME_MAX;
+      return;
     }
-    else if (FD_ISSET(fd_err, &copy))
+    ERROR ("exec plugin: realloc failed.");
+  }
+  else
+  {
+    ERROR ("exec plugin: Program `%s' wrote a line longer than %zu bytes. "
+        "Discarding it.", s->pl->exec, s->buffer_size);
+  }
+  s->buffer_fill = 0;
+} /* }}} void exec_stream_parse */
+
+/* Reads from the pipe and handles the input. Returns non-zero if the pipe has
+ * been closed by the child or reading failed. */
+static int exec_stream_read (exec_stream_t *s) /* {{{ */
+{
+  ssize_t len;
+
+  len = read (s->fd, s->buffer + s->buffer_fill,
+      s->buffer_size - s->buffer_fill);
+  if (len < 0)
+  {
+    if ((errno == EAGAIN) || (errno == EINTR))
+      return (0);
+    return (-1);
+  }
+  else if (len == 0) /* We've reached EOF */
+    return (-1);
+
+  s->buffer_fill += (size_t) len;
+  exec_stream_parse (s);
+
+  return (0);
+} /* }}} int exec_stream_read */
+
+#if KERNEL_LINUX
+static int exec_set_nonblocking (int fd) /* {{{ */
+{
+  int flags;
+
+  flags = fcntl (fd, F_GETFL);
+  if ((flags < 0) || (fcntl (fd, F_SETFL, flags | O_NONBLOCK) != 0))
+  {
+    char errbuf[1024];
+    ERROR ("exec plugin: fcntl (%i, O_NONBLOCK) failed: %s", fd,
+        sstrerror (errno, errbuf, sizeof (errbuf)));
+    return (-1);
+  }
+
+  return (0);
+} /* }}} int exec_set_nonblocking */
+
+/* Forks the program and adds its pipes to the event loop. Must be called with
+ * `pl_lock' held. */
+static int exec_start_child (program_list_t *pl) /* {{{ */
+{
+  int fd_out = -1;
+  int fd_err = -1;
+  int pid;
+  exec_stream_t *streams[2];
+  size_t i;
+
+  pid = fork_child (pl, NULL, &fd_out, &fd_err);
+  if (pid < 0)
+    return (-1);
+  pl->pid = pid;
+
+  streams[0] = &pl->out;
+  streams[1] = &pl->err;
+
+  if ((exec_stream_init (&pl->out, pl, fd_out, /* is_stderr = */ 0) != 0)
+      || (exec_stream_init (&pl->err, pl, fd_err, /* is_stderr = */ 1) != 0))
+    goto failed;
+
+  for (i = 0; i < STATIC_ARRAY_SIZE (streams); i++)
+  {
+    struct epoll_event ev;
+
+    memset (&ev, 0, sizeof (ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = streams[i];
+
+    if (exec_set_nonblocking (streams[i]->fd) != 0)
+      goto failed;
+
+    if (epoll_ctl (exec_epoll_fd, EPOLL_CTL_ADD, streams[i]->fd, &ev) != 0)
     {
-      char *pnl;
+      char errbuf[1024];
+      ERROR ("exec plugin: epoll_ctl failed: %s",
+          sstrerror (errno, errbuf, sizeof (errbuf)));
+      goto failed;
+    }
+  }
 
-      len = read(fd_err, pbuffer_err, sizeof(buffer_err) - 1 - (pbuffer_err - buffer_err));
+  return (0);
 
-      if (len < 0)
-      {
-        if (errno == EAGAIN || errno == EINTR)
-          continue;
-        break;
-      }
-      else if (len == 0)
-      {
-        /* We've reached EOF */
-        NOTICE ("exec plugin: Program `%s' has closed STDERR.", pl->exec);
+failed:
+  pl->out.fd = fd_out;
+  pl->err.fd = fd_err;
+  exec_stream_close (&pl->out);
+  exec_stream_close (&pl->err);
+  kill (pl->pid, SIGTERM);
+  pl->pid = 0;
+  return (-1);
+} /* }}} int exec_start_child */
+
+/* Called by the reader thread once the child has closed its STDOUT. */
+static void exec_child_finished (program_list_t *pl) /* {{{ */
+{
+  pid_t pid;
+  int status;
+
+  pthread_mutex_lock (&pl_lock);
 
-        /* Remove file descriptor form select() set. */
-        FD_CLR (fd_err, &fdset);
-        copy = fdset;
-        highest_fd = fd;
+  exec_stream_close (&pl->out);
+  exec_stream_close (&pl->err);
 
-        /* Clean up file descriptor */
-        close (fd_err);
-        fd_err = -1;
+  /* Don't block the reader thread if the child is still running. Once it
+   * exits, `sigchld_handler' reaps it and clears `PL_RUNNING', so that no
+   * second instance is started in the meantime. If the handler has reaped
+   * it already, `pid' is zero or waitpid fails with ECHILD. */
+  pid = pl->pid;
+  if (pid > 0)
+  {
+    pid_t ret = waitpid (pid, &status, WNOHANG);
+    if (ret > 0)
+      pl->status = status;
+    if ((ret > 0) || ((ret < 0) && (errno == ECHILD)))
+      pl->pid = 0;
+  }
+
+  if (pl->pid == 0)
+  {
+    DEBUG ("exec plugin: Child %i exited with status %i.",
+        (int) pid, pl->status);
+    pl->flags &= ~PL_RUNNING;
+  }
+  else
+    DEBUG ("exec plugin: Child %i closed STDOUT but is still running.",
+        (int) pid);
+
+  pthread_mutex_unlock (&pl_lock);
+} /* }}} void exec_child_finished */
+
+static void *exec_reader (void __attribute__((unused)) *arg) /* {{{ */
+{
+  while (42)
+  {
+    struct epoll_event events[64];
+    int events_num;
+    int i;
+
+    events_num = epoll_wait (exec_epoll_fd, events,
+        STATIC_ARRAY_SIZE (events), -1);
+    if (events_num < 0)
+    {
+      char errbuf[1024];
+
+      if (errno == EINTR)
         continue;
-      }
 
-      pbuffer_err[len] = '\0';
+      ERROR ("exec plugin: epoll_wait failed: %s",
+          sstrerror (errno, errbuf, sizeof (errbuf)));
+      break;
+    }
 
-      len += pbuffer_err - buffer_err;
-      pbuffer_err = buffer_err;
+    for (i = 0; i < events_num; i++)
+    {
+      exec_stream_t *s = events[i].data.ptr;
 
-      while ((pnl = strchr(pbuffer_err, '\n')))
-      {
-        *pnl = '\0';
-        if (*(pnl-1) == '\r' ) *(pnl-1) = '\0';
+      if (s == NULL) /* exec_shutdown */
+        return (NULL);
 
-        ERROR ("exec plugin: exec_read_one: error = %s", pbuffer_err);
+      /* The stream may have been closed by an earlier event of this batch. */
+      if (s->fd < 0)
+        continue;
 
-        pbuffer_err = ++pnl;
-      }
-      /* not completely read ? */
-      if (pbuffer_err - buffer_err < len)
+      if (exec_stream_read (s) == 0)
+        continue;
+
+      if (s->is_stderr)
       {
-        len -= pbuffer_err - buffer_err;
-        memmove(buffer_err, pbuffer_err, len);
-        pbuffer_err = buffer_err + len;
+        NOTICE ("exec plugin: Program `%s' has closed STDERR.", s->pl->exec);
+        exec_stream_close (s);
       }
       else
-        pbuffer_err = buffer_err;
-    }
-    /* reset copy */
-    copy = fdset;
+        exec_child_finished (s->pl);
+    } /* for (i) */
+  } /* while (42) */
+
+  return ((void *) 1);
+} /* }}} void *exec_reader */
+
+static void exec_reader_close_fds (void) /* {{{ */
+{
+  if (exec_epoll_fd >= 0)
+    close (exec_epoll_fd);
+  exec_epoll_fd = -1;
+
+  close_pipe (exec_wakeup_fd);
+  exec_wakeup_fd[0] = -1;
+  exec_wakeup_fd[1] = -1;
+} /* }}} void exec_reader_close_fds */
+
+static int exec_reader_start (void) /* {{{ */
+{
+  struct epoll_event ev;
+  char errbuf[1024];
+  int status;
+
+  exec_epoll_fd = epoll_create1 (EPOLL_CLOEXEC);
+  if (exec_epoll_fd < 0)
+  {
+    ERROR ("exec plugin: epoll_create1 failed: %s",
+        sstrerror (errno, errbuf, sizeof (errbuf)));
+    return (-1);
+  }
+
+  if (create_pipe (exec_wakeup_fd) != 0)
+  {
+    exec_reader_close_fds ();
+    return (-1);
+  }
+
+  memset (&ev, 0, sizeof (ev));
+  ev.events = EPOLLIN;
+  ev.data.ptr = NULL;
+  if (epoll_ctl (exec_epoll_fd, EPOLL_CTL_ADD, exec_wakeup_fd[0], &ev) != 0)
+  {
+    ERROR ("exec plugin: epoll_ctl failed: %s",
+        sstrerror (errno, errbuf, sizeof (errbuf)));
+    exec_reader_close_fds ();
+    return (-1);
+  }
+
+  status = plugin_thread_create (&exec_reader_thread, /* attr = */ NULL,
+      exec_reader, /* arg = */ NULL);
+  if (status != 0)
+  {
+    ERROR ("exec plugin: pthread_create failed: %s",
+        sstrerror (status, errbuf, sizeof (errbuf)));
+    exec_reader_close_fds ();
+    return (-1);
+  }
+  exec_reader_running = 1;
+
+  return (0);
+} /* }}} int exec_reader_start */
+
+static void exec_reader_stop (void) /* {{{ */
+{
+  if (!exec_reader_running)
+    return;
+
+  if (write (exec_wakeup_fd[1], "", 1) != 1)
+  {
+    char errbuf[1024];
+    ERROR ("exec plugin: Waking up the reader thread failed: %s",
+        sstrerror (errno, errbuf, sizeof (errbuf)));
+    pthread_cancel (exec_reader_thread);
+  }
+  pthread_join (exec_reader_thread, /* retval = */ NULL);
+  exec_reader_running = 0;
+} /* }}} void exec_reader_stop */
+#else /* if !KERNEL_LINUX */
+static void *exec_read_one (void *arg) /* {{{ */
+{
+  program_list_t *pl = (program_list_t *) arg;
+  int fd, fd_err;
+  int status;
+
+  status = fork_child (pl, NULL, &fd, &fd_err);
+  if (status < 0)
+  {
+    /* Reset the "running" flag */
+    pthread_mutex_lock (&pl_lock);
+    pl->flags &= ~PL_RUNNING;
+    pthread_mutex_unlock (&pl_lock);
+    pthread_exit ((void *) 1);
+  }
+  pl->pid = status;
+
+  assert (pl->pid != 0);
+
+  if ((exec_stream_init (&pl->out, pl, fd, /* is_stderr = */ 0) != 0)
+      || (exec_stream_init (&pl->err, pl, fd_err, /* is_stderr = */ 1) != 0))
+  {
+    pl->out.fd = fd;
+    pl->err.fd = fd_err;
+    exec_stream_close (&pl->out);
+    kill (pl->pid, SIGTERM);
   }
 
+  while (pl->out.fd >= 0)
+  {
+    fd_set fdset;
+    int highest_fd = pl->out.fd;
+
+    FD_ZERO (&fdset);
+    FD_SET (pl->out.fd, &fdset);
+    if (pl->err.fd >= 0)
+    {
+      FD_SET (pl->err.fd, &fdset);
+      if (highest_fd < pl->err.fd)
+        highest_fd = pl->err.fd;
+    }
+
+    status = select (highest_fd + 1, &fdset, NULL, NULL, NULL);
+    if (status < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+
+    if (FD_ISSET (pl->out.fd, &fdset)
+        && (exec_stream_read (&pl->out) != 0))
+      break;
+
+    if ((pl->err.fd >= 0) && FD_ISSET (pl->err.fd, &fdset)
+        && (exec_stream_read (&pl->err) != 0))
+    {
+      NOTICE ("exec plugin: Program `%s' has closed STDERR.", pl->exec);
+      exec_stream_close (&pl->err);
+    }
+  } /* while (pl->out.fd >= 0) */
+
   DEBUG ("exec plugin: exec_read_one: Waiting for `%s' to exit.", pl->exec);
   if (waitpid (pl->pid, &status, 0) > 0)
     pl->status = status;
@@ -709,48 +1075,24 @@ static void *exec_read_one (void *arg) /* {{{ */
 
   pl->pid = 0;
 
+  exec_stream_close (&pl->out);
+  exec_stream_close (&pl->err);
+
   pthread_mutex_lock (&pl_lock);
   pl->flags &= ~PL_RUNNING;
   pthread_mutex_unlock (&pl_lock);
 
-  close (fd);
-  if (fd_err >= 0)
-    close (fd_err);
-
   pthread_exit ((void *) 0);
   return (NULL);
 } /* void *exec_read_one }}} */
+#endif /* !KERNEL_LINUX */
 
-static void *exec_notification_one (void *arg) /* {{{ */
+static void exec_notification_print (FILE *fh, /* {{{ */
+    const notification_t *n)
 {
-  program_list_t *pl = ((program_list_and_notification_t *) arg)->pl;
-  notification_t *n = &((program_list_and_notification_t *) arg)->n;
   notification_meta_t *meta;
-  int fd;
-  FILE *fh;
-  int pid;
-  int status;
   const char *severity;
 
-  pid = fork_child (pl, &fd, NULL, NULL);
-  if (pid < 0) {
-    sfree (arg);
-    pthread_exit ((void *) 1);
-  }
-
-  fh = fdopen (fd, "w");
-  if (fh == NULL)
-  {
-    char errbuf[1024];
-    ERROR ("exec plugin: fdopen (%i) failed: %s", fd,
-        sstrerror (errno, errbuf, sizeof (errbuf)));
-    kill (pl->pid, SIGTERM);
-    pl->pid = 0;
-    close (fd);
-    sfree (arg);
-    pthread_exit ((void *) 1);
-  }
-
   severity = "FAILURE";
   if (n->severity == NOTIF_WARNING)
     severity = "WARNING";
@@ -790,31 +1132,122 @@ static void *exec_notification_one (void *arg) /* {{{ */
   }
 
   fprintf (fh, "\n%s\n", n->message);
+} /* }}} void exec_notification_print */
+
+/* Forks the program and writes the notification to its STDIN. The child is
+ * not waited for, so a slow program does not hold up other notifications; it
+ * is reaped by `sigchld_handler'. */
+static void exec_notification_one (program_list_and_notification_t *pln) /* {{{ */
+{
+  program_list_t *pl = pln->pl;
+  notification_t *n = &pln->n;
+  int fd;
+  FILE *fh;
+  int pid;
+
+  pid = fork_child (pl, &fd, NULL, NULL);
+  if (pid < 0)
+    goto out;
+
+  fh = fdopen (fd, "w");
+  if (fh == NULL)
+  {
+    char errbuf[1024];
+    ERROR ("exec plugin: fdopen (%i) failed: %s", fd,
+        sstrerror (errno, errbuf, sizeof (errbuf)));
+    kill (pid, SIGTERM);
+    close (fd);
+    goto out;
+  }
+
+  exec_notification_print (fh, n);
 
   fflush (fh);
   fclose (fh);
 
-  waitpid (pid, &status, 0);
-
-  DEBUG ("exec plugin: Child %i exited with status %i.",
-      pid, status);
+  DEBUG ("exec plugin: Notification handed to child %i.", pid);
 
+out:
   if (n->meta != NULL)
     plugin_notification_meta_free (n->meta);
   n->meta = NULL;
-  sfree (arg);
-  pthread_exit ((void *) 0);
+  sfree (pln);
+} /* }}} void exec_notification_one */
+
+static void *exec_notification_worker (void __attribute__((unused)) *arg) /* {{{ */
+{
+  pthread_mutex_lock (&notif_lock);
+  while (42)
+  {
+    program_list_and_notification_t *pln;
+
+    while ((notif_queue_head == NULL) && !notif_shutdown)
+      pthread_cond_wait (&notif_cond, &notif_lock);
+
+    if (notif_shutdown)
+      break;
+
+    pln = notif_queue_head;
+    notif_queue_head = pln->next;
+    if (notif_queue_head == NULL)
+      notif_queue_tail = NULL;
+    notif_queue_num--;
+
+    pthread_mutex_unlock (&notif_lock);
+    exec_notification_one (pln);
+    pthread_mutex_lock (&notif_lock);
+  } /* while (42) */
+  pthread_mutex_unlock (&notif_lock);
+
   return (NULL);
-} /* void *exec_notification_one }}} */
+} /* }}} void *exec_notification_worker */
 
 static int exec_init (void) /* {{{ */
 {
   struct sigaction sa;
+  program_list_t *pl;
+  _Bool have_normal = 0;
+  _Bool have_notif = 0;
 
   memset (&sa, '\0', sizeof (sa));
   sa.sa_handler = sigchld_handler;
   sigaction (SIGCHLD, &sa, NULL);
 
+  for (pl = pl_head; pl != NULL; pl = pl->next)
+  {
+    if ((pl->flags & PL_NORMAL) != 0)
+      have_normal = 1;
+    if ((pl->flags & PL_NOTIF_ACTION) != 0)
+      have_notif = 1;
+  }
+
+#if KERNEL_LINUX
+  if (have_normal && !exec_reader_running)
+  {
+    if (exec_reader_start () != 0)
+      return (-1);
+  }
+#else
+  (void) have_normal;
+#endif
+
+  if (have_notif && !notif_thread_running)
+  {
+    int status;
+
+    notif_shutdown = 0;
+    status = plugin_thread_create (&notif_thread, /* attr = */ NULL,
+        exec_notification_worker, /* arg = */ NULL);
+    if (status != 0)
+    {
+      char errbuf[1024];
+      ERROR ("exec plugin: pthread_create failed: %s",
+          sstrerror (status, errbuf, sizeof (errbuf)));
+      return (-1);
+    }
+    notif_thread_running = 1;
+  }
+
   return (0);
 } /* int exec_init }}} */
 
@@ -824,8 +1257,10 @@ static int exec_read (void) /* {{{ */
 
   for (pl = pl_head; pl != NULL; pl = pl->next)
   {
+#if !KERNEL_LINUX
     pthread_t t;
     pthread_attr_t attr;
+#endif
 
     /* Only execute `normal' style executables here. */
     if ((pl->flags & PL_NORMAL) == 0)
@@ -838,6 +1273,11 @@ static int exec_read (void) /* {{{ */
       pthread_mutex_unlock (&pl_lock);
       continue;
     }
+#if KERNEL_LINUX
+    if (exec_start_child (pl) == 0)
+      pl->flags |= PL_RUNNING;
+    pthread_mutex_unlock (&pl_lock);
+#else
     pl->flags |= PL_RUNNING;
     pthread_mutex_unlock (&pl_lock);
 
@@ -845,6 +1285,7 @@ static int exec_read (void) /* {{{ */
     pthread_attr_setdetachstate (&attr, PTHREAD_CREATE_DETACHED);
     plugin_thread_create (&t, &attr, exec_read_one, (void *) pl);
     pthread_attr_destroy (&attr);
+#endif
   } /* for (pl) */
 
   return (0);
@@ -858,17 +1299,10 @@ static int exec_notification (const notification_t *n, /* {{{ */
 
   for (pl = pl_head; pl != NULL; pl = pl->next)
   {
-    pthread_t t;
-    pthread_attr_t attr;
-
     /* Only execute `notification' style executables here. */
     if ((pl->flags & PL_NOTIF_ACTION) == 0)
       continue;
 
-    /* Skip if a child is already running. */
-    if (pl->pid != 0)
-      continue;
-
     pln = (program_list_and_notification_t *) malloc (sizeof
         (program_list_and_notification_t));
     if (pln == NULL)
@@ -879,16 +1313,34 @@ static int exec_notification (const notification_t *n, /* {{{ */
 
     pln->pl = pl;
     memcpy (&pln->n, n, sizeof (notification_t));
+    pln->next = NULL;
 
     /* Set the `meta' member to NULL, otherwise `plugin_notification_meta_copy'
      * will run into an endless loop. */
     pln->n.meta = NULL;
     plugin_notification_meta_copy (&pln->n, n);
 
-    pthread_attr_init (&attr);
-    pthread_attr_setdetachstate (&attr, PTHREAD_CREATE_DETACHED);
-    plugin_thread_create (&t, &attr, exec_notification_one, (void *) pln);
-    pthread_attr_destroy (&attr);
+    pthread_mutex_lock (&notif_lock);
+    if (notif_queue_num >= EXEC_NOTIF_QUEUE_MAX)
+    {
+      pthread_mutex_unlock (&notif_lock);
+      WARNING ("exec plugin: %zu notifications are waiting to be handled. "
+          "Dropping notification for `%s'.", notif_queue_num, pl->exec);
+      if (pln->n.meta != NULL)
+        plugin_notification_meta_free (pln->n.meta);
+      sfree (pln);
+      continue;
+    }
+
+    if (notif_queue_tail == NULL)
+      notif_queue_head = pln;
+    else
+      notif_queue_tail->next = pln;
+    notif_queue_tail = pln;
+    notif_queue_num++;
+
+    pthread_cond_signal (&notif_cond);
+    pthread_mutex_unlock (&notif_lock);
   } /* for (pl) */
 
   return (0);
@@ -899,6 +1351,33 @@ static int exec_shutdown (void) /* {{{ */
   program_list_t *pl;
   program_list_t *next;
 
+#if KERNEL_LINUX
+  exec_reader_stop ();
+#endif
+
+  if (notif_thread_running)
+  {
+    pthread_mutex_lock (&notif_lock);
+    notif_shutdown = 1;
+    pthread_cond_broadcast (&notif_cond);
+    pthread_mutex_unlock (&notif_lock);
+
+    pthread_join (notif_thread, /* retval = */ NULL);
+    notif_thread_running = 0;
+  }
+
+  while (notif_queue_head != NULL)
+  {
+    program_list_and_notification_t *pln = notif_queue_head;
+    notif_queue_head = pln->next;
+
+    if (pln->n.meta != NULL)
+      plugin_notification_meta_free (pln->n.meta);
+    sfree (pln);
+  }
+  notif_queue_tail = NULL;
+  notif_queue_num = 0;
+
   pl = pl_head;
   while (pl != NULL)
   {
@@ -910,6 +1389,12 @@ static int exec_shutdown (void) /* {{{ */
       INFO ("exec plugin: Sent SIGTERM to %hu", (unsigned short int) pl->pid);
     }
 
+#if KERNEL_LINUX
+    exec_stream_close (&pl->out);
+    exec_stream_close (&pl->err);
+#endif
+    sfree (pl->out.buffer);
+    sfree (pl->err.buffer);
     sfree (pl->user);
     sfree (pl);
 
@@ -917,6 +1402,10 @@ static int exec_shutdown (void) /* {{{ */
   } /* while (pl) */
   pl_head = NULL;
 
+#if KERNEL_LINUX
+  exec_reader_close_fds ();
+#endif
+
   return (0);
 } /* int exec_shutdown }}} */
 
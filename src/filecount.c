@@ -24,15 +24,43 @@
 #include "collectd.h"
 #include "common.h"
 #include "plugin.h"       
+#include "utils_avltree.h"
 
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <dirent.h>
 #include <fnmatch.h>
+#include <pthread.h>
+
+#if HAVE_SYS_INOTIFY_H
+# include <sys/inotify.h>
+# define FC_NOTIFY_EVENTS (IN_CREATE | IN_DELETE | IN_MOVED_FROM \
+    | IN_MOVED_TO | IN_MODIFY | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF \
+    | IN_ONLYDIR)
+#endif
 
 #define FC_RECURSIVE 1
 #define FC_HIDDEN 2
+#define FC_INCREMENTAL 4
+
+/* Counts of a single directory, kept between reads in "Incremental" mode.
+ * Directories which haven't changed since the last read are not read again:
+ * their counts and subdirectories are taken from here. */
+struct fc_node_s
+{
+  /* Relative to the configured directory, which itself is "". */
+  char *path;
+  int wd;
+  _Bool dirty;
+  unsigned int generation;
+
+  uint64_t files_num;
+  uint64_t files_size;
+  char **subdirs;
+  size_t subdirs_num;
+};
+typedef struct fc_node_s fc_node_t;
 
 struct fc_directory_conf_s
 {
@@ -50,14 +78,48 @@ struct fc_directory_conf_s
   int64_t mtime;
   int64_t size;
 
+  /* Incremental mode */
+  int notify_fd;
+  c_avl_tree_t *nodes;   /* path -> fc_node_t */
+  c_avl_tree_t *watches; /* wd -> fc_node_t */
+  unsigned int generation;
+  cdtime_t rescan_interval;
+  cdtime_t last_rescan;
+  _Bool notify_warned;
+
   /* Helper for the recursive functions */
   time_t now;
+  int root_fd;
 };
 typedef struct fc_directory_conf_s fc_directory_conf_t;
 
 static fc_directory_conf_t **directories = NULL;
 static size_t directories_num = 0;
 
+/* Directories are scanned by a pool of "Threads" threads, including the read
+ * thread. Each work item is a single directory; its subdirectories are added
+ * to the queue as they are found. "fc_lock" also protects the counters of
+ * fc_directory_conf_t and the nodes of the incremental mode. */
+struct fc_work_s
+{
+  fc_directory_conf_t *dir;
+  char *path;
+};
+typedef struct fc_work_s fc_work_t;
+
+static pthread_mutex_t fc_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t fc_cond = PTHREAD_COND_INITIALIZER;
+static fc_work_t *work_queue = NULL;
+static size_t work_queue_num = 0;
+static size_t work_queue_size = 0;
+/* Number of queued items plus items being worked on. */
+static size_t work_pending = 0;
+
+static int threads_num = 1;
+static pthread_t *workers = NULL;
+static size_t workers_num = 0;
+static _Bool workers_stop = 0;
+
 static void fc_submit_dir (const fc_directory_conf_t *dir)
 {
   value_t values[1];
@@ -317,8 +379,8 @@ static int fc_config_add_dir_option (fc_directory_conf_t *dir,
   if ((ci->values_num != 1)
       || (ci->values[0].type != OCONFIG_TYPE_BOOLEAN))
   {
-    WARNING ("filecount plugin: The `Recursive' config options needs exactly "
-        "one boolean argument.");
+    WARNING ("filecount plugin: The `%s' config options needs exactly "
+        "one boolean argument.", ci->key);
     return (-1);
   }
 
@@ -363,6 +425,9 @@ static int fc_config_add_dir (oconfig_item_t *ci)
   fc_config_set_instance (dir, dir->path);
 
   dir->options = FC_RECURSIVE;
+  dir->notify_fd = -1;
+  dir->root_fd = -1;
+  dir->rescan_interval = TIME_T_TO_CDTIME_T (3600);
 
   dir->name = NULL;
   dir->mtime = 0;
@@ -385,6 +450,10 @@ static int fc_config_add_dir (oconfig_item_t *ci)
       status = fc_config_add_dir_option (dir, option, FC_RECURSIVE);
     else if (strcasecmp ("IncludeHidden", option->key) == 0)
       status = fc_config_add_dir_option (dir, option, FC_HIDDEN);
+    else if (strcasecmp ("Incremental", option->key) == 0)
+      status = fc_config_add_dir_option (dir, option, FC_INCREMENTAL);
+    else if (strcasecmp ("RescanInterval", option->key) == 0)
+      status = cf_util_get_cdtime (option, &dir->rescan_interval);
     else
     {
       WARNING ("filecount plugin: fc_config_add_dir: "
@@ -396,6 +465,24 @@ static int fc_config_add_dir (oconfig_item_t *ci)
       break;
   } /* for (ci->children) */
 
+  if ((status == 0) && (dir->options & FC_INCREMENTAL))
+  {
+#if HAVE_SYS_INOTIFY_H
+    if (dir->mtime != 0)
+    {
+      /* Whether a file is counted changes without the file being touched. */
+      WARNING ("filecount plugin: `Incremental' cannot be used together "
+          "with `MTime'. Directory `%s' is read completely every time.",
+          dir->path);
+      dir->options &= ~FC_INCREMENTAL;
+    }
+#else
+    WARNING ("filecount plugin: `Incremental' requires inotify, which is not "
+        "available on this system.");
+    dir->options &= ~FC_INCREMENTAL;
+#endif
+  }
+
   if (status == 0)
   {
     fc_directory_conf_t **temp;
@@ -436,6 +523,12 @@ static int fc_config (oconfig_item_t *ci)
     oconfig_item_t *child = ci->children + i;
     if (strcasecmp ("Directory", child->key) == 0)
       fc_config_add_dir (child);
+    else if (strcasecmp ("Threads", child->key) == 0)
+    {
+      cf_util_get_int (child, &threads_num);
+      if (threads_num < 1)
+        threads_num = 1;
+    }
     else
     {
       WARNING ("filecount plugin: Ignoring unknown config option `%s'.",
@@ -446,55 +539,254 @@ static int fc_config (oconfig_item_t *ci)
   return (0);
 } /* int fc_config */
 
-static int fc_init (void)
+static int fc_compare_wd (const void *a, const void *b)
 {
-  if (directories_num < 1)
+  int wd_a = *((const int *) a);
+  int wd_b = *((const int *) b);
+
+  return ((wd_a > wd_b) - (wd_a < wd_b));
+} /* int fc_compare_wd */
+
+static void fc_node_free (fc_node_t *node)
+{
+  size_t i;
+
+  if (node == NULL)
+    return;
+
+  for (i = 0; i < node->subdirs_num; i++)
+    sfree (node->subdirs[i]);
+  sfree (node->subdirs);
+  sfree (node->path);
+  sfree (node);
+} /* void fc_node_free */
+
+/* Returns the node for "path", creating it if necessary. Must be called with
+ * fc_lock held. */
+static fc_node_t *fc_node_get (fc_directory_conf_t *dir, const char *path)
+{
+  fc_node_t *node = NULL;
+
+  if (c_avl_get (dir->nodes, path, (void *) &node) == 0)
+    return (node);
+
+  node = calloc (1, sizeof (*node));
+  if (node == NULL)
+    return (NULL);
+  node->path = strdup (path);
+  if (node->path == NULL)
   {
-    WARNING ("filecount plugin: No directories have been configured.");
-    return (-1);
+    sfree (node);
+    return (NULL);
   }
+  node->wd = -1;
+  node->dirty = 1;
 
-  return (0);
-} /* int fc_init */
+  if (c_avl_insert (dir->nodes, node->path, node) != 0)
+  {
+    fc_node_free (node);
+    return (NULL);
+  }
+
+  return (node);
+} /* fc_node_t *fc_node_get */
+
+/* Removes "node" from the watches tree. Must be called with fc_lock held. */
+static void fc_node_unwatch (fc_directory_conf_t *dir, fc_node_t *node)
+{
+  if (node->wd < 0)
+    return;
+
+  c_avl_remove (dir->watches, &node->wd, NULL, NULL);
+  node->wd = -1;
+} /* void fc_node_unwatch */
 
-static int fc_read_dir_callback (const char *dirname, const char *filename,
-    void *user_data)
+/* Watches the directory of "node" for changes. This is done before the
+ * directory is read, so that changes made while it is being read cause it to
+ * be read again next time. Must be called with fc_lock held. */
+static void fc_node_watch (fc_directory_conf_t *dir, fc_node_t *node)
 {
-  fc_directory_conf_t *dir = user_data;
+#if HAVE_SYS_INOTIFY_H
   char abs_path[PATH_MAX];
-  struct stat statbuf;
-  int status;
+  fc_node_t *other = NULL;
+  int wd;
 
-  if (dir == NULL)
-    return (-1);
+  if (node->path[0] == 0)
+    sstrncpy (abs_path, dir->path, sizeof (abs_path));
+  else
+    ssnprintf (abs_path, sizeof (abs_path), "%s/%s", dir->path, node->path);
 
-  ssnprintf (abs_path, sizeof (abs_path), "%s/%s", dirname, filename);
+  wd = inotify_add_watch (dir->notify_fd, abs_path, FC_NOTIFY_EVENTS);
+  if (wd < 0)
+  {
+    char errbuf[1024];
+
+    if (!dir->notify_warned)
+      WARNING ("filecount plugin: inotify_add_watch (%s) failed: %s. "
+          "Directories which cannot be watched are read every time.",
+          abs_path, sstrerror (errno, errbuf, sizeof (errbuf)));
+    dir->notify_warned = 1;
+    fc_node_unwatch (dir, node);
+    return;
+  }
 
-  status = lstat (abs_path, &statbuf);
-  if (status != 0)
+  if (wd == node->wd)
+    return;
+  fc_node_unwatch (dir, node);
+
+  /* The same directory was watched under a different name before it was
+   * moved. The old node will be removed after this read. */
+  if (c_avl_get (dir->watches, &wd, (void *) &other) == 0)
+    fc_node_unwatch (dir, other);
+
+  node->wd = wd;
+  c_avl_insert (dir->watches, &node->wd, node);
+#endif
+} /* void fc_node_watch */
+
+/* Marks all directories which have changed since the last read as dirty. */
+static void fc_notify_read (fc_directory_conf_t *dir)
+{
+#if HAVE_SYS_INOTIFY_H
+  char buffer[4096]
+    __attribute__ ((aligned (__alignof__ (struct inotify_event))));
+  _Bool all_dirty = 0;
+  ssize_t len;
+
+  while ((len = read (dir->notify_fd, buffer, sizeof (buffer))) > 0)
   {
-    ERROR ("filecount plugin: stat (%s) failed.", abs_path);
-    return (-1);
+    char *ptr;
+
+    for (ptr = buffer; ptr < buffer + len; )
+    {
+      struct inotify_event *ev = (struct inotify_event *) ptr;
+      fc_node_t *node = NULL;
+
+      if (ev->mask & IN_Q_OVERFLOW)
+        all_dirty = 1;
+      else if (c_avl_get (dir->watches, &ev->wd, (void *) &node) == 0)
+      {
+        node->dirty = 1;
+        if (ev->mask & IN_IGNORED)
+          fc_node_unwatch (dir, node);
+      }
+
+      ptr += sizeof (*ev) + ev->len;
+    }
   }
 
-  if (S_ISDIR (statbuf.st_mode) && (dir->options & FC_RECURSIVE))
+  if (cdtime () - dir->last_rescan >= dir->rescan_interval)
   {
-    status = walk_directory (abs_path, fc_read_dir_callback, dir,
-        /* include hidden = */ (dir->options & FC_HIDDEN) ? 1 : 0);
-    return (status);
+    all_dirty = 1;
+    dir->last_rescan = cdtime ();
   }
-  else if (!S_ISREG (statbuf.st_mode))
+
+  if (all_dirty)
   {
-    return (0);
+    c_avl_iterator_t *iter = c_avl_get_iterator (dir->nodes);
+    fc_node_t *node;
+    char *path;
+
+    while (c_avl_iterator_next (iter, (void *) &path, (void *) &node) == 0)
+      node->dirty = 1;
+    c_avl_iterator_destroy (iter);
   }
+#endif
+} /* void fc_notify_read */
+
+/* Removes the nodes of directories which no longer exist. */
+static void fc_nodes_expire (fc_directory_conf_t *dir)
+{
+  c_avl_iterator_t *iter;
+  fc_node_t **expired = NULL;
+  size_t expired_num = 0;
+  fc_node_t *node;
+  char *path;
+  size_t i;
 
-  if (dir->name != NULL)
+  iter = c_avl_get_iterator (dir->nodes);
+  while (c_avl_iterator_next (iter, (void *) &path, (void *) &node) == 0)
   {
-    status = fnmatch (dir->name, filename, /* flags = */ 0);
-    if (status != 0)
-      return (0);
+    fc_node_t **tmp;
+
+    if (node->generation == dir->generation)
+      continue;
+
+    tmp = realloc (expired, (expired_num + 1) * sizeof (*expired));
+    if (tmp == NULL)
+      break;
+    expired = tmp;
+    expired[expired_num++] = node;
   }
+  c_avl_iterator_destroy (iter);
 
+  for (i = 0; i < expired_num; i++)
+  {
+    node = expired[i];
+    c_avl_remove (dir->nodes, node->path, NULL, NULL);
+#if HAVE_SYS_INOTIFY_H
+    if (node->wd >= 0)
+      inotify_rm_watch (dir->notify_fd, node->wd);
+#endif
+    fc_node_unwatch (dir, node);
+    fc_node_free (node);
+  }
+  sfree (expired);
+} /* void fc_nodes_expire */
+
+/* Adds a directory to the work queue. Takes ownership of "path". */
+static int fc_work_push (fc_directory_conf_t *dir, char *path)
+{
+  pthread_mutex_lock (&fc_lock);
+  if (work_queue_num >= work_queue_size)
+  {
+    size_t size = (work_queue_size == 0) ? 64 : 2 * work_queue_size;
+    fc_work_t *tmp;
+
+    tmp = realloc (work_queue, size * sizeof (*work_queue));
+    if (tmp == NULL)
+    {
+      pthread_mutex_unlock (&fc_lock);
+      ERROR ("filecount plugin: realloc failed.");
+      sfree (path);
+      return (-1);
+    }
+    work_queue = tmp;
+    work_queue_size = size;
+  }
+
+  work_queue[work_queue_num].dir = dir;
+  work_queue[work_queue_num].path = path;
+  work_queue_num++;
+  work_pending++;
+  pthread_cond_signal (&fc_cond);
+  pthread_mutex_unlock (&fc_lock);
+
+  return (0);
+} /* int fc_work_push */
+
+static int fc_push_subdir (fc_directory_conf_t *dir, const char *path,
+    const char *name)
+{
+  char buffer[PATH_MAX];
+  char *subdir;
+
+  if (path[0] == 0)
+    sstrncpy (buffer, name, sizeof (buffer));
+  else
+    ssnprintf (buffer, sizeof (buffer), "%s/%s", path, name);
+
+  subdir = strdup (buffer);
+  if (subdir == NULL)
+    return (-1);
+
+  return (fc_work_push (dir, subdir));
+} /* int fc_push_subdir */
+
+/* Checks the selectors. Returns non-zero if the file is to be counted. */
+static int fc_match_stat (const fc_directory_conf_t *dir,
+    const struct stat *statbuf)
+{
   if (dir->mtime != 0)
   {
     time_t mtime = dir->now;
@@ -504,12 +796,8 @@ static int fc_read_dir_callback (const char *dirname, const char *filename,
     else
       mtime -= dir->mtime;
 
-    DEBUG ("filecount plugin: Only collecting files that were touched %s %u.",
-        (dir->mtime < 0) ? "after" : "before",
-        (unsigned int) mtime);
-
-    if (((dir->mtime < 0) && (statbuf.st_mtime < mtime))
-        || ((dir->mtime > 0) && (statbuf.st_mtime > mtime)))
+    if (((dir->mtime < 0) && (statbuf->st_mtime < mtime))
+        || ((dir->mtime > 0) && (statbuf->st_mtime > mtime)))
       return (0);
   }
 
@@ -522,34 +810,308 @@ static int fc_read_dir_callback (const char *dirname, const char *filename,
     else
       size = (off_t) dir->size;
 
-    if (((dir->size < 0) && (statbuf.st_size > size))
-        || ((dir->size > 0) && (statbuf.st_size < size)))
+    if (((dir->size < 0) && (statbuf->st_size > size))
+        || ((dir->size > 0) && (statbuf->st_size < size)))
       return (0);
   }
 
-  dir->files_num++;
-  dir->files_size += (uint64_t) statbuf.st_size;
+  return (1);
+} /* int fc_match_stat */
+
+/* Counts the files in a single directory and queues its subdirectories. The
+ * directory is opened relative to the configured directory and files are
+ * stat'ed relative to the directory, so that paths are resolved only once per
+ * directory. The file type reported by readdir(3) saves stat'ing directories
+ * and files not matching "Name". */
+static void fc_scan_dir (fc_directory_conf_t *dir, const char *path)
+{
+  fc_node_t *node = NULL;
+  uint64_t files_num = 0;
+  uint64_t files_size = 0;
+  char **subdirs = NULL;
+  size_t subdirs_num = 0;
+  struct dirent *ent;
+  DIR *dh;
+  int fd;
+
+  if (dir->options & FC_INCREMENTAL)
+  {
+    pthread_mutex_lock (&fc_lock);
+    node = fc_node_get (dir, path);
+    if ((node != NULL) && !node->dirty && (node->wd >= 0))
+    {
+      size_t i;
+
+      node->generation = dir->generation;
+      dir->files_num += node->files_num;
+      dir->files_size += node->files_size;
+      pthread_mutex_unlock (&fc_lock);
+
+      /* Subdirectories are only modified by fc_scan_dir for the same path,
+       * i.e. by this thread. */
+      for (i = 0; i < node->subdirs_num; i++)
+        fc_push_subdir (dir, path, node->subdirs[i]);
+      return;
+    }
+    if (node != NULL)
+      fc_node_watch (dir, node);
+    pthread_mutex_unlock (&fc_lock);
+  }
+
+  fd = openat (dir->root_fd, (path[0] != 0) ? path : ".",
+      O_RDONLY | O_DIRECTORY | O_NOFOLLOW);
+  if ((fd < 0) || ((dh = fdopendir (fd)) == NULL))
+  {
+    char errbuf[1024];
+    if (errno != ENOENT)
+      ERROR ("filecount plugin: Cannot open `%s/%s': %s", dir->path, path,
+          sstrerror (errno, errbuf, sizeof (errbuf)));
+    if (fd >= 0)
+      close (fd);
+    return;
+  }
+
+  while ((ent = readdir (dh)) != NULL)
+  {
+    struct stat statbuf;
+    _Bool have_stat = 0;
+    _Bool is_dir = 0;
+    _Bool is_reg = 0;
+
+    if (dir->options & FC_HIDDEN)
+    {
+      if ((strcmp (".", ent->d_name) == 0)
+          || (strcmp ("..", ent->d_name) == 0))
+        continue;
+    }
+    else if (ent->d_name[0] == '.')
+      continue;
+
+#ifdef DT_UNKNOWN
+    if (ent->d_type == DT_DIR)
+      is_dir = 1;
+    else if (ent->d_type == DT_REG)
+      is_reg = 1;
+    else if (ent->d_type != DT_UNKNOWN)
+      continue;
+    else
+#endif
+    {
+      if (fstatat (fd, ent->d_name, &statbuf, AT_SYMLINK_NOFOLLOW) != 0)
+      {
+        char errbuf[1024];
+        /* Files disappear all the time in spool directories. */
+        if (errno != ENOENT)
+          ERROR ("filecount plugin: stat (%s/%s/%s) failed: %s", dir->path,
+              path, ent->d_name, sstrerror (errno, errbuf, sizeof (errbuf)));
+        continue;
+      }
+      have_stat = 1;
+      is_dir = S_ISDIR (statbuf.st_mode) ? 1 : 0;
+      is_reg = S_ISREG (statbuf.st_mode) ? 1 : 0;
+    }
+
+    if (is_dir)
+    {
+      if (!(dir->options & FC_RECURSIVE))
+        continue;
+
+      if (node != NULL)
+      {
+        char **tmp = realloc (subdirs, (subdirs_num + 1) * sizeof (*subdirs));
+        if (tmp != NULL)
+        {
+          subdirs = tmp;
+          subdirs[subdirs_num] = strdup (ent->d_name);
+          if (subdirs[subdirs_num] != NULL)
+            subdirs_num++;
+        }
+      }
+      fc_push_subdir (dir, path, ent->d_name);
+      continue;
+    }
+    else if (!is_reg)
+      continue;
+
+    if ((dir->name != NULL)
+        && (fnmatch (dir->name, ent->d_name, /* flags = */ 0) != 0))
+      continue;
+
+    if (!have_stat)
+    {
+      if (fstatat (fd, ent->d_name, &statbuf, AT_SYMLINK_NOFOLLOW) != 0)
+      {
+        char errbuf[1024];
+        if (errno != ENOENT)
+          ERROR ("filecount plugin: stat (%s/%s/%s) failed: %s", dir->path,
+              path, ent->d_name, sstrerror (errno, errbuf, sizeof (errbuf)));
+        continue;
+      }
+      if (!S_ISREG (statbuf.st_mode))
+        continue;
+    }
+
+    if (!fc_match_stat (dir, &statbuf))
+      continue;
+
+    files_num++;
+    files_size += (uint64_t) statbuf.st_size;
+  } /* while (readdir) */
+
+  closedir (dh);
+
+  pthread_mutex_lock (&fc_lock);
+  dir->files_num += files_num;
+  dir->files_size += files_size;
+  if (node != NULL)
+  {
+    size_t i;
+
+    for (i = 0; i < node->subdirs_num; i++)
+      sfree (node->subdirs[i]);
+    sfree (node->subdirs);
+
+    node->files_num = files_num;
+    node->files_size = files_size;
+    node->subdirs = subdirs;
+    node->subdirs_num = subdirs_num;
+    node->generation = dir->generation;
+    node->dirty = 0;
+  }
+  pthread_mutex_unlock (&fc_lock);
+} /* void fc_scan_dir */
+
+/* Processes queued directories. If "until_done" is true, returns as soon as
+ * all work is done; otherwise only when the plugin shuts down. */
+static void fc_work_run (_Bool until_done)
+{
+  pthread_mutex_lock (&fc_lock);
+  while (42)
+  {
+    fc_work_t work;
+
+    while ((work_queue_num == 0) && !workers_stop
+        && !(until_done && (work_pending == 0)))
+      pthread_cond_wait (&fc_cond, &fc_lock);
+
+    if (work_queue_num == 0)
+      break;
+
+    work = work_queue[--work_queue_num];
+    pthread_mutex_unlock (&fc_lock);
+
+    fc_scan_dir (work.dir, work.path);
+    sfree (work.path);
+
+    pthread_mutex_lock (&fc_lock);
+    work_pending--;
+    if (work_pending == 0)
+      pthread_cond_broadcast (&fc_cond);
+  }
+  pthread_mutex_unlock (&fc_lock);
+} /* void fc_work_run */
+
+static void *fc_worker (void __attribute__((unused)) *arg)
+{
+  fc_work_run (/* until_done = */ 0);
+  return (NULL);
+} /* void *fc_worker */
+
+static int fc_init (void)
+{
+  size_t i;
+
+  if (directories_num < 1)
+  {
+    WARNING ("filecount plugin: No directories have been configured.");
+    return (-1);
+  }
+
+  for (i = 0; i < directories_num; i++)
+  {
+    fc_directory_conf_t *dir = directories[i];
+
+    if (!(dir->options & FC_INCREMENTAL) || (dir->nodes != NULL))
+      continue;
+
+    dir->nodes = c_avl_create ((void *) strcmp);
+    dir->watches = c_avl_create (fc_compare_wd);
+#if HAVE_SYS_INOTIFY_H
+    dir->notify_fd = inotify_init1 (IN_NONBLOCK | IN_CLOEXEC);
+#endif
+    if ((dir->nodes == NULL) || (dir->watches == NULL)
+        || (dir->notify_fd < 0))
+    {
+      ERROR ("filecount plugin: Setting up the incremental mode for `%s' "
+          "failed. Reading it completely every time.", dir->path);
+      dir->options &= ~FC_INCREMENTAL;
+    }
+  }
+
+  /* The read thread is one of the scanning threads. */
+  if ((workers == NULL) && (threads_num > 1))
+  {
+    workers = calloc ((size_t) threads_num - 1, sizeof (*workers));
+    if (workers == NULL)
+    {
+      ERROR ("filecount plugin: calloc failed.");
+      return (-1);
+    }
+
+    for (i = 0; i < (size_t) threads_num - 1; i++)
+    {
+      if (plugin_thread_create (workers + workers_num, NULL,
+            fc_worker, NULL) != 0)
+      {
+        ERROR ("filecount plugin: Starting a worker thread failed.");
+        break;
+      }
+      workers_num++;
+    }
+  }
 
   return (0);
-} /* int fc_read_dir_callback */
+} /* int fc_init */
 
 static int fc_read_dir (fc_directory_conf_t *dir)
 {
-  int status;
+  char *root;
 
   dir->files_num = 0;
   dir->files_size = 0;
 
   if (dir->mtime != 0)
     dir->now = time (NULL);
-    
-  status = walk_directory (dir->path, fc_read_dir_callback, dir,
-      /* include hidden */ (dir->options & FC_HIDDEN) ? 1 : 0);
-  if (status != 0)
+
+  dir->root_fd = open (dir->path, O_RDONLY | O_DIRECTORY);
+  if (dir->root_fd < 0)
+  {
+    char errbuf[1024];
+    WARNING ("filecount plugin: Cannot open `%s': %s", dir->path,
+        sstrerror (errno, errbuf, sizeof (errbuf)));
+    return (-1);
+  }
+
+  if (dir->options & FC_INCREMENTAL)
+  {
+    fc_notify_read (dir);
+    dir->generation++;
+  }
+
+  root = strdup ("");
+  if ((root == NULL) || (fc_work_push (dir, root) != 0))
   {
-    WARNING ("filecount plugin: walk_directory (%s) failed.", dir->path);
+    close (dir->root_fd);
+    dir->root_fd = -1;
     return (-1);
   }
+  fc_work_run (/* until_done = */ 1);
+
+  close (dir->root_fd);
+  dir->root_fd = -1;
+
+  if (dir->options & FC_INCREMENTAL)
+    fc_nodes_expire (dir);
 
   fc_submit_dir (dir);
 
@@ -566,11 +1128,54 @@ static int fc_read (void)
   return (0);
 } /* int fc_read */
 
+static int fc_shutdown (void)
+{
+  size_t i;
+
+  pthread_mutex_lock (&fc_lock);
+  workers_stop = 1;
+  pthread_cond_broadcast (&fc_cond);
+  pthread_mutex_unlock (&fc_lock);
+
+  for (i = 0; i < workers_num; i++)
+    pthread_join (workers[i], NULL);
+  sfree (workers);
+  workers_num = 0;
+  sfree (work_queue);
+  work_queue_size = 0;
+
+  for (i = 0; i < directories_num; i++)
+  {
+    fc_directory_conf_t *dir = directories[i];
+    fc_node_t *node;
+    char *path;
+
+    if (dir->nodes != NULL)
+    {
+      while (c_avl_pick (dir->nodes, (void *) &path, (void *) &node) == 0)
+        fc_node_free (node);
+      c_avl_destroy (dir->nodes);
+      dir->nodes = NULL;
+    }
+    if (dir->watches != NULL)
+    {
+      c_avl_destroy (dir->watches);
+      dir->watches = NULL;
+    }
+    if (dir->notify_fd >= 0)
+      close (dir->notify_fd);
+    dir->notify_fd = -1;
+  }
+
+  return (0);
+} /* int fc_shutdown */
+
 void module_register (void)
 {
   plugin_register_complex_config ("filecount", fc_config);
   plugin_register_init ("filecount", fc_init);
   plugin_register_read ("filecount", fc_read);
+  plugin_register_shutdown ("filecount", fc_shutdown);
 } /* void module_register */
 
 /*
@@ -28,6 +28,10 @@
 #include "configfile.h"
 #include "utils_ignorelist.h"
 
+#if KERNEL_LINUX
+# include "utils_procfs.h"
+#endif
+
 #if HAVE_SYS_TYPES_H
 #  include <sys/types.h>
 #endif
@@ -67,6 +71,21 @@
 # endif /* !COLLECT_GETIFADDRS */
 #endif /* KERNEL_LINUX */
 
+/*
+ * On Linux the counters of all interfaces are requested with a single
+ * rtnetlink dump if libmnl is available. This avoids formatting and parsing
+ * /proc/net/dev, which gets expensive with thousands of (virtual) interfaces.
+ * /proc/net/dev is still used if the netlink socket cannot be opened.
+ */
+#if KERNEL_LINUX && HAVE_LIBMNL && !HAVE_GETIFADDRS
+# define COLLECT_NETLINK 1
+# include <linux/netlink.h>
+# include <linux/rtnetlink.h>
+# include <libmnl/libmnl.h>
+#else
+# define COLLECT_NETLINK 0
+#endif
+
 #if HAVE_PERFSTAT
 static perfstat_netinterface_t *ifstat;
 static int nif;
@@ -90,6 +109,15 @@ static int config_keys_num = 2;
 
 static ignorelist_t *ignorelist = NULL;
 
+#if COLLECT_NETLINK
+/* The kernel fills dump replies up to the size of the receive buffer, but
+ * not beyond 32 kByte. */
+# define IF_NL_BUFFER_SIZE 32768
+
+static struct mnl_socket *if_nl = NULL;
+static unsigned int if_nl_seq = 0;
+#endif /* COLLECT_NETLINK */
+
 #ifdef HAVE_LIBKSTAT
 #define MAX_NUMIF 256
 extern kstat_ctl_t *kc;
@@ -161,9 +189,11 @@ static int interface_init (void)
 } /* int interface_init */
 #endif /* HAVE_LIBKSTAT */
 
+/* `t' is the time the counters were read or zero for "now". */
 static void if_submit (const char *dev, const char *type,
 		derive_t rx,
-		derive_t tx)
+		derive_t tx,
+		cdtime_t t)
 {
 	value_t values[2];
 	value_list_t vl = VALUE_LIST_INIT;
@@ -176,6 +206,7 @@ static void if_submit (const char *dev, const char *type,
 
 	vl.values = values;
 	vl.values_len = 2;
+	vl.time = t;
 	sstrncpy (vl.host, hostname_g, sizeof (vl.host));
 	sstrncpy (vl.plugin, "interface", sizeof (vl.plugin));
 	sstrncpy (vl.plugin_instance, dev, sizeof (vl.plugin_instance));
@@ -184,6 +215,218 @@ static void if_submit (const char *dev, const char *type,
 	plugin_dispatch_values (&vl);
 } /* void if_submit */
 
+#if KERNEL_LINUX
+static void if_submit_interface (procfs_interface_t const *ifp, cdtime_t t)
+{
+	if_submit (ifp->name, "if_octets", ifp->rx_bytes, ifp->tx_bytes, t);
+	if_submit (ifp->name, "if_packets", ifp->rx_packets, ifp->tx_packets, t);
+	if_submit (ifp->name, "if_errors", ifp->rx_errors, ifp->tx_errors, t);
+	if_submit (ifp->name, "if_dropped", ifp->rx_dropped, ifp->tx_dropped, t);
+} /* void if_submit_interface */
+#endif /* KERNEL_LINUX */
+
+#if COLLECT_NETLINK
+/* The "drop" column of /proc/net/dev includes the missed packets; do the
+ * same so the values don't jump when falling back to /proc/net/dev. */
+#define IF_NL_COPY_STATS(dst, src) do { \
+	(dst)->rx_bytes   = (derive_t) (src).rx_bytes;   \
+	(dst)->rx_packets = (derive_t) (src).rx_packets; \
+	(dst)->rx_errors  = (derive_t) (src).rx_errors;  \
+	(dst)->rx_dropped = (derive_t) ((src).rx_dropped \
+			+ (src).rx_missed_errors); \
+	(dst)->tx_bytes   = (derive_t) (src).tx_bytes;   \
+	(dst)->tx_packets = (derive_t) (src).tx_packets; \
+	(dst)->tx_errors  = (derive_t) (src).tx_errors;  \
+	(dst)->tx_dropped = (derive_t) (src).tx_dropped; \
+} while (0)
+
+/* Copies name and counters of a RTM_NEWLINK message to `ifp'. The attributes
+ * are walked once; the 64 bit counters are preferred over the 32 bit ones,
+ * regardless of their order. Returns ENOENT if the message doesn't contain
+ * any counters. */
+static int if_nl_parse_link (struct nlmsghdr const *nlh,
+		procfs_interface_t *ifp)
+{
+	struct nlattr const *attr;
+	_Bool have_name = 0;
+	_Bool have_stats = 0;
+	_Bool have_stats64 = 0;
+
+	if (nlh->nlmsg_type != RTM_NEWLINK)
+		return (EINVAL);
+
+	mnl_attr_for_each (attr, nlh, sizeof (struct ifinfomsg))
+	{
+		switch (mnl_attr_get_type (attr))
+		{
+			case IFLA_IFNAME:
+				if (mnl_attr_validate (attr, MNL_TYPE_STRING) < 0)
+					return (EINVAL);
+				sstrncpy (ifp->name, mnl_attr_get_str (attr),
+						sizeof (ifp->name));
+				have_name = 1;
+				break;
+
+#if HAVE_RTNL_LINK_STATS64
+			case IFLA_STATS64:
+			{
+				struct rtnl_link_stats64 s;
+
+				if (mnl_attr_validate2 (attr, MNL_TYPE_UNSPEC, sizeof (s)) < 0)
+					return (EINVAL);
+				/* The payload is only four byte aligned. */
+				memcpy (&s, mnl_attr_get_payload (attr), sizeof (s));
+				IF_NL_COPY_STATS (ifp, s);
+				have_stats64 = 1;
+				break;
+			}
+#endif
+
+			case IFLA_STATS:
+			{
+				struct rtnl_link_stats s;
+
+				if (have_stats64)
+					break;
+				if (mnl_attr_validate2 (attr, MNL_TYPE_UNSPEC, sizeof (s)) < 0)
+					return (EINVAL);
+				memcpy (&s, mnl_attr_get_payload (attr), sizeof (s));
+				IF_NL_COPY_STATS (ifp, s);
+				have_stats = 1;
+				break;
+			}
+		}
+	}
+
+	if (!have_name)
+		return (EINVAL);
+	if (!have_stats && !have_stats64)
+		return (ENOENT);
+	return (0);
+} /* int if_nl_parse_link */
+
+static int if_nl_link_cb (struct nlmsghdr const *nlh, void *data)
+{
+	cdtime_t const *t = data;
+	procfs_interface_t ifp;
+	int status;
+
+	status = if_nl_parse_link (nlh, &ifp);
+	if (status == ENOENT)
+	{
+		DEBUG ("interface plugin: No statistics for interface %s.", ifp.name);
+		return (MNL_CB_OK);
+	}
+	else if (status != 0)
+	{
+		ERROR ("interface plugin: Parsing RTM_NEWLINK message failed.");
+		return (MNL_CB_ERROR);
+	}
+
+	if_submit_interface (&ifp, *t);
+	return (MNL_CB_OK);
+} /* int if_nl_link_cb */
+
+static int if_nl_open (void)
+{
+	if_nl = mnl_socket_open (NETLINK_ROUTE);
+	if (if_nl == NULL)
+		return (-1);
+
+	if (mnl_socket_bind (if_nl, 0, MNL_SOCKET_AUTOPID) < 0)
+	{
+		int status = errno;
+		mnl_socket_close (if_nl);
+		if_nl = NULL;
+		errno = status;
+		return (-1);
+	}
+
+	return (0);
+} /* int if_nl_open */
+
+static void if_nl_close (void)
+{
+	if (if_nl == NULL)
+		return;
+
+	mnl_socket_close (if_nl);
+	if_nl = NULL;
+} /* void if_nl_close */
+
+/* Requests a dump of all links and dispatches their counters. The socket is
+ * kept open across reads. */
+static int if_nl_read (void)
+{
+	char buffer[IF_NL_BUFFER_SIZE];
+	struct nlmsghdr *nlh;
+	struct rtgenmsg *rt;
+	unsigned int seq;
+	unsigned int portid;
+	cdtime_t t;
+	ssize_t status;
+
+	portid = mnl_socket_get_portid (if_nl);
+
+	nlh = mnl_nlmsg_put_header (buffer);
+	nlh->nlmsg_type = RTM_GETLINK;
+	nlh->nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+	nlh->nlmsg_seq = seq = ++if_nl_seq;
+	rt = mnl_nlmsg_put_extra_header (nlh, sizeof (*rt));
+	rt->rtgen_family = AF_PACKET;
+
+	t = cdtime ();
+	if (mnl_socket_sendto (if_nl, nlh, nlh->nlmsg_len) < 0)
+	{
+		char errbuf[1024];
+		ERROR ("interface plugin: mnl_socket_sendto failed: %s",
+				sstrerror (errno, errbuf, sizeof (errbuf)));
+		return (-1);
+	}
+
+	status = mnl_socket_recvfrom (if_nl, buffer, sizeof (buffer));
+	while (status > 0)
+	{
+		status = mnl_cb_run (buffer, (size_t) status, seq, portid,
+				if_nl_link_cb, &t);
+		if (status <= MNL_CB_STOP)
+			break;
+		status = mnl_socket_recvfrom (if_nl, buffer, sizeof (buffer));
+	}
+	if (status < 0)
+	{
+		char errbuf[1024];
+		ERROR ("interface plugin: Receiving the link dump failed: %s",
+				sstrerror (errno, errbuf, sizeof (errbuf)));
+		return (-1);
+	}
+
+	return (0);
+} /* int if_nl_read */
+
+static int interface_init (void)
+{
+	if (if_nl != NULL)
+		return (0);
+
+	if (if_nl_open () != 0)
+	{
+		char errbuf[1024];
+		INFO ("interface plugin: Opening the netlink socket failed: %s. "
+				"Reading /proc/net/dev instead.",
+				sstrerror (errno, errbuf, sizeof (errbuf)));
+	}
+
+	return (0);
+} /* int interface_init */
+
+static int interface_shutdown (void)
+{
+	if_nl_close ();
+	return (0);
+} /* int interface_shutdown */
+#endif /* COLLECT_NETLINK */
+
 static int interface_read (void)
 {
 #if HAVE_GETIFADDRS
@@ -225,13 +468,13 @@ static int interface_read (void)
 
 			if_submit (if_ptr->ifa_name, "if_octets",
 				if_data->IFA_RX_BYTES,
-				if_data->IFA_TX_BYTES);
+				if_data->IFA_TX_BYTES, 0);
 			if_submit (if_ptr->ifa_name, "if_packets",
 				if_data->IFA_RX_PACKT,
-				if_data->IFA_TX_PACKT);
+				if_data->IFA_TX_PACKT, 0);
 			if_submit (if_ptr->ifa_name, "if_errors",
 				if_data->IFA_RX_ERROR,
-				if_data->IFA_TX_ERROR);
+				if_data->IFA_TX_ERROR, 0);
 		}
 	}
 
@@ -239,60 +482,35 @@ static int interface_read (void)
 /* #endif HAVE_GETIFADDRS */
 
 #elif KERNEL_LINUX
-	FILE *fh;
-	char buffer[1024];
-	derive_t incoming, outgoing;
-	char *device;
+	procfs_netdev_t const *nd;
+	size_t i;
+
+#if COLLECT_NETLINK
+	if (if_nl != NULL)
+	{
+		if (if_nl_read () == 0)
+			return (0);
 
-	char *dummy;
-	char *fields[16];
-	int numfields;
+		/* Part of the dump may be left in the socket: don't reuse it. */
+		ERROR ("interface plugin: Reading the interface statistics via "
+				"netlink failed. Reading /proc/net/dev from now on.");
+		if_nl_close ();
+		return (-1);
+	}
+#endif /* COLLECT_NETLINK */
 
-	if ((fh = fopen ("/proc/net/dev", "r")) == NULL)
+	if ((nd = procfs_netdev_acquire ()) == NULL)
 	{
 		char errbuf[1024];
-		WARNING ("interface plugin: fopen: %s",
+		WARNING ("interface plugin: reading /proc/net/dev failed: %s",
 				sstrerror (errno, errbuf, sizeof (errbuf)));
 		return (-1);
 	}
 
-	while (fgets (buffer, 1024, fh) != NULL)
-	{
-		if (!(dummy = strchr(buffer, ':')))
-			continue;
-		dummy[0] = '\0';
-		dummy++;
-
-		device = buffer;
-		while (device[0] == ' ')
-			device++;
+	for (i = 0; i < nd->interface_num; i++)
+		if_submit_interface (nd->interface + i, nd->time);
 
-		if (device[0] == '\0')
-			continue;
-
-		numfields = strsplit (dummy, fields, 16);
-
-		if (numfields < 11)
-			continue;
-
-		incoming = atoll (fields[0]);
-		outgoing = atoll (fields[8]);
-		if_submit (device, "if_octets", incoming, outgoing);
-
-		incoming = atoll (fields[1]);
-		outgoing = atoll (fields[9]);
-		if_submit (device, "if_packets", incoming, outgoing);
-
-		incoming = atoll (fields[2]);
-		outgoing = atoll (fields[10]);
-		if_submit (device, "if_errors", incoming, outgoing);
-
-		incoming = atoll (fields[3]);
-		outgoing = atoll (fields[11]);
-		if_submit (device, "if_dropped", incoming, outgoing);
-	}
-
-	fclose (fh);
+	procfs_release (nd);
 /* #endif KERNEL_LINUX */
 
 #elif HAVE_LIBKSTAT
@@ -323,7 +541,7 @@ static int interface_read (void)
 		if (tx == -1LL)
 			tx = get_kstat_value (ksp[i], "obytes");
 		if ((rx != -1LL) || (tx != -1LL))
-			if_submit (iname, "if_octets", rx, tx);
+			if_submit (iname, "if_octets", rx, tx, 0);
 
 		/* try to get 64bit counters */
 		rx = get_kstat_value (ksp[i], "ipackets64");
@@ -334,13 +552,13 @@ static int interface_read (void)
 		if (tx == -1LL)
 			tx = get_kstat_value (ksp[i], "opackets");
 		if ((rx != -1LL) || (tx != -1LL))
-			if_submit (iname, "if_packets", rx, tx);
+			if_submit (iname, "if_packets", rx, tx, 0);
 
 		/* no 64bit error counters yet */
 		rx = get_kstat_value (ksp[i], "ierrors");
 		tx = get_kstat_value (ksp[i], "oerrors");
 		if ((rx != -1LL) || (tx != -1LL))
-			if_submit (iname, "if_errors", rx, tx);
+			if_submit (iname, "if_errors", rx, tx, 0);
 	}
 /* #endif HAVE_LIBKSTAT */
 
@@ -351,7 +569,7 @@ static int interface_read (void)
 	ios = sg_get_network_io_stats (&num);
 
 	for (i = 0; i < num; i++)
-		if_submit (ios[i].interface_name, "if_octets", ios[i].rx, ios[i].tx);
+		if_submit (ios[i].interface_name, "if_octets", ios[i].rx, ios[i].tx, 0);
 /* #endif HAVE_LIBSTATGRAB */
 
 #elif defined(HAVE_PERFSTAT)
@@ -385,9 +603,9 @@ static int interface_read (void)
 
 	for (i = 0; i < ifs; i++)
 	{
-		if_submit (ifstat[i].name, "if_octets", ifstat[i].ibytes, ifstat[i].obytes);
-		if_submit (ifstat[i].name, "if_packets", ifstat[i].ipackets ,ifstat[i].opackets);
-		if_submit (ifstat[i].name, "if_errors", ifstat[i].ierrors, ifstat[i].oerrors );
+		if_submit (ifstat[i].name, "if_octets", ifstat[i].ibytes, ifstat[i].obytes, 0);
+		if_submit (ifstat[i].name, "if_packets", ifstat[i].ipackets ,ifstat[i].opackets, 0);
+		if_submit (ifstat[i].name, "if_errors", ifstat[i].ierrors, ifstat[i].oerrors, 0);
 	}
 #endif /* HAVE_PERFSTAT */
 
@@ -398,8 +616,11 @@ void module_register (void)
 {
 	plugin_register_config ("interface", interface_config,
 			config_keys, config_keys_num);
-#if HAVE_LIBKSTAT
+#if HAVE_LIBKSTAT || COLLECT_NETLINK
 	plugin_register_init ("interface", interface_init);
+#endif
+#if COLLECT_NETLINK
+	plugin_register_shutdown ("interface", interface_shutdown);
 #endif
 	plugin_register_read ("interface", interface_read);
 } /* void module_register */
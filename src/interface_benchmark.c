@@ -0,0 +1,432 @@
+/**
+ * collectd - src/interface_benchmark.c
+ * Copyright (C) 2026       agent
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   agent <agent at local>
+ */
+
+/*
+ * Compares how fast the interface plugin parses the counters of many
+ * interfaces, e.g. the veth devices of a host running lots of containers, from
+ * the text of /proc/net/dev and from a rtnetlink link dump.
+ * Usage: benchmark_interface [<iterations> [<interfaces>]]
+ * The input is generated: by default 5000 interfaces. The netlink messages
+ * carry, besides the counters, a few attributes to get roughly the size the
+ * kernel sends for a veth device.
+ */
+
+#include "interface.c" /* sic */
+
+#include <time.h>
+
+struct buffer_s
+{
+  char *data;
+  size_t len;
+  size_t size;
+};
+typedef struct buffer_s buffer_t;
+
+/* The counters the kernel keeps per device, see struct rtnl_link_stats64 in
+ * <linux/if_link.h>. */
+struct link_stats_s
+{
+  uint64_t rx_packets;
+  uint64_t tx_packets;
+  uint64_t rx_bytes;
+  uint64_t tx_bytes;
+  uint64_t rx_errors;
+  uint64_t tx_errors;
+  uint64_t rx_dropped;
+  uint64_t tx_dropped;
+  uint64_t multicast;
+  uint64_t collisions;
+  uint64_t rx_length_errors;
+  uint64_t rx_over_errors;
+  uint64_t rx_crc_errors;
+  uint64_t rx_frame_errors;
+  uint64_t rx_fifo_errors;
+  uint64_t rx_missed_errors;
+  uint64_t tx_aborted_errors;
+  uint64_t tx_carrier_errors;
+  uint64_t tx_fifo_errors;
+  uint64_t tx_heartbeat_errors;
+  uint64_t tx_window_errors;
+  uint64_t rx_compressed;
+  uint64_t tx_compressed;
+};
+typedef struct link_stats_s link_stats_t;
+
+struct sum_s
+{
+  unsigned long interfaces;
+  uint64_t rx_bytes;
+  uint64_t rx_packets;
+  uint64_t rx_errors;
+  uint64_t rx_dropped;
+  uint64_t tx_bytes;
+  uint64_t tx_packets;
+  uint64_t tx_errors;
+  uint64_t tx_dropped;
+};
+typedef struct sum_s sum_t;
+
+static double now (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ((double) ts.tv_sec) + ((double) ts.tv_nsec) / 1e9;
+}
+
+static void *xrealloc (void *ptr, size_t size)
+{
+  ptr = realloc (ptr, size);
+  if (ptr == NULL)
+  {
+    fprintf (stderr, "realloc failed\n");
+    exit (EXIT_FAILURE);
+  }
+  return (ptr);
+}
+
+/* Counters of the synthetic interface `i'. Every counter gets a different
+ * value, so mixing up fields is noticed. */
+static void interface_counters (int i, link_stats_t *ls)
+{
+  uint64_t *c = (uint64_t *) ls;
+  size_t j;
+
+  for (j = 0; j < sizeof (*ls) / sizeof (*c); j++)
+    c[j] = (uint64_t) i * 1000003ULL + (uint64_t) j * 7919ULL + 1;
+#if HAVE_RTNL_LINK_STATS64
+  /* Exceeds the 32 bit counters. */
+  ls->rx_bytes += 5000000000ULL;
+#endif
+}
+
+static void sum_add (sum_t *sum, procfs_interface_t const *ifp)
+{
+  sum->interfaces++;
+  sum->rx_bytes   += (uint64_t) ifp->rx_bytes;
+  sum->rx_packets += (uint64_t) ifp->rx_packets;
+  sum->rx_errors  += (uint64_t) ifp->rx_errors;
+  sum->rx_dropped += (uint64_t) ifp->rx_dropped;
+  sum->tx_bytes   += (uint64_t) ifp->tx_bytes;
+  sum->tx_packets += (uint64_t) ifp->tx_packets;
+  sum->tx_errors  += (uint64_t) ifp->tx_errors;
+  sum->tx_dropped += (uint64_t) ifp->tx_dropped;
+}
+
+static void generate_netdev (buffer_t *b, int interfaces_num)
+{
+  int i;
+
+  b->size = 256 + (size_t) interfaces_num * 256;
+  b->data = xrealloc (b->data, b->size);
+  b->len = (size_t) snprintf (b->data, b->size,
+      "Inter-|   Receive                                                |  Transmit\n"
+      " face |bytes    packets errs drop fifo frame compressed multicast|bytes    packets errs drop fifo colls carrier compressed\n");
+
+  /* The columns are calculated like dev_seq_printf_stats() in
+   * net/core/net-procfs.c does. */
+  for (i = 0; i < interfaces_num; i++)
+  {
+    link_stats_t ls;
+
+    interface_counters (i, &ls);
+    b->len += (size_t) snprintf (b->data + b->len, b->size - b->len,
+        "veth%05x: %"PRIu64" %"PRIu64" %"PRIu64" %"PRIu64" %"PRIu64" %"PRIu64
+        " %"PRIu64" %"PRIu64" %"PRIu64" %"PRIu64" %"PRIu64" %"PRIu64" %"PRIu64
+        " %"PRIu64" %"PRIu64" %"PRIu64"\n", (unsigned int) i,
+        ls.rx_bytes, ls.rx_packets, ls.rx_errors,
+        ls.rx_dropped + ls.rx_missed_errors,
+        ls.rx_fifo_errors,
+        ls.rx_length_errors + ls.rx_over_errors + ls.rx_crc_errors
+          + ls.rx_frame_errors,
+        ls.rx_compressed, ls.multicast,
+        ls.tx_bytes, ls.tx_packets, ls.tx_errors, ls.tx_dropped,
+        ls.tx_fifo_errors, ls.collisions,
+        ls.tx_carrier_errors + ls.tx_aborted_errors + ls.tx_window_errors
+          + ls.tx_heartbeat_errors,
+        ls.tx_compressed);
+  }
+}
+
+static double bench_netdev (buffer_t const *b, unsigned long iterations,
+    sum_t *sum)
+{
+  char *copy = xrealloc (NULL, b->len + 1);
+  double elapsed = 0.0;
+  unsigned long i;
+
+  for (i = 0; i < iterations; i++)
+  {
+    procfs_netdev_t nd;
+    double begin;
+    size_t j;
+
+    /* Parsing modifies the buffer. */
+    memcpy (copy, b->data, b->len + 1);
+
+    begin = now ();
+    memset (&nd, 0, sizeof (nd));
+    if (procfs_netdev_parse (&nd, copy) != 0)
+      exit (EXIT_FAILURE);
+    for (j = 0; j < nd.interface_num; j++)
+      sum_add (sum, nd.interface + j);
+    sfree (nd.interface);
+    elapsed += now () - begin;
+  }
+
+  sfree (copy);
+  return (elapsed);
+}
+
+#if COLLECT_NETLINK
+/* The dump as read from the socket: a number of datagrams of up to
+ * IF_NL_BUFFER_SIZE bytes each. */
+struct dump_s
+{
+  buffer_t *chunks;
+  size_t chunks_num;
+};
+typedef struct dump_s dump_t;
+
+static struct nlmsghdr *dump_put_header (dump_t *d, size_t size)
+{
+  buffer_t *b = (d->chunks_num == 0) ? NULL : d->chunks + d->chunks_num - 1;
+  struct nlmsghdr *nlh;
+
+  if ((b == NULL) || (b->size - b->len < size))
+  {
+    d->chunks = xrealloc (d->chunks, (d->chunks_num + 1) * sizeof (*d->chunks));
+    b = d->chunks + d->chunks_num;
+    d->chunks_num++;
+
+    b->size = IF_NL_BUFFER_SIZE;
+    b->len = 0;
+    b->data = calloc (1, b->size);
+    if (b->data == NULL)
+      exit (EXIT_FAILURE);
+  }
+
+  nlh = mnl_nlmsg_put_header (b->data + b->len);
+  nlh->nlmsg_seq = 1;
+  nlh->nlmsg_pid = 0;
+  return (nlh);
+}
+
+static void dump_commit (dump_t *d, struct nlmsghdr const *nlh)
+{
+  d->chunks[d->chunks_num - 1].len += MNL_ALIGN (nlh->nlmsg_len);
+}
+
+#define LINK_STATS_COPY(dst, src, type) do { \
+  memset ((dst), 0, sizeof (*(dst))); \
+  (dst)->rx_packets          = (type) (src)->rx_packets; \
+  (dst)->tx_packets          = (type) (src)->tx_packets; \
+  (dst)->rx_bytes            = (type) (src)->rx_bytes; \
+  (dst)->tx_bytes            = (type) (src)->tx_bytes; \
+  (dst)->rx_errors           = (type) (src)->rx_errors; \
+  (dst)->tx_errors           = (type) (src)->tx_errors; \
+  (dst)->rx_dropped          = (type) (src)->rx_dropped; \
+  (dst)->tx_dropped          = (type) (src)->tx_dropped; \
+  (dst)->multicast           = (type) (src)->multicast; \
+  (dst)->collisions          = (type) (src)->collisions; \
+  (dst)->rx_length_errors    = (type) (src)->rx_length_errors; \
+  (dst)->rx_over_errors      = (type) (src)->rx_over_errors; \
+  (dst)->rx_crc_errors       = (type) (src)->rx_crc_errors; \
+  (dst)->rx_frame_errors     = (type) (src)->rx_frame_errors; \
+  (dst)->rx_fifo_errors      = (type) (src)->rx_fifo_errors; \
+  (dst)->rx_missed_errors    = (type) (src)->rx_missed_errors; \
+  (dst)->tx_aborted_errors   = (type) (src)->tx_aborted_errors; \
+  (dst)->tx_carrier_errors   = (type) (src)->tx_carrier_errors; \
+  (dst)->tx_fifo_errors      = (type) (src)->tx_fifo_errors; \
+  (dst)->tx_heartbeat_errors = (type) (src)->tx_heartbeat_errors; \
+  (dst)->tx_window_errors    = (type) (src)->tx_window_errors; \
+  (dst)->rx_compressed       = (type) (src)->rx_compressed; \
+  (dst)->tx_compressed       = (type) (src)->tx_compressed; \
+} while (0)
+
+static void generate_dump (dump_t *d, int interfaces_num)
+{
+  /* Stands in for IFLA_AF_SPEC, IFLA_LINKINFO, IFLA_MAP etc. */
+  static char const filler[640];
+  static uint8_t const address[6] = { 0x02, 0x42, 0xac, 0x11, 0x00, 0x02 };
+  int i;
+
+  for (i = 0; i < interfaces_num; i++)
+  {
+    struct nlmsghdr *nlh;
+    struct ifinfomsg *ifm;
+    struct rtnl_link_stats stats32;
+#if HAVE_RTNL_LINK_STATS64
+    struct rtnl_link_stats64 stats64;
+#endif
+    char name[IFNAMSIZ];
+    link_stats_t ls;
+
+    interface_counters (i, &ls);
+    snprintf (name, sizeof (name), "veth%05x", (unsigned int) i);
+
+    nlh = dump_put_header (d, 2048);
+    nlh->nlmsg_type = RTM_NEWLINK;
+    nlh->nlmsg_flags = NLM_F_MULTI;
+    ifm = mnl_nlmsg_put_extra_header (nlh, sizeof (*ifm));
+    ifm->ifi_family = AF_UNSPEC;
+    ifm->ifi_index = i + 1;
+
+    mnl_attr_put_strz (nlh, IFLA_IFNAME, name);
+    mnl_attr_put_u32 (nlh, IFLA_TXQLEN, 1000);
+    mnl_attr_put_u32 (nlh, IFLA_MTU, 1500);
+    mnl_attr_put_u32 (nlh, IFLA_GROUP, 0);
+    mnl_attr_put_u32 (nlh, IFLA_PROMISCUITY, 0);
+    mnl_attr_put_u32 (nlh, IFLA_NUM_TX_QUEUES, 1);
+    mnl_attr_put_u32 (nlh, IFLA_NUM_RX_QUEUES, 1);
+    mnl_attr_put_strz (nlh, IFLA_QDISC, "noqueue");
+    mnl_attr_put (nlh, IFLA_ADDRESS, sizeof (address), address);
+    mnl_attr_put (nlh, IFLA_BROADCAST, sizeof (address), address);
+
+    /* The kernel sends the 64 bit counters first. */
+#if HAVE_RTNL_LINK_STATS64
+    LINK_STATS_COPY (&stats64, &ls, uint64_t);
+    mnl_attr_put (nlh, IFLA_STATS64, sizeof (stats64), &stats64);
+#endif
+    LINK_STATS_COPY (&stats32, &ls, uint32_t);
+    mnl_attr_put (nlh, IFLA_STATS, sizeof (stats32), &stats32);
+
+    mnl_attr_put (nlh, IFLA_AF_SPEC, sizeof (filler), filler);
+    dump_commit (d, nlh);
+  }
+
+  {
+    struct nlmsghdr *nlh = dump_put_header (d, MNL_NLMSG_HDRLEN + 4);
+    nlh->nlmsg_type = NLMSG_DONE;
+    nlh->nlmsg_flags = NLM_F_MULTI;
+    mnl_nlmsg_put_extra_header (nlh, 4);
+    dump_commit (d, nlh);
+  }
+}
+
+static int bench_link_cb (struct nlmsghdr const *nlh, void *data)
+{
+  procfs_interface_t ifp;
+
+  if (if_nl_parse_link (nlh, &ifp) != 0)
+    return (MNL_CB_ERROR);
+
+  sum_add (data, &ifp);
+  return (MNL_CB_OK);
+}
+
+static double bench_netlink (dump_t const *d, unsigned long iterations,
+    sum_t *sum)
+{
+  double begin = now ();
+  unsigned long i;
+
+  for (i = 0; i < iterations; i++)
+  {
+    size_t j;
+    int status = MNL_CB_OK;
+
+    for (j = 0; (j < d->chunks_num) && (status > MNL_CB_STOP); j++)
+      status = mnl_cb_run (d->chunks[j].data, d->chunks[j].len,
+          /* seq = */ 1, /* portid = */ 0, bench_link_cb, sum);
+    if (status != MNL_CB_STOP)
+    {
+      fprintf (stderr, "mnl_cb_run failed\n");
+      exit (EXIT_FAILURE);
+    }
+  }
+
+  return (now () - begin);
+}
+#endif /* COLLECT_NETLINK */
+
+static void report (char const *name, size_t bytes, double elapsed,
+    unsigned long iterations, sum_t const *sum)
+{
+  printf ("%-14s %8zu bytes  %9.3f ms/read  %7.1f ns/interface\n",
+      name, bytes, 1000.0 * elapsed / (double) iterations,
+      1e9 * elapsed / (double) sum->interfaces);
+}
+
+int main (int argc, char **argv)
+{
+  buffer_t netdev = { NULL, 0, 0 };
+  unsigned long iterations = 100;
+  int interfaces_num = 5000;
+  sum_t netdev_sum = { 0 };
+  double elapsed;
+
+  if (argc > 3)
+  {
+    fprintf (stderr, "Usage: %s [<iterations> [<interfaces>]]\n", argv[0]);
+    return (EXIT_FAILURE);
+  }
+  if (argc > 1)
+    iterations = strtoul (argv[1], NULL, 0);
+  if (argc > 2)
+    interfaces_num = atoi (argv[2]);
+  if ((iterations == 0) || (interfaces_num <= 0))
+    return (EXIT_FAILURE);
+
+  printf ("%d interfaces, %lu iterations\n", interfaces_num, iterations);
+
+  generate_netdev (&netdev, interfaces_num);
+  elapsed = bench_netdev (&netdev, iterations, &netdev_sum);
+  report ("/proc/net/dev", netdev.len, elapsed, iterations, &netdev_sum);
+
+#if COLLECT_NETLINK
+  {
+    dump_t dump = { NULL, 0 };
+    sum_t netlink_sum = { 0 };
+    size_t bytes = 0;
+    size_t i;
+
+    generate_dump (&dump, interfaces_num);
+    for (i = 0; i < dump.chunks_num; i++)
+      bytes += dump.chunks[i].len;
+
+    elapsed = bench_netlink (&dump, iterations, &netlink_sum);
+    report ("rtnetlink", bytes, elapsed, iterations, &netlink_sum);
+
+    /* Both inputs describe the same counters. */
+    if (memcmp (&netdev_sum, &netlink_sum, sizeof (netdev_sum)) != 0)
+    {
+      fprintf (stderr, "The parsed counters differ.\n");
+      return (EXIT_FAILURE);
+    }
+
+    for (i = 0; i < dump.chunks_num; i++)
+      sfree (dump.chunks[i].data);
+    sfree (dump.chunks);
+  }
+#endif /* COLLECT_NETLINK */
+
+  sfree (netdev.data);
+  return (EXIT_SUCCESS);
+}
+
+/* vim: set sw=2 sts=2 et : */
@@ -25,6 +25,8 @@
 #include "plugin.h"
 #include "common.h"
 #include "filter_chain.h"
+#include "configfile.h"
+#include "utils_avltree.h"
 
 #include <pthread.h>
 #include <jni.h>
@@ -63,6 +65,29 @@ typedef struct java_plugin_class_s java_plugin_class_t;
 #define CB_TYPE_NOTIFICATION 8
 #define CB_TYPE_MATCH        9
 #define CB_TYPE_TARGET      10
+#define CB_TYPE_BATCH_WRITE 11
+
+/* Value lists buffered for a batch write callback. */
+struct cjni_batch_entry_s /* {{{ */
+{
+  const data_set_t *ds;
+  value_list_t vl;
+};
+typedef struct cjni_batch_entry_s cjni_batch_entry_t;
+/* }}} */
+
+struct cjni_batch_s /* {{{ */
+{
+  pthread_mutex_t lock;
+  cjni_batch_entry_t *entries;
+  size_t entries_num;
+  size_t entries_size;
+  /* Time the first entry has been added. */
+  cdtime_t first_time;
+};
+typedef struct cjni_batch_s cjni_batch_t;
+/* }}} */
+
 struct cjni_callback_info_s /* {{{ */
 {
   char     *name;
@@ -70,10 +95,60 @@ struct cjni_callback_info_s /* {{{ */
   jclass    class;
   jobject   object;
   jmethodID method;
+  /* Only used by CB_TYPE_BATCH_WRITE callbacks. */
+  cjni_batch_t *batch;
 };
 typedef struct cjni_callback_info_s cjni_callback_info_t;
 /* }}} */
 
+/* Global references to the classes of the API and the IDs of the methods used
+ * to convert values to Java objects. They are looked up once, when the JVM is
+ * created, instead of every time a value is converted. */
+struct cjni_api_cache_s /* {{{ */
+{
+  jclass    c_long;
+  jmethodID m_long_init;
+
+  jclass    c_double;
+  jmethodID m_double_init;
+
+  jclass    c_datasource;
+  jmethodID m_datasource_init;
+  jmethodID m_datasource_set_name;
+  jmethodID m_datasource_set_type;
+  jmethodID m_datasource_set_min;
+  jmethodID m_datasource_set_max;
+
+  jclass    c_dataset;
+  jmethodID m_dataset_init;
+  jmethodID m_dataset_add_data_source;
+
+  jclass    c_valuelist;
+  jmethodID m_valuelist_init;
+  jmethodID m_valuelist_set_host;
+  jmethodID m_valuelist_set_plugin;
+  jmethodID m_valuelist_set_plugin_instance;
+  jmethodID m_valuelist_set_type;
+  jmethodID m_valuelist_set_type_instance;
+  jmethodID m_valuelist_set_time;
+  jmethodID m_valuelist_set_interval;
+  jmethodID m_valuelist_set_data_set;
+  jmethodID m_valuelist_add_value;
+
+  jclass    c_notification;
+  jmethodID m_notification_init;
+  jmethodID m_notification_set_host;
+  jmethodID m_notification_set_plugin;
+  jmethodID m_notification_set_plugin_instance;
+  jmethodID m_notification_set_type;
+  jmethodID m_notification_set_type_instance;
+  jmethodID m_notification_set_message;
+  jmethodID m_notification_set_time;
+  jmethodID m_notification_set_severity;
+};
+typedef struct cjni_api_cache_s cjni_api_cache_t;
+/* }}} */
+
 /*
  * Global variables
  */
@@ -95,6 +170,24 @@ static pthread_mutex_t       java_callbacks_lock = PTHREAD_MUTEX_INITIALIZER;
 
 static oconfig_item_t       *config_block = NULL;
 
+static cjni_api_cache_t      api;
+
+/* DataSet objects, one per type. They are shared by all ValueList objects
+ * passed to write callbacks, so they're only created once. */
+static c_avl_tree_t         *data_sets = NULL;
+static pthread_mutex_t       data_sets_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* List of batch write callbacks. Protected by `java_callbacks_lock'. Values
+ * still buffered are delivered on shutdown. */
+static cjni_callback_info_t **batch_writers     = NULL;
+static size_t                 batch_writers_num = 0;
+
+static int                   batch_size = 256;
+static cdtime_t              batch_timeout = TIME_T_TO_CDTIME_T (10);
+/* Set once the read callback delivering expired batches has been registered.
+ * Protected by `java_callbacks_lock'. */
+static _Bool                 batch_timer_registered = 0;
+
 /*
  * Prototypes
  *
@@ -109,6 +202,9 @@ static int cjni_callback_register (JNIEnv *jvm_env, jobject o_name,
 static int cjni_read (user_data_t *user_data);
 static int cjni_write (const data_set_t *ds, const value_list_t *vl,
     user_data_t *ud);
+static int cjni_batch_timer (user_data_t *ud);
+static int cjni_write_batch (const data_set_t *ds, const value_list_t *vl,
+    user_data_t *ud);
 static int cjni_flush (cdtime_t timeout, const char *identifier, user_data_t *ud);
 static void cjni_log (int severity, const char *message, user_data_t *ud);
 static int cjni_notification (const notification_t *n, user_data_t *ud);
@@ -124,10 +220,8 @@ static int cjni_match_target_invoke (const data_set_t *ds, value_list_t *vl,
  * C to Java conversion functions
  */
 static int ctoj_string (JNIEnv *jvm_env, /* {{{ */
-    const char *string,
-    jclass class_ptr, jobject object_ptr, const char *method_name)
+    const char *string, jobject object_ptr, jmethodID m_set)
 {
-  jmethodID m_set;
   jstring o_string;
 
   /* Create a java.lang.String */
@@ -139,18 +233,7 @@ static int ctoj_string (JNIEnv *jvm_env, /* {{{ */
     return (-1);
   }
 
-  /* Search for the `void setFoo (String s)' method. */
-  m_set = (*jvm_env)->GetMethodID (jvm_env, class_ptr,
-      method_name, "(Ljava/lang/String;)V");
-  if (m_set == NULL)
-  {
-    ERROR ("java plugin: ctoj_string: Cannot find method `void %s (String)'.",
-        method_name);
-    (*jvm_env)->DeleteLocalRef (jvm_env, o_string);
-    return (-1);
-  }
-
-  /* Call the method. */
+  /* Call the `void setFoo (String s)' method. */
   (*jvm_env)->CallVoidMethod (jvm_env, object_ptr, m_set, o_string);
 
   /* Decrease reference counter on the java.lang.String object. */
@@ -176,123 +259,18 @@ static jstring ctoj_output_string (JNIEnv *jvm_env, /* {{{ */
   return (o_string);
 } /* }}} int ctoj_output_string */
 
-static int ctoj_int (JNIEnv *jvm_env, /* {{{ */
-    jint value,
-    jclass class_ptr, jobject object_ptr, const char *method_name)
-{
-  jmethodID m_set;
-
-  /* Search for the `void setFoo (int i)' method. */
-  m_set = (*jvm_env)->GetMethodID (jvm_env, class_ptr,
-      method_name, "(I)V");
-  if (m_set == NULL)
-  {
-    ERROR ("java plugin: ctoj_int: Cannot find method `void %s (int)'.",
-        method_name);
-    return (-1);
-  }
-
-  (*jvm_env)->CallVoidMethod (jvm_env, object_ptr, m_set, value);
-
-  return (0);
-} /* }}} int ctoj_int */
-
-static int ctoj_long (JNIEnv *jvm_env, /* {{{ */
-    jlong value,
-    jclass class_ptr, jobject object_ptr, const char *method_name)
-{
-  jmethodID m_set;
-
-  /* Search for the `void setFoo (long l)' method. */
-  m_set = (*jvm_env)->GetMethodID (jvm_env, class_ptr,
-      method_name, "(J)V");
-  if (m_set == NULL)
-  {
-    ERROR ("java plugin: ctoj_long: Cannot find method `void %s (long)'.",
-        method_name);
-    return (-1);
-  }
-
-  (*jvm_env)->CallVoidMethod (jvm_env, object_ptr, m_set, value);
-
-  return (0);
-} /* }}} int ctoj_long */
-
-static int ctoj_double (JNIEnv *jvm_env, /* {{{ */
-    jdouble value,
-    jclass class_ptr, jobject object_ptr, const char *method_name)
-{
-  jmethodID m_set;
-
-  /* Search for the `void setFoo (double d)' method. */
-  m_set = (*jvm_env)->GetMethodID (jvm_env, class_ptr,
-      method_name, "(D)V");
-  if (m_set == NULL)
-  {
-    ERROR ("java plugin: ctoj_double: Cannot find method `void %s (double)'.",
-        method_name);
-    return (-1);
-  }
-
-  (*jvm_env)->CallVoidMethod (jvm_env, object_ptr, m_set, value);
-
-  return (0);
-} /* }}} int ctoj_double */
-
 /* Convert a jlong to a java.lang.Number */
 static jobject ctoj_jlong_to_number (JNIEnv *jvm_env, jlong value) /* {{{ */
 {
-  jclass c_long;
-  jmethodID m_long_constructor;
-
-  /* Look up the java.lang.Long class */
-  c_long = (*jvm_env)->FindClass (jvm_env, "java/lang/Long");
-  if (c_long == NULL)
-  {
-    ERROR ("java plugin: ctoj_jlong_to_number: Looking up the "
-        "java.lang.Long class failed.");
-    return (NULL);
-  }
-
-  m_long_constructor = (*jvm_env)->GetMethodID (jvm_env,
-      c_long, "<init>", "(J)V");
-  if (m_long_constructor == NULL)
-  {
-    ERROR ("java plugin: ctoj_jlong_to_number: Looking up the "
-        "`Long (long)' constructor failed.");
-    return (NULL);
-  }
-
   return ((*jvm_env)->NewObject (jvm_env,
-        c_long, m_long_constructor, value));
+        api.c_long, api.m_long_init, value));
 } /* }}} jobject ctoj_jlong_to_number */
 
 /* Convert a jdouble to a java.lang.Number */
 static jobject ctoj_jdouble_to_number (JNIEnv *jvm_env, jdouble value) /* {{{ */
 {
-  jclass c_double;
-  jmethodID m_double_constructor;
-
-  /* Look up the java.lang.Long class */
-  c_double = (*jvm_env)->FindClass (jvm_env, "java/lang/Double");
-  if (c_double == NULL)
-  {
-    ERROR ("java plugin: ctoj_jdouble_to_number: Looking up the "
-        "java.lang.Double class failed.");
-    return (NULL);
-  }
-
-  m_double_constructor = (*jvm_env)->GetMethodID (jvm_env,
-      c_double, "<init>", "(D)V");
-  if (m_double_constructor == NULL)
-  {
-    ERROR ("java plugin: ctoj_jdouble_to_number: Looking up the "
-        "`Double (double)' constructor failed.");
-    return (NULL);
-  }
-
   return ((*jvm_env)->NewObject (jvm_env,
-        c_double, m_double_constructor, value));
+        api.c_double, api.m_double_init, value));
 } /* }}} jobject ctoj_jdouble_to_number */
 
 /* Convert a value_t to a java.lang.Number */
@@ -315,34 +293,12 @@ static jobject ctoj_value_to_number (JNIEnv *jvm_env, /* {{{ */
 static jobject ctoj_data_source (JNIEnv *jvm_env, /* {{{ */
     const data_source_t *dsrc)
 {
-  jclass c_datasource;
-  jmethodID m_datasource_constructor;
   jobject o_datasource;
   int status;
 
-  /* Look up the DataSource class */
-  c_datasource = (*jvm_env)->FindClass (jvm_env,
-      "org/collectd/api/DataSource");
-  if (c_datasource == NULL)
-  {
-    ERROR ("java plugin: ctoj_data_source: "
-        "FindClass (org/collectd/api/DataSource) failed.");
-    return (NULL);
-  }
-
-  /* Lookup the `ValueList ()' constructor. */
-  m_datasource_constructor = (*jvm_env)->GetMethodID (jvm_env, c_datasource,
-      "<init>", "()V");
-  if (m_datasource_constructor == NULL)
-  {
-    ERROR ("java plugin: ctoj_data_source: Cannot find the "
-        "`DataSource ()' constructor.");
-    return (NULL);
-  }
-
   /* Create a new instance. */
-  o_datasource = (*jvm_env)->NewObject (jvm_env, c_datasource,
-      m_datasource_constructor);
+  o_datasource = (*jvm_env)->NewObject (jvm_env, api.c_datasource,
+      api.m_datasource_init);
   if (o_datasource == NULL)
   {
     ERROR ("java plugin: ctoj_data_source: "
@@ -352,7 +308,7 @@ static jobject ctoj_data_source (JNIEnv *jvm_env, /* {{{ */
 
   /* Set name via `void setName (String name)' */
   status = ctoj_string (jvm_env, dsrc->name,
-      c_datasource, o_datasource, "setName");
+      o_datasource, api.m_datasource_set_name);
   if (status != 0)
   {
     ERROR ("java plugin: ctoj_data_source: "
@@ -362,37 +318,15 @@ static jobject ctoj_data_source (JNIEnv *jvm_env, /* {{{ */
   }
 
   /* Set type via `void setType (int type)' */
-  status = ctoj_int (jvm_env, dsrc->type,
-      c_datasource, o_datasource, "setType");
-  if (status != 0)
-  {
-    ERROR ("java plugin: ctoj_data_source: "
-        "ctoj_int (setType) failed.");
-    (*jvm_env)->DeleteLocalRef (jvm_env, o_datasource);
-    return (NULL);
-  }
+  (*jvm_env)->CallVoidMethod (jvm_env, o_datasource,
+      api.m_datasource_set_type, (jint) dsrc->type);
 
-  /* Set min via `void setMin (double min)' */
-  status = ctoj_double (jvm_env, dsrc->min,
-      c_datasource, o_datasource, "setMin");
-  if (status != 0)
-  {
-    ERROR ("java plugin: ctoj_data_source: "
-        "ctoj_double (setMin) failed.");
-    (*jvm_env)->DeleteLocalRef (jvm_env, o_datasource);
-    return (NULL);
-  }
-
-  /* Set max via `void setMax (double max)' */
-  status = ctoj_double (jvm_env, dsrc->max,
-      c_datasource, o_datasource, "setMax");
-  if (status != 0)
-  {
-    ERROR ("java plugin: ctoj_data_source: "
-        "ctoj_double (setMax) failed.");
-    (*jvm_env)->DeleteLocalRef (jvm_env, o_datasource);
-    return (NULL);
-  }
+  /* Set min and max via `void setMin (double min)' and
+   * `void setMax (double max)' */
+  (*jvm_env)->CallVoidMethod (jvm_env, o_datasource,
+      api.m_datasource_set_min, (jdouble) dsrc->min);
+  (*jvm_env)->CallVoidMethod (jvm_env, o_datasource,
+      api.m_datasource_set_max, (jdouble) dsrc->max);
 
   return (o_datasource);
 } /* }}} jobject ctoj_data_source */
@@ -613,42 +547,10 @@ static jobject ctoj_oconfig_item (JNIEnv *jvm_env, /* {{{ */
 /* Convert a data_set_t to a org/collectd/api/DataSet */
 static jobject ctoj_data_set (JNIEnv *jvm_env, const data_set_t *ds) /* {{{ */
 {
-  jclass c_dataset;
-  jmethodID m_constructor;
-  jmethodID m_add;
   jobject o_type;
   jobject o_dataset;
   size_t i;
 
-  /* Look up the org/collectd/api/DataSet class */
-  c_dataset = (*jvm_env)->FindClass (jvm_env, "org/collectd/api/DataSet");
-  if (c_dataset == NULL)
-  {
-    ERROR ("java plugin: ctoj_data_set: Looking up the "
-        "org/collectd/api/DataSet class failed.");
-    return (NULL);
-  }
-
-  /* Search for the `DataSet (String type)' constructor. */
-  m_constructor = (*jvm_env)->GetMethodID (jvm_env,
-      c_dataset, "<init>", "(Ljava/lang/String;)V");
-  if (m_constructor == NULL)
-  {
-    ERROR ("java plugin: ctoj_data_set: Looking up the "
-        "`DataSet (String)' constructor failed.");
-    return (NULL);
-  }
-
-  /* Search for the `void addDataSource (DataSource)' method. */
-  m_add = (*jvm_env)->GetMethodID (jvm_env,
-      c_dataset, "addDataSource", "(Lorg/collectd/api/DataSource;)V");
-  if (m_add == NULL)
-  {
-    ERROR ("java plugin: ctoj_data_set: Looking up the "
-        "`addDataSource (DataSource)' method failed.");
-    return (NULL);
-  }
-
   o_type = (*jvm_env)->NewStringUTF (jvm_env, ds->type);
   if (o_type == NULL)
   {
@@ -657,7 +559,7 @@ static jobject ctoj_data_set (JNIEnv *jvm_env, const data_set_t *ds) /* {{{ */
   }
 
   o_dataset = (*jvm_env)->NewObject (jvm_env,
-      c_dataset, m_constructor, o_type);
+      api.c_dataset, api.m_dataset_init, o_type);
   if (o_dataset == NULL)
   {
     ERROR ("java plugin: ctoj_data_set: Creating a DataSet object failed.");
@@ -681,7 +583,8 @@ static jobject ctoj_data_set (JNIEnv *jvm_env, const data_set_t *ds) /* {{{ */
       return (NULL);
     }
 
-    (*jvm_env)->CallVoidMethod (jvm_env, o_dataset, m_add, o_datasource);
+    (*jvm_env)->CallVoidMethod (jvm_env, o_dataset,
+        api.m_dataset_add_data_source, o_datasource);
 
     (*jvm_env)->DeleteLocalRef (jvm_env, o_datasource);
   } /* for (i = 0; i < ds->ds_num; i++) */
@@ -689,106 +592,92 @@ static jobject ctoj_data_set (JNIEnv *jvm_env, const data_set_t *ds) /* {{{ */
   return (o_dataset);
 } /* }}} jobject ctoj_data_set */
 
-static int ctoj_value_list_add_value (JNIEnv *jvm_env, /* {{{ */
-    value_t value, int ds_type,
-    jclass class_ptr, jobject object_ptr)
+/* Returns the shared DataSet object of "ds", creating it if necessary. The
+ * returned object is a global reference owned by the cache and must not be
+ * deleted by the caller. */
+static jobject ctoj_data_set_cached (JNIEnv *jvm_env, /* {{{ */
+    const data_set_t *ds)
 {
-  jmethodID m_addvalue;
-  jobject o_number;
+  jobject o_dataset = NULL;
+  jobject o_tmp;
+  char *type;
 
-  m_addvalue = (*jvm_env)->GetMethodID (jvm_env, class_ptr,
-      "addValue", "(Ljava/lang/Number;)V");
-  if (m_addvalue == NULL)
+  pthread_mutex_lock (&data_sets_lock);
+
+  if (data_sets == NULL)
+    data_sets = c_avl_create ((int (*) (const void *, const void *)) strcmp);
+  if (data_sets == NULL)
   {
-    ERROR ("java plugin: ctoj_value_list_add_value: "
-        "Cannot find method `void addValue (Number)'.");
-    return (-1);
+    pthread_mutex_unlock (&data_sets_lock);
+    ERROR ("java plugin: ctoj_data_set_cached: c_avl_create failed.");
+    return (NULL);
   }
 
-  o_number = ctoj_value_to_number (jvm_env, value, ds_type);
-  if (o_number == NULL)
+  if (c_avl_get (data_sets, ds->type, (void *) &o_dataset) == 0)
   {
-    ERROR ("java plugin: ctoj_value_list_add_value: "
-        "ctoj_value_to_number failed.");
-    return (-1);
+    pthread_mutex_unlock (&data_sets_lock);
+    return (o_dataset);
   }
 
-  (*jvm_env)->CallVoidMethod (jvm_env, object_ptr, m_addvalue, o_number);
+  o_tmp = ctoj_data_set (jvm_env, ds);
+  if (o_tmp == NULL)
+  {
+    pthread_mutex_unlock (&data_sets_lock);
+    return (NULL);
+  }
 
-  (*jvm_env)->DeleteLocalRef (jvm_env, o_number);
+  o_dataset = (*jvm_env)->NewGlobalRef (jvm_env, o_tmp);
+  (*jvm_env)->DeleteLocalRef (jvm_env, o_tmp);
+  type = strdup (ds->type);
+  if ((o_dataset == NULL) || (type == NULL)
+      || (c_avl_insert (data_sets, type, o_dataset) != 0))
+  {
+    pthread_mutex_unlock (&data_sets_lock);
+    ERROR ("java plugin: ctoj_data_set_cached: Caching the DataSet of "
+        "\"%s\" failed.", ds->type);
+    if (o_dataset != NULL)
+      (*jvm_env)->DeleteGlobalRef (jvm_env, o_dataset);
+    sfree (type);
+    return (NULL);
+  }
 
-  return (0);
-} /* }}} int ctoj_value_list_add_value */
+  pthread_mutex_unlock (&data_sets_lock);
+  return (o_dataset);
+} /* }}} jobject ctoj_data_set_cached */
 
-static int ctoj_value_list_add_data_set (JNIEnv *jvm_env, /* {{{ */
-    jclass c_valuelist, jobject o_valuelist, const data_set_t *ds)
+static int ctoj_value_list_add_value (JNIEnv *jvm_env, /* {{{ */
+    value_t value, int ds_type, jobject object_ptr)
 {
-  jmethodID m_setdataset;
-  jobject o_dataset;
-
-  /* Look for the `void setDataSource (List<DataSource> ds)' method. */
-  m_setdataset = (*jvm_env)->GetMethodID (jvm_env, c_valuelist,
-      "setDataSet", "(Lorg/collectd/api/DataSet;)V");
-  if (m_setdataset == NULL)
-  {
-    ERROR ("java plugin: ctoj_value_list_add_data_set: "
-        "Cannot find the `void setDataSet (DataSet)' method.");
-    return (-1);
-  }
+  jobject o_number;
 
-  /* Create a DataSet object. */
-  o_dataset = ctoj_data_set (jvm_env, ds);
-  if (o_dataset == NULL)
+  o_number = ctoj_value_to_number (jvm_env, value, ds_type);
+  if (o_number == NULL)
   {
-    ERROR ("java plugin: ctoj_value_list_add_data_set: "
-        "ctoj_data_set (%s) failed.", ds->type);
+    ERROR ("java plugin: ctoj_value_list_add_value: "
+        "ctoj_value_to_number failed.");
     return (-1);
   }
 
-  /* Actually call the method. */
-  (*jvm_env)->CallVoidMethod (jvm_env,
-      o_valuelist, m_setdataset, o_dataset);
+  (*jvm_env)->CallVoidMethod (jvm_env, object_ptr,
+      api.m_valuelist_add_value, o_number);
 
-  /* Decrease reference counter on the List<DataSource> object. */
-  (*jvm_env)->DeleteLocalRef (jvm_env, o_dataset);
+  (*jvm_env)->DeleteLocalRef (jvm_env, o_number);
 
   return (0);
-} /* }}} int ctoj_value_list_add_data_set */
+} /* }}} int ctoj_value_list_add_value */
 
 /* Convert a value_list_t (and data_set_t) to a org/collectd/api/ValueList */
 static jobject ctoj_value_list (JNIEnv *jvm_env, /* {{{ */
     const data_set_t *ds, const value_list_t *vl)
 {
-  jclass c_valuelist;
-  jmethodID m_valuelist_constructor;
   jobject o_valuelist;
+  jobject o_dataset;
   int status;
   size_t i;
 
-  /* First, create a new ValueList instance..
-   * Look up the class.. */
-  c_valuelist = (*jvm_env)->FindClass (jvm_env,
-      "org/collectd/api/ValueList");
-  if (c_valuelist == NULL)
-  {
-    ERROR ("java plugin: ctoj_value_list: "
-        "FindClass (org/collectd/api/ValueList) failed.");
-    return (NULL);
-  }
-
-  /* Lookup the `ValueList ()' constructor. */
-  m_valuelist_constructor = (*jvm_env)->GetMethodID (jvm_env, c_valuelist,
-      "<init>", "()V");
-  if (m_valuelist_constructor == NULL)
-  {
-    ERROR ("java plugin: ctoj_value_list: Cannot find the "
-        "`ValueList ()' constructor.");
-    return (NULL);
-  }
-
   /* Create a new instance. */
-  o_valuelist = (*jvm_env)->NewObject (jvm_env, c_valuelist,
-      m_valuelist_constructor);
+  o_valuelist = (*jvm_env)->NewObject (jvm_env, api.c_valuelist,
+      api.m_valuelist_init);
   if (o_valuelist == NULL)
   {
     ERROR ("java plugin: ctoj_value_list: Creating a new ValueList instance "
@@ -796,60 +685,46 @@ static jobject ctoj_value_list (JNIEnv *jvm_env, /* {{{ */
     return (NULL);
   }
 
-  status = ctoj_value_list_add_data_set (jvm_env,
-      c_valuelist, o_valuelist, ds);
-  if (status != 0)
+  o_dataset = ctoj_data_set_cached (jvm_env, ds);
+  if (o_dataset == NULL)
   {
     ERROR ("java plugin: ctoj_value_list: "
-        "ctoj_value_list_add_data_set failed.");
+        "ctoj_data_set_cached (%s) failed.", ds->type);
     (*jvm_env)->DeleteLocalRef (jvm_env, o_valuelist);
     return (NULL);
   }
+  (*jvm_env)->CallVoidMethod (jvm_env,
+      o_valuelist, api.m_valuelist_set_data_set, o_dataset);
 
   /* Set the strings.. */
-#define SET_STRING(str,method_name) do { \
-  status = ctoj_string (jvm_env, str, \
-      c_valuelist, o_valuelist, method_name); \
+#define SET_STRING(str,method) do { \
+  status = ctoj_string (jvm_env, str, o_valuelist, api.method); \
   if (status != 0) { \
     ERROR ("java plugin: ctoj_value_list: ctoj_string (%s) failed.", \
-        method_name); \
+        #method); \
     (*jvm_env)->DeleteLocalRef (jvm_env, o_valuelist); \
     return (NULL); \
   } } while (0)
 
-  SET_STRING (vl->host,            "setHost");
-  SET_STRING (vl->plugin,          "setPlugin");
-  SET_STRING (vl->plugin_instance, "setPluginInstance");
-  SET_STRING (vl->type,            "setType");
-  SET_STRING (vl->type_instance,   "setTypeInstance");
+  SET_STRING (vl->host,            m_valuelist_set_host);
+  SET_STRING (vl->plugin,          m_valuelist_set_plugin);
+  SET_STRING (vl->plugin_instance, m_valuelist_set_plugin_instance);
+  SET_STRING (vl->type,            m_valuelist_set_type);
+  SET_STRING (vl->type_instance,   m_valuelist_set_type_instance);
 
 #undef SET_STRING
 
-  /* Set the `time' member. Java stores time in milliseconds. */
-  status = ctoj_long (jvm_env, (jlong) CDTIME_T_TO_MS (vl->time),
-      c_valuelist, o_valuelist, "setTime");
-  if (status != 0)
-  {
-    ERROR ("java plugin: ctoj_value_list: ctoj_long (setTime) failed.");
-    (*jvm_env)->DeleteLocalRef (jvm_env, o_valuelist);
-    return (NULL);
-  }
-
-  /* Set the `interval' member.. */
-  status = ctoj_long (jvm_env,
-      (jlong) CDTIME_T_TO_MS (vl->interval),
-      c_valuelist, o_valuelist, "setInterval");
-  if (status != 0)
-  {
-    ERROR ("java plugin: ctoj_value_list: ctoj_long (setInterval) failed.");
-    (*jvm_env)->DeleteLocalRef (jvm_env, o_valuelist);
-    return (NULL);
-  }
+  /* Set the `time' and `interval' members. Java stores time in
+   * milliseconds. */
+  (*jvm_env)->CallVoidMethod (jvm_env, o_valuelist,
+      api.m_valuelist_set_time, (jlong) CDTIME_T_TO_MS (vl->time));
+  (*jvm_env)->CallVoidMethod (jvm_env, o_valuelist,
+      api.m_valuelist_set_interval, (jlong) CDTIME_T_TO_MS (vl->interval));
 
   for (i = 0; i < vl->values_len; i++)
   {
     status = ctoj_value_list_add_value (jvm_env, vl->values[i], ds->ds[i].type,
-        c_valuelist, o_valuelist);
+        o_valuelist);
     if (status != 0)
     {
       ERROR ("java plugin: ctoj_value_list: "
@@ -866,35 +741,12 @@ static jobject ctoj_value_list (JNIEnv *jvm_env, /* {{{ */
 static jobject ctoj_notification (JNIEnv *jvm_env, /* {{{ */
     const notification_t *n)
 {
-  jclass c_notification;
-  jmethodID m_constructor;
   jobject o_notification;
   int status;
 
-  /* First, create a new Notification instance..
-   * Look up the class.. */
-  c_notification = (*jvm_env)->FindClass (jvm_env,
-      "org/collectd/api/Notification");
-  if (c_notification == NULL)
-  {
-    ERROR ("java plugin: ctoj_notification: "
-        "FindClass (org/collectd/api/Notification) failed.");
-    return (NULL);
-  }
-
-  /* Lookup the `Notification ()' constructor. */
-  m_constructor = (*jvm_env)->GetMethodID (jvm_env, c_notification,
-      "<init>", "()V");
-  if (m_constructor == NULL)
-  {
-    ERROR ("java plugin: ctoj_notification: Cannot find the "
-        "`Notification ()' constructor.");
-    return (NULL);
-  }
-
   /* Create a new instance. */
-  o_notification = (*jvm_env)->NewObject (jvm_env, c_notification,
-      m_constructor);
+  o_notification = (*jvm_env)->NewObject (jvm_env, api.c_notification,
+      api.m_notification_init);
   if (o_notification == NULL)
   {
     ERROR ("java plugin: ctoj_notification: Creating a new Notification "
@@ -903,44 +755,31 @@ static jobject ctoj_notification (JNIEnv *jvm_env, /* {{{ */
   }
 
   /* Set the strings.. */
-#define SET_STRING(str,method_name) do { \
-  status = ctoj_string (jvm_env, str, \
-      c_notification, o_notification, method_name); \
+#define SET_STRING(str,method) do { \
+  status = ctoj_string (jvm_env, str, o_notification, api.method); \
   if (status != 0) { \
     ERROR ("java plugin: ctoj_notification: ctoj_string (%s) failed.", \
-        method_name); \
+        #method); \
     (*jvm_env)->DeleteLocalRef (jvm_env, o_notification); \
     return (NULL); \
   } } while (0)
 
-  SET_STRING (n->host,            "setHost");
-  SET_STRING (n->plugin,          "setPlugin");
-  SET_STRING (n->plugin_instance, "setPluginInstance");
-  SET_STRING (n->type,            "setType");
-  SET_STRING (n->type_instance,   "setTypeInstance");
-  SET_STRING (n->message,         "setMessage");
+  SET_STRING (n->host,            m_notification_set_host);
+  SET_STRING (n->plugin,          m_notification_set_plugin);
+  SET_STRING (n->plugin_instance, m_notification_set_plugin_instance);
+  SET_STRING (n->type,            m_notification_set_type);
+  SET_STRING (n->type_instance,   m_notification_set_type_instance);
+  SET_STRING (n->message,         m_notification_set_message);
 
 #undef SET_STRING
 
   /* Set the `time' member. Java stores time in milliseconds. */
-  status = ctoj_long (jvm_env, (jlong) CDTIME_T_TO_MS (n->time),
-      c_notification, o_notification, "setTime");
-  if (status != 0)
-  {
-    ERROR ("java plugin: ctoj_notification: ctoj_long (setTime) failed.");
-    (*jvm_env)->DeleteLocalRef (jvm_env, o_notification);
-    return (NULL);
-  }
+  (*jvm_env)->CallVoidMethod (jvm_env, o_notification,
+      api.m_notification_set_time, (jlong) CDTIME_T_TO_MS (n->time));
 
   /* Set the `severity' member.. */
-  status = ctoj_int (jvm_env, (jint) n->severity,
-      c_notification, o_notification, "setSeverity");
-  if (status != 0)
-  {
-    ERROR ("java plugin: ctoj_notification: ctoj_int (setSeverity) failed.");
-    (*jvm_env)->DeleteLocalRef (jvm_env, o_notification);
-    return (NULL);
-  }
+  (*jvm_env)->CallVoidMethod (jvm_env, o_notification,
+      api.m_notification_set_severity, (jint) n->severity);
 
   return (o_notification);
 } /* }}} jobject ctoj_notification */
@@ -1468,6 +1307,56 @@ static jint JNICALL cjni_api_register_write (JNIEnv *jvm_env, /* {{{ */
   return (0);
 } /* }}} jint cjni_api_register_write */
 
+static jint JNICALL cjni_api_register_batch_write (JNIEnv *jvm_env, /* {{{ */
+    jobject this, jobject o_name, jobject o_write)
+{
+  user_data_t ud;
+  cjni_callback_info_t *cbi;
+  cjni_callback_info_t **tmp;
+
+  cbi = cjni_callback_info_create (jvm_env, o_name, o_write,
+      CB_TYPE_BATCH_WRITE);
+  if (cbi == NULL)
+    return (-1);
+
+  DEBUG ("java plugin: Registering new batch write callback: %s", cbi->name);
+
+  pthread_mutex_lock (&java_callbacks_lock);
+  tmp = realloc (batch_writers,
+      (batch_writers_num + 1) * sizeof (*batch_writers));
+  if (tmp == NULL)
+  {
+    pthread_mutex_unlock (&java_callbacks_lock);
+    ERROR ("java plugin: cjni_api_register_batch_write: realloc failed.");
+    cjni_callback_info_destroy (cbi);
+    return (-1);
+  }
+  batch_writers = tmp;
+  batch_writers[batch_writers_num] = cbi;
+  batch_writers_num++;
+
+  /* Without the timer, a batch would wait for the next value list to arrive
+   * before its age is checked. */
+  if ((batch_timeout > 0) && !batch_timer_registered)
+  {
+    plugin_register_complex_read (/* group = */ NULL, "java/batch",
+        cjni_batch_timer, /* interval = */ batch_timeout / 4,
+        /* user_data = */ NULL);
+    batch_timer_registered = 1;
+  }
+  pthread_mutex_unlock (&java_callbacks_lock);
+
+  memset (&ud, 0, sizeof (ud));
+  ud.data = (void *) cbi;
+  ud.free_func = cjni_callback_info_destroy;
+
+  plugin_register_write (cbi->name, cjni_write_batch, &ud);
+
+  (*jvm_env)->DeleteLocalRef (jvm_env, o_write);
+
+  return (0);
+} /* }}} jint cjni_api_register_batch_write */
+
 static jint JNICALL cjni_api_register_flush (JNIEnv *jvm_env, /* {{{ */
     jobject this, jobject o_name, jobject o_flush)
 {
@@ -1683,6 +1572,10 @@ static JNINativeMethod jni_api_functions[] = /* {{{ */
     "(Ljava/lang/String;Lorg/collectd/api/CollectdWriteInterface;)I",
     cjni_api_register_write },
 
+  { "registerBatchWrite",
+    "(Ljava/lang/String;Lorg/collectd/api/CollectdBatchWriteInterface;)I",
+    cjni_api_register_batch_write },
+
   { "registerFlush",
     "(Ljava/lang/String;Lorg/collectd/api/CollectdFlushInterface;)I",
     cjni_api_register_flush },
@@ -1755,6 +1648,11 @@ static cjni_callback_info_t *cjni_callback_info_create (JNIEnv *jvm_env, /* {{{
       method_signature = "(Lorg/collectd/api/ValueList;)I";
       break;
 
+    case CB_TYPE_BATCH_WRITE:
+      method_name = "write";
+      method_signature = "([Lorg/collectd/api/ValueList;)I";
+      break;
+
     case CB_TYPE_FLUSH:
       method_name = "flush";
       method_signature = "(Ljava/lang/Number;Ljava/lang/String;)I";
@@ -1855,6 +1753,20 @@ static cjni_callback_info_t *cjni_callback_info_create (JNIEnv *jvm_env, /* {{{
     return (NULL);
   }
 
+  if (type == CB_TYPE_BATCH_WRITE)
+  {
+    cbi->batch = calloc (1, sizeof (*cbi->batch));
+    if (cbi->batch == NULL)
+    {
+      ERROR ("java plugin: cjni_callback_info_create: calloc failed.");
+      (*jvm_env)->DeleteGlobalRef (jvm_env, cbi->object);
+      sfree (cbi->name);
+      sfree (cbi);
+      return (NULL);
+    }
+    pthread_mutex_init (&cbi->batch->lock, /* attr = */ NULL);
+  }
+
   return (cbi);
 } /* }}} cjni_callback_info_t cjni_callback_info_create */
 
@@ -1945,11 +1857,10 @@ static void cjni_jvm_env_destroy (void *args) /* {{{ */
         "cjni_env->reference_counter = %i;", cjni_env->reference_counter);
   }
 
-  if (cjni_env->jvm_env != NULL)
-  {
-    ERROR ("java plugin: cjni_jvm_env_destroy: cjni_env->jvm_env = %p;",
-        (void *) cjni_env->jvm_env);
-  }
+  /* Threads stay attached to the JVM until they exit, see
+   * `cjni_thread_attach'. */
+  if ((cjni_env->jvm_env != NULL) && (jvm != NULL))
+    (*jvm)->DetachCurrentThread (jvm);
 
   /* The pointer is allocated in `cjni_thread_attach' */
   free (cjni_env);
@@ -1982,6 +1893,129 @@ static int cjni_init_native (JNIEnv *jvm_env) /* {{{ */
   return (0);
 } /* }}} int cjni_init_native */
 
+/* Look up the classes and methods used to convert values to Java objects and
+ * store them in the global `api' variable. */
+static int cjni_api_cache_init (JNIEnv *jvm_env) /* {{{ */
+{
+#define FIND_CLASS(var,name) do { \
+  jclass tmp = (*jvm_env)->FindClass (jvm_env, name); \
+  if (tmp == NULL) { \
+    ERROR ("java plugin: cjni_api_cache_init: FindClass (%s) failed.", \
+        name); \
+    return (-1); \
+  } \
+  api.var = (*jvm_env)->NewGlobalRef (jvm_env, tmp); \
+  (*jvm_env)->DeleteLocalRef (jvm_env, tmp); \
+  if (api.var == NULL) { \
+    ERROR ("java plugin: cjni_api_cache_init: NewGlobalRef (%s) failed.", \
+        name); \
+    return (-1); \
+  } } while (0)
+
+#define GET_METHOD(var,class,name,signature) do { \
+  api.var = (*jvm_env)->GetMethodID (jvm_env, api.class, name, signature); \
+  if (api.var == NULL) { \
+    ERROR ("java plugin: cjni_api_cache_init: Cannot find the `%s' method " \
+        "with signature `%s'.", name, signature); \
+    return (-1); \
+  } } while (0)
+
+  FIND_CLASS (c_long, "java/lang/Long");
+  GET_METHOD (m_long_init, c_long, "<init>", "(J)V");
+
+  FIND_CLASS (c_double, "java/lang/Double");
+  GET_METHOD (m_double_init, c_double, "<init>", "(D)V");
+
+  FIND_CLASS (c_datasource, "org/collectd/api/DataSource");
+  GET_METHOD (m_datasource_init, c_datasource, "<init>", "()V");
+  GET_METHOD (m_datasource_set_name, c_datasource,
+      "setName", "(Ljava/lang/String;)V");
+  GET_METHOD (m_datasource_set_type, c_datasource, "setType", "(I)V");
+  GET_METHOD (m_datasource_set_min, c_datasource, "setMin", "(D)V");
+  GET_METHOD (m_datasource_set_max, c_datasource, "setMax", "(D)V");
+
+  FIND_CLASS (c_dataset, "org/collectd/api/DataSet");
+  GET_METHOD (m_dataset_init, c_dataset, "<init>", "(Ljava/lang/String;)V");
+  GET_METHOD (m_dataset_add_data_source, c_dataset,
+      "addDataSource", "(Lorg/collectd/api/DataSource;)V");
+
+  FIND_CLASS (c_valuelist, "org/collectd/api/ValueList");
+  GET_METHOD (m_valuelist_init, c_valuelist, "<init>", "()V");
+  GET_METHOD (m_valuelist_set_host, c_valuelist,
+      "setHost", "(Ljava/lang/String;)V");
+  GET_METHOD (m_valuelist_set_plugin, c_valuelist,
+      "setPlugin", "(Ljava/lang/String;)V");
+  GET_METHOD (m_valuelist_set_plugin_instance, c_valuelist,
+      "setPluginInstance", "(Ljava/lang/String;)V");
+  GET_METHOD (m_valuelist_set_type, c_valuelist,
+      "setType", "(Ljava/lang/String;)V");
+  GET_METHOD (m_valuelist_set_type_instance, c_valuelist,
+      "setTypeInstance", "(Ljava/lang/String;)V");
+  GET_METHOD (m_valuelist_set_time, c_valuelist, "setTime", "(J)V");
+  GET_METHOD (m_valuelist_set_interval, c_valuelist, "setInterval", "(J)V");
+  GET_METHOD (m_valuelist_set_data_set, c_valuelist,
+      "setDataSet", "(Lorg/collectd/api/DataSet;)V");
+  GET_METHOD (m_valuelist_add_value, c_valuelist,
+      "addValue", "(Ljava/lang/Number;)V");
+
+  FIND_CLASS (c_notification, "org/collectd/api/Notification");
+  GET_METHOD (m_notification_init, c_notification, "<init>", "()V");
+  GET_METHOD (m_notification_set_host, c_notification,
+      "setHost", "(Ljava/lang/String;)V");
+  GET_METHOD (m_notification_set_plugin, c_notification,
+      "setPlugin", "(Ljava/lang/String;)V");
+  GET_METHOD (m_notification_set_plugin_instance, c_notification,
+      "setPluginInstance", "(Ljava/lang/String;)V");
+  GET_METHOD (m_notification_set_type, c_notification,
+      "setType", "(Ljava/lang/String;)V");
+  GET_METHOD (m_notification_set_type_instance, c_notification,
+      "setTypeInstance", "(Ljava/lang/String;)V");
+  GET_METHOD (m_notification_set_message, c_notification,
+      "setMessage", "(Ljava/lang/String;)V");
+  GET_METHOD (m_notification_set_time, c_notification, "setTime", "(J)V");
+  GET_METHOD (m_notification_set_severity, c_notification,
+      "setSeverity", "(I)V");
+
+#undef GET_METHOD
+#undef FIND_CLASS
+
+  return (0);
+} /* }}} int cjni_api_cache_init */
+
+/* Release the global references held by `api' and the DataSet cache. */
+static void cjni_api_cache_free (JNIEnv *jvm_env) /* {{{ */
+{
+  char *type;
+  jobject o_dataset;
+
+  if (data_sets != NULL)
+  {
+    while (c_avl_pick (data_sets, (void *) &type, (void *) &o_dataset) == 0)
+    {
+      (*jvm_env)->DeleteGlobalRef (jvm_env, o_dataset);
+      sfree (type);
+    }
+    c_avl_destroy (data_sets);
+    data_sets = NULL;
+  }
+
+#define FREE_CLASS(var) do { \
+  if (api.var != NULL) \
+    (*jvm_env)->DeleteGlobalRef (jvm_env, api.var); \
+  } while (0)
+
+  FREE_CLASS (c_long);
+  FREE_CLASS (c_double);
+  FREE_CLASS (c_datasource);
+  FREE_CLASS (c_dataset);
+  FREE_CLASS (c_valuelist);
+  FREE_CLASS (c_notification);
+
+#undef FREE_CLASS
+
+  memset (&api, 0, sizeof (api));
+} /* }}} void cjni_api_cache_free */
+
 /* Create the JVM. This is called when the first thread tries to access the JVM
  * via cjni_thread_attach. */
 static int cjni_create_jvm (void) /* {{{ */
@@ -2037,12 +2071,23 @@ static int cjni_create_jvm (void) /* {{{ */
     return (-1);
   }
 
+  status = cjni_api_cache_init (jvm_env);
+  if (status != 0)
+  {
+    ERROR ("java plugin: cjni_create_jvm: cjni_api_cache_init failed.");
+    return (-1);
+  }
+
   DEBUG ("java plugin: The JVM has been created.");
   return (0);
 } /* }}} int cjni_create_jvm */
 
-/* Increase the reference counter to the JVM for this thread. If it was zero,
- * attach the JVM first. */
+/* Increase the reference counter to the JVM for this thread and push a new
+ * frame for local references, which is popped by `cjni_thread_detach'.
+ * Threads are attached to the JVM the first time this is called and stay
+ * attached until they exit, because attaching and detaching is expensive and
+ * write callbacks are called very often. They're attached as daemon threads,
+ * so they don't keep `DestroyJavaVM' from returning. */
 static JNIEnv *cjni_thread_attach (void) /* {{{ */
 {
   cjni_jvm_env_t *cjni_env;
@@ -2080,32 +2125,35 @@ static JNIEnv *cjni_thread_attach (void) /* {{{ */
     pthread_setspecific (jvm_env_key, cjni_env);
   }
 
-  if (cjni_env->reference_counter > 0)
-  {
-    cjni_env->reference_counter++;
-    jvm_env = cjni_env->jvm_env;
-  }
-  else
+  if (cjni_env->jvm_env == NULL)
   {
     int status;
     JavaVMAttachArgs args;
 
-    assert (cjni_env->jvm_env == NULL);
+    assert (cjni_env->reference_counter == 0);
 
     memset (&args, 0, sizeof (args));
     args.version = JNI_VERSION_1_2;
 
-    status = (*jvm)->AttachCurrentThread (jvm, (void *) &jvm_env, (void *) &args);
+    status = (*jvm)->AttachCurrentThreadAsDaemon (jvm, (void *) &jvm_env,
+        (void *) &args);
     if (status != 0)
     {
-      ERROR ("java plugin: cjni_thread_attach: AttachCurrentThread failed "
-          "with status %i.", status);
+      ERROR ("java plugin: cjni_thread_attach: AttachCurrentThreadAsDaemon "
+          "failed with status %i.", status);
       return (NULL);
     }
 
-    cjni_env->reference_counter = 1;
     cjni_env->jvm_env = jvm_env;
   }
+  jvm_env = cjni_env->jvm_env;
+
+  if ((*jvm_env)->PushLocalFrame (jvm_env, /* capacity = */ 16) != 0)
+  {
+    ERROR ("java plugin: cjni_thread_attach: PushLocalFrame failed.");
+    return (NULL);
+  }
+  cjni_env->reference_counter++;
 
   DEBUG ("java plugin: cjni_thread_attach: cjni_env->reference_counter = %i",
       cjni_env->reference_counter);
@@ -2113,12 +2161,11 @@ static JNIEnv *cjni_thread_attach (void) /* {{{ */
   return (jvm_env);
 } /* }}} JNIEnv *cjni_thread_attach */
 
-/* Decrease the reference counter of this thread. If it reaches zero, detach
- * from the JVM. */
+/* Decrease the reference counter of this thread and free all local references
+ * created since the corresponding `cjni_thread_attach'. */
 static int cjni_thread_detach (void) /* {{{ */
 {
   cjni_jvm_env_t *cjni_env;
-  int status;
 
   cjni_env = pthread_getspecific (jvm_env_key);
   if (cjni_env == NULL)
@@ -2130,22 +2177,19 @@ static int cjni_thread_detach (void) /* {{{ */
   assert (cjni_env->reference_counter > 0);
   assert (cjni_env->jvm_env != NULL);
 
-  cjni_env->reference_counter--;
-  DEBUG ("java plugin: cjni_thread_detach: cjni_env->reference_counter = %i",
-      cjni_env->reference_counter);
-
-  if (cjni_env->reference_counter > 0)
-    return (0);
-
-  status = (*jvm)->DetachCurrentThread (jvm);
-  if (status != 0)
+  /* A pending exception would be reported by the next JNI call of this
+   * thread, which may be in a completely different callback. */
+  if ((*cjni_env->jvm_env)->ExceptionCheck (cjni_env->jvm_env))
   {
-    ERROR ("java plugin: cjni_thread_detach: DetachCurrentThread failed "
-        "with status %i.", status);
+    (*cjni_env->jvm_env)->ExceptionDescribe (cjni_env->jvm_env);
+    (*cjni_env->jvm_env)->ExceptionClear (cjni_env->jvm_env);
   }
 
-  cjni_env->reference_counter = 0;
-  cjni_env->jvm_env = NULL;
+  (*cjni_env->jvm_env)->PopLocalFrame (cjni_env->jvm_env, /* result = */ NULL);
+
+  cjni_env->reference_counter--;
+  DEBUG ("java plugin: cjni_thread_detach: cjni_env->reference_counter = %i",
+      cjni_env->reference_counter);
 
   return (0);
 } /* }}} int cjni_thread_detach */
@@ -2389,6 +2433,27 @@ static int cjni_config_perform (oconfig_item_t *ci) /* {{{ */
       else
         errors++;
     }
+    else if (strcasecmp ("BatchSize", child->key) == 0)
+    {
+      status = cf_util_get_int (child, &batch_size);
+      if ((status == 0) && (batch_size < 1))
+      {
+        WARNING ("java plugin: `BatchSize' must be at least one.");
+        batch_size = 1;
+      }
+      if (status == 0)
+        success++;
+      else
+        errors++;
+    }
+    else if (strcasecmp ("BatchTimeout", child->key) == 0)
+    {
+      status = cf_util_get_cdtime (child, &batch_timeout);
+      if (status == 0)
+        success++;
+      else
+        errors++;
+    }
     else
     {
       WARNING ("java plugin: Option `%s' not allowed here.", child->key);
@@ -2457,6 +2522,141 @@ static int cjni_config_callback (oconfig_item_t *ci) /* {{{ */
   return (0);
 } /* }}} int cjni_config_callback */
 
+static void cjni_batch_entries_free (cjni_batch_entry_t *entries, /* {{{ */
+    size_t entries_num)
+{
+  size_t i;
+
+  for (i = 0; i < entries_num; i++)
+    sfree (entries[i].vl.values);
+  sfree (entries);
+} /* }}} void cjni_batch_entries_free */
+
+static void cjni_batch_destroy (cjni_batch_t *batch) /* {{{ */
+{
+  if (batch == NULL)
+    return;
+
+  cjni_batch_entries_free (batch->entries, batch->entries_num);
+  pthread_mutex_destroy (&batch->lock);
+  sfree (batch);
+} /* }}} void cjni_batch_destroy */
+
+/* Convert the buffered value lists to an array of ValueList objects and pass it
+ * to the `write' method of a CB_TYPE_BATCH_WRITE callback. Frees "entries". */
+static int cjni_batch_deliver (cjni_callback_info_t *cbi, /* {{{ */
+    cjni_batch_entry_t *entries, size_t entries_num)
+{
+  JNIEnv *jvm_env;
+  jobjectArray o_array;
+  int ret_status;
+  size_t i;
+
+  jvm_env = cjni_thread_attach ();
+  if (jvm_env == NULL)
+  {
+    cjni_batch_entries_free (entries, entries_num);
+    return (-1);
+  }
+
+  o_array = (*jvm_env)->NewObjectArray (jvm_env, (jsize) entries_num,
+      api.c_valuelist, /* initial element = */ NULL);
+  if (o_array == NULL)
+  {
+    ERROR ("java plugin: cjni_batch_deliver: NewObjectArray failed.");
+    cjni_batch_entries_free (entries, entries_num);
+    cjni_thread_detach ();
+    return (-1);
+  }
+
+  for (i = 0; i < entries_num; i++)
+  {
+    jobject o_vl;
+
+    o_vl = ctoj_value_list (jvm_env, entries[i].ds, &entries[i].vl);
+    if (o_vl == NULL)
+    {
+      ERROR ("java plugin: cjni_batch_deliver: ctoj_value_list failed.");
+      cjni_batch_entries_free (entries, entries_num);
+      cjni_thread_detach ();
+      return (-1);
+    }
+
+    (*jvm_env)->SetObjectArrayElement (jvm_env, o_array, (jsize) i, o_vl);
+    (*jvm_env)->DeleteLocalRef (jvm_env, o_vl);
+  }
+  cjni_batch_entries_free (entries, entries_num);
+
+  ret_status = (*jvm_env)->CallIntMethod (jvm_env,
+      cbi->object, cbi->method, o_array);
+
+  cjni_thread_detach ();
+  return (ret_status);
+} /* }}} int cjni_batch_deliver */
+
+/* Deliver all value lists buffered for "cbi" if the oldest one is at least
+ * "max_age" old. Zero delivers them unconditionally. */
+static int cjni_batch_flush (cjni_callback_info_t *cbi, /* {{{ */
+    cdtime_t max_age)
+{
+  cjni_batch_entry_t *entries;
+  size_t entries_num;
+
+  pthread_mutex_lock (&cbi->batch->lock);
+  if ((cbi->batch->entries_num == 0)
+      || ((max_age > 0) && ((cdtime () - cbi->batch->first_time) < max_age)))
+  {
+    pthread_mutex_unlock (&cbi->batch->lock);
+    return (0);
+  }
+  entries = cbi->batch->entries;
+  entries_num = cbi->batch->entries_num;
+  cbi->batch->entries = NULL;
+  cbi->batch->entries_num = 0;
+  cbi->batch->entries_size = 0;
+  pthread_mutex_unlock (&cbi->batch->lock);
+
+  if (entries_num == 0)
+  {
+    sfree (entries);
+    return (0);
+  }
+
+  return (cjni_batch_deliver (cbi, entries, entries_num));
+} /* }}} int cjni_batch_flush */
+
+/* Read callback delivering the batches older than `BatchTimeout'. The lock is
+ * not held while calling Java, which may register callbacks. The callbacks
+ * are only destroyed after the read threads have been stopped. */
+static int cjni_batch_timer (__attribute__((unused)) user_data_t *ud) /* {{{ */
+{
+  cjni_callback_info_t **writers;
+  size_t writers_num;
+  size_t i;
+
+  pthread_mutex_lock (&java_callbacks_lock);
+  writers_num = batch_writers_num;
+  writers = NULL;
+  if (writers_num > 0)
+  {
+    writers = malloc (writers_num * sizeof (*writers));
+    if (writers == NULL)
+    {
+      pthread_mutex_unlock (&java_callbacks_lock);
+      ERROR ("java plugin: cjni_batch_timer: malloc failed.");
+      return (-1);
+    }
+    memcpy (writers, batch_writers, writers_num * sizeof (*writers));
+  }
+  pthread_mutex_unlock (&java_callbacks_lock);
+
+  for (i = 0; i < writers_num; i++)
+    cjni_batch_flush (writers[i], batch_timeout);
+
+  sfree (writers);
+  return (0);
+} /* }}} int cjni_batch_timer */
+
 /* Free the data contained in the `user_data_t' pointer passed to `cjni_read'
  * and `cjni_write'. In particular, delete the global reference to the Java
  * object. */
@@ -2472,6 +2672,8 @@ static void cjni_callback_info_destroy (void *arg) /* {{{ */
   /* This condition can occur when shutting down. */
   if (jvm == NULL)
   {
+    if (cbi != NULL)
+      cjni_batch_destroy (cbi->batch);
     sfree (cbi);
     return;
   }
@@ -2479,6 +2681,28 @@ static void cjni_callback_info_destroy (void *arg) /* {{{ */
   if (arg == NULL)
     return;
 
+  if (cbi->batch != NULL)
+  {
+    size_t i;
+
+    pthread_mutex_lock (&java_callbacks_lock);
+    for (i = 0; i < batch_writers_num; i++)
+    {
+      if (batch_writers[i] != cbi)
+        continue;
+
+      memmove (batch_writers + i, batch_writers + i + 1,
+          (batch_writers_num - (i + 1)) * sizeof (*batch_writers));
+      batch_writers_num--;
+      break;
+    }
+    pthread_mutex_unlock (&java_callbacks_lock);
+
+    cjni_batch_flush (cbi, /* max_age = */ 0);
+    cjni_batch_destroy (cbi->batch);
+    cbi->batch = NULL;
+  }
+
   jvm_env = cjni_thread_attach ();
   if (jvm_env == NULL)
   {
@@ -2572,6 +2796,92 @@ static int cjni_write (const data_set_t *ds, const value_list_t *vl, /* {{{ */
   return (ret_status);
 } /* }}} int cjni_write */
 
+/* Buffer the value list for the CB_TYPE_BATCH_WRITE callback pointed to by the
+ * `user_data_t' pointer. The buffered value lists are passed to Java once
+ * `BatchSize' of them have been collected or the oldest one is older than
+ * `BatchTimeout'. */
+static int cjni_write_batch (const data_set_t *ds, /* {{{ */
+    const value_list_t *vl, user_data_t *ud)
+{
+  cjni_callback_info_t *cbi;
+  cjni_batch_t *batch;
+  cjni_batch_entry_t *entry;
+  cjni_batch_entry_t *entries;
+  size_t entries_num;
+  cdtime_t now;
+
+  if (jvm == NULL)
+  {
+    ERROR ("java plugin: cjni_write_batch: jvm == NULL");
+    return (-1);
+  }
+
+  if ((ud == NULL) || (ud->data == NULL))
+  {
+    ERROR ("java plugin: cjni_write_batch: Invalid user data.");
+    return (-1);
+  }
+
+  cbi = (cjni_callback_info_t *) ud->data;
+  batch = cbi->batch;
+  now = cdtime ();
+
+  pthread_mutex_lock (&batch->lock);
+
+  if (batch->entries_num >= batch->entries_size)
+  {
+    size_t new_size = (batch->entries_size > 0)
+      ? 2 * batch->entries_size : (size_t) batch_size;
+
+    entries = realloc (batch->entries, new_size * sizeof (*entries));
+    if (entries == NULL)
+    {
+      pthread_mutex_unlock (&batch->lock);
+      ERROR ("java plugin: cjni_write_batch: realloc failed.");
+      return (-1);
+    }
+    batch->entries = entries;
+    batch->entries_size = new_size;
+  }
+
+  entry = batch->entries + batch->entries_num;
+  memcpy (&entry->vl, vl, sizeof (entry->vl));
+  entry->ds = ds;
+  entry->vl.meta = NULL;
+  entry->vl.values = malloc (vl->values_len * sizeof (*entry->vl.values));
+  if (entry->vl.values == NULL)
+  {
+    pthread_mutex_unlock (&batch->lock);
+    ERROR ("java plugin: cjni_write_batch: malloc failed.");
+    return (-1);
+  }
+  memcpy (entry->vl.values, vl->values,
+      vl->values_len * sizeof (*entry->vl.values));
+
+  if (batch->entries_num == 0)
+    batch->first_time = now;
+  batch->entries_num++;
+
+  if ((batch->entries_num < (size_t) batch_size)
+      && ((batch_timeout == 0) || ((now - batch->first_time) < batch_timeout)))
+  {
+    pthread_mutex_unlock (&batch->lock);
+    return (0);
+  }
+
+  /* Take the buffered entries and call Java without holding the lock, so that
+   * other write threads can continue to fill the next batch. */
+  entries = batch->entries;
+  entries_num = batch->entries_num;
+  batch->entries = NULL;
+  batch->entries_num = 0;
+  batch->entries_size = 0;
+
+  pthread_mutex_unlock (&batch->lock);
+
+  return (cjni_batch_deliver (cbi, entries, entries_num));
+} /* }}} int cjni_write_batch */
+
 /* Call the CB_TYPE_FLUSH callback pointed to by the `user_data_t' pointer. */
 static int cjni_flush (cdtime_t timeout, const char *identifier, /* {{{ */
     user_data_t *ud)
@@ -2906,10 +3216,11 @@ static int cjni_match_target_invoke (const data_set_t *ds, /* {{{ */
     return (-1);
   }
 
-  o_ds = ctoj_data_set (jvm_env, ds);
+  o_ds = ctoj_data_set_cached (jvm_env, ds);
   if (o_ds == NULL)
   {
-    ERROR ("java plugin: cjni_match_target_invoke: ctoj_value_list failed.");
+    ERROR ("java plugin: cjni_match_target_invoke: "
+        "ctoj_data_set_cached failed.");
     cjni_thread_detach ();
     return (-1);
   }
@@ -3005,12 +3316,39 @@ static int cjni_shutdown (void) /* {{{ */
 {
   JNIEnv *jvm_env;
   JavaVMAttachArgs args;
+  cjni_jvm_env_t *cjni_env;
+  cjni_callback_info_t **writers;
+  size_t writers_num;
   int status;
   size_t i;
 
   if (jvm == NULL)
     return (0);
 
+  /* Deliver the values still buffered for batch write callbacks. The lock is
+   * not held while calling Java, which may register callbacks. */
+  pthread_mutex_lock (&java_callbacks_lock);
+  writers = batch_writers;
+  writers_num = batch_writers_num;
+  batch_writers = NULL;
+  batch_writers_num = 0;
+  pthread_mutex_unlock (&java_callbacks_lock);
+
+  for (i = 0; i < writers_num; i++)
+    cjni_batch_flush (writers[i], /* max_age = */ 0);
+  sfree (writers);
+
+  /* This thread may still be attached as a daemon thread by
+   * `cjni_thread_attach'. Re-attach it as a regular thread, which
+   * `DestroyJavaVM' expects. */
+  cjni_env = pthread_getspecific (jvm_env_key);
+  if ((cjni_env != NULL) && (cjni_env->jvm_env != NULL))
+  {
+    (*jvm)->DetachCurrentThread (jvm);
+    cjni_env->jvm_env = NULL;
+    cjni_env->reference_counter = 0;
+  }
+
   jvm_env = NULL;
   memset (&args, 0, sizeof (args));
   args.version = JNI_VERSION_1_2;
@@ -3052,6 +3390,8 @@ static int cjni_shutdown (void) /* {{{ */
   java_classes_list_len = 0;
   sfree (java_classes_list);
 
+  cjni_api_cache_free (jvm_env);
+
   /* Destroy the JVM */
   DEBUG ("java plugin: Destroying the JVM.");
   (*jvm)->DestroyJavaVM (jvm);
@@ -0,0 +1,624 @@
+/**
+ * collectd - src/libcollectdclient/async.c
+ * Copyright (C) 2026       agent
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   agent <agent at local>
+ **/
+
+#if HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "collectd/lcc_features.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include "collectd/async.h"
+
+#define LCC_ASYNC_QUEUE_SIZE_DEFAULT 65536
+#define LCC_ASYNC_BATCH_SIZE_DEFAULT  1024
+
+/*
+ * Private data types
+ */
+/* A queued value list. The values are copied into "values" and
+ * "values_types", which are reused and only grow. */
+struct lcc_async_entry_s
+{
+  lcc_value_list_t vl;
+  size_t values_size;
+};
+typedef struct lcc_async_entry_s lcc_async_entry_t;
+
+struct lcc_async_sender_s
+{
+  lcc_async_t *async;
+  pthread_t thread;
+  _Bool thread_running;
+
+  lcc_connection_t *con;
+
+  /* Entries taken from the queue are swapped with these, so that the queue
+   * slots can be reused while the batch is being sent. */
+  lcc_async_entry_t *batch;
+  lcc_value_list_t *batch_vl;
+};
+typedef struct lcc_async_sender_s lcc_async_sender_t;
+
+struct lcc_async_s
+{
+  char *address;
+  lcc_network_t *net;
+
+  int protocol;
+  size_t senders_num;
+  size_t queue_size;
+  size_t batch_size;
+  double flush_interval;
+  int blocking;
+  lcc_async_callback_t callback;
+  void *user_data;
+
+  pthread_mutex_t lock;
+  /* Signaled when value lists are queued or on shutdown. */
+  pthread_cond_t send_cond;
+  /* Signaled when value lists have been taken from the queue or sent. */
+  pthread_cond_t done_cond;
+
+  lcc_async_entry_t *queue;
+  size_t queue_head;
+  size_t queue_num;
+  size_t in_flight;
+  size_t flush_waiting;
+
+  _Bool started;
+  _Bool shutdown;
+
+  lcc_async_sender_t *senders;
+
+  lcc_async_stats_t stats;
+};
+
+/*
+ * Private functions
+ */
+static int entry_copy (lcc_async_entry_t *e, /* {{{ */
+    const lcc_value_list_t *vl)
+{
+  if (e->values_size < vl->values_len)
+  {
+    value_t *values;
+    int *types;
+
+    values = realloc (e->vl.values, vl->values_len * sizeof (*values));
+    if (values == NULL)
+      return (ENOMEM);
+    e->vl.values = values;
+
+    types = realloc (e->vl.values_types, vl->values_len * sizeof (*types));
+    if (types == NULL)
+      return (ENOMEM);
+    e->vl.values_types = types;
+
+    e->values_size = vl->values_len;
+  }
+
+  memcpy (e->vl.values, vl->values, vl->values_len * sizeof (*vl->values));
+  memcpy (e->vl.values_types, vl->values_types,
+      vl->values_len * sizeof (*vl->values_types));
+  e->vl.values_len = vl->values_len;
+  e->vl.time = vl->time;
+  e->vl.interval = vl->interval;
+  memcpy (&e->vl.identifier, &vl->identifier, sizeof (e->vl.identifier));
+
+  return (0);
+} /* }}} int entry_copy */
+
+static void entries_free (lcc_async_entry_t *e, size_t num) /* {{{ */
+{
+  size_t i;
+
+  if (e == NULL)
+    return;
+
+  for (i = 0; i < num; i++)
+  {
+    free (e[i].vl.values);
+    free (e[i].vl.values_types);
+  }
+  free (e);
+} /* }}} void entries_free */
+
+static int sender_connect (lcc_async_sender_t *s, /* {{{ */
+    char *errbuf, size_t errbuf_size)
+{
+  int status;
+
+  if (s->con != NULL)
+    return (0);
+
+  status = lcc_connect (s->async->address, &s->con);
+  if (status != 0)
+  {
+    snprintf (errbuf, errbuf_size, "Connecting to %s failed.",
+        s->async->address);
+    errbuf[errbuf_size - 1] = 0;
+    s->con = NULL;
+    return (-1);
+  }
+
+  lcc_set_protocol (s->con, s->async->protocol);
+  return (0);
+} /* }}} int sender_connect */
+
+static int sender_send (lcc_async_sender_t *s, size_t num, /* {{{ */
+    char *errbuf, size_t errbuf_size)
+{
+  size_t i;
+  int status;
+
+  for (i = 0; i < num; i++)
+    s->batch_vl[i] = s->batch[i].vl;
+
+  if (s->async->net != NULL)
+  {
+    for (i = 0; i < num; i++)
+      lcc_network_values_send (s->async->net, s->batch_vl + i);
+
+    status = lcc_network_flush (s->async->net);
+    if (status != 0)
+    {
+      snprintf (errbuf, errbuf_size, "Sending network packets failed.");
+      errbuf[errbuf_size - 1] = 0;
+    }
+    return (status);
+  }
+
+  status = sender_connect (s, errbuf, errbuf_size);
+  if (status != 0)
+    return (status);
+
+  status = lcc_putval_batch (s->con, s->batch_vl, num);
+  if (status != 0)
+  {
+    snprintf (errbuf, errbuf_size, "%s", lcc_strerror (s->con));
+    errbuf[errbuf_size - 1] = 0;
+
+    /* The connection may be unusable, e.g. if the daemon has been
+     * restarted. Reconnect before sending the next batch. */
+    LCC_DESTROY (s->con);
+  }
+
+  return (status);
+} /* }}} int sender_send */
+
+/* Takes up to "batch_size" value lists from the queue. Must be called with
+ * the lock held. */
+static size_t sender_take (lcc_async_sender_t *s) /* {{{ */
+{
+  lcc_async_t *a = s->async;
+  size_t num;
+  size_t i;
+
+  num = a->queue_num;
+  if (num > a->batch_size)
+    num = a->batch_size;
+
+  for (i = 0; i < num; i++)
+  {
+    lcc_async_entry_t *e = a->queue + ((a->queue_head + i) % a->queue_size);
+    lcc_async_entry_t tmp;
+
+    tmp = *e;
+    *e = s->batch[i];
+    s->batch[i] = tmp;
+  }
+
+  a->queue_head = (a->queue_head + num) % a->queue_size;
+  a->queue_num -= num;
+  a->in_flight += num;
+
+  pthread_cond_broadcast (&a->done_cond);
+  return (num);
+} /* }}} size_t sender_take */
+
+static void *sender_thread (void *arg) /* {{{ */
+{
+  lcc_async_sender_t *s = arg;
+  lcc_async_t *a = s->async;
+
+  pthread_mutex_lock (&a->lock);
+  while (42)
+  {
+    char errbuf[1024] = "";
+    size_t num;
+    int status;
+
+    while ((a->queue_num == 0) && !a->shutdown)
+      pthread_cond_wait (&a->send_cond, &a->lock);
+
+    if (a->queue_num == 0)
+      break;
+
+    /* Wait for a full batch, but not longer than the flush interval. */
+    if ((a->queue_num < a->batch_size) && !a->shutdown
+        && (a->flush_waiting == 0))
+    {
+      struct timeval tv;
+      struct timespec deadline;
+      double t;
+
+      gettimeofday (&tv, NULL);
+      t = (double) tv.tv_sec + ((double) tv.tv_usec) / 1e6
+        + a->flush_interval;
+      deadline.tv_sec = (time_t) t;
+      deadline.tv_nsec = (long) ((t - (double) deadline.tv_sec) * 1e9);
+
+      while ((a->queue_num > 0) && (a->queue_num < a->batch_size)
+          && !a->shutdown && (a->flush_waiting == 0))
+      {
+        if (pthread_cond_timedwait (&a->send_cond, &a->lock,
+              &deadline) == ETIMEDOUT)
+          break;
+      }
+
+      /* Another thread may have taken the value lists. */
+      if (a->queue_num == 0)
+        continue;
+    }
+
+    num = sender_take (s);
+    pthread_mutex_unlock (&a->lock);
+
+    status = sender_send (s, num, errbuf, sizeof (errbuf));
+    if (a->callback != NULL)
+      a->callback (status, num, (status == 0) ? NULL : errbuf, a->user_data);
+
+    pthread_mutex_lock (&a->lock);
+    a->in_flight -= num;
+    if (status == 0)
+      a->stats.sent += num;
+    else
+      a->stats.failed += num;
+    pthread_cond_broadcast (&a->done_cond);
+  }
+  pthread_mutex_unlock (&a->lock);
+
+  return (NULL);
+} /* }}} void *sender_thread */
+
+static int async_create (lcc_async_t **ret_async) /* {{{ */
+{
+  lcc_async_t *a;
+
+  a = calloc (1, sizeof (*a));
+  if (a == NULL)
+    return (ENOMEM);
+
+  a->protocol = LCC_PROTOCOL_TEXT;
+  a->senders_num = 1;
+  a->queue_size = LCC_ASYNC_QUEUE_SIZE_DEFAULT;
+  a->batch_size = LCC_ASYNC_BATCH_SIZE_DEFAULT;
+  a->flush_interval = 1.0;
+  a->blocking = 1;
+
+  pthread_mutex_init (&a->lock, NULL);
+  pthread_cond_init (&a->send_cond, NULL);
+  pthread_cond_init (&a->done_cond, NULL);
+
+  *ret_async = a;
+  return (0);
+} /* }}} int async_create */
+
+/*
+ * Public functions
+ */
+int lcc_async_create (const char *address, /* {{{ */
+    lcc_async_t **ret_async)
+{
+  lcc_async_t *a = NULL;
+  int status;
+
+  if ((address == NULL) || (ret_async == NULL))
+    return (EINVAL);
+
+  status = async_create (&a);
+  if (status != 0)
+    return (status);
+
+  a->address = strdup (address);
+  if (a->address == NULL)
+  {
+    lcc_async_destroy (a);
+    return (ENOMEM);
+  }
+
+  *ret_async = a;
+  return (0);
+} /* }}} int lcc_async_create */
+
+int lcc_async_create_network (lcc_network_t *net, /* {{{ */
+    lcc_async_t **ret_async)
+{
+  lcc_async_t *a = NULL;
+  int status;
+
+  if ((net == NULL) || (ret_async == NULL))
+    return (EINVAL);
+
+  status = async_create (&a);
+  if (status != 0)
+    return (status);
+
+  a->net = net;
+
+  *ret_async = a;
+  return (0);
+} /* }}} int lcc_async_create_network */
+
+void lcc_async_destroy (lcc_async_t *a) /* {{{ */
+{
+  size_t i;
+
+  if (a == NULL)
+    return;
+
+  pthread_mutex_lock (&a->lock);
+  a->shutdown = 1;
+  pthread_cond_broadcast (&a->send_cond);
+  pthread_cond_broadcast (&a->done_cond);
+  pthread_mutex_unlock (&a->lock);
+
+  if (a->senders != NULL)
+  {
+    for (i = 0; i < a->senders_num; i++)
+    {
+      lcc_async_sender_t *s = a->senders + i;
+
+      if (s->thread_running)
+        pthread_join (s->thread, NULL);
+      LCC_DESTROY (s->con);
+      entries_free (s->batch, a->batch_size);
+      free (s->batch_vl);
+    }
+    free (a->senders);
+  }
+
+  entries_free (a->queue, a->queue_size);
+
+  pthread_cond_destroy (&a->done_cond);
+  pthread_cond_destroy (&a->send_cond);
+  pthread_mutex_destroy (&a->lock);
+
+  free (a->address);
+  free (a);
+} /* }}} void lcc_async_destroy */
+
+#define ASYNC_SET(a, field, value) do { \
+  if ((a) == NULL)                      \
+    return (EINVAL);                    \
+  if ((a)->started)                     \
+    return (EBUSY);                     \
+  (a)->field = (value);                 \
+  return (0);                           \
+} while (0)
+
+int lcc_async_set_protocol (lcc_async_t *a, int protocol) /* {{{ */
+{
+  if ((protocol != LCC_PROTOCOL_TEXT) && (protocol != LCC_PROTOCOL_BINARY))
+    return (EINVAL);
+  ASYNC_SET (a, protocol, protocol);
+} /* }}} int lcc_async_set_protocol */
+
+int lcc_async_set_connections (lcc_async_t *a, size_t num) /* {{{ */
+{
+  if ((num < 1) || ((a != NULL) && (a->net != NULL) && (num != 1)))
+    return (EINVAL);
+  ASYNC_SET (a, senders_num, num);
+} /* }}} int lcc_async_set_connections */
+
+int lcc_async_set_queue_size (lcc_async_t *a, size_t size) /* {{{ */
+{
+  if (size < 1)
+    return (EINVAL);
+  ASYNC_SET (a, queue_size, size);
+} /* }}} int lcc_async_set_queue_size */
+
+int lcc_async_set_batch_size (lcc_async_t *a, size_t size) /* {{{ */
+{
+  if (size < 1)
+    return (EINVAL);
+  ASYNC_SET (a, batch_size, size);
+} /* }}} int lcc_async_set_batch_size */
+
+int lcc_async_set_flush_interval (lcc_async_t *a, double interval) /* {{{ */
+{
+  if (!(interval > 0.0))
+    return (EINVAL);
+  ASYNC_SET (a, flush_interval, interval);
+} /* }}} int lcc_async_set_flush_interval */
+
+int lcc_async_set_blocking (lcc_async_t *a, int blocking) /* {{{ */
+{
+  ASYNC_SET (a, blocking, blocking);
+} /* }}} int lcc_async_set_blocking */
+
+int lcc_async_set_callback (lcc_async_t *a, /* {{{ */
+    lcc_async_callback_t callback, void *user_data)
+{
+  if ((a == NULL) || a->started)
+    return ((a == NULL) ? EINVAL : EBUSY);
+
+  a->callback = callback;
+  a->user_data = user_data;
+  return (0);
+} /* }}} int lcc_async_set_callback */
+
+#undef ASYNC_SET
+
+int lcc_async_start (lcc_async_t *a) /* {{{ */
+{
+  size_t i;
+  int status;
+
+  if (a == NULL)
+    return (EINVAL);
+  if (a->started)
+    return (EBUSY);
+
+  /* A batch never needs to be larger than the queue. */
+  if (a->batch_size > a->queue_size)
+    a->batch_size = a->queue_size;
+
+  a->queue = calloc (a->queue_size, sizeof (*a->queue));
+  a->senders = calloc (a->senders_num, sizeof (*a->senders));
+  if ((a->queue == NULL) || (a->senders == NULL))
+    return (ENOMEM);
+
+  for (i = 0; i < a->senders_num; i++)
+  {
+    lcc_async_sender_t *s = a->senders + i;
+
+    s->async = a;
+    s->batch = calloc (a->batch_size, sizeof (*s->batch));
+    s->batch_vl = calloc (a->batch_size, sizeof (*s->batch_vl));
+    if ((s->batch == NULL) || (s->batch_vl == NULL))
+      return (ENOMEM);
+
+    /* Connect right away, so that configuration errors are reported to the
+     * caller. Later failures cause the connection to be re-established. */
+    if (a->net == NULL)
+    {
+      status = lcc_connect (a->address, &s->con);
+      if (status != 0)
+      {
+        s->con = NULL;
+        return (ECONNREFUSED);
+      }
+      lcc_set_protocol (s->con, a->protocol);
+    }
+  }
+
+  a->started = 1;
+
+  for (i = 0; i < a->senders_num; i++)
+  {
+    lcc_async_sender_t *s = a->senders + i;
+
+    status = pthread_create (&s->thread, NULL, sender_thread, s);
+    if (status != 0)
+      return (status);
+    s->thread_running = 1;
+  }
+
+  return (0);
+} /* }}} int lcc_async_start */
+
+int lcc_async_putval (lcc_async_t *a, const lcc_value_list_t *vl) /* {{{ */
+{
+  lcc_async_entry_t *e;
+  int status;
+
+  if ((a == NULL) || (vl == NULL) || (vl->values_len < 1)
+      || (vl->values == NULL) || (vl->values_types == NULL))
+    return (EINVAL);
+
+  pthread_mutex_lock (&a->lock);
+
+  if (!a->started || a->shutdown)
+  {
+    pthread_mutex_unlock (&a->lock);
+    return (EINVAL);
+  }
+
+  while (a->queue_num >= a->queue_size)
+  {
+    if (!a->blocking || a->shutdown)
+    {
+      a->stats.dropped++;
+      pthread_mutex_unlock (&a->lock);
+      return (EAGAIN);
+    }
+    pthread_cond_wait (&a->done_cond, &a->lock);
+  }
+
+  e = a->queue + ((a->queue_head + a->queue_num) % a->queue_size);
+  status = entry_copy (e, vl);
+  if (status != 0)
+  {
+    pthread_mutex_unlock (&a->lock);
+    return (status);
+  }
+
+  a->queue_num++;
+  a->stats.submitted++;
+
+  /* Wake a sender to start the flush interval, and again whenever a batch
+   * is complete. */
+  if ((a->queue_num == 1) || ((a->queue_num % a->batch_size) == 0))
+    pthread_cond_signal (&a->send_cond);
+
+  pthread_mutex_unlock (&a->lock);
+  return (0);
+} /* }}} int lcc_async_putval */
+
+int lcc_async_flush (lcc_async_t *a) /* {{{ */
+{
+  if (a == NULL)
+    return (EINVAL);
+
+  pthread_mutex_lock (&a->lock);
+  if (!a->started)
+  {
+    pthread_mutex_unlock (&a->lock);
+    return (0);
+  }
+
+  a->flush_waiting++;
+  pthread_cond_broadcast (&a->send_cond);
+  while ((a->queue_num > 0) || (a->in_flight > 0))
+    pthread_cond_wait (&a->done_cond, &a->lock);
+  a->flush_waiting--;
+
+  pthread_mutex_unlock (&a->lock);
+  return (0);
+} /* }}} int lcc_async_flush */
+
+int lcc_async_stats (lcc_async_t *a, lcc_async_stats_t *ret_stats) /* {{{ */
+{
+  if ((a == NULL) || (ret_stats == NULL))
+    return (EINVAL);
+
+  pthread_mutex_lock (&a->lock);
+  *ret_stats = a->stats;
+  pthread_mutex_unlock (&a->lock);
+
+  return (0);
+} /* }}} int lcc_async_stats */
+
+/* vim: set sw=2 sts=2 et fdm=marker : */
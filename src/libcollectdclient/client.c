@@ -47,6 +47,7 @@
 #include <netdb.h>
 
 #include "collectd/client.h"
+#include "collectd/network_buffer.h"
 
 /* NI_MAXHOST has been obsoleted by RFC 3493 which is a reason for SunOS 5.11
  * to no longer define it. We'll use the old, RFC 2553 value here. */
@@ -91,6 +92,16 @@
   (c)->errbuf[sizeof ((c)->errbuf) - 1] = 0; \
 } while (0)
 
+/* Binary PUTVAL frames: a zero byte, the version, the payload size as a 16 bit
+ * integer in network byte order and the payload in the network format. */
+#define LCC_BINARY_MAGIC       0x00
+#define LCC_BINARY_VERSION     0x01
+#define LCC_BINARY_HEADER_SIZE 4
+#define LCC_BINARY_PAYLOAD_MAX 65535
+
+/* Number of PUTVAL commands sent before waiting for their responses. */
+#define LCC_PIPELINE_DEPTH 32
+
 #if COLLECT_DEBUG
 # define LCC_DEBUG(...) printf (__VA_ARGS__)
 #else
@@ -104,6 +115,10 @@ struct lcc_connection_s
 {
   FILE *fh;
   char errbuf[1024];
+
+  int protocol;
+  lcc_network_buffer_t *nb;
+  char *frame;
 };
 
 struct lcc_response_s
@@ -611,10 +626,25 @@ int lcc_disconnect (lcc_connection_t *c) /* {{{ */
     c->fh = NULL;
   }
 
+  lcc_network_buffer_destroy (c->nb);
+  free (c->frame);
   free (c);
   return (0);
 } /* }}} int lcc_disconnect */
 
+int lcc_set_protocol (lcc_connection_t *c, int protocol) /* {{{ */
+{
+  if ((c == NULL)
+      || ((protocol != LCC_PROTOCOL_TEXT) && (protocol != LCC_PROTOCOL_BINARY)))
+  {
+    lcc_set_errno (c, EINVAL);
+    return (-1);
+  }
+
+  c->protocol = protocol;
+  return (0);
+} /* }}} int lcc_set_protocol */
+
 int lcc_getval (lcc_connection_t *c, lcc_identifier_t *ident, /* {{{ */
     size_t *ret_values_num, gauge_t **ret_values, char ***ret_values_names)
 {
@@ -743,17 +773,19 @@ int lcc_getval (lcc_connection_t *c, lcc_identifier_t *ident, /* {{{ */
   return (0);
 } /* }}} int lcc_getval */
 
-int lcc_putval (lcc_connection_t *c, const lcc_value_list_t *vl) /* {{{ */
+/* Formats the identifier, options and values of "vl" the way PUTVAL expects
+ * them, with a leading space but without the command itself. */
+static int lcc_format_putval (lcc_connection_t *c, /* {{{ */
+    char *ret, size_t ret_size, const lcc_value_list_t *vl)
 {
   char ident_str[6 * LCC_NAME_LEN];
   char ident_esc[12 * LCC_NAME_LEN];
   char command[1024] = "";
-  lcc_response_t res;
   int status;
   size_t i;
 
-  if ((c == NULL) || (vl == NULL) || (vl->values_len < 1)
-      || (vl->values == NULL) || (vl->values_types == NULL))
+  if ((vl->values_len < 1) || (vl->values == NULL)
+      || (vl->values_types == NULL))
   {
     lcc_set_errno (c, EINVAL);
     return (-1);
@@ -764,7 +796,7 @@ int lcc_putval (lcc_connection_t *c, const lcc_value_list_t *vl) /* {{{ */
   if (status != 0)
     return (status);
 
-  SSTRCATF (command, "PUTVAL %s",
+  SSTRCATF (command, " %s",
       lcc_strescape (ident_esc, ident_str, sizeof (ident_esc)));
 
   if (vl->interval > 0.0)
@@ -793,19 +825,253 @@ int lcc_putval (lcc_connection_t *c, const lcc_value_list_t *vl) /* {{{ */
 
   } /* for (i = 0; i < vl->values_len; i++) */
 
-  status = lcc_sendreceive (c, command, &res);
-  if (status != 0)
-    return (status);
+  strncpy (ret, command, ret_size);
+  ret[ret_size - 1] = 0;
+  return (0);
+} /* }}} int lcc_format_putval */
 
-  if (res.status != 0)
+/* Reads the responses to all outstanding PUTVAL commands. Unless "error" is
+ * already set, the first error reported by the server is kept in the
+ * connection's error buffer. */
+static int lcc_putval_receive (lcc_connection_t *c, /* {{{ */
+    size_t *outstanding, int *error)
+{
+  if (*outstanding == 0)
+    return (0);
+
+  if (fflush (c->fh) != 0)
   {
-    LCC_SET_ERRSTR (c, "Server error: %s", res.message);
+    lcc_set_errno (c, errno);
+    return (-1);
+  }
+
+  while (*outstanding > 0)
+  {
+    lcc_response_t res;
+    int status;
+
+    memset (&res, 0, sizeof (res));
+    status = lcc_receive (c, &res);
+    if (status != 0)
+      return (status);
+    (*outstanding)--;
+
+    if ((res.status != 0) && (*error == 0))
+    {
+      LCC_SET_ERRSTR (c, "Server error: %s", res.message);
+      *error = 1;
+    }
     lcc_response_free (&res);
+  }
+
+  return (0);
+} /* }}} int lcc_putval_receive */
+
+/* Sends a PUTVAL line without waiting for the response, unless the maximum
+ * number of outstanding commands has been reached. */
+static int lcc_putval_send (lcc_connection_t *c, /* {{{ */
+    const char *command, size_t *outstanding, int *error)
+{
+  LCC_DEBUG ("send:    --> %s\n", command);
+
+  if (fprintf (c->fh, "%s\r\n", command) < 0)
+  {
+    lcc_set_errno (c, errno);
     return (-1);
   }
+  (*outstanding)++;
+
+  if (*outstanding >= LCC_PIPELINE_DEPTH)
+    return (lcc_putval_receive (c, outstanding, error));
+
+  return (0);
+} /* }}} int lcc_putval_send */
+
+/* Sends the network buffer as a binary PUTVAL frame, see lcc_putval_send. */
+static int lcc_putval_send_frame (lcc_connection_t *c, /* {{{ */
+    size_t *outstanding, int *error)
+{
+  unsigned char header[LCC_BINARY_HEADER_SIZE];
+  size_t payload_size = LCC_BINARY_PAYLOAD_MAX;
+  int status;
+
+  status = lcc_network_buffer_finalize (c->nb);
+  if (status == 0)
+    status = lcc_network_buffer_get (c->nb, c->frame, &payload_size);
+  if (status != 0)
+  {
+    lcc_set_errno (c, status);
+    return (-1);
+  }
+
+  header[0] = LCC_BINARY_MAGIC;
+  header[1] = LCC_BINARY_VERSION;
+  header[2] = (unsigned char) (payload_size >> 8);
+  header[3] = (unsigned char) (payload_size & 0xff);
+
+  if ((fwrite (header, sizeof (header), 1, c->fh) != 1)
+      || (fwrite (c->frame, payload_size, 1, c->fh) != 1))
+  {
+    lcc_set_errno (c, errno);
+    return (-1);
+  }
+
+  lcc_network_buffer_initialize (c->nb);
+  (*outstanding)++;
+
+  if (*outstanding >= LCC_PIPELINE_DEPTH)
+    return (lcc_putval_receive (c, outstanding, error));
 
-  lcc_response_free (&res);
   return (0);
+} /* }}} int lcc_putval_send_frame */
+
+static int lcc_putval_binary (lcc_connection_t *c, /* {{{ */
+    const lcc_value_list_t *vl, size_t vl_num)
+{
+  size_t outstanding = 0;
+  int error = 0;
+  size_t pending = 0;
+  size_t i;
+  int status;
+
+  if (c->nb == NULL)
+  {
+    c->frame = malloc (LCC_BINARY_PAYLOAD_MAX);
+    c->nb = lcc_network_buffer_create (LCC_BINARY_PAYLOAD_MAX);
+    if ((c->frame == NULL) || (c->nb == NULL))
+    {
+      free (c->frame);
+      c->frame = NULL;
+      lcc_network_buffer_destroy (c->nb);
+      c->nb = NULL;
+      lcc_set_errno (c, ENOMEM);
+      return (-1);
+    }
+  }
+  lcc_network_buffer_initialize (c->nb);
+
+  for (i = 0; i < vl_num; i++)
+  {
+    if ((vl[i].values_len < 1) || (vl[i].values == NULL)
+        || (vl[i].values_types == NULL))
+      status = -1;
+    else
+      status = lcc_network_buffer_add_value (c->nb, vl + i);
+
+    if ((status != 0) && (pending > 0))
+    {
+      /* The frame is full: send it and start a new one. */
+      status = lcc_putval_send_frame (c, &outstanding, &error);
+      if (status != 0)
+        return (status);
+      pending = 0;
+
+      status = lcc_network_buffer_add_value (c->nb, vl + i);
+    }
+
+    if (status != 0)
+    {
+      /* Invalid or too large for a frame. */
+      lcc_set_errno (c, EINVAL);
+      error = 1;
+      break;
+    }
+    pending++;
+  }
+
+  if (pending > 0)
+  {
+    status = lcc_putval_send_frame (c, &outstanding, &error);
+    if (status != 0)
+      return (status);
+  }
+
+  /* Read the remaining responses even after an error, so that the next
+   * command doesn't receive one of them. */
+  status = lcc_putval_receive (c, &outstanding, &error);
+  if (status != 0)
+    return (status);
+
+  return (error ? -1 : 0);
+} /* }}} int lcc_putval_binary */
+
+int lcc_putval_batch (lcc_connection_t *c, /* {{{ */
+    const lcc_value_list_t *vl, size_t vl_num)
+{
+  char command[1024] = "";
+  size_t outstanding = 0;
+  int error = 0;
+  int status;
+  size_t i;
+
+  if ((c == NULL) || (vl == NULL))
+  {
+    lcc_set_errno (c, EINVAL);
+    return (-1);
+  }
+
+  if (c->fh == NULL)
+  {
+    lcc_set_errno (c, EBADF);
+    return (-1);
+  }
+
+  if (c->protocol == LCC_PROTOCOL_BINARY)
+    return (lcc_putval_binary (c, vl, vl_num));
+
+  /* Value lists are appended to the current PUTVAL line while it fits into
+   * the server's line buffer. Lines are sent without waiting for the
+   * response to the previous one. */
+  for (i = 0; i < vl_num; i++)
+  {
+    char values[1024];
+
+    status = lcc_format_putval (c, values, sizeof (values), vl + i);
+    if (status != 0)
+    {
+      error = 1;
+      break;
+    }
+
+    if ((command[0] != 0)
+        && (strlen (command) + strlen (values) + 3 > sizeof (command)))
+    {
+      status = lcc_putval_send (c, command, &outstanding, &error);
+      if (status != 0)
+        return (status);
+      command[0] = 0;
+    }
+
+    if (command[0] == 0)
+      SSTRCPY (command, "PUTVAL");
+    SSTRCAT (command, values);
+  }
+
+  if (command[0] != 0)
+  {
+    status = lcc_putval_send (c, command, &outstanding, &error);
+    if (status != 0)
+      return (status);
+  }
+
+  /* Read the remaining responses even after an error, so that the next
+   * command doesn't receive one of them. */
+  status = lcc_putval_receive (c, &outstanding, &error);
+  if (status != 0)
+    return (status);
+
+  return (error ? -1 : 0);
+} /* }}} int lcc_putval_batch */
+
+int lcc_putval (lcc_connection_t *c, const lcc_value_list_t *vl) /* {{{ */
+{
+  if (vl == NULL)
+  {
+    lcc_set_errno (c, EINVAL);
+    return (-1);
+  }
+
+  return (lcc_putval_batch (c, vl, 1));
 } /* }}} int lcc_putval */
 
 int lcc_flush (lcc_connection_t *c, const char *plugin, /* {{{ */
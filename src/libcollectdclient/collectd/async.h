@@ -0,0 +1,107 @@
+/**
+ * collectd - src/libcollectdclient/collectd/async.h
+ * Copyright (C) 2026       agent
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   agent <agent at local>
+ **/
+
+#ifndef LIBCOLLECTDCLIENT_ASYNC_H
+#define LIBCOLLECTDCLIENT_ASYNC_H 1
+
+#include <stdint.h>
+#include <inttypes.h>
+
+#include "client.h"
+#include "network.h"
+
+LCC_BEGIN_DECLS
+
+/*
+ * Asynchronous submission of value lists. lcc_async_putval copies the value
+ * list into a queue and returns immediately. Background threads take batches
+ * from the queue and send them, either to the unixsock plugin using a pool of
+ * connections, or through an lcc_network_t object.
+ */
+struct lcc_async_s;
+typedef struct lcc_async_s lcc_async_t;
+
+/* Called from a background thread after a batch of "vl_num" value lists has
+ * been sent. "status" is zero on success; otherwise "errmsg" describes the
+ * error. */
+typedef void (*lcc_async_callback_t) (int status, size_t vl_num,
+    const char *errmsg, void *user_data);
+
+struct lcc_async_stats_s
+{
+  uint64_t submitted;
+  uint64_t sent;
+  uint64_t failed;
+  uint64_t dropped;
+};
+typedef struct lcc_async_stats_s lcc_async_stats_t;
+
+/*
+ * Create / destroy object
+ */
+int lcc_async_create (const char *address, lcc_async_t **ret_async);
+int lcc_async_create_network (lcc_network_t *net, lcc_async_t **ret_async);
+/* Sends all queued value lists and stops the background threads. The
+ * lcc_network_t object passed to lcc_async_create_network is not
+ * destroyed. */
+void lcc_async_destroy (lcc_async_t *async);
+
+/*
+ * Configuration. Only possible before lcc_async_start has been called.
+ */
+int lcc_async_set_protocol (lcc_async_t *async, int protocol);
+/* Number of connections, and thus sending threads. Defaults to one. Always
+ * one with lcc_async_create_network. */
+int lcc_async_set_connections (lcc_async_t *async, size_t num);
+/* Maximum number of queued value lists. Defaults to 65536. */
+int lcc_async_set_queue_size (lcc_async_t *async, size_t size);
+/* Maximum number of value lists sent at once. Defaults to 1024. */
+int lcc_async_set_batch_size (lcc_async_t *async, size_t size);
+/* Queued value lists are sent at the latest after "interval" seconds, even
+ * if the batch is not full. Defaults to one second. */
+int lcc_async_set_flush_interval (lcc_async_t *async, double interval);
+/* If non-zero, lcc_async_putval waits for space when the queue is full.
+ * Otherwise, the value list is dropped and EAGAIN is returned. */
+int lcc_async_set_blocking (lcc_async_t *async, int blocking);
+int lcc_async_set_callback (lcc_async_t *async,
+    lcc_async_callback_t callback, void *user_data);
+
+/* Connects and starts the background threads. */
+int lcc_async_start (lcc_async_t *async);
+
+/*
+ * Send data
+ */
+int lcc_async_putval (lcc_async_t *async, const lcc_value_list_t *vl);
+/* Waits until all value lists submitted so far have been sent. */
+int lcc_async_flush (lcc_async_t *async);
+
+int lcc_async_stats (lcc_async_t *async, lcc_async_stats_t *ret_stats);
+
+LCC_END_DECLS
+
+/* vim: set sw=2 sts=2 et : */
+#endif /* LIBCOLLECTDCLIENT_ASYNC_H */
@@ -104,8 +104,22 @@ int lcc_disconnect (lcc_connection_t *c);
 int lcc_getval (lcc_connection_t *c, lcc_identifier_t *ident,
     size_t *ret_values_num, gauge_t **ret_values, char ***ret_values_names);
 
+/* Protocols used by lcc_putval and lcc_putval_batch. With
+ * LCC_PROTOCOL_BINARY, value lists are sent in the network plugin's format,
+ * which requires a daemon accepting binary PUTVAL frames. */
+#define LCC_PROTOCOL_TEXT   0
+#define LCC_PROTOCOL_BINARY 1
+
+int lcc_set_protocol (lcc_connection_t *c, int protocol);
+
 int lcc_putval (lcc_connection_t *c, const lcc_value_list_t *vl);
 
+/* Submits "vl_num" value lists. As many value lists as possible are combined
+ * into one command and commands are sent without waiting for the response to
+ * the previous one. Returns zero if the server accepted all value lists. */
+int lcc_putval_batch (lcc_connection_t *c,
+    const lcc_value_list_t *vl, size_t vl_num);
+
 int lcc_flush (lcc_connection_t *c, const char *plugin,
     lcc_identifier_t *ident, int timeout);
 
@@ -75,6 +75,9 @@ int lcc_server_set_security_level (lcc_server_t *srv,
  */
 int lcc_network_values_send (lcc_network_t *net,
     const lcc_value_list_t *vl);
+/* Sends value lists which are still buffered, i.e. the last, partially
+ * filled packet of each server. */
+int lcc_network_flush (lcc_network_t *net);
 #if 0
 int lcc_network_notification_send (lcc_network_t *net,
     const lcc_notification_t *notif);
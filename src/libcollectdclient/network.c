@@ -73,6 +73,7 @@ struct lcc_server_s
   socklen_t sa_len;
 
   lcc_network_buffer_t *buffer;
+  size_t buffer_values_num;
 
   lcc_server_t *next;
 };
@@ -222,11 +223,13 @@ static int server_send_buffer (lcc_server_t *srv) /* {{{ */
   if (status != 0)
   {
     lcc_network_buffer_initialize (srv->buffer);
+    srv->buffer_values_num = 0;
     return (status);
   }
 
   status = lcc_network_buffer_get (srv->buffer, buffer, &buffer_size);
   lcc_network_buffer_initialize (srv->buffer);
+  srv->buffer_values_num = 0;
 
   if (status != 0)
     return (status);
@@ -258,10 +261,16 @@ static int server_value_add (lcc_server_t *srv, /* {{{ */
 
   status = lcc_network_buffer_add_value (srv->buffer, vl);
   if (status == 0)
+  {
+    srv->buffer_values_num++;
     return (0);
+  }
 
   server_send_buffer (srv);
-  return (lcc_network_buffer_add_value (srv->buffer, vl));
+  status = lcc_network_buffer_add_value (srv->buffer, vl);
+  if (status == 0)
+    srv->buffer_values_num++;
+  return (status);
 } /* }}} int server_value_add */
 
 /*
@@ -487,4 +496,27 @@ int lcc_network_values_send (lcc_network_t *net, /* {{{ */
   return (0);
 } /* }}} int lcc_network_values_send */
 
+int lcc_network_flush (lcc_network_t *net) /* {{{ */
+{
+  lcc_server_t *srv;
+  int status = 0;
+
+  if (net == NULL)
+    return (EINVAL);
+
+  for (srv = net->servers; srv != NULL; srv = srv->next)
+  {
+    int tmp;
+
+    if (srv->buffer_values_num == 0)
+      continue;
+
+    tmp = server_send_buffer (srv);
+    if (tmp != 0)
+      status = tmp;
+  }
+
+  return (status);
+} /* }}} int lcc_network_flush */
+
 /* vim: set sw=2 sts=2 et fdm=marker : */
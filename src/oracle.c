@@ -399,6 +399,7 @@ static int o_read_database_query (o_database_t *db, /* {{{ */
    * space declared above. */
   OCIDefine **oci_defines;
 
+  cdtime_t begin;
   int status;
   size_t i;
 
@@ -444,6 +445,7 @@ static int o_read_database_query (o_database_t *db, /* {{{ */
   assert (oci_statement != NULL);
 
   /* Execute the statement */
+  begin = cdtime ();
   status = OCIStmtExecute (db->oci_service_context, /* {{{ */
       oci_statement,
       oci_error,
@@ -634,6 +636,10 @@ static int o_read_database_query (o_database_t *db, /* {{{ */
     }
   } /* }}} while (42) */
 
+  /* Dispatches the value lists collected for the rows above. */
+  udb_query_submit_stats (q, prep_area, cdtime () - begin);
+  udb_query_finish_result (q, prep_area);
+
   /* DEBUG ("oracle plugin: o_read_database_query: This statement succeeded: %s", q->statement); */
   FREE_ALL;
 
@@ -37,6 +37,7 @@
 #undef DONT_POISON_SPRINTF_YET
 
 #include "configfile.h"
+#include "utils_complain.h"
 
 #if HAVE_STDBOOL_H
 # include <stdbool.h>
@@ -83,6 +84,9 @@
 
 #define PLUGIN_TYPES    7
 
+/* only used by the interpreter pool */
+#define PLUGIN_FC_EXEC  253
+
 #define PLUGIN_CONFIG   254
 #define PLUGIN_DATASET  255
 
@@ -155,6 +159,78 @@ typedef struct {
 		sfree (data); \
 	} while (0)
 
+/* a call handed to the interpreter pool */
+typedef struct c_job_s {
+	/* PLUGIN_READ, PLUGIN_WRITE, PLUGIN_LOG, PLUGIN_NOTIF, PLUGIN_FLUSH or
+	 * PLUGIN_FC_EXEC */
+	int type;
+
+	union {
+		/* PLUGIN_WRITE - a copy of the value list */
+		struct {
+			const data_set_t *ds;
+			value_list_t      vl;
+		} write;
+
+		/* PLUGIN_LOG */
+		struct {
+			int   level;
+			char *msg;
+		} log;
+
+		/* PLUGIN_NOTIF - a copy of the notification */
+		notification_t notif;
+
+		/* PLUGIN_FLUSH */
+		struct {
+			cdtime_t  timeout;
+			char     *identifier;
+		} flush;
+
+		/* PLUGIN_FC_EXEC - owned by the caller */
+		struct {
+			int                   type;
+			pfc_user_data_t      *data;
+			const data_set_t     *ds;
+			const value_list_t   *vl;
+			notification_meta_t **meta;
+		} fc;
+	} args;
+
+	/* PLUGIN_READ and PLUGIN_FC_EXEC jobs are synchronous: the caller waits
+	 * for "done" to be set and owns the job */
+	_Bool done;
+	int   status;
+
+	struct c_job_s *next;
+} c_job_t;
+
+typedef struct {
+	/* queue of pending asynchronous jobs */
+	c_job_t *head;
+	c_job_t *tail;
+	size_t   queue_len;
+
+	/* synchronous jobs are processed first since their callers wait */
+	c_job_t *sync_head;
+	c_job_t *sync_tail;
+
+	/* number of write batches being processed; a flush waits for the writes
+	 * queued before it */
+	int writes_running;
+
+	pthread_t *threads;
+	size_t     threads_num;
+
+	_Bool shutdown;
+
+	pthread_mutex_t mutex;
+	/* signaled when a job has been queued or on shutdown */
+	pthread_cond_t  job_cond;
+	/* signaled when a synchronous job is done */
+	pthread_cond_t  done_cond;
+} c_pool_t;
+
 /*
  * Public variable
  */
@@ -174,6 +250,21 @@ static pthread_key_t perl_thr_key;
 static int    perl_argc = 0;
 static char **perl_argv = NULL;
 
+/* if pool_size > 0, threads without an interpreter of their own use a fixed
+ * number of worker threads instead of cloning the base interpreter */
+static int    pool_size = 0;
+static int    pool_write_batch_size = 64;
+/* asynchronous jobs exceeding this limit are dropped */
+static int    pool_queue_limit = 16384;
+static c_complain_t pool_complaint = C_COMPLAIN_INIT_STATIC;
+
+static c_pool_t pool = {
+	NULL, NULL, 0, NULL, NULL, 0, NULL, 0, 0,
+	PTHREAD_MUTEX_INITIALIZER,
+	PTHREAD_COND_INITIALIZER,
+	PTHREAD_COND_INITIALIZER
+};
+
 static char base_name[DATA_MAX_NAME_LEN] = "";
 
 static struct {
@@ -1144,6 +1235,102 @@ static int pplugin_call_all (pTHX_ int type, ...)
 	return ret;
 } /* static int pplugin_call_all (int, ...) */
 
+/*
+ * Pass a list of PLUGIN_WRITE jobs to all write callbacks at once.
+ *
+ * Every data set is converted only once per batch.
+ */
+static int pplugin_write_batch (pTHX_ c_job_t *jobs)
+{
+	struct {
+		const data_set_t *ds;
+		SV *pds;
+	} cache[16];
+	size_t cache_num = 0;
+
+	c_job_t *job;
+
+	int retvals = 0;
+	int ret = 0;
+
+	dSP;
+
+	ENTER;
+	SAVETMPS;
+
+	PUSHMARK (SP);
+
+	for (job = jobs; NULL != job; job = job->next) {
+		/*
+		 * $_[n] = [ $type, $ds, $vl ];
+		 *
+		 * $ds and $vl are the same as the arguments of a write callback
+		 */
+		const data_set_t *ds = job->args.write.ds;
+		SV *pds = NULL;
+		HV *pvl = newHV ();
+		AV *args = newAV ();
+		size_t i;
+
+		for (i = 0; i < cache_num; ++i)
+			if (cache[i].ds == ds)
+				break;
+
+		if (i < cache_num) {
+			pds = cache[i].pds;
+		}
+		else {
+			AV *tmp = newAV ();
+
+			if (-1 == data_set2av (aTHX_ (data_set_t *)ds, tmp)) {
+				av_clear (tmp);
+				av_undef (tmp);
+				tmp = (AV *)&PL_sv_undef;
+				ret = -1;
+			}
+
+			pds = sv_2mortal (newRV_noinc ((SV *)tmp));
+
+			if (cache_num < STATIC_ARRAY_SIZE (cache)) {
+				cache[cache_num].ds = ds;
+				cache[cache_num].pds = pds;
+				++cache_num;
+			}
+		}
+
+		if (-1 == value_list2hv (aTHX_ &job->args.write.vl,
+					(data_set_t *)ds, pvl)) {
+			hv_clear (pvl);
+			hv_undef (pvl);
+			pvl = (HV *)&PL_sv_undef;
+			ret = -1;
+		}
+
+		av_push (args, newSVpv (ds->type, 0));
+		av_push (args, newSVsv (pds));
+		av_push (args, newRV_noinc ((SV *)pvl));
+
+		XPUSHs (sv_2mortal (newRV_noinc ((SV *)args)));
+	}
+
+	PUTBACK;
+
+	retvals = call_pv ("Collectd::_plugin_write_batch", G_SCALAR);
+
+	SPAGAIN;
+	if (0 < retvals) {
+		SV *tmp = POPs;
+		if (! SvTRUE (tmp))
+			ret = -1;
+	}
+
+	PUTBACK;
+	FREETMPS;
+	LEAVE;
+
+	return ret;
+} /* static int pplugin_write_batch (c_job_t *) */
+
 /*
  * collectd's perl interpreter based thread implementation.
  *
@@ -1254,6 +1441,344 @@ static c_ithread_t *c_ithread_create (PerlInterpreter *base)
 	return t;
 } /* static c_ithread_t *c_ithread_create (PerlInterpreter *) */
 
+/*
+ * Interpreter pool.
+ *
+ * Instead of cloning an interpreter for each thread calling into Perl, a
+ * fixed number of worker threads, each owning a clone of the base
+ * interpreter, processes the calls of all threads without an interpreter of
+ * their own. Read and filter chain calls wait for their result, all other
+ * calls are copied and processed asynchronously. Queued value lists are
+ * passed to the write callbacks in batches.
+ */
+
+static int fc_call (pTHX_ int type, int cb_type, pfc_user_data_t *data, ...);
+
+static void c_job_free (c_job_t *job)
+{
+	while (NULL != job) {
+		c_job_t *next = job->next;
+
+		if (PLUGIN_WRITE == job->type)
+			sfree (job->args.write.vl.values);
+		else if (PLUGIN_LOG == job->type)
+			sfree (job->args.log.msg);
+		else if (PLUGIN_NOTIF == job->type)
+			plugin_notification_meta_free (job->args.notif.meta);
+		else if (PLUGIN_FLUSH == job->type)
+			sfree (job->args.flush.identifier);
+
+		sfree (job);
+		job = next;
+	}
+	return;
+} /* static void c_job_free (c_job_t *) */
+
+#define C_JOB_IS_SYNC(job) \
+	((PLUGIN_READ == (job)->type) || (PLUGIN_FC_EXEC == (job)->type))
+
+/* must be called with pool.mutex locked
+ * Removes the next job from the queues. Consecutive PLUGIN_WRITE jobs are
+ * returned as a list of at most pool_write_batch_size jobs. Returns NULL if
+ * there is no job which may be processed right now. */
+static c_job_t *c_pool_dequeue (void)
+{
+	c_job_t *job = pool.sync_head;
+	c_job_t *last;
+	int num = 1;
+
+	if (NULL != job) {
+		pool.sync_head = job->next;
+		if (NULL == pool.sync_head)
+			pool.sync_tail = NULL;
+		job->next = NULL;
+		return job;
+	}
+
+	job = pool.head;
+	if (NULL == job)
+		return NULL;
+
+	/* the write callbacks have to see the values queued before a flush
+	 * request before the flush callbacks are called */
+	if ((PLUGIN_FLUSH == job->type) && (0 < pool.writes_running))
+		return NULL;
+
+	last = job;
+	if (PLUGIN_WRITE == job->type) {
+		while ((NULL != last->next) && (PLUGIN_WRITE == last->next->type)
+				&& (num < pool_write_batch_size)) {
+			last = last->next;
+			++num;
+		}
+		++pool.writes_running;
+	}
+
+	pool.head = last->next;
+	if (NULL == pool.head)
+		pool.tail = NULL;
+	pool.queue_len -= (size_t)num;
+
+	last->next = NULL;
+	return job;
+} /* static c_job_t *c_pool_dequeue (void) */
+
+static int c_pool_run (pTHX_ c_job_t *job)
+{
+	if (PLUGIN_READ == job->type)
+		return pplugin_call_all (aTHX_ PLUGIN_READ);
+	else if (PLUGIN_WRITE == job->type)
+		return pplugin_write_batch (aTHX_ job);
+	else if (PLUGIN_LOG == job->type)
+		return pplugin_call_all (aTHX_ PLUGIN_LOG,
+				job->args.log.level, job->args.log.msg);
+	else if (PLUGIN_NOTIF == job->type)
+		return pplugin_call_all (aTHX_ PLUGIN_NOTIF, &job->args.notif);
+	else if (PLUGIN_FLUSH == job->type)
+		return pplugin_call_all (aTHX_ PLUGIN_FLUSH,
+				job->args.flush.timeout, job->args.flush.identifier);
+	else if (PLUGIN_FC_EXEC == job->type)
+		return fc_call (aTHX_ job->args.fc.type, FC_CB_EXEC,
+				job->args.fc.data, job->args.fc.ds, job->args.fc.vl,
+				job->args.fc.meta);
+	return -1;
+} /* static int c_pool_run (c_job_t *) */
+
+static void *c_pool_worker (void *arg)
+{
+	c_ithread_t *t = arg;
+
+	dTHXa (t->interp);
+	PERL_SET_CONTEXT (aTHX);
+
+	pthread_mutex_lock (&pool.mutex);
+	while (42) {
+		c_job_t *job;
+		int status;
+
+		if (NULL == (job = c_pool_dequeue ())) {
+			/* pending jobs are processed before shutting down */
+			if (pool.shutdown && (NULL == pool.head)
+					&& (NULL == pool.sync_head))
+				break;
+			pthread_cond_wait (&pool.job_cond, &pool.mutex);
+			continue;
+		}
+
+		pthread_mutex_unlock (&pool.mutex);
+		status = c_pool_run (aTHX_ job);
+		pthread_mutex_lock (&pool.mutex);
+
+		if (C_JOB_IS_SYNC (job)) {
+			job->status = status;
+			job->done = 1;
+			pthread_cond_broadcast (&pool.done_cond);
+		}
+		else {
+			/* wake up workers waiting to process a flush request */
+			if ((PLUGIN_WRITE == job->type) && (0 == --pool.writes_running))
+				pthread_cond_broadcast (&pool.job_cond);
+
+			pthread_mutex_unlock (&pool.mutex);
+			c_job_free (job);
+			pthread_mutex_lock (&pool.mutex);
+		}
+	}
+	pthread_mutex_unlock (&pool.mutex);
+	return NULL;
+} /* static void *c_pool_worker (void *) */
+
+/* Queues "job". Asynchronous jobs are owned by the pool afterwards. Returns
+ * EAGAIN if the queue is full; flush requests are never refused. */
+static int c_pool_submit (c_job_t *job)
+{
+	pthread_mutex_lock (&pool.mutex);
+
+	if (pool.shutdown) {
+		pthread_mutex_unlock (&pool.mutex);
+		return -1;
+	}
+
+	job->next = NULL;
+	if (C_JOB_IS_SYNC (job)) {
+		if (NULL == pool.sync_tail)
+			pool.sync_head = job;
+		else
+			pool.sync_tail->next = job;
+		pool.sync_tail = job;
+	}
+	else {
+		if ((0 < pool_queue_limit) && (PLUGIN_FLUSH != job->type)
+				&& (pool.queue_len >= (size_t)pool_queue_limit)) {
+			pthread_mutex_unlock (&pool.mutex);
+			return EAGAIN;
+		}
+
+		if (NULL == pool.tail)
+			pool.head = job;
+		else
+			pool.tail->next = job;
+		pool.tail = job;
+		++pool.queue_len;
+	}
+
+	pthread_cond_signal (&pool.job_cond);
+	pthread_mutex_unlock (&pool.mutex);
+	return 0;
+} /* static int c_pool_submit (c_job_t *) */
+
+/* Queues the asynchronous "job" and complains if it has been dropped because
+ * the queue is full. */
+static int c_pool_submit_async (c_job_t *job, const char *what)
+{
+	int status = c_pool_submit (job);
+
+	if (EAGAIN == status) {
+		c_job_free (job);
+		c_complain (LOG_WARNING, &pool_complaint,
+				"perl plugin: The queue of the interpreters is full "
+				"(QueueLimit %i). Dropping %s.", pool_queue_limit, what);
+		return -1;
+	}
+	else if (0 != status) {
+		c_job_free (job);
+		return -1;
+	}
+
+	/* only report recovery once the interpreters have caught up */
+	if (0 != pool_complaint.interval) {
+		size_t queue_len;
+
+		pthread_mutex_lock (&pool.mutex);
+		queue_len = pool.queue_len;
+		pthread_mutex_unlock (&pool.mutex);
+
+		if (queue_len <= (size_t)pool_queue_limit / 2)
+			c_release (LOG_INFO, &pool_complaint, "perl plugin: The queue of "
+					"the interpreters is no longer full.");
+	}
+	return 0;
+} /* static int c_pool_submit_async (c_job_t *, const char *) */
+
+/* Queues "job" and waits for it to be processed. */
+static int c_pool_call (c_job_t *job)
+{
+	job->done = 0;
+	job->status = -1;
+
+	if (0 != c_pool_submit (job))
+		return -1;
+
+	pthread_mutex_lock (&pool.mutex);
+	while (! job->done)
+		pthread_cond_wait (&pool.done_cond, &pool.mutex);
+	pthread_mutex_unlock (&pool.mutex);
+
+	return job->status;
+} /* static int c_pool_call (c_job_t *) */
+
+static c_job_t *c_job_create (int type)
+{
+	c_job_t *job = malloc (sizeof (*job));
+
+	/* not logging anything here, this is used by perl_log() */
+	if (NULL == job)
+		return NULL;
+
+	memset (job, 0, sizeof (*job));
+	job->type = type;
+	return job;
+} /* static c_job_t *c_job_create (int) */
+
+static int c_pool_write (const data_set_t *ds, const value_list_t *vl)
+{
+	c_job_t *job = c_job_create (PLUGIN_WRITE);
+
+	if (NULL == job) {
+		log_err ("c_pool_write: malloc failed.");
+		return -1;
+	}
+
+	job->args.write.ds = ds;
+	memcpy (&job->args.write.vl, vl, sizeof (*vl));
+	job->args.write.vl.meta = NULL;
+	job->args.write.vl.values = malloc (vl->values_len * sizeof (*vl->values));
+
+	if (NULL == job->args.write.vl.values) {
+		log_err ("c_pool_write: malloc failed.");
+		sfree (job);
+		return -1;
+	}
+	memcpy (job->args.write.vl.values, vl->values,
+			vl->values_len * sizeof (*vl->values));
+
+	return c_pool_submit_async (job, "values");
+} /* static int c_pool_write (const data_set_t *, const value_list_t *) */
+
+/* Starts the worker threads. Must be called by the main thread after the
+ * init callbacks have been run by the base interpreter. */
+static int c_pool_start (void)
+{
+	dTHXa (perl_threads->head->interp);
+	int i;
+
+	pool.threads = calloc ((size_t)pool_size, sizeof (*pool.threads));
+	if (NULL == pool.threads) {
+		log_err ("c_pool_start: calloc failed.");
+		return -1;
+	}
+
+	for (i = 0; i < pool_size; ++i) {
+		c_ithread_t *t = NULL;
+		int status;
+
+		pthread_mutex_lock (&perl_threads->mutex);
+		t = c_ithread_create (aTHX);
+		pthread_mutex_unlock (&perl_threads->mutex);
+
+		/* perl_clone() leaves us in the new interpreter's context and
+		 * c_ithread_create() assigned it to this thread */
+		PERL_SET_CONTEXT (aTHX);
+		pthread_setspecific (perl_thr_key, (const void *)perl_threads->head);
+
+		status = plugin_thread_create (pool.threads + pool.threads_num,
+				/* attr = */ NULL, c_pool_worker, t);
+		if (0 != status) {
+			log_err ("c_pool_start: Creating worker thread failed.");
+			break;
+		}
+		++pool.threads_num;
+	}
+
+	if (0 == pool.threads_num) {
+		log_warn ("Falling back to one interpreter per thread.");
+		sfree (pool.threads);
+		pool_size = 0;
+		return -1;
+	}
+
+	log_info ("Started %zu Perl interpreter(s).", pool.threads_num);
+	return 0;
+} /* static int c_pool_start (void) */
+
+/* Processes all pending jobs and stops the worker threads. */
+static void c_pool_stop (void)
+{
+	size_t i;
+
+	pthread_mutex_lock (&pool.mutex);
+	pool.shutdown = 1;
+	pthread_cond_broadcast (&pool.job_cond);
+	pthread_mutex_unlock (&pool.mutex);
+
+	for (i = 0; i < pool.threads_num; ++i)
+		pthread_join (pool.threads[i], NULL);
+
+	sfree (pool.threads);
+	pool.threads_num = 0;
+	return;
+} /* static void c_pool_stop (void) */
+
 /*
  * Filter chains implementation.
  */
@@ -1484,6 +2009,19 @@ static int fc_exec (int type, const data_set_t *ds, const value_list_t *vl,
 
 	assert (NULL != data);
 
+	if ((NULL == aTHX) && (0 < pool_size)) {
+		c_job_t job;
+
+		memset (&job, 0, sizeof (job));
+		job.type = PLUGIN_FC_EXEC;
+		job.args.fc.type = type;
+		job.args.fc.data = data;
+		job.args.fc.ds   = ds;
+		job.args.fc.vl   = vl;
+		job.args.fc.meta = meta;
+		return c_pool_call (&job);
+	}
+
 	if (NULL == aTHX) {
 		c_ithread_t *t = NULL;
 
@@ -1908,6 +2446,7 @@ static XS (Collectd_call_by_name)
 
 static int perl_init (void)
 {
+	int status;
 	dTHX;
 
 	if (NULL == perl_threads)
@@ -1925,7 +2464,13 @@ static int perl_init (void)
 
 	log_debug ("perl_init: c_ithread: interp = %p (active threads: %i)",
 			aTHX, perl_threads->number_of_threads);
-	return pplugin_call_all (aTHX_ PLUGIN_INIT);
+	status = pplugin_call_all (aTHX_ PLUGIN_INIT);
+
+	/* clone the interpreters after the init callbacks have been run, just
+	 * like the read threads would otherwise do */
+	if ((0 < pool_size) && (aTHX == perl_threads->head->interp))
+		c_pool_start ();
+	return status;
 } /* static int perl_init (void) */
 
 static int perl_read (void)
@@ -1935,6 +2480,14 @@ static int perl_read (void)
 	if (NULL == perl_threads)
 		return 0;
 
+	if ((NULL == aTHX) && (0 < pool_size)) {
+		c_job_t job;
+
+		memset (&job, 0, sizeof (job));
+		job.type = PLUGIN_READ;
+		return c_pool_call (&job);
+	}
+
 	if (NULL == aTHX) {
 		c_ithread_t *t = NULL;
 
@@ -1964,6 +2517,9 @@ static int perl_write (const data_set_t *ds, const value_list_t *vl,
 	if (NULL == perl_threads)
 		return 0;
 
+	if ((NULL == aTHX) && (0 < pool_size))
+		return c_pool_write (ds, vl);
+
 	if (NULL == aTHX) {
 		c_ithread_t *t = NULL;
 
@@ -1998,6 +2554,22 @@ static void perl_log (int level, const char *msg,
 	if (NULL == perl_threads)
 		return;
 
+	if ((NULL == aTHX) && (0 < pool_size)) {
+		c_job_t *job = c_job_create (PLUGIN_LOG);
+
+		if (NULL == job)
+			return;
+
+		job->args.log.level = level;
+		job->args.log.msg = strdup (msg);
+
+		/* dropped silently if the queue is full; complaining would log
+		 * through this function again */
+		if ((NULL == job->args.log.msg) || (0 != c_pool_submit (job)))
+			c_job_free (job);
+		return;
+	}
+
 	if (NULL == aTHX) {
 		c_ithread_t *t = NULL;
 
@@ -2030,6 +2602,21 @@ static int perl_notify (const notification_t *notif,
 	if (NULL == perl_threads)
 		return 0;
 
+	if ((NULL == aTHX) && (0 < pool_size)) {
+		c_job_t *job = c_job_create (PLUGIN_NOTIF);
+
+		if (NULL == job) {
+			log_err ("perl_notify: malloc failed.");
+			return -1;
+		}
+
+		memcpy (&job->args.notif, notif, sizeof (*notif));
+		job->args.notif.meta = NULL;
+		plugin_notification_meta_copy (&job->args.notif, notif);
+
+		return c_pool_submit_async (job, "a notification");
+	}
+
 	if (NULL == aTHX) {
 		c_ithread_t *t = NULL;
 
@@ -2050,6 +2637,25 @@ static int perl_flush (cdtime_t timeout, const char *identifier,
 	if (NULL == perl_threads)
 		return 0;
 
+	if ((NULL == aTHX) && (0 < pool_size)) {
+		c_job_t *job = c_job_create (PLUGIN_FLUSH);
+
+		if (NULL == job) {
+			log_err ("perl_flush: malloc failed.");
+			return -1;
+		}
+
+		job->args.flush.timeout = timeout;
+		if (NULL != identifier)
+			job->args.flush.identifier = strdup (identifier);
+
+		if (0 != c_pool_submit (job)) {
+			c_job_free (job);
+			return -1;
+		}
+		return 0;
+	}
+
 	if (NULL == aTHX) {
 		c_ithread_t *t = NULL;
 
@@ -2095,6 +2701,9 @@ static int perl_shutdown (void)
 	plugin_unregister_write ("perl");
 	plugin_unregister_flush ("perl");
 
+	if (0 < pool_size)
+		c_pool_stop ();
+
 	ret = pplugin_call_all (aTHX_ PLUGIN_SHUTDOWN);
 
 	pthread_mutex_lock (&perl_threads->mutex);
@@ -2441,6 +3050,70 @@ static int perl_config_includedir (pTHX_ oconfig_item_t *ci)
 	return 0;
 } /* static int perl_config_includedir (oconfig_item_it *) */
 
+/*
+ * Interpreters <Number>
+ */
+static int perl_config_interpreters (pTHX_ oconfig_item_t *ci)
+{
+	int value = 0;
+
+	if ((0 != ci->children_num) || (0 != cf_util_get_int (ci, &value))) {
+		log_err ("Interpreters expects a single number argument.");
+		return 1;
+	}
+
+	if (0 > value) {
+		log_err ("Interpreters must not be negative.");
+		return 1;
+	}
+
+	log_debug ("perl_config: Using %i interpreter(s)", value);
+	pool_size = value;
+	return 0;
+} /* static int perl_config_interpreters (oconfig_item_it *) */
+
+/*
+ * WriteBatchSize <Number>
+ */
+static int perl_config_writebatchsize (pTHX_ oconfig_item_t *ci)
+{
+	int value = 0;
+
+	if ((0 != ci->children_num) || (0 != cf_util_get_int (ci, &value))) {
+		log_err ("WriteBatchSize expects a single number argument.");
+		return 1;
+	}
+
+	if (1 > value) {
+		log_err ("WriteBatchSize must be positive.");
+		return 1;
+	}
+
+	pool_write_batch_size = value;
+	return 0;
+} /* static int perl_config_writebatchsize (oconfig_item_it *) */
+
+/*
+ * QueueLimit <Number>
+ */
+static int perl_config_queuelimit (pTHX_ oconfig_item_t *ci)
+{
+	int value = 0;
+
+	if ((0 != ci->children_num) || (0 != cf_util_get_int (ci, &value))) {
+		log_err ("QueueLimit expects a single number argument.");
+		return 1;
+	}
+
+	if (0 > value) {
+		log_err ("QueueLimit must not be negative.");
+		return 1;
+	}
+
+	pool_queue_limit = value;
+	return 0;
+} /* static int perl_config_queuelimit (oconfig_item_it *) */
+
 /*
  * <Plugin> block
  */
@@ -2522,6 +3195,12 @@ static int perl_config (oconfig_item_t *ci)
 			current_status = perl_config_enabledebugger (aTHX_ c);
 		else if (0 == strcasecmp (c->key, "IncludeDir"))
 			current_status = perl_config_includedir (aTHX_ c);
+		else if (0 == strcasecmp (c->key, "Interpreters"))
+			current_status = perl_config_interpreters (aTHX_ c);
+		else if (0 == strcasecmp (c->key, "WriteBatchSize"))
+			current_status = perl_config_writebatchsize (aTHX_ c);
+		else if (0 == strcasecmp (c->key, "QueueLimit"))
+			current_status = perl_config_queuelimit (aTHX_ c);
 		else if (0 == strcasecmp (c->key, "Plugin"))
 			current_status = perl_config_plugin (aTHX_ c);
 		else
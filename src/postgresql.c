@@ -44,6 +44,8 @@
 # include <pthread.h>
 #endif
 
+#include <poll.h>
+
 #include <pg_config_manual.h>
 #include <libpq-fe.h>
 
@@ -127,6 +129,12 @@ typedef struct {
 	c_psql_writer_t **writers;
 	size_t            writers_num;
 
+	/* Additional connections used for executing queries concurrently with
+	 * those on "conn"; see c_psql_read_concurrent(). */
+	PGconn     **pool;
+	size_t       pool_num;
+	c_complain_t pool_complaint;
+
 	/* make sure we don't access the database object in parallel */
 	pthread_mutex_t   db_lock;
 
@@ -252,6 +260,10 @@ static c_psql_database_t *c_psql_database_new (const char *name)
 	db->writers        = NULL;
 	db->writers_num    = 0;
 
+	db->pool           = NULL;
+	db->pool_num       = 0;
+	C_COMPLAIN_INIT (&db->pool_complaint);
+
 	pthread_mutex_init (&db->db_lock, /* attrs = */ NULL);
 
 	db->interval   = 0;
@@ -298,6 +310,12 @@ static void c_psql_database_delete (void *data)
 	PQfinish (db->conn);
 	db->conn = NULL;
 
+	for (i = 0; i < db->pool_num; ++i)
+		if (db->pool[i] != NULL)
+			PQfinish (db->pool[i]);
+	sfree (db->pool);
+	db->pool_num = 0;
+
 	if (db->q_prep_areas)
 		for (i = 0; i < db->queries_num; ++i)
 			udb_query_delete_preparation_area (db->q_prep_areas[i]);
@@ -334,16 +352,13 @@ static void c_psql_database_delete (void *data)
 	return;
 } /* c_psql_database_delete */
 
-static int c_psql_connect (c_psql_database_t *db)
+static PGconn *c_psql_new_conn (c_psql_database_t *db)
 {
 	char  conninfo[4096];
 	char *buf     = conninfo;
 	int   buf_len = sizeof (conninfo);
 	int   status;
 
-	if ((! db) || (! db->database))
-		return -1;
-
 	status = ssnprintf (buf, buf_len, "dbname = '%s'", db->database);
 	if (0 < status) {
 		buf     += status;
@@ -358,11 +373,50 @@ static int c_psql_connect (c_psql_database_t *db)
 	C_PSQL_PAR_APPEND (buf, buf_len, "krbsrvname", db->krbsrvname);
 	C_PSQL_PAR_APPEND (buf, buf_len, "service",    db->service);
 
-	db->conn = PQconnectdb (conninfo);
+	return PQconnectdb (conninfo);
+} /* c_psql_new_conn */
+
+static int c_psql_connect (c_psql_database_t *db)
+{
+	if ((! db) || (! db->database))
+		return -1;
+
+	db->conn = c_psql_new_conn (db);
 	db->proto_version = PQprotocolVersion (db->conn);
 	return 0;
 } /* c_psql_connect */
 
+/* Connects or reconnects the additional connections of the pool. Returns the
+ * number of usable connections. */
+static size_t c_psql_check_pool (c_psql_database_t *db)
+{
+	size_t ok = 0;
+	size_t i;
+
+	for (i = 0; i < db->pool_num; ++i) {
+		if (NULL == db->pool[i])
+			db->pool[i] = c_psql_new_conn (db);
+		else if (CONNECTION_OK != PQstatus (db->pool[i]))
+			PQreset (db->pool[i]);
+
+		if ((NULL != db->pool[i])
+				&& (CONNECTION_OK == PQstatus (db->pool[i])))
+			++ok;
+	}
+
+	if (ok < db->pool_num)
+		c_complain (LOG_ERR, &db->pool_complaint,
+				"Only %zu of %zu additional connections to database %s (%s) "
+				"could be established.", ok, db->pool_num,
+				db->database, db->instance);
+	else
+		c_release (LOG_INFO, &db->pool_complaint,
+				"All %zu additional connections to database %s (%s) have "
+				"been established.", db->pool_num,
+				db->database, db->instance);
+	return ok;
+} /* c_psql_check_pool */
+
 static int c_psql_check_connection (c_psql_database_t *db)
 {
 	_Bool init = 0;
@@ -426,17 +480,12 @@ static PGresult *c_psql_exec_query_noparams (c_psql_database_t *db,
 	return PQexec (db->conn, udb_query_get_statement (q));
 } /* c_psql_exec_query_noparams */
 
-static PGresult *c_psql_exec_query_params (c_psql_database_t *db,
-		udb_query_t *q, c_psql_user_data_t *data)
+/* Fills in the parameters of a query. "interval" is used as buffer for the
+ * interval parameter and must be at least 64 bytes long. */
+static void c_psql_query_params (c_psql_database_t *db,
+		c_psql_user_data_t *data, const char **params, char *interval)
 {
-	const char *params[db->max_params_num];
-	char        interval[64];
-	int         i;
-
-	if ((data == NULL) || (data->params_num == 0))
-		return (c_psql_exec_query_noparams (db, q));
-
-	assert (db->max_params_num >= data->params_num);
+	int i;
 
 	for (i = 0; i < data->params_num; ++i) {
 		switch (data->params[i]) {
@@ -451,7 +500,7 @@ static PGresult *c_psql_exec_query_params (c_psql_database_t *db,
 				params[i] = db->user;
 				break;
 			case C_PSQL_PARAM_INTERVAL:
-				ssnprintf (interval, sizeof (interval), "%.3f",
+				ssnprintf (interval, 64, "%.3f",
 						(db->interval > 0)
 						? CDTIME_T_TO_DOUBLE (db->interval)
 						: plugin_get_interval ());
@@ -464,6 +513,20 @@ static PGresult *c_psql_exec_query_params (c_psql_database_t *db,
 				assert (0);
 		}
 	}
+} /* c_psql_query_params */
+
+static PGresult *c_psql_exec_query_params (c_psql_database_t *db,
+		udb_query_t *q, c_psql_user_data_t *data)
+{
+	const char *params[db->max_params_num];
+	char        interval[64];
+
+	if ((data == NULL) || (data->params_num == 0))
+		return (c_psql_exec_query_noparams (db, q));
+
+	assert (db->max_params_num >= data->params_num);
+
+	c_psql_query_params (db, data, params, interval);
 
 	return PQexecParams (db->conn, udb_query_get_statement (q),
 			data->params_num, NULL,
@@ -471,14 +534,12 @@ static PGresult *c_psql_exec_query_params (c_psql_database_t *db,
 			NULL, NULL, /* return text data */ 0);
 } /* c_psql_exec_query_params */
 
-/* db->db_lock must be locked when calling this function */
-static int c_psql_exec_query (c_psql_database_t *db, udb_query_t *q,
-		udb_query_preparation_area_t *prep_area)
+/* Hands the rows of "res" to the db query interface. Does not access the
+ * connection, so db->db_lock does not need to be locked. */
+static int c_psql_handle_result (c_psql_database_t *db, udb_query_t *q,
+		udb_query_preparation_area_t *prep_area, PGresult *res,
+		cdtime_t begin)
 {
-	PGresult *res;
-
-	c_psql_user_data_t *data;
-
 	const char *host;
 
 	char **column_names;
@@ -489,53 +550,12 @@ static int c_psql_exec_query (c_psql_database_t *db, udb_query_t *q,
 	int status;
 	int row, col;
 
-	/* The user data may hold parameter information, but may be NULL. */
-	data = udb_query_get_user_data (q);
-
-	/* Versions up to `3' don't know how to handle parameters. */
-	if (3 <= db->proto_version)
-		res = c_psql_exec_query_params (db, q, data);
-	else if ((NULL == data) || (0 == data->params_num))
-		res = c_psql_exec_query_noparams (db, q);
-	else {
-		log_err ("Connection to database \"%s\" (%s) does not support "
-				"parameters (protocol version %d) - "
-				"cannot execute query \"%s\".",
-				db->database, db->instance, db->proto_version,
-				udb_query_get_name (q));
-		return -1;
-	}
-
-	/* give c_psql_write() a chance to acquire the lock if called recursively
-	 * through dispatch_values(); this will happen if, both, queries and
-	 * writers are configured for a single connection */
-	pthread_mutex_unlock (&db->db_lock);
-
 	column_names = NULL;
 	column_values = NULL;
 
-	if (PGRES_TUPLES_OK != PQresultStatus (res)) {
-		pthread_mutex_lock (&db->db_lock);
-
-		if ((CONNECTION_OK != PQstatus (db->conn))
-				&& (0 == c_psql_check_connection (db))) {
-			PQclear (res);
-			return c_psql_exec_query (db, q, prep_area);
-		}
-
-		log_err ("Failed to execute SQL query: %s",
-				PQerrorMessage (db->conn));
-		log_info ("SQL query was: %s",
-				udb_query_get_statement (q));
-		PQclear (res);
-		return -1;
-	}
-
 #define BAIL_OUT(status) \
 	sfree (column_names); \
 	sfree (column_values); \
-	PQclear (res); \
-	pthread_mutex_lock (&db->db_lock); \
 	return status
 
 	rows_num = PQntuples (res);
@@ -557,8 +577,8 @@ static int c_psql_exec_query (c_psql_database_t *db, udb_query_t *q,
 	}
 	
 	for (col = 0; col < column_num; ++col) {
-		/* Pointers returned by `PQfname' are freed by `PQclear' via
-		 * `BAIL_OUT'. */
+		/* Pointers returned by `PQfname' are freed by `PQclear' in the
+		 * caller. */
 		column_names[col] = PQfname (res, col);
 		if (NULL == column_names[col]) {
 			log_err ("Failed to resolve name of column %i.", col);
@@ -583,8 +603,8 @@ static int c_psql_exec_query (c_psql_database_t *db, udb_query_t *q,
 
 	for (row = 0; row < rows_num; ++row) {
 		for (col = 0; col < column_num; ++col) {
-			/* Pointers returned by `PQgetvalue' are freed by `PQclear' via
-			 * `BAIL_OUT'. */
+			/* Pointers returned by `PQgetvalue' are freed by `PQclear' in
+			 * the caller. */
 			column_values[col] = PQgetvalue (res, row, col);
 			if (NULL == column_values[col]) {
 				log_err ("Failed to get value at (row = %i, col = %i).",
@@ -604,12 +624,278 @@ static int c_psql_exec_query (c_psql_database_t *db, udb_query_t *q,
 		}
 	} /* for (row = 0; row < rows_num; ++row) */
 
+	udb_query_submit_stats (q, prep_area, cdtime () - begin);
 	udb_query_finish_result (q, prep_area);
 
 	BAIL_OUT (0);
 #undef BAIL_OUT
+} /* c_psql_handle_result */
+
+/* db->db_lock must be locked when calling this function */
+static int c_psql_exec_query (c_psql_database_t *db, udb_query_t *q,
+		udb_query_preparation_area_t *prep_area)
+{
+	PGresult *res;
+
+	c_psql_user_data_t *data;
+
+	cdtime_t begin;
+	int status;
+
+	/* The user data may hold parameter information, but may be NULL. */
+	data = udb_query_get_user_data (q);
+
+	begin = cdtime ();
+
+	/* Versions up to `3' don't know how to handle parameters. */
+	if (3 <= db->proto_version)
+		res = c_psql_exec_query_params (db, q, data);
+	else if ((NULL == data) || (0 == data->params_num))
+		res = c_psql_exec_query_noparams (db, q);
+	else {
+		log_err ("Connection to database \"%s\" (%s) does not support "
+				"parameters (protocol version %d) - "
+				"cannot execute query \"%s\".",
+				db->database, db->instance, db->proto_version,
+				udb_query_get_name (q));
+		return -1;
+	}
+
+	/* give c_psql_write() a chance to acquire the lock if called recursively
+	 * through dispatch_values(); this will happen if, both, queries and
+	 * writers are configured for a single connection */
+	pthread_mutex_unlock (&db->db_lock);
+
+	if (PGRES_TUPLES_OK != PQresultStatus (res)) {
+		pthread_mutex_lock (&db->db_lock);
+
+		if ((CONNECTION_OK != PQstatus (db->conn))
+				&& (0 == c_psql_check_connection (db))) {
+			PQclear (res);
+			return c_psql_exec_query (db, q, prep_area);
+		}
+
+		log_err ("Failed to execute SQL query: %s",
+				PQerrorMessage (db->conn));
+		log_info ("SQL query was: %s",
+				udb_query_get_statement (q));
+		PQclear (res);
+		return -1;
+	}
+
+	status = c_psql_handle_result (db, q, prep_area, res, begin);
+
+	PQclear (res);
+	pthread_mutex_lock (&db->db_lock);
+	return status;
 } /* c_psql_exec_query */
 
+/* Sends query "q" on "conn" without waiting for the result. */
+static int c_psql_send_query (c_psql_database_t *db, PGconn *conn,
+		udb_query_t *q)
+{
+	c_psql_user_data_t *data = udb_query_get_user_data (q);
+	const char *params[db->max_params_num > 0 ? db->max_params_num : 1];
+	char        interval[64];
+
+	if ((NULL == data) || (0 == data->params_num))
+		return PQsendQuery (conn, udb_query_get_statement (q));
+
+	if (3 > db->proto_version) {
+		log_err ("Connection to database \"%s\" (%s) does not support "
+				"parameters (protocol version %d) - "
+				"cannot execute query \"%s\".",
+				db->database, db->instance, db->proto_version,
+				udb_query_get_name (q));
+		return 0;
+	}
+
+	c_psql_query_params (db, data, params, interval);
+
+	return PQsendQueryParams (conn, udb_query_get_statement (q),
+			data->params_num, NULL,
+			(const char *const *) params,
+			NULL, NULL, /* return text data */ 0);
+} /* c_psql_send_query */
+
+/* Cancels the query running on "conn" and discards its results, so that the
+ * connection can be used again. */
+static void c_psql_cancel_query (PGconn *conn)
+{
+	PGcancel *cancel;
+	PGresult *res;
+	char errbuf[256];
+
+	cancel = PQgetCancel (conn);
+	if (NULL != cancel) {
+		if (! PQcancel (cancel, errbuf, sizeof (errbuf)))
+			log_warn ("Failed to cancel SQL query: %s", errbuf);
+		PQfreeCancel (cancel);
+	}
+
+	while (NULL != (res = PQgetResult (conn)))
+		PQclear (res);
+} /* c_psql_cancel_query */
+
+/* Executes the queries of "db" using the connections of the pool, and "conn"
+ * unless writers need it, at the same time. Each connection has at most one
+ * query in flight; when its result has been handled, the next query is sent
+ * on that connection. Queries which have not finished after one interval are
+ * cancelled. db->db_lock is released while dispatching values, like
+ * c_psql_exec_query() does. Returns the number of successful queries. */
+static int c_psql_read_concurrent (c_psql_database_t *db)
+{
+	struct {
+		PGconn  *conn;
+		size_t   query;
+		cdtime_t begin;
+		_Bool    busy;
+		_Bool    failed;
+	} slots[db->pool_num + 1];
+	struct pollfd fds[db->pool_num + 1];
+	size_t slots_num = 0;
+	size_t busy = 0;
+	size_t next = 0;
+	int success = 0;
+	cdtime_t timeout;
+	cdtime_t deadline;
+	size_t i;
+
+	timeout = (db->interval > 0) ? db->interval : plugin_get_interval ();
+	deadline = cdtime () + timeout;
+
+	memset (slots, 0, sizeof (slots));
+	/* c_psql_write() may use "conn" while the lock is released. */
+	if (0 == db->writers_num)
+		slots[slots_num++].conn = db->conn;
+	for (i = 0; i < db->pool_num; ++i)
+		if ((NULL != db->pool[i])
+				&& (CONNECTION_OK == PQstatus (db->pool[i])))
+			slots[slots_num++].conn = db->pool[i];
+
+	while (42) {
+		size_t fds_num = 0;
+		cdtime_t now;
+		int status;
+
+		/* Send the next queries on idle connections. */
+		for (i = 0; i < slots_num; ++i) {
+			while (! slots[i].busy && ! slots[i].failed
+					&& (next < db->queries_num)) {
+				udb_query_t *q = db->queries[next];
+
+				if ((0 != db->server_version)
+						&& (udb_query_check_version (q, db->server_version) <= 0)) {
+					++next;
+					continue;
+				}
+
+				slots[i].begin = cdtime ();
+				if (! c_psql_send_query (db, slots[i].conn, q)) {
+					log_err ("Failed to send SQL query \"%s\": %s",
+							udb_query_get_name (q),
+							PQerrorMessage (slots[i].conn));
+					if (CONNECTION_OK != PQstatus (slots[i].conn))
+						slots[i].failed = 1;
+					++next;
+					continue;
+				}
+
+				slots[i].query = next;
+				slots[i].busy = 1;
+				++busy;
+				++next;
+			}
+		}
+
+		if (0 == busy)
+			break;
+
+		now = cdtime ();
+		if (now >= deadline) {
+			log_err ("%zu SQL queries did not finish within %.3f seconds "
+					"and are cancelled.", busy, CDTIME_T_TO_DOUBLE (timeout));
+			break;
+		}
+
+		for (i = 0; i < slots_num; ++i) {
+			if (! slots[i].busy)
+				continue;
+			fds[fds_num].fd = PQsocket (slots[i].conn);
+			fds[fds_num].events = POLLIN;
+			fds[fds_num].revents = 0;
+			++fds_num;
+		}
+
+		status = poll (fds, (nfds_t) fds_num,
+				(int) CDTIME_T_TO_MS (deadline - now) + 1);
+		if (0 > status) {
+			char errbuf[1024];
+
+			if (EINTR == errno)
+				continue;
+
+			log_err ("poll failed: %s",
+					sstrerror (errno, errbuf, sizeof (errbuf)));
+			break;
+		}
+
+		/* Collect the results of all connections which are done. The fds
+		 * are in the same order as the busy slots. */
+		fds_num = 0;
+		for (i = 0; i < slots_num; ++i) {
+			udb_query_t *q;
+
+			if (! slots[i].busy)
+				continue;
+			if (0 == fds[fds_num++].revents)
+				continue;
+
+			q = db->queries[slots[i].query];
+			if (! PQconsumeInput (slots[i].conn))
+				slots[i].failed = 1;
+
+			while (slots[i].failed || ! PQisBusy (slots[i].conn)) {
+				PGresult *res = PQgetResult (slots[i].conn);
+
+				if (NULL == res) {
+					slots[i].busy = 0;
+					--busy;
+					break;
+				}
+
+				if (PGRES_TUPLES_OK == PQresultStatus (res)) {
+					int handled;
+
+					pthread_mutex_unlock (&db->db_lock);
+					handled = c_psql_handle_result (db, q,
+							db->q_prep_areas[slots[i].query], res,
+							slots[i].begin);
+					pthread_mutex_lock (&db->db_lock);
+
+					if (0 == handled)
+						++success;
+				}
+				else {
+					log_err ("Failed to execute SQL query: %s",
+							PQresultErrorMessage (res));
+					log_info ("SQL query was: %s",
+							udb_query_get_statement (q));
+				}
+				PQclear (res);
+			}
+		}
+	}
+
+	/* After a timeout or an error, don't leave queries running on the
+	 * connections used by the next read. */
+	for (i = 0; i < slots_num; ++i)
+		if (slots[i].busy)
+			c_psql_cancel_query (slots[i].conn);
+
+	return success;
+} /* c_psql_read_concurrent */
+
 static int c_psql_read (user_data_t *ud)
 {
 	c_psql_database_t *db;
@@ -635,6 +921,12 @@ static int c_psql_read (user_data_t *ud)
 		return -1;
 	}
 
+	if ((db->pool_num > 0) && (c_psql_check_pool (db) > 0)) {
+		success = c_psql_read_concurrent (db);
+		pthread_mutex_unlock (&db->db_lock);
+		return (success > 0) ? 0 : -1;
+	}
+
 	for (i = 0; i < db->queries_num; ++i)
 	{
 		udb_query_preparation_area_t *prep_area;
@@ -1242,6 +1534,11 @@ static int c_psql_config_database (oconfig_item_t *ci)
 			cf_util_get_cdtime (c, &db->commit_interval);
 		else if (strcasecmp ("ExpireDelay", c->key) == 0)
 			cf_util_get_cdtime (c, &db->expire_delay);
+		else if (strcasecmp ("Connections", c->key) == 0) {
+			int connections = 1;
+			if ((0 == cf_util_get_int (c, &connections)) && (1 < connections))
+				db->pool_num = (size_t) connections - 1;
+		}
 		else
 			log_warn ("Ignoring unknown config key \"%s\".", c->key);
 	}
@@ -1265,6 +1562,16 @@ static int c_psql_config_database (oconfig_item_t *ci)
 		}
 	}
 
+	if (db->pool_num > 0) {
+		db->pool = calloc (db->pool_num, sizeof (*db->pool));
+		if (db->pool == NULL) {
+			log_err ("Out of memory.");
+			db->pool_num = 0;
+			c_psql_database_delete (db);
+			return -1;
+		}
+	}
+
 	for (i = 0; (size_t)i < db->queries_num; ++i) {
 		c_psql_user_data_t *data;
 		data = udb_query_get_user_data (db->queries[i]);
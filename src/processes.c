@@ -92,6 +92,7 @@
 #  ifndef CONFIG_HZ
 #    define CONFIG_HZ 100
 #  endif
+#  include "utils_procfs.h"
 /* #endif KERNEL_LINUX */
 
 #elif HAVE_LIBKVM_GETPROCS && (HAVE_STRUCT_KINFO_PROC_FREEBSD || HAVE_STRUCT_KINFO_PROC_OPENBSD)
@@ -771,7 +772,8 @@ static void ps_submit_proc_list (procstat_t *ps)
 } /* void ps_submit_proc_list */
 
 #if KERNEL_LINUX || KERNEL_SOLARIS
-static void ps_submit_fork_rate (derive_t value)
+/* `t' is the time the counter was read or zero for "now". */
+static void ps_submit_fork_rate (derive_t value, cdtime_t t)
 {
 	value_t values[1];
 	value_list_t vl = VALUE_LIST_INIT;
@@ -780,6 +782,7 @@ static void ps_submit_fork_rate (derive_t value)
 
 	vl.values = values;
 	vl.values_len = 1;
+	vl.time = t;
 	sstrncpy(vl.host, hostname_g, sizeof (vl.host));
 	sstrncpy(vl.plugin, "processes", sizeof (vl.plugin));
 	sstrncpy(vl.plugin_instance, "", sizeof (vl.plugin_instance));
@@ -1257,47 +1260,25 @@ static char *ps_get_cmdline (long pid, char *name, char *buf, size_t buf_len)
 
 static int read_fork_rate (void)
 {
-	FILE *proc_stat;
-	char buffer[1024];
-	value_t value;
-	_Bool value_valid = 0;
+	procfs_stat_t const *st;
+	int status = 0;
 
-	proc_stat = fopen ("/proc/stat", "r");
-	if (proc_stat == NULL)
+	st = procfs_stat_acquire ();
+	if (st == NULL)
 	{
 		char errbuf[1024];
-		ERROR ("processes plugin: fopen (/proc/stat) failed: %s",
+		ERROR ("processes plugin: reading /proc/stat failed: %s",
 				sstrerror (errno, errbuf, sizeof (errbuf)));
 		return (-1);
 	}
 
-	while (fgets (buffer, sizeof (buffer), proc_stat) != NULL)
-	{
-		int status;
-		char *fields[3];
-		int fields_num;
-
-		fields_num = strsplit (buffer, fields,
-				STATIC_ARRAY_SIZE (fields));
-		if (fields_num != 2)
-			continue;
-
-		if (strcmp ("processes", fields[0]) != 0)
-			continue;
-
-		status = parse_value (fields[1], &value, DS_TYPE_DERIVE);
-		if (status == 0)
-			value_valid = 1;
-
-		break;
-	}
-	fclose(proc_stat);
-
-	if (!value_valid)
-		return (-1);
+	if (st->have_processes)
+		ps_submit_fork_rate (st->processes, st->time);
+	else
+		status = -1;
 
-	ps_submit_fork_rate (value.derive);
-	return (0);
+	procfs_release (st);
+	return (status);
 }
 #endif /*KERNEL_LINUX */
 
@@ -1477,7 +1458,7 @@ static int read_fork_rate (void)
 		}
 	}
 
-	ps_submit_fork_rate (result);
+	ps_submit_fork_rate (result, 0);
 	return (0);
 }
 #endif /* KERNEL_SOLARIS */
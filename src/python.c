@@ -26,6 +26,7 @@
 
 #include <Python.h>
 #include <structmember.h>
+#include <structseq.h>
 
 #include <signal.h>
 #if HAVE_PTHREAD_H
@@ -37,10 +38,35 @@
 
 #include "cpython.h"
 
+/* Value lists buffered for a batched write callback. */
+typedef struct cpy_batch_entry_s {
+	const data_set_t *ds;
+	value_list_t vl;
+} cpy_batch_entry_t;
+
+typedef struct cpy_batch_s {
+	pthread_mutex_t lock;
+	cpy_batch_entry_t *entries;
+	size_t entries_num;
+	size_t entries_size;
+	/* Number of value lists passed to the callback at once. */
+	size_t size;
+	/* Maximum time a value list is held back. Zero means no limit. */
+	cdtime_t timeout;
+	/* Time the first entry has been added. */
+	cdtime_t first_time;
+	/* Registrations using the callback: the write callback and, if there is
+	 * a timeout, the read callback delivering expired batches. Protected by
+	 * cpy_batch_writers_lock. */
+	int refs;
+} cpy_batch_t;
+
 typedef struct cpy_callback_s {
 	char *name;
 	PyObject *callback;
 	PyObject *data;
+	/* Only used by batched write callbacks. */
+	cpy_batch_t *batch;
 	struct cpy_callback_s *next;
 } cpy_callback_t;
 
@@ -144,7 +170,7 @@ static char reg_read_doc[] = "register_read(callback[, interval][, data][, name]
 		"The callback function will be called without parameters, except for\n"
 		"data if it was supplied.";
 
-static char reg_write_doc[] = "register_write(callback[, data][, name]) -> identifier\n"
+static char reg_write_doc[] = "register_write(callback[, data][, name][, batch_size][, batch_timeout]) -> identifier\n"
 		"\n"
 		"Register a callback function to receive values dispatched by other plugins.\n"
 		"'callback' is a callable object that will be called every time a value\n"
@@ -156,13 +182,23 @@ static char reg_write_doc[] = "register_write(callback[, data][, name]) -> ident
 		"    Every callback needs a unique identifier, so if you want to\n"
 		"    register this callback multiple time from the same module you need\n"
 		"    to specify a name here.\n"
+		"'batch_size' is an optional number of value lists. If it is greater\n"
+		"    than zero, value lists are queued and passed to the callback\n"
+		"    function in batches of this size.\n"
+		"'batch_timeout' is the maximum number of seconds a value list is\n"
+		"    queued. Defaults to 10. Zero disables the timeout.\n"
 		"'identifier' is the full identifier assigned to this callback.\n"
 		"\n"
 		"The callback function will be called with one or two parameters:\n"
 		"values: A Values object which is a copy of the dispatched values.\n"
+		"    If 'batch_size' was given, a list of ValueRecord objects instead.\n"
 		"data: The optional data parameter passed to the register function.\n"
 		"    If the parameter was omitted it will be omitted here, too.";
 
+static char value_record_doc[] = "A read-only copy of a dispatched value list passed to batched\n"
+		"write callbacks. 'values' is a tuple of numbers and 'meta' is either\n"
+		"a dict or None.";
+
 static char reg_notification_doc[] = "register_notification(callback[, data][, name]) -> identifier\n"
 		"\n"
 		"Register a callback function for notifications.\n"
@@ -236,14 +272,119 @@ static cpy_callback_t *cpy_config_callbacks;
 static cpy_callback_t *cpy_init_callbacks;
 static cpy_callback_t *cpy_shutdown_callbacks;
 
-static void cpy_destroy_user_data(void *data) {
-	cpy_callback_t *c = data;
+/* Batched write callbacks, so that queued values can be flushed on shutdown.
+ * Unlike the lists above this one is not protected by the GIL. */
+static cpy_callback_t *cpy_batch_writers;
+static pthread_mutex_t cpy_batch_writers_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static PyStructSequence_Field value_record_fields[] = {
+	{"host", NULL},
+	{"plugin", NULL},
+	{"plugin_instance", NULL},
+	{"type", NULL},
+	{"type_instance", NULL},
+	{"time", NULL},
+	{"interval", NULL},
+	{"values", NULL},
+	{"meta", NULL},
+	{NULL, NULL}
+};
+
+static PyStructSequence_Desc value_record_desc = {
+	"collectd.ValueRecord",
+	value_record_doc,
+	value_record_fields,
+	STATIC_ARRAY_SIZE(value_record_fields) - 1
+};
+
+static PyTypeObject ValueRecordType;
+
+static void cpy_batch_flush(cpy_callback_t *c, cdtime_t max_age);
+
+static void cpy_batch_entries_free(cpy_batch_entry_t *entries, size_t entries_num) {
+	size_t i;
+
+	for (i = 0; i < entries_num; ++i) {
+		sfree(entries[i].vl.values);
+		meta_data_destroy(entries[i].vl.meta);
+	}
+	sfree(entries);
+}
+
+static void cpy_batch_timer_name(cpy_callback_t *c, char *buf, size_t size) {
+	ssnprintf(buf, size, "%s/batch", c->name);
+}
+
+/* Called when the write callback goes away: stops the timer and passes the
+ * queued values on. */
+static void cpy_batch_unregister(cpy_callback_t *c) {
+	cpy_callback_t *prev = NULL, *tmp;
+	char buf[512];
+
+	pthread_mutex_lock(&cpy_batch_writers_lock);
+	for (tmp = cpy_batch_writers; tmp; prev = tmp, tmp = tmp->next)
+		if (tmp == c)
+			break;
+	if (tmp != NULL) {
+		if (prev == NULL)
+			cpy_batch_writers = tmp->next;
+		else
+			prev->next = tmp->next;
+	}
+	pthread_mutex_unlock(&cpy_batch_writers_lock);
+
+	/* The timer may be running right now; it keeps "c" alive until it has
+	 * been destroyed. */
+	if (c->batch->timeout > 0) {
+		cpy_batch_timer_name(c, buf, sizeof(buf));
+		plugin_unregister_read(buf);
+	}
+
+	/* After Py_Finalize() the queued values can only be dropped. */
+	if (Py_IsInitialized())
+		cpy_batch_flush(c, /* max_age = */ 0);
+}
+
+/* Drops one reference to a batched write callback. Returns true if it was
+ * the last one. */
+static _Bool cpy_batch_release(cpy_callback_t *c) {
+	_Bool last;
+
+	pthread_mutex_lock(&cpy_batch_writers_lock);
+	last = (--c->batch->refs == 0);
+	pthread_mutex_unlock(&cpy_batch_writers_lock);
+
+	return last;
+}
+
+static void cpy_callback_free(cpy_callback_t *c) {
+	if (c->batch != NULL) {
+		cpy_batch_entries_free(c->batch->entries, c->batch->entries_num);
+		pthread_mutex_destroy(&c->batch->lock);
+		sfree(c->batch);
+	}
 	free(c->name);
 	Py_DECREF(c->callback);
 	Py_XDECREF(c->data);
 	free(c);
 }
 
+static void cpy_destroy_user_data(void *data) {
+	cpy_callback_t *c = data;
+	if (c->batch != NULL) {
+		cpy_batch_unregister(c);
+		if (!cpy_batch_release(c))
+			return;
+	}
+	cpy_callback_free(c);
+}
+
+static void cpy_batch_timer_destroy(void *data) {
+	cpy_callback_t *c = data;
+	if (cpy_batch_release(c))
+		cpy_callback_free(c);
+}
+
 /* You must hold the GIL to call this function!
  * But if you managed to extract the callback parameter then you probably already do. */
 
@@ -354,6 +495,70 @@ static int cpy_read_callback(user_data_t *data) {
 	return 0;
 }
 
+/* Returns a new reference or NULL with an exception set. */
+static PyObject *cpy_value_to_python(int ds_type, value_t value) {
+	if (ds_type == DS_TYPE_COUNTER)
+		return PyLong_FromUnsignedLongLong(value.counter);
+	else if (ds_type == DS_TYPE_GAUGE)
+		return PyFloat_FromDouble(value.gauge);
+	else if (ds_type == DS_TYPE_DERIVE)
+		return PyLong_FromLongLong(value.derive);
+	else if (ds_type == DS_TYPE_ABSOLUTE)
+		return PyLong_FromUnsignedLongLong(value.absolute);
+
+	PyErr_Format(PyExc_TypeError, "Unknown value type %d.", ds_type);
+	return NULL;
+}
+
+/* Returns a new reference to a dict holding the entries of "meta". */
+static PyObject *cpy_meta_to_dict(meta_data_t *meta) {
+	int i, num;
+	char **table;
+	PyObject *dict, *temp;
+
+	dict = PyDict_New();  /* New reference. */
+	if (dict == NULL || meta == NULL)
+		return dict;
+
+	num = meta_data_toc(meta, &table);
+	for (i = 0; i < num; ++i) {
+		int type;
+		char *string;
+		int64_t si;
+		uint64_t ui;
+		double d;
+		_Bool b;
+
+		temp = NULL;
+		type = meta_data_type(meta, table[i]);
+		if (type == MD_TYPE_STRING) {
+			if (meta_data_get_string(meta, table[i], &string) == 0) {
+				temp = cpy_string_to_unicode_or_bytes(string);  /* New reference. */
+				free(string);
+			}
+		} else if (type == MD_TYPE_SIGNED_INT) {
+			if (meta_data_get_signed_int(meta, table[i], &si) == 0)
+				temp = PyObject_CallFunction((void *) &SignedType, "L", (long long) si);  /* New reference. */
+		} else if (type == MD_TYPE_UNSIGNED_INT) {
+			if (meta_data_get_unsigned_int(meta, table[i], &ui) == 0)
+				temp = PyObject_CallFunction((void *) &UnsignedType, "K", (unsigned long long) ui);  /* New reference. */
+		} else if (type == MD_TYPE_DOUBLE) {
+			if (meta_data_get_double(meta, table[i], &d) == 0)
+				temp = PyFloat_FromDouble(d);  /* New reference. */
+		} else if (type == MD_TYPE_BOOLEAN) {
+			if (meta_data_get_boolean(meta, table[i], &b) == 0)
+				temp = PyBool_FromLong(b);  /* New reference. */
+		}
+		if (temp != NULL) {
+			PyDict_SetItemString(dict, table[i], temp);
+			Py_DECREF(temp);
+		}
+		free(table[i]);
+	}
+	free(table);
+	return dict;
+}
+
 static int cpy_write_callback(const data_set_t *ds, const value_list_t *value_list, user_data_t *data) {
 	size_t i;
 	cpy_callback_t *c = data->data;
@@ -367,80 +572,15 @@ static int cpy_write_callback(const data_set_t *ds, const value_list_t *value_li
 			CPY_RETURN_FROM_THREADS 0;
 		}
 		for (i = 0; i < value_list->values_len; ++i) {
-			if (ds->ds[i].type == DS_TYPE_COUNTER) {
-				PyList_SetItem(list, i, PyLong_FromUnsignedLongLong(value_list->values[i].counter));
-			} else if (ds->ds[i].type == DS_TYPE_GAUGE) {
-				PyList_SetItem(list, i, PyFloat_FromDouble(value_list->values[i].gauge));
-			} else if (ds->ds[i].type == DS_TYPE_DERIVE) {
-				PyList_SetItem(list, i, PyLong_FromLongLong(value_list->values[i].derive));
-			} else if (ds->ds[i].type == DS_TYPE_ABSOLUTE) {
-				PyList_SetItem(list, i, PyLong_FromUnsignedLongLong(value_list->values[i].absolute));
-			} else {
-				Py_BEGIN_ALLOW_THREADS
-				ERROR("cpy_write_callback: Unknown value type %d.", ds->ds[i].type);
-				Py_END_ALLOW_THREADS
-				Py_DECREF(list);
-				CPY_RETURN_FROM_THREADS 0;
-			}
-			if (PyErr_Occurred() != NULL) {
+			temp = cpy_value_to_python(ds->ds[i].type, value_list->values[i]); /* New reference. */
+			if (temp == NULL) {
 				cpy_log_exception("value building for write callback");
 				Py_DECREF(list);
 				CPY_RETURN_FROM_THREADS 0;
 			}
+			PyList_SET_ITEM(list, i, temp); /* Steals a reference. */
 		}
-		dict = PyDict_New();  /* New reference. */
-		if (value_list->meta) {
-			int num;
-			char **table;
-			meta_data_t *meta = value_list->meta;
-
-			num = meta_data_toc(meta, &table);
-			for (i = 0; i < num; ++i) {
-				int type;
-				char *string;
-				int64_t si;
-				uint64_t ui;
-				double d;
-				_Bool b;
-				
-				type = meta_data_type(meta, table[i]);
-				if (type == MD_TYPE_STRING) {
-					if (meta_data_get_string(meta, table[i], &string))
-						continue;
-					temp = cpy_string_to_unicode_or_bytes(string);  /* New reference. */
-					free(string);
-					PyDict_SetItemString(dict, table[i], temp);
-					Py_XDECREF(temp);
-				} else if (type == MD_TYPE_SIGNED_INT) {
-					if (meta_data_get_signed_int(meta, table[i], &si))
-						continue;
-					temp = PyObject_CallFunctionObjArgs((void *) &SignedType, PyLong_FromLongLong(si), (void *) 0);  /* New reference. */
-					PyDict_SetItemString(dict, table[i], temp);
-					Py_XDECREF(temp);
-				} else if (type == MD_TYPE_UNSIGNED_INT) {
-					if (meta_data_get_unsigned_int(meta, table[i], &ui))
-						continue;
-					temp = PyObject_CallFunctionObjArgs((void *) &UnsignedType, PyLong_FromUnsignedLongLong(ui), (void *) 0);  /* New reference. */
-					PyDict_SetItemString(dict, table[i], temp);
-					Py_XDECREF(temp);
-				} else if (type == MD_TYPE_DOUBLE) {
-					if (meta_data_get_double(meta, table[i], &d))
-						continue;
-					temp = PyFloat_FromDouble(d);  /* New reference. */
-					PyDict_SetItemString(dict, table[i], temp);
-					Py_XDECREF(temp);
-				} else if (type == MD_TYPE_BOOLEAN) {
-					if (meta_data_get_boolean(meta, table[i], &b))
-						continue;
-					if (b)
-						PyDict_SetItemString(dict, table[i], Py_True);
-					else
-						PyDict_SetItemString(dict, table[i], Py_False);
-				}
-				free(table[i]);
-			}
-			free(table);
-		}
+		dict = cpy_meta_to_dict(value_list->meta); /* New reference. */
 		v = (Values *) Values_New(); /* New reference. */
 		sstrncpy(v->data.host, value_list->host, sizeof(v->data.host));
 		sstrncpy(v->data.type, value_list->type, sizeof(v->data.type));
@@ -464,6 +604,180 @@ static int cpy_write_callback(const data_set_t *ds, const value_list_t *value_li
 	return 0;
 }
 
+/* Returns a new ValueRecord reference or NULL with an exception set. Unlike a
+ * Values object, a record is a plain tuple and the meta dict is only built if
+ * the value list has meta data. */
+static PyObject *cpy_value_record(const data_set_t *ds, const value_list_t *vl) {
+	size_t i;
+	PyObject *record, *values, *temp;
+
+	values = PyTuple_New(vl->values_len); /* New reference. */
+	if (values == NULL)
+		return NULL;
+	for (i = 0; i < vl->values_len; ++i) {
+		temp = cpy_value_to_python(ds->ds[i].type, vl->values[i]); /* New reference. */
+		if (temp == NULL) {
+			Py_DECREF(values);
+			return NULL;
+		}
+		PyTuple_SET_ITEM(values, i, temp); /* Steals a reference. */
+	}
+
+	record = PyStructSequence_New(&ValueRecordType); /* New reference. */
+	if (record == NULL) {
+		Py_DECREF(values);
+		return NULL;
+	}
+	PyStructSequence_SET_ITEM(record, 0, cpy_string_to_unicode_or_bytes(vl->host));
+	PyStructSequence_SET_ITEM(record, 1, cpy_string_to_unicode_or_bytes(vl->plugin));
+	PyStructSequence_SET_ITEM(record, 2, cpy_string_to_unicode_or_bytes(vl->plugin_instance));
+	PyStructSequence_SET_ITEM(record, 3, cpy_string_to_unicode_or_bytes(vl->type));
+	PyStructSequence_SET_ITEM(record, 4, cpy_string_to_unicode_or_bytes(vl->type_instance));
+	PyStructSequence_SET_ITEM(record, 5, PyFloat_FromDouble(CDTIME_T_TO_DOUBLE(vl->time)));
+	PyStructSequence_SET_ITEM(record, 6, PyFloat_FromDouble(CDTIME_T_TO_DOUBLE(vl->interval)));
+	PyStructSequence_SET_ITEM(record, 7, values);
+	if (vl->meta == NULL) {
+		Py_INCREF(Py_None);
+		PyStructSequence_SET_ITEM(record, 8, Py_None);
+	} else {
+		PyStructSequence_SET_ITEM(record, 8, cpy_meta_to_dict(vl->meta));
+	}
+
+	if (PyErr_Occurred() != NULL) {
+		Py_DECREF(record);
+		return NULL;
+	}
+	return record;
+}
+
+/* Passes the queued value lists to the callback as a list of ValueRecord
+ * objects, acquiring the GIL only once. Frees "entries". */
+static void cpy_batch_deliver(cpy_callback_t *c, cpy_batch_entry_t *entries, size_t entries_num) {
+	size_t i;
+	PyObject *ret, *list, *record;
+
+	CPY_LOCK_THREADS
+		list = PyList_New(entries_num); /* New reference. */
+		if (list == NULL) {
+			cpy_log_exception("batch write callback");
+		} else {
+			for (i = 0; i < entries_num; ++i) {
+				record = cpy_value_record(entries[i].ds, &entries[i].vl); /* New reference. */
+				if (record == NULL)
+					break;
+				PyList_SET_ITEM(list, i, record); /* Steals a reference. */
+			}
+			if (i < entries_num) {
+				cpy_log_exception("value building for batch write callback");
+			} else {
+				ret = PyObject_CallFunctionObjArgs(c->callback, list, c->data, (void *) 0); /* New reference. */
+				if (ret == NULL) {
+					cpy_log_exception("batch write callback");
+				} else {
+					Py_DECREF(ret);
+				}
+			}
+			Py_DECREF(list);
+		}
+	CPY_RELEASE_THREADS
+
+	cpy_batch_entries_free(entries, entries_num);
+}
+
+/* Passes the queued value lists to the callback if the oldest one has been
+ * queued for at least "max_age". Zero passes them on unconditionally. */
+static void cpy_batch_flush(cpy_callback_t *c, cdtime_t max_age) {
+	cpy_batch_entry_t *entries;
+	size_t entries_num;
+
+	pthread_mutex_lock(&c->batch->lock);
+	if ((c->batch->entries_num == 0)
+			|| ((max_age > 0) && ((cdtime() - c->batch->first_time) < max_age))) {
+		pthread_mutex_unlock(&c->batch->lock);
+		return;
+	}
+	entries = c->batch->entries;
+	entries_num = c->batch->entries_num;
+	c->batch->entries = NULL;
+	c->batch->entries_num = 0;
+	c->batch->entries_size = 0;
+	pthread_mutex_unlock(&c->batch->lock);
+
+	cpy_batch_deliver(c, entries, entries_num);
+}
+
+/* Read callback delivering batches older than "batch_timeout" even if no
+ * further value lists arrive. */
+static int cpy_batch_timer(user_data_t *data) {
+	cpy_callback_t *c = data->data;
+
+	cpy_batch_flush(c, c->batch->timeout);
+	return 0;
+}
+
+/* Queues a copy of the value list without touching the GIL. Python is only
+ * called once "batch_size" value lists have been queued or the oldest one
+ * is older than "batch_timeout". */
+static int cpy_write_batch_callback(const data_set_t *ds, const value_list_t *value_list, user_data_t *data) {
+	cpy_callback_t *c = data->data;
+	cpy_batch_t *batch = c->batch;
+	cpy_batch_entry_t *entry, *entries;
+	size_t entries_num;
+	cdtime_t now = cdtime();
+
+	pthread_mutex_lock(&batch->lock);
+
+	if (batch->entries_num >= batch->entries_size) {
+		size_t new_size = (batch->entries_size > 0) ? 2 * batch->entries_size : batch->size;
+
+		entries = realloc(batch->entries, new_size * sizeof(*entries));
+		if (entries == NULL) {
+			pthread_mutex_unlock(&batch->lock);
+			ERROR("python plugin: cpy_write_batch_callback: realloc failed.");
+			return -1;
+		}
+		batch->entries = entries;
+		batch->entries_size = new_size;
+	}
+
+	entry = batch->entries + batch->entries_num;
+	memcpy(&entry->vl, value_list, sizeof(entry->vl));
+	entry->ds = ds;
+	entry->vl.values = malloc(value_list->values_len * sizeof(*entry->vl.values));
+	if (entry->vl.values == NULL) {
+		pthread_mutex_unlock(&batch->lock);
+		ERROR("python plugin: cpy_write_batch_callback: malloc failed.");
+		return -1;
+	}
+	memcpy(entry->vl.values, value_list->values,
+			value_list->values_len * sizeof(*entry->vl.values));
+	entry->vl.meta = NULL;
+	if (value_list->meta != NULL)
+		entry->vl.meta = meta_data_clone(value_list->meta);
+
+	if (batch->entries_num == 0)
+		batch->first_time = now;
+	batch->entries_num++;
+
+	if ((batch->entries_num < batch->size)
+			&& ((batch->timeout == 0) || ((now - batch->first_time) < batch->timeout))) {
+		pthread_mutex_unlock(&batch->lock);
+		return 0;
+	}
+
+	/* Take the queued entries and call Python without holding the lock, so
+	 * that other write threads can continue to fill the next batch. */
+	entries = batch->entries;
+	entries_num = batch->entries_num;
+	batch->entries = NULL;
+	batch->entries_num = 0;
+	batch->entries_size = 0;
+	pthread_mutex_unlock(&batch->lock);
+
+	cpy_batch_deliver(c, entries, entries_num);
+	return 0;
+}
+
 static int cpy_notification_callback(const notification_t *notification, user_data_t *data) {
 	cpy_callback_t *c = data->data;
 	PyObject *ret, *notify;
@@ -708,8 +1022,89 @@ static PyObject *cpy_register_log(PyObject *self, PyObject *args, PyObject *kwds
 }
 
 static PyObject *cpy_register_write(PyObject *self, PyObject *args, PyObject *kwds) {
-	return cpy_register_generic_userdata((void *) plugin_register_write,
-			(void *) cpy_write_callback, args, kwds);
+	char buf[512];
+	cpy_callback_t *c = NULL;
+	user_data_t user_data;
+	int batch_size = 0;
+	double batch_timeout = 10.0;
+	char *name = NULL;
+	PyObject *callback = NULL, *data = NULL;
+	static char *kwlist[] = {"callback", "data", "name", "batch_size", "batch_timeout", NULL};
+	
+	if (PyArg_ParseTupleAndKeywords(args, kwds, "O|Oetid", kwlist, &callback, &data, NULL, &name, &batch_size, &batch_timeout) == 0) return NULL;
+	if (PyCallable_Check(callback) == 0) {
+		PyMem_Free(name);
+		PyErr_SetString(PyExc_TypeError, "callback needs a be a callable object.");
+		return NULL;
+	}
+	if (batch_size < 0 || batch_timeout < 0) {
+		PyMem_Free(name);
+		PyErr_SetString(PyExc_ValueError, "batch_size and batch_timeout must not be negative.");
+		return NULL;
+	}
+	cpy_build_name(buf, sizeof(buf), callback, name);
+	PyMem_Free(name);
+	
+	c = malloc(sizeof(*c));
+	if (c == NULL)
+		return NULL;
+	memset (c, 0, sizeof (*c));
+
+	if (batch_size > 0) {
+		c->batch = malloc(sizeof(*c->batch));
+		if (c->batch == NULL) {
+			free(c);
+			return NULL;
+		}
+		memset (c->batch, 0, sizeof (*c->batch));
+		pthread_mutex_init(&c->batch->lock, NULL);
+		c->batch->size = (size_t) batch_size;
+		c->batch->timeout = DOUBLE_TO_CDTIME_T(batch_timeout);
+		c->batch->refs = 1;
+	}
+
+	Py_INCREF(callback);
+	Py_XINCREF(data);
+
+	c->name = strdup(buf);
+	c->callback = callback;
+	c->data = data;
+	c->next = NULL;
+
+	memset (&user_data, 0, sizeof (user_data));
+	user_data.free_func = cpy_destroy_user_data;
+	user_data.data = c;
+
+	if (c->batch == NULL) {
+		plugin_register_write(buf, cpy_write_callback, &user_data);
+		return cpy_string_to_unicode_or_bytes(buf);
+	}
+
+	pthread_mutex_lock(&cpy_batch_writers_lock);
+	c->next = cpy_batch_writers;
+	cpy_batch_writers = c;
+	if (c->batch->timeout > 0)
+		c->batch->refs++;
+	pthread_mutex_unlock(&cpy_batch_writers_lock);
+
+	plugin_register_write(buf, cpy_write_batch_callback, &user_data);
+
+	/* Without the timer, a batch would wait for the next value list to
+	 * arrive before its age is checked. */
+	if (c->batch->timeout > 0) {
+		char timer_name[512];
+		user_data_t timer_data;
+
+		memset (&timer_data, 0, sizeof (timer_data));
+		timer_data.free_func = cpy_batch_timer_destroy;
+		timer_data.data = c;
+
+		cpy_batch_timer_name(c, timer_name, sizeof(timer_name));
+		if (plugin_register_complex_read(/* group = */ "python", timer_name,
+				cpy_batch_timer, c->batch->timeout / 4, &timer_data) != 0)
+			cpy_batch_release(c);
+	}
+	return cpy_string_to_unicode_or_bytes(buf);
 }
 
 static PyObject *cpy_register_notification(PyObject *self, PyObject *args, PyObject *kwds) {
@@ -905,8 +1300,21 @@ static int cpy_shutdown(void) {
 	PyObject *ret;
 	
 	/* This can happen if the module was loaded but not configured. */
-	if (state != NULL)
+	if (state != NULL) {
+		/* Hand the queued values to the batched write callbacks while
+		 * Python is still around. */
+		pthread_mutex_lock(&cpy_batch_writers_lock);
+		while ((c = cpy_batch_writers) != NULL) {
+			cpy_batch_writers = c->next;
+			c->next = NULL;
+			pthread_mutex_unlock(&cpy_batch_writers_lock);
+			cpy_batch_flush(c, /* max_age = */ 0);
+			pthread_mutex_lock(&cpy_batch_writers_lock);
+		}
+		pthread_mutex_unlock(&cpy_batch_writers_lock);
+
 		PyEval_RestoreThread(state);
+	}
 
 	for (c = cpy_shutdown_callbacks; c; c = c->next) {
 		ret = PyObject_CallFunctionObjArgs(c->callback, c->data, (void *) 0); /* New reference. */
@@ -1074,6 +1482,7 @@ static int cpy_init_python(void) {
 	PyType_Ready(&SignedType);
 	UnsignedType.tp_base = &PyLong_Type;
 	PyType_Ready(&UnsignedType);
+	PyStructSequence_InitType(&ValueRecordType, &value_record_desc);
 	sys = PyImport_ImportModule("sys"); /* New reference. */
 	if (sys == NULL) {
 		cpy_log_exception("python initialization");
@@ -1098,6 +1507,7 @@ static int cpy_init_python(void) {
 	PyModule_AddObject(module, "Notification", (void *) &NotificationType); /* Steals a reference. */
 	PyModule_AddObject(module, "Signed", (void *) &SignedType); /* Steals a reference. */
 	PyModule_AddObject(module, "Unsigned", (void *) &UnsignedType); /* Steals a reference. */
+	PyModule_AddObject(module, "ValueRecord", (void *) &ValueRecordType); /* Steals a reference. */
 	PyModule_AddIntConstant(module, "LOG_DEBUG", LOG_DEBUG);
 	PyModule_AddIntConstant(module, "LOG_INFO", LOG_INFO);
 	PyModule_AddIntConstant(module, "LOG_NOTICE", LOG_NOTICE);
@@ -33,6 +33,9 @@
 
 #include <net-snmp/net-snmp-config.h>
 #include <net-snmp/net-snmp-includes.h>
+#if HAVE_NETSNMP_LARGE_FD_SET
+# include <net-snmp/library/large_fd_set.h>
+#endif
 
 #include <fnmatch.h>
 
@@ -71,6 +74,11 @@ struct data_definition_s
 };
 typedef struct data_definition_s data_definition_t;
 
+struct csnmp_engine_s;
+typedef struct csnmp_engine_s csnmp_engine_t;
+struct csnmp_walk_s;
+typedef struct csnmp_walk_s csnmp_walk_t;
+
 struct host_definition_s
 {
   char *name;
@@ -96,6 +104,27 @@ struct host_definition_s
   cdtime_t interval;
   data_definition_t **data_list;
   int data_list_len;
+
+  /* Use GETBULK with this many repetitions to walk tables. GETNEXT is used if
+   * this is zero or with SNMPv1. */
+  int max_repetitions;
+  /* Number of requests the asynchronous engine sends to this host at the
+   * same time. */
+  int max_in_flight;
+
+  /* Used by the asynchronous engine only. "poll_active", "poll_remove" and
+   * "poll_next" are protected by the engine's lock, everything else is only
+   * accessed by the engine's thread. */
+  csnmp_engine_t *engine;
+  _Bool poll_active;
+  _Bool poll_remove;
+  _Bool poll_abort;
+  _Bool poll_failed;
+  cdtime_t poll_start;
+  int poll_data_next;
+  int poll_success;
+  csnmp_walk_t *poll_walks;
+  struct host_definition_s *poll_next;
 };
 typedef struct host_definition_s host_definition_t;
 
@@ -117,15 +146,78 @@ struct csnmp_table_values_s
 };
 typedef struct csnmp_table_values_s csnmp_table_values_t;
 
+/* State of querying one "Data" block from one host. Tables are walked with a
+ * sequence of requests, each built from the OIDs returned by the previous
+ * response, so that the same code can be driven by synchronous and
+ * asynchronous requests. */
+struct csnmp_walk_s
+{
+  host_definition_t *host;
+  data_definition_t *data;
+  const data_set_t *ds;
+
+  /* Holds the last OID returned by the device. We use this in the GETNEXT
+   * request to proceed. */
+  oid_t *oid_list;
+  size_t oid_list_len;
+  /* Set to false when an OID has left its subtree so we don't re-request it
+   * again. */
+  _Bool *oid_list_todo;
+  /* The columns, i.e. indexes into "oid_list", contained in the last request
+   * in the order they were added. */
+  size_t *req_columns;
+  size_t req_columns_num;
+  int max_repetitions;
+
+  /* `value_list_head' and `value_list_tail' implement a linked list for each
+   * value. `instance_list_head' and `instance_list_tail' implement a linked
+   * list of instance names. This is used to jump gaps in the table. */
+  csnmp_list_instances_t *instance_list_head;
+  csnmp_list_instances_t *instance_list_tail;
+  csnmp_table_values_t **value_list_head;
+  csnmp_table_values_t **value_list_tail;
+
+  csnmp_walk_t *next;
+};
+
+/* The asynchronous engine: a thread multiplexing the sessions of all hosts
+ * assigned to it. The read callback of a host only queues the host and
+ * returns immediately. */
+struct csnmp_engine_s
+{
+  pthread_t thread;
+  _Bool thread_started;
+  pthread_mutex_t lock;
+  /* Signalled when a poll has been finished or aborted. */
+  pthread_cond_t cond;
+  _Bool loop;
+  int wake_fd[2];
+
+  /* Hosts which are due, protected by "lock". */
+  host_definition_t *queue_head;
+  host_definition_t *queue_tail;
+  /* Hosts being polled, only accessed by the engine's thread. */
+  host_definition_t *active;
+};
+
 /*
  * Private variables
  */
 static data_definition_t *data_head = NULL;
 
+static int async_threads_num = 0;
+static csnmp_engine_t *engines = NULL;
+#if HAVE_NETSNMP_LARGE_FD_SET
+static size_t engines_num = 0;
+static size_t engines_next = 0;
+static pthread_mutex_t engines_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
 /*
  * Prototypes
  */
 static int csnmp_read_host (user_data_t *ud);
+static void csnmp_async_remove (host_definition_t *host);
 
 /*
  * Private functions
@@ -202,6 +294,10 @@ static void csnmp_host_definition_destroy (void *arg) /* {{{ */
         hd->name);
   }
 
+  /* Hosts are destroyed when the read callbacks are unregistered, before the
+   * shutdown callback is called. The engine must not touch them anymore. */
+  csnmp_async_remove (hd);
+
   csnmp_host_close_session (hd);
 
   sfree (hd->name);
@@ -651,6 +747,7 @@ static int csnmp_config_add_host (oconfig_item_t *ci)
     return (-1);
   memset (hd, '\0', sizeof (host_definition_t));
   hd->version = 2;
+  hd->max_in_flight = 1;
   C_COMPLAIN_INIT (&hd->complaint);
 
   status = cf_util_get_string(ci, &hd->name);
@@ -692,6 +789,10 @@ static int csnmp_config_add_host (oconfig_item_t *ci)
       status = csnmp_config_add_host_security_level (hd, option);
     else if (strcasecmp ("Context", option->key) == 0)
       status = cf_util_get_string(option, &hd->context);
+    else if (strcasecmp ("MaxRepetitions", option->key) == 0)
+      status = cf_util_get_int (option, &hd->max_repetitions);
+    else if (strcasecmp ("MaxInFlight", option->key) == 0)
+      status = cf_util_get_int (option, &hd->max_in_flight);
     else
     {
       WARNING ("snmp plugin: csnmp_config_add_host: Option `%s' not allowed here.", option->key);
@@ -710,6 +811,13 @@ static int csnmp_config_add_host (oconfig_item_t *ci)
       status = -1;
       break;
     }
+    if ((hd->max_repetitions < 0) || (hd->max_in_flight < 1))
+    {
+      WARNING ("snmp plugin: `MaxRepetitions' must not be negative and "
+          "`MaxInFlight' must be positive for host `%s'", hd->name);
+      status = -1;
+      break;
+    }
     if (hd->community == NULL && hd->version < 3)
     {
       WARNING ("snmp plugin: `Community' not given for host `%s'", hd->name);
@@ -805,6 +913,23 @@ static int csnmp_config (oconfig_item_t *ci)
       csnmp_config_add_data (child);
     else if (strcasecmp ("Host", child->key) == 0)
       csnmp_config_add_host (child);
+    else if (strcasecmp ("AsyncThreads", child->key) == 0)
+    {
+      if ((cf_util_get_int (child, &async_threads_num) != 0)
+          || (async_threads_num < 0))
+      {
+        WARNING ("snmp plugin: `AsyncThreads' must be zero or positive.");
+        async_threads_num = 0;
+      }
+#if !HAVE_NETSNMP_LARGE_FD_SET
+      if (async_threads_num > 0)
+      {
+        WARNING ("snmp plugin: `AsyncThreads' requires Net-SNMP 5.5 or "
+            "later. Hosts will be queried synchronously.");
+        async_threads_num = 0;
+      }
+#endif
+    }
     else
     {
       WARNING ("snmp plugin: Ignoring unknown config option `%s'.", child->key);
@@ -1142,21 +1267,15 @@ static int csnmp_strvbcopy (char *dst, /* {{{ */
 
 static int csnmp_instance_list_add (csnmp_list_instances_t **head,
     csnmp_list_instances_t **tail,
-    const struct snmp_pdu *res,
+    struct variable_list *vb,
     const host_definition_t *hd, const data_definition_t *dd)
 {
   csnmp_list_instances_t *il;
-  struct variable_list *vb;
   oid_t vb_name;
   int status;
   uint32_t i;
   uint32_t is_matched;
 
-  /* Set vb on the last variable */
-  for (vb = res->variables;
-      (vb != NULL) && (vb->next_variable != NULL);
-      vb = vb->next_variable)
-    /* do nothing */;
   if (vb == NULL)
     return (-1);
 
@@ -1395,113 +1514,315 @@ static int csnmp_dispatch_table (host_definition_t *host, data_definition_t *dat
   return (0);
 } /* int csnmp_dispatch_table */
 
-static int csnmp_read_table (host_definition_t *host, data_definition_t *data)
+static void csnmp_walk_destroy (csnmp_walk_t *w) /* {{{ */
 {
-  struct snmp_pdu *req;
-  struct snmp_pdu *res = NULL;
-  struct variable_list *vb;
-
-  const data_set_t *ds;
-
-  size_t oid_list_len = data->values_len + 1;
-  /* Holds the last OID returned by the device. We use this in the GETNEXT
-   * request to proceed. */
-  oid_t oid_list[oid_list_len];
-  /* Set to false when an OID has left its subtree so we don't re-request it
-   * again. */
-  _Bool oid_list_todo[oid_list_len];
-
-  int status;
   size_t i;
 
-  /* `value_list_head' and `value_list_tail' implement a linked list for each
-   * value. `instance_list_head' and `instance_list_tail' implement a linked list of
-   * instance names. This is used to jump gaps in the table. */
-  csnmp_list_instances_t *instance_list_head;
-  csnmp_list_instances_t *instance_list_tail;
-  csnmp_table_values_t **value_list_head;
-  csnmp_table_values_t **value_list_tail;
+  if (w == NULL)
+    return;
 
-  DEBUG ("snmp plugin: csnmp_read_table (host = %s, data = %s)",
-      host->name, data->name);
+  while (w->instance_list_head != NULL)
+  {
+    csnmp_list_instances_t *next = w->instance_list_head->next;
+    sfree (w->instance_list_head);
+    w->instance_list_head = next;
+  }
 
-  if (host->sess_handle == NULL)
+  if (w->value_list_head != NULL)
   {
-    DEBUG ("snmp plugin: csnmp_read_table: host->sess_handle == NULL");
-    return (-1);
+    for (i = 0; i < w->data->values_len; i++)
+    {
+      while (w->value_list_head[i] != NULL)
+      {
+        csnmp_table_values_t *next = w->value_list_head[i]->next;
+        sfree (w->value_list_head[i]);
+        w->value_list_head[i] = next;
+      }
+    }
   }
 
+  sfree (w->value_list_head);
+  sfree (w->value_list_tail);
+  sfree (w->oid_list);
+  sfree (w->oid_list_todo);
+  sfree (w->req_columns);
+  sfree (w);
+} /* }}} void csnmp_walk_destroy */
+
+static csnmp_walk_t *csnmp_walk_create (host_definition_t *host, /* {{{ */
+    data_definition_t *data)
+{
+  csnmp_walk_t *w;
+  const data_set_t *ds;
+  size_t i;
+
   ds = plugin_get_ds (data->type);
   if (!ds)
   {
     ERROR ("snmp plugin: DataSet `%s' not defined.", data->type);
-    return (-1);
+    return (NULL);
   }
 
   if (ds->ds_num != data->values_len)
   {
     ERROR ("snmp plugin: DataSet `%s' requires %zu values, but config talks about %zu",
         data->type, ds->ds_num, data->values_len);
-    return (-1);
+    return (NULL);
   }
   assert (data->values_len > 0);
 
-  /* We need a copy of all the OIDs, because GETNEXT will destroy them. */
-  memcpy (oid_list, data->values, data->values_len * sizeof (oid_t));
-  if (data->instance.oid.oid_len > 0)
-    memcpy (oid_list + data->values_len, &data->instance.oid, sizeof (oid_t));
-  else /* no InstanceFrom option specified. */
-    oid_list_len--;
+  w = malloc (sizeof (*w));
+  if (w == NULL)
+    return (NULL);
+  memset (w, 0, sizeof (*w));
+  w->host = host;
+  w->data = data;
+  w->ds = ds;
+
+  /* Single values are read with one GET request. */
+  if (!data->is_table)
+    return (w);
 
-  for (i = 0; i < oid_list_len; i++)
-    oid_list_todo[i] = 1;
+  w->oid_list_len = data->values_len + 1;
+  w->oid_list = calloc (w->oid_list_len, sizeof (*w->oid_list));
+  w->oid_list_todo = calloc (w->oid_list_len, sizeof (*w->oid_list_todo));
+  w->req_columns = calloc (w->oid_list_len, sizeof (*w->req_columns));
 
   /* We're going to construct n linked lists, one for each "value".
    * value_list_head will contain pointers to the heads of these linked lists,
    * value_list_tail will contain pointers to the tail of the lists. */
-  value_list_head = calloc (data->values_len, sizeof (*value_list_head));
-  value_list_tail = calloc (data->values_len, sizeof (*value_list_tail));
-  if ((value_list_head == NULL) || (value_list_tail == NULL))
+  w->value_list_head = calloc (data->values_len, sizeof (*w->value_list_head));
+  w->value_list_tail = calloc (data->values_len, sizeof (*w->value_list_tail));
+  if ((w->oid_list == NULL) || (w->oid_list_todo == NULL)
+      || (w->req_columns == NULL)
+      || (w->value_list_head == NULL) || (w->value_list_tail == NULL))
+  {
+    ERROR ("snmp plugin: csnmp_walk_create: calloc failed.");
+    csnmp_walk_destroy (w);
+    return (NULL);
+  }
+
+  /* We need a copy of all the OIDs, because GETNEXT will destroy them. */
+  memcpy (w->oid_list, data->values, data->values_len * sizeof (oid_t));
+  if (data->instance.oid.oid_len > 0)
+    memcpy (w->oid_list + data->values_len, &data->instance.oid, sizeof (oid_t));
+  else /* no InstanceFrom option specified. */
+    w->oid_list_len--;
+
+  for (i = 0; i < w->oid_list_len; i++)
+    w->oid_list_todo[i] = 1;
+
+  /* GETBULK is not available in SNMPv1. */
+  if (host->version != 1)
+    w->max_repetitions = host->max_repetitions;
+
+  return (w);
+} /* }}} csnmp_walk_t *csnmp_walk_create */
+
+/* Creates the next request of a table walk. Sets "ret_req" to NULL if all
+ * columns have left their subtree. */
+static int csnmp_walk_request (csnmp_walk_t *w, /* {{{ */
+    struct snmp_pdu **ret_req)
+{
+  struct snmp_pdu *req;
+  size_t i;
+
+  *ret_req = NULL;
+
+  w->req_columns_num = 0;
+  for (i = 0; i < w->oid_list_len; i++)
+    if (w->oid_list_todo[i])
+      w->req_columns[w->req_columns_num++] = i;
+
+  if (w->req_columns_num == 0)
+  {
+    /* The request would be empty - so we are finished */
+    DEBUG ("snmp plugin: all variables have left their subtree");
+    return (0);
+  }
+
+  if (w->max_repetitions > 0)
+  {
+    req = snmp_pdu_create (SNMP_MSG_GETBULK);
+    if (req != NULL)
+    {
+      req->non_repeaters = 0;
+      req->max_repetitions = w->max_repetitions;
+    }
+  }
+  else
+    req = snmp_pdu_create (SNMP_MSG_GETNEXT);
+
+  if (req == NULL)
   {
-    ERROR ("snmp plugin: csnmp_read_table: calloc failed.");
-    sfree (value_list_head);
-    sfree (value_list_tail);
+    ERROR ("snmp plugin: snmp_pdu_create failed.");
     return (-1);
   }
 
-  instance_list_head = NULL;
-  instance_list_tail = NULL;
+  /* Do not rerequest already finished OIDs */
+  for (i = 0; i < w->req_columns_num; i++)
+  {
+    oid_t *o = w->oid_list + w->req_columns[i];
+    snmp_add_null_var (req, o->oid, o->oid_len);
+  }
 
-  status = 0;
-  while (status == 0)
+  *ret_req = req;
+  return (0);
+} /* }}} int csnmp_walk_request */
+
+/* Adds the variables of a GETNEXT or GETBULK response to the walk. */
+static int csnmp_walk_response (csnmp_walk_t *w, /* {{{ */
+    struct snmp_pdu *res)
+{
+  host_definition_t *host = w->host;
+  data_definition_t *data = w->data;
+  struct variable_list *vb;
+  size_t vb_index;
+
+  /* The response didn't fit into a single packet. Try again with fewer
+   * repetitions. */
+  if ((res->errstat == SNMP_ERR_TOOBIG) && (w->max_repetitions > 1))
   {
-    int oid_list_todo_num;
+    w->max_repetitions /= 2;
+    DEBUG ("snmp plugin: host = %s; data = %s; Reducing MaxRepetitions "
+        "to %i.", host->name, data->name, w->max_repetitions);
+    return (0);
+  }
 
-    req = snmp_pdu_create (SNMP_MSG_GETNEXT);
-    if (req == NULL)
+  if (res->variables == NULL)
+    return (-1);
+
+  for (vb = res->variables, vb_index = 0;
+      vb != NULL;
+      vb = vb->next_variable, vb_index++)
+  {
+    /* GETBULK responses contain "max_repetitions" rows, each containing one
+     * variable per requested column. */
+    size_t i = w->req_columns[vb_index % w->req_columns_num];
+
+    /* This column has left its subtree in a previous row. */
+    if (!w->oid_list_todo[i])
+      continue;
+
+    /* An instance is configured and the res variable we process is the
+     * instance value (last index) */
+    if ((data->instance.oid.oid_len > 0) && (i == data->values_len))
     {
-      ERROR ("snmp plugin: snmp_pdu_create failed.");
-      status = -1;
-      break;
-    }
+      if ((vb->type == SNMP_ENDOFMIBVIEW)
+          || (snmp_oid_ncompare (data->instance.oid.oid,
+              data->instance.oid.oid_len,
+              vb->name, vb->name_length,
+              data->instance.oid.oid_len) != 0))
+      {
+        DEBUG ("snmp plugin: host = %s; data = %s; Instance left its subtree.",
+            host->name, data->name);
+        w->oid_list_todo[i] = 0;
+        continue;
+      }
 
-    oid_list_todo_num = 0;
-    for (i = 0; i < oid_list_len; i++)
+      /* Allocate a new `csnmp_list_instances_t', insert the instance name and
+       * add it to the list */
+      if (csnmp_instance_list_add (&w->instance_list_head,
+            &w->instance_list_tail, vb, host, data) != 0)
+      {
+        ERROR ("snmp plugin: host %s: csnmp_instance_list_add failed.",
+            host->name);
+        return (-1);
+      }
+    }
+    else /* The variable we are processing is a normal value */
     {
-      /* Do not rerequest already finished OIDs */
-      if (!oid_list_todo[i])
+      csnmp_table_values_t *vt;
+      oid_t vb_name;
+      oid_t suffix;
+      int ret;
+
+      if (vb->type == SNMP_ENDOFMIBVIEW)
+      {
+        w->oid_list_todo[i] = 0;
+        continue;
+      }
+
+      csnmp_oid_init (&vb_name, vb->name, vb->name_length);
+
+      /* Calculate the current suffix. This is later used to check that the
+       * suffix is increasing. This also checks if we left the subtree */
+      ret = csnmp_oid_suffix (&suffix, &vb_name, data->values + i);
+      if (ret != 0)
+      {
+        DEBUG ("snmp plugin: host = %s; data = %s; i = %zu; "
+            "Value probably left its subtree.",
+            host->name, data->name, i);
+        w->oid_list_todo[i] = 0;
+        continue;
+      }
+
+      /* Make sure the OIDs returned by the agent are increasing. Otherwise our
+       * table matching algorithm will get confused. */
+      if ((w->value_list_tail[i] != NULL)
+          && (csnmp_oid_compare (&suffix, &w->value_list_tail[i]->suffix) <= 0))
+      {
+        DEBUG ("snmp plugin: host = %s; data = %s; i = %zu; "
+            "Suffix is not increasing.",
+            host->name, data->name, i);
+        w->oid_list_todo[i] = 0;
         continue;
-      oid_list_todo_num++;
-      snmp_add_null_var (req, oid_list[i].oid, oid_list[i].oid_len);
+      }
+
+      vt = malloc (sizeof (*vt));
+      if (vt == NULL)
+      {
+        ERROR ("snmp plugin: malloc failed.");
+        return (-1);
+      }
+      memset (vt, 0, sizeof (*vt));
+
+      vt->value = csnmp_value_list_to_value (vb, w->ds->ds[i].type,
+          data->scale, data->shift, host->name, data->name);
+      memcpy (&vt->suffix, &suffix, sizeof (vt->suffix));
+      vt->next = NULL;
+
+      if (w->value_list_tail[i] == NULL)
+        w->value_list_head[i] = vt;
+      else
+        w->value_list_tail[i]->next = vt;
+      w->value_list_tail[i] = vt;
     }
 
-    if (oid_list_todo_num == 0)
-    {
-      /* The request is still empty - so we are finished */
-      DEBUG ("snmp plugin: all variables have left their subtree");
-      status = 0;
+    /* Copy OID to oid_list[i] */
+    memcpy (w->oid_list[i].oid, vb->name, sizeof (oid) * vb->name_length);
+    w->oid_list[i].oid_len = vb->name_length;
+  } /* for (vb = res->variables ...) */
+
+  return (0);
+} /* }}} int csnmp_walk_response */
+
+static int csnmp_read_table (host_definition_t *host, data_definition_t *data)
+{
+  csnmp_walk_t *w;
+  struct snmp_pdu *req;
+  struct snmp_pdu *res = NULL;
+  int status;
+
+  DEBUG ("snmp plugin: csnmp_read_table (host = %s, data = %s)",
+      host->name, data->name);
+
+  if (host->sess_handle == NULL)
+  {
+    DEBUG ("snmp plugin: csnmp_read_table: host->sess_handle == NULL");
+    return (-1);
+  }
+
+  w = csnmp_walk_create (host, data);
+  if (w == NULL)
+    return (-1);
+
+  status = 0;
+  while (status == 0)
+  {
+    status = csnmp_walk_request (w, &req);
+    if ((status != 0) || (req == NULL))
       break;
-    }
 
     res = NULL;
     status = snmp_sess_synch_response (host->sess_handle, req, &res);
@@ -1520,7 +1841,6 @@ static int csnmp_read_table (host_definition_t *host, data_definition_t *data)
       res = NULL;
 
       /* snmp_synch_response already freed our PDU */
-      req = NULL;
       sfree (errstr);
       csnmp_host_close_session (host);
 
@@ -1528,190 +1848,54 @@ static int csnmp_read_table (host_definition_t *host, data_definition_t *data)
       break;
     }
 
-    status = 0;
-    assert (res != NULL);
     c_release (LOG_INFO, &host->complaint,
         "snmp plugin: host %s: snmp_sess_synch_response successful.",
         host->name);
 
-    vb = res->variables;
-    if (vb == NULL)
-    {
-      status = -1;
-      break;
-    }
-
-    for (vb = res->variables, i = 0; (vb != NULL); vb = vb->next_variable, i++)
-    {
-      /* Calculate value index from todo list */
-      while ((i < oid_list_len) && !oid_list_todo[i])
-        i++;
-
-      /* An instance is configured and the res variable we process is the
-       * instance value (last index) */
-      if ((data->instance.oid.oid_len > 0) && (i == data->values_len))
-      {
-        if ((vb->type == SNMP_ENDOFMIBVIEW)
-            || (snmp_oid_ncompare (data->instance.oid.oid,
-                data->instance.oid.oid_len,
-                vb->name, vb->name_length,
-                data->instance.oid.oid_len) != 0))
-        {
-          DEBUG ("snmp plugin: host = %s; data = %s; Instance left its subtree.",
-              host->name, data->name);
-          oid_list_todo[i] = 0;
-          continue;
-        }
-
-        /* Allocate a new `csnmp_list_instances_t', insert the instance name and
-         * add it to the list */
-        if (csnmp_instance_list_add (&instance_list_head, &instance_list_tail,
-              res, host, data) != 0)
-        {
-          ERROR ("snmp plugin: host %s: csnmp_instance_list_add failed.",
-              host->name);
-          status = -1;
-          break;
-        }
-      }
-      else /* The variable we are processing is a normal value */
-      {
-        csnmp_table_values_t *vt;
-        oid_t vb_name;
-        oid_t suffix;
-        int ret;
-
-        csnmp_oid_init (&vb_name, vb->name, vb->name_length);
-
-        /* Calculate the current suffix. This is later used to check that the
-         * suffix is increasing. This also checks if we left the subtree */
-        ret = csnmp_oid_suffix (&suffix, &vb_name, data->values + i);
-        if (ret != 0)
-        {
-          DEBUG ("snmp plugin: host = %s; data = %s; i = %zu; "
-              "Value probably left its subtree.",
-              host->name, data->name, i);
-          oid_list_todo[i] = 0;
-          continue;
-        }
-
-        /* Make sure the OIDs returned by the agent are increasing. Otherwise our
-         * table matching algorithm will get confused. */
-        if ((value_list_tail[i] != NULL)
-            && (csnmp_oid_compare (&suffix, &value_list_tail[i]->suffix) <= 0))
-        {
-          DEBUG ("snmp plugin: host = %s; data = %s; i = %zu; "
-              "Suffix is not increasing.",
-              host->name, data->name, i);
-          oid_list_todo[i] = 0;
-          continue;
-        }
-
-        vt = malloc (sizeof (*vt));
-        if (vt == NULL)
-        {
-          ERROR ("snmp plugin: malloc failed.");
-          status = -1;
-          break;
-        }
-        memset (vt, 0, sizeof (*vt));
+    status = csnmp_walk_response (w, res);
 
-        vt->value = csnmp_value_list_to_value (vb, ds->ds[i].type,
-            data->scale, data->shift, host->name, data->name);
-        memcpy (&vt->suffix, &suffix, sizeof (vt->suffix));
-        vt->next = NULL;
-
-        if (value_list_tail[i] == NULL)
-          value_list_head[i] = vt;
-        else
-          value_list_tail[i]->next = vt;
-        value_list_tail[i] = vt;
-      }
-
-      /* Copy OID to oid_list[i] */
-      memcpy (oid_list[i].oid, vb->name, sizeof (oid) * vb->name_length);
-      oid_list[i].oid_len = vb->name_length;
-
-    } /* for (vb = res->variables ...) */
-
-    if (res != NULL)
-      snmp_free_pdu (res);
+    snmp_free_pdu (res);
     res = NULL;
   } /* while (status == 0) */
 
-  if (res != NULL)
-    snmp_free_pdu (res);
-  res = NULL;
+  if (status == 0)
+    csnmp_dispatch_table (host, data, w->instance_list_head,
+        w->value_list_head);
 
-  if (req != NULL)
-    snmp_free_pdu (req);
-  req = NULL;
+  csnmp_walk_destroy (w);
 
-  if (status == 0)
-    csnmp_dispatch_table (host, data, instance_list_head, value_list_head);
+  return (0);
+} /* int csnmp_read_table */
 
-  /* Free all allocated variables here */
-  while (instance_list_head != NULL)
-  {
-    csnmp_list_instances_t *next = instance_list_head->next;
-    sfree (instance_list_head);
-    instance_list_head = next;
-  }
+static struct snmp_pdu *csnmp_value_request (data_definition_t *data) /* {{{ */
+{
+  struct snmp_pdu *req;
+  size_t i;
 
-  for (i = 0; i < data->values_len; i++)
+  req = snmp_pdu_create (SNMP_MSG_GET);
+  if (req == NULL)
   {
-    while (value_list_head[i] != NULL)
-    {
-      csnmp_table_values_t *next = value_list_head[i]->next;
-      sfree (value_list_head[i]);
-      value_list_head[i] = next;
-    }
+    ERROR ("snmp plugin: snmp_pdu_create failed.");
+    return (NULL);
   }
 
-  sfree (value_list_head);
-  sfree (value_list_tail);
+  for (i = 0; i < data->values_len; i++)
+    snmp_add_null_var (req, data->values[i].oid, data->values[i].oid_len);
 
-  return (0);
-} /* int csnmp_read_table */
+  return (req);
+} /* }}} struct snmp_pdu *csnmp_value_request */
 
-static int csnmp_read_value (host_definition_t *host, data_definition_t *data)
+/* Dispatches the values of a GET response. */
+static int csnmp_value_response (host_definition_t *host, /* {{{ */
+    data_definition_t *data, const data_set_t *ds, struct snmp_pdu *res)
 {
-  struct snmp_pdu *req;
-  struct snmp_pdu *res;
   struct variable_list *vb;
-
-  const data_set_t *ds;
   value_list_t vl = VALUE_LIST_INIT;
-
-  int status;
   size_t i;
 
-  DEBUG ("snmp plugin: csnmp_read_value (host = %s, data = %s)",
-      host->name, data->name);
-
-  if (host->sess_handle == NULL)
-  {
-    DEBUG ("snmp plugin: csnmp_read_value: host->sess_handle == NULL");
-    return (-1);
-  }
-
-  ds = plugin_get_ds (data->type);
-  if (!ds)
-  {
-    ERROR ("snmp plugin: DataSet `%s' not defined.", data->type);
-    return (-1);
-  }
-
-  if (ds->ds_num != data->values_len)
-  {
-    ERROR ("snmp plugin: DataSet `%s' requires %zu values, but config talks about %zu",
-        data->type, ds->ds_num, data->values_len);
-    return (-1);
-  }
-
-  vl.values_len = ds->ds_num;
-  vl.values = (value_t *) malloc (sizeof (value_t) * vl.values_len);
-  if (vl.values == NULL)
+  vl.values_len = ds->ds_num;
+  vl.values = (value_t *) malloc (sizeof (value_t) * vl.values_len);
+  if (vl.values == NULL)
     return (-1);
   for (i = 0; i < vl.values_len; i++)
   {
@@ -1728,16 +1912,64 @@ static int csnmp_read_value (host_definition_t *host, data_definition_t *data)
 
   vl.interval = host->interval;
 
-  req = snmp_pdu_create (SNMP_MSG_GET);
-  if (req == NULL)
+  for (vb = res->variables; vb != NULL; vb = vb->next_variable)
   {
-    ERROR ("snmp plugin: snmp_pdu_create failed.");
-    sfree (vl.values);
+#if COLLECT_DEBUG
+    char buffer[1024];
+    snprint_variable (buffer, sizeof (buffer),
+        vb->name, vb->name_length, vb);
+    DEBUG ("snmp plugin: Got this variable: %s", buffer);
+#endif /* COLLECT_DEBUG */
+
+    for (i = 0; i < data->values_len; i++)
+      if (snmp_oid_compare (data->values[i].oid, data->values[i].oid_len,
+            vb->name, vb->name_length) == 0)
+        vl.values[i] = csnmp_value_list_to_value (vb, ds->ds[i].type,
+            data->scale, data->shift, host->name, data->name);
+  } /* for (res->variables) */
+
+  DEBUG ("snmp plugin: -> plugin_dispatch_values (&vl);");
+  plugin_dispatch_values (&vl);
+  sfree (vl.values);
+
+  return (0);
+} /* }}} int csnmp_value_response */
+
+static int csnmp_read_value (host_definition_t *host, data_definition_t *data)
+{
+  struct snmp_pdu *req;
+  struct snmp_pdu *res;
+
+  const data_set_t *ds;
+
+  int status;
+
+  DEBUG ("snmp plugin: csnmp_read_value (host = %s, data = %s)",
+      host->name, data->name);
+
+  if (host->sess_handle == NULL)
+  {
+    DEBUG ("snmp plugin: csnmp_read_value: host->sess_handle == NULL");
     return (-1);
   }
 
-  for (i = 0; i < data->values_len; i++)
-    snmp_add_null_var (req, data->values[i].oid, data->values[i].oid_len);
+  ds = plugin_get_ds (data->type);
+  if (!ds)
+  {
+    ERROR ("snmp plugin: DataSet `%s' not defined.", data->type);
+    return (-1);
+  }
+
+  if (ds->ds_num != data->values_len)
+  {
+    ERROR ("snmp plugin: DataSet `%s' requires %zu values, but config talks about %zu",
+        data->type, ds->ds_num, data->values_len);
+    return (-1);
+  }
+
+  req = csnmp_value_request (data);
+  if (req == NULL)
+    return (-1);
 
   res = NULL;
   status = snmp_sess_synch_response (host->sess_handle, req, &res);
@@ -1755,39 +1987,627 @@ static int csnmp_read_value (host_definition_t *host, data_definition_t *data)
     res = NULL;
 
     sfree (errstr);
-    sfree (vl.values);
     csnmp_host_close_session (host);
 
     return (-1);
   }
 
+  status = csnmp_value_response (host, data, ds, res);
 
-  for (vb = res->variables; vb != NULL; vb = vb->next_variable)
+  snmp_free_pdu (res);
+  res = NULL;
+
+  return (status);
+} /* int csnmp_read_value */
+
+#if HAVE_NETSNMP_LARGE_FD_SET
+/*
+ * The asynchronous engine {{{
+ *
+ * Callgraph:
+ *  csnmp_read_host
+ *  +-> csnmp_async_submit          (read thread: queue the host)
+ *  csnmp_engine_thread
+ *  +-> csnmp_async_poll_start      (open session, send first requests)
+ *  !   +-> csnmp_async_walk_start
+ *  +-> snmp_sess_read / snmp_sess_timeout
+ *  !   +-> csnmp_async_callback    (handle response, send next request)
+ *  !       +-> csnmp_async_walk_done
+ *  !           +-> csnmp_async_walk_start
+ *  +-> csnmp_async_poll_finish     (dispatch the poll duration)
+ */
+static int csnmp_async_callback (int operation, netsnmp_session *sess,
+    int reqid, netsnmp_pdu *res, void *magic);
+
+static void csnmp_async_walk_unlink (csnmp_walk_t *w) /* {{{ */
+{
+  csnmp_walk_t **ptr;
+
+  for (ptr = &w->host->poll_walks; *ptr != NULL; ptr = &(*ptr)->next)
   {
-#if COLLECT_DEBUG
-    char buffer[1024];
-    snprint_variable (buffer, sizeof (buffer),
-        vb->name, vb->name_length, vb);
-    DEBUG ("snmp plugin: Got this variable: %s", buffer);
-#endif /* COLLECT_DEBUG */
+    if (*ptr == w)
+    {
+      *ptr = w->next;
+      w->next = NULL;
+      return;
+    }
+  }
+} /* }}} void csnmp_async_walk_unlink */
 
-    for (i = 0; i < data->values_len; i++)
-      if (snmp_oid_compare (data->values[i].oid, data->values[i].oid_len,
-            vb->name, vb->name_length) == 0)
-        vl.values[i] = csnmp_value_list_to_value (vb, ds->ds[i].type,
-            data->scale, data->shift, host->name, data->name);
-  } /* for (res->variables) */
+/* Sends the next request of a walk. Returns zero if a request has been sent,
+ * greater than zero if the walk is complete and less than zero on error. */
+static int csnmp_async_walk_send (csnmp_walk_t *w) /* {{{ */
+{
+  host_definition_t *host = w->host;
+  struct snmp_pdu *req = NULL;
 
-  if (res != NULL)
-    snmp_free_pdu (res);
-  res = NULL;
+  if (w->data->is_table)
+  {
+    if (csnmp_walk_request (w, &req) != 0)
+      return (-1);
+    if (req == NULL)
+      return (1);
+  }
+  else
+  {
+    req = csnmp_value_request (w->data);
+    if (req == NULL)
+      return (-1);
+  }
 
-  DEBUG ("snmp plugin: -> plugin_dispatch_values (&vl);");
+  if (snmp_sess_async_send (host->sess_handle, req,
+        csnmp_async_callback, w) == 0)
+  {
+    char *errstr = NULL;
+
+    snmp_sess_error (host->sess_handle, NULL, NULL, &errstr);
+    c_complain (LOG_ERR, &host->complaint,
+        "snmp plugin: host %s: snmp_sess_async_send failed: %s",
+        host->name, (errstr == NULL) ? "Unknown problem" : errstr);
+    sfree (errstr);
+    snmp_free_pdu (req);
+    return (-1);
+  }
+
+  return (0);
+} /* }}} int csnmp_async_walk_send */
+
+/* Starts walking the next "Data" blocks of the host until "MaxInFlight"
+ * walks are active. */
+static void csnmp_async_walk_start (host_definition_t *host) /* {{{ */
+{
+  size_t active_num = 0;
+  csnmp_walk_t *w;
+
+  for (w = host->poll_walks; w != NULL; w = w->next)
+    active_num++;
+
+  while ((active_num < (size_t) host->max_in_flight)
+      && (host->poll_data_next < host->data_list_len)
+      && (host->sess_handle != NULL) && !host->poll_abort)
+  {
+    data_definition_t *data = host->data_list[host->poll_data_next];
+    int status;
+
+    host->poll_data_next++;
+
+    w = csnmp_walk_create (host, data);
+    if (w == NULL)
+      continue;
+
+    status = csnmp_async_walk_send (w);
+    if (status != 0)
+    {
+      if (status < 0)
+        host->poll_failed = 1;
+      csnmp_walk_destroy (w);
+      continue;
+    }
+
+    w->next = host->poll_walks;
+    host->poll_walks = w;
+    active_num++;
+  }
+} /* }}} void csnmp_async_walk_start */
+
+static void csnmp_async_walk_done (csnmp_walk_t *w, _Bool success) /* {{{ */
+{
+  host_definition_t *host = w->host;
+
+  csnmp_async_walk_unlink (w);
+
+  if (success)
+  {
+    if (w->data->is_table)
+      csnmp_dispatch_table (host, w->data, w->instance_list_head,
+          w->value_list_head);
+    host->poll_success++;
+  }
+  else
+    host->poll_failed = 1;
+
+  csnmp_walk_destroy (w);
+
+  /* Don't send any more requests once a request timed out: the host is most
+   * likely unreachable and every further request would time out, too. */
+  if (!host->poll_failed)
+    csnmp_async_walk_start (host);
+} /* }}} void csnmp_async_walk_done */
+
+/* Called by snmp_sess_read() and snmp_sess_timeout(). The response PDU is
+ * freed by the library. */
+static int csnmp_async_callback (int operation, /* {{{ */
+    __attribute__((unused)) netsnmp_session *sess,
+    __attribute__((unused)) int reqid,
+    netsnmp_pdu *res, void *magic)
+{
+  csnmp_walk_t *w = magic;
+  host_definition_t *host = w->host;
+  int status;
+
+  /* The session is being closed: don't send any further requests. */
+  if (host->poll_abort)
+  {
+    csnmp_async_walk_done (w, /* success = */ 0);
+    return (1);
+  }
+
+  if (operation != NETSNMP_CALLBACK_OP_RECEIVED_MESSAGE)
+  {
+    c_complain (LOG_ERR, &host->complaint,
+        "snmp plugin: host %s: %s", host->name,
+        (operation == NETSNMP_CALLBACK_OP_TIMED_OUT)
+        ? "Request timed out." : "Request failed.");
+    csnmp_async_walk_done (w, /* success = */ 0);
+    return (1);
+  }
+
+  c_release (LOG_INFO, &host->complaint,
+      "snmp plugin: host %s: Received a response.", host->name);
+
+  if (!w->data->is_table)
+  {
+    status = csnmp_value_response (host, w->data, w->ds, res);
+    csnmp_async_walk_done (w, /* success = */ (status == 0));
+    return (1);
+  }
+
+  status = csnmp_walk_response (w, res);
+  if (status == 0)
+    status = csnmp_async_walk_send (w);
+
+  if (status != 0)
+    csnmp_async_walk_done (w, /* success = */ (status > 0));
+
+  return (1);
+} /* }}} int csnmp_async_callback */
+
+static void csnmp_async_poll_start (csnmp_engine_t *e, /* {{{ */
+    host_definition_t *host)
+{
+  host->poll_start = cdtime ();
+  host->poll_failed = 0;
+  host->poll_success = 0;
+  host->poll_data_next = 0;
+  host->poll_walks = NULL;
+
+  if (host->sess_handle == NULL)
+    csnmp_host_open_session (host);
+
+  if (host->sess_handle != NULL)
+    csnmp_async_walk_start (host);
+  else
+    host->poll_failed = 1;
+
+  host->poll_next = e->active;
+  e->active = host;
+} /* }}} void csnmp_async_poll_start */
+
+static void csnmp_async_poll_finish (csnmp_engine_t *e, /* {{{ */
+    host_definition_t *host)
+{
+  value_list_t vl = VALUE_LIST_INIT;
+  value_t value;
+
+  if (host->poll_failed)
+    csnmp_host_close_session (host);
+
+  value.gauge = CDTIME_T_TO_DOUBLE (cdtime () - host->poll_start);
+  vl.values = &value;
+  vl.values_len = 1;
+  vl.interval = host->interval;
+  sstrncpy (vl.host, host->name, sizeof (vl.host));
+  sstrncpy (vl.plugin, "snmp", sizeof (vl.plugin));
+  sstrncpy (vl.type, "duration", sizeof (vl.type));
+  sstrncpy (vl.type_instance, "poll", sizeof (vl.type_instance));
   plugin_dispatch_values (&vl);
-  sfree (vl.values);
+
+  if ((host->poll_success == 0) && (host->data_list_len > 0))
+  {
+    DEBUG ("snmp plugin: host %s: No data has been read.", host->name);
+  }
+
+  pthread_mutex_lock (&e->lock);
+  host->poll_active = 0;
+  pthread_cond_broadcast (&e->cond);
+  pthread_mutex_unlock (&e->lock);
+} /* }}} void csnmp_async_poll_finish */
+
+/* Drops the poll in progress without dispatching anything. Closing the
+ * session drops all outstanding requests; the library may call the callback
+ * for them, which must not send new requests. */
+static void csnmp_async_poll_abort (csnmp_engine_t *e, /* {{{ */
+    host_definition_t *host)
+{
+  host->poll_abort = 1;
+  csnmp_host_close_session (host);
+  while (host->poll_walks != NULL)
+  {
+    csnmp_walk_t *w = host->poll_walks;
+    host->poll_walks = w->next;
+    csnmp_walk_destroy (w);
+  }
+  host->poll_abort = 0;
+
+  pthread_mutex_lock (&e->lock);
+  host->poll_active = 0;
+  pthread_cond_broadcast (&e->cond);
+  pthread_mutex_unlock (&e->lock);
+} /* }}} void csnmp_async_poll_abort */
+
+static void *csnmp_engine_thread (void *arg) /* {{{ */
+{
+  csnmp_engine_t *e = arg;
+  /* A plain fd_set can't hold descriptors >= FD_SETSIZE, which are common
+   * with many hosts. The large fd set grows as needed. */
+  netsnmp_large_fd_set fds;
+
+  netsnmp_large_fd_set_init (&fds, FD_SETSIZE);
+
+  while (42)
+  {
+    host_definition_t *host;
+    host_definition_t *removed;
+    host_definition_t **ptr;
+    struct timeval timeout;
+    int fds_num;
+    int block;
+    int status;
+
+    /* Take all due hosts off the queue and the hosts being destroyed off the
+     * active list. */
+    pthread_mutex_lock (&e->lock);
+    if (!e->loop)
+    {
+      pthread_mutex_unlock (&e->lock);
+      break;
+    }
+    host = e->queue_head;
+    e->queue_head = NULL;
+    e->queue_tail = NULL;
+
+    removed = NULL;
+    ptr = &e->active;
+    while (*ptr != NULL)
+    {
+      host_definition_t *this = *ptr;
+      if (!this->poll_remove)
+      {
+        ptr = &this->poll_next;
+        continue;
+      }
+      *ptr = this->poll_next;
+      this->poll_next = removed;
+      removed = this;
+    }
+    pthread_mutex_unlock (&e->lock);
+
+    while (removed != NULL)
+    {
+      host_definition_t *next = removed->poll_next;
+      removed->poll_next = NULL;
+      csnmp_async_poll_abort (e, removed);
+      removed = next;
+    }
+
+    while (host != NULL)
+    {
+      host_definition_t *next = host->poll_next;
+      csnmp_async_poll_start (e, host);
+      host = next;
+    }
+
+    /* Wait for responses on all sessions, for the earliest retransmission
+     * and for new hosts being queued. */
+    NETSNMP_LARGE_FD_ZERO (&fds);
+    NETSNMP_LARGE_FD_SET (e->wake_fd[0], &fds);
+    fds_num = e->wake_fd[0] + 1;
+    timeout.tv_sec = 1;
+    timeout.tv_usec = 0;
+    block = 0;
+
+    for (host = e->active; host != NULL; host = host->poll_next)
+      if (host->sess_handle != NULL)
+        snmp_sess_select_info2 (host->sess_handle, &fds_num, &fds,
+            &timeout, &block);
+
+    status = netsnmp_large_fd_set_select (fds_num, &fds,
+        /* writefds = */ NULL, /* exceptfds = */ NULL, &timeout);
+    if ((status < 0) && (errno != EINTR))
+    {
+      char errbuf[1024];
+      ERROR ("snmp plugin: select failed: %s",
+          sstrerror (errno, errbuf, sizeof (errbuf)));
+      NETSNMP_LARGE_FD_ZERO (&fds);
+      status = 0;
+    }
+
+    if ((status > 0) && NETSNMP_LARGE_FD_ISSET (e->wake_fd[0], &fds))
+    {
+      char buffer[64];
+      while (read (e->wake_fd[0], buffer, sizeof (buffer)) > 0)
+        /* drain */;
+    }
+
+    for (host = e->active; host != NULL; host = host->poll_next)
+    {
+      if (host->sess_handle == NULL)
+        continue;
+      if (status > 0)
+        snmp_sess_read2 (host->sess_handle, &fds);
+      snmp_sess_timeout (host->sess_handle);
+    }
+
+    /* Finish the hosts without outstanding requests. */
+    ptr = &e->active;
+    while (*ptr != NULL)
+    {
+      host = *ptr;
+      if ((host->poll_walks != NULL)
+          || ((host->poll_data_next < host->data_list_len)
+            && !host->poll_failed && (host->sess_handle != NULL)))
+      {
+        ptr = &host->poll_next;
+        continue;
+      }
+
+      *ptr = host->poll_next;
+      host->poll_next = NULL;
+      csnmp_async_poll_finish (e, host);
+    }
+  } /* while (42) */
+
+  /* Abort all polls in progress. */
+  while (e->active != NULL)
+  {
+    host_definition_t *host = e->active;
+    e->active = host->poll_next;
+    host->poll_next = NULL;
+    csnmp_async_poll_abort (e, host);
+  }
+
+  netsnmp_large_fd_set_cleanup (&fds);
+  return (NULL);
+} /* }}} void *csnmp_engine_thread */
+
+static int csnmp_engines_start (void) /* {{{ */
+{
+  size_t i;
+
+  engines = calloc ((size_t) async_threads_num, sizeof (*engines));
+  if (engines == NULL)
+  {
+    ERROR ("snmp plugin: calloc failed.");
+    return (-1);
+  }
+
+  for (i = 0; i < (size_t) async_threads_num; i++)
+  {
+    csnmp_engine_t *e = engines + i;
+    char errbuf[1024];
+    int status;
+
+    pthread_mutex_init (&e->lock, /* attr = */ NULL);
+    pthread_cond_init (&e->cond, /* attr = */ NULL);
+    e->loop = 1;
+    e->wake_fd[0] = -1;
+    e->wake_fd[1] = -1;
+    engines_num++;
+
+    if (pipe (e->wake_fd) != 0)
+    {
+      ERROR ("snmp plugin: pipe failed: %s",
+          sstrerror (errno, errbuf, sizeof (errbuf)));
+      return (-1);
+    }
+    fcntl (e->wake_fd[0], F_SETFL, fcntl (e->wake_fd[0], F_GETFL) | O_NONBLOCK);
+    fcntl (e->wake_fd[1], F_SETFL, fcntl (e->wake_fd[1], F_GETFL) | O_NONBLOCK);
+
+    status = plugin_thread_create (&e->thread, /* attr = */ NULL,
+        csnmp_engine_thread, e);
+    if (status != 0)
+    {
+      ERROR ("snmp plugin: pthread_create failed: %s",
+          sstrerror (status, errbuf, sizeof (errbuf)));
+      return (-1);
+    }
+    e->thread_started = 1;
+  }
 
   return (0);
-} /* int csnmp_read_value */
+} /* }}} int csnmp_engines_start */
+
+static void csnmp_engines_stop (void) /* {{{ */
+{
+  size_t i;
+
+  pthread_mutex_lock (&engines_lock);
+
+  for (i = 0; i < engines_num; i++)
+  {
+    csnmp_engine_t *e = engines + i;
+    host_definition_t *host;
+
+    pthread_mutex_lock (&e->lock);
+    e->loop = 0;
+    for (host = e->queue_head; host != NULL; host = host->poll_next)
+      host->poll_active = 0;
+    e->queue_head = NULL;
+    e->queue_tail = NULL;
+    pthread_mutex_unlock (&e->lock);
+
+    if (e->thread_started)
+    {
+      if (write (e->wake_fd[1], "x", 1) < 0)
+      {
+        /* The thread will notice within a second. */
+      }
+      pthread_join (e->thread, /* retval = */ NULL);
+      e->thread_started = 0;
+    }
+
+    if (e->wake_fd[0] >= 0)
+      close (e->wake_fd[0]);
+    if (e->wake_fd[1] >= 0)
+      close (e->wake_fd[1]);
+    pthread_cond_destroy (&e->cond);
+    pthread_mutex_destroy (&e->lock);
+  }
+
+  sfree (engines);
+  engines_num = 0;
+
+  pthread_mutex_unlock (&engines_lock);
+} /* }}} void csnmp_engines_stop */
+
+/* Queues the host for polling by its engine and returns immediately. */
+static int csnmp_async_submit (host_definition_t *host) /* {{{ */
+{
+  csnmp_engine_t *e;
+
+  pthread_mutex_lock (&engines_lock);
+  if (engines_num == 0)
+  {
+    pthread_mutex_unlock (&engines_lock);
+    return (-1);
+  }
+  if (host->engine == NULL)
+  {
+    host->engine = engines + (engines_next % engines_num);
+    engines_next++;
+  }
+  e = host->engine;
+
+  pthread_mutex_lock (&e->lock);
+  if (!e->loop)
+  {
+    pthread_mutex_unlock (&e->lock);
+    pthread_mutex_unlock (&engines_lock);
+    return (-1);
+  }
+  if (host->poll_active)
+  {
+    pthread_mutex_unlock (&e->lock);
+    pthread_mutex_unlock (&engines_lock);
+    c_complain (LOG_WARNING, &host->complaint,
+        "snmp plugin: host %s: The previous poll is still in progress. "
+        "Skipping this interval.", host->name);
+    return (0);
+  }
+
+  host->poll_active = 1;
+  host->poll_next = NULL;
+  if (e->queue_tail == NULL)
+    e->queue_head = host;
+  else
+    e->queue_tail->poll_next = host;
+  e->queue_tail = host;
+  pthread_mutex_unlock (&e->lock);
+
+  if (write (e->wake_fd[1], "x", 1) < 0)
+  {
+    /* The pipe is full, so the engine will wake up anyway. */
+  }
+  pthread_mutex_unlock (&engines_lock);
+
+  return (0);
+} /* }}} int csnmp_async_submit */
+
+/* Makes the engine forget about the host: removes it from the queue or
+ * aborts the poll in progress and waits for the engine to let go of it. */
+static void csnmp_async_remove (host_definition_t *host) /* {{{ */
+{
+  csnmp_engine_t *e;
+  host_definition_t *prev;
+  host_definition_t *this;
+
+  pthread_mutex_lock (&engines_lock);
+  e = host->engine;
+  if ((engines_num == 0) || (e == NULL))
+  {
+    pthread_mutex_unlock (&engines_lock);
+    return;
+  }
+
+  pthread_mutex_lock (&e->lock);
+  prev = NULL;
+  for (this = e->queue_head; this != NULL; this = this->poll_next)
+  {
+    if (this == host)
+      break;
+    prev = this;
+  }
+  if (this != NULL)
+  {
+    if (prev == NULL)
+      e->queue_head = host->poll_next;
+    else
+      prev->poll_next = host->poll_next;
+    if (e->queue_tail == host)
+      e->queue_tail = prev;
+    host->poll_next = NULL;
+    host->poll_active = 0;
+  }
+
+  if (host->poll_active)
+  {
+    host->poll_remove = 1;
+    if (write (e->wake_fd[1], "x", 1) < 0)
+    {
+      /* The pipe is full, so the engine will wake up anyway. */
+    }
+    while (host->poll_active)
+      pthread_cond_wait (&e->cond, &e->lock);
+    host->poll_remove = 0;
+  }
+  host->engine = NULL;
+  pthread_mutex_unlock (&e->lock);
+
+  pthread_mutex_unlock (&engines_lock);
+} /* }}} void csnmp_async_remove */
+/* }}} End of the asynchronous engine */
+#else /* !HAVE_NETSNMP_LARGE_FD_SET */
+/* Without large fd sets, snmp_sess_select_info2() and snmp_sess_read2()
+ * "AsyncThreads" is ignored by csnmp_config() and hosts are always queried
+ * by the read threads. */
+static int csnmp_engines_start (void)
+{
+  return (-1);
+}
+
+static void csnmp_engines_stop (void)
+{
+}
+
+static int csnmp_async_submit (host_definition_t *host)
+{
+  return (-1);
+}
+
+static void csnmp_async_remove (host_definition_t *host)
+{
+}
+#endif /* HAVE_NETSNMP_LARGE_FD_SET */
 
 static int csnmp_read_host (user_data_t *ud)
 {
@@ -1801,6 +2621,9 @@ static int csnmp_read_host (user_data_t *ud)
   if (host->interval == 0)
     host->interval = plugin_get_interval ();
 
+  if (async_threads_num > 0)
+    return (csnmp_async_submit (host));
+
   if (host->sess_handle == NULL)
     csnmp_host_open_session (host);
 
@@ -1831,6 +2654,15 @@ static int csnmp_init (void)
 {
   call_snmp_init_once ();
 
+  if ((async_threads_num > 0) && (engines == NULL))
+  {
+    if (csnmp_engines_start () != 0)
+    {
+      csnmp_engines_stop ();
+      return (-1);
+    }
+  }
+
   return (0);
 } /* int csnmp_init */
 
@@ -1839,6 +2671,9 @@ static int csnmp_shutdown (void)
   data_definition_t *data_this;
   data_definition_t *data_next;
 
+  /* Usually the engines have been stopped when the hosts were destroyed. */
+  csnmp_engines_stop ();
+
   /* When we get here, the read threads have been stopped and all the
    * `host_definition_t' will be freed. */
   DEBUG ("snmp plugin: Destroying all data definitions.");
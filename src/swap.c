@@ -70,6 +70,7 @@
 #define MAX(x,y) ((x) > (y) ? (x) : (y))
 
 #if KERNEL_LINUX
+# include "utils_procfs.h"
 # define SWAP_HAVE_REPORT_BY_DEVICE 1
 static derive_t pagesize;
 static _Bool report_bytes = 0;
@@ -356,8 +357,6 @@ static int swap_read_io (void) /* {{{ */
 	FILE *fh;
 	char buffer[1024];
 
-	_Bool old_kernel = 0;
-
 	uint8_t have_data = 0;
 	derive_t swap_in  = 0;
 	derive_t swap_out = 0;
@@ -365,28 +364,33 @@ static int swap_read_io (void) /* {{{ */
 	fh = fopen ("/proc/vmstat", "r");
 	if (fh == NULL)
 	{
-		/* /proc/vmstat does not exist in kernels <2.6 */
-		fh = fopen ("/proc/stat", "r");
-		if (fh == NULL)
+		/* /proc/vmstat does not exist in kernels <2.6; those report the
+		 * same counters in the "swap" line of /proc/stat. */
+		procfs_stat_t const *st = procfs_stat_acquire ();
+		if (st == NULL)
 		{
 			char errbuf[1024];
-			WARNING ("swap: fopen: %s",
+			WARNING ("swap: reading /proc/stat failed: %s",
 					sstrerror (errno, errbuf, sizeof (errbuf)));
 			return (-1);
 		}
-		else
-			old_kernel = 1;
-	}
 
-	while (fgets (buffer, sizeof (buffer), fh) != NULL)
+		if (st->have_swap)
+		{
+			swap_in = st->swap_in;
+			swap_out = st->swap_out;
+			have_data = 0x03;
+		}
+		procfs_release (st);
+	}
+	else
 	{
-		char *fields[8];
-		int numfields;
-
-		numfields = strsplit (buffer, fields, STATIC_ARRAY_SIZE (fields));
-
-		if (!old_kernel)
+		while (fgets (buffer, sizeof (buffer), fh) != NULL)
 		{
+			char *fields[8];
+			int numfields;
+
+			numfields = strsplit (buffer, fields, STATIC_ARRAY_SIZE (fields));
 			if (numfields != 2)
 				continue;
 
@@ -400,21 +404,10 @@ static int swap_read_io (void) /* {{{ */
 				strtoderive (fields[1], &swap_out);
 				have_data |= 0x02;
 			}
-		}
-		else /* if (old_kernel) */
-		{
-			if (numfields != 3)
-				continue;
-
-			if (strcasecmp ("page", fields[0]) == 0)
-			{
-				strtoderive (fields[1], &swap_in);
-				strtoderive (fields[2], &swap_out);
-			}
-		}
-	} /* while (fgets) */
+		} /* while (fgets) */
 
-	fclose (fh);
+		fclose (fh);
+	}
 
 	if (have_data != 0x03)
 		return (ENOENT);
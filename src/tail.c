@@ -59,6 +59,7 @@ typedef struct ctail_config_match_s ctail_config_match_t;
 static cu_tail_match_t **tail_match_list = NULL;
 static size_t tail_match_list_num = 0;
 static cdtime_t tail_match_list_intervals[255];
+static _Bool tail_match_list_continuous[255];
 
 static int ctail_config_add_match_dstype (ctail_config_match_t *cm,
     oconfig_item_t *ci)
@@ -222,6 +223,7 @@ static int ctail_config_add_file (oconfig_item_t *ci)
 {
   cu_tail_match_t *tm;
   cdtime_t interval = 0;
+  _Bool continuous = 0;
   char *plugin_instance = NULL;
   int num_matches = 0;
   int i;
@@ -249,6 +251,8 @@ static int ctail_config_add_file (oconfig_item_t *ci)
       status = cf_util_get_string (option, &plugin_instance);
     else if (strcasecmp ("Interval", option->key) == 0)
       cf_util_get_cdtime (option, &interval);
+    else if (strcasecmp ("ReadContinuously", option->key) == 0)
+      status = cf_util_get_boolean (option, &continuous);
     else if (strcasecmp ("Match", option->key) == 0)
     {
       status = ctail_config_add_match (tm, plugin_instance, option, interval);
@@ -291,6 +295,7 @@ static int ctail_config_add_file (oconfig_item_t *ci)
     tail_match_list = temp;
     tail_match_list[tail_match_list_num] = tm;
     tail_match_list_intervals[tail_match_list_num] = interval;
+    tail_match_list_continuous[tail_match_list_num] = continuous;
     tail_match_list_num++;
   }
 
@@ -346,6 +351,11 @@ static int ctail_init (void)
 
   for (i = 0; i < tail_match_list_num; i++)
   {
+    if (tail_match_list_continuous[i]
+        && (tail_match_start (tail_match_list[i]) != 0))
+      WARNING ("tail plugin: Reading file #%zu continuously failed. "
+          "Reading it in the read callback instead.", i);
+
     ud.data = (void *)tail_match_list[i];
     ssnprintf(str, sizeof(str), "tail-%zu", i);
     plugin_register_complex_read (NULL, str, ctail_read, tail_match_list_intervals[i], &ud);
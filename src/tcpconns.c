@@ -75,6 +75,10 @@
 #if HAVE_LINUX_INET_DIAG_H
 # include <linux/inet_diag.h>
 #endif
+#if HAVE_LINUX_SOCK_DIAG_H
+# include <linux/sock_diag.h>
+#endif
+# include <netinet/in.h>
 # include <arpa/inet.h>
 /* #endif KERNEL_LINUX */
 
@@ -133,9 +137,25 @@
 
 #if KERNEL_LINUX
 #if HAVE_STRUCT_LINUX_INET_DIAG_REQ
+/* Size of the buffer the netlink socket is read into and of the socket's
+ * receive buffer. */
+# define CONN_NETLINK_BUFFER_SIZE 65536
+# define CONN_NETLINK_RCVBUF      (4 * 1024 * 1024)
+
+/* The kernel filters sockets using a small bytecode program, see
+ * conn_build_filter(). Each port takes CONN_FILTER_PORT_SIZE bytes. If more
+ * ports are selected, all sockets are dumped and filtered here. */
+# define CONN_FILTER_PORT_SIZE 20
+# define CONN_FILTER_MAX       16384
+
 struct nlreq {
   struct nlmsghdr nlh;
-  struct inet_diag_req r;
+  union {
+    struct inet_diag_req v1;
+#if HAVE_LINUX_SOCK_DIAG_H
+    struct inet_diag_req_v2 v2;
+#endif
+  } r;
 };
 #endif
 
@@ -273,6 +293,8 @@ static int config_keys_num = STATIC_ARRAY_SIZE (config_keys);
 static int port_collect_listening = 0;
 static int port_collect_total = 0;
 static port_entry_t *port_list_head = NULL;
+/* Direct-indexed lookup table for the entries in port_list_head. */
+static port_entry_t *port_table[65536];
 static uint32_t count_total[TCP_STATE_MAX + 1];
 
 #if KERNEL_LINUX
@@ -281,6 +303,16 @@ static uint32_t count_total[TCP_STATE_MAX + 1];
  * sequence_number is useless and we get a compilation warning.
  */
 static uint32_t sequence_number = 0;
+
+/* The netlink socket is kept open between reads. */
+static int netlink_fd = -1;
+static char *netlink_buffer = NULL;
+
+# if HAVE_LINUX_SOCK_DIAG_H
+/* Kernels before 3.3 don't support sock_diag and return an error. We then
+ * fall back to the old request format. */
+static _Bool netlink_use_v2 = 1;
+# endif
 #endif
 
 static enum
@@ -375,13 +407,7 @@ static port_entry_t *conn_get_port_entry (uint16_t port, int create)
 {
   port_entry_t *ret;
 
-  ret = port_list_head;
-  while (ret != NULL)
-  {
-    if (ret->port == port)
-      break;
-    ret = ret->next;
-  }
+  ret = port_table[port];
 
   if ((ret == NULL) && (create != 0))
   {
@@ -393,6 +419,7 @@ static port_entry_t *conn_get_port_entry (uint16_t port, int create)
     ret->port = port;
     ret->next = port_list_head;
     port_list_head = ret;
+    port_table[port] = ret;
   }
 
   return (ret);
@@ -425,6 +452,7 @@ static void conn_reset_port_entry (void)
       else
         prev->next = next;
 
+      port_table[pe->port] = NULL;
       sfree (pe);
       pe = next;
 
@@ -480,52 +508,198 @@ static int conn_handle_ports (uint16_t port_local, uint16_t port_remote, uint8_t
 } /* int conn_handle_ports */
 
 #if KERNEL_LINUX
-/* Returns zero on success, less than zero on socket error and greater than
- * zero on other errors. */
-static int conn_read_netlink (void)
-{
 #if HAVE_STRUCT_LINUX_INET_DIAG_REQ
-  int fd;
-  struct sockaddr_nl nladdr;
-  struct nlreq req;
-  struct msghdr msg;
-  struct iovec iov;
-  struct inet_diag_msg *r;
-  char buf[8192];
+static void conn_netlink_close (void)
+{
+  if (netlink_fd >= 0)
+    close (netlink_fd);
+  netlink_fd = -1;
+} /* void conn_netlink_close */
+
+static int conn_netlink_open (void)
+{
+  int rcvbuf = CONN_NETLINK_RCVBUF;
+  char errbuf[1024];
+
+  if (netlink_fd >= 0)
+    return (0);
+
+  if (netlink_buffer == NULL)
+  {
+    netlink_buffer = malloc (CONN_NETLINK_BUFFER_SIZE);
+    if (netlink_buffer == NULL)
+    {
+      ERROR ("tcpconns plugin: conn_netlink_open: malloc failed.");
+      return (-1);
+    }
+  }
 
   /* If this fails, it's likely a permission problem. We'll fall back to
    * reading this information from files below. */
-  fd = socket(AF_NETLINK, SOCK_RAW, NETLINK_INET_DIAG);
-  if (fd < 0)
+  netlink_fd = socket (AF_NETLINK, SOCK_RAW, NETLINK_INET_DIAG);
+  if (netlink_fd < 0)
   {
     ERROR ("tcpconns plugin: conn_read_netlink: socket(AF_NETLINK, SOCK_RAW, "
 	"NETLINK_INET_DIAG) failed: %s",
-	sstrerror (errno, buf, sizeof (buf)));
+	sstrerror (errno, errbuf, sizeof (errbuf)));
     return (-1);
   }
 
+  /* A full dump of a large socket table arrives faster than it is read. */
+  if (setsockopt (netlink_fd, SOL_SOCKET, SO_RCVBUF,
+	&rcvbuf, sizeof (rcvbuf)) != 0)
+    DEBUG ("tcpconns plugin: conn_netlink_open: setsockopt (SO_RCVBUF) "
+	"failed: %s", sstrerror (errno, errbuf, sizeof (errbuf)));
+
+  return (0);
+} /* int conn_netlink_open */
+
+/* Appends a block to "bc" that accepts a socket if its source (or
+ * destination) port equals "port" by jumping to the end of the program, at
+ * "bc_len", and continues with the next block otherwise. The kernel checks
+ * that all instructions can be reached by following the "yes" jumps, so
+ * "yes" always points to the next instruction and "no" is used for
+ * branching. */
+static size_t conn_filter_port (uint8_t *bc, size_t offset, size_t bc_len,
+    uint8_t code_ge, uint8_t code_le, uint16_t port)
+{
+  struct inet_diag_bc_op *op = (struct inet_diag_bc_op *) (bc + offset);
+
+  /* port < wanted: next block */
+  op[0].code = code_ge;
+  op[0].yes = 2 * sizeof (*op);
+  op[0].no = CONN_FILTER_PORT_SIZE;
+  op[1].code = 0;
+  op[1].yes = 0;
+  op[1].no = port;
+
+  /* port > wanted: next block */
+  op[2].code = code_le;
+  op[2].yes = 2 * sizeof (*op);
+  op[2].no = CONN_FILTER_PORT_SIZE - 2 * sizeof (*op);
+  op[3].code = 0;
+  op[3].yes = 0;
+  op[3].no = port;
+
+  /* match: accept */
+  op[4].code = INET_DIAG_BC_JMP;
+  op[4].yes = sizeof (*op);
+  op[4].no = (uint16_t) (bc_len - (offset + 4 * sizeof (*op)));
+
+  return (offset + CONN_FILTER_PORT_SIZE);
+} /* size_t conn_filter_port */
+
+/* Builds a filter matching all collected ports. Returns the length of the
+ * program, zero if no socket can match and -1 if the ports don't fit into
+ * the buffer, in which case all sockets have to be dumped. */
+static ssize_t conn_build_filter (uint8_t *bc, size_t bc_size)
+{
+  struct inet_diag_bc_op *op;
+  port_entry_t *pe;
+  size_t ports_num = 0;
+  size_t bc_len;
+  size_t offset = 0;
+
+  for (pe = port_list_head; pe != NULL; pe = pe->next)
+  {
+    if (pe->flags & (PORT_COLLECT_LOCAL | PORT_IS_LISTENING))
+      ports_num++;
+    if (pe->flags & PORT_COLLECT_REMOTE)
+      ports_num++;
+  }
+
+  if (ports_num == 0)
+    return (0);
+
+  /* One final instruction rejects sockets which didn't match any port. */
+  bc_len = ports_num * CONN_FILTER_PORT_SIZE + sizeof (*op);
+  if (bc_len > bc_size)
+    return (-1);
+
+  for (pe = port_list_head; pe != NULL; pe = pe->next)
+  {
+    if (pe->flags & (PORT_COLLECT_LOCAL | PORT_IS_LISTENING))
+      offset = conn_filter_port (bc, offset, bc_len,
+	  INET_DIAG_BC_S_GE, INET_DIAG_BC_S_LE, pe->port);
+    if (pe->flags & PORT_COLLECT_REMOTE)
+      offset = conn_filter_port (bc, offset, bc_len,
+	  INET_DIAG_BC_D_GE, INET_DIAG_BC_D_LE, pe->port);
+  }
+
+  /* Jump beyond the end of the program: reject. */
+  op = (struct inet_diag_bc_op *) (bc + offset);
+  op->code = INET_DIAG_BC_JMP;
+  op->yes = sizeof (*op);
+  op->no = 2 * sizeof (*op);
+
+  return ((ssize_t) bc_len);
+} /* ssize_t conn_build_filter */
+
+/* Dumps the TCP sockets of one address family which are in one of "states".
+ * If "bc_len" is non-zero, the filter "bc" is sent along. Returns zero on
+ * success, less than zero on socket error and greater than zero on other
+ * errors. */
+static int conn_netlink_dump (int family, uint32_t states,
+    const uint8_t *bc, size_t bc_len)
+{
+  static char req_buffer[NLMSG_SPACE (sizeof (struct nlreq))
+    + NLA_HDRLEN + CONN_FILTER_MAX];
+  struct nlreq *req = (struct nlreq *) req_buffer;
+  struct sockaddr_nl nladdr;
+  struct msghdr msg;
+  struct iovec iov;
+  struct inet_diag_msg *r;
+  size_t req_len;
+  char errbuf[1024];
+
   memset(&nladdr, 0, sizeof(nladdr));
   nladdr.nl_family = AF_NETLINK;
 
-  memset(&req, 0, sizeof(req));
-  req.nlh.nlmsg_len = sizeof(req);
-  req.nlh.nlmsg_type = TCPDIAG_GETSOCK;
+  memset(req, 0, sizeof(*req));
+#if HAVE_LINUX_SOCK_DIAG_H
+  if (netlink_use_v2)
+  {
+    req->nlh.nlmsg_type = SOCK_DIAG_BY_FAMILY;
+    req->r.v2.sdiag_family = (uint8_t) family;
+    req->r.v2.sdiag_protocol = IPPROTO_TCP;
+    req->r.v2.idiag_states = states;
+    req_len = NLMSG_LENGTH (sizeof (req->r.v2));
+  }
+  else
+#endif
+  {
+    req->nlh.nlmsg_type = TCPDIAG_GETSOCK;
+    req->r.v1.idiag_family = (uint8_t) family;
+    req->r.v1.idiag_states = states;
+    req_len = NLMSG_LENGTH (sizeof (req->r.v1));
+  }
+
+  /* The filter is passed as an attribute following the request. */
+  req_len = NLMSG_ALIGN (req_len);
+  if (bc_len > 0)
+  {
+    struct nlattr *attr = (struct nlattr *) (req_buffer + req_len);
+
+    attr->nla_type = INET_DIAG_REQ_BYTECODE;
+    attr->nla_len = (uint16_t) (NLA_HDRLEN + bc_len);
+    memcpy (req_buffer + req_len + NLA_HDRLEN, bc, bc_len);
+    req_len += NLA_ALIGN (attr->nla_len);
+  }
+
   /* NLM_F_ROOT: return the complete table instead of a single entry.
    * NLM_F_MATCH: return all entries matching criteria (not implemented)
    * NLM_F_REQUEST: must be set on all request messages */
-  req.nlh.nlmsg_flags = NLM_F_ROOT | NLM_F_MATCH | NLM_F_REQUEST;
-  req.nlh.nlmsg_pid = 0;
+  req->nlh.nlmsg_len = (uint32_t) req_len;
+  req->nlh.nlmsg_flags = NLM_F_ROOT | NLM_F_MATCH | NLM_F_REQUEST;
+  req->nlh.nlmsg_pid = 0;
   /* The sequence_number is used to track our messages. Since netlink is not
    * reliable, we don't want to end up with a corrupt or incomplete old
    * message in case the system is/was out of memory. */
-  req.nlh.nlmsg_seq = ++sequence_number;
-  req.r.idiag_family = AF_INET;
-  req.r.idiag_states = 0xfff;
-  req.r.idiag_ext = 0;
+  req->nlh.nlmsg_seq = ++sequence_number;
 
   memset(&iov, 0, sizeof(iov));
-  iov.iov_base = &req;
-  iov.iov_len = sizeof(req);
+  iov.iov_base = req;
+  iov.iov_len = req_len;
 
   memset(&msg, 0, sizeof(msg));
   msg.msg_name = (void*)&nladdr;
@@ -533,16 +707,16 @@ static int conn_read_netlink (void)
   msg.msg_iov = &iov;
   msg.msg_iovlen = 1;
 
-  if (sendmsg (fd, &msg, 0) < 0)
+  if (sendmsg (netlink_fd, &msg, 0) < 0)
   {
     ERROR ("tcpconns plugin: conn_read_netlink: sendmsg(2) failed: %s",
-	sstrerror (errno, buf, sizeof (buf)));
-    close (fd);
+	sstrerror (errno, errbuf, sizeof (errbuf)));
+    conn_netlink_close ();
     return (-1);
   }
 
-  iov.iov_base = buf;
-  iov.iov_len = sizeof(buf);
+  iov.iov_base = netlink_buffer;
+  iov.iov_len = CONN_NETLINK_BUFFER_SIZE;
 
   while (1)
   {
@@ -555,26 +729,26 @@ static int conn_read_netlink (void)
     msg.msg_iov = &iov;
     msg.msg_iovlen = 1;
 
-    status = recvmsg(fd, (void *) &msg, /* flags = */ 0);
+    status = recvmsg(netlink_fd, (void *) &msg, /* flags = */ 0);
     if (status < 0)
     {
       if ((errno == EINTR) || (errno == EAGAIN))
         continue;
 
       ERROR ("tcpconns plugin: conn_read_netlink: recvmsg(2) failed: %s",
-	  sstrerror (errno, buf, sizeof (buf)));
-      close (fd);
+	  sstrerror (errno, errbuf, sizeof (errbuf)));
+      conn_netlink_close ();
       return (-1);
     }
     else if (status == 0)
     {
-      close (fd);
       DEBUG ("tcpconns plugin: conn_read_netlink: Unexpected zero-sized "
 	  "reply from netlink socket.");
+      conn_netlink_close ();
       return (0);
     }
 
-    h = (struct nlmsghdr*)buf;
+    h = (struct nlmsghdr*)netlink_buffer;
     while (NLMSG_OK(h, status))
     {
       if (h->nlmsg_seq != sequence_number)
@@ -584,10 +758,7 @@ static int conn_read_netlink (void)
       }
 
       if (h->nlmsg_type == NLMSG_DONE)
-      {
-	close (fd);
 	return (0);
-      }
       else if (h->nlmsg_type == NLMSG_ERROR)
       {
 	struct nlmsgerr *msg_error;
@@ -596,7 +767,6 @@ static int conn_read_netlink (void)
 	WARNING ("tcpconns plugin: conn_read_netlink: Received error %i.",
 	    msg_error->error);
 
-	close (fd);
 	return (1);
       }
 
@@ -613,6 +783,69 @@ static int conn_read_netlink (void)
 
   /* Not reached because the while() loop above handles the exit condition. */
   return (0);
+} /* int conn_netlink_dump */
+
+static int conn_netlink_dump_all (uint32_t states,
+    const uint8_t *bc, size_t bc_len)
+{
+  int status;
+
+#if HAVE_LINUX_SOCK_DIAG_H
+  if (netlink_use_v2)
+  {
+    status = conn_netlink_dump (AF_INET, states, bc, bc_len);
+    if (status == 0)
+      return (conn_netlink_dump (AF_INET6, states, bc, bc_len));
+    else if (status < 0)
+      return (status);
+
+    INFO ("tcpconns plugin: The kernel doesn't support sock_diag requests. "
+	"Falling back to inet_diag.");
+    netlink_use_v2 = 0;
+  }
+#endif
+
+  /* As before sock_diag was supported, only IPv4 sockets are dumped with the
+   * old request format. */
+  status = conn_netlink_dump (AF_INET, states, bc, bc_len);
+  return (status);
+} /* int conn_netlink_dump_all */
+#endif /* HAVE_STRUCT_LINUX_INET_DIAG_REQ */
+
+/* Returns zero on success, less than zero on socket error and greater than
+ * zero on other errors. */
+static int conn_read_netlink (void)
+{
+#if HAVE_STRUCT_LINUX_INET_DIAG_REQ
+  static uint8_t bc[CONN_FILTER_MAX];
+  ssize_t bc_len = -1;
+  uint32_t states = 0xfff;
+  int status;
+
+  status = conn_netlink_open ();
+  if (status != 0)
+    return (status);
+
+  /* With a summary of all ports, every socket is needed. Otherwise the kernel
+   * only sends sockets with a collected port. The listening ports, which are
+   * collected by default, are not known in advance: they are dumped first. */
+  if (!port_collect_total)
+  {
+    if (port_collect_listening)
+    {
+      status = conn_netlink_dump_all (1 << TCP_STATE_LISTEN, NULL, 0);
+      if (status != 0)
+	return (status);
+      states &= ~(1 << TCP_STATE_LISTEN);
+    }
+
+    bc_len = conn_build_filter (bc, sizeof (bc));
+    if (bc_len == 0)
+      return (0);
+  }
+
+  return (conn_netlink_dump_all (states, bc,
+	(bc_len > 0) ? (size_t) bc_len : 0));
 #else
   return (1);
 #endif /* HAVE_STRUCT_LINUX_INET_DIAG_REQ */
@@ -757,6 +990,16 @@ static int conn_init (void)
   return (0);
 } /* int conn_init */
 
+static int conn_shutdown (void)
+{
+#if HAVE_STRUCT_LINUX_INET_DIAG_REQ
+  conn_netlink_close ();
+  sfree (netlink_buffer);
+#endif
+
+  return (0);
+} /* int conn_shutdown */
+
 static int conn_read (void)
 {
   int status;
@@ -1078,6 +1321,7 @@ void module_register (void)
 			config_keys, config_keys_num);
 #if KERNEL_LINUX
 	plugin_register_init ("tcpconns", conn_init);
+	plugin_register_shutdown ("tcpconns", conn_shutdown);
 #elif HAVE_SYSCTLBYNAME
 	/* no initialization */
 #elif HAVE_LIBKVM_NLIST
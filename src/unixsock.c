@@ -42,14 +42,24 @@
 #include <sys/stat.h>
 #include <sys/un.h>
 
+#include <fcntl.h>
 #include <grp.h>
 
+#if KERNEL_LINUX
+# include <sys/epoll.h>
+#endif
+
 #ifndef UNIX_PATH_MAX
 # define UNIX_PATH_MAX sizeof (((struct sockaddr_un *)0)->sun_path)
 #endif
 
 #define US_DEFAULT_PATH LOCALSTATEDIR"/run/"PACKAGE_NAME"-unixsock"
 
+/* Limits of the event loop: longest accepted command line and amount of
+ * pending output after which no more commands are read from a client. */
+#define US_LINE_MAX   65536
+#define US_OUTPUT_MAX 1048576
+
 /*
  * Private variables
  */
@@ -59,7 +69,8 @@ static const char *config_keys[] =
 	"SocketFile",
 	"SocketGroup",
 	"SocketPerms",
-	"DeleteSocket"
+	"DeleteSocket",
+	"EventLoop"
 };
 static int config_keys_num = STATIC_ARRAY_SIZE (config_keys);
 
@@ -71,6 +82,7 @@ static char *sock_file  = NULL;
 static char *sock_group = NULL;
 static int   sock_perms = S_IRWXU | S_IRWXG;
 static _Bool delete_socket = 0;
+static _Bool event_loop = 0;
 
 static pthread_t listen_thread = (pthread_t) 0;
 
@@ -188,11 +200,105 @@ static int us_open_socket (void)
 	return (0);
 } /* int us_open_socket */
 
+static void us_close_socket (void)
+{
+	int status;
+
+	close (sock_fd);
+	sock_fd = -1;
+
+	status = unlink ((sock_file != NULL) ? sock_file : US_DEFAULT_PATH);
+	if (status != 0)
+	{
+		char errbuf[1024];
+		NOTICE ("unixsock plugin: unlink (%s) failed: %s",
+				(sock_file != NULL) ? sock_file : US_DEFAULT_PATH,
+				sstrerror (errno, errbuf, sizeof (errbuf)));
+	}
+} /* void us_close_socket */
+
+/* Handles one text command. Returns non-zero if the connection should be
+ * closed. */
+static int us_handle_command (FILE *fhout, char *buffer)
+{
+	/* Only the command name is needed, so truncating long lines is fine. */
+	char buffer_copy[1024];
+	char *fields[128];
+	int   fields_num;
+
+	sstrncpy (buffer_copy, buffer, sizeof (buffer_copy));
+
+	fields_num = strsplit (buffer_copy, fields,
+			sizeof (fields) / sizeof (fields[0]));
+	if (fields_num < 1)
+	{
+		fprintf (fhout, "-1 Internal error\n");
+		return (-1);
+	}
+
+	if (strcasecmp (fields[0], "getval") == 0)
+	{
+		handle_getval (fhout, buffer);
+	}
+	else if (strcasecmp (fields[0], "gethistory") == 0)
+	{
+		handle_gethistory (fhout, buffer);
+	}
+	else if (strcasecmp (fields[0], "getthreshold") == 0)
+	{
+		handle_getthreshold (fhout, buffer);
+	}
+	else if (strcasecmp (fields[0], "putval") == 0)
+	{
+		handle_putval (fhout, buffer);
+	}
+	else if (strcasecmp (fields[0], "listval") == 0)
+	{
+		handle_listval (fhout, buffer);
+	}
+	else if (strcasecmp (fields[0], "putnotif") == 0)
+	{
+		handle_putnotif (fhout, buffer);
+	}
+	else if (strcasecmp (fields[0], "flush") == 0)
+	{
+		handle_flush (fhout, buffer);
+	}
+	else
+	{
+		if (fprintf (fhout, "-1 Unknown command: %s\n", fields[0]) < 0)
+		{
+			char errbuf[1024];
+			WARNING ("unixsock plugin: failed to write to socket #%i: %s",
+					fileno (fhout),
+					sstrerror (errno, errbuf, sizeof (errbuf)));
+			return (-1);
+		}
+	}
+
+	return (0);
+} /* int us_handle_command */
+
+/* Checks the header of a binary frame and returns the size of its payload,
+ * or -1 if the frame can't be handled. */
+static int us_binary_payload_size (FILE *fhout, const unsigned char *header)
+{
+	if (header[1] != PUTVAL_BINARY_VERSION)
+	{
+		fprintf (fhout, "-1 Unsupported binary frame version %u.\n",
+				(unsigned int) header[1]);
+		return (-1);
+	}
+
+	return ((((int) header[2]) << 8) | ((int) header[3]));
+} /* int us_binary_payload_size */
+
 static void *us_handle_client (void *arg)
 {
 	int fdin;
 	int fdout;
 	FILE *fhin, *fhout;
+	char *payload = NULL;
 
 	fdin = *((int *) arg);
 	free (arg);
@@ -249,10 +355,60 @@ static void *us_handle_client (void *arg)
 	while (42)
 	{
 		char buffer[1024];
-		char buffer_copy[1024];
-		char *fields[128];
-		int   fields_num;
 		int   len;
+		int   c;
+
+		/* Binary frames start with a zero byte. */
+		errno = 0;
+		c = fgetc (fhin);
+		if (c == EOF)
+		{
+			if ((errno == EINTR) || (errno == EAGAIN))
+			{
+				clearerr (fhin);
+				continue;
+			}
+
+			if (errno != 0)
+			{
+				char errbuf[1024];
+				WARNING ("unixsock plugin: failed to read from socket #%i: %s",
+						fileno (fhin),
+						sstrerror (errno, errbuf, sizeof (errbuf)));
+			}
+			break;
+		}
+		else if (c == PUTVAL_BINARY_MAGIC)
+		{
+			unsigned char header[PUTVAL_BINARY_HEADER_SIZE];
+			int payload_size;
+
+			header[0] = (unsigned char) c;
+			if (fread (header + 1, sizeof (header) - 1, 1, fhin) != 1)
+				break;
+
+			payload_size = us_binary_payload_size (fhout, header);
+			if (payload_size < 0)
+				break;
+
+			if (payload == NULL)
+			{
+				payload = malloc (1 << 16);
+				if (payload == NULL)
+				{
+					fprintf (fhout, "-1 malloc failed.\n");
+					break;
+				}
+			}
+
+			if ((payload_size > 0)
+					&& (fread (payload, (size_t) payload_size, 1, fhin) != 1))
+				break;
+
+			handle_putval_binary (fhout, payload, (size_t) payload_size);
+			continue;
+		}
+		ungetc (c, fhin);
 
 		errno = 0;
 		if (fgets (buffer, sizeof (buffer), fhin) == NULL)
@@ -278,63 +434,762 @@ static void *us_handle_client (void *arg)
 		if (len == 0)
 			continue;
 
-		sstrncpy (buffer_copy, buffer, sizeof (buffer_copy));
+		if (us_handle_command (fhout, buffer) != 0)
+			break;
+	} /* while (fgets) */
+
+	DEBUG ("unixsock plugin: us_handle_client: Exiting..");
+	sfree (payload);
+	fclose (fhin);
+	fclose (fhout);
+
+	pthread_exit ((void *) 0);
+	return ((void *) 0);
+} /* void *us_handle_client */
+
+#if KERNEL_LINUX
+/*
+ * Event loop
+ *
+ * With "EventLoop" enabled, a single thread serves all clients. Commands are
+ * processed as soon as they have been received completely, without waiting
+ * for the client to read the responses to previous commands. Responses are
+ * collected in an output buffer which is written whenever the socket becomes
+ * writable.
+ */
+struct us_job_s;
+
+struct us_client_s
+{
+	/* -1 once the client has been destroyed while a job was running. */
+	int fd;
+	uint32_t events;
+	_Bool closing;
+	/* The command being handled by the worker thread, if any. */
+	struct us_job_s *job;
+
+	char  *input;
+	size_t input_fill;
+
+	char  *output;
+	size_t output_fill;
+	size_t output_size;
+
+	struct us_client_s *prev;
+	struct us_client_s *next;
+};
+typedef struct us_client_s us_client_t;
+
+/* Lines of up to US_LINE_MAX - 1 characters and binary frames with the
+ * maximum payload size both fit into the input buffer, which keeps space for
+ * a terminating null byte. */
+#define US_INPUT_SIZE (US_LINE_MAX + PUTVAL_BINARY_HEADER_SIZE + 1)
+
+static us_client_t *clients = NULL;
+
+/*
+ * Commands other than PUTVAL may take a while, FLUSH in particular, so they
+ * are handed to a worker thread and the event loop keeps serving the other
+ * clients. The input of the client isn't processed any further until the
+ * response is back, which keeps the responses in order.
+ */
+struct us_job_s
+{
+	us_client_t *client;
+	char *command;
+	char *output;
+	size_t output_size;
+	_Bool close;
+	struct us_job_s *next;
+};
+typedef struct us_job_s us_job_t;
+
+static pthread_t        worker_thread;
+static _Bool            worker_started = 0;
+static _Bool            worker_loop = 0;
+static pthread_mutex_t  worker_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t   worker_cond = PTHREAD_COND_INITIALIZER;
+/* Protected by "worker_lock". */
+static us_job_t        *jobs_queue_head = NULL;
+static us_job_t        *jobs_queue_tail = NULL;
+static us_job_t        *jobs_done = NULL;
+/* Written by the worker thread to wake up the event loop. */
+static int              worker_wake_fd[2] = { -1, -1 };
+
+static int us_set_nonblocking (int fd)
+{
+	int flags;
+
+	flags = fcntl (fd, F_GETFL);
+	if ((flags < 0) || (fcntl (fd, F_SETFL, flags | O_NONBLOCK) != 0))
+	{
+		char errbuf[1024];
+		ERROR ("unixsock plugin: fcntl (%i, O_NONBLOCK) failed: %s", fd,
+				sstrerror (errno, errbuf, sizeof (errbuf)));
+		return (-1);
+	}
+
+	return (0);
+} /* int us_set_nonblocking */
+
+/* Closes the connection and frees the client. While a job of the client is
+ * running, only the connection is closed; the job frees the client once it
+ * is done. */
+static void us_client_destroy (int epfd, us_client_t *client)
+{
+	if (client->fd >= 0)
+	{
+		epoll_ctl (epfd, EPOLL_CTL_DEL, client->fd, NULL);
+		close (client->fd);
+		client->fd = -1;
 
-		fields_num = strsplit (buffer_copy, fields,
-				sizeof (fields) / sizeof (fields[0]));
-		if (fields_num < 1)
+		if (client->prev != NULL)
+			client->prev->next = client->next;
+		else
+			clients = client->next;
+		if (client->next != NULL)
+			client->next->prev = client->prev;
+		client->prev = NULL;
+		client->next = NULL;
+	}
+
+	if (client->job != NULL)
+		return;
+
+	sfree (client->input);
+	sfree (client->output);
+	sfree (client);
+} /* void us_client_destroy */
+
+static void us_client_accept (int epfd)
+{
+	while (42)
+	{
+		us_client_t *client;
+		struct epoll_event ev;
+		int fd;
+
+		fd = accept (sock_fd, NULL, NULL);
+		if (fd < 0)
 		{
-			fprintf (fhout, "-1 Internal error\n");
-			fclose (fhin);
-			fclose (fhout);
-			pthread_exit ((void *) 1);
-			return ((void *) 1);
+			char errbuf[1024];
+
+			if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+				return;
+			if (errno == EINTR)
+				continue;
+
+			ERROR ("unixsock plugin: accept failed: %s",
+					sstrerror (errno, errbuf, sizeof (errbuf)));
+			return;
 		}
 
-		if (strcasecmp (fields[0], "getval") == 0)
+		if (us_set_nonblocking (fd) != 0)
 		{
-			handle_getval (fhout, buffer);
+			close (fd);
+			continue;
 		}
-		else if (strcasecmp (fields[0], "getthreshold") == 0)
+
+		client = calloc (1, sizeof (*client));
+		if (client != NULL)
+			client->input = malloc (US_INPUT_SIZE);
+		if ((client == NULL) || (client->input == NULL))
 		{
-			handle_getthreshold (fhout, buffer);
+			ERROR ("unixsock plugin: malloc failed.");
+			sfree (client);
+			close (fd);
+			continue;
 		}
-		else if (strcasecmp (fields[0], "putval") == 0)
+		client->fd = fd;
+		client->events = EPOLLIN;
+
+		memset (&ev, 0, sizeof (ev));
+		ev.events = client->events;
+		ev.data.ptr = client;
+		if (epoll_ctl (epfd, EPOLL_CTL_ADD, fd, &ev) != 0)
 		{
-			handle_putval (fhout, buffer);
+			char errbuf[1024];
+			ERROR ("unixsock plugin: epoll_ctl failed: %s",
+					sstrerror (errno, errbuf, sizeof (errbuf)));
+			sfree (client->input);
+			sfree (client);
+			close (fd);
+			continue;
 		}
-		else if (strcasecmp (fields[0], "listval") == 0)
+
+		client->next = clients;
+		if (clients != NULL)
+			clients->prev = client;
+		clients = client;
+
+		DEBUG ("unixsock plugin: Accepted client on fd #%i", fd);
+	}
+} /* void us_client_accept */
+
+/* Appends "output" to the client's output buffer. Takes ownership of
+ * "output". */
+static int us_client_append (us_client_t *client,
+		char *output, size_t output_size)
+{
+	if (output_size == 0)
+	{
+		sfree (output);
+		return (0);
+	}
+
+	if (client->output_fill == 0)
+	{
+		/* Take over the buffer instead of copying it. */
+		sfree (client->output);
+		client->output = output;
+		client->output_fill = output_size;
+		client->output_size = output_size;
+		return (0);
+	}
+
+	if (client->output_size - client->output_fill < output_size)
+	{
+		char *tmp = realloc (client->output, client->output_fill + output_size);
+		if (tmp == NULL)
+		{
+			ERROR ("unixsock plugin: realloc failed.");
+			sfree (output);
+			return (-1);
+		}
+		client->output = tmp;
+		client->output_size = client->output_fill + output_size;
+	}
+	memcpy (client->output + client->output_fill, output, output_size);
+	client->output_fill += output_size;
+	sfree (output);
+
+	return (0);
+} /* int us_client_append */
+
+static _Bool us_command_is_putval (const char *line)
+{
+	while (isspace ((int) *line))
+		line++;
+
+	return ((strncasecmp ("PUTVAL", line, strlen ("PUTVAL")) == 0)
+			&& ((line[6] == 0) || isspace ((int) line[6])));
+} /* _Bool us_command_is_putval */
+
+/* Queues "line" for the worker thread. */
+static int us_job_submit (us_client_t *client, const char *line)
+{
+	us_job_t *job;
+
+	job = calloc (1, sizeof (*job));
+	if (job == NULL)
+		return (-1);
+	job->command = strdup (line);
+	if (job->command == NULL)
+	{
+		sfree (job);
+		return (-1);
+	}
+	job->client = client;
+	client->job = job;
+
+	pthread_mutex_lock (&worker_lock);
+	if (jobs_queue_tail == NULL)
+		jobs_queue_head = job;
+	else
+		jobs_queue_tail->next = job;
+	jobs_queue_tail = job;
+	pthread_cond_signal (&worker_cond);
+	pthread_mutex_unlock (&worker_lock);
+
+	return (0);
+} /* int us_job_submit */
+
+static void us_job_free (us_job_t *job)
+{
+	sfree (job->command);
+	sfree (job->output);
+	sfree (job);
+} /* void us_job_free */
+
+static void *us_worker_thread (void __attribute__((unused)) *arg)
+{
+	pthread_mutex_lock (&worker_lock);
+	while (42)
+	{
+		us_job_t *job;
+		FILE *fh;
+
+		while (worker_loop && (jobs_queue_head == NULL))
+			pthread_cond_wait (&worker_cond, &worker_lock);
+		if (!worker_loop)
+			break;
+
+		job = jobs_queue_head;
+		jobs_queue_head = job->next;
+		if (jobs_queue_head == NULL)
+			jobs_queue_tail = NULL;
+		job->next = NULL;
+		pthread_mutex_unlock (&worker_lock);
+
+		fh = open_memstream (&job->output, &job->output_size);
+		if (fh == NULL)
 		{
-			handle_listval (fhout, buffer);
+			char errbuf[1024];
+			ERROR ("unixsock plugin: open_memstream failed: %s",
+					sstrerror (errno, errbuf, sizeof (errbuf)));
+			job->close = 1;
 		}
-		else if (strcasecmp (fields[0], "putnotif") == 0)
+		else
 		{
-			handle_putnotif (fhout, buffer);
+			if (us_handle_command (fh, job->command) != 0)
+				job->close = 1;
+			fclose (fh);
 		}
-		else if (strcasecmp (fields[0], "flush") == 0)
+
+		pthread_mutex_lock (&worker_lock);
+		job->next = jobs_done;
+		jobs_done = job;
+		if (write (worker_wake_fd[1], "x", 1) < 0)
 		{
-			handle_flush (fhout, buffer);
+			/* The pipe is full, so the event loop will wake up anyway. */
 		}
-		else
+	}
+	pthread_mutex_unlock (&worker_lock);
+
+	return ((void *) 0);
+} /* void *us_worker_thread */
+
+static int us_worker_start (int epfd)
+{
+	struct epoll_event ev;
+	int status;
+
+	if (pipe (worker_wake_fd) != 0)
+	{
+		char errbuf[1024];
+		ERROR ("unixsock plugin: pipe failed: %s",
+				sstrerror (errno, errbuf, sizeof (errbuf)));
+		return (-1);
+	}
+
+	memset (&ev, 0, sizeof (ev));
+	ev.events = EPOLLIN;
+	ev.data.ptr = worker_wake_fd;
+	if ((us_set_nonblocking (worker_wake_fd[0]) != 0)
+			|| (us_set_nonblocking (worker_wake_fd[1]) != 0)
+			|| (epoll_ctl (epfd, EPOLL_CTL_ADD, worker_wake_fd[0], &ev) != 0))
+		return (-1);
+
+	worker_loop = 1;
+	status = plugin_thread_create (&worker_thread, NULL,
+			us_worker_thread, NULL);
+	if (status != 0)
+	{
+		char errbuf[1024];
+		ERROR ("unixsock plugin: pthread_create failed: %s",
+				sstrerror (status, errbuf, sizeof (errbuf)));
+		return (-1);
+	}
+	worker_started = 1;
+
+	return (0);
+} /* int us_worker_start */
+
+/* Stops the worker thread and frees all jobs, and the clients which have been
+ * destroyed while their job was running. */
+static void us_worker_stop (void)
+{
+	us_job_t *jobs[2];
+	size_t i;
+
+	pthread_mutex_lock (&worker_lock);
+	worker_loop = 0;
+	pthread_cond_broadcast (&worker_cond);
+	pthread_mutex_unlock (&worker_lock);
+
+	if (worker_started)
+	{
+		pthread_join (worker_thread, NULL);
+		worker_started = 0;
+	}
+
+	jobs[0] = jobs_queue_head;
+	jobs[1] = jobs_done;
+	jobs_queue_head = jobs_queue_tail = jobs_done = NULL;
+	for (i = 0; i < STATIC_ARRAY_SIZE (jobs); i++)
+	{
+		while (jobs[i] != NULL)
 		{
-			if (fprintf (fhout, "-1 Unknown command: %s\n", fields[0]) < 0)
+			us_job_t *job = jobs[i];
+			jobs[i] = job->next;
+
+			job->client->job = NULL;
+			if (job->client->fd < 0)
+				us_client_destroy (-1, job->client);
+			us_job_free (job);
+		}
+	}
+
+	for (i = 0; i < STATIC_ARRAY_SIZE (worker_wake_fd); i++)
+	{
+		if (worker_wake_fd[i] >= 0)
+			close (worker_wake_fd[i]);
+		worker_wake_fd[i] = -1;
+	}
+} /* void us_worker_stop */
+
+/* Handles all complete commands in the client's input buffer and appends the
+ * responses to its output buffer. Stops at the first command handed to the
+ * worker thread. */
+static int us_client_process (us_client_t *client)
+{
+	FILE *fh;
+	char *output = NULL;
+	size_t output_size = 0;
+	size_t offset = 0;
+
+	fh = open_memstream (&output, &output_size);
+	if (fh == NULL)
+	{
+		char errbuf[1024];
+		ERROR ("unixsock plugin: open_memstream failed: %s",
+				sstrerror (errno, errbuf, sizeof (errbuf)));
+		return (-1);
+	}
+
+	while ((offset < client->input_fill) && (client->job == NULL))
+	{
+		char *begin = client->input + offset;
+		size_t avail = client->input_fill - offset;
+		char *end;
+		size_t len;
+
+		if (begin[0] == PUTVAL_BINARY_MAGIC)
+		{
+			int payload_size;
+
+			if (avail < PUTVAL_BINARY_HEADER_SIZE)
+				break;
+
+			payload_size = us_binary_payload_size (fh,
+					(unsigned char *) begin);
+			if (payload_size < 0)
 			{
-				char errbuf[1024];
-				WARNING ("unixsock plugin: failed to write to socket #%i: %s",
-						fileno (fhout),
-						sstrerror (errno, errbuf, sizeof (errbuf)));
+				client->closing = 1;
 				break;
 			}
+
+			if (avail < PUTVAL_BINARY_HEADER_SIZE + (size_t) payload_size)
+				break;
+
+			handle_putval_binary (fh, begin + PUTVAL_BINARY_HEADER_SIZE,
+					(size_t) payload_size);
+			offset += PUTVAL_BINARY_HEADER_SIZE + (size_t) payload_size;
+			continue;
 		}
-	} /* while (fgets) */
 
-	DEBUG ("unixsock plugin: us_handle_client: Exiting..");
-	fclose (fhin);
-	fclose (fhout);
+		end = memchr (begin, '\n', avail);
+		if (end == NULL)
+		{
+			if (avail >= US_LINE_MAX)
+			{
+				fprintf (fh, "-1 Line too long.\n");
+				client->closing = 1;
+				break;
+			}
+			/* Wait for the rest of the line. */
+			break;
+		}
+		*end = 0;
+		offset += (size_t) (end - begin) + 1;
+
+		len = (size_t) (end - begin);
+		while ((len > 0) && (begin[len - 1] == '\r'))
+			begin[--len] = 0;
+
+		if (len == 0)
+			continue;
+
+		/* Processing continues once the response is back. If the job can't
+		 * be queued, the command is handled right here. */
+		if (!us_command_is_putval (begin)
+				&& (us_job_submit (client, begin) == 0))
+			break;
+
+		if (us_handle_command (fh, begin) != 0)
+		{
+			client->closing = 1;
+			break;
+		}
+	} /* while (offset < client->input_fill) */
+
+	if (client->closing)
+		client->input_fill = 0;
+	else if (offset > 0)
+	{
+		memmove (client->input, client->input + offset,
+				client->input_fill - offset);
+		client->input_fill -= offset;
+	}
+
+	fclose (fh);
+	return (us_client_append (client, output, output_size));
+} /* int us_client_process */
+
+static int us_client_read (us_client_t *client)
+{
+	ssize_t status;
+
+	status = read (client->fd, client->input + client->input_fill,
+			US_INPUT_SIZE - 1 - client->input_fill);
+	if (status < 0)
+	{
+		char errbuf[1024];
+
+		if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR))
+			return (0);
+
+		WARNING ("unixsock plugin: failed to read from socket #%i: %s",
+				client->fd, sstrerror (errno, errbuf, sizeof (errbuf)));
+		return (-1);
+	}
+	else if (status == 0)
+	{
+		/* Like fgets(3), handle a last line without a newline. */
+		if ((client->input_fill > 0)
+				&& (client->input[0] != PUTVAL_BINARY_MAGIC))
+			client->input[client->input_fill++] = '\n';
+		client->closing = 1;
+		return (us_client_process (client));
+	}
+
+	client->input_fill += (size_t) status;
+	return (us_client_process (client));
+} /* int us_client_read */
+
+static int us_client_write (us_client_t *client)
+{
+	size_t offset = 0;
+
+	while (offset < client->output_fill)
+	{
+		ssize_t status;
+
+		status = send (client->fd, client->output + offset,
+				client->output_fill - offset, MSG_NOSIGNAL);
+		if (status < 0)
+		{
+			char errbuf[1024];
+
+			if (errno == EINTR)
+				continue;
+			if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+				break;
+
+			WARNING ("unixsock plugin: failed to write to socket #%i: %s",
+					client->fd, sstrerror (errno, errbuf, sizeof (errbuf)));
+			return (-1);
+		}
+		offset += (size_t) status;
+	}
+
+	memmove (client->output, client->output + offset,
+			client->output_fill - offset);
+	client->output_fill -= offset;
+
+	return (0);
+} /* int us_client_write */
+
+/* Reads from the client only while its pending output is below the limit, so
+ * that clients which don't read their responses can't exhaust memory. */
+static int us_client_update (int epfd, us_client_t *client)
+{
+	struct epoll_event ev;
+	uint32_t events = 0;
+
+	if (client->closing && (client->output_fill == 0) && (client->job == NULL))
+		return (-1);
+
+	if (!client->closing && (client->job == NULL)
+			&& (client->output_fill < US_OUTPUT_MAX))
+		events |= EPOLLIN;
+	if (client->output_fill > 0)
+		events |= EPOLLOUT;
+
+	if (events == client->events)
+		return (0);
+
+	memset (&ev, 0, sizeof (ev));
+	ev.events = events;
+	ev.data.ptr = client;
+	if (epoll_ctl (epfd, EPOLL_CTL_MOD, client->fd, &ev) != 0)
+	{
+		char errbuf[1024];
+		ERROR ("unixsock plugin: epoll_ctl failed: %s",
+				sstrerror (errno, errbuf, sizeof (errbuf)));
+		return (-1);
+	}
+	client->events = events;
+
+	return (0);
+} /* int us_client_update */
+
+/* Handles the events of a client: reads and processes commands and writes
+ * pending responses. */
+static void us_client_handle (int epfd, us_client_t *client, uint32_t events)
+{
+	int status = 0;
+
+	/* The connection has been closed while a job is running. */
+	if ((client->job != NULL) && (events & (EPOLLHUP | EPOLLERR)))
+	{
+		us_client_destroy (epfd, client);
+		return;
+	}
+
+	if ((events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+			&& (client->events & EPOLLIN))
+		status = us_client_read (client);
+
+	if ((status == 0) && (client->output_fill > 0))
+		status = us_client_write (client);
+
+	if (status == 0)
+		status = us_client_update (epfd, client);
+
+	if (status != 0)
+		us_client_destroy (epfd, client);
+} /* void us_client_handle */
+
+/* Hands the responses of finished jobs to their clients and continues
+ * processing their input. */
+static void us_jobs_finish (int epfd)
+{
+	us_job_t *job;
+	char buffer[64];
+
+	while (read (worker_wake_fd[0], buffer, sizeof (buffer)) > 0)
+		/* drain */;
+
+	pthread_mutex_lock (&worker_lock);
+	job = jobs_done;
+	jobs_done = NULL;
+	pthread_mutex_unlock (&worker_lock);
+
+	while (job != NULL)
+	{
+		us_job_t *next = job->next;
+		us_client_t *client = job->client;
+		int status;
+
+		client->job = NULL;
+		if (client->fd < 0)
+		{
+			us_client_destroy (epfd, client);
+			us_job_free (job);
+			job = next;
+			continue;
+		}
+
+		if (job->close)
+		{
+			client->closing = 1;
+			client->input_fill = 0;
+		}
+		status = us_client_append (client, job->output, job->output_size);
+		job->output = NULL;
+		us_job_free (job);
+
+		if (status == 0)
+			status = us_client_process (client);
+		if (status == 0)
+			us_client_handle (epfd, client, /* events = */ 0);
+		else
+			us_client_destroy (epfd, client);
+
+		job = next;
+	}
+} /* void us_jobs_finish */
+
+static void *us_event_thread (void __attribute__((unused)) *arg)
+{
+	struct epoll_event ev;
+	int epfd;
+
+	if (us_open_socket () != 0)
+		pthread_exit ((void *) 1);
+
+	epfd = epoll_create1 (EPOLL_CLOEXEC);
+	if (epfd < 0)
+	{
+		char errbuf[1024];
+		ERROR ("unixsock plugin: epoll_create1 failed: %s",
+				sstrerror (errno, errbuf, sizeof (errbuf)));
+		us_close_socket ();
+		pthread_exit ((void *) 1);
+	}
+
+	memset (&ev, 0, sizeof (ev));
+	ev.events = EPOLLIN;
+	ev.data.ptr = NULL;
+	if ((us_set_nonblocking (sock_fd) != 0)
+			|| (epoll_ctl (epfd, EPOLL_CTL_ADD, sock_fd, &ev) != 0))
+	{
+		ERROR ("unixsock plugin: Adding the socket to the event loop failed.");
+		close (epfd);
+		us_close_socket ();
+		pthread_exit ((void *) 1);
+	}
+
+	if (us_worker_start (epfd) != 0)
+	{
+		ERROR ("unixsock plugin: Starting the worker thread failed.");
+		us_worker_stop ();
+		close (epfd);
+		us_close_socket ();
+		pthread_exit ((void *) 1);
+	}
+
+	while (loop != 0)
+	{
+		struct epoll_event events[64];
+		int events_num;
+		int i;
+
+		events_num = epoll_wait (epfd, events, STATIC_ARRAY_SIZE (events), -1);
+		if (events_num < 0)
+		{
+			char errbuf[1024];
+
+			if (errno == EINTR)
+				continue;
+
+			ERROR ("unixsock plugin: epoll_wait failed: %s",
+					sstrerror (errno, errbuf, sizeof (errbuf)));
+			break;
+		}
+
+		for (i = 0; i < events_num; i++)
+		{
+			if (events[i].data.ptr == NULL)
+				us_client_accept (epfd);
+			else if (events[i].data.ptr == (void *) worker_wake_fd)
+				us_jobs_finish (epfd);
+			else
+				us_client_handle (epfd, events[i].data.ptr, events[i].events);
+		}
+	} /* while (loop) */
+
+	us_worker_stop ();
+	while (clients != NULL)
+		us_client_destroy (epfd, clients);
+
+	close (epfd);
+	us_close_socket ();
 
-	pthread_exit ((void *) 0);
 	return ((void *) 0);
-} /* void *us_handle_client */
+} /* void *us_event_thread */
+#endif /* KERNEL_LINUX */
 
 static void *us_server_thread (void __attribute__((unused)) *arg)
 {
@@ -394,18 +1249,8 @@ static void *us_server_thread (void __attribute__((unused)) *arg)
 		}
 	} /* while (loop) */
 
-	close (sock_fd);
-	sock_fd = -1;
 	pthread_attr_destroy (&th_attr);
-
-	status = unlink ((sock_file != NULL) ? sock_file : US_DEFAULT_PATH);
-	if (status != 0)
-	{
-		char errbuf[1024];
-		NOTICE ("unixsock plugin: unlink (%s) failed: %s",
-				(sock_file != NULL) ? sock_file : US_DEFAULT_PATH,
-				sstrerror (errno, errbuf, sizeof (errbuf)));
-	}
+	us_close_socket ();
 
 	return ((void *) 0);
 } /* void *us_server_thread */
@@ -441,6 +1286,18 @@ static int us_config (const char *key, const char *val)
 		else
 			delete_socket = 0;
 	}
+	else if (strcasecmp (key, "EventLoop") == 0)
+	{
+#if KERNEL_LINUX
+		if (IS_TRUE (val))
+			event_loop = 1;
+		else
+			event_loop = 0;
+#else
+		WARNING ("unixsock plugin: The \"EventLoop\" option is only "
+				"supported on Linux.");
+#endif
+	}
 	else
 	{
 		return (-1);
@@ -462,8 +1319,14 @@ static int us_init (void)
 
 	loop = 1;
 
-	status = plugin_thread_create (&listen_thread, NULL,
-			us_server_thread, NULL);
+#if KERNEL_LINUX
+	if (event_loop)
+		status = plugin_thread_create (&listen_thread, NULL,
+				us_event_thread, NULL);
+	else
+#endif
+		status = plugin_thread_create (&listen_thread, NULL,
+				us_server_thread, NULL);
 	if (status != 0)
 	{
 		char errbuf[1024];
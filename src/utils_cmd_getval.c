@@ -43,6 +43,157 @@
     fflush(fh); \
   } while (0)
 
+struct getval_result_s
+{
+  char *identifier;
+  const data_set_t *ds;
+  gauge_t *values;
+  size_t values_num;
+};
+typedef struct getval_result_s getval_result_t;
+
+static void getval_results_free (getval_result_t *results, /* {{{ */
+    size_t results_num)
+{
+  size_t i;
+
+  for (i = 0; i < results_num; i++)
+    sfree (results[i].values);
+  sfree (results);
+} /* }}} void getval_results_free */
+
+/* GETVAL <Identifier> <Identifier> [...]
+ *
+ * Returns one line per data source, prefixed with the identifier. "first" is
+ * the first identifier, "buffer" holds the remaining ones. */
+static int handle_getval_multi (FILE *fh, char *first, /* {{{ */
+    char *buffer)
+{
+  getval_result_t *results = NULL;
+  size_t results_num = 0;
+  size_t lines_num = 0;
+  char *identifier = first;
+  int status;
+  size_t i;
+
+  /* Look up all identifiers before printing anything, so the number of lines
+   * is known and errors can be reported. */
+  while (identifier != NULL)
+  {
+    getval_result_t *tmp;
+    getval_result_t *r;
+    char *identifier_copy;
+    char *hostname;
+    char *plugin;
+    char *plugin_instance;
+    char *type;
+    char *type_instance;
+
+    /* parse_identifier() modifies its first argument,
+     * returning pointers into it */
+    identifier_copy = sstrdup (identifier);
+    status = parse_identifier (identifier_copy, &hostname,
+        &plugin, &plugin_instance,
+        &type, &type_instance);
+    if (status != 0)
+    {
+      sfree (identifier_copy);
+      getval_results_free (results, results_num);
+      print_to_socket (fh, "-1 Cannot parse identifier `%s'.\n", identifier);
+      return (-1);
+    }
+
+    tmp = realloc (results, (results_num + 1) * sizeof (*results));
+    if (tmp == NULL)
+    {
+      sfree (identifier_copy);
+      getval_results_free (results, results_num);
+      print_to_socket (fh, "-1 realloc failed.\n");
+      return (-1);
+    }
+    results = tmp;
+    r = results + results_num;
+    memset (r, 0, sizeof (*r));
+
+    /* "identifier" points into the command buffer, which stays valid. */
+    r->identifier = identifier;
+    r->ds = plugin_get_ds (type);
+    if (r->ds == NULL)
+    {
+      getval_results_free (results, results_num);
+      print_to_socket (fh, "-1 Type `%s' is unknown.\n", type);
+      sfree (identifier_copy);
+      return (-1);
+    }
+    sfree (identifier_copy);
+
+    status = uc_get_rate_by_name (identifier, &r->values, &r->values_num);
+    if (status != 0)
+    {
+      getval_results_free (results, results_num);
+      print_to_socket (fh, "-1 No such value: %s\n", identifier);
+      return (-1);
+    }
+    results_num++;
+
+    if (r->ds->ds_num != r->values_num)
+    {
+      ERROR ("ds[%s]->ds_num = %zu, "
+          "but uc_get_rate_by_name returned %zu values.",
+          r->ds->type, r->ds->ds_num, r->values_num);
+      getval_results_free (results, results_num);
+      print_to_socket (fh, "-1 Error reading value from cache.\n");
+      return (-1);
+    }
+    lines_num += r->values_num;
+
+    identifier = NULL;
+    if (*buffer == 0)
+      break;
+
+    status = parse_string (&buffer, &identifier);
+    if (status != 0)
+    {
+      getval_results_free (results, results_num);
+      print_to_socket (fh, "-1 Cannot parse identifier.\n");
+      return (-1);
+    }
+  } /* while (identifier != NULL) */
+
+  print_to_socket (fh, "%zu Value%s found\n", lines_num,
+      (lines_num == 1) ? "" : "s");
+
+  for (i = 0; i < results_num; i++)
+  {
+    getval_result_t *r = results + i;
+    size_t j;
+
+    for (j = 0; j < r->values_num; j++)
+    {
+      int len;
+
+      if (isnan (r->values[j]))
+        len = fprintf (fh, "%s %s=NaN\n", r->identifier, r->ds->ds[j].name);
+      else
+        len = fprintf (fh, "%s %s=%12e\n", r->identifier, r->ds->ds[j].name,
+            r->values[j]);
+
+      if (len < 0)
+      {
+        char errbuf[1024];
+        WARNING ("handle_getval: failed to write to socket #%i: %s",
+            fileno (fh), sstrerror (errno, errbuf, sizeof (errbuf)));
+        getval_results_free (results, results_num);
+        return (-1);
+      }
+    }
+  }
+  fflush (fh);
+
+  getval_results_free (results, results_num);
+  return (0);
+} /* }}} int handle_getval_multi */
+
 int handle_getval (FILE *fh, char *buffer)
 {
   char *command;
@@ -93,10 +244,7 @@ int handle_getval (FILE *fh, char *buffer)
   assert (identifier != NULL);
 
   if (*buffer != 0)
-  {
-    print_to_socket (fh, "-1 Garbage after end of command: %s\n", buffer);
-    return (-1);
-  }
+    return (handle_getval_multi (fh, identifier, buffer));
 
   /* parse_identifier() modifies its first argument,
    * returning pointers into it */
@@ -164,4 +312,239 @@ int handle_getval (FILE *fh, char *buffer)
   return (0);
 } /* int handle_getval */
 
+struct gethistory_request_s
+{
+  char *identifier;
+  /* Number of steps announced in the status line. */
+  size_t steps_num;
+  size_t values_num;
+};
+typedef struct gethistory_request_s gethistory_request_t;
+
+static int gethistory_print_step (FILE *fh, /* {{{ */
+    char const *identifier, cdtime_t t,
+    gauge_t const *values, size_t values_num)
+{
+  size_t i;
+  int status;
+
+  /* Written to "fh" piece by piece: neither the identifier nor the number of
+   * values is bounded by a line buffer. */
+  status = fprintf (fh, "%s %.3f", identifier, CDTIME_T_TO_DOUBLE (t));
+  for (i = 0; (i < values_num) && (status >= 0); i++)
+  {
+    if ((values == NULL) || isnan (values[i]))
+      status = fputs (":NaN", fh);
+    else
+      status = fprintf (fh, ":"GAUGE_FORMAT, values[i]);
+  }
+  if (status >= 0)
+    status = fputs ("\n", fh);
+
+  if (status < 0)
+  {
+    char errbuf[1024];
+    WARNING ("handle_gethistory: failed to write to socket #%i: %s",
+        fileno (fh), sstrerror (errno, errbuf, sizeof (errbuf)));
+    return (-1);
+  }
+
+  return (0);
+} /* }}} int gethistory_print_step */
+
+/* Prints the steps counted for "r", oldest first. Only the history of one
+ * identifier is held in memory at a time. */
+static int gethistory_print (FILE *fh, /* {{{ */
+    gethistory_request_t const *r)
+{
+  cdtime_t *times = NULL;
+  gauge_t *history = NULL;
+  size_t steps_num = 0;
+  size_t values_num = 0;
+  size_t i;
+  int status = 0;
+
+  if (r->steps_num == 0)
+    return (0);
+
+  /* More steps may have been recorded since they were counted; the newest
+   * ones are returned. If the value has been removed from the cache or its
+   * history has been reset in the meantime, fewer steps are returned. */
+  if (uc_get_history_range_by_name (r->identifier, r->steps_num,
+        &times, &history, &steps_num, &values_num) != 0)
+    steps_num = 0;
+  if ((steps_num > r->steps_num) || (values_num != r->values_num))
+    steps_num = 0;
+
+  /* Keep the number of lines announced in the status line: report the
+   * missing, i.e. oldest, steps with time zero and undefined values. */
+  for (i = steps_num; (i < r->steps_num) && (status == 0); i++)
+    status = gethistory_print_step (fh, r->identifier, 0, NULL,
+        r->values_num);
+
+  for (i = steps_num; (i > 0) && (status == 0); i--)
+    status = gethistory_print_step (fh, r->identifier, times[i - 1],
+        history + ((i - 1) * values_num), values_num);
+
+  sfree (times);
+  sfree (history);
+  return (status);
+} /* }}} int gethistory_print */
+
+/* GETHISTORY [steps=<N>] <Identifier> [[steps=<N>] <Identifier> ...] */
+int handle_gethistory (FILE *fh, char *buffer) /* {{{ */
+{
+  char *command;
+  gethistory_request_t *requests = NULL;
+  size_t requests_num = 0;
+  size_t steps = 0;
+  size_t lines_num = 0;
+  int status;
+  size_t i;
+
+  if ((fh == NULL) || (buffer == NULL))
+    return (-1);
+
+  DEBUG ("utils_cmd_getval: handle_gethistory (fh = %p, buffer = %s);",
+      (void *) fh, buffer);
+
+  command = NULL;
+  status = parse_string (&buffer, &command);
+  if (status != 0)
+  {
+    print_to_socket (fh, "-1 Cannot parse command.\n");
+    return (-1);
+  }
+  assert (command != NULL);
+
+  if (strcasecmp ("GETHISTORY", command) != 0)
+  {
+    print_to_socket (fh, "-1 Unexpected command: `%s'.\n", command);
+    return (-1);
+  }
+
+  /* Count the steps of all identifiers before printing anything, so the
+   * number of lines is known and errors can be reported. The history itself
+   * is copied one identifier at a time while printing. */
+  while (*buffer != 0)
+  {
+    gethistory_request_t *tmp;
+    gethistory_request_t *r;
+    char *identifier_copy;
+    char *hostname;
+    char *plugin;
+    char *plugin_instance;
+    char *type;
+    char *type_instance;
+    char *key = NULL;
+    char *value = NULL;
+
+    status = parse_option (&buffer, &key, &value);
+    if (status < 0)
+    {
+      sfree (requests);
+      print_to_socket (fh, "-1 Misformatted option.\n");
+      return (-1);
+    }
+    else if (status == 0)
+    {
+      char *endptr = NULL;
+      unsigned long tmp_steps;
+
+      if (strcasecmp ("steps", key) != 0)
+      {
+        sfree (requests);
+        print_to_socket (fh, "-1 Unknown option: %s\n", key);
+        return (-1);
+      }
+
+      errno = 0;
+      tmp_steps = strtoul (value, &endptr, 10);
+      if ((errno != 0) || (endptr == value) || (*endptr != 0))
+      {
+        sfree (requests);
+        print_to_socket (fh, "-1 Invalid number of steps: %s\n", value);
+        return (-1);
+      }
+      /* applies to the identifiers following the option */
+      steps = (size_t) tmp_steps;
+      continue;
+    }
+
+    key = NULL;
+    status = parse_string (&buffer, &key);
+    if (status != 0)
+    {
+      sfree (requests);
+      print_to_socket (fh, "-1 Cannot parse identifier.\n");
+      return (-1);
+    }
+    assert (key != NULL);
+
+    /* parse_identifier() modifies its first argument,
+     * returning pointers into it */
+    identifier_copy = sstrdup (key);
+    status = parse_identifier (identifier_copy, &hostname,
+        &plugin, &plugin_instance,
+        &type, &type_instance);
+    if (status != 0)
+    {
+      sfree (identifier_copy);
+      sfree (requests);
+      print_to_socket (fh, "-1 Cannot parse identifier `%s'.\n", key);
+      return (-1);
+    }
+    sfree (identifier_copy);
+
+    tmp = realloc (requests, (requests_num + 1) * sizeof (*requests));
+    if (tmp == NULL)
+    {
+      sfree (requests);
+      print_to_socket (fh, "-1 realloc failed.\n");
+      return (-1);
+    }
+    requests = tmp;
+    r = requests + requests_num;
+    memset (r, 0, sizeof (*r));
+
+    /* "key" points into the command buffer, which stays valid. */
+    r->identifier = key;
+    status = uc_get_history_range_by_name (key, steps,
+        /* ret_times = */ NULL, /* ret_history = */ NULL,
+        &r->steps_num, &r->values_num);
+    if (status != 0)
+    {
+      sfree (requests);
+      print_to_socket (fh, "-1 No such value: %s\n", key);
+      return (-1);
+    }
+
+    requests_num++;
+    lines_num += r->steps_num;
+  } /* while (*buffer != 0) */
+
+  if (requests_num == 0)
+  {
+    print_to_socket (fh, "-1 No identifier given.\n");
+    return (-1);
+  }
+
+  print_to_socket (fh, "%zu Value%s found\n", lines_num,
+      (lines_num == 1) ? "" : "s");
+
+  for (i = 0; i < requests_num; i++)
+  {
+    status = gethistory_print (fh, requests + i);
+    if (status != 0)
+    {
+      sfree (requests);
+      return (-1);
+    }
+  }
+  fflush (fh);
+
+  sfree (requests);
+  return (0);
+} /* }}} int handle_gethistory */
+
 /* vim: set sw=2 sts=2 ts=8 : */
@@ -32,16 +32,7 @@
 #include "utils_cache.h"
 #include "utils_parse_option.h"
 
-#define free_everything_and_return(status) do { \
-    size_t j; \
-    for (j = 0; j < number; j++) { \
-      sfree(names[j]); \
-      names[j] = NULL; \
-    } \
-    sfree(names); \
-    sfree(times); \
-    return (status); \
-  } while (0)
+#include <fnmatch.h>
 
 #define print_to_socket(fh, ...) \
   do { \
@@ -49,20 +40,110 @@
       char errbuf[1024]; \
       WARNING ("handle_listval: failed to write to socket #%i: %s", \
           fileno (fh), sstrerror (errno, errbuf, sizeof (errbuf))); \
-      free_everything_and_return (-1); \
+      sfree (ls.buffer); \
+      return (-1); \
     } \
     fflush(fh); \
   } while (0)
 
+struct listval_state_s
+{
+  /* Glob patterns for the parts of the identifier, or NULL. */
+  char *host;
+  char *plugin;
+  char *type;
+  size_t limit;
+
+  /* The response lines, formatted while iterating over the cache. */
+  char *buffer;
+  size_t buffer_fill;
+  size_t buffer_size;
+  size_t number;
+  int status;
+};
+typedef struct listval_state_s listval_state_t;
+
+static _Bool listval_match (listval_state_t *ls, const char *name) /* {{{ */
+{
+  char copy[6 * DATA_MAX_NAME_LEN];
+  char *plugin;
+  char *type;
+
+  if ((ls->host == NULL) && (ls->plugin == NULL) && (ls->type == NULL))
+    return (1);
+
+  /* Host names can't contain slashes, so splitting at the first two gives
+   * "host", "plugin[-instance]" and "type[-instance]". */
+  sstrncpy (copy, name, sizeof (copy));
+  plugin = strchr (copy, '/');
+  if (plugin == NULL)
+    return (0);
+  *(plugin++) = 0;
+  type = strchr (plugin, '/');
+  if (type == NULL)
+    return (0);
+  *(type++) = 0;
+
+  if ((ls->host != NULL) && (fnmatch (ls->host, copy, 0) != 0))
+    return (0);
+  if ((ls->plugin != NULL) && (fnmatch (ls->plugin, plugin, 0) != 0))
+    return (0);
+  if ((ls->type != NULL) && (fnmatch (ls->type, type, 0) != 0))
+    return (0);
+
+  return (1);
+} /* }}} _Bool listval_match */
+
+/* Called by uc_iterate_names() with the cache lock held, so this only copies
+ * the line into a buffer. Writing to the socket happens afterwards. */
+static int listval_callback (const char *name, cdtime_t time, /* {{{ */
+    void *user_data)
+{
+  listval_state_t *ls = user_data;
+  char line[6 * DATA_MAX_NAME_LEN + 32];
+  size_t line_len;
+
+  if (!listval_match (ls, name))
+    return (0);
+
+  ssnprintf (line, sizeof (line), "%.3f %s\n", CDTIME_T_TO_DOUBLE (time), name);
+  line_len = strlen (line);
+
+  if (ls->buffer_size - ls->buffer_fill < line_len)
+  {
+    size_t new_size = (ls->buffer_size > 0) ? 2 * ls->buffer_size : 65536;
+    char *tmp;
+
+    tmp = realloc (ls->buffer, new_size);
+    if (tmp == NULL)
+    {
+      ls->status = ENOMEM;
+      return (-1);
+    }
+    ls->buffer = tmp;
+    ls->buffer_size = new_size;
+  }
+
+  memcpy (ls->buffer + ls->buffer_fill, line, line_len);
+  ls->buffer_fill += line_len;
+  ls->number++;
+
+  if ((ls->limit > 0) && (ls->number >= ls->limit))
+    return (1);
+  return (0);
+} /* }}} int listval_callback */
+
+/* LISTVAL [host=<glob>] [plugin=<glob>] [type=<glob>] [after=<identifier>]
+ *   [limit=<N>] */
 int handle_listval (FILE *fh, char *buffer)
 {
   char *command;
-  char **names = NULL;
-  cdtime_t *times = NULL;
-  size_t number = 0;
-  size_t i;
+  char *after = NULL;
+  listval_state_t ls;
   int status;
 
+  memset (&ls, 0, sizeof (ls));
+
   DEBUG ("utils_cmd_listval: handle_listval (fh = %p, buffer = %s);",
       (void *) fh, buffer);
 
@@ -71,37 +152,81 @@ int handle_listval (FILE *fh, char *buffer)
   if (status != 0)
   {
     print_to_socket (fh, "-1 Cannot parse command.\n");
-    free_everything_and_return (-1);
+    return (-1);
   }
   assert (command != NULL);
 
   if (strcasecmp ("LISTVAL", command) != 0)
   {
     print_to_socket (fh, "-1 Unexpected command: `%s'.\n", command);
-    free_everything_and_return (-1);
+    return (-1);
   }
 
-  if (*buffer != 0)
+  while (*buffer != 0)
   {
-    print_to_socket (fh, "-1 Garbage after end of command: %s\n", buffer);
-    free_everything_and_return (-1);
+    char *key = NULL;
+    char *value = NULL;
+
+    status = parse_option (&buffer, &key, &value);
+    if (status != 0)
+    {
+      print_to_socket (fh, "-1 Garbage after end of command: %s\n", buffer);
+      return (-1);
+    }
+
+    /* "key" and "value" point into the command buffer, which stays valid. */
+    if (strcasecmp ("host", key) == 0)
+      ls.host = value;
+    else if (strcasecmp ("plugin", key) == 0)
+      ls.plugin = value;
+    else if (strcasecmp ("type", key) == 0)
+      ls.type = value;
+    else if (strcasecmp ("after", key) == 0)
+      after = value;
+    else if (strcasecmp ("limit", key) == 0)
+    {
+      char *endptr = NULL;
+      unsigned long tmp;
+
+      errno = 0;
+      tmp = strtoul (value, &endptr, 10);
+      if ((errno != 0) || (endptr == value) || (*endptr != 0))
+      {
+        print_to_socket (fh, "-1 Invalid limit: %s\n", value);
+        return (-1);
+      }
+      ls.limit = (size_t) tmp;
+    }
+    else
+    {
+      print_to_socket (fh, "-1 Unknown option: %s\n", key);
+      return (-1);
+    }
   }
 
-  status = uc_get_names (&names, &times, &number);
-  if (status != 0)
+  status = uc_iterate_names (after, listval_callback, &ls);
+  if ((status < 0) || (ls.status != 0))
   {
-    DEBUG ("command listval: uc_get_names failed with status %i", status);
-    print_to_socket (fh, "-1 uc_get_names failed.\n");
-    free_everything_and_return (-1);
+    DEBUG ("command listval: uc_iterate_names failed with status %i", status);
+    print_to_socket (fh, "-1 uc_iterate_names failed.\n");
+    return (-1);
   }
 
   print_to_socket (fh, "%i Value%s found\n",
-      (int) number, (number == 1) ? "" : "s");
-  for (i = 0; i < number; i++)
-    print_to_socket (fh, "%.3f %s\n", CDTIME_T_TO_DOUBLE (times[i]),
-       	names[i]);
+      (int) ls.number, (ls.number == 1) ? "" : "s");
+  if ((ls.buffer_fill > 0)
+      && (fwrite (ls.buffer, ls.buffer_fill, 1, fh) != 1))
+  {
+    char errbuf[1024];
+    WARNING ("handle_listval: failed to write to socket #%i: %s",
+        fileno (fh), sstrerror (errno, errbuf, sizeof (errbuf)));
+    sfree (ls.buffer);
+    return (-1);
+  }
+  fflush (fh);
 
-  free_everything_and_return (0);
+  sfree (ls.buffer);
+  return (0);
 } /* int handle_listval */
 
 /* vim: set sw=2 sts=2 ts=8 : */
@@ -28,9 +28,14 @@
 #include "common.h"
 #include "plugin.h"
 
+#include "network.h"
 #include "utils_parse_option.h"
 #include "utils_cmd_putval.h"
 
+#if HAVE_ARPA_INET_H
+# include <arpa/inet.h>
+#endif
+
 #define print_to_socket(fh, ...) \
     do { \
         if (fprintf (fh, __VA_ARGS__) < 0) { \
@@ -67,50 +72,21 @@ static int set_option (value_list_t *vl, const char *key, const char *value)
 	return (0);
 } /* int parse_option */
 
-int handle_putval (FILE *fh, char *buffer)
+/* Sets the identifier of "vl" and resizes "vl->values" to the number of data
+ * sources of its type. The type's data set is returned in "ret_ds". On error,
+ * a message suitable for the client is written to "errbuf". */
+static int set_identifier (value_list_t *vl, const data_set_t **ret_ds,
+		const char *identifier, char *errbuf, size_t errbuf_size)
 {
-	char *command;
-	char *identifier;
+	char *identifier_copy;
 	char *hostname;
 	char *plugin;
 	char *plugin_instance;
 	char *type;
 	char *type_instance;
-	int   status;
-	int   values_submitted;
-
-	char *identifier_copy;
-
 	const data_set_t *ds;
-	value_list_t vl = VALUE_LIST_INIT;
-	vl.values = NULL;
-
-	DEBUG ("utils_cmd_putval: handle_putval (fh = %p, buffer = %s);",
-			(void *) fh, buffer);
-
-	command = NULL;
-	status = parse_string (&buffer, &command);
-	if (status != 0)
-	{
-		print_to_socket (fh, "-1 Cannot parse command.\n");
-		return (-1);
-	}
-	assert (command != NULL);
-
-	if (strcasecmp ("PUTVAL", command) != 0)
-	{
-		print_to_socket (fh, "-1 Unexpected command: `%s'.\n", command);
-		return (-1);
-	}
-
-	identifier = NULL;
-	status = parse_string (&buffer, &identifier);
-	if (status != 0)
-	{
-		print_to_socket (fh, "-1 Cannot parse identifier.\n");
-		return (-1);
-	}
-	assert (identifier != NULL);
+	value_t *values;
+	int status;
 
 	/* parse_identifier() modifies its first argument,
 	 * returning pointers into it */
@@ -123,74 +99,214 @@ int handle_putval (FILE *fh, char *buffer)
 	{
 		DEBUG ("handle_putval: Cannot parse identifier `%s'.",
 				identifier);
-		print_to_socket (fh, "-1 Cannot parse identifier `%s'.\n",
+		ssnprintf (errbuf, errbuf_size, "Cannot parse identifier `%s'.",
 				identifier);
 		sfree (identifier_copy);
 		return (-1);
 	}
 
-	if ((strlen (hostname) >= sizeof (vl.host))
-			|| (strlen (plugin) >= sizeof (vl.plugin))
+	if ((strlen (hostname) >= sizeof (vl->host))
+			|| (strlen (plugin) >= sizeof (vl->plugin))
 			|| ((plugin_instance != NULL)
-				&& (strlen (plugin_instance) >= sizeof (vl.plugin_instance)))
+				&& (strlen (plugin_instance) >= sizeof (vl->plugin_instance)))
 			|| ((type_instance != NULL)
-				&& (strlen (type_instance) >= sizeof (vl.type_instance))))
+				&& (strlen (type_instance) >= sizeof (vl->type_instance))))
 	{
-		print_to_socket (fh, "-1 Identifier too long.\n");
+		sstrncpy (errbuf, "Identifier too long.", errbuf_size);
 		sfree (identifier_copy);
 		return (-1);
 	}
 
-	sstrncpy (vl.host, hostname, sizeof (vl.host));
-	sstrncpy (vl.plugin, plugin, sizeof (vl.plugin));
-	sstrncpy (vl.type, type, sizeof (vl.type));
-	if (plugin_instance != NULL)
-		sstrncpy (vl.plugin_instance, plugin_instance, sizeof (vl.plugin_instance));
-	if (type_instance != NULL)
-		sstrncpy (vl.type_instance, type_instance, sizeof (vl.type_instance));
-
 	ds = plugin_get_ds (type);
 	if (ds == NULL) {
-		print_to_socket (fh, "-1 Type `%s' isn't defined.\n", type);
+		ssnprintf (errbuf, errbuf_size, "Type `%s' isn't defined.", type);
 		sfree (identifier_copy);
 		return (-1);
 	}
 
-	/* Free identifier_copy */
-	hostname = NULL;
-	plugin = NULL; plugin_instance = NULL;
-	type = NULL;   type_instance = NULL;
+	sstrncpy (vl->host, hostname, sizeof (vl->host));
+	sstrncpy (vl->plugin, plugin, sizeof (vl->plugin));
+	sstrncpy (vl->type, type, sizeof (vl->type));
+	sstrncpy (vl->plugin_instance,
+			(plugin_instance != NULL) ? plugin_instance : "",
+			sizeof (vl->plugin_instance));
+	sstrncpy (vl->type_instance,
+			(type_instance != NULL) ? type_instance : "",
+			sizeof (vl->type_instance));
 	sfree (identifier_copy);
 
-	vl.values_len = ds->ds_num;
-	vl.values = (value_t *) malloc (vl.values_len * sizeof (value_t));
-	if (vl.values == NULL)
+	/* Options given for a previous identifier don't carry over. */
+	vl->interval = 0;
+
+	if ((vl->values == NULL) || (vl->values_len != ds->ds_num))
+	{
+		values = realloc (vl->values, ds->ds_num * sizeof (*values));
+		if (values == NULL)
+		{
+			sstrncpy (errbuf, "malloc failed.", errbuf_size);
+			return (-1);
+		}
+		vl->values = values;
+		vl->values_len = ds->ds_num;
+	}
+
+	*ret_ds = ds;
+	return (0);
+} /* int set_identifier */
+
+/* Returns true if the next field in "buffer" is an identifier. Identifiers
+ * always contain a slash, options and values never do. This has to be checked
+ * before trying to parse an option, because the host name of an identifier
+ * may contain an equal sign. */
+static _Bool next_is_identifier (const char *buffer)
+{
+	while (isspace ((int) *buffer))
+		buffer++;
+
+	if (*buffer == '"')
 	{
-		print_to_socket (fh, "-1 malloc failed.\n");
+		for (buffer++; (*buffer != 0) && (*buffer != '"'); buffer++)
+		{
+			if (*buffer == '/')
+				return (1);
+			if ((*buffer == '\\') && (buffer[1] != 0))
+				buffer++;
+		}
+		return (0);
+	}
+
+	for (; (*buffer != 0) && !isspace ((int) *buffer); buffer++)
+		if (*buffer == '/')
+			return (1);
+	return (0);
+} /* _Bool next_is_identifier */
+
+/* Appends a copy of "vl" to "vls". */
+static int value_lists_append (value_list_t **vls, size_t *vls_num,
+		const value_list_t *vl)
+{
+	value_list_t *tmp;
+	value_list_t *copy;
+
+	tmp = realloc (*vls, (*vls_num + 1) * sizeof (*tmp));
+	if (tmp == NULL)
+		return (-1);
+	*vls = tmp;
+
+	copy = tmp + *vls_num;
+	memcpy (copy, vl, sizeof (*copy));
+	copy->values = malloc (vl->values_len * sizeof (*copy->values));
+	if (copy->values == NULL)
+		return (-1);
+	memcpy (copy->values, vl->values, vl->values_len * sizeof (*copy->values));
+
+	(*vls_num)++;
+	return (0);
+} /* int value_lists_append */
+
+static void value_lists_free (value_list_t *vls, size_t vls_num)
+{
+	size_t i;
+
+	for (i = 0; i < vls_num; i++)
+		sfree (vls[i].values);
+	sfree (vls);
+} /* void value_lists_free */
+
+/* The value lists of a batched line are only dispatched once the whole line
+ * has been parsed, so that an error response means nothing has been
+ * dispatched. */
+#define putval_fail(fh, ...) \
+    do { \
+        value_lists_free (vls, vls_num); \
+        print_to_socket (fh, __VA_ARGS__); \
+        sfree (vl.values); \
+        return (-1); \
+    } while (0)
+
+int handle_putval (FILE *fh, char *buffer)
+{
+	char *command;
+	char *identifier;
+	char errbuf[1024];
+	int   status;
+	size_t i;
+
+	const data_set_t *ds = NULL;
+	value_list_t vl = VALUE_LIST_INIT;
+	value_list_t *vls = NULL;
+	size_t vls_num = 0;
+	vl.values = NULL;
+
+	DEBUG ("utils_cmd_putval: handle_putval (fh = %p, buffer = %s);",
+			(void *) fh, buffer);
+
+	command = NULL;
+	status = parse_string (&buffer, &command);
+	if (status != 0)
+	{
+		print_to_socket (fh, "-1 Cannot parse command.\n");
+		return (-1);
+	}
+	assert (command != NULL);
+
+	if (strcasecmp ("PUTVAL", command) != 0)
+	{
+		print_to_socket (fh, "-1 Unexpected command: `%s'.\n", command);
+		return (-1);
+	}
+
+	identifier = NULL;
+	status = parse_string (&buffer, &identifier);
+	if (status != 0)
+	{
+		print_to_socket (fh, "-1 Cannot parse identifier.\n");
+		return (-1);
+	}
+	assert (identifier != NULL);
+
+	status = set_identifier (&vl, &ds, identifier, errbuf, sizeof (errbuf));
+	if (status != 0)
+	{
+		print_to_socket (fh, "-1 %s\n", errbuf);
 		return (-1);
 	}
 
 	/* All the remaining fields are part of the optionlist. */
-	values_submitted = 0;
 	while (*buffer != 0)
 	{
 		char *string = NULL;
 		char *value  = NULL;
 
+		/* The identifier of the next value list in a batch. Options and
+		 * values following it apply to that value list. */
+		if (next_is_identifier (buffer))
+		{
+			status = parse_string (&buffer, &string);
+			if (status != 0)
+				putval_fail (fh, "-1 Cannot parse identifier.\n");
+			assert (string != NULL);
+
+			status = set_identifier (&vl, &ds, string,
+					errbuf, sizeof (errbuf));
+			if (status != 0)
+				putval_fail (fh, "-1 %s\n", errbuf);
+			continue;
+		}
+
 		status = parse_option (&buffer, &string, &value);
 		if (status < 0)
 		{
 			/* parse_option failed, buffer has been modified.
 			 * => we need to abort */
-			print_to_socket (fh, "-1 Misformatted option.\n");
-			sfree (vl.values);
-			return (-1);
+			putval_fail (fh, "-1 Misformatted option.\n");
 		}
 		else if (status == 0)
 		{
 			assert (string != NULL);
 			assert (value != NULL);
-			set_option (&vl, string, value);
+			if (set_option (&vl, string, value) != 0)
+				putval_fail (fh, "-1 Unknown option `%s'.\n", string);
 			continue;
 		}
 		/* else: parse_option but buffer has not been modified. This is
@@ -198,34 +314,265 @@ int handle_putval (FILE *fh, char *buffer)
 
 		status = parse_string (&buffer, &string);
 		if (status != 0)
-		{
-			print_to_socket (fh, "-1 Misformatted value.\n");
-			sfree (vl.values);
-			return (-1);
-		}
+			putval_fail (fh, "-1 Misformatted value.\n");
 		assert (string != NULL);
 
 		status = parse_values (string, &vl, ds);
 		if (status != 0)
-		{
-			print_to_socket (fh, "-1 Parsing the values string failed.\n");
-			sfree (vl.values);
-			return (-1);
-		}
+			putval_fail (fh, "-1 Parsing the values string failed.\n");
 
-		plugin_dispatch_values (&vl);
-		values_submitted++;
+		if (value_lists_append (&vls, &vls_num, &vl) != 0)
+			putval_fail (fh, "-1 malloc failed.\n");
 	} /* while (*buffer != 0) */
 	/* Done parsing the options. */
 
-	print_to_socket (fh, "0 Success: %i %s been dispatched.\n",
-			values_submitted,
-			(values_submitted == 1) ? "value has" : "values have");
+	for (i = 0; i < vls_num; i++)
+		plugin_dispatch_values (vls + i);
+
+	value_lists_free (vls, vls_num);
+	print_to_socket (fh, "0 Success: %zu %s been dispatched.\n",
+			vls_num, (vls_num == 1) ? "value has" : "values have");
 
 	sfree (vl.values);
 	return (0);
 } /* int handle_putval */
 
+/* Reads a string part. Like the network plugin, strings must be
+ * null-terminated and fit into the value list's fields. */
+static int binary_read_string (const char *payload, size_t payload_size,
+		char *output, size_t output_size)
+{
+	if ((payload_size < 1) || (payload_size > output_size)
+			|| (payload[payload_size - 1] != 0))
+		return (-1);
+
+	memcpy (output, payload, payload_size);
+	return (0);
+} /* int binary_read_string */
+
+static int binary_read_number (const char *payload, size_t payload_size,
+		uint64_t *ret_value)
+{
+	uint64_t tmp;
+
+	if (payload_size != sizeof (tmp))
+		return (-1);
+
+	memcpy (&tmp, payload, sizeof (tmp));
+	*ret_value = ntohll (tmp);
+	return (0);
+} /* int binary_read_number */
+
+/* Decodes a "values" part into "vl->values", which is resized as needed. The
+ * number and types of the values have to match the data set. */
+static int binary_read_values (const char *payload, size_t payload_size,
+		value_list_t *vl, size_t *values_size,
+		char *errbuf, size_t errbuf_size)
+{
+	const data_set_t *ds;
+	const uint8_t *types;
+	uint16_t tmp16;
+	size_t num;
+	size_t i;
+
+	if (payload_size < sizeof (tmp16))
+	{
+		sstrncpy (errbuf, "Truncated values part.", errbuf_size);
+		return (-1);
+	}
+	memcpy (&tmp16, payload, sizeof (tmp16));
+	num = (size_t) ntohs (tmp16);
+	if (payload_size != sizeof (tmp16) + num * (1 + sizeof (value_t)))
+	{
+		sstrncpy (errbuf, "Length and number of values don't match.",
+				errbuf_size);
+		return (-1);
+	}
+
+	ds = plugin_get_ds (vl->type);
+	if (ds == NULL)
+	{
+		ssnprintf (errbuf, errbuf_size, "Type `%s' isn't defined.", vl->type);
+		return (-1);
+	}
+	if (ds->ds_num != num)
+	{
+		ssnprintf (errbuf, errbuf_size,
+				"Type `%s' has %zu data sources, got %zu values.",
+				vl->type, ds->ds_num, num);
+		return (-1);
+	}
+
+	if (*values_size < num)
+	{
+		value_t *tmp = realloc (vl->values, num * sizeof (*tmp));
+		if (tmp == NULL)
+		{
+			sstrncpy (errbuf, "malloc failed.", errbuf_size);
+			return (-1);
+		}
+		vl->values = tmp;
+		*values_size = num;
+	}
+
+	types = (const uint8_t *) (payload + sizeof (tmp16));
+	payload += sizeof (tmp16) + num;
+	for (i = 0; i < num; i++)
+	{
+		value_t v;
+
+		if (types[i] != ds->ds[i].type)
+		{
+			ssnprintf (errbuf, errbuf_size,
+					"Value %zu of type `%s' has the wrong data source type.",
+					i, vl->type);
+			return (-1);
+		}
+
+		/* memcpy, because the payload is not necessarily aligned. */
+		memcpy (&v, payload + i * sizeof (v), sizeof (v));
+		switch (types[i])
+		{
+			case DS_TYPE_COUNTER:
+				v.counter = (counter_t) ntohll (v.counter);
+				break;
+			case DS_TYPE_GAUGE:
+				v.gauge = (gauge_t) ntohd (v.gauge);
+				break;
+			case DS_TYPE_DERIVE:
+				v.derive = (derive_t) ntohll (v.derive);
+				break;
+			case DS_TYPE_ABSOLUTE:
+				v.absolute = (absolute_t) ntohll (v.absolute);
+				break;
+		}
+		vl->values[i] = v;
+	}
+	vl->values_len = num;
+
+	return (0);
+} /* int binary_read_values */
+
+int handle_putval_binary (FILE *fh, const char *buffer, size_t buffer_size)
+{
+	char errbuf[1024];
+	size_t values_size = 0;
+	int status = 0;
+	size_t i;
+
+	value_list_t vl = VALUE_LIST_INIT;
+	value_list_t *vls = NULL;
+	size_t vls_num = 0;
+	vl.values = NULL;
+
+	DEBUG ("utils_cmd_putval: handle_putval_binary (fh = %p, "
+			"buffer_size = %zu);", (void *) fh, buffer_size);
+
+	while ((status == 0) && (buffer_size > 0))
+	{
+		const char *payload;
+		size_t payload_size;
+		uint16_t part_type;
+		uint16_t part_size;
+		uint64_t tmp = 0;
+
+		if (buffer_size < 2 * sizeof (uint16_t))
+		{
+			sstrncpy (errbuf, "Truncated part header.", sizeof (errbuf));
+			status = -1;
+			break;
+		}
+		memcpy (&part_type, buffer, sizeof (part_type));
+		memcpy (&part_size, buffer + sizeof (part_type), sizeof (part_size));
+		part_type = ntohs (part_type);
+		part_size = ntohs (part_size);
+
+		if ((part_size < 2 * sizeof (uint16_t)) || (part_size > buffer_size))
+		{
+			ssnprintf (errbuf, sizeof (errbuf),
+					"Invalid size %"PRIu16" of part 0x%04"PRIx16".",
+					part_size, part_type);
+			status = -1;
+			break;
+		}
+		payload = buffer + 2 * sizeof (uint16_t);
+		payload_size = part_size - 2 * sizeof (uint16_t);
+		buffer += part_size;
+		buffer_size -= part_size;
+
+		switch (part_type)
+		{
+			case TYPE_HOST:
+				status = binary_read_string (payload, payload_size,
+						vl.host, sizeof (vl.host));
+				break;
+			case TYPE_PLUGIN:
+				status = binary_read_string (payload, payload_size,
+						vl.plugin, sizeof (vl.plugin));
+				break;
+			case TYPE_PLUGIN_INSTANCE:
+				status = binary_read_string (payload, payload_size,
+						vl.plugin_instance, sizeof (vl.plugin_instance));
+				break;
+			case TYPE_TYPE:
+				status = binary_read_string (payload, payload_size,
+						vl.type, sizeof (vl.type));
+				break;
+			case TYPE_TYPE_INSTANCE:
+				status = binary_read_string (payload, payload_size,
+						vl.type_instance, sizeof (vl.type_instance));
+				break;
+			case TYPE_TIME:
+				status = binary_read_number (payload, payload_size, &tmp);
+				vl.time = TIME_T_TO_CDTIME_T (tmp);
+				break;
+			case TYPE_TIME_HR:
+				status = binary_read_number (payload, payload_size, &tmp);
+				vl.time = (cdtime_t) tmp;
+				break;
+			case TYPE_INTERVAL:
+				status = binary_read_number (payload, payload_size, &tmp);
+				vl.interval = TIME_T_TO_CDTIME_T (tmp);
+				break;
+			case TYPE_INTERVAL_HR:
+				status = binary_read_number (payload, payload_size, &tmp);
+				vl.interval = (cdtime_t) tmp;
+				break;
+			case TYPE_VALUES:
+				status = binary_read_values (payload, payload_size,
+						&vl, &values_size, errbuf, sizeof (errbuf));
+				if (status != 0)
+					continue;
+				status = value_lists_append (&vls, &vls_num, &vl);
+				if (status != 0)
+					sstrncpy (errbuf, "malloc failed.", sizeof (errbuf));
+				continue;
+			default:
+				/* Notifications, signatures and encryption are not
+				 * supported here. Skip the part, like the network plugin
+				 * does for unknown parts. */
+				continue;
+		}
+
+		if (status != 0)
+			ssnprintf (errbuf, sizeof (errbuf),
+					"Malformed part 0x%04"PRIx16".", part_type);
+	} /* while (buffer_size > 0) */
+
+	if (status != 0)
+		putval_fail (fh, "-1 %s\n", errbuf);
+
+	for (i = 0; i < vls_num; i++)
+		plugin_dispatch_values (vls + i);
+
+	value_lists_free (vls, vls_num);
+	print_to_socket (fh, "0 Success: %zu %s been dispatched.\n",
+			vls_num, (vls_num == 1) ? "value has" : "values have");
+
+	sfree (vl.values);
+	return (0);
+} /* int handle_putval_binary */
+
 int create_putval (char *ret, size_t ret_len, /* {{{ */
 	const data_set_t *ds, const value_list_t *vl)
 {
@@ -31,7 +31,16 @@
 
 #include "plugin.h"
 
+/* Binary PUTVAL frames start with a zero byte, which never starts a text
+ * command, followed by a version byte and the size of the payload as a 16 bit
+ * integer in network byte order. The payload is a sequence of parts as sent by
+ * the network plugin. */
+#define PUTVAL_BINARY_MAGIC       0x00
+#define PUTVAL_BINARY_VERSION     0x01
+#define PUTVAL_BINARY_HEADER_SIZE 4
+
 int handle_putval (FILE *fh, char *buffer);
+int handle_putval_binary (FILE *fh, const char *buffer, size_t buffer_size);
 
 int create_putval (char *ret, size_t ret_len,
 		const data_set_t *ds, const value_list_t *vl);
@@ -0,0 +1,410 @@
+/**
+ * collectd - src/utils_curl_multi.c
+ * Copyright (C) 2026       agent
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   agent <agent at local>
+ **/
+
+#include "collectd.h"
+#include "common.h"
+#include "plugin.h"
+#include "utils_curl_multi.h"
+
+#include <pthread.h>
+
+struct ucm_transfer_s;
+typedef struct ucm_transfer_s ucm_transfer_t;
+struct ucm_transfer_s
+{
+  CURL *curl;
+  ucm_callback_t callback;
+  void *user_data;
+  plugin_ctx_t ctx;
+
+  /* Set once the handle has been added to the multi handle. */
+  _Bool active;
+  /* Set by ucm_remove(). */
+  _Bool cancel;
+
+  ucm_transfer_t *next;
+};
+
+/* "lock" protects all of the following variables. "cond" is signaled
+ * whenever a transfer has been removed or a callback has returned. */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+
+static pthread_t engine_thread;
+static _Bool engine_running = 0;
+static _Bool engine_loop = 0;
+static int wake_fd[2] = { -1, -1 };
+
+static ucm_transfer_t *transfers = NULL;
+/* The handle whose callback is being called right now. */
+static CURL *callback_curl = NULL;
+
+static long max_host_connections = 0;
+
+/* The multi handle is only used by the engine's thread. */
+static CURLM *multi = NULL;
+
+static void ucm_wake (void) /* {{{ */
+{
+  if (write (wake_fd[1], "x", 1) < 0)
+  {
+    /* The pipe is full, so the engine will wake up anyway. */
+  }
+} /* }}} void ucm_wake */
+
+/* Removes "t" from the list of transfers. Must be called with "lock"
+ * held. */
+static void ucm_unlink (ucm_transfer_t *t) /* {{{ */
+{
+  ucm_transfer_t **ptr;
+
+  for (ptr = &transfers; *ptr != NULL; ptr = &(*ptr)->next)
+  {
+    if (*ptr == t)
+    {
+      *ptr = t->next;
+      t->next = NULL;
+      return;
+    }
+  }
+} /* }}} void ucm_unlink */
+
+static ucm_transfer_t *ucm_find (CURL *curl) /* {{{ */
+{
+  ucm_transfer_t *t;
+
+  for (t = transfers; t != NULL; t = t->next)
+    if (t->curl == curl)
+      return (t);
+
+  return (NULL);
+} /* }}} ucm_transfer_t *ucm_find */
+
+/* Unlinks "t" and marks its callback as running, so that ucm_remove() waits
+ * for it. Returns false if the transfer has been cancelled, in which case "t"
+ * has been freed. Must be called with "lock" held. */
+static _Bool ucm_claim (ucm_transfer_t *t) /* {{{ */
+{
+  ucm_unlink (t);
+
+  if (t->cancel)
+  {
+    sfree (t);
+    pthread_cond_broadcast (&cond);
+    return (0);
+  }
+
+  callback_curl = t->curl;
+  return (1);
+} /* }}} _Bool ucm_claim */
+
+/* Calls the callback of a transfer claimed with ucm_claim() and frees "t".
+ * Must be called without holding "lock". */
+static void ucm_finish (ucm_transfer_t *t, CURLcode status) /* {{{ */
+{
+  plugin_ctx_t old_ctx;
+
+  old_ctx = plugin_set_ctx (t->ctx);
+  (*t->callback) (t->curl, status, t->user_data);
+  plugin_set_ctx (old_ctx);
+
+  pthread_mutex_lock (&lock);
+  callback_curl = NULL;
+  pthread_cond_broadcast (&cond);
+  pthread_mutex_unlock (&lock);
+
+  sfree (t);
+} /* }}} void ucm_finish */
+
+/* Adds new transfers to the multi handle and drops cancelled ones. */
+static void ucm_update_handles (void) /* {{{ */
+{
+  ucm_transfer_t *t;
+
+  pthread_mutex_lock (&lock);
+  t = transfers;
+  while (t != NULL)
+  {
+    ucm_transfer_t *next = t->next;
+    CURLMcode status;
+
+    if (t->cancel)
+    {
+      if (t->active)
+        curl_multi_remove_handle (multi, t->curl);
+      ucm_claim (t);
+    }
+    else if (!t->active)
+    {
+      status = curl_multi_add_handle (multi, t->curl);
+      if (status == CURLM_OK)
+        t->active = 1;
+      else
+      {
+        ERROR ("utils_curl_multi: curl_multi_add_handle failed: %s",
+            curl_multi_strerror (status));
+        ucm_claim (t);
+        pthread_mutex_unlock (&lock);
+        ucm_finish (t, CURLE_FAILED_INIT);
+        pthread_mutex_lock (&lock);
+        /* The list may have changed in the meantime. */
+        next = transfers;
+      }
+    }
+
+    t = next;
+  }
+  pthread_mutex_unlock (&lock);
+} /* }}} void ucm_update_handles */
+
+static void ucm_read_messages (void) /* {{{ */
+{
+  CURLMsg *msg;
+  int msgs_left;
+
+  while ((msg = curl_multi_info_read (multi, &msgs_left)) != NULL)
+  {
+    ucm_transfer_t *t;
+    CURL *curl = msg->easy_handle;
+    CURLcode status = msg->data.result;
+    _Bool claimed = 0;
+
+    if (msg->msg != CURLMSG_DONE)
+      continue;
+
+    /* "msg" is invalid after the handle has been removed. */
+    curl_multi_remove_handle (multi, curl);
+
+    pthread_mutex_lock (&lock);
+    t = ucm_find (curl);
+    if (t != NULL)
+      claimed = ucm_claim (t);
+    pthread_mutex_unlock (&lock);
+
+    if (claimed)
+      ucm_finish (t, status);
+  }
+} /* }}} void ucm_read_messages */
+
+static void *ucm_engine (__attribute__((unused)) void *arg) /* {{{ */
+{
+  ucm_transfer_t *t;
+
+  while (42)
+  {
+    struct curl_waitfd wfd;
+    int running = 0;
+    int numfds = 0;
+
+    pthread_mutex_lock (&lock);
+    if (!engine_loop)
+    {
+      pthread_mutex_unlock (&lock);
+      break;
+    }
+    pthread_mutex_unlock (&lock);
+
+    ucm_update_handles ();
+
+    curl_multi_perform (multi, &running);
+    ucm_read_messages ();
+
+    memset (&wfd, 0, sizeof (wfd));
+    wfd.fd = wake_fd[0];
+    wfd.events = CURL_WAIT_POLLIN;
+    curl_multi_wait (multi, &wfd, 1, /* timeout = */ 1000, &numfds);
+
+    if (wfd.revents != 0)
+    {
+      char buffer[64];
+      while (read (wake_fd[0], buffer, sizeof (buffer)) > 0)
+        /* drain */;
+    }
+  } /* while (42) */
+
+  /* Abort all remaining transfers. */
+  pthread_mutex_lock (&lock);
+  while ((t = transfers) != NULL)
+  {
+    if (t->active)
+      curl_multi_remove_handle (multi, t->curl);
+
+    if (!ucm_claim (t))
+      continue;
+
+    pthread_mutex_unlock (&lock);
+    ucm_finish (t, CURLE_ABORTED_BY_CALLBACK);
+    pthread_mutex_lock (&lock);
+  }
+  pthread_mutex_unlock (&lock);
+
+  return (NULL);
+} /* }}} void *ucm_engine */
+
+/* Must be called with "lock" held. */
+static int ucm_start (void) /* {{{ */
+{
+  char errbuf[1024];
+  int status;
+
+  if (engine_running)
+    return (0);
+
+  multi = curl_multi_init ();
+  if (multi == NULL)
+  {
+    ERROR ("utils_curl_multi: curl_multi_init failed.");
+    return (-1);
+  }
+#if LIBCURL_VERSION_NUM >= 0x071e00
+  if (max_host_connections > 0)
+    curl_multi_setopt (multi, CURLMOPT_MAX_HOST_CONNECTIONS,
+        max_host_connections);
+#endif
+
+  if (pipe (wake_fd) != 0)
+  {
+    ERROR ("utils_curl_multi: pipe failed: %s",
+        sstrerror (errno, errbuf, sizeof (errbuf)));
+    curl_multi_cleanup (multi);
+    multi = NULL;
+    return (-1);
+  }
+  fcntl (wake_fd[0], F_SETFL, fcntl (wake_fd[0], F_GETFL) | O_NONBLOCK);
+  fcntl (wake_fd[1], F_SETFL, fcntl (wake_fd[1], F_GETFL) | O_NONBLOCK);
+
+  engine_loop = 1;
+  status = plugin_thread_create (&engine_thread, /* attr = */ NULL,
+      ucm_engine, /* arg = */ NULL);
+  if (status != 0)
+  {
+    ERROR ("utils_curl_multi: pthread_create failed: %s",
+        sstrerror (status, errbuf, sizeof (errbuf)));
+    engine_loop = 0;
+    close (wake_fd[0]);
+    close (wake_fd[1]);
+    wake_fd[0] = wake_fd[1] = -1;
+    curl_multi_cleanup (multi);
+    multi = NULL;
+    return (-1);
+  }
+
+  engine_running = 1;
+  return (0);
+} /* }}} int ucm_start */
+
+int ucm_submit (CURL *curl, ucm_callback_t callback, void *user_data) /* {{{ */
+{
+  ucm_transfer_t *t;
+
+  if ((curl == NULL) || (callback == NULL))
+    return (EINVAL);
+
+  t = malloc (sizeof (*t));
+  if (t == NULL)
+    return (ENOMEM);
+  memset (t, 0, sizeof (*t));
+  t->curl = curl;
+  t->callback = callback;
+  t->user_data = user_data;
+  t->ctx = plugin_get_ctx ();
+
+  pthread_mutex_lock (&lock);
+  if ((ucm_find (curl) != NULL) || (callback_curl == curl))
+  {
+    pthread_mutex_unlock (&lock);
+    sfree (t);
+    return (EBUSY);
+  }
+
+  if (ucm_start () != 0)
+  {
+    pthread_mutex_unlock (&lock);
+    sfree (t);
+    return (-1);
+  }
+
+  t->next = transfers;
+  transfers = t;
+  ucm_wake ();
+  pthread_mutex_unlock (&lock);
+
+  return (0);
+} /* }}} int ucm_submit */
+
+void ucm_remove (CURL *curl) /* {{{ */
+{
+  ucm_transfer_t *t;
+
+  pthread_mutex_lock (&lock);
+  while (42)
+  {
+    t = ucm_find (curl);
+    if ((t == NULL) && (callback_curl != curl))
+      break;
+
+    if ((t != NULL) && !t->cancel)
+    {
+      t->cancel = 1;
+      ucm_wake ();
+    }
+    pthread_cond_wait (&cond, &lock);
+  }
+  pthread_mutex_unlock (&lock);
+} /* }}} void ucm_remove */
+
+void ucm_set_max_host_connections (long num) /* {{{ */
+{
+  pthread_mutex_lock (&lock);
+  max_host_connections = (num > 0) ? num : 0;
+  pthread_mutex_unlock (&lock);
+} /* }}} void ucm_set_max_host_connections */
+
+void ucm_shutdown (void) /* {{{ */
+{
+  pthread_mutex_lock (&lock);
+  if (!engine_running)
+  {
+    pthread_mutex_unlock (&lock);
+    return;
+  }
+  engine_loop = 0;
+  ucm_wake ();
+  pthread_mutex_unlock (&lock);
+
+  pthread_join (engine_thread, /* retval = */ NULL);
+
+  pthread_mutex_lock (&lock);
+  engine_running = 0;
+  close (wake_fd[0]);
+  close (wake_fd[1]);
+  wake_fd[0] = wake_fd[1] = -1;
+  curl_multi_cleanup (multi);
+  multi = NULL;
+  pthread_mutex_unlock (&lock);
+} /* }}} void ucm_shutdown */
+
+/* vim: set sw=2 sts=2 et fdm=marker : */
@@ -0,0 +1,71 @@
+/**
+ * collectd - src/utils_curl_multi.h
+ * Copyright (C) 2026       agent
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   agent <agent at local>
+ **/
+
+#ifndef UTILS_CURL_MULTI_H
+#define UTILS_CURL_MULTI_H 1
+
+#include "collectd.h"
+
+#include <curl/curl.h>
+
+/*
+ * HTTP fetch engine used by the curl, curl_json and curl_xml plugins. Each
+ * plugin links its own copy, i.e. the engine is not shared between plugins.
+ * A plugin's transfers are performed by a single thread using one "multi"
+ * handle, so they share the connection and DNS cache and hundreds of URLs can
+ * be fetched in parallel without occupying a read thread each. The engine is
+ * started with the first transfer.
+ *
+ * Easy handles are configured by the caller as usual. In particular the
+ * CURLOPT_WRITEFUNCTION callback is called by the engine's thread while the
+ * body is being received, so that the body can be fed into a parser as it
+ * arrives.
+ */
+
+/* Called by the engine's thread once a transfer is complete. "status" is
+ * CURLE_ABORTED_BY_CALLBACK if the engine is being shut down. The plugin
+ * context of the thread which submitted the transfer is in effect. */
+typedef void (*ucm_callback_t) (CURL *curl, CURLcode status, void *user_data);
+
+/* Hands "curl" to the engine and returns immediately. Returns EBUSY if "curl"
+ * is still being transferred. */
+int ucm_submit (CURL *curl, ucm_callback_t callback, void *user_data);
+
+/* Aborts the transfer of "curl", if any, without calling its callback. When
+ * this function returns, the callback is not running and the engine doesn't
+ * reference "curl" anymore, so it can be freed. */
+void ucm_remove (CURL *curl);
+
+/* Limits the number of concurrent connections to a single host. Zero means
+ * no limit, which is the default. Takes effect when the engine is started. */
+void ucm_set_max_host_connections (long num);
+
+/* Stops the engine. Transfers still in progress are aborted. */
+void ucm_shutdown (void);
+
+#endif /* UTILS_CURL_MULTI_H */
+
+/* vim: set sw=2 sts=2 et : */
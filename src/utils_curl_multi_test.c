@@ -0,0 +1,380 @@
+/**
+ * collectd - src/utils_curl_multi_test.c
+ * Copyright (C) 2026       agent
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   agent <agent at local>
+ */
+
+#include "common.h" /* for STATIC_ARRAY_SIZE */
+#include "collectd.h"
+#include "testing.h"
+#include "utils_curl_multi.h"
+
+#include <pthread.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+/*
+ * A minimal HTTP server. Every connection is handled by its own thread, which
+ * answers a single request for "/<delay>/<body>" with "<body>" after sleeping
+ * <delay> milliseconds.
+ */
+static int server_port;
+static pthread_mutex_t server_lock = PTHREAD_MUTEX_INITIALIZER;
+static int server_conns_active = 0;
+static int server_conns_max = 0;
+
+static void *server_conn (void *arg)
+{
+  int fd = (int) (intptr_t) arg;
+  char request[1024];
+  size_t request_len = 0;
+  char response[1024];
+  char body[256] = "";
+  int delay = 0;
+
+  pthread_mutex_lock (&server_lock);
+  server_conns_active++;
+  if (server_conns_max < server_conns_active)
+    server_conns_max = server_conns_active;
+  pthread_mutex_unlock (&server_lock);
+
+  while (request_len < sizeof (request) - 1)
+  {
+    ssize_t status = read (fd, request + request_len,
+        sizeof (request) - 1 - request_len);
+    if (status <= 0)
+      break;
+    request_len += (size_t) status;
+    request[request_len] = 0;
+    if (strstr (request, "\r\n\r\n") != NULL)
+      break;
+  }
+  request[request_len] = 0;
+
+  sscanf (request, "GET /%d/%255[^ ]", &delay, body);
+  if (delay > 0)
+    usleep (1000 * delay);
+
+  ssnprintf (response, sizeof (response),
+      "HTTP/1.0 200 OK\r\n"
+      "Content-Length: %zu\r\n"
+      "Connection: close\r\n"
+      "\r\n"
+      "%s", strlen (body), body);
+  if (write (fd, response, strlen (response)) < 0)
+  {
+    /* The client may have given up already. */
+  }
+
+  pthread_mutex_lock (&server_lock);
+  server_conns_active--;
+  pthread_mutex_unlock (&server_lock);
+
+  close (fd);
+  return (NULL);
+}
+
+static void *server_main (void *arg)
+{
+  int listen_fd = (int) (intptr_t) arg;
+
+  while (42)
+  {
+    pthread_t thread;
+    int fd;
+
+    fd = accept (listen_fd, NULL, NULL);
+    if (fd < 0)
+      continue;
+
+    pthread_create (&thread, NULL, server_conn, (void *) (intptr_t) fd);
+    pthread_detach (thread);
+  }
+
+  return (NULL);
+}
+
+static int server_start (void)
+{
+  struct sockaddr_in addr;
+  socklen_t addr_len = sizeof (addr);
+  pthread_t thread;
+  int fd;
+
+  fd = socket (AF_INET, SOCK_STREAM, 0);
+  if (fd < 0)
+    return (-1);
+
+  memset (&addr, 0, sizeof (addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+  addr.sin_port = 0;
+  if ((bind (fd, (struct sockaddr *) &addr, sizeof (addr)) != 0)
+      || (listen (fd, 128) != 0)
+      || (getsockname (fd, (struct sockaddr *) &addr, &addr_len) != 0))
+  {
+    close (fd);
+    return (-1);
+  }
+  server_port = ntohs (addr.sin_port);
+
+  if (pthread_create (&thread, NULL, server_main, (void *) (intptr_t) fd) != 0)
+    return (-1);
+  pthread_detach (thread);
+
+  return (0);
+}
+
+/*
+ * Client side
+ */
+struct fetch_s
+{
+  CURL *curl;
+  char url[256];
+  char buffer[256];
+  size_t buffer_fill;
+  CURLcode status;
+  _Bool done;
+};
+typedef struct fetch_s fetch_t;
+
+static pthread_mutex_t fetch_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t fetch_cond = PTHREAD_COND_INITIALIZER;
+static int fetch_done_num = 0;
+
+static size_t fetch_write (void *buf, size_t size, size_t nmemb,
+    void *user_data)
+{
+  fetch_t *f = user_data;
+  size_t len = size * nmemb;
+
+  if (len >= sizeof (f->buffer) - f->buffer_fill)
+    return (0);
+
+  memcpy (f->buffer + f->buffer_fill, buf, len);
+  f->buffer_fill += len;
+  f->buffer[f->buffer_fill] = 0;
+  return (len);
+}
+
+static void fetch_callback (CURL *curl, CURLcode status, void *user_data)
+{
+  fetch_t *f = user_data;
+
+  pthread_mutex_lock (&fetch_lock);
+  f->status = status;
+  f->done = 1;
+  fetch_done_num++;
+  pthread_cond_broadcast (&fetch_cond);
+  pthread_mutex_unlock (&fetch_lock);
+}
+
+static void fetch_init (fetch_t *f, int delay, char const *body)
+{
+  memset (f, 0, sizeof (*f));
+  ssnprintf (f->url, sizeof (f->url), "http://127.0.0.1:%d/%d/%s",
+      server_port, delay, body);
+
+  f->curl = curl_easy_init ();
+  curl_easy_setopt (f->curl, CURLOPT_NOSIGNAL, 1L);
+  curl_easy_setopt (f->curl, CURLOPT_URL, f->url);
+  curl_easy_setopt (f->curl, CURLOPT_WRITEFUNCTION, fetch_write);
+  curl_easy_setopt (f->curl, CURLOPT_WRITEDATA, f);
+}
+
+static void fetch_wait (int num)
+{
+  pthread_mutex_lock (&fetch_lock);
+  while (fetch_done_num < num)
+    pthread_cond_wait (&fetch_cond, &fetch_lock);
+  fetch_done_num = 0;
+  pthread_mutex_unlock (&fetch_lock);
+}
+
+/* Submits "f" and waits for its callback to return, so that the handle can
+ * be submitted again or freed right away. */
+static CURLcode fetch_perform (fetch_t *f)
+{
+  f->done = 0;
+  if (ucm_submit (f->curl, fetch_callback, f) != 0)
+    return (CURLE_FAILED_INIT);
+
+  fetch_wait (1);
+  /* The callback may still be returning; ucm_remove() waits for it. */
+  ucm_remove (f->curl);
+  return (f->status);
+}
+
+DEF_TEST(submit)
+{
+  fetch_t f;
+
+  fetch_init (&f, 0, "hello");
+  EXPECT_EQ_INT (CURLE_OK, fetch_perform (&f));
+  EXPECT_EQ_STR ("hello", f.buffer);
+
+  /* The handle can be reused. */
+  f.buffer_fill = 0;
+  EXPECT_EQ_INT (CURLE_OK, fetch_perform (&f));
+  EXPECT_EQ_STR ("hello", f.buffer);
+
+  curl_easy_cleanup (f.curl);
+  return (0);
+}
+
+DEF_TEST(parallel)
+{
+  fetch_t f[64];
+  char body[32];
+  cdtime_t begin;
+  cdtime_t elapsed;
+  size_t i;
+
+  /* Every request takes 100 ms, so fetching them one after another would take
+   * more than six seconds. */
+  begin = cdtime ();
+  for (i = 0; i < STATIC_ARRAY_SIZE (f); i++)
+  {
+    ssnprintf (body, sizeof (body), "page%zu", i);
+    fetch_init (f + i, 100, body);
+    CHECK_ZERO (ucm_submit (f[i].curl, fetch_callback, f + i));
+  }
+
+  /* A handle can only be transferred once at a time. */
+  EXPECT_EQ_INT (EBUSY, ucm_submit (f[0].curl, fetch_callback, f));
+
+  fetch_wait ((int) STATIC_ARRAY_SIZE (f));
+  elapsed = cdtime () - begin;
+
+  for (i = 0; i < STATIC_ARRAY_SIZE (f); i++)
+  {
+    ssnprintf (body, sizeof (body), "page%zu", i);
+    EXPECT_EQ_INT (CURLE_OK, f[i].status);
+    EXPECT_EQ_STR (body, f[i].buffer);
+    curl_easy_cleanup (f[i].curl);
+  }
+
+  OK1 (elapsed < TIME_T_TO_CDTIME_T (3), "transfers are performed in parallel");
+  return (0);
+}
+
+DEF_TEST(max_host_connections)
+{
+  fetch_t f[16];
+  size_t i;
+
+  ucm_shutdown ();
+  ucm_set_max_host_connections (2);
+
+  /* Server threads of the previous test may still be finishing. */
+  pthread_mutex_lock (&server_lock);
+  while (server_conns_active > 0)
+  {
+    pthread_mutex_unlock (&server_lock);
+    usleep (10000);
+    pthread_mutex_lock (&server_lock);
+  }
+  server_conns_max = 0;
+  pthread_mutex_unlock (&server_lock);
+
+  for (i = 0; i < STATIC_ARRAY_SIZE (f); i++)
+  {
+    fetch_init (f + i, 20, "limited");
+    CHECK_ZERO (ucm_submit (f[i].curl, fetch_callback, f + i));
+  }
+  fetch_wait ((int) STATIC_ARRAY_SIZE (f));
+
+  for (i = 0; i < STATIC_ARRAY_SIZE (f); i++)
+  {
+    EXPECT_EQ_INT (CURLE_OK, f[i].status);
+    EXPECT_EQ_STR ("limited", f[i].buffer);
+    curl_easy_cleanup (f[i].curl);
+  }
+
+  pthread_mutex_lock (&server_lock);
+  OK1 (server_conns_max <= 2, "at most two concurrent connections");
+  pthread_mutex_unlock (&server_lock);
+
+  ucm_shutdown ();
+  ucm_set_max_host_connections (0);
+  return (0);
+}
+
+DEF_TEST(remove)
+{
+  fetch_t f;
+
+  fetch_init (&f, 2000, "slow");
+  CHECK_ZERO (ucm_submit (f.curl, fetch_callback, &f));
+  usleep (100000);
+
+  ucm_remove (f.curl);
+  OK1 (!f.done, "callback is not called after ucm_remove");
+
+  /* The handle can be submitted again. */
+  curl_easy_setopt (f.curl, CURLOPT_URL, "http://127.0.0.1:1/");
+  f.buffer_fill = 0;
+  EXPECT_EQ_INT (CURLE_COULDNT_CONNECT, fetch_perform (&f));
+
+  curl_easy_cleanup (f.curl);
+  return (0);
+}
+
+DEF_TEST(shutdown)
+{
+  fetch_t f;
+
+  fetch_init (&f, 2000, "slow");
+  CHECK_ZERO (ucm_submit (f.curl, fetch_callback, &f));
+  usleep (100000);
+
+  ucm_shutdown ();
+  OK1 (f.done, "callback is called on shutdown");
+  EXPECT_EQ_INT (CURLE_ABORTED_BY_CALLBACK, f.status);
+  fetch_done_num = 0;
+
+  curl_easy_cleanup (f.curl);
+  return (0);
+}
+
+int main (void)
+{
+  curl_global_init (CURL_GLOBAL_ALL);
+  if (server_start () != 0)
+  {
+    printf ("Bail out! Starting the HTTP server failed.\n");
+    return (1);
+  }
+
+  RUN_TEST(submit);
+  RUN_TEST(parallel);
+  RUN_TEST(max_host_connections);
+  RUN_TEST(remove);
+  RUN_TEST(shutdown);
+
+  ucm_shutdown ();
+  END_TEST;
+}
+
+/* vim: set sw=2 sts=2 et : */
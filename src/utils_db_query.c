@@ -30,6 +30,13 @@
 #include "configfile.h"
 #include "utils_db_query.h"
 
+/* Number of value lists dispatched at once. */
+#define UDB_BATCH_SIZE 256
+
+/* Size of the buffer a numeric column used as instance or meta data is
+ * formatted into. */
+#define UDB_NUMBER_SIZE 32
+
 /*
  * Data types
  */
@@ -58,6 +65,8 @@ struct udb_query_s /* {{{ */
   unsigned int min_version;
   unsigned int max_version;
 
+  _Bool statistics;
+
   udb_result_t *results;
 }; /* }}} */
 
@@ -68,8 +77,10 @@ struct udb_result_preparation_area_s /* {{{ */
   size_t *values_pos;
   size_t *metadata_pos;
   char  **instances_buffer;
-  char  **values_buffer;
   char  **metadata_buffer;
+  /* Numeric instance and meta data columns are formatted into this buffer,
+   * UDB_NUMBER_SIZE bytes per column. */
+  char   *numbers_buffer;
 
   struct udb_result_preparation_area_s *next;
 }; /* }}} */
@@ -84,6 +95,19 @@ struct udb_query_preparation_area_s /* {{{ */
 
   cdtime_t interval;
 
+  /* Used by udb_query_handle_result to pass strings on. */
+  udb_column_t *columns;
+  uint64_t rows_num;
+
+  /* Value lists not dispatched yet. The values of all value lists are stored
+   * one after another in "batch_values". Since that array may be moved when
+   * growing, the "values" pointers are only set when dispatching. */
+  value_list_t *batch;
+  size_t batch_num;
+  value_t *batch_values;
+  size_t batch_values_num;
+  size_t batch_values_size;
+
   udb_result_preparation_area_t *result_prep_areas;
 }; /* }}} */
 
@@ -188,14 +212,143 @@ static int udb_config_set_uint (unsigned int *ret_value, /* {{{ */
   return (0);
 } /* }}} int udb_config_set_uint */
 
+/*
+ * Column private functions
+ */
+static char *udb_column_to_string (udb_column_t const *c, /* {{{ */
+    char *buffer, size_t buffer_size)
+{
+  switch (c->type)
+  {
+    case UDB_COLUMN_INTEGER:
+      ssnprintf (buffer, buffer_size, "%"PRIi64, c->value.integer);
+      return (buffer);
+    case UDB_COLUMN_DOUBLE:
+      ssnprintf (buffer, buffer_size, "%.15g", c->value.number);
+      return (buffer);
+    case UDB_COLUMN_STRING:
+      break;
+  }
+
+  /* The buffers handed to strjoin and meta_data_add_string are not
+   * modified. */
+  return ((char *) c->value.string);
+} /* }}} char *udb_column_to_string */
+
+static int udb_column_to_value (udb_column_t const *c, /* {{{ */
+    value_t *ret_value, int ds_type)
+{
+  char const *str;
+  char *endptr = NULL;
+
+  if (c->type == UDB_COLUMN_INTEGER)
+  {
+    switch (ds_type)
+    {
+      case DS_TYPE_COUNTER:
+        ret_value->counter = (counter_t) c->value.integer;
+        return (0);
+      case DS_TYPE_GAUGE:
+        ret_value->gauge = (gauge_t) c->value.integer;
+        return (0);
+      case DS_TYPE_DERIVE:
+        ret_value->derive = (derive_t) c->value.integer;
+        return (0);
+      case DS_TYPE_ABSOLUTE:
+        ret_value->absolute = (absolute_t) c->value.integer;
+        return (0);
+    }
+    return (-1);
+  }
+  else if (c->type == UDB_COLUMN_DOUBLE)
+  {
+    switch (ds_type)
+    {
+      case DS_TYPE_COUNTER:
+        ret_value->counter = (counter_t) c->value.number;
+        return (0);
+      case DS_TYPE_GAUGE:
+        ret_value->gauge = (gauge_t) c->value.number;
+        return (0);
+      case DS_TYPE_DERIVE:
+        ret_value->derive = (derive_t) c->value.number;
+        return (0);
+      case DS_TYPE_ABSOLUTE:
+        ret_value->absolute = (absolute_t) c->value.number;
+        return (0);
+    }
+    return (-1);
+  }
+
+  /* Parse the string in place; parse_value copies it first. Anything unusual
+   * is left to parse_value, so that it is reported the same way. */
+  str = c->value.string;
+  if (str == NULL)
+    return (-1);
+
+  switch (ds_type)
+  {
+    case DS_TYPE_COUNTER:
+      ret_value->counter = (counter_t) strtoull (str, &endptr, 0);
+      break;
+    case DS_TYPE_GAUGE:
+      ret_value->gauge = (gauge_t) strtod (str, &endptr);
+      break;
+    case DS_TYPE_DERIVE:
+      ret_value->derive = (derive_t) strtoll (str, &endptr, 0);
+      break;
+    case DS_TYPE_ABSOLUTE:
+      ret_value->absolute = (absolute_t) strtoull (str, &endptr, 0);
+      break;
+  }
+
+  if ((endptr == NULL) || (endptr == str))
+    return (parse_value (str, ret_value, ds_type));
+  while (isspace ((int) *endptr))
+    endptr++;
+  if (*endptr != 0)
+    return (parse_value (str, ret_value, ds_type));
+
+  return (0);
+} /* }}} int udb_column_to_value */
+
 /*
  * Result private functions
  */
+static void udb_query_dispatch_batch (udb_query_preparation_area_t *q_area) /* {{{ */
+{
+  size_t offset = 0;
+  size_t i;
+
+  if (q_area->batch_num == 0)
+    return;
+
+  for (i = 0; i < q_area->batch_num; i++)
+  {
+    q_area->batch[i].values = q_area->batch_values + offset;
+    offset += (size_t) q_area->batch[i].values_len;
+  }
+
+  plugin_dispatch_values_list (q_area->batch, q_area->batch_num);
+
+  for (i = 0; i < q_area->batch_num; i++)
+  {
+    meta_data_destroy (q_area->batch[i].meta);
+    q_area->batch[i].meta = NULL;
+  }
+
+  q_area->batch_num = 0;
+  q_area->batch_values_num = 0;
+} /* }}} void udb_query_dispatch_batch */
+
+/* Adds the value list for one row to the batch of "q_area". */
 static int udb_result_submit (udb_result_t *r, /* {{{ */
     udb_result_preparation_area_t *r_area,
-    udb_query_t const *q, udb_query_preparation_area_t *q_area)
+    udb_query_t const *q, udb_query_preparation_area_t *q_area,
+    udb_column_t const *columns)
 {
   value_list_t vl = VALUE_LIST_INIT;
+  value_t *values;
   size_t i;
   int status;
 
@@ -204,26 +357,55 @@ static int udb_result_submit (udb_result_t *r, /* {{{ */
   assert (((size_t) r_area->ds->ds_num) == r->values_num);
   assert (r->values_num > 0);
 
-  vl.values = (value_t *) calloc (r->values_num, sizeof (value_t));
-  if (vl.values == NULL)
+  if (q_area->batch_num >= UDB_BATCH_SIZE)
+    udb_query_dispatch_batch (q_area);
+
+  if (q_area->batch == NULL)
   {
-    ERROR ("db query utils: malloc failed.");
-    return (-1);
+    q_area->batch = calloc (UDB_BATCH_SIZE, sizeof (*q_area->batch));
+    if (q_area->batch == NULL)
+    {
+      ERROR ("db query utils: calloc failed.");
+      return (-1);
+    }
   }
-  vl.values_len = r_area->ds->ds_num;
 
+  if (q_area->batch_values_num + r->values_num > q_area->batch_values_size)
+  {
+    size_t size = 2 * q_area->batch_values_size;
+    value_t *tmp;
+
+    if (size < q_area->batch_values_num + r->values_num)
+      size = UDB_BATCH_SIZE * r->values_num;
+
+    tmp = realloc (q_area->batch_values, size * sizeof (*tmp));
+    if (tmp == NULL)
+    {
+      ERROR ("db query utils: realloc failed.");
+      return (-1);
+    }
+    q_area->batch_values = tmp;
+    q_area->batch_values_size = size;
+  }
+
+  values = q_area->batch_values + q_area->batch_values_num;
   for (i = 0; i < r->values_num; i++)
   {
-    char *value_str = r_area->values_buffer[i];
+    udb_column_t const *c = columns + r_area->values_pos[i];
 
-    if (0 != parse_value (value_str, &vl.values[i], r_area->ds->ds[i].type))
+    if (udb_column_to_value (c, values + i, r_area->ds->ds[i].type) != 0)
     {
+      char buffer[UDB_NUMBER_SIZE];
+      char *value_str = udb_column_to_string (c, buffer, sizeof (buffer));
+
       ERROR ("db query utils: udb_result_submit: Parsing `%s' as %s failed.",
-          value_str, DS_TYPE_TO_STRING (r_area->ds->ds[i].type));
+          (value_str != NULL) ? value_str : "(null)",
+          DS_TYPE_TO_STRING (r_area->ds->ds[i].type));
       errno = EINVAL;
       return (-1);
     }
   }
+  vl.values_len = r_area->ds->ds_num;
 
   if (q_area->interval > 0)
     vl.interval = q_area->interval;
@@ -244,6 +426,11 @@ static int udb_result_submit (udb_result_t *r, /* {{{ */
   }
   else /* if ((r->instances_num > 0) */
   {
+    for (i = 0; i < r->instances_num; i++)
+      r_area->instances_buffer[i] = udb_column_to_string (
+          columns + r_area->instances_pos[i],
+          r_area->numbers_buffer + i * UDB_NUMBER_SIZE, UDB_NUMBER_SIZE);
+
     if (r->instance_prefix == NULL)
     {
       strjoin (vl.type_instance, sizeof (vl.type_instance),
@@ -276,6 +463,11 @@ static int udb_result_submit (udb_result_t *r, /* {{{ */
 
     for (i = 0; i < r->metadata_num; i++)
     {
+      r_area->metadata_buffer[i] = udb_column_to_string (
+          columns + r_area->metadata_pos[i],
+          r_area->numbers_buffer + (r->instances_num + i) * UDB_NUMBER_SIZE,
+          UDB_NUMBER_SIZE);
+
       status = meta_data_add_string (vl.meta, r->metadata[i],
           r_area->metadata_buffer[i]);
       if (status != 0)
@@ -289,14 +481,10 @@ static int udb_result_submit (udb_result_t *r, /* {{{ */
   }
   /* }}} */
 
-  plugin_dispatch_values (&vl);
+  q_area->batch[q_area->batch_num] = vl;
+  q_area->batch_num++;
+  q_area->batch_values_num += r->values_num;
 
-  if (r->metadata_num > 0)
-  {
-    meta_data_destroy (vl.meta);
-    vl.meta = NULL;
-  }
-  sfree (vl.values);
   return (0);
 } /* }}} void udb_result_submit */
 
@@ -311,29 +499,18 @@ static void udb_result_finish_result (udb_result_t const *r, /* {{{ */
   sfree (prep_area->values_pos);
   sfree (prep_area->metadata_pos);
   sfree (prep_area->instances_buffer);
-  sfree (prep_area->values_buffer);
   sfree (prep_area->metadata_buffer);
+  sfree (prep_area->numbers_buffer);
 } /* }}} void udb_result_finish_result */
 
 static int udb_result_handle_result (udb_result_t *r, /* {{{ */
     udb_query_preparation_area_t *q_area,
     udb_result_preparation_area_t *r_area,
-    udb_query_t const *q, char **column_values)
+    udb_query_t const *q, udb_column_t const *columns)
 {
-  size_t i;
-
   assert (r && q_area && r_area);
 
-  for (i = 0; i < r->instances_num; i++)
-    r_area->instances_buffer[i] = column_values[r_area->instances_pos[i]];
-
-  for (i = 0; i < r->values_num; i++)
-    r_area->values_buffer[i] = column_values[r_area->values_pos[i]];
-
-  for (i = 0; i < r->metadata_num; i++)
-    r_area->metadata_buffer[i] = column_values[r_area->metadata_pos[i]];
-
-  return udb_result_submit (r, r_area, q, q_area);
+  return udb_result_submit (r, r_area, q, q_area, columns);
 } /* }}} int udb_result_handle_result */
 
 static int udb_result_prepare_result (udb_result_t const *r, /* {{{ */
@@ -351,8 +528,8 @@ static int udb_result_prepare_result (udb_result_t const *r, /* {{{ */
   sfree (prep_area->values_pos); \
   sfree (prep_area->metadata_pos); \
   sfree (prep_area->instances_buffer); \
-  sfree (prep_area->values_buffer); \
   sfree (prep_area->metadata_buffer); \
+  sfree (prep_area->numbers_buffer); \
   return (status)
 
   /* Make sure previous preparations are cleaned up. */
@@ -383,7 +560,7 @@ static int udb_result_prepare_result (udb_result_t const *r, /* {{{ */
   /* }}} */
 
   /* Allocate r->instances_pos, r->values_pos, r->metadata_post,
-   * r->instances_buffer, r->values_buffer, and r->metadata_buffer {{{ */
+   * r->instances_buffer, r->metadata_buffer, and r->numbers_buffer {{{ */
   if (r->instances_num > 0)
   {
     prep_area->instances_pos
@@ -411,13 +588,6 @@ static int udb_result_prepare_result (udb_result_t const *r, /* {{{ */
     BAIL_OUT (-ENOMEM);
   }
 
-  prep_area->values_buffer
-    = (char **) calloc (r->values_num, sizeof (char *));
-  if (prep_area->values_buffer == NULL)
-  {
-    ERROR ("db query utils: udb_result_prepare_result: malloc failed.");
-    BAIL_OUT (-ENOMEM);
-  }
 
   prep_area->metadata_pos
     = (size_t *) calloc (r->metadata_num, sizeof (size_t));
@@ -435,6 +605,14 @@ static int udb_result_prepare_result (udb_result_t const *r, /* {{{ */
     BAIL_OUT (-ENOMEM);
   }
 
+  prep_area->numbers_buffer = calloc (r->instances_num + r->metadata_num + 1,
+      UDB_NUMBER_SIZE);
+  if (prep_area->numbers_buffer == NULL)
+  {
+    ERROR ("db query utils: udb_result_prepare_result: malloc failed.");
+    BAIL_OUT (-ENOMEM);
+  }
+
   /* }}} */
 
   /* Determine the position of the instance columns {{{ */
@@ -708,6 +886,8 @@ int udb_query_create (udb_query_t ***ret_query_list, /* {{{ */
       status = udb_config_set_uint (&q->min_version, child);
     else if (strcasecmp ("MaxVersion", child->key) == 0)
       status = udb_config_set_uint (&q->max_version, child);
+    else if (strcasecmp ("Statistics", child->key) == 0)
+      status = cf_util_get_boolean (child, &q->statistics);
 
     /* Call custom callbacks */
     else if (cb != NULL)
@@ -930,7 +1110,11 @@ void udb_query_finish_result (udb_query_t const *q, /* {{{ */
   if ((q == NULL) || (prep_area == NULL))
     return;
 
+  udb_query_dispatch_batch (prep_area);
+
   prep_area->column_num = 0;
+  prep_area->rows_num = 0;
+  sfree (prep_area->columns);
   sfree (prep_area->host);
   sfree (prep_area->plugin);
   sfree (prep_area->db_name);
@@ -949,13 +1133,37 @@ void udb_query_finish_result (udb_query_t const *q, /* {{{ */
 
 int udb_query_handle_result (udb_query_t const *q, /* {{{ */
     udb_query_preparation_area_t *prep_area, char **column_values)
+{
+  size_t i;
+
+  if ((q == NULL) || (prep_area == NULL))
+    return (-EINVAL);
+
+  if (prep_area->columns == NULL)
+  {
+    ERROR ("db query utils: Query `%s': Query is not prepared; "
+        "can't handle result.", q->name);
+    return (-EINVAL);
+  }
+
+  for (i = 0; i < prep_area->column_num; i++)
+  {
+    prep_area->columns[i].type = UDB_COLUMN_STRING;
+    prep_area->columns[i].value.string = column_values[i];
+  }
+
+  return (udb_query_handle_result_columns (q, prep_area, prep_area->columns));
+} /* }}} int udb_query_handle_result */
+
+int udb_query_handle_result_columns (udb_query_t const *q, /* {{{ */
+    udb_query_preparation_area_t *prep_area, udb_column_t const *columns)
 {
   udb_result_preparation_area_t *r_area;
   udb_result_t *r;
   int success;
   int status;
 
-  if ((q == NULL) || (prep_area == NULL))
+  if ((q == NULL) || (prep_area == NULL) || (columns == NULL))
     return (-EINVAL);
 
   if ((prep_area->column_num < 1) || (prep_area->host == NULL)
@@ -969,23 +1177,27 @@ int udb_query_handle_result (udb_query_t const *q, /* {{{ */
 #if defined(COLLECT_DEBUG) && COLLECT_DEBUG /* {{{ */
   do
   {
+    char buffer[UDB_NUMBER_SIZE];
     size_t i;
 
     for (i = 0; i < prep_area->column_num; i++)
     {
       DEBUG ("db query utils: udb_query_handle_result (%s, %s): "
           "column[%zu] = %s;",
-          prep_area->db_name, q->name, i, column_values[i]);
+          prep_area->db_name, q->name, i,
+          udb_column_to_string (columns + i, buffer, sizeof (buffer)));
     }
   } while (0);
 #endif /* }}} */
 
+  prep_area->rows_num++;
+
   success = 0;
   for (r = q->results, r_area = prep_area->result_prep_areas;
       r != NULL; r = r->next, r_area = r_area->next)
   {
     status = udb_result_handle_result (r, prep_area, r_area,
-        q, column_values);
+        q, columns);
     if (status == 0)
       success++;
   }
@@ -998,7 +1210,36 @@ int udb_query_handle_result (udb_query_t const *q, /* {{{ */
   }
 
   return (0);
-} /* }}} int udb_query_handle_result */
+} /* }}} int udb_query_handle_result_columns */
+
+void udb_query_submit_stats (udb_query_t const *q, /* {{{ */
+    udb_query_preparation_area_t *prep_area, cdtime_t duration)
+{
+  value_list_t vl = VALUE_LIST_INIT;
+  value_t value;
+
+  if ((q == NULL) || (prep_area == NULL) || !q->statistics
+      || (prep_area->host == NULL))
+    return;
+
+  vl.values = &value;
+  vl.values_len = 1;
+  if (prep_area->interval > 0)
+    vl.interval = prep_area->interval;
+  sstrncpy (vl.host, prep_area->host, sizeof (vl.host));
+  sstrncpy (vl.plugin, prep_area->plugin, sizeof (vl.plugin));
+  sstrncpy (vl.plugin_instance, prep_area->db_name,
+      sizeof (vl.plugin_instance));
+  sstrncpy (vl.type_instance, q->name, sizeof (vl.type_instance));
+
+  sstrncpy (vl.type, "duration", sizeof (vl.type));
+  value.gauge = CDTIME_T_TO_DOUBLE (duration);
+  plugin_dispatch_values (&vl);
+
+  sstrncpy (vl.type, "records", sizeof (vl.type));
+  value.gauge = (gauge_t) prep_area->rows_num;
+  plugin_dispatch_values (&vl);
+} /* }}} void udb_query_submit_stats */
 
 int udb_query_prepare_result (udb_query_t const *q, /* {{{ */
     udb_query_preparation_area_t *prep_area,
@@ -1012,6 +1253,8 @@ int udb_query_prepare_result (udb_query_t const *q, /* {{{ */
   if ((q == NULL) || (prep_area == NULL))
     return (-EINVAL);
 
+  /* Dispatches the last batch of the previous result if the caller didn't
+   * finish it. */
   udb_query_finish_result (q, prep_area);
 
   prep_area->column_num = column_num;
@@ -1020,9 +1263,10 @@ int udb_query_prepare_result (udb_query_t const *q, /* {{{ */
   prep_area->db_name = strdup (db_name);
 
   prep_area->interval = interval;
+  prep_area->columns = calloc (column_num, sizeof (*prep_area->columns));
 
   if ((prep_area->host == NULL) || (prep_area->plugin == NULL)
-      || (prep_area->db_name == NULL))
+      || (prep_area->db_name == NULL) || (prep_area->columns == NULL))
   {
     ERROR ("db query utils: Query `%s': Prepare failed: Out of memory.", q->name);
     udb_query_finish_result (q, prep_area);
@@ -1115,6 +1359,9 @@ udb_query_delete_preparation_area (udb_query_preparation_area_t *q_area) /* {{{
   if (q_area == NULL)
     return;
 
+  /* Don't lose the last batch of an unfinished result. */
+  udb_query_dispatch_batch (q_area);
+
   r_area = q_area->result_prep_areas;
   while (r_area != NULL)
   {
@@ -1124,14 +1371,19 @@ udb_query_delete_preparation_area (udb_query_preparation_area_t *q_area) /* {{{
 
     sfree (area->instances_pos);
     sfree (area->values_pos);
+    sfree (area->metadata_pos);
     sfree (area->instances_buffer);
-    sfree (area->values_buffer);
+    sfree (area->metadata_buffer);
+    sfree (area->numbers_buffer);
     free (area);
   }
 
   sfree (q_area->host);
   sfree (q_area->plugin);
   sfree (q_area->db_name);
+  sfree (q_area->columns);
+  sfree (q_area->batch);
+  sfree (q_area->batch_values);
 
   free (q_area);
 } /* }}} void udb_query_delete_preparation_area */
@@ -41,6 +41,28 @@ typedef struct udb_query_preparation_area_s udb_query_preparation_area_t;
 typedef int (*udb_query_create_callback_t) (udb_query_t *q,
     oconfig_item_t *ci);
 
+/* A single field of a result row. Drivers which know the type of a column
+ * pass numbers as such, saving the conversion to a string and back. Numbers
+ * used as instance or meta data are formatted as needed. */
+enum udb_column_type_e
+{
+  UDB_COLUMN_STRING = 0,
+  UDB_COLUMN_INTEGER,
+  UDB_COLUMN_DOUBLE
+};
+
+struct udb_column_s
+{
+  enum udb_column_type_e type;
+  union
+  {
+    char const *string;
+    int64_t integer;
+    double number;
+  } value;
+};
+typedef struct udb_column_s udb_column_t;
+
 /* 
  * Public functions
  */
@@ -76,9 +98,27 @@ int udb_query_prepare_result (udb_query_t const *q,
     char **column_names, size_t column_num, cdtime_t interval);
 int udb_query_handle_result (udb_query_t const *q,
     udb_query_preparation_area_t *prep_area, char **column_values);
+int udb_query_handle_result_columns (udb_query_t const *q,
+    udb_query_preparation_area_t *prep_area, udb_column_t const *columns);
+/* Value lists are collected while handling the rows of a result and
+ * dispatched in batches. The last batch is dispatched by
+ * udb_query_finish_result. Callers which don't call it, e.g. on an error
+ * path, don't lose that batch: it is dispatched by the next call to
+ * udb_query_prepare_result or by udb_query_delete_preparation_area, i.e.
+ * up to one interval late. */
 void udb_query_finish_result (udb_query_t const *q,
     udb_query_preparation_area_t *prep_area);
 
+/*
+ * udb_query_submit_stats
+ *
+ * Dispatches the time it took to execute the query and the number of rows
+ * handled since udb_query_prepare_result, if the "Statistics" option is
+ * enabled for the query. Must be called before udb_query_finish_result.
+ */
+void udb_query_submit_stats (udb_query_t const *q,
+    udb_query_preparation_area_t *prep_area, cdtime_t duration);
+
 udb_query_preparation_area_t *
 udb_query_allocate_preparation_area (udb_query_t *q);
 void
@@ -0,0 +1,290 @@
+/**
+ * collectd - src/utils_db_query_test.c
+ * Copyright (C) 2026       agent
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   agent <agent at local>
+ */
+
+/* Batches are handed to this function instead of the daemon. */
+#define plugin_dispatch_values_list test_dispatch_values_list
+
+#include "utils_db_query.c" /* sic */
+#include "testing.h"
+
+#define ROWS_NUM 600
+
+static data_source_t dsrc_gauge[] = {
+  { "value", DS_TYPE_GAUGE, 0.0, NAN }
+};
+static data_set_t ds_gauge = { "gauge", STATIC_ARRAY_SIZE (dsrc_gauge),
+  dsrc_gauge };
+
+static size_t batches[8];
+static size_t batches_num = 0;
+static gauge_t dispatched[ROWS_NUM];
+static char dispatched_instance[ROWS_NUM][DATA_MAX_NAME_LEN];
+static size_t dispatched_num = 0;
+
+int test_dispatch_values_list (value_list_t const *vl, size_t vl_num)
+{
+  size_t i;
+
+  if (batches_num < STATIC_ARRAY_SIZE (batches))
+    batches[batches_num] = vl_num;
+  batches_num++;
+
+  for (i = 0; (i < vl_num) && (dispatched_num < ROWS_NUM); i++)
+  {
+    dispatched[dispatched_num] = vl[i].values[0].gauge;
+    sstrncpy (dispatched_instance[dispatched_num], vl[i].type_instance,
+        sizeof (dispatched_instance[dispatched_num]));
+    dispatched_num++;
+  }
+
+  return (0);
+}
+
+const data_set_t *plugin_get_ds (const char *name)
+{
+  if (strcmp (name, ds_gauge.type) == 0)
+    return (&ds_gauge);
+  return (NULL);
+}
+
+int cf_util_get_boolean (const oconfig_item_t *ci, _Bool *ret_bool)
+{
+  return (ENOTSUP);
+}
+
+DEF_TEST(column_to_value)
+{
+  struct {
+    udb_column_t column;
+    int ds_type;
+    int want_status;
+    double want;
+  } cases[] = {
+    { { UDB_COLUMN_INTEGER, { .integer = 42 } }, DS_TYPE_GAUGE,    0, 42.0 },
+    { { UDB_COLUMN_INTEGER, { .integer = -3 } }, DS_TYPE_DERIVE,   0, -3.0 },
+    { { UDB_COLUMN_INTEGER, { .integer = 7 } },  DS_TYPE_COUNTER,  0, 7.0 },
+    { { UDB_COLUMN_DOUBLE,  { .number = 1.5 } }, DS_TYPE_GAUGE,    0, 1.5 },
+    { { UDB_COLUMN_DOUBLE,  { .number = 9.9 } }, DS_TYPE_ABSOLUTE, 0, 9.0 },
+    { { UDB_COLUMN_STRING,  { .string = "12" } },     DS_TYPE_DERIVE,  0, 12.0 },
+    { { UDB_COLUMN_STRING,  { .string = "0x10" } },   DS_TYPE_COUNTER, 0, 16.0 },
+    { { UDB_COLUMN_STRING,  { .string = "2.25 " } },  DS_TYPE_GAUGE,   0, 2.25 },
+    /* Left to parse_value, which ignores trailing garbage. */
+    { { UDB_COLUMN_STRING,  { .string = "12abc" } },  DS_TYPE_DERIVE,  0, 12.0 },
+    { { UDB_COLUMN_STRING,  { .string = "abc" } },    DS_TYPE_DERIVE, -1, 0.0 },
+    { { UDB_COLUMN_STRING,  { .string = "" } },       DS_TYPE_GAUGE,  -1, 0.0 },
+    { { UDB_COLUMN_STRING,  { .string = NULL } },     DS_TYPE_GAUGE,  -1, 0.0 },
+  };
+  size_t i;
+
+  for (i = 0; i < STATIC_ARRAY_SIZE (cases); i++)
+  {
+    value_t v;
+    int status;
+
+    memset (&v, 0, sizeof (v));
+    status = udb_column_to_value (&cases[i].column, &v, cases[i].ds_type);
+    if (cases[i].want_status != 0)
+    {
+      OK (status != 0);
+      continue;
+    }
+
+    EXPECT_EQ_INT (0, status);
+    switch (cases[i].ds_type)
+    {
+      case DS_TYPE_COUNTER:
+        EXPECT_EQ_UINT64 ((uint64_t) cases[i].want, (uint64_t) v.counter);
+        break;
+      case DS_TYPE_GAUGE:
+        EXPECT_EQ_DOUBLE (cases[i].want, v.gauge);
+        break;
+      case DS_TYPE_DERIVE:
+        EXPECT_EQ_INT ((int) cases[i].want, (int) v.derive);
+        break;
+      case DS_TYPE_ABSOLUTE:
+        EXPECT_EQ_UINT64 ((uint64_t) cases[i].want, (uint64_t) v.absolute);
+        break;
+    }
+  }
+
+  return (0);
+}
+
+DEF_TEST(batches)
+{
+  char *instances[] = { "name" };
+  char *values[] = { "value" };
+  char *column_names[] = { "name", "value" };
+  udb_result_t r;
+  udb_query_t q;
+  udb_query_preparation_area_t *prep_area;
+  size_t i;
+
+  memset (&r, 0, sizeof (r));
+  r.type = "gauge";
+  r.instance_prefix = "row";
+  r.instances = instances;
+  r.instances_num = STATIC_ARRAY_SIZE (instances);
+  r.values = values;
+  r.values_num = STATIC_ARRAY_SIZE (values);
+
+  memset (&q, 0, sizeof (q));
+  q.name = "test";
+  q.statement = "SELECT name, value FROM test";
+  q.max_version = UINT_MAX;
+  q.results = &r;
+
+  CHECK_NOT_NULL (prep_area = udb_query_allocate_preparation_area (&q));
+  CHECK_ZERO (udb_query_prepare_result (&q, prep_area, "example.com",
+        "test", "db", column_names, STATIC_ARRAY_SIZE (column_names),
+        /* interval = */ 0));
+
+  /* Alternate between typed and string columns; both end up in the same
+   * batch. */
+  for (i = 0; i < ROWS_NUM; i++)
+  {
+    if (i % 2 == 0)
+    {
+      udb_column_t columns[2];
+
+      columns[0].type = UDB_COLUMN_INTEGER;
+      columns[0].value.integer = (int64_t) i;
+      columns[1].type = UDB_COLUMN_DOUBLE;
+      columns[1].value.number = (double) i;
+      CHECK_ZERO (udb_query_handle_result_columns (&q, prep_area, columns));
+    }
+    else
+    {
+      char name[32];
+      char value[32];
+      char *column_values[] = { name, value };
+
+      ssnprintf (name, sizeof (name), "%zu", i);
+      ssnprintf (value, sizeof (value), "%zu", i);
+      CHECK_ZERO (udb_query_handle_result (&q, prep_area, column_values));
+    }
+  }
+
+  /* Full batches are dispatched while rows are handled, the rest when the
+   * result is finished. */
+  EXPECT_EQ_INT (2, (int) batches_num);
+  udb_query_finish_result (&q, prep_area);
+  EXPECT_EQ_INT (3, (int) batches_num);
+
+  EXPECT_EQ_INT (UDB_BATCH_SIZE, (int) batches[0]);
+  EXPECT_EQ_INT (UDB_BATCH_SIZE, (int) batches[1]);
+  EXPECT_EQ_INT (ROWS_NUM - 2 * UDB_BATCH_SIZE, (int) batches[2]);
+  EXPECT_EQ_INT (ROWS_NUM, (int) dispatched_num);
+
+  for (i = 0; i < ROWS_NUM; i++)
+  {
+    char want[DATA_MAX_NAME_LEN];
+
+    ssnprintf (want, sizeof (want), "row-%zu", i);
+    EXPECT_EQ_STR (want, dispatched_instance[i]);
+    EXPECT_EQ_DOUBLE ((double) i, dispatched[i]);
+  }
+
+  udb_query_delete_preparation_area (prep_area);
+  return (0);
+}
+
+DEF_TEST(unfinished_result)
+{
+  char *instances[] = { "name" };
+  char *values[] = { "value" };
+  char *column_names[] = { "name", "value" };
+  udb_result_t r;
+  udb_query_t q;
+  udb_query_preparation_area_t *prep_area;
+  size_t i;
+
+  memset (&r, 0, sizeof (r));
+  r.type = "gauge";
+  r.instances = instances;
+  r.instances_num = STATIC_ARRAY_SIZE (instances);
+  r.values = values;
+  r.values_num = STATIC_ARRAY_SIZE (values);
+
+  memset (&q, 0, sizeof (q));
+  q.name = "test";
+  q.statement = "SELECT name, value FROM test";
+  q.max_version = UINT_MAX;
+  q.results = &r;
+
+  batches_num = 0;
+  dispatched_num = 0;
+
+  CHECK_NOT_NULL (prep_area = udb_query_allocate_preparation_area (&q));
+  for (i = 0; i < 5; i++)
+  {
+    char name[32];
+    char value[32];
+    char *column_values[] = { name, value };
+
+    /* Start a new result after three rows without finishing the first. */
+    if ((i == 0) || (i == 3))
+      CHECK_ZERO (udb_query_prepare_result (&q, prep_area, "example.com",
+            "test", "db", column_names, STATIC_ARRAY_SIZE (column_names),
+            /* interval = */ 0));
+
+    ssnprintf (name, sizeof (name), "%zu", i);
+    ssnprintf (value, sizeof (value), "%zu", i);
+    CHECK_ZERO (udb_query_handle_result (&q, prep_area, column_values));
+  }
+
+  /* The first result has been dispatched by udb_query_prepare_result. */
+  EXPECT_EQ_INT (1, (int) batches_num);
+  EXPECT_EQ_INT (3, (int) batches[0]);
+
+  /* The second one is dispatched when the area is deleted. */
+  udb_query_delete_preparation_area (prep_area);
+  EXPECT_EQ_INT (2, (int) batches_num);
+  EXPECT_EQ_INT (2, (int) batches[1]);
+  EXPECT_EQ_INT (5, (int) dispatched_num);
+
+  for (i = 0; i < 5; i++)
+  {
+    char want[DATA_MAX_NAME_LEN];
+
+    ssnprintf (want, sizeof (want), "%zu", i);
+    EXPECT_EQ_STR (want, dispatched_instance[i]);
+    EXPECT_EQ_DOUBLE ((double) i, dispatched[i]);
+  }
+
+  return (0);
+}
+
+int main (void)
+{
+  RUN_TEST(column_to_value);
+  RUN_TEST(batches);
+  RUN_TEST(unfinished_result);
+
+  END_TEST;
+}
+
+/* vim: set sw=2 sts=2 et : */
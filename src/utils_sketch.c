@@ -0,0 +1,349 @@
+/**
+ * collectd - src/utils_sketch.c
+ * Copyright (C) 2026       agent
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   agent <agent at local>
+ **/
+
+#include "collectd.h"
+#include "common.h"
+#include "utils_sketch.h"
+
+#include <math.h>
+
+/* Values closer to zero than this are counted as zero. */
+#ifndef SKETCH_MIN_VALUE
+# define SKETCH_MIN_VALUE 1e-9
+#endif
+
+/* Bins are allocated in chunks of this size. */
+#ifndef SKETCH_BINS_CHUNK
+# define SKETCH_BINS_CHUNK 64
+#endif
+
+/* Upper bound for the number of bins per store. With one percent accuracy
+ * this covers about 17 orders of magnitude. If values span a larger range,
+ * the bins of the values closest to zero are collapsed. */
+#ifndef SKETCH_MAX_BINS
+# define SKETCH_MAX_BINS 2048
+#endif
+
+struct sketch_store_s
+{
+  uint64_t *bins;
+  size_t bins_num;
+  /* key of bins[0] */
+  int offset;
+};
+typedef struct sketch_store_s sketch_store_t;
+
+struct sketch_s
+{
+  double gamma;
+  double log_gamma;
+
+  uint64_t num;
+  uint64_t zero_num;
+
+  double min;
+  double max;
+
+  sketch_store_t positive;
+  sketch_store_t negative;
+};
+
+static int sketch_key (sketch_t const *s, double value) /* {{{ */
+{
+  return ((int) ceil (log (value) / s->log_gamma));
+} /* }}} int sketch_key */
+
+/* Returns the value in the middle of the bin identified by "key", so that the
+ * relative error towards both bin boundaries is the same. */
+static double sketch_key_value (sketch_t const *s, int key) /* {{{ */
+{
+  return (2.0 * pow (s->gamma, (double) key) / (s->gamma + 1.0));
+} /* }}} double sketch_key_value */
+
+/* Resizes the store so that "key" fits into it. Returns the key that the
+ * value must be accounted to, which differs from "key" if the lowest bins had
+ * to be collapsed. */
+static int store_grow (sketch_store_t *st, int key, int *ret_key) /* {{{ */
+{
+  int lo;
+  int hi;
+  size_t new_num;
+  uint64_t *new_bins;
+  size_t i;
+
+  if (st->bins_num == 0)
+  {
+    lo = key - (SKETCH_BINS_CHUNK / 2);
+    hi = lo + SKETCH_BINS_CHUNK - 1;
+  }
+  else
+  {
+    lo = (key < st->offset) ? key : st->offset;
+    hi = st->offset + ((int) st->bins_num) - 1;
+    if (key > hi)
+      hi = key;
+  }
+
+  new_num = (size_t) (hi - lo + 1);
+  new_num = SKETCH_BINS_CHUNK
+    * ((new_num + SKETCH_BINS_CHUNK - 1) / SKETCH_BINS_CHUNK);
+  if (new_num > SKETCH_MAX_BINS)
+    new_num = SKETCH_MAX_BINS;
+
+  /* Keep the highest bins, i.e. the ones with the largest magnitude. */
+  if ((hi - lo + 1) > (int) new_num)
+    lo = hi - ((int) new_num) + 1;
+  else if (key < st->offset)
+    lo = hi - ((int) new_num) + 1;
+
+  new_bins = calloc (new_num, sizeof (*new_bins));
+  if (new_bins == NULL)
+    return (ENOMEM);
+
+  for (i = 0; i < st->bins_num; i++)
+  {
+    int k = st->offset + ((int) i);
+
+    if (st->bins[i] == 0)
+      continue;
+
+    if (k < lo)
+      k = lo;
+    new_bins[k - lo] += st->bins[i];
+  }
+
+  sfree (st->bins);
+  st->bins = new_bins;
+  st->bins_num = new_num;
+  st->offset = lo;
+
+  *ret_key = (key < lo) ? lo : key;
+  return (0);
+} /* }}} int store_grow */
+
+static int store_add (sketch_store_t *st, int key, uint64_t count) /* {{{ */
+{
+  if ((st->bins_num == 0) || (key < st->offset)
+      || (key >= (st->offset + ((int) st->bins_num))))
+  {
+    int status = store_grow (st, key, &key);
+    if (status != 0)
+      return (status);
+  }
+
+  st->bins[key - st->offset] += count;
+  return (0);
+} /* }}} int store_add */
+
+sketch_t *sketch_create (double relative_accuracy) /* {{{ */
+{
+  sketch_t *s;
+
+  if (!(relative_accuracy > 0.0) || !(relative_accuracy < 1.0))
+    return (NULL);
+
+  s = malloc (sizeof (*s));
+  if (s == NULL)
+    return (NULL);
+  memset (s, 0, sizeof (*s));
+
+  s->gamma = (1.0 + relative_accuracy) / (1.0 - relative_accuracy);
+  s->log_gamma = log (s->gamma);
+  s->min = NAN;
+  s->max = NAN;
+
+  return (s);
+} /* }}} sketch_t *sketch_create */
+
+void sketch_destroy (sketch_t *s) /* {{{ */
+{
+  if (s == NULL)
+    return;
+
+  sfree (s->positive.bins);
+  sfree (s->negative.bins);
+  sfree (s);
+} /* }}} void sketch_destroy */
+
+int sketch_add (sketch_t *s, double value) /* {{{ */
+{
+  int status = 0;
+
+  if ((s == NULL) || isnan (value))
+    return (EINVAL);
+
+  if (value >= SKETCH_MIN_VALUE)
+    status = store_add (&s->positive, sketch_key (s, value), 1);
+  else if (value <= -SKETCH_MIN_VALUE)
+    status = store_add (&s->negative, sketch_key (s, -value), 1);
+  else
+    s->zero_num++;
+
+  if (status != 0)
+    return (status);
+
+  if (isnan (s->min) || (s->min > value))
+    s->min = value;
+  if (isnan (s->max) || (s->max < value))
+    s->max = value;
+  s->num++;
+
+  return (0);
+} /* }}} int sketch_add */
+
+int sketch_merge (sketch_t *dst, sketch_t const *src) /* {{{ */
+{
+  size_t i;
+
+  if ((dst == NULL) || (src == NULL))
+    return (EINVAL);
+
+  if (dst->gamma != src->gamma)
+    return (EINVAL);
+
+  if (src->num == 0)
+    return (0);
+
+  for (i = 0; i < src->positive.bins_num; i++)
+  {
+    int status;
+
+    if (src->positive.bins[i] == 0)
+      continue;
+
+    status = store_add (&dst->positive, src->positive.offset + ((int) i),
+        src->positive.bins[i]);
+    if (status != 0)
+      return (status);
+  }
+
+  for (i = 0; i < src->negative.bins_num; i++)
+  {
+    int status;
+
+    if (src->negative.bins[i] == 0)
+      continue;
+
+    status = store_add (&dst->negative, src->negative.offset + ((int) i),
+        src->negative.bins[i]);
+    if (status != 0)
+      return (status);
+  }
+
+  dst->zero_num += src->zero_num;
+  dst->num += src->num;
+
+  if (isnan (dst->min) || (dst->min > src->min))
+    dst->min = src->min;
+  if (isnan (dst->max) || (dst->max < src->max))
+    dst->max = src->max;
+
+  return (0);
+} /* }}} int sketch_merge */
+
+void sketch_reset (sketch_t *s) /* {{{ */
+{
+  if (s == NULL)
+    return;
+
+  if (s->positive.bins != NULL)
+    memset (s->positive.bins, 0,
+        s->positive.bins_num * sizeof (*s->positive.bins));
+  if (s->negative.bins != NULL)
+    memset (s->negative.bins, 0,
+        s->negative.bins_num * sizeof (*s->negative.bins));
+
+  s->num = 0;
+  s->zero_num = 0;
+  s->min = NAN;
+  s->max = NAN;
+} /* }}} void sketch_reset */
+
+uint64_t sketch_get_num (sketch_t const *s) /* {{{ */
+{
+  if (s == NULL)
+    return (0);
+  return (s->num);
+} /* }}} uint64_t sketch_get_num */
+
+double sketch_get_percentile (sketch_t const *s, double percent) /* {{{ */
+{
+  double rank;
+  uint64_t sum;
+  double value = NAN;
+  size_t i;
+
+  if ((s == NULL) || (s->num == 0)
+      || !((percent >= 0.0) && (percent <= 100.0)))
+    return (NAN);
+
+  if (percent == 0.0)
+    return (s->min);
+  else if (percent == 100.0)
+    return (s->max);
+
+  /* Zero-based rank of the requested value. */
+  rank = (percent / 100.0) * ((double) (s->num - 1));
+  sum = 0;
+
+  /* Negative values: the largest magnitude comes first. */
+  for (i = s->negative.bins_num; i > 0; i--)
+  {
+    sum += s->negative.bins[i - 1];
+    if (((double) sum) > rank)
+    {
+      value = -sketch_key_value (s, s->negative.offset + ((int) i) - 1);
+      break;
+    }
+  }
+
+  if (isnan (value))
+  {
+    sum += s->zero_num;
+    if (((double) sum) > rank)
+      value = 0.0;
+  }
+
+  for (i = 0; isnan (value) && (i < s->positive.bins_num); i++)
+  {
+    sum += s->positive.bins[i];
+    if (((double) sum) > rank)
+      value = sketch_key_value (s, s->positive.offset + ((int) i));
+  }
+
+  if (isnan (value))
+    return (s->max);
+
+  /* The bin's center may lie outside of the range actually seen. */
+  if (value < s->min)
+    value = s->min;
+  if (value > s->max)
+    value = s->max;
+
+  return (value);
+} /* }}} double sketch_get_percentile */
+
+/* vim: set sw=2 sts=2 et fdm=marker : */
@@ -0,0 +1,61 @@
+/**
+ * collectd - src/utils_sketch.h
+ * Copyright (C) 2026       agent
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   agent <agent at local>
+ **/
+
+#ifndef UTILS_SKETCH_H
+#define UTILS_SKETCH_H 1
+
+#include "collectd.h"
+
+/*
+ * Mergeable quantile sketch. Values are sorted into logarithmically sized
+ * bins, so that every quantile is reported with a bounded relative error.
+ * Two sketches created with the same accuracy can be merged by adding up
+ * their bins, which makes it possible to keep one sketch per thread and
+ * combine them when reading.
+ */
+struct sketch_s;
+typedef struct sketch_s sketch_t;
+
+/* "relative_accuracy" is the maximum relative error of reported quantiles,
+ * e.g. 0.01 for one percent. */
+sketch_t *sketch_create (double relative_accuracy);
+void sketch_destroy (sketch_t *s);
+
+int sketch_add (sketch_t *s, double value);
+/* Adds all values of "src" to "dst". Both sketches must have been created
+ * with the same accuracy. */
+int sketch_merge (sketch_t *dst, sketch_t const *src);
+/* Removes all values but keeps the allocated bins around for reuse. */
+void sketch_reset (sketch_t *s);
+
+uint64_t sketch_get_num (sketch_t const *s);
+/* Returns the value below which "percent" percent of all values fall, or NAN
+ * if the sketch is empty or "percent" is not within [0, 100]. */
+double sketch_get_percentile (sketch_t const *s, double percent);
+
+#endif /* UTILS_SKETCH_H */
+
+/* vim: set sw=2 sts=2 et : */
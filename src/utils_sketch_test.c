@@ -0,0 +1,167 @@
+/**
+ * collectd - src/utils_sketch_test.c
+ * Copyright (C) 2026       agent
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   agent <agent at local>
+ */
+
+#include "common.h" /* for STATIC_ARRAY_SIZE */
+#include "collectd.h"
+#include "testing.h"
+#include "utils_sketch.h"
+
+/* Sketches are created with one percent accuracy below. */
+#define EXPECT_NEAR(expect, actual) do { \
+  double want__ = (double) expect; \
+  double got__  = (double) actual; \
+  double err__  = fabs (want__ - got__) / fabs (want__); \
+  if (!(err__ <= 0.01)) { \
+    printf ("not ok %i - %s = %.15g, want %.15g\n", \
+        ++check_count__, #actual, got__, want__); \
+    return (-1); \
+  } \
+  printf ("ok %i - %s = %.15g\n", ++check_count__, #actual, got__); \
+} while (0)
+
+DEF_TEST(percentile)
+{
+  sketch_t *s;
+  int i;
+
+  CHECK_NOT_NULL (s = sketch_create (0.01));
+  OK (isnan (sketch_get_percentile (s, 50.0)));
+
+  for (i = 1; i <= 1000; i++)
+    CHECK_ZERO (sketch_add (s, (double) i));
+
+  EXPECT_EQ_UINT64 (1000, sketch_get_num (s));
+  EXPECT_EQ_DOUBLE (   1.0, sketch_get_percentile (s,   0.0));
+  EXPECT_EQ_DOUBLE (1000.0, sketch_get_percentile (s, 100.0));
+  EXPECT_NEAR ( 500.0, sketch_get_percentile (s, 50.0));
+  EXPECT_NEAR ( 950.0, sketch_get_percentile (s, 95.0));
+  EXPECT_NEAR ( 990.0, sketch_get_percentile (s, 99.0));
+
+  OK (isnan (sketch_get_percentile (s,  -1.0)));
+  OK (isnan (sketch_get_percentile (s, 101.0)));
+
+  sketch_reset (s);
+  EXPECT_EQ_UINT64 (0, sketch_get_num (s));
+  OK (isnan (sketch_get_percentile (s, 50.0)));
+
+  sketch_destroy (s);
+  return (0);
+}
+
+DEF_TEST(signed_values)
+{
+  double values[] = { -100.0, -10.0, -1.0, 0.0, 1.0, 10.0, 100.0 };
+  sketch_t *s;
+  size_t i;
+
+  CHECK_NOT_NULL (s = sketch_create (0.01));
+
+  for (i = 0; i < STATIC_ARRAY_SIZE (values); i++)
+    CHECK_ZERO (sketch_add (s, values[i]));
+
+  EXPECT_EQ_DOUBLE (-100.0, sketch_get_percentile (s, 0.0));
+  EXPECT_NEAR (-10.0, sketch_get_percentile (s, 20.0));
+  EXPECT_EQ_DOUBLE (0.0, sketch_get_percentile (s, 50.0));
+  EXPECT_NEAR ( 10.0, sketch_get_percentile (s, 85.0));
+  EXPECT_EQ_DOUBLE (100.0, sketch_get_percentile (s, 100.0));
+
+  sketch_destroy (s);
+  return (0);
+}
+
+DEF_TEST(merge)
+{
+  sketch_t *a;
+  sketch_t *b;
+  sketch_t *all;
+  int i;
+
+  CHECK_NOT_NULL (a = sketch_create (0.01));
+  CHECK_NOT_NULL (b = sketch_create (0.01));
+  CHECK_NOT_NULL (all = sketch_create (0.01));
+
+  /* Two disjunct ranges, so that merging has to grow the bins. */
+  for (i = 1; i <= 500; i++)
+  {
+    CHECK_ZERO (sketch_add (a, (double) i));
+    CHECK_ZERO (sketch_add (b, (double) (1000000 + i)));
+    CHECK_ZERO (sketch_add (all, (double) i));
+    CHECK_ZERO (sketch_add (all, (double) (1000000 + i)));
+  }
+
+  CHECK_ZERO (sketch_merge (a, b));
+  EXPECT_EQ_UINT64 (1000, sketch_get_num (a));
+  EXPECT_EQ_DOUBLE (1.0, sketch_get_percentile (a, 0.0));
+  EXPECT_EQ_DOUBLE (1000500.0, sketch_get_percentile (a, 100.0));
+  EXPECT_EQ_DOUBLE (sketch_get_percentile (all, 25.0),
+      sketch_get_percentile (a, 25.0));
+  EXPECT_EQ_DOUBLE (sketch_get_percentile (all, 75.0),
+      sketch_get_percentile (a, 75.0));
+  EXPECT_NEAR (250.0, sketch_get_percentile (a, 25.0));
+  EXPECT_NEAR (1000250.0, sketch_get_percentile (a, 75.0));
+
+  /* Sketches with different accuracy can't be merged. */
+  sketch_destroy (b);
+  CHECK_NOT_NULL (b = sketch_create (0.05));
+  OK (sketch_merge (a, b) != 0);
+
+  sketch_destroy (a);
+  sketch_destroy (b);
+  sketch_destroy (all);
+  return (0);
+}
+
+DEF_TEST(wide_range)
+{
+  sketch_t *s;
+  int i;
+
+  CHECK_NOT_NULL (s = sketch_create (0.01));
+
+  /* Spans more orders of magnitude than fit into the bins. The smallest
+   * values are collapsed, the largest ones must stay accurate. */
+  for (i = -8; i < 30; i++)
+    CHECK_ZERO (sketch_add (s, pow (10.0, (double) i)));
+
+  EXPECT_EQ_UINT64 (38, sketch_get_num (s));
+  EXPECT_NEAR (1e29, sketch_get_percentile (s, 100.0));
+  EXPECT_NEAR (1e28, sketch_get_percentile (s, 98.0));
+
+  sketch_destroy (s);
+  return (0);
+}
+
+int main (void)
+{
+  RUN_TEST(percentile);
+  RUN_TEST(signed_values);
+  RUN_TEST(merge);
+  RUN_TEST(wide_range);
+
+  END_TEST;
+}
+
+/* vim: set sw=2 sts=2 et : */
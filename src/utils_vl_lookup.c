@@ -46,6 +46,22 @@ kstat_ctl_t *kc;
 } while (0)
 #endif
 
+/* Default number of slots in the per-identifier result cache. Each occupied
+ * slot takes about 700 bytes. */
+#ifndef LU_CACHE_SIZE_DEFAULT
+# define LU_CACHE_SIZE_DEFAULT 1024
+#endif
+
+/* Number of locks protecting the cache slots. */
+#ifndef LU_CACHE_LOCKS_NUM
+# define LU_CACHE_LOCKS_NUM 64
+#endif
+
+/* Identifiers matching more user classes than this are not cached. */
+#ifndef LU_CACHE_MAX_MATCHES
+# define LU_CACHE_MAX_MATCHES 16
+#endif
+
 /*
  * Types
  */
@@ -69,15 +85,8 @@ struct identifier_match_s
 };
 typedef struct identifier_match_s identifier_match_t;
 
-struct lookup_s
-{
-  c_avl_tree_t *by_type_tree;
-
-  lookup_class_callback_t cb_user_class;
-  lookup_obj_callback_t cb_user_obj;
-  lookup_free_class_callback_t cb_free_class;
-  lookup_free_obj_callback_t cb_free_obj;
-};
+struct user_class_s;
+typedef struct user_class_s user_class_t;
 
 struct user_obj_s;
 typedef struct user_obj_s user_obj_t;
@@ -96,7 +105,6 @@ struct user_class_s
   identifier_match_t match;
   user_obj_t *user_obj_list; /* list of user_obj */
 };
-typedef struct user_class_s user_class_t;
 
 struct user_class_list_s;
 typedef struct user_class_list_s user_class_list_t;
@@ -113,6 +121,59 @@ struct by_type_entry_s
 };
 typedef struct by_type_entry_s by_type_entry_t;
 
+/* One user class / user object pair an identifier was handed to. */
+struct lu_match_s
+{
+  user_class_t *user_class;
+  user_obj_t *user_obj;
+};
+typedef struct lu_match_s lu_match_t;
+
+struct lu_match_list_s
+{
+  lu_match_t matches[LU_CACHE_MAX_MATCHES];
+  size_t matches_num;
+  /* set if more than LU_CACHE_MAX_MATCHES user classes matched */
+  _Bool overflow;
+};
+typedef struct lu_match_list_s lu_match_list_t;
+
+/* Result of a previous lookup for one identifier. An entry with zero matches
+ * is a "negative" entry, i.e. the identifier does not match anything. */
+struct lu_cache_entry_s
+{
+  char key[5 * DATA_MAX_NAME_LEN];
+  size_t key_len;
+  uint32_t hash;
+  unsigned int generation;
+
+  lu_match_t *matches;
+  size_t matches_num;
+};
+typedef struct lu_cache_entry_s lu_cache_entry_t;
+
+struct lookup_s
+{
+  /* Protects by_type_tree, the by_plugin trees and the user class lists. It is
+   * not held while user objects are created or called. */
+  pthread_mutex_t by_type_lock;
+  c_avl_tree_t *by_type_tree;
+
+  lookup_class_callback_t cb_user_class;
+  lookup_obj_callback_t cb_user_obj;
+  lookup_free_class_callback_t cb_free_class;
+  lookup_free_obj_callback_t cb_free_obj;
+
+  /* Direct mapped cache: an identifier can only be stored in the slot
+   * determined by its hash, a colliding identifier replaces the entry. */
+  lu_cache_entry_t **cache;
+  size_t cache_size;
+  pthread_mutex_t cache_locks[LU_CACHE_LOCKS_NUM];
+  /* Incremented by lookup_add() while holding all cache locks. Entries with
+   * an older generation are stale. */
+  unsigned int cache_generation;
+};
+
 /*
  * Private functions
  */
@@ -285,12 +346,35 @@ static user_obj_t *lu_find_user_obj (user_class_t *user_class, /* {{{ */
   return (NULL);
 } /* }}} user_obj_t *lu_find_user_obj */
 
+static int lu_call_user_obj (lookup_t *obj, /* {{{ */
+    data_set_t const *ds, value_list_t const *vl,
+    user_class_t *user_class, user_obj_t *user_obj)
+{
+  int status;
+
+  status = obj->cb_user_obj (ds, vl,
+      user_class->user_class, user_obj->user_obj);
+  if (status != 0)
+  {
+    ERROR ("utils_vl_lookup: The user object callback failed with status %i.",
+        status);
+    /* Returning a negative value means: abort! */
+    if (status < 0)
+      return (status);
+    else
+      return (1);
+  }
+
+  return (0);
+} /* }}} int lu_call_user_obj */
+
+/* If the value list matches the user class, the user object is appended to
+ * "match_list". */
 static int lu_handle_user_class (lookup_t *obj, /* {{{ */
     data_set_t const *ds, value_list_t const *vl,
-    user_class_t *user_class)
+    user_class_t *user_class, lu_match_list_t *match_list)
 {
   user_obj_t *user_obj;
-  int status;
 
   assert (strcmp (vl->type, user_class->match.type.str) == 0);
   assert (user_class->match.plugin.is_regex
@@ -315,25 +399,28 @@ static int lu_handle_user_class (lookup_t *obj, /* {{{ */
   }
   pthread_mutex_unlock (&user_class->lock);
 
-  status = obj->cb_user_obj (ds, vl,
-      user_class->user_class, user_obj->user_obj);
-  if (status != 0)
+  if (match_list->matches_num < LU_CACHE_MAX_MATCHES)
   {
-    ERROR ("utils_vl_lookup: The user object callback failed with status %i.",
-        status);
-    /* Returning a negative value means: abort! */
-    if (status < 0)
-      return (status);
-    else
-      return (1);
+    lu_match_t *m = match_list->matches + match_list->matches_num;
+    m->user_class = user_class;
+    m->user_obj = user_obj;
+    match_list->matches_num++;
+  }
+  else
+  {
+    match_list->overflow = 1;
   }
 
-  return (0);
+  return (lu_call_user_obj (obj, ds, vl, user_class, user_obj));
 } /* }}} int lu_handle_user_class */
 
+/* obj->by_type_lock must be held when calling this function. It is released
+ * while each user class is handled and held again when the function returns.
+ * This is safe because user classes are only ever appended to the list and
+ * are not freed before lookup_destroy(). */
 static int lu_handle_user_class_list (lookup_t *obj, /* {{{ */
     data_set_t const *ds, value_list_t const *vl,
-    user_class_list_t *user_class_list)
+    user_class_list_t *user_class_list, lu_match_list_t *match_list)
 {
   user_class_list_t *ptr;
   int retval = 0;
@@ -342,7 +429,9 @@ static int lu_handle_user_class_list (lookup_t *obj, /* {{{ */
   {
     int status;
 
-    status = lu_handle_user_class (obj, ds, vl, &ptr->entry);
+    pthread_mutex_unlock (&obj->by_type_lock);
+    status = lu_handle_user_class (obj, ds, vl, &ptr->entry, match_list);
+    pthread_mutex_lock (&obj->by_type_lock);
     if (status < 0)
       return (status);
     else if (status == 0)
@@ -536,6 +625,178 @@ static void lu_destroy_by_type (lookup_t *obj, /* {{{ */
   sfree (by_type);
 } /* }}} int lu_destroy_by_type */
 
+/* Serializes the identifier of "vl" into "buffer", separating the fields
+ * with null bytes. Returns the number of bytes used. */
+static size_t lu_cache_key (char *buffer, size_t buffer_size, /* {{{ */
+    value_list_t const *vl)
+{
+  char const *fields[] = { vl->host, vl->plugin, vl->plugin_instance,
+    vl->type, vl->type_instance };
+  size_t offset = 0;
+  size_t i;
+
+  for (i = 0; i < STATIC_ARRAY_SIZE (fields); i++)
+  {
+    size_t len = strnlen (fields[i], DATA_MAX_NAME_LEN - 1);
+
+    assert ((offset + len + 1) <= buffer_size);
+    memcpy (buffer + offset, fields[i], len);
+    offset += len;
+    buffer[offset] = 0;
+    offset++;
+  }
+
+  return (offset);
+} /* }}} size_t lu_cache_key */
+
+/* 32 bit FNV-1a hash */
+static uint32_t lu_cache_hash (char const *key, size_t key_len) /* {{{ */
+{
+  uint32_t hash = 2166136261U;
+  size_t i;
+
+  for (i = 0; i < key_len; i++)
+  {
+    hash ^= (uint32_t) ((unsigned char) key[i]);
+    hash *= 16777619U;
+  }
+
+  return (hash);
+} /* }}} uint32_t lu_cache_hash */
+
+static void lu_cache_entry_free (lu_cache_entry_t *ce) /* {{{ */
+{
+  if (ce == NULL)
+    return;
+
+  sfree (ce->matches);
+  sfree (ce);
+} /* }}} void lu_cache_entry_free */
+
+/* Removes all entries from the cache. All cache locks must be held. */
+static void lu_cache_clear (lookup_t *obj) /* {{{ */
+{
+  size_t i;
+
+  for (i = 0; i < obj->cache_size; i++)
+  {
+    lu_cache_entry_free (obj->cache[i]);
+    obj->cache[i] = NULL;
+  }
+} /* }}} void lu_cache_clear */
+
+static void lu_cache_lock_all (lookup_t *obj) /* {{{ */
+{
+  size_t i;
+
+  for (i = 0; i < LU_CACHE_LOCKS_NUM; i++)
+    pthread_mutex_lock (&obj->cache_locks[i]);
+} /* }}} void lu_cache_lock_all */
+
+static void lu_cache_unlock_all (lookup_t *obj) /* {{{ */
+{
+  size_t i;
+
+  for (i = LU_CACHE_LOCKS_NUM; i > 0; i--)
+    pthread_mutex_unlock (&obj->cache_locks[i - 1]);
+} /* }}} void lu_cache_unlock_all */
+
+/* Looks up "key" in the cache and copies the matches into "match_list".
+ * Returns zero on cache hit and ENOENT otherwise. In the latter case,
+ * "ret_generation" is set to the cache generation the caller must pass to
+ * lu_cache_insert(). */
+static int lu_cache_get (lookup_t *obj, /* {{{ */
+    char const *key, size_t key_len, uint32_t hash,
+    lu_match_list_t *match_list, unsigned int *ret_generation)
+{
+  size_t slot = (size_t) (hash % obj->cache_size);
+  pthread_mutex_t *lock = obj->cache_locks + (slot % LU_CACHE_LOCKS_NUM);
+  lu_cache_entry_t *ce;
+  int status = ENOENT;
+
+  pthread_mutex_lock (lock);
+
+  *ret_generation = obj->cache_generation;
+
+  ce = obj->cache[slot];
+  if ((ce != NULL)
+      && (ce->generation == obj->cache_generation)
+      && (ce->hash == hash)
+      && (ce->key_len == key_len)
+      && (memcmp (ce->key, key, key_len) == 0))
+  {
+    assert (ce->matches_num <= LU_CACHE_MAX_MATCHES);
+    if (ce->matches_num > 0)
+      memcpy (match_list->matches, ce->matches,
+          ce->matches_num * sizeof (*ce->matches));
+    match_list->matches_num = ce->matches_num;
+    status = 0;
+  }
+
+  pthread_mutex_unlock (lock);
+
+  return (status);
+} /* }}} int lu_cache_get */
+
+static void lu_cache_insert (lookup_t *obj, /* {{{ */
+    char const *key, size_t key_len, uint32_t hash,
+    lu_match_list_t const *match_list, unsigned int generation)
+{
+  size_t slot = (size_t) (hash % obj->cache_size);
+  pthread_mutex_t *lock = obj->cache_locks + (slot % LU_CACHE_LOCKS_NUM);
+  lu_cache_entry_t *ce;
+  lu_match_t *matches = NULL;
+
+  if (match_list->overflow)
+    return;
+
+  if (match_list->matches_num > 0)
+  {
+    matches = calloc (match_list->matches_num, sizeof (*matches));
+    if (matches == NULL)
+      return;
+    memcpy (matches, match_list->matches,
+        match_list->matches_num * sizeof (*matches));
+  }
+
+  pthread_mutex_lock (lock);
+
+  /* lookup_add() was called since the lookup was done; the result may be
+   * incomplete. */
+  if (generation != obj->cache_generation)
+  {
+    pthread_mutex_unlock (lock);
+    sfree (matches);
+    return;
+  }
+
+  ce = obj->cache[slot];
+  if (ce == NULL)
+  {
+    ce = malloc (sizeof (*ce));
+    if (ce == NULL)
+    {
+      pthread_mutex_unlock (lock);
+      sfree (matches);
+      return;
+    }
+    memset (ce, 0, sizeof (*ce));
+    obj->cache[slot] = ce;
+  }
+
+  assert (key_len <= sizeof (ce->key));
+  memcpy (ce->key, key, key_len);
+  ce->key_len = key_len;
+  ce->hash = hash;
+  ce->generation = generation;
+
+  sfree (ce->matches);
+  ce->matches = matches;
+  ce->matches_num = match_list->matches_num;
+
+  pthread_mutex_unlock (lock);
+} /* }}} void lu_cache_insert */
+
 /*
  * Public functions
  */
@@ -545,6 +806,8 @@ lookup_t *lookup_create (lookup_class_callback_t cb_user_class, /* {{{ */
     lookup_free_obj_callback_t cb_free_obj)
 {
   lookup_t *obj = malloc (sizeof (*obj));
+  size_t i;
+
   if (obj == NULL)
   {
     ERROR ("utils_vl_lookup: malloc failed.");
@@ -559,6 +822,21 @@ lookup_t *lookup_create (lookup_class_callback_t cb_user_class, /* {{{ */
     sfree (obj);
     return (NULL);
   }
+  pthread_mutex_init (&obj->by_type_lock, /* attr = */ NULL);
+
+  obj->cache_size = LU_CACHE_SIZE_DEFAULT;
+  obj->cache = calloc (obj->cache_size, sizeof (*obj->cache));
+  if (obj->cache == NULL)
+  {
+    ERROR ("utils_vl_lookup: calloc failed.");
+    pthread_mutex_destroy (&obj->by_type_lock);
+    c_avl_destroy (obj->by_type_tree);
+    sfree (obj);
+    return (NULL);
+  }
+
+  for (i = 0; i < LU_CACHE_LOCKS_NUM; i++)
+    pthread_mutex_init (&obj->cache_locks[i], /* attr = */ NULL);
 
   obj->cb_user_class = cb_user_class;
   obj->cb_user_obj = cb_user_obj;
@@ -570,11 +848,17 @@ lookup_t *lookup_create (lookup_class_callback_t cb_user_class, /* {{{ */
 
 void lookup_destroy (lookup_t *obj) /* {{{ */
 {
+  size_t i;
   int status;
 
   if (obj == NULL)
     return;
 
+  lu_cache_clear (obj);
+  sfree (obj->cache);
+  for (i = 0; i < LU_CACHE_LOCKS_NUM; i++)
+    pthread_mutex_destroy (&obj->cache_locks[i]);
+
   while (42)
   {
     char *type = NULL;
@@ -591,23 +875,59 @@ void lookup_destroy (lookup_t *obj) /* {{{ */
 
   c_avl_destroy (obj->by_type_tree);
   obj->by_type_tree = NULL;
+  pthread_mutex_destroy (&obj->by_type_lock);
 
   sfree (obj);
 } /* }}} void lookup_destroy */
 
+int lookup_set_cache_size (lookup_t *obj, size_t cache_size) /* {{{ */
+{
+  lu_cache_entry_t **cache = NULL;
+
+  if (obj == NULL)
+    return (EINVAL);
+
+  if (cache_size > 0)
+  {
+    cache = calloc (cache_size, sizeof (*cache));
+    if (cache == NULL)
+    {
+      ERROR ("utils_vl_lookup: calloc failed.");
+      return (ENOMEM);
+    }
+  }
+
+  lu_cache_lock_all (obj);
+  lu_cache_clear (obj);
+  sfree (obj->cache);
+  obj->cache = cache;
+  obj->cache_size = cache_size;
+  obj->cache_generation++;
+  lu_cache_unlock_all (obj);
+
+  return (0);
+} /* }}} int lookup_set_cache_size */
+
 int lookup_add (lookup_t *obj, /* {{{ */
     identifier_t const *ident, unsigned int group_by, void *user_class)
 {
   by_type_entry_t *by_type = NULL;
   user_class_list_t *user_class_obj;
+  int status;
+
+  pthread_mutex_lock (&obj->by_type_lock);
 
   by_type = lu_search_by_type (obj, ident->type, /* allocate = */ 1);
   if (by_type == NULL)
+  {
+    pthread_mutex_unlock (&obj->by_type_lock);
     return (-1);
+  }
 
   user_class_obj = malloc (sizeof (*user_class_obj));
   if (user_class_obj == NULL)
   {
+    pthread_mutex_unlock (&obj->by_type_lock);
     ERROR ("utils_vl_lookup: malloc failed.");
     return (ENOMEM);
   }
@@ -618,7 +938,19 @@ int lookup_add (lookup_t *obj, /* {{{ */
   user_class_obj->entry.user_obj_list = NULL;
   user_class_obj->next = NULL;
 
-  return (lu_add_by_plugin (by_type, user_class_obj));
+  status = lu_add_by_plugin (by_type, user_class_obj);
+
+  pthread_mutex_unlock (&obj->by_type_lock);
+
+  /* Cached results, including negative ones, may be invalidated by the new
+   * user class. Lookups that were started before this point will not insert
+   * their result into the cache because the generation has changed. */
+  lu_cache_lock_all (obj);
+  lu_cache_clear (obj);
+  obj->cache_generation++;
+  lu_cache_unlock_all (obj);
+
+  return (status);
 } /* }}} int lookup_add */
 
 /* returns the number of successful calls to the callback function */
@@ -627,34 +959,85 @@ int lookup_search (lookup_t *obj, /* {{{ */
 {
   by_type_entry_t *by_type = NULL;
   user_class_list_t *user_class_list = NULL;
+  lu_match_list_t match_list;
+  char key[5 * DATA_MAX_NAME_LEN];
+  size_t key_len = 0;
+  uint32_t hash = 0;
+  unsigned int generation = 0;
   int retval = 0;
   int status;
 
   if ((obj == NULL) || (ds == NULL) || (vl == NULL))
     return (-EINVAL);
 
+  memset (&match_list, 0, sizeof (match_list));
+
+  if (obj->cache_size > 0)
+  {
+    size_t i;
+
+    key_len = lu_cache_key (key, sizeof (key), vl);
+    hash = lu_cache_hash (key, key_len);
+
+    status = lu_cache_get (obj, key, key_len, hash, &match_list, &generation);
+    if (status == 0)
+    {
+      for (i = 0; i < match_list.matches_num; i++)
+      {
+        status = lu_call_user_obj (obj, ds, vl,
+            match_list.matches[i].user_class,
+            match_list.matches[i].user_obj);
+        if (status < 0)
+          return (status);
+        else if (status == 0)
+          retval++;
+      }
+
+      return (retval);
+    }
+  }
+
+  pthread_mutex_lock (&obj->by_type_lock);
+
   by_type = lu_search_by_type (obj, vl->type, /* allocate = */ 0);
   if (by_type == NULL)
+  {
+    pthread_mutex_unlock (&obj->by_type_lock);
+    if (obj->cache_size > 0)
+      lu_cache_insert (obj, key, key_len, hash, &match_list, generation);
     return (0);
+  }
 
   status = c_avl_get (by_type->by_plugin_tree,
       vl->plugin, (void *) &user_class_list);
   if (status == 0)
   {
-    status = lu_handle_user_class_list (obj, ds, vl, user_class_list);
+    status = lu_handle_user_class_list (obj, ds, vl, user_class_list,
+        &match_list);
     if (status < 0)
+    {
+      pthread_mutex_unlock (&obj->by_type_lock);
       return (status);
+    }
     retval += status;
   }
 
   if (by_type->wildcard_plugin_list != NULL)
   {
     status = lu_handle_user_class_list (obj, ds, vl,
-        by_type->wildcard_plugin_list);
+        by_type->wildcard_plugin_list, &match_list);
     if (status < 0)
+    {
+      pthread_mutex_unlock (&obj->by_type_lock);
       return (status);
+    }
     retval += status;
   }
-    
+
+  pthread_mutex_unlock (&obj->by_type_lock);
+
+  if (obj->cache_size > 0)
+    lu_cache_insert (obj, key, key_len, hash, &match_list, generation);
+
   return (retval);
 } /* }}} lookup_search */
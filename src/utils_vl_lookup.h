@@ -79,6 +79,12 @@ lookup_t *lookup_create (lookup_class_callback_t,
     lookup_free_obj_callback_t);
 void lookup_destroy (lookup_t *obj);
 
+/* Sets the number of slots in the cache which maps identifiers to the user
+ * objects they were handed to before. Zero disables the cache. Must not be
+ * called while other threads use lookup_search(). */
+int lookup_set_cache_size (lookup_t *obj, size_t cache_size);
+
+/* Adds a user class. May be called while other threads use lookup_search(). */
 int lookup_add (lookup_t *obj,
     identifier_t const *ident, unsigned int group_by, void *user_class);
 
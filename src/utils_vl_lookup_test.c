@@ -28,6 +28,8 @@
 #include "testing.h"
 #include "utils_vl_lookup.h"
 
+#include <pthread.h>
+
 static _Bool expect_new_obj = 0;
 static _Bool have_new_obj = 0;
 
@@ -237,12 +239,265 @@ DEF_TEST(regex)
   return (0);
 }
 
+/*
+ * Concurrency test: several threads look up the same identifiers, so that
+ * both cached and uncached lookups, including negative results, happen in
+ * parallel. Meanwhile another thread adds user classes.
+ */
+#define CONCURRENT_THREADS_NUM 4
+#define CONCURRENT_HOSTS_NUM 16
+#define CONCURRENT_ITERATIONS 200
+#define CONCURRENT_LATE_NUM 8
+
+struct concurrent_obj_s
+{
+  char host[DATA_MAX_NAME_LEN];
+  int hits;
+};
+typedef struct concurrent_obj_s concurrent_obj_t;
+
+static pthread_mutex_t concurrent_lock = PTHREAD_MUTEX_INITIALIZER;
+static int concurrent_objs_num = 0;
+static int concurrent_hits_num = 0;
+static int concurrent_errors_num = 0;
+/* number of "late" user classes added by concurrent_add_thread() */
+static int concurrent_late_num = 0;
+/* user class of the "late" user classes; the "match" user class is NULL */
+static char concurrent_late_class[] = "late";
+
+static void *concurrent_class_callback (data_set_t const *ds,
+    value_list_t const *vl, void *user_class)
+{
+  concurrent_obj_t *obj;
+
+  obj = calloc (1, sizeof (*obj));
+  strncpy (obj->host, vl->host, sizeof (obj->host));
+
+  if (user_class != NULL)
+    return ((void *) obj);
+
+  pthread_mutex_lock (&concurrent_lock);
+  concurrent_objs_num++;
+  pthread_mutex_unlock (&concurrent_lock);
+
+  return ((void *) obj);
+}
+
+static int concurrent_obj_callback (data_set_t const *ds,
+    value_list_t const *vl,
+    void *user_class, void *user_obj)
+{
+  concurrent_obj_t *obj = user_obj;
+
+  pthread_mutex_lock (&concurrent_lock);
+  if (strcmp (obj->host, vl->host) != 0)
+    concurrent_errors_num++;
+  obj->hits++;
+  if (user_class == NULL)
+    concurrent_hits_num++;
+  pthread_mutex_unlock (&concurrent_lock);
+
+  return (0);
+}
+
+static int concurrent_search (lookup_t *obj, char const *host,
+    char const *plugin)
+{
+  value_list_t vl = VALUE_LIST_STATIC;
+
+  strncpy (vl.host, host, sizeof (vl.host));
+  strncpy (vl.plugin, plugin, sizeof (vl.plugin));
+  strncpy (vl.type, "test", sizeof (vl.type));
+  strncpy (vl.type_instance, "0", sizeof (vl.type_instance));
+
+  return (lookup_search (obj, &ds_test, &vl));
+}
+
+static void *concurrent_thread (void *arg)
+{
+  lookup_t *obj = arg;
+  int i;
+  int j;
+
+  for (i = 0; i < CONCURRENT_ITERATIONS; i++)
+  {
+    for (j = 0; j < CONCURRENT_HOSTS_NUM; j++)
+    {
+      char host[DATA_MAX_NAME_LEN];
+      char plugin[DATA_MAX_NAME_LEN];
+      int late = j % CONCURRENT_LATE_NUM;
+      int late_num;
+      int late_status;
+      int status;
+
+      snprintf (host, sizeof (host), "host%i", j);
+      snprintf (plugin, sizeof (plugin), "late%i", late);
+
+      /* matches one user class */
+      status = concurrent_search (obj, host, "match");
+      /* matches nothing, i.e. a negative cache entry */
+      status += 10 * concurrent_search (obj, host, "nomatch");
+
+      /* matches nothing until concurrent_add_thread() has added the user
+       * class, one user class afterwards */
+      pthread_mutex_lock (&concurrent_lock);
+      late_num = concurrent_late_num;
+      pthread_mutex_unlock (&concurrent_lock);
+      late_status = concurrent_search (obj, host, plugin);
+
+      if ((status != 1)
+          || ((late < late_num) && (late_status != 1))
+          || ((late_status != 0) && (late_status != 1)))
+      {
+        pthread_mutex_lock (&concurrent_lock);
+        concurrent_errors_num++;
+        pthread_mutex_unlock (&concurrent_lock);
+      }
+    }
+  }
+
+  return (NULL);
+}
+
+static int concurrent_hits (void)
+{
+  int hits;
+
+  pthread_mutex_lock (&concurrent_lock);
+  hits = concurrent_hits_num;
+  pthread_mutex_unlock (&concurrent_lock);
+
+  return (hits);
+}
+
+static void *concurrent_add_thread (void *arg)
+{
+  lookup_t *obj = arg;
+  identifier_t ident;
+  int i;
+
+  memset (&ident, 0, sizeof (ident));
+  strncpy (ident.host, "/.*/", sizeof (ident.host));
+  strncpy (ident.plugin_instance, "", sizeof (ident.plugin_instance));
+  strncpy (ident.type, "test", sizeof (ident.type));
+  strncpy (ident.type_instance, "/.*/", sizeof (ident.type_instance));
+
+  for (i = 0; i < CONCURRENT_LATE_NUM; i++)
+  {
+    int status;
+
+    /* spread the additions over the run of the search threads */
+    while (concurrent_hits () < (i * CONCURRENT_THREADS_NUM
+          * CONCURRENT_ITERATIONS * CONCURRENT_HOSTS_NUM) / CONCURRENT_LATE_NUM)
+      usleep (100);
+
+    snprintf (ident.plugin, sizeof (ident.plugin), "late%i", i);
+    status = lookup_add (obj, &ident, LU_GROUP_BY_HOST, concurrent_late_class);
+
+    /* appended to the wildcard list, matches nothing that is looked up */
+    if ((status == 0) && (i == CONCURRENT_LATE_NUM / 2))
+    {
+      strncpy (ident.plugin, "/^wildcard/", sizeof (ident.plugin));
+      status = lookup_add (obj, &ident, LU_GROUP_BY_HOST,
+          concurrent_late_class);
+    }
+
+    pthread_mutex_lock (&concurrent_lock);
+    if (status != 0)
+      concurrent_errors_num++;
+    else
+      concurrent_late_num++;
+    pthread_mutex_unlock (&concurrent_lock);
+  }
+
+  return (NULL);
+}
+
+static int run_concurrent_test (size_t cache_size)
+{
+  pthread_t threads[CONCURRENT_THREADS_NUM];
+  pthread_t add_thread;
+  identifier_t ident;
+  lookup_t *obj;
+  int status;
+  int i;
+
+  concurrent_objs_num = 0;
+  concurrent_hits_num = 0;
+  concurrent_errors_num = 0;
+  concurrent_late_num = 0;
+
+  CHECK_NOT_NULL (obj = lookup_create (concurrent_class_callback,
+        concurrent_obj_callback, /* free class = */ NULL, (void *) free));
+  CHECK_ZERO (lookup_set_cache_size (obj, cache_size));
+
+  memset (&ident, 0, sizeof (ident));
+  strncpy (ident.host, "/.*/", sizeof (ident.host));
+  strncpy (ident.plugin, "match", sizeof (ident.plugin));
+  strncpy (ident.plugin_instance, "", sizeof (ident.plugin_instance));
+  strncpy (ident.type, "test", sizeof (ident.type));
+  strncpy (ident.type_instance, "/.*/", sizeof (ident.type_instance));
+  CHECK_ZERO (lookup_add (obj, &ident, LU_GROUP_BY_HOST, /* user class = */ NULL));
+
+  CHECK_ZERO (pthread_create (&add_thread, NULL, concurrent_add_thread, obj));
+  for (i = 0; i < CONCURRENT_THREADS_NUM; i++)
+    CHECK_ZERO (pthread_create (threads + i, NULL, concurrent_thread, obj));
+  for (i = 0; i < CONCURRENT_THREADS_NUM; i++)
+    CHECK_ZERO (pthread_join (threads[i], NULL));
+  CHECK_ZERO (pthread_join (add_thread, NULL));
+
+  EXPECT_EQ_INT (0, concurrent_errors_num);
+  EXPECT_EQ_INT (CONCURRENT_LATE_NUM, concurrent_late_num);
+  for (i = 0; i < CONCURRENT_LATE_NUM; i++)
+  {
+    char plugin[DATA_MAX_NAME_LEN];
+
+    snprintf (plugin, sizeof (plugin), "late%i", i);
+    status = concurrent_search (obj, "host0", plugin);
+    EXPECT_EQ_INT (1, status);
+  }
+  EXPECT_EQ_INT (CONCURRENT_HOSTS_NUM, concurrent_objs_num);
+  EXPECT_EQ_INT (CONCURRENT_THREADS_NUM * CONCURRENT_ITERATIONS
+      * CONCURRENT_HOSTS_NUM, concurrent_hits_num);
+
+  /* Adding a user class must invalidate the negative entries. */
+  strncpy (ident.plugin, "nomatch", sizeof (ident.plugin));
+  CHECK_ZERO (lookup_add (obj, &ident, LU_GROUP_BY_HOST, /* user class = */ NULL));
+
+  status = concurrent_search (obj, "host0", "nomatch");
+  EXPECT_EQ_INT (1, status);
+  EXPECT_EQ_INT (CONCURRENT_HOSTS_NUM + 1, concurrent_objs_num);
+  status = concurrent_search (obj, "host0", "nomatch");
+  EXPECT_EQ_INT (1, status);
+  EXPECT_EQ_INT (CONCURRENT_HOSTS_NUM + 1, concurrent_objs_num);
+  EXPECT_EQ_INT (0, concurrent_errors_num);
+
+  lookup_destroy (obj);
+  return (0);
+}
+
+DEF_TEST(concurrent_cache)
+{
+  /* large cache: every identifier gets its own slot */
+  if (run_concurrent_test (4096) != 0)
+    return (-1);
+  /* tiny cache: entries are replaced all the time */
+  if (run_concurrent_test (3) != 0)
+    return (-1);
+  /* no cache */
+  if (run_concurrent_test (0) != 0)
+    return (-1);
+
+  return (0);
+}
+
 int main (int argc, char **argv) /* {{{ */
 {
   RUN_TEST(group_by_specific_host);
   RUN_TEST(group_by_any_host);
   RUN_TEST(multiple_lookups);
   RUN_TEST(regex);
+  RUN_TEST(concurrent_cache);
 
   END_TEST;
 } /* }}} int main */
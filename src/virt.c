@@ -25,6 +25,9 @@
 #include "configfile.h"
 #include "utils_ignorelist.h"
 #include "utils_complain.h"
+#include "utils_avltree.h"
+
+#include <pthread.h>
 
 #include <libvirt/libvirt.h>
 #include <libvirt/virterror.h>
@@ -35,6 +38,20 @@
 /* Plugin name */
 #define PLUGIN_NAME "virt"
 
+/* virDomainListGetStats is available since libvirt 1.2.8, the DEVICE_ADDED
+ * event since 1.2.15. */
+#ifdef LIBVIR_CHECK_VERSION
+# if LIBVIR_CHECK_VERSION(1,2,8)
+#  define HAVE_BULK_STATS 1
+# endif
+# if LIBVIR_CHECK_VERSION(1,2,15)
+#  define HAVE_DEVICE_EVENTS 1
+# endif
+#endif
+
+/* Number of value lists collected before they are dispatched at once. */
+#define LV_BATCH_SIZE 256
+
 static const char *config_keys[] = {
     "Connection",
 
@@ -50,6 +67,8 @@ static const char *config_keys[] = {
 
     "PluginInstanceFormat",
 
+    "BulkStats",
+
     NULL
 };
 #define NR_CONFIG_KEYS ((sizeof config_keys / sizeof config_keys[0]) - 1)
@@ -59,9 +78,23 @@ static virConnectPtr conn = 0;
 static char *conn_string = NULL;
 static c_complain_t conn_complain = C_COMPLAIN_INIT_STATIC;
 
-/* Seconds between list refreshes, 0 disables completely. */
+/* Seconds between list refreshes, 0 disables completely. Not used while
+ * domain lifecycle and device events are received. */
 static int interval = 60;
 
+/* Use virDomainListGetStats to query all domains with a single call. */
+static _Bool bulk_stats = 0;
+
+/* Event loop for domain lifecycle events. `domains_changed' is set by the
+ * event loop thread and causes the lists to be refreshed on the next read. */
+static _Bool event_loop_running = 0;
+static _Bool event_loop_failed = 0;
+static pthread_t event_loop_thread;
+static int event_loop_timer = -1;
+static int event_callbacks[3] = { -1, -1, -1 };
+static _Bool domains_changed = 0;
+static pthread_mutex_t event_lock = PTHREAD_MUTEX_INITIALIZER;
+
 /* List of domains, if specified. */
 static ignorelist_t *il_domains = NULL;
 /* List of block devices, if specified. */
@@ -72,10 +105,24 @@ static ignorelist_t *il_interface_devices = NULL;
 static int ignore_device_match (ignorelist_t *,
                                 const char *domname, const char *devpath);
 
-/* Actual list of domains found on last refresh. */
+/* Actual list of domains found on last refresh. The list is terminated by a
+ * NULL pointer, as required by virDomainListGetStats. */
 static virDomainPtr *domains = NULL;
 static int nr_domains = 0;
 
+/* Devices of each domain in `domains', as ranges of `block_devices' and
+ * `interface_devices'. */
+struct domain_devices {
+    int first_block;
+    int nr_block;
+    int first_interface;
+    int nr_interface;
+};
+static struct domain_devices *domain_devices = NULL;
+
+/* Maps domain names to their index in `domains'. */
+static c_avl_tree_t *domain_tree = NULL;
+
 static void free_domains (void);
 static int add_domain (virDomainPtr dom);
 
@@ -142,6 +189,11 @@ static enum if_field interface_format = if_name;
 /* Time that we last refreshed. */
 static time_t last_refresh = (time_t) 0;
 
+/* Value lists waiting to be dispatched with plugin_dispatch_values_list. */
+static value_list_t lv_batch[LV_BATCH_SIZE];
+static value_t lv_batch_values[LV_BATCH_SIZE][2];
+static size_t lv_batch_num = 0;
+
 static int refresh_lists (void);
 
 /* ERROR(...) macro for virterrors. */
@@ -223,6 +275,36 @@ init_value_list (value_list_t *vl, virDomainPtr dom)
 
 } /* void init_value_list */
 
+static void
+lv_batch_flush (void)
+{
+    if (lv_batch_num == 0)
+        return;
+
+    plugin_dispatch_values_list (lv_batch, lv_batch_num);
+    lv_batch_num = 0;
+} /* void lv_batch_flush */
+
+/* Queues a copy of the value list. The queued value lists are dispatched
+ * together by lv_batch_flush, which locks the write queue only once. */
+static void
+lv_dispatch (value_list_t const *vl)
+{
+    value_list_t *dst;
+
+    assert (vl->values_len <= STATIC_ARRAY_SIZE (lv_batch_values[0]));
+
+    if (lv_batch_num >= LV_BATCH_SIZE)
+        lv_batch_flush ();
+
+    dst = lv_batch + lv_batch_num;
+    memcpy (dst, vl, sizeof (*dst));
+    memcpy (lv_batch_values[lv_batch_num], vl->values,
+            vl->values_len * sizeof (vl->values[0]));
+    dst->values = lv_batch_values[lv_batch_num];
+    lv_batch_num++;
+} /* void lv_dispatch */
+
 static void
 memory_submit (gauge_t memory, virDomainPtr dom)
 {
@@ -239,7 +321,7 @@ memory_submit (gauge_t memory, virDomainPtr dom)
     sstrncpy (vl.type, "memory", sizeof (vl.type));
     sstrncpy (vl.type_instance, "total", sizeof (vl.type_instance));
 
-    plugin_dispatch_values (&vl);
+    lv_dispatch (&vl);
 }
 
 static void
@@ -261,7 +343,7 @@ memory_stats_submit (gauge_t memory, virDomainPtr dom, int tag_index)
     sstrncpy (vl.type, "memory", sizeof (vl.type));
     sstrncpy (vl.type_instance, tags[tag_index], sizeof (vl.type_instance));
 
-    plugin_dispatch_values (&vl);
+    lv_dispatch (&vl);
 }
 
 static void
@@ -280,7 +362,7 @@ cpu_submit (unsigned long long cpu_time,
 
     sstrncpy (vl.type, type, sizeof (vl.type));
 
-    plugin_dispatch_values (&vl);
+    lv_dispatch (&vl);
 }
 
 static void
@@ -299,7 +381,7 @@ vcpu_submit (derive_t cpu_time,
     sstrncpy (vl.type, type, sizeof (vl.type));
     ssnprintf (vl.type_instance, sizeof (vl.type_instance), "%d", vcpu_nr);
 
-    plugin_dispatch_values (&vl);
+    lv_dispatch (&vl);
 }
 
 static void
@@ -319,18 +401,153 @@ submit_derive2 (const char *type, derive_t v0, derive_t v1,
     sstrncpy (vl.type, type, sizeof (vl.type));
     sstrncpy (vl.type_instance, devname, sizeof (vl.type_instance));
 
-    plugin_dispatch_values (&vl);
+    lv_dispatch (&vl);
 } /* void submit_derive2 */
 
+static void
+lv_set_domains_changed (void)
+{
+    pthread_mutex_lock (&event_lock);
+    domains_changed = 1;
+    pthread_mutex_unlock (&event_lock);
+} /* void lv_set_domains_changed */
+
+static int
+lv_lifecycle_event (virConnectPtr __attribute__((unused)) c,
+        virDomainPtr __attribute__((unused)) dom, int event,
+        int __attribute__((unused)) detail,
+        void __attribute__((unused)) *opaque)
+{
+    /* Only running domains are in the lists. */
+    if ((event == VIR_DOMAIN_EVENT_STARTED)
+            || (event == VIR_DOMAIN_EVENT_STOPPED))
+        lv_set_domains_changed ();
+    return 0;
+} /* int lv_lifecycle_event */
+
+#if HAVE_DEVICE_EVENTS
+static void
+lv_device_event (virConnectPtr __attribute__((unused)) c,
+        virDomainPtr __attribute__((unused)) dom,
+        const char __attribute__((unused)) *dev_alias,
+        void __attribute__((unused)) *opaque)
+{
+    lv_set_domains_changed ();
+} /* void lv_device_event */
+#endif
+
+static void
+lv_event_loop_wakeup (int __attribute__((unused)) timer,
+        void __attribute__((unused)) *opaque)
+{
+    /* Only used to make virEventRunDefaultImpl return. */
+    virEventUpdateTimeout (event_loop_timer, -1);
+} /* void lv_event_loop_wakeup */
+
+static void *
+lv_event_loop (void __attribute__((unused)) *arg)
+{
+    while (event_loop_running) {
+        if (virEventRunDefaultImpl () != 0) {
+            VIRT_ERROR (NULL, "virEventRunDefaultImpl");
+            break;
+        }
+    }
+
+    /* Without events, the lists are refreshed every RefreshInterval seconds
+     * again. */
+    pthread_mutex_lock (&event_lock);
+    event_loop_failed = 1;
+    pthread_mutex_unlock (&event_lock);
+    return NULL;
+} /* void *lv_event_loop */
+
 static int
 lv_init (void)
 {
+    int status;
+
     if (virInitialize () != 0)
         return -1;
-    else
+
+    /* The event implementation has to be registered before a connection is
+     * opened. If this fails, the lists are refreshed periodically. */
+    if (event_loop_running)
+        return 0;
+
+    if (virEventRegisterDefaultImpl () != 0) {
+        VIRT_ERROR (NULL, "virEventRegisterDefaultImpl");
         return 0;
+    }
+
+    event_loop_timer = virEventAddTimeout (/* timeout = */ -1,
+            lv_event_loop_wakeup, /* opaque = */ NULL, /* ff = */ NULL);
+
+    event_loop_running = 1;
+    status = plugin_thread_create (&event_loop_thread, /* attr = */ NULL,
+            lv_event_loop, /* arg = */ NULL);
+    if (status != 0) {
+        char errbuf[1024];
+        ERROR (PLUGIN_NAME " plugin: pthread_create failed: %s",
+                sstrerror (status, errbuf, sizeof (errbuf)));
+        event_loop_running = 0;
+    }
+
+    return 0;
 }
 
+static void
+lv_register_events (void)
+{
+    pthread_mutex_lock (&event_lock);
+    if (!event_loop_running || event_loop_failed) {
+        pthread_mutex_unlock (&event_lock);
+        return;
+    }
+    pthread_mutex_unlock (&event_lock);
+
+    event_callbacks[0] = virConnectDomainEventRegisterAny (conn,
+            /* dom = */ NULL, VIR_DOMAIN_EVENT_ID_LIFECYCLE,
+            VIR_DOMAIN_EVENT_CALLBACK (lv_lifecycle_event),
+            /* opaque = */ NULL, /* freecb = */ NULL);
+    if (event_callbacks[0] < 0) {
+        VIRT_ERROR (conn, "Registering for lifecycle events");
+        return;
+    }
+
+#if HAVE_DEVICE_EVENTS
+    event_callbacks[1] = virConnectDomainEventRegisterAny (conn,
+            /* dom = */ NULL, VIR_DOMAIN_EVENT_ID_DEVICE_ADDED,
+            VIR_DOMAIN_EVENT_CALLBACK (lv_device_event),
+            /* opaque = */ NULL, /* freecb = */ NULL);
+    event_callbacks[2] = virConnectDomainEventRegisterAny (conn,
+            /* dom = */ NULL, VIR_DOMAIN_EVENT_ID_DEVICE_REMOVED,
+            VIR_DOMAIN_EVENT_CALLBACK (lv_device_event),
+            /* opaque = */ NULL, /* freecb = */ NULL);
+#endif
+} /* void lv_register_events */
+
+static void
+lv_disconnect (void)
+{
+    size_t i;
+
+    if (conn == NULL)
+        return;
+
+    for (i = 0; i < STATIC_ARRAY_SIZE (event_callbacks); i++) {
+        if (event_callbacks[i] >= 0)
+            virConnectDomainEventDeregisterAny (conn, event_callbacks[i]);
+        event_callbacks[i] = -1;
+    }
+
+    virConnectClose (conn);
+    conn = NULL;
+
+    /* Refresh the lists after reconnecting. */
+    last_refresh = (time_t) 0;
+} /* void lv_disconnect */
+
 static int
 lv_config (const char *key, const char *value)
 {
@@ -470,6 +687,17 @@ lv_config (const char *key, const char *value)
         return 0;
     }
 
+    if (strcasecmp (key, "BulkStats") == 0) {
+#if HAVE_BULK_STATS
+        bulk_stats = IS_TRUE (value) ? 1 : 0;
+#else
+        if (IS_TRUE (value))
+            WARNING (PLUGIN_NAME " plugin: BulkStats requires libvirt 1.2.8 "
+                    "or later. The option will be ignored.");
+#endif
+        return 0;
+    }
+
     if (strcasecmp (key, "InterfaceFormat") == 0) {
         if (strcasecmp (value, "name") == 0)
             interface_format = if_name;
@@ -488,11 +716,219 @@ lv_config (const char *key, const char *value)
     return -1;
 }
 
+#if HAVE_BULK_STATS
+/* Maps the tags used by virDomainMemoryStats, i.e. the indexes of the tags in
+ * memory_stats_submit, to the names of the bulk stats fields. */
+static const char *balloon_fields[] = {
+    "balloon.swap_in", "balloon.swap_out", "balloon.major_fault",
+    "balloon.minor_fault", "balloon.unused", "balloon.available",
+    "balloon.current", "balloon.rss"
+};
+
+static int
+lv_get_ullong (virDomainStatsRecordPtr record, const char *name,
+        unsigned long long *ret_value)
+{
+    return (virTypedParamsGetULLong (record->params, record->nparams,
+                name, ret_value) == 1) ? 0 : -1;
+} /* int lv_get_ullong */
+
+static int
+lv_get_ullong2 (virDomainStatsRecordPtr record, const char *prefix,
+        size_t index, const char *field0, const char *field1,
+        derive_t *ret_v0, derive_t *ret_v1)
+{
+    char name[64];
+    unsigned long long v0, v1;
+
+    ssnprintf (name, sizeof (name), "%s.%zu.%s", prefix, index, field0);
+    if (lv_get_ullong (record, name, &v0) != 0)
+        return -1;
+
+    ssnprintf (name, sizeof (name), "%s.%zu.%s", prefix, index, field1);
+    if (lv_get_ullong (record, name, &v1) != 0)
+        return -1;
+
+    *ret_v0 = (derive_t) v0;
+    *ret_v1 = (derive_t) v1;
+    return 0;
+} /* int lv_get_ullong2 */
+
+static void
+lv_submit_record (virDomainStatsRecordPtr record)
+{
+    virDomainPtr dom;
+    struct domain_devices *devs;
+    const char *name;
+    void *index;
+    unsigned long long v;
+    unsigned int count;
+    int state;
+    size_t i;
+    int j;
+
+    /* The records have their own domain objects, so find ours by name. */
+    name = virDomainGetName (record->dom);
+    if ((name == NULL) || (domain_tree == NULL)
+            || (c_avl_get (domain_tree, name, &index) != 0))
+        return;
+    dom = domains[(intptr_t) index];
+    devs = domain_devices + (intptr_t) index;
+
+    /* only gather stats for running domains */
+    if ((virTypedParamsGetInt (record->params, record->nparams,
+                    "state.state", &state) != 1)
+            || (state != VIR_DOMAIN_RUNNING))
+        return;
+
+    if (lv_get_ullong (record, "cpu.time", &v) == 0)
+        cpu_submit (v, dom, "virt_cpu_total");
+
+    if (lv_get_ullong (record, "balloon.current", &v) == 0)
+        memory_submit ((gauge_t) v * 1024, dom);
+
+    for (i = 0; i < STATIC_ARRAY_SIZE (balloon_fields); i++)
+        if (lv_get_ullong (record, balloon_fields[i], &v) == 0)
+            memory_stats_submit ((gauge_t) v * 1024, dom, (int) i);
+
+    count = 0;
+    virTypedParamsGetUInt (record->params, record->nparams,
+            "vcpu.current", &count);
+    for (i = 0; i < count; i++) {
+        char field[64];
+
+        ssnprintf (field, sizeof (field), "vcpu.%zu.time", i);
+        if (lv_get_ullong (record, field, &v) == 0)
+            vcpu_submit ((derive_t) v, dom, (int) i, "virt_vcpu");
+    }
+
+    count = 0;
+    virTypedParamsGetUInt (record->params, record->nparams,
+            "block.count", &count);
+    for (i = 0; i < count; i++) {
+        struct block_device *bd = NULL;
+        const char *dev = NULL;
+        char field[64];
+        derive_t v0, v1;
+
+        ssnprintf (field, sizeof (field), "block.%zu.name", i);
+        if (virTypedParamsGetString (record->params, record->nparams,
+                    field, &dev) != 1)
+            continue;
+
+        /* Only devices in the list, i.e. not ignored, are reported. */
+        for (j = devs->first_block; j < devs->first_block + devs->nr_block; j++)
+            if (strcmp (block_devices[j].path, dev) == 0)
+                bd = block_devices + j;
+        if (bd == NULL)
+            continue;
+
+        if (lv_get_ullong2 (record, "block", i, "rd.reqs", "wr.reqs",
+                    &v0, &v1) == 0)
+            submit_derive2 ("disk_ops", v0, v1, dom, bd->path);
+
+        if (lv_get_ullong2 (record, "block", i, "rd.bytes", "wr.bytes",
+                    &v0, &v1) == 0)
+            submit_derive2 ("disk_octets", v0, v1, dom, bd->path);
+    }
+
+    count = 0;
+    virTypedParamsGetUInt (record->params, record->nparams,
+            "net.count", &count);
+    for (i = 0; i < count; i++) {
+        struct interface_device *id = NULL;
+        const char *dev = NULL;
+        char *display_name;
+        char field[64];
+        derive_t v0, v1;
+
+        ssnprintf (field, sizeof (field), "net.%zu.name", i);
+        if (virTypedParamsGetString (record->params, record->nparams,
+                    field, &dev) != 1)
+            continue;
+
+        for (j = devs->first_interface;
+                j < devs->first_interface + devs->nr_interface; j++)
+            if (strcmp (interface_devices[j].path, dev) == 0)
+                id = interface_devices + j;
+        if (id == NULL)
+            continue;
+
+        switch (interface_format) {
+            case if_address:
+                display_name = id->address;
+                break;
+            case if_number:
+                display_name = id->number;
+                break;
+            case if_name:
+            default:
+                display_name = id->path;
+        }
+
+        if (lv_get_ullong2 (record, "net", i, "rx.bytes", "tx.bytes",
+                    &v0, &v1) == 0)
+            submit_derive2 ("if_octets", v0, v1, dom, display_name);
+
+        if (lv_get_ullong2 (record, "net", i, "rx.pkts", "tx.pkts",
+                    &v0, &v1) == 0)
+            submit_derive2 ("if_packets", v0, v1, dom, display_name);
+
+        if (lv_get_ullong2 (record, "net", i, "rx.errs", "tx.errs",
+                    &v0, &v1) == 0)
+            submit_derive2 ("if_errors", v0, v1, dom, display_name);
+
+        if (lv_get_ullong2 (record, "net", i, "rx.drop", "tx.drop",
+                    &v0, &v1) == 0)
+            submit_derive2 ("if_dropped", v0, v1, dom, display_name);
+    }
+} /* void lv_submit_record */
+
+/* Queries the stats of all domains in the list with a single call. */
+static int
+lv_read_bulk (void)
+{
+    virDomainStatsRecordPtr *records = NULL;
+    unsigned int stats = VIR_DOMAIN_STATS_STATE | VIR_DOMAIN_STATS_CPU_TOTAL
+        | VIR_DOMAIN_STATS_BALLOON | VIR_DOMAIN_STATS_VCPU
+        | VIR_DOMAIN_STATS_INTERFACE | VIR_DOMAIN_STATS_BLOCK;
+    int n;
+    int i;
+
+    if (nr_domains == 0)
+        return 0;
+
+    n = virDomainListGetStats (domains, stats, &records, /* flags = */ 0);
+    if (n < 0) {
+        virErrorPtr err = virConnGetLastError (conn);
+
+        if ((err != NULL) && (err->code == VIR_ERR_NO_SUPPORT)) {
+            WARNING (PLUGIN_NAME " plugin: The hypervisor does not support "
+                    "bulk stats. Disabling BulkStats.");
+            bulk_stats = 0;
+        } else {
+            VIRT_ERROR (conn, "virDomainListGetStats");
+            /* Maybe a domain went away. */
+            lv_set_domains_changed ();
+        }
+        return -1;
+    }
+
+    for (i = 0; i < n; i++)
+        lv_submit_record (records[i]);
+
+    virDomainStatsRecordListFree (records);
+    return 0;
+} /* int lv_read_bulk */
+#endif /* HAVE_BULK_STATS */
+
 static int
 lv_read (void)
 {
     time_t t;
     int i;
+    _Bool changed;
+    _Bool have_events;
 
     if (conn == NULL) {
         /* `conn_string == NULL' is acceptable. */
@@ -503,24 +939,46 @@ lv_read (void)
                     "virConnectOpenReadOnly failed.");
             return -1;
         }
+        lv_register_events ();
     }
     c_release (LOG_NOTICE, &conn_complain,
             PLUGIN_NAME " plugin: Connection established.");
 
     time (&t);
 
-    /* Need to refresh domain or device lists? */
-    if ((last_refresh == (time_t) 0) ||
-            ((interval > 0) && ((last_refresh + interval) <= t))) {
+    pthread_mutex_lock (&event_lock);
+    changed = domains_changed;
+    domains_changed = 0;
+#if HAVE_DEVICE_EVENTS
+    have_events = (event_callbacks[0] >= 0) && (event_callbacks[1] >= 0)
+        && (event_callbacks[2] >= 0) && !event_loop_failed;
+#else
+    /* Hot-plugged devices are only noticed by refreshing. */
+    have_events = 0;
+#endif
+    pthread_mutex_unlock (&event_lock);
+
+    /* Need to refresh domain or device lists? While lifecycle and device
+     * events are received, the lists are only refreshed when domains or
+     * their devices change. */
+    if ((last_refresh == (time_t) 0) || changed
+            || (!have_events && (interval > 0)
+                && ((last_refresh + interval) <= t))) {
         if (refresh_lists () != 0) {
-            if (conn != NULL)
-                virConnectClose (conn);
-            conn = NULL;
+            lv_disconnect ();
             return -1;
         }
         last_refresh = t;
     }
 
+#if HAVE_BULK_STATS
+    /* Fall back to querying each domain if bulk stats fail. */
+    if (bulk_stats && (lv_read_bulk () == 0)) {
+        lv_batch_flush ();
+        return 0;
+    }
+#endif
+
 #if 0
     for (i = 0; i < nr_domains; ++i)
         fprintf (stderr, "domain %s\n", virDomainGetName (domains[i]));
@@ -667,6 +1125,7 @@ lv_read (void)
 		    interface_devices[i].dom, display_name);
     } /* for (nr_interface_devices) */
 
+    lv_batch_flush ();
     return 0;
 }
 
@@ -681,6 +1140,10 @@ refresh_lists (void)
         return -1;
     }
 
+    free_block_devices ();
+    free_interface_devices ();
+    free_domains ();
+
     if (n > 0) {
         int i;
         int *domids;
@@ -699,10 +1162,6 @@ refresh_lists (void)
             return -1;
         }
 
-        free_block_devices ();
-        free_interface_devices ();
-        free_domains ();
-
         /* Fetch each domain and add it to the list, unless ignore. */
         for (i = 0; i < n; ++i) {
             virDomainPtr dom = NULL;
@@ -711,6 +1170,7 @@ refresh_lists (void)
             xmlDocPtr xml_doc = NULL;
             xmlXPathContextPtr xpath_ctx = NULL;
             xmlXPathObjectPtr xpath_obj = NULL;
+            int dom_index = -1;
             int j;
 
             dom = virDomainLookupByID (conn, domids[i]);
@@ -729,7 +1189,8 @@ refresh_lists (void)
             if (il_domains && ignorelist_match (il_domains, name) != 0)
                 goto cont;
 
-            if (add_domain (dom) < 0) {
+            dom_index = add_domain (dom);
+            if (dom_index < 0) {
                 ERROR (PLUGIN_NAME " plugin: malloc failed.");
                 goto cont;
             }
@@ -820,6 +1281,14 @@ refresh_lists (void)
             }
 
         cont:
+            if (dom_index >= 0) {
+                struct domain_devices *devs = domain_devices + dom_index;
+                devs->nr_block = nr_block_devices - devs->first_block;
+                devs->nr_interface = nr_interface_devices - devs->first_interface;
+            } else {
+                /* The domain is not in the list, e.g. because it is ignored. */
+                virDomainFree (dom);
+            }
             if (xpath_obj) xmlXPathFreeObject (xpath_obj);
             if (xpath_ctx) xmlXPathFreeContext (xpath_ctx);
             if (xml_doc) xmlFreeDoc (xml_doc);
@@ -829,6 +1298,17 @@ refresh_lists (void)
         sfree (domids);
     }
 
+    domain_tree = c_avl_create ((void *) strcmp);
+    if (domain_tree != NULL) {
+        int i;
+
+        for (i = 0; i < nr_domains; ++i) {
+            const char *name = virDomainGetName (domains[i]);
+            if (name != NULL)
+                c_avl_insert (domain_tree, (void *) name, (void *) (intptr_t) i);
+        }
+    }
+
     return 0;
 }
 
@@ -837,12 +1317,21 @@ free_domains (void)
 {
     int i;
 
+    if (domain_tree) {
+        void *key, *value;
+        while (c_avl_pick (domain_tree, &key, &value) == 0)
+            /* The keys are owned by the domain objects. */;
+        c_avl_destroy (domain_tree);
+    }
+    domain_tree = NULL;
+
     if (domains) {
         for (i = 0; i < nr_domains; ++i)
             virDomainFree (domains[i]);
         sfree (domains);
     }
     domains = NULL;
+    sfree (domain_devices);
     nr_domains = 0;
 }
 
@@ -850,7 +1339,9 @@ static int
 add_domain (virDomainPtr dom)
 {
     virDomainPtr *new_ptr;
-    int new_size = sizeof (domains[0]) * (nr_domains+1);
+    struct domain_devices *new_devices;
+    /* One more for the terminating NULL pointer. */
+    int new_size = sizeof (domains[0]) * (nr_domains+2);
 
     if (domains)
         new_ptr = realloc (domains, new_size);
@@ -859,9 +1350,22 @@ add_domain (virDomainPtr dom)
 
     if (new_ptr == NULL)
         return -1;
-
     domains = new_ptr;
+
+    new_devices = realloc (domain_devices,
+            sizeof (domain_devices[0]) * (nr_domains+1));
+    if (new_devices == NULL) {
+        domains[nr_domains] = NULL;
+        return -1;
+    }
+    domain_devices = new_devices;
+
     domains[nr_domains] = dom;
+    domains[nr_domains+1] = NULL;
+    domain_devices[nr_domains].first_block = nr_block_devices;
+    domain_devices[nr_domains].nr_block = 0;
+    domain_devices[nr_domains].first_interface = nr_interface_devices;
+    domain_devices[nr_domains].nr_interface = 0;
     return nr_domains++;
 }
 
@@ -989,9 +1493,16 @@ lv_shutdown (void)
     free_interface_devices ();
     free_domains ();
 
-    if (conn != NULL)
-        virConnectClose (conn);
-    conn = NULL;
+    lv_disconnect ();
+
+    if (event_loop_running) {
+        event_loop_running = 0;
+        virEventUpdateTimeout (event_loop_timer, 0);
+        pthread_join (event_loop_thread, /* retval = */ NULL);
+    }
+    if (event_loop_timer >= 0)
+        virEventRemoveTimeout (event_loop_timer);
+    event_loop_timer = -1;
 
     ignorelist_free (il_domains);
     il_domains = NULL;